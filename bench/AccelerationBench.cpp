@@ -0,0 +1,218 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <Piper/Render/Acceleration.hpp>
+#include <Piper/Render/BenchUtil.hpp>
+#include <Piper/Render/SamplingUtil.hpp>
+#include <Piper/Render/Shape.hpp>
+
+PIPER_NAMESPACE_BEGIN
+
+Ref<AccelerationBuilder> createEmbreeBackend(const BuildSettings& sceneSettings, const BuildSettings& shapeSettings);
+
+// the hits only carry the geometric attributes, so the shading cost is excluded
+class BenchShape final : public Shape {
+    Ref<PrimitiveGroup> mPrimitiveGroup;
+
+public:
+    void bind(Ref<PrimitiveGroup> group) noexcept {
+        mPrimitiveGroup = std::move(group);
+    }
+    void updateTransform(const KeyFrames&, TimeInterval) override {}
+    [[nodiscard]] PrimitiveGroup* primitiveGroup() const noexcept override {
+        return mPrimitiveGroup.get();
+    }
+    Intersection generateIntersection(const Ray& ray, const Distance hitDistance,
+                                      const AffineTransform<FrameOfReference::Object, FrameOfReference::World>&,
+                                      const Normal<FrameOfReference::World>& geometryNormal, const glm::vec2 barycentric,
+                                      const uint32_t primitiveIndex) const noexcept override {
+        return SurfaceHit{ ray.origin + ray.direction * hitDistance,
+                           hitDistance,
+                           geometryNormal,
+                           geometryNormal,
+                           Direction<FrameOfReference::World>::fromRaw(glm::vec3{ 1.0f, 0.0f, 0.0f }),
+                           primitiveIndex,
+                           barycentric,
+                           barycentric,
+                           ray.t,
+                           0.0f,
+                           0.0f,
+                           Handle<Material>{} };
+    }
+};
+
+// A bumpy height field over [0, 1]^2 in the XY plane, the primary rays look down at it from a pinhole above.
+class SyntheticScene final {
+    static constexpr uint32_t resolution = 512;
+
+    std::vector<glm::vec3> mVertices;
+    std::vector<glm::uvec3> mIndices;
+    Ref<AccelerationBuilder> mBuilder;
+    Ref<BottomLevelGeometry> mGeometry;
+    Ref<BenchShape> mShape;
+    Ref<Acceleration> mAcceleration;
+
+public:
+    SyntheticScene() {
+        // NOTICE: the vertex buffer must be readable for 4 more bytes past the last vertex
+        mVertices.reserve((resolution + 1) * (resolution + 1) + 1);
+        for(uint32_t y = 0; y <= resolution; ++y)
+            for(uint32_t x = 0; x <= resolution; ++x) {
+                const auto u = static_cast<Float>(x) / resolution, v = static_cast<Float>(y) / resolution;
+                mVertices.emplace_back(u, v, 0.05f * std::sin(40.0f * u) * std::cos(30.0f * v));
+            }
+        mVertices.emplace_back(0.0f);
+        mIndices.reserve(2ULL * resolution * resolution);
+        for(uint32_t y = 0; y < resolution; ++y)
+            for(uint32_t x = 0; x < resolution; ++x) {
+                const auto base = y * (resolution + 1) + x;
+                mIndices.emplace_back(base, base + 1, base + resolution + 1);
+                mIndices.emplace_back(base + 1, base + resolution + 2, base + resolution + 1);
+            }
+
+        const BuildSettings settings{ BuildQuality::High, false, false, false };
+        mBuilder = createEmbreeBackend(settings, settings);
+        mGeometry = mBuilder->buildFromTriangleMesh({ mVertices.data(), mVertices.size() - 1 }, mIndices, settings);
+        mShape = makeRefCount<BenchShape>();
+        mShape->bind(mBuilder->buildInstance(mGeometry, *mShape));
+
+        ShutterKeyFrames transform{ context().globalAllocator };
+        transform.push_back({ glm::vec3{ 1.0f }, glm::identity<glm::quat>(), glm::zero<glm::vec3>() });
+        mShape->primitiveGroup()->updateTransform(transform);
+        mShape->primitiveGroup()->commit();
+
+        std::pmr::vector<PrimitiveGroup*> groups{ { mShape->primitiveGroup() }, context().globalAllocator };
+        mAcceleration = mBuilder->buildScene(groups);
+        mAcceleration->commit();
+        mAcceleration->swap();
+    }
+
+    [[nodiscard]] const Acceleration& acceleration() const noexcept {
+        return *mAcceleration;
+    }
+
+    // the rays of a 16x16 tile are adjacent, the consecutive tiles are scattered over the height field
+    [[nodiscard]] static RayStream primaryRays(const uint32_t count) {
+        auto& sampler = getBenchSampler();
+        RayStream res{ context().globalAllocator };
+        res.reserve(count);
+        const auto origin = Point<FrameOfReference::World>::fromRaw(glm::vec3{ 0.5f, 0.5f, 2.0f });
+        for(uint32_t base = 0; base < count; base += 256) {
+            const auto tile = sampler.sampleVec2() * 0.9f;
+            for(uint32_t idx = base; idx < std::min(count, base + 256); ++idx) {
+                const auto pixel = tile + glm::vec2{ static_cast<Float>(idx & 15), static_cast<Float>((idx >> 4) & 15) } * (0.1f / 16.0f);
+                const auto target = glm::vec3{ pixel, 0.0f };
+                res.push_back(Ray{ origin, Direction<FrameOfReference::World>::fromRaw(glm::normalize(target - origin.raw())), 0.0f });
+            }
+        }
+        return res;
+    }
+
+    // the origins are spread over the bounding box of the height field and the directions are uniform
+    [[nodiscard]] static RayStream incoherentRays(const uint32_t count) {
+        auto& sampler = getBenchSampler();
+        RayStream res{ context().globalAllocator };
+        res.reserve(count);
+        for(uint32_t idx = 0; idx < count; ++idx) {
+            const auto origin = glm::vec3{ sampler.sampleVec2(), 0.05f + 0.1f * sampler.sample() };
+            res.push_back(Ray{ Point<FrameOfReference::World>::fromRaw(origin),
+                               sampleUniformSphere<FrameOfReference::World>(sampler.sampleVec2()), 0.0f });
+        }
+        return res;
+    }
+};
+
+static const SyntheticScene& getSyntheticScene() {
+    static SyntheticScene scene;
+    return scene;
+}
+
+static void benchEmbreeTrace(benchmark::State& state) {
+    const auto& acceleration = getSyntheticScene().acceleration();
+    const auto rays = SyntheticScene::incoherentRays(benchInputCount);
+    uint32_t idx = 0;
+    for(auto _ : state)
+        benchmark::DoNotOptimize(acceleration.trace(rays[idx++ & benchInputMask]));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(benchEmbreeTrace);
+
+// Arg: the number of rays in the stream
+static void benchEmbreeTracePrimary(benchmark::State& state) {
+    const auto& acceleration = getSyntheticScene().acceleration();
+    const auto rays = SyntheticScene::primaryRays(static_cast<uint32_t>(state.range(0)));
+    MemoryArena arena;
+    for(auto _ : state) {
+        ArenaRewindScope scope;
+        benchmark::DoNotOptimize(acceleration.tracePrimary(rays));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(benchEmbreeTracePrimary)->Arg(256)->Arg(4096);
+
+// the compact hit records without the surface reconstruction
+static void benchEmbreeTraceHits(benchmark::State& state) {
+    const auto& acceleration = getSyntheticScene().acceleration();
+    const auto rays = SyntheticScene::primaryRays(static_cast<uint32_t>(state.range(0)));
+    MemoryArena arena;
+    for(auto _ : state) {
+        ArenaRewindScope scope;
+        benchmark::DoNotOptimize(acceleration.traceHits(rays, true));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(benchEmbreeTraceHits)->Arg(256)->Arg(4096);
+
+static void benchEmbreeTraceStream(benchmark::State& state) {
+    const auto& acceleration = getSyntheticScene().acceleration();
+    const auto rays = SyntheticScene::incoherentRays(static_cast<uint32_t>(state.range(0)));
+    MemoryArena arena;
+    for(auto _ : state) {
+        ArenaRewindScope scope;
+        benchmark::DoNotOptimize(acceleration.trace(rays));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(benchEmbreeTraceStream)->Arg(256)->Arg(4096);
+
+static void benchEmbreeOccluded(benchmark::State& state) {
+    const auto& acceleration = getSyntheticScene().acceleration();
+    const auto rays = SyntheticScene::incoherentRays(benchInputCount);
+    uint32_t idx = 0;
+    for(auto _ : state)
+        benchmark::DoNotOptimize(acceleration.occluded(rays[idx++ & benchInputMask], Distance::fromRaw(0.5f)));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(benchEmbreeOccluded);
+
+static void benchEmbreeOccludedStream(benchmark::State& state) {
+    const auto& acceleration = getSyntheticScene().acceleration();
+    const auto count = static_cast<uint32_t>(state.range(0));
+    const auto rays = SyntheticScene::incoherentRays(count);
+    const std::pmr::vector<Distance> distances(count, Distance::fromRaw(0.5f), context().globalAllocator);
+    MemoryArena arena;
+    for(auto _ : state) {
+        ArenaRewindScope scope;
+        benchmark::DoNotOptimize(acceleration.occluded(rays, distances));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(benchEmbreeOccludedStream)->Arg(256)->Arg(4096);
+
+PIPER_NAMESPACE_END
@@ -0,0 +1,75 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <Piper/Core/StaticFactory.hpp>
+#include <Piper/Render/BenchUtil.hpp>
+#include <Piper/Render/Material.hpp>
+#include <Piper/Render/RenderGlobalSetting.hpp>
+#include <Piper/Render/SamplingUtil.hpp>
+
+PIPER_NAMESPACE_BEGIN
+
+constexpr auto diffuseConfig = R"({ "Type": "Diffuse", "Reflectance": { "Type": "MonoSpectrumTexture", "Value": 0.8 } })";
+constexpr auto dielectricConfig = R"({ "Type": "Dielectric", "Material": "GlassBK7", "Roughness": 0.3, "RemapRoughness": true })";
+constexpr auto conductorConfig = R"({ "Type": "Conductor", "Material": "Cu", "Roughness": 0.3, "RemapRoughness": true })";
+constexpr auto conductorAnisotropicConfig =
+    R"({ "Type": "Conductor", "Material": "Cu", "RoughnessU": 0.3, "RoughnessV": 0.5, "RemapRoughness": true })";
+
+static std::vector<Direction<FrameOfReference::World>> generateDirections() {
+    auto& sampler = getBenchSampler();
+    std::vector<Direction<FrameOfReference::World>> res;
+    res.reserve(benchInputCount);
+    for(uint32_t idx = 0; idx < benchInputCount; ++idx)
+        res.push_back(sampleUniformSphere<FrameOfReference::World>(sampler.sampleVec2()));
+    return res;
+}
+
+static void benchBSDFSample(benchmark::State& state, const std::string_view config) {
+    const auto material = getStaticFactory().make<Material<RSSRGB>>(parseJSONConfigNodeFromStr(config, {}));
+    const auto bsdf = material->evaluate(std::monostate{}, makeBenchSurfaceHit(Handle<Material>{ material.get() }));
+    const auto wo = generateDirections();
+    auto& sampler = getBenchSampler();
+    uint32_t idx = 0;
+    for(auto _ : state)
+        benchmark::DoNotOptimize(bsdf.sample(sampler, wo[idx++ & benchInputMask]));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(benchBSDFSample, Diffuse, diffuseConfig);
+BENCHMARK_CAPTURE(benchBSDFSample, DielectricRough, dielectricConfig);
+BENCHMARK_CAPTURE(benchBSDFSample, ConductorRough, conductorConfig);
+BENCHMARK_CAPTURE(benchBSDFSample, ConductorAnisotropicRough, conductorAnisotropicConfig);
+
+static void benchBSDFEvaluate(benchmark::State& state, const std::string_view config) {
+    const auto material = getStaticFactory().make<Material<RSSRGB>>(parseJSONConfigNodeFromStr(config, {}));
+    const auto bsdf = material->evaluate(std::monostate{}, makeBenchSurfaceHit(Handle<Material>{ material.get() }));
+    const auto wo = generateDirections();
+    const auto wi = generateDirections();
+    uint32_t idx = 0;
+    for(auto _ : state) {
+        benchmark::DoNotOptimize(bsdf.evaluate(wo[idx & benchInputMask], wi[(idx * 7 + 3) & benchInputMask]));
+        ++idx;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(benchBSDFEvaluate, Diffuse, diffuseConfig);
+BENCHMARK_CAPTURE(benchBSDFEvaluate, DielectricRough, dielectricConfig);
+BENCHMARK_CAPTURE(benchBSDFEvaluate, ConductorRough, conductorConfig);
+BENCHMARK_CAPTURE(benchBSDFEvaluate, ConductorAnisotropicRough, conductorAnisotropicConfig);
+
+PIPER_NAMESPACE_END
@@ -0,0 +1,45 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <Piper/Render/BenchUtil.hpp>
+
+PIPER_NAMESPACE_BEGIN
+
+SampleProvider& getBenchSampler() noexcept {
+    static MemoryArena arena;
+    static SampleProvider sampler{ {}, seeding(seeding(1ULL)) };
+    return sampler;
+}
+
+SurfaceHit makeBenchSurfaceHit(const Handle<Material> surface) noexcept {
+    return SurfaceHit{ Point<FrameOfReference::World>::fromRaw(glm::zero<glm::vec3>()),
+                       Distance::fromRaw(10.0f),
+                       Normal<FrameOfReference::World>::fromRaw(glm::vec3{ 0.0f, 1.0f, 0.0f }),
+                       Normal<FrameOfReference::World>::fromRaw(glm::vec3{ 0.0f, 1.0f, 0.0f }),
+                       Direction<FrameOfReference::World>::fromRaw(glm::vec3{ 1.0f, 0.0f, 0.0f }),
+                       0,
+                       glm::zero<glm::vec2>(),
+                       glm::zero<glm::vec2>(),
+                       0.0f,
+                       0.0f,
+                       0.0f,
+                       surface };
+}
+
+PIPER_NAMESPACE_END
@@ -0,0 +1,44 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <Piper/Core/StaticFactory.hpp>
+#include <Piper/Render/BenchUtil.hpp>
+#include <Piper/Render/Filter.hpp>
+
+PIPER_NAMESPACE_BEGIN
+
+static void benchFilterEvaluate(benchmark::State& state, const std::string_view config) {
+    const auto filter = getStaticFactory().make<Filter>(parseJSONConfigNodeFromStr(config, {}));
+    auto& sampler = getBenchSampler();
+    std::vector<glm::vec2> offsets(benchInputCount);
+    for(auto& offset : offsets)
+        offset = (sampler.sampleVec2() * 2.0f - 1.0f) * filter->radius();
+    uint32_t idx = 0;
+    for(auto _ : state) {
+        const auto offset = offsets[idx++ & benchInputMask];
+        benchmark::DoNotOptimize(filter->evaluate(offset.x, offset.y));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(benchFilterEvaluate, Box, R"({ "Type": "BoxFilter" })");
+BENCHMARK_CAPTURE(benchFilterEvaluate, Triangle, R"({ "Type": "TriangleFilter" })");
+BENCHMARK_CAPTURE(benchFilterEvaluate, Gaussian, R"({ "Type": "GaussianFilter", "Alpha": 2.0 })");
+BENCHMARK_CAPTURE(benchFilterEvaluate, Lanczos, R"({ "Type": "LanczosFilter", "Radius": 3.0 })");
+
+PIPER_NAMESPACE_END
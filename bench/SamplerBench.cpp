@@ -0,0 +1,102 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <Piper/Core/StaticFactory.hpp>
+#include <Piper/Render/BenchUtil.hpp>
+#include <Piper/Render/Sampler.hpp>
+
+PIPER_NAMESPACE_BEGIN
+
+static Ref<TileSampler> prepareSobolSampler(const bool lazy) {
+    const auto sampler = getStaticFactory().make<Sampler>(parseJSONConfigNodeFromStr(
+        fmt::format(R"({{ "Type": "SobolSampler", "SampleCount": 64, "LazyGeneration": {} }})", lazy), {}));
+    return sampler->prepare(0, 1024, 1024, 1);
+}
+
+// Arg(0): eager generation of all dimensions, Arg(1): lazy generation
+static void benchSobolTileSamplerGenerate(benchmark::State& state) {
+    const auto tileSampler = prepareSobolSampler(state.range(0) != 0);
+    MemoryArena arena;
+    uint32_t idx = 0;
+    for(auto _ : state) {
+        ArenaRewindScope scope;
+        auto [pixelSample, provider] = tileSampler->generate(idx & 1023, (idx >> 10) & 1023, (idx >> 20) & 63);
+        benchmark::DoNotOptimize(pixelSample);
+        benchmark::DoNotOptimize(provider.sample());
+        ++idx;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(benchSobolTileSamplerGenerate)->Arg(0)->Arg(1);
+
+// the lazy sample provider refills 16 dimensions at a time by sobolKernel
+static void benchSobolKernel(benchmark::State& state) {
+    const auto tileSampler = prepareSobolSampler(true);
+    const auto& generator = dynamic_cast<const SampleGenerator&>(*tileSampler);
+    const auto dims = static_cast<uint32_t>(state.range(0));
+    std::vector<Float> samples(dims);
+    uint32_t idx = 0;
+    for(auto _ : state) {
+        generator.generate(idx++, 0, dims, samples.data());
+        benchmark::DoNotOptimize(samples.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * dims);
+}
+BENCHMARK(benchSobolKernel)->Arg(16)->Arg(256);
+
+// Arg(0): white noise rotation, Arg(1): blue noise rotation. 16 dimensions are consumed to cover one refill
+static void benchPMJ02TileSamplerGenerate(benchmark::State& state) {
+    const auto sampler = getStaticFactory().make<Sampler>(parseJSONConfigNodeFromStr(
+        fmt::format(R"({{ "Type": "PMJ02Sampler", "SampleCount": 64, "BlueNoise": {} }})", state.range(0) != 0), {}));
+    const auto tileSampler = sampler->prepare(0, 1024, 1024, 1);
+    MemoryArena arena;
+    uint32_t idx = 0;
+    for(auto _ : state) {
+        ArenaRewindScope scope;
+        auto [pixelSample, provider] = tileSampler->generate(idx & 1023, (idx >> 10) & 1023, (idx >> 20) & 63);
+        benchmark::DoNotOptimize(pixelSample);
+        for(uint32_t dim = 0; dim < 16; ++dim)
+            benchmark::DoNotOptimize(provider.sample());
+        ++idx;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(benchPMJ02TileSamplerGenerate)->Arg(0)->Arg(1);
+
+// the Morton index is scrambled per dimension pair, the per-frame setup is free
+static void benchZSobolTileSamplerGenerate(benchmark::State& state) {
+    const auto sampler =
+        getStaticFactory().make<Sampler>(parseJSONConfigNodeFromStr(R"({ "Type": "ZSobolSampler", "SampleCount": 64 })", {}));
+    const auto tileSampler = sampler->prepare(0, 1024, 1024, 1);
+    MemoryArena arena;
+    uint32_t idx = 0;
+    for(auto _ : state) {
+        ArenaRewindScope scope;
+        auto [pixelSample, provider] = tileSampler->generate(idx & 1023, (idx >> 10) & 1023, (idx >> 20) & 63);
+        benchmark::DoNotOptimize(pixelSample);
+        for(uint32_t dim = 0; dim < 16; ++dim)
+            benchmark::DoNotOptimize(provider.sample());
+        ++idx;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(benchZSobolTileSamplerGenerate);
+
+PIPER_NAMESPACE_END
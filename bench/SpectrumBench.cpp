@@ -0,0 +1,82 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <Piper/Render/BenchUtil.hpp>
+#include <Piper/Render/Spectrum.hpp>
+#include <Piper/Render/SpectrumUtil.hpp>
+
+PIPER_NAMESPACE_BEGIN
+
+// the hero wavelengths are equally spaced over the visible range
+static std::vector<SampledSpectrum> generateWavelengths() {
+    auto& sampler = getBenchSampler();
+    constexpr auto nSamples = SampledSpectrum::nSamples;
+    const auto stride = static_cast<Float>(wavelengthMax - wavelengthMin) / static_cast<Float>(nSamples);
+    std::vector<SampledSpectrum> res;
+    res.reserve(benchInputCount);
+    for(uint32_t idx = 0; idx < benchInputCount; ++idx) {
+        const auto base = static_cast<Float>(wavelengthMin) + sampler.sample() * stride;
+        auto lambda = undefined<SampledSpectrum::VecType>();
+        for(int32_t sampleIdx = 0; sampleIdx < nSamples; ++sampleIdx)
+            lambda[sampleIdx] = base + static_cast<Float>(sampleIdx) * stride;
+        res.push_back(SampledSpectrum::fromRaw(lambda));
+    }
+    return res;
+}
+
+static std::vector<RGBSpectrum> generateColors() {
+    auto& sampler = getBenchSampler();
+    std::vector<RGBSpectrum> res;
+    res.reserve(benchInputCount);
+    for(uint32_t idx = 0; idx < benchInputCount; ++idx)
+        res.push_back(RGBSpectrum::fromRaw({ sampler.sample(), sampler.sample(), sampler.sample() }));
+    return res;
+}
+
+static void benchToRGB(benchmark::State& state) {
+    const auto wavelengths = generateWavelengths();
+    auto& sampler = getBenchSampler();
+    std::vector<SampledSpectrum> values;
+    values.reserve(benchInputCount);
+    for(uint32_t idx = 0; idx < benchInputCount; ++idx)
+        values.push_back(spectrumCast<SampledSpectrum>(RGBSpectrum::fromRaw({ sampler.sample(), sampler.sample(), sampler.sample() }),
+                                                       wavelengths[idx]));
+    uint32_t idx = 0;
+    for(auto _ : state) {
+        const auto sel = idx++ & benchInputMask;
+        benchmark::DoNotOptimize(toRGB(values[sel], wavelengths[sel]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(benchToRGB);
+
+// the RGB to spectrum upsampling by the rgb2spec table
+static void benchSpectrumCastRGBToSampled(benchmark::State& state) {
+    const auto wavelengths = generateWavelengths();
+    const auto colors = generateColors();
+    uint32_t idx = 0;
+    for(auto _ : state) {
+        const auto sel = idx++ & benchInputMask;
+        benchmark::DoNotOptimize(spectrumCast<SampledSpectrum>(colors[sel], wavelengths[sel]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(benchSpectrumCastRGBToSampled);
+
+PIPER_NAMESPACE_END
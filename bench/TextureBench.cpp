@@ -0,0 +1,65 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <Piper/Core/StaticFactory.hpp>
+#include <Piper/Render/BenchUtil.hpp>
+#include <Piper/Render/Texture.hpp>
+
+PIPER_NAMESPACE_BEGIN
+
+static std::vector<TextureEvaluateInfo> generateLookups() {
+    auto& sampler = getBenchSampler();
+    std::vector<TextureEvaluateInfo> res;
+    res.reserve(benchInputCount);
+    for(uint32_t idx = 0; idx < benchInputCount; ++idx)
+        res.push_back({ sampler.sampleVec2(), 0.0f, idx, sampler.sample() * 1e-2f });
+    return res;
+}
+
+// NOTICE: the bitmap textures need image files, so the procedural textures over the constant ones are measured
+static void benchScalarTextureEvaluate(benchmark::State& state) {
+    const auto texture = getStaticFactory().make<ScalarTexture2D>(
+        parseJSONConfigNodeFromStr(R"({ "Type": "CheckerBoard", "Size": [ 0.1, 0.1 ], "White": 0.9, "Black": 0.1 })", {}));
+    const auto lookups = generateLookups();
+    uint32_t idx = 0;
+    for(auto _ : state)
+        benchmark::DoNotOptimize(texture->evaluate(lookups[idx++ & benchInputMask]));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(benchScalarTextureEvaluate);
+
+static void benchSpectrumTextureEvaluate(benchmark::State& state) {
+    constexpr auto config = R"(
+{
+    "Type": "CheckerBoard",
+    "Size": [ 0.1, 0.1 ],
+    "White": { "Type": "MonoSpectrumTexture", "Value": 0.9 },
+    "Black": { "Type": "MonoSpectrumTexture", "Value": 0.1 }
+}
+)";
+    const auto texture = getStaticFactory().make<SpectrumTexture2D<RSSRGB>>(parseJSONConfigNodeFromStr(config, {}));
+    const auto lookups = generateLookups();
+    uint32_t idx = 0;
+    for(auto _ : state)
+        benchmark::DoNotOptimize(texture->evaluate(lookups[idx++ & benchInputMask], std::monostate{}));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(benchSpectrumTextureEvaluate);
+
+PIPER_NAMESPACE_END
@@ -0,0 +1,155 @@
+#
+#    SPDX-License-Identifier: GPL-3.0-or-later
+#
+#    This file is part of Piper0, a physically based renderer.
+#    Copyright (C) 2022 Yingwei Zheng
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+# Renders the reference scenes with each integrator and sampler configuration and collects the time-to-quality results.
+# The reference images are rendered once with a high sample count and reused by the later runs, the progressive renderer
+# records the RMSE against them over time. The results are summarized in <output>/summary.json.
+#
+# Usage: python3 bench/scenes/run.py --piper <path to Piper> [--output <dir>] [--scene CornellBox] [--time-budget 60]
+
+import argparse
+import json
+import os
+import subprocess
+import time
+
+sceneDir = os.path.dirname(os.path.abspath(__file__))
+scenes = ['CornellBox', 'TexturedInterior', 'ManyLights', 'GlassCaustics', 'MotionBlur']
+
+# (name, integrator, sampler)
+configurations = [
+    ('Path-Sobol', {'Type': 'PathIntegrator'}, 'SobolSampler'),
+    ('Path-ZSobol', {'Type': 'PathIntegrator'}, 'ZSobolSampler'),
+    ('Path-PMJ02', {'Type': 'PathIntegrator'}, 'PMJ02Sampler'),
+    ('BDPT-Sobol', {'Type': 'BDPTIntegrator'}, 'SobolSampler'),
+    ('VCM-Sobol', {'Type': 'VCMIntegrator'}, 'SobolSampler'),
+]
+
+
+def loadScene(name):
+    with open(os.path.join(sceneDir, name + '.json')) as f:
+        text = f.read()
+    return json.loads(text.replace('${SceneDir}', sceneDir.replace('\\', '/')))
+
+
+def makePipeline(scene, integrator, sampler, sampleCount, outputName, progressive=None):
+    integrator = dict(integrator)
+    integrator['MaxDepth'] = scene['MaxDepth']
+    action = {
+        'Width': scene['Width'],
+        'Height': scene['Height'],
+        'FrameCount': 1,
+        'Sampler': {'Type': sampler, 'SampleCount': sampleCount},
+        'Begin': 0.0,
+        'FPS': 1.0,
+        'ShutterOpen': scene['ShutterOpen'],
+        'ShutterClose': scene['ShutterClose'],
+        'Channels': ['Color'],
+        'Sensor': 'Camera'
+    }
+    if progressive is not None:
+        action['Progressive'] = progressive
+    renderer = {
+        'Type': 'Renderer',
+        'Name': 'Renderer',
+        'Variant': 'RSSRGB',
+        'Scene': scene['Scene'],
+        'Integrator': integrator,
+        'LightSampler': scene.get('LightSampler', {'Type': 'PowerLightSampler'}),
+        'Filter': {'Type': 'GaussianFilter', 'Alpha': 2.0, 'Radius': 1.5},
+        'Action': [action]
+    }
+    return {
+        'Pipeline': [
+            renderer,
+            {'Type': 'StatsOutput', 'Name': 'Stats', 'PrevNode': 'Renderer', 'OutputPath': '${OutputDir}/' + outputName + '.frame.json'},
+            {'Type': 'EXROutput', 'Name': 'Output', 'PrevNode': 'Renderer', 'OutputPath': '${OutputDir}/' + outputName + '.exr'}
+        ]
+    }
+
+
+def render(piper, pipeline, outputDir, name):
+    os.makedirs(outputDir, exist_ok=True)
+    inputPath = os.path.join(outputDir, name + '.json')
+    with open(inputPath, 'w') as f:
+        json.dump(pipeline, f, indent=4)
+    begin = time.perf_counter()
+    # the material presets (e.g. data/ior) are resolved relative to the working directory
+    subprocess.run([piper, '--input', inputPath, '--output', outputDir, '--headless'], check=True,
+                   cwd=os.path.dirname(os.path.dirname(sceneDir)))
+    wallTime = time.perf_counter() - begin
+
+    with open(os.path.join(outputDir, name + '.frame.json')) as f:
+        frame = json.load(f)['Stats']
+    with open(os.path.join(outputDir, name + '.stats.json')) as f:
+        report = json.load(f)
+    return {
+        'WallTime': wallTime,
+        'RenderTime': frame.get('RenderTime'),
+        'RaysPerSecond': frame.get('RaysPerSecond'),
+        'Convergence': frame.get('Convergence', []),
+        'MemoryUsage': report.get('MemoryUsage'),
+        'SubsystemMemory': {tag: usage['Peak'] for tag, usage in report.get('SubsystemMemory', {}).items()}
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Time-to-quality benchmark of the reference scenes')
+    parser.add_argument('--piper', required=True, help='path to the Piper executable')
+    parser.add_argument('--output', default='output', help='output directory')
+    parser.add_argument('--scene', action='append', choices=scenes, help='scenes to render (default: all)')
+    parser.add_argument('--reference-spp', type=int, default=16384, help='sample count of the reference images')
+    parser.add_argument('--time-budget', type=float, default=60.0, help='time budget of each run in seconds')
+    parser.add_argument('--rerender-reference', action='store_true', help='render the reference images even if they exist')
+    args = parser.parse_args()
+
+    piper = os.path.abspath(args.piper)
+    outputDir = os.path.abspath(args.output)
+    referenceDir = os.path.join(outputDir, 'references')
+    summary = {}
+    for name in args.scene or scenes:
+        scene = loadScene(name)
+        referencePath = os.path.join(referenceDir, name + '.exr')
+        if args.rerender_reference or not os.path.exists(referencePath):
+            print(f'Rendering the reference of {name}')
+            render(piper, makePipeline(scene, {'Type': 'PathIntegrator'}, 'SobolSampler', args.reference_spp, name), referenceDir, name)
+
+        results = {}
+        for configName, integrator, sampler in configurations:
+            print(f'Rendering {name} with {configName}')
+            runName = name + '-' + configName
+            # the sample count is only an upper bound, the run stops at the time budget
+            progressive = {'SamplesPerPass': 1, 'TimeBudget': args.time_budget, 'Reference': referencePath.replace('\\', '/')}
+            pipeline = makePipeline(scene, integrator, sampler, args.reference_spp, runName, progressive)
+            results[configName] = render(piper, pipeline, os.path.join(outputDir, name), runName)
+        summary[name] = results
+
+    with open(os.path.join(outputDir, 'summary.json'), 'w') as f:
+        json.dump(summary, f, indent=4)
+    for name, results in summary.items():
+        print(name)
+        for configName, result in results.items():
+            curve = result['Convergence']
+            rmse = curve[-1]['RMSE'] if curve else float('nan')
+            print(f'    {configName:<12} {result["WallTime"]:8.2f}s  {curve[-1]["Samples"] if curve else 0:6} spp  RMSE {rmse:.6f}')
+
+
+if __name__ == '__main__':
+    main()
@@ -22,6 +22,7 @@
 #include <Piper/Core/Context.hpp>
 #include <Piper/Core/FileIO.hpp>
 #include <Piper/Core/RefCount.hpp>
+#include <algorithm>
 #include <variant>
 
 PIPER_NAMESPACE_BEGIN
@@ -30,8 +31,18 @@ class ConfigAttr final : public RefCountBase {
 public:
     using AttrArray = std::pmr::vector<Ref<ConfigAttr>>;
 
+    // The homogeneous numeric arrays are stored contiguously by the parsers instead of one attribute per element, and the arrays of
+    // the numeric arrays with the same length (e.g. the samples of the measured spectra) are flattened row by row.
+    template <typename T>
+    struct NumericArray final {
+        std::pmr::vector<T> values;
+        uint32_t width;  // the number of values per row, the flat arrays have one row
+    };
+    using FloatArray = NumericArray<float>;
+    using UIntArray = NumericArray<uint32_t>;
+
 private:
-    std::variant<bool, uint32_t, double, std::string_view, std::pmr::string, AttrArray, Ref<ConfigNode>> mValue;
+    std::variant<bool, uint32_t, double, std::string_view, std::pmr::string, AttrArray, Ref<ConfigNode>, FloatArray, UIntArray> mValue;
 
 public:
     template <typename T>
@@ -56,7 +67,20 @@ public:
     }
 
     [[nodiscard]] bool isArray() const noexcept {
-        return mValue.index() == 5;
+        return std::holds_alternative<AttrArray>(mValue) || std::holds_alternative<FloatArray>(mValue) ||
+            std::holds_alternative<UIntArray>(mValue);
+    }
+
+    // null if the array is not stored as the numbers of type T
+    // NOTICE: the arrays built by the converters still use AttrArray, see parseFloats for the consumers accepting both
+    template <typename T>
+    requires(std::is_same_v<float, T> || std::is_same_v<uint32_t, T>) [[nodiscard]] const NumericArray<T>* numericArray()
+    const noexcept {
+        return std::get_if<NumericArray<T>>(&mValue);
+    }
+
+    [[nodiscard]] const auto& value() const noexcept {
+        return mValue;
     }
 
     template <typename T>
@@ -73,7 +97,9 @@ public:
 
 class ConfigNode final : public RefCountBase {
 public:
-    using AttrMap = std::pmr::unordered_map<std::string_view, Ref<ConfigAttr>>;
+    // A flat array sorted by key, so that a node costs one allocation and lookups are binary searches over contiguous memory.
+    // The first one wins if a key is duplicated.
+    using AttrMap = std::pmr::vector<std::pair<std::string_view, Ref<ConfigAttr>>>;
 
 private:
     std::string_view mName;
@@ -83,7 +109,9 @@ private:
 
 public:
     ConfigNode(std::string_view name, std::string_view type, AttrMap value, Ref<RefCountBase> holder)
-        : mName{ name }, mType{ type }, mValue{ std::move(value) }, mHolder{ std::move(holder) } {}
+        : mName{ name }, mType{ type }, mValue{ std::move(value) }, mHolder{ std::move(holder) } {
+        std::ranges::stable_sort(mValue, {}, &AttrMap::value_type::first);
+    }
 
     auto type() const noexcept {
         return mType;
@@ -91,15 +119,19 @@ public:
     auto name() const noexcept {
         return mName;
     }
+    const AttrMap& attributes() const noexcept {
+        return mValue;
+    }
 
     const Ref<ConfigAttr>* tryGet(const std::string_view attr) const {
-        if(const auto iter = mValue.find(attr); iter != mValue.cend())
+        if(const auto iter = std::ranges::lower_bound(mValue, attr, {}, &AttrMap::value_type::first);
+           iter != mValue.cend() && iter->first == attr)
             return &iter->second;
         return nullptr;
     }
 
     const Ref<ConfigAttr>& get(const std::string_view attr) const {
-        return mValue.find(attr)->second;
+        return std::ranges::lower_bound(mValue, attr, {}, &AttrMap::value_type::first)->second;
     }
 
     const Ref<ConfigAttr>& get(const char*) const = delete;
@@ -114,4 +146,13 @@ Ref<ConfigNode> parseJSONConfigNodeFromStr(std::string_view str, const ResolveCo
 Ref<ConfigNode> parseYAMLConfigNode(std::string_view path, const ResolveConfiguration& config);
 Ref<ConfigNode> parseXMLConfigNode(std::string_view path, const ResolveConfiguration& config);
 
+// The resolved config tree (with the included files flattened) is stored in a compiled snapshot, which is memory-mapped by the
+// following runs. The snapshot is rebuilt when any input file or the resolve configuration is changed.
+Ref<ConfigNode> parseJSONConfigNodeWithSnapshot(std::string_view path, const ResolveConfiguration& config, const fs::path& snapshot);
+
+namespace Impl {
+    // the config files read by the parsers are recorded here if it is not null
+    std::pmr::vector<std::string>*& configInputFiles() noexcept;
+}  // namespace Impl
+
 PIPER_NAMESPACE_END
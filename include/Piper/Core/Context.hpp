@@ -20,8 +20,11 @@
 
 #pragma once
 #include <Piper/Config.hpp>
+#include <cstddef>
+#include <cstdint>
 #include <memory_resource>
 #include <oneapi/tbb/partitioner.h>
+#include <vector>
 
 PIPER_NAMESPACE_BEGIN
 
@@ -32,29 +35,135 @@ struct Context final {
     std::pmr::memory_resource* scopedAllocator;
 };
 
-Context& context();
+namespace detail {
+    extern constinit thread_local Context threadContext;
+}
 
+// NOTICE: the context of each thread is constant-initialized, so the lookup is a plain thread-local load without an initialization
+// guard or a call, which is cheap enough for the hot paths (e.g., the pmr containers of each path state)
+inline Context& context() noexcept {
+    return detail::threadContext;
+}
+
+// the subsystems whose memory usage is tracked separately
+enum class MemoryTag : uint8_t { Geometry, Texture, Film, Frame, Config };
+
+struct MemoryUsage final {
+    uint64_t live = 0;  // in bytes
+    uint64_t peak = 0;
+};
+
+// the thread-safe allocator of the subsystem shared by all threads, the allocations are forwarded to the global allocator
+std::pmr::memory_resource* trackedAllocator(MemoryTag tag);
+MemoryUsage memoryUsage(MemoryTag tag);
+
+// A bump-pointer allocator for a single thread, the memory is only reclaimed by rewinding to a mark or destroying the resource.
+// The chunks are kept after rewinding, so a loop which rewinds every iteration allocates nothing from the upstream in the steady
+// state.
+class MonotonicArenaResource final : public std::pmr::memory_resource {
+    struct Chunk final {
+        std::byte* data;
+        size_t size;
+    };
+
+    std::pmr::memory_resource* mUpstream;
+    std::pmr::vector<Chunk> mChunks;
+    size_t mChunkIdx = 0;  // the chunk being bumped, valid if mChunks is not empty
+    std::byte* mCurrent = nullptr;  // null before the first chunk
+    std::byte* mEnd = nullptr;
+
+    void* allocateSlow(size_t bytes, size_t alignment);
+
+    void* do_allocate(const size_t bytes, const size_t alignment) override {
+        const auto aligned = reinterpret_cast<std::byte*>((reinterpret_cast<uintptr_t>(mCurrent) + alignment - 1) & ~(alignment - 1));
+        if(mCurrent && aligned + bytes <= mEnd) {
+            mCurrent = aligned + bytes;
+            return aligned;
+        }
+        return allocateSlow(bytes, alignment);
+    }
+    // NOTICE: the objects left by rewinding may be destroyed after their memory is reused, so nothing is given back here
+    void do_deallocate(void*, size_t, size_t) override {}
+    [[nodiscard]] bool do_is_equal(const memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+public:
+    struct Mark final {
+        size_t chunkIdx;
+        std::byte* current;
+    };
+
+    explicit MonotonicArenaResource(std::pmr::memory_resource* upstream) noexcept : mUpstream{ upstream }, mChunks{ upstream } {}
+    MonotonicArenaResource(const MonotonicArenaResource&) = delete;
+    MonotonicArenaResource(MonotonicArenaResource&&) = delete;
+    MonotonicArenaResource& operator=(const MonotonicArenaResource&) = delete;
+    MonotonicArenaResource& operator=(MonotonicArenaResource&&) = delete;
+    ~MonotonicArenaResource() override;
+
+    [[nodiscard]] Mark mark() const noexcept {
+        return { mChunkIdx, mCurrent };
+    }
+    // NOTICE: all allocations after the mark are invalidated
+    void release(const Mark& mark) noexcept {
+        mChunkIdx = mark.chunkIdx;
+        mCurrent = mark.current;
+        mEnd = mChunks.empty() ? nullptr : mChunks[mChunkIdx].data + mChunks[mChunkIdx].size;
+    }
+};
+
+// The outermost arena of a thread installs the scoped allocator, the nested ones (e.g., a tile stolen by a waiting thread) rewind
+// it to where they began.
 class MemoryArena final {
-    // std::pmr::monotonic_buffer_resource mAllocator{ context().scopedAllocator ? 0U : 4096U, context().localAllocator }; //TODO: FIXME
-    std::pmr::unsynchronized_pool_resource mProxyAllocator{ context().localAllocator };
-    tbb::cache_aligned_resource mAllocator{ &mProxyAllocator };
+    MonotonicArenaResource mAllocator{ context().localAllocator };
+    MonotonicArenaResource* mOuter = nullptr;
+    MonotonicArenaResource::Mark mMark{};
 
 public:
     MemoryArena() {
         auto& allocator = context().scopedAllocator;
         if(!allocator)
             allocator = &mAllocator;
+        else {
+            // the scoped allocator is always installed by a MemoryArena
+            mOuter = static_cast<MonotonicArenaResource*>(allocator);
+            mMark = mOuter->mark();
+        }
     }
     MemoryArena(const MemoryArena&) = delete;
     MemoryArena(MemoryArena&&) = delete;
     MemoryArena& operator=(const MemoryArena&) = delete;
     MemoryArena& operator=(MemoryArena&&) = delete;
     ~MemoryArena() {
-        if(context().scopedAllocator == &mAllocator)
+        if(mOuter)
+            mOuter->release(mMark);
+        else if(context().scopedAllocator == &mAllocator)
             context().scopedAllocator = nullptr;
     }
 };
 
+// Rewinds the scoped allocator when leaving the scope, e.g., per sample batch of a tile. Nothing allocated from the scoped allocator
+// in the scope is allowed to escape it, including the growth of the containers created before the scope.
+class ArenaRewindScope final {
+    MonotonicArenaResource* mArena;
+    MonotonicArenaResource::Mark mMark{};
+
+public:
+    // the scoped allocator is always installed by a MemoryArena
+    ArenaRewindScope() noexcept : mArena{ static_cast<MonotonicArenaResource*>(context().scopedAllocator) } {
+        if(mArena)
+            mMark = mArena->mark();
+    }
+    ArenaRewindScope(const ArenaRewindScope&) = delete;
+    ArenaRewindScope(ArenaRewindScope&&) = delete;
+    ArenaRewindScope& operator=(const ArenaRewindScope&) = delete;
+    ArenaRewindScope& operator=(ArenaRewindScope&&) = delete;
+    ~ArenaRewindScope() {
+        if(mArena)
+            mArena->release(mMark);
+    }
+};
+
 extern tbb::affinity_partitioner globalAffinityPartitioner;
 
 PIPER_NAMESPACE_END
@@ -20,11 +20,39 @@
 
 #pragma once
 #include <Piper/Core/Common.hpp>
+#include <span>
 
 PIPER_NAMESPACE_BEGIN
 BinaryData loadData(const fs::path& path);
+// read the whole file once, so that the following reads hit the page cache
+void prefetchFile(const fs::path& path);
+
+// read-only memory mapping of a whole file
+class MappedFile final {
+    void* mFile = nullptr;
+    void* mMapping = nullptr;
+    const std::byte* mData = nullptr;
+    size_t mSize = 0;
+
+public:
+    explicit MappedFile(const fs::path& path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile(MappedFile&&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile& operator=(MappedFile&&) = delete;
+    ~MappedFile();
+
+    [[nodiscard]] std::span<const std::byte> data() const noexcept {
+        return { mData, mSize };
+    }
+};
+
+// the content hash used to address the cached files
+uint64_t hashFile(const fs::path& path);
 
 void addSearchPath(fs::path path);
+// the files in the search paths are indexed on the first lookup, so the index should be dropped when the files may be changed
+void invalidateSearchPathIndex();
 std::string resolvePath(std::string_view name);
 
 PIPER_NAMESPACE_END
@@ -20,10 +20,19 @@
 
 #pragma once
 #include <Piper/Core/Context.hpp>
+#include <Piper/Core/Stats.hpp>
 #include <optional>
 
 PIPER_NAMESPACE_BEGIN
 
+// the user-space events of the hardware performance counters, summed over the observed threads
+struct HardwareCounters final {
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t cacheMisses = 0;  // the last level cache
+    uint64_t branchMisses = 0;
+};
+
 struct CurrentStatus final {
     std::pmr::vector<std::pair<double, double>> cores{ context().localAllocator };
     double userRatio = 0.0;
@@ -34,11 +43,26 @@ struct CurrentStatus final {
     double writeSpeed = 0.0;
     uint64_t activeIOThread = 0;
     std::pmr::vector<std::string> customStatus;
+    Throughput throughput;
+    double interval = 0.0;                            // in seconds
+    std::optional<HardwareCounters> hardwareCounters;  // the events during the interval, nullopt if unavailable
+    std::pmr::vector<std::pair<MemoryTag, MemoryUsage>> subsystemMemory{ context().localAllocator };
+};
+
+// the resource usage of the process since the monitor is created
+struct ProcessTime final {
+    double wallTime = 0.0;  // in seconds
+    double userTime = 0.0;
+    double kernelTime = 0.0;
+    uint64_t memoryUsage = 0;  // in bytes
 };
 
 class Monitor {
 public:
     virtual std::optional<CurrentStatus> update() = 0;
+    [[nodiscard]] virtual ProcessTime processTime() = 0;
+    // the totals since the monitor is created, nullopt if the counters are unavailable (e.g., restricted by perf_event_paranoid)
+    [[nodiscard]] virtual std::optional<HardwareCounters> hardwareCounters() = 0;
     virtual void updateCustomStatus(void*, std::string message) = 0;
     [[nodiscard]] virtual uint32_t updateCount() const noexcept = 0;
     virtual ~Monitor() = default;
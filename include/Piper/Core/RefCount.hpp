@@ -47,6 +47,14 @@ class RefCountBase {
     void addRef() noexcept {
         ++mRefCount;
     }
+    // increments only if the object is still alive
+    bool tryAddRef() noexcept {
+        auto count = mRefCount.load(std::memory_order_relaxed);
+        while(count != 0)
+            if(mRefCount.compare_exchange_weak(count, count + 1))
+                return true;
+        return false;
+    }
     void decRef() noexcept {
         if((--mRefCount) == 0) {
             std::destroy_at(this);
@@ -95,6 +103,10 @@ public:
             mPtr->decRef();
     }
     Ref(const Ref& rhs) noexcept : Ref{ rhs.mPtr } {}
+    // for the weak caches, the entries whose count has reached zero are being destroyed and will be removed by their destructors
+    [[nodiscard]] static Ref tryAcquire(T* ptr) noexcept {
+        return ptr && ptr->tryAddRef() ? Ref{ ptr, Impl::owns } : Ref{};
+    }
     template <typename U>
     Ref(const Ref<U>& rhs) noexcept : Ref{ rhs.mPtr } {}
 
@@ -25,6 +25,7 @@
 #include <oneapi/tbb/concurrent_unordered_map.h>
 #include <oneapi/tbb/concurrent_vector.h>
 #include <optional>
+#include <vector>
 
 PIPER_NAMESPACE_BEGIN
 
@@ -36,8 +37,12 @@ void warning(std::string message);
 void error(std::string message);
 [[noreturn]] void fatal(std::string message);
 
-tbb::concurrent_vector<std::pair<LogType, std::string>>& consoleOutput();
-std::ofstream& logFile();
+// The messages are queued in a bounded ring buffer and written by a background thread, so reporting never blocks on the file.
+// Only the latest messages are kept for the console of the UI.
+std::vector<std::pair<LogType, std::string>> consoleHistory();
+void openLogFile(const fs::path& path);
+// blocks until all messages reported before the call are written to the log file
+void flushLog();
 
 using Clock = std::chrono::system_clock;
 
@@ -0,0 +1,74 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <Piper/Config.hpp>
+#include <atomic>
+#include <oneapi/tbb/concurrent_vector.h>
+#include <span>
+
+PIPER_NAMESPACE_BEGIN
+
+// Approximate LRU residency of read-only memory-mapped regions. The evicted pages are read from the file again on the next
+// access, so eviction never invalidates the data seen by the readers.
+class ResidencyManager final {
+    struct Block final {
+        const std::byte* ptr = nullptr;
+        size_t size = 0;
+        std::atomic_uint32_t lastUse = 0;
+        std::atomic_bool resident = false;
+    };
+
+    tbb::concurrent_vector<Block> mBlocks;
+    std::atomic_size_t mResidentSize = 0;
+    std::atomic_uint32_t mEpoch = 0;
+    size_t mBudget = 0;
+
+    void trim();
+
+public:
+    static constexpr size_t blockSize = 1 << 20;
+
+    static ResidencyManager& get();
+
+    // 0 means disabled
+    void setBudget(size_t bytes) noexcept {
+        mBudget = bytes;
+    }
+    [[nodiscard]] bool enabled() const noexcept {
+        return mBudget != 0;
+    }
+
+    // returns the index of the first block of the region
+    uint32_t registerRegion(std::span<const std::byte> region);
+    void unregisterRegion(uint32_t firstBlock, std::span<const std::byte> region);
+
+    void touch(const uint32_t block) noexcept {
+        auto& item = mBlocks[block];
+        // avoid writing to the shared cache line when it is not necessary
+        if(const auto epoch = mEpoch.load(std::memory_order_relaxed); item.lastUse.load(std::memory_order_relaxed) != epoch)
+            item.lastUse.store(epoch, std::memory_order_relaxed);
+        if(!item.resident.load(std::memory_order_relaxed) && !item.resident.exchange(true, std::memory_order_relaxed) &&
+           (mResidentSize += item.size) > mBudget)
+            trim();
+    }
+};
+
+PIPER_NAMESPACE_END
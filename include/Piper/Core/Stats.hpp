@@ -21,6 +21,11 @@
 #pragma once
 #include <Piper/Config.hpp>
 #include <Piper/Core/Report.hpp>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <string>
+#include <vector>
 
 PIPER_NAMESPACE_BEGIN
 
@@ -31,14 +36,26 @@ enum class StatsType {
     Intersection,
     Occlusion,
     TraceDepth,
+    AdaptiveTermination,
+    AccelerationMemoryPeak,
     TracingEnd,
     ShadingBegin,
+    Sample,
     ShadingEnd,
     TexturingBegin,
     Texture2D,
+    TextureTileHit,
+    TextureTileDecode,
+    TextureTileEviction,
     TexturingEnd,
 };
 
+// the counters summed over all threads while they are still running
+struct LiveStats final {
+    uint64_t count = 0;
+    uint64_t positiveCount = 0;
+};
+
 class LocalStatsBase {
 public:
     LocalStatsBase();
@@ -48,6 +65,10 @@ public:
     LocalStatsBase& operator=(const LocalStatsBase&) = delete;
 
     virtual void accumulate() = 0;
+    // only the counters are readable during rendering
+    [[nodiscard]] virtual std::optional<std::pair<StatsType, LiveStats>> snapshot() const noexcept {
+        return std::nullopt;
+    }
     virtual ~LocalStatsBase() = default;
 };
 
@@ -66,6 +87,8 @@ public:
         return mType;
     }
     virtual void print() = 0;
+    // appends the accumulated value as a JSON object
+    virtual void dump(std::string& out) const = 0;
     virtual ~StatsBase() = default;
 };
 
@@ -78,19 +101,25 @@ public:
         mCount += count;
     }
     void print() override;
+    void dump(std::string& out) const override;
 };
 
+// NOTICE: the local counters are only written by their own threads, so the relaxed load and store are enough and no locked
+// instruction is issued. The other threads read them with relaxed loads for the live stats.
 class LocalCounterBase final : public LocalStatsBase {
     CounterBase& mBase;
-    uint64_t mCount = 0;
+    std::atomic_uint64_t mCount = 0;
 
 public:
     explicit LocalCounterBase(CounterBase& base) : mBase{ base } {}
-    void count() noexcept {
-        ++mCount;
+    void count(const uint64_t count) noexcept {
+        mCount.store(mCount.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
     }
     void accumulate() override {
-        mBase.add(mCount);
+        mBase.add(mCount.load(std::memory_order_relaxed));
+    }
+    [[nodiscard]] std::optional<std::pair<StatsType, LiveStats>> snapshot() const noexcept override {
+        return std::make_pair(mBase.type(), LiveStats{ mCount.load(std::memory_order_relaxed), 0 });
     }
 };
 
@@ -107,8 +136,8 @@ class Counter final {
 
 public:
     Counter() = delete;
-    static void count() noexcept {
-        localBase().count();
+    static void count(const uint64_t count = 1) noexcept {
+        localBase().count(count);
     }
 };
 
@@ -122,20 +151,30 @@ public:
         mPositiveCount += positiveCount;
     }
     void print() override;
+    void dump(std::string& out) const override;
 };
 
 class LocalBoolCounterBase final : public LocalStatsBase {
     BoolCounterBase& mBase;
-    uint64_t mCount = 0, mPositiveCount = 0;
+    std::atomic_uint64_t mCount = 0, mPositiveCount = 0;
 
 public:
     explicit LocalBoolCounterBase(BoolCounterBase& base) : mBase{ base } {}
     void count(const bool res) noexcept {
-        ++mCount;
-        mPositiveCount += res;
+        mCount.store(mCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if(res)
+            mPositiveCount.store(mPositiveCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
     }
     void accumulate() override {
-        mBase.add(mCount, mPositiveCount);
+        mBase.add(mCount.load(std::memory_order_relaxed), mPositiveCount.load(std::memory_order_relaxed));
+    }
+    [[nodiscard]] uint64_t localCount() const noexcept {
+        return mCount.load(std::memory_order_relaxed);
+    }
+    [[nodiscard]] std::optional<std::pair<StatsType, LiveStats>> snapshot() const noexcept override {
+        // the positive count is loaded first, so that it never exceeds the total one
+        const auto positiveCount = mPositiveCount.load(std::memory_order_relaxed);
+        return std::make_pair(mBase.type(), LiveStats{ mCount.load(std::memory_order_relaxed), positiveCount });
     }
 };
 
@@ -155,6 +194,10 @@ public:
     static void count(const bool res) noexcept {
         localBase().count(res);
     }
+    // the total count of the calling thread, the difference of two calls is the count of the work between them
+    [[nodiscard]] static uint64_t localCount() noexcept {
+        return localBase().localCount();
+    }
 };
 
 class HistogramBase final : public StatsBase {
@@ -167,6 +210,7 @@ public:
             mCount[idx] += count[idx];
     }
     void print() override;
+    void dump(std::string& out) const override;
 };
 
 class LocalHistogramBase final : public LocalStatsBase {
@@ -211,6 +255,7 @@ public:
         mCount += count;
     }
     void print() override;
+    void dump(std::string& out) const override;
 };
 
 class LocalTimerBase final : public LocalStatsBase {
@@ -264,6 +309,7 @@ public:
         mValue = std::min(mValue, val);
     }
     void print() override;
+    void dump(std::string& out) const override;
 };
 
 class LocalTickTimerBase final : public LocalStatsBase {
@@ -307,6 +353,108 @@ public:
     }
 };
 
+// the maximum of the recorded values, e.g. the memory usage
+class PeakBase final : public StatsBase {
+    uint64_t mValue = 0;
+
+public:
+    explicit PeakBase(const StatsType type) : StatsBase{ type } {}
+    void add(const uint64_t val) noexcept {
+        mValue = std::max(mValue, val);
+    }
+    void print() override;
+    void dump(std::string& out) const override;
+};
+
+class LocalPeakBase final : public LocalStatsBase {
+    PeakBase& mBase;
+    uint64_t mValue = 0;
+
+public:
+    explicit LocalPeakBase(PeakBase& base) : mBase{ base } {}
+    void record(const uint64_t val) noexcept {
+        mValue = std::max(mValue, val);
+    }
+    void accumulate() override {
+        mBase.add(mValue);
+    }
+};
+
+template <StatsType T>
+class Peak final {
+    static PeakBase& base() {
+        static PeakBase base{ T };
+        return base;
+    }
+    static LocalPeakBase& localBase() {
+        thread_local static LocalPeakBase base{ Peak::base() };
+        return base;
+    }
+
+public:
+    Peak() = delete;
+    static void record(const uint64_t val) noexcept {
+        localBase().record(val);
+    }
+};
+
 void printStats();
+// the accumulated stats grouped by category as a JSON object, e.g. {"Tracing":{"Intersection":{...},...},...}
+std::string dumpStats();
+// the per-run report for tracking the performance regressions, the hash identifies the scene and its configuration
+void writeStatsReport(const fs::path& path, uint64_t configHash);
+
+// sums the counters of the given type over all threads without stopping them
+LiveStats sampleLiveStats(StatsType type);
+
+struct Throughput final {
+    double raysPerSecond = 0.0;
+    double occlusionRaysPerSecond = 0.0;
+    double samplesPerSecond = 0.0;
+    double textureLookupsPerSecond = 0.0;
+    double hitRatio = 0.0;  // of the traced rays
+};
+
+// the throughput between two updates
+class ThroughputMeter final {
+    std::chrono::steady_clock::time_point mLastTime = std::chrono::steady_clock::now();
+    LiveStats mRays = sampleLiveStats(StatsType::Intersection);
+    LiveStats mOcclusionRays = sampleLiveStats(StatsType::Occlusion);
+    LiveStats mSamples = sampleLiveStats(StatsType::Sample);
+    LiveStats mTextureLookups = sampleLiveStats(StatsType::Texture2D);
+
+public:
+    Throughput update();
+};
+
+std::string formatThroughput(const Throughput& throughput);
+
+// the counters of a frame, the deltas of the live stats between the beginning and the end of the frame
+// a point of the time-to-quality curve of a progressive frame
+struct ConvergencePoint final {
+    double time;       // in seconds since the first pass, the error estimation is excluded
+    uint32_t samples;  // per pixel
+    double rmse;       // against the reference image
+};
+
+struct FrameStats final {
+    double renderTime = 0.0;  // in seconds
+    std::vector<std::pair<StatsType, LiveStats>> counters;
+    std::vector<ConvergencePoint> convergence;
+};
+
+class FrameStatsMeter final {
+    std::chrono::steady_clock::time_point mBegin = std::chrono::steady_clock::now();
+    std::vector<std::pair<StatsType, LiveStats>> mCounters = sampleAllLiveStats();
+
+    static std::vector<std::pair<StatsType, LiveStats>> sampleAllLiveStats();
+
+public:
+    [[nodiscard]] FrameStats finish() const;
+};
+
+// e.g. {"RenderTime":1.5,"RaysPerSecond":66.7,"Counters":{"Intersection":{"Count":100,"Positive":90},...},
+//       "Convergence":[{"Time":0.5,"Samples":4,"RMSE":0.1},...]}
+std::string dumpFrameStats(const FrameStats& stats);
 
 PIPER_NAMESPACE_END
@@ -22,25 +22,71 @@
 
 #pragma once
 #include <Piper/Config.hpp>
+#include <chrono>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
 
 PIPER_NAMESPACE_BEGIN
 
+class PreviewImage;
+
 class DisplayProvider {
 public:
     virtual bool isSupported() = 0;
     virtual void connect(std::string_view serverConfig) = 0;
     virtual void create(std::string_view imageName, uint32_t width, uint32_t height,
                         const std::initializer_list<std::string_view>& channels) = 0;
-    virtual void update(std::string_view imageName, const std::initializer_list<std::string_view>& channels,
+    // the droppable updates are discarded if the queue is full, returns false in that case
+    virtual bool update(std::string_view imageName, const std::initializer_list<std::string_view>& channels,
                         const std::initializer_list<uint64_t>& offsets, const std::initializer_list<uint64_t>& strides, uint32_t x,
-                        uint32_t y, uint32_t width, uint32_t height, const std::span<float>& data) = 0;
+                        uint32_t y, uint32_t width, uint32_t height, std::vector<float> data, bool droppable) = 0;
     virtual void open(std::string_view imagePath) = 0;
     virtual void close(std::string_view imageName) = 0;
     virtual void disconnect() = 0;
+    // the registered previews are flushed periodically in the background
+    virtual void addPreview(PreviewImage* preview) = 0;
+    virtual void removePreview(PreviewImage* preview) = 0;
     [[nodiscard]] virtual uint16_t uniqueID() const noexcept = 0;
     virtual ~DisplayProvider() = default;
 };
 
 DisplayProvider& getDisplayProvider();
 
+struct PreviewPolicy final {
+    uint32_t minInterval = 250;  // in milliseconds, the dirty region is coalesced between two updates
+    uint32_t downsample = 1;     // the image sent to the display is point sampled every `downsample` pixels
+};
+
+// A live preview of an image (RGB only). The rows are written to a local buffer at the preview resolution, and the dirty region
+// is sent to the display by the I/O thread at most once per interval, so that a slow connection never stalls the writers. If
+// the queue is full, the region stays dirty and is sent by the next flush.
+class PreviewImage final {
+    std::string mName;
+    uint32_t mWidth, mHeight;
+    PreviewPolicy mPolicy;
+    std::vector<float> mData;
+    std::mutex mMutex;      // guards the buffer and the dirty region
+    std::mutex mSendMutex;  // the display provider is not thread-safe
+    uint32_t mDirtyX0, mDirtyY0, mDirtyX1, mDirtyY1;
+    std::chrono::steady_clock::time_point mLastUpdate;
+
+    void resetDirtyRegion() noexcept;
+
+public:
+    // the width and height are in the full resolution
+    PreviewImage(std::string name, uint32_t width, uint32_t height, const PreviewPolicy& policy);
+    PreviewImage(const PreviewImage&) = delete;
+    PreviewImage& operator=(const PreviewImage&) = delete;
+    ~PreviewImage();
+
+    // writes the pixels [x, x + rgb.size() / 3) of row y (in the full resolution), 3 floats per pixel
+    void update(uint32_t x, uint32_t y, std::span<const float> rgb);
+    // sends the dirty region if the interval has elapsed since the last update
+    // the forced flushes (e.g., the final one) are never dropped, the dropped regions are merged back and sent by the next flush
+    void flush(bool force = false);
+    [[nodiscard]] bool due() const noexcept;
+};
+
 PIPER_NAMESPACE_END
@@ -0,0 +1,49 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <Piper/Config.hpp>
+#include <oneapi/tbb/task_arena.h>
+#include <optional>
+
+PIPER_NAMESPACE_BEGIN
+
+enum class SMTPolicy { Use, Avoid };
+
+struct ThreadSetting final {
+    uint32_t threadCount = 0;  // 0 means all hardware threads allowed by the other constraints
+    SMTPolicy smt = SMTPolicy::Use;
+    std::optional<int32_t> numaNode;
+};
+
+// NOTICE: must be called before any parallel work. The budget is shared by TBB, Embree, OIDN, OpenImageIO and OpenEXR.
+void configureThreading(const ThreadSetting& setting);
+uint32_t threadBudget() noexcept;
+std::optional<int32_t> boundNumaNode() noexcept;
+// All rendering work runs in this arena, so the threads are placed by its constraints. Since the memory is placed by the first
+// touch, the film and the per-thread scratch allocated inside the arena are local to the bound NUMA node.
+tbb::task_arena& renderArena();
+
+// Cooperative cancellation of the running job (e.g., a job superseded in server mode). The BVH builds abort through their progress
+// monitors, the renderer stops at the tile and pass boundaries, and the pipeline skips the remaining frames.
+void requestCancellation() noexcept;
+void resetCancellation() noexcept;
+[[nodiscard]] bool cancellationRequested() noexcept;
+
+PIPER_NAMESPACE_END
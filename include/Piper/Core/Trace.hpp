@@ -0,0 +1,81 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <Piper/Core/Common.hpp>
+#include <atomic>
+#include <string_view>
+
+PIPER_NAMESPACE_BEGIN
+
+// The spans are recorded into per-thread timelines and exported in the Chrome trace event format, which is loaded by
+// chrome://tracing and https://ui.perfetto.dev. They cost a relaxed load unless the tracing is started, and they are compiled out
+// without PIPER_WITH_TRACING.
+
+void startTracing();
+void writeTrace(const fs::path& path);
+
+namespace detail {
+    extern std::atomic_bool tracingEnabled;
+    uint64_t traceTimestamp() noexcept;  // in nanoseconds since the tracing is started
+    void recordSpan(std::string_view name, uint64_t begin, uint64_t end) noexcept;
+}  // namespace detail
+
+[[nodiscard]] inline bool isTracing() noexcept {
+    return detail::tracingEnabled.load(std::memory_order_relaxed);
+}
+
+// NOTICE: the name must outlive the exporting of the trace (e.g., a literal or a name in the config tree)
+class TraceSpan final {
+    std::string_view mName;
+    uint64_t mBegin = 0;
+
+public:
+    explicit TraceSpan(const std::string_view name) noexcept : mName{ isTracing() ? name : std::string_view{} } {
+        if(!mName.empty())
+            mBegin = detail::traceTimestamp();
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan(TraceSpan&&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+    TraceSpan& operator=(TraceSpan&&) = delete;
+    ~TraceSpan() {
+        if(!mName.empty())
+            detail::recordSpan(mName, mBegin, detail::traceTimestamp());
+    }
+};
+
+#define PIPER_TRACE_CONCAT_IMPL(x, y) x##y
+#define PIPER_TRACE_CONCAT(x, y) PIPER_TRACE_CONCAT_IMPL(x, y)
+
+#ifdef PIPER_WITH_TRACING
+#define PIPER_TRACE_SPAN(name) const ::Piper::TraceSpan PIPER_TRACE_CONCAT(piperTraceSpan, __LINE__){ name }
+// only one of every `rate` spans of a thread is recorded, for the spans in the hot loops
+#define PIPER_TRACE_SAMPLED_SPAN(name, rate)                                                          \
+    thread_local uint32_t PIPER_TRACE_CONCAT(piperTraceCounter, __LINE__) = 0;                        \
+    const ::Piper::TraceSpan PIPER_TRACE_CONCAT(piperTraceSpan, __LINE__) {                           \
+        ++PIPER_TRACE_CONCAT(piperTraceCounter, __LINE__) % (rate) == 0 ? (name) : std::string_view{} \
+    }
+#else
+#define PIPER_TRACE_SPAN(name) static_cast<void>(0)
+#define PIPER_TRACE_SAMPLED_SPAN(name, rate) static_cast<void>(0)
+#endif
+
+PIPER_NAMESPACE_END
@@ -23,10 +23,14 @@ namespace Piper {
     class AccelerationBuilder;
     class ConfigAttr;
     class ConfigNode;
+    template <typename Settings>
+    class Light;
     class LightBase;
     class LightSampler;
     template <typename Settings>
     class Material;
+    template <typename Settings>
+    class Medium;
     class PrimitiveGroup;
     struct Ray;
     template <typename T>
@@ -23,37 +23,120 @@
 #include <Piper/Render/Intersection.hpp>
 #include <Piper/Render/KeyFrames.hpp>
 #include <Piper/Render/Ray.hpp>
+#include <functional>
+#include <span>
 
 PIPER_NAMESPACE_BEGIN
 
+enum class BuildQuality { Low, Medium, High };
+
+// Round: swept circles, Flat: ribbons facing the ray
+enum class CurveType { Round, Flat };
+
+// Sphere: spheres, Disk: disks oriented by the normals
+enum class PointType { Sphere, Disk };
+
+struct BuildSettings final {
+    BuildQuality quality;
+    bool compact;
+    bool robust;
+    // refit the top-level BVH after instance updates instead of rebuilding it
+    bool refit;
+
+    [[nodiscard]] std::string key() const;
+};
+
+// read Quality/Compact/Robust/Refit, the missing ones are kept
+BuildSettings parseBuildSettings(const Ref<ConfigNode>& node, BuildSettings settings);
+
+// the offset along the normal of the limit surface at (u, v) of the quad face
+using DisplacementFunction = std::function<Float(uint32_t face, glm::vec2 uv)>;
+
+// NOTICE: updateTransform/commit only modify the back buffer, which becomes visible after Acceleration::swap
 class PrimitiveGroup : public RefCountBase {
 public:
+    static constexpr uint32_t bufferCount = 2;
+
     virtual void updateTransform(const ShutterKeyFrames& transform) = 0;
     virtual void commit() = 0;
 };
 
+// bottom-level acceleration structure, which is shared by all instances of the same mesh
+class BottomLevelGeometry : public RefCountBase {};
+
+// a level of detail of the asset, the hits of the level are resolved by its own shape
+struct DetailLevel final {
+    Ref<BottomLevelGeometry> geometry;
+    const Shape* shape;
+    Float edgeLength;  // the typical edge length of the triangles in the object space
+};
+
 class OcclusionQueryIterator final {
 public:
 };
 
 class Acceleration : public RefCountBase {
 public:
-    virtual void commit() = 0;
+    // build the back buffer, it is safe to trace the front buffer concurrently
+    // false if the build is cancelled, then the back buffer must be committed again before swapping
+    virtual bool commit() = 0;
+    // make the committed back buffer visible to the queries
+    virtual void swap() = 0;
+    // the bounding sphere of the scene
+    virtual Point<FrameOfReference::World> center() const noexcept = 0;
     virtual Float radius() const noexcept = 0;
     virtual Intersection trace(const Ray& ray) const = 0;
     virtual bool occluded(const Ray& shadowRay, Distance dist) const = 0;
+    // batched shadow rays, the distances are the lengths of the rays
+    virtual std::pmr::vector<bool> occluded(const RayStream& shadowRays, const std::pmr::vector<Distance>& distances) const = 0;
     // virtual OcclusionQueryIterator occlusions(const Ray& shadowRay, const Distance dist) const = 0;
     virtual std::pmr::vector<Intersection> tracePrimary(const RayStream& rayStream) const = 0;
+    // incoherent ray stream (e.g., secondary bounces of wavefront path tracing)
+    virtual std::pmr::vector<Intersection> trace(const RayStream& rayStream) const = 0;
+    // the compact hits of the ray stream, the attributes are not interpolated until resolve
+    virtual std::pmr::vector<HitRecord> traceHits(const RayStream& rayStream, bool coherent) const = 0;
+    // reconstruct the surface hits of a traced batch, the missed ones become std::monostate
+    virtual std::pmr::vector<Intersection> resolve(const RayStream& rayStream, std::span<const HitRecord> hits) const = 0;
 };
 
 class AccelerationBuilder : public RefCountBase {
 public:
     virtual uint32_t maxStepCount() const noexcept = 0;
-    virtual Ref<PrimitiveGroup>
-    buildFromTriangleMesh(uint32_t vertices, uint32_t faces,
-                          const std::function<void(void*, void*)>& writeCallback,  // verticesBuffer,indicesBuffer
-                          const Shape& shape) const noexcept = 0;
+    // the default settings of the shapes without their own ones
+    virtual const BuildSettings& shapeSettings() const noexcept = 0;
+    // the buffers are shared with the backend without copying, so they must outlive the returned geometry
+    // NOTICE: the vertex buffer must be readable for 4 more bytes past the last vertex
+    virtual Ref<BottomLevelGeometry> buildFromTriangleMesh(std::span<const glm::vec3> vertices, std::span<const glm::uvec3> indices,
+                                                           const BuildSettings& settings) const noexcept = 0;
+    // uniform cubic B-spline curves, the control points are (position, radius) and each segment starts at one of them
+    virtual Ref<BottomLevelGeometry> buildFromCurves(std::span<const glm::vec4> controlPoints, std::span<const uint32_t> segments,
+                                                     CurveType type, const BuildSettings& settings) const noexcept = 0;
+    // analytic spheres or disks, the points are (center, radius) and the normals are only used by the disks
+    // NOTICE: the normal buffer must be readable for 4 more bytes past the last normal
+    virtual Ref<BottomLevelGeometry> buildFromPoints(std::span<const glm::vec4> points, std::span<const glm::vec3> normals,
+                                                     PointType type, const BuildSettings& settings) const noexcept = 0;
+    // open cylinders (or cones) without caps, the end points are (position, radius) and each segment starts at one of them
+    virtual Ref<BottomLevelGeometry> buildFromCylinders(std::span<const glm::vec4> endPoints, std::span<const uint32_t> segments,
+                                                        const BuildSettings& settings) const noexcept = 0;
+    // Catmull-Clark subdivision surfaces of quad cages, the edge levels are the tessellation rates of the edges of each face
+    // NOTICE: the patches are tessellated lazily by the backend, so the displacement is evaluated during rendering
+    virtual Ref<BottomLevelGeometry> buildFromSubdivisionMesh(std::span<const glm::vec3> vertices, std::span<const glm::uvec4> quads,
+                                                              std::span<const Float> edgeLevels, DisplacementFunction displacement,
+                                                              const BuildSettings& settings) const noexcept = 0;
+    virtual Ref<PrimitiveGroup> buildInstance(const Ref<BottomLevelGeometry>& geometry, const Shape& shape) const noexcept = 0;
+    // the levels are sorted from the finest to the coarsest, each ray only traverses the level selected by the width of its cone at
+    // the instance. The coarser level is used if its edges are shorter than detailScale times the width, and the transitions between
+    // the levels are stochastic.
+    virtual Ref<PrimitiveGroup> buildLODInstance(std::span<const DetailLevel> levels, Float detailScale) const noexcept = 0;
     virtual Ref<Acceleration> buildScene(const std::pmr::vector<PrimitiveGroup*>& primitiveGroups) const noexcept = 0;
 };
 
+// trace an incoherent ray stream binned by the direction octant and the 30-bit Morton code of the origin (10 bits per axis relative to
+// the bounds of the stream), the hits keep the order of the rays
+std::pmr::vector<Intersection> traceReordered(const Acceleration& acceleration, const RayStream& rayStream);
+
+// the boundaries of the media without a surface are index-matched, so the rays pass through them without a bounce
+// returns the first hit with a surface along the traced ray, its distance is measured from the origin of the ray
+Intersection passInterfaces(const Acceleration& acceleration, const Ray& ray, Intersection intersection);
+
 PIPER_NAMESPACE_END
@@ -107,6 +107,13 @@ public:
 
     [[nodiscard]] virtual InversePdfValue inversePdf(const Direction& wo, const Direction& wi, TransportMode transportMode,
                                                      BxDFDirection sampleDirection = BxDFDirection::All) const noexcept = 0;
+
+    // evaluate and inversePdf in one call, the BxDFs sharing the microfacet terms between them should override it
+    [[nodiscard]] virtual std::pair<Rational<Spectrum>, InversePdfValue>
+    evaluateWithPdf(const Direction& wo, const Direction& wi, const TransportMode transportMode,
+                    const BxDFDirection sampleDirection = BxDFDirection::All) const noexcept {
+        return { evaluate(wo, wi, transportMode), inversePdf(wo, wi, transportMode, sampleDirection) };
+    }
 };
 
 class ShadingFrame final {
@@ -136,9 +143,12 @@ class BSDF final {
     PIPER_IMPORT_SHADING();
 
     static constexpr uint32_t maxBxDFSize = 256;
+    static constexpr uint32_t maxBxDFAlignment = 64;
 
+    alignas(maxBxDFAlignment) std::byte mBxDFStorage[maxBxDFSize];
     ShadingFrame mFrame;
-    std::byte mBxDFStorage[maxBxDFSize]{};
+    uint16_t mBxDFSize;
+    uint8_t mBxDFAlignment;
     bool mOwns;
     bool mKeepOneWavelength;
 
@@ -146,16 +156,20 @@ public:
     template <typename T>
     requires std::is_base_of_v<BxDF<Setting>, std::decay_t<T>> BSDF(const ShadingFrame& shadingFrame, T bxdf,
                                                                     const bool keepOneWavelength = false)
-        : mFrame{ shadingFrame }, mOwns{ true }, mKeepOneWavelength{ keepOneWavelength } {
-        static_assert(sizeof(T) <= maxBxDFSize);
+        : mFrame{ shadingFrame }, mBxDFSize{ static_cast<uint16_t>(sizeof(T)) }, mBxDFAlignment{ static_cast<uint8_t>(alignof(T)) },
+          mOwns{ true }, mKeepOneWavelength{ keepOneWavelength } {
+        static_assert(sizeof(T) <= maxBxDFSize && alignof(T) <= maxBxDFAlignment);
         new(reinterpret_cast<T*>(mBxDFStorage)) T{ std::move(bxdf) };
     }
     BSDF(const BSDF&) = delete;
     BSDF& operator=(const BSDF&) = delete;
+    // NOTICE: BxDFs are relocated bytewise, only the bytes of the actual BxDF are copied
     BSDF(BSDF&& rhs)
-    noexcept : mFrame{ rhs.mFrame }, mOwns{ std::exchange(rhs.mOwns, false) }, mKeepOneWavelength{ rhs.mKeepOneWavelength } {
+    noexcept
+        : mFrame{ rhs.mFrame }, mBxDFSize{ rhs.mBxDFSize }, mBxDFAlignment{ rhs.mBxDFAlignment }, mOwns{ std::exchange(rhs.mOwns, false) },
+          mKeepOneWavelength{ rhs.mKeepOneWavelength } {
         if(mOwns)
-            memcpy(mBxDFStorage, rhs.mBxDFStorage, maxBxDFSize);
+            memcpy(mBxDFStorage, rhs.mBxDFStorage, mBxDFSize);
     }
     BSDF& operator=(BSDF&&) = delete;
 
@@ -168,6 +182,20 @@ public:
         return reinterpret_cast<const BxDF<Setting>*>(mBxDFStorage);
     }
 
+    [[nodiscard]] uint32_t bxdfSize() const noexcept {
+        return mBxDFSize;
+    }
+
+    [[nodiscard]] uint32_t bxdfAlignment() const noexcept {
+        return mBxDFAlignment;
+    }
+
+    // Moves the BxDF to dst (at least bxdfSize() bytes aligned to bxdfAlignment()), dst owns it afterwards
+    void relocateBxDF(std::byte* dst) noexcept {
+        memcpy(dst, mBxDFStorage, mBxDFSize);
+        mOwns = false;
+    }
+
     [[nodiscard]] BxDFPart part() const noexcept {
         return cast()->part();
     }
@@ -195,6 +223,13 @@ public:
                                       BxDFDirection sampleDirection = BxDFDirection::All) const noexcept {
         return cast()->inversePdf(mFrame(wo), mFrame(wi), transportMode, sampleDirection);
     }
+
+    [[nodiscard]] std::pair<Rational<Spectrum>, InversePdfValue>
+    evaluateWithPdf(const Piper::Direction<FrameOfReference::World>& wo, const Piper::Direction<FrameOfReference::World>& wi,
+                    TransportMode transportMode = TransportMode::Radiance,
+                    BxDFDirection sampleDirection = BxDFDirection::All) const noexcept {
+        return cast()->evaluateWithPdf(mFrame(wo), mFrame(wi), transportMode, sampleDirection);
+    }
 };
 
 PIPER_NAMESPACE_END
@@ -0,0 +1,34 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <Piper/Render/Intersection.hpp>
+#include <Piper/Render/Sampler.hpp>
+#include <benchmark/benchmark.h>
+
+PIPER_NAMESPACE_BEGIN
+
+SampleProvider& getBenchSampler() noexcept;
+// the inputs are generated before the timed loop and cycled through, the mask selects the input of the iteration
+constexpr uint32_t benchInputCount = 1024;
+constexpr uint32_t benchInputMask = benchInputCount - 1;
+// a hit at the origin, the normal is +Y and dpdu is +X
+SurfaceHit makeBenchSurfaceHit(Handle<Material> surface) noexcept;
+
+PIPER_NAMESPACE_END
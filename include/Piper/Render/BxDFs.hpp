@@ -21,6 +21,7 @@
 #pragma once
 #include <Piper/Render/BSDF.hpp>
 #include <Piper/Render/Scattering.hpp>
+#include <Piper/Render/SpectrumUtil.hpp>
 
 PIPER_NAMESPACE_BEGIN
 
@@ -245,6 +246,58 @@ public:
 
         return InversePdfValue::fromPdf(pdf);
     }
+
+    // NOTICE: the half vector, the Fresnel term, D and the masking terms are shared by the value and the pdf
+    [[nodiscard]] std::pair<Rational<Spectrum>, InversePdfValue>
+    evaluateWithPdf(const Direction& wo, const Direction& wi, const TransportMode transportMode,
+                    const BxDFDirection sampleDirection) const noexcept override {
+        const auto invalid = std::pair{ Rational<Spectrum>::zero(), InversePdfValue::invalid() };
+        if(mEta == 1.0f || mDistribution.effectivelySmooth())
+            return invalid;
+
+        const auto cosThetaO = cosTheta(wo), cosThetaI = cosTheta(wi);
+        const bool reflect = cosThetaO * cosThetaI > 0.0f;
+        const auto etaP = reflect ? 1.0f : (cosThetaO > 0.0f ? mEta : rcp(mEta));
+        const auto halfVector = wi.raw() * etaP + wo.raw();
+
+        if(cosThetaI == 0.0f || cosThetaO == 0.0f || glm::length2(halfVector) == 0.0f)
+            return invalid;
+
+        const auto wm = faceForward(Direction::fromRaw(glm::normalize(halfVector)), Direction::positiveZ());
+        const auto dotIM = dot(wi, wm), dotOM = dot(wo, wm);
+
+        if(dotIM * cosThetaI < 0.0f || dotOM * cosThetaO < 0.0f)
+            return invalid;
+
+        const auto f = fresnelDielectric(dotOM, mEta);
+        const auto d = mDistribution.evalD(wm);
+        const auto lambdaO = mDistribution.lambda(wo);
+        const auto g = rcp(1.0f + lambdaO + mDistribution.lambda(wi));
+        // the visible normal pdf, equals to mDistribution.pdf(wo, wm)
+        const auto pdfWm = rcp(1.0f + lambdaO) / std::fabs(cosThetaO) * d * std::fabs(dotOM);
+
+        const auto reflection = match(sampleDirection, BxDFDirection::Reflection) ? f : 0.0f;
+        const auto transmission = match(sampleDirection, BxDFDirection::Transmission) ? 1.0f - f : 0.0f;
+        const auto sampleable = reflection != 0.0f || transmission != 0.0f;
+
+        if(reflect) {
+            const auto fr = Rational<Spectrum>::fromScalar(d * g * f / std::fabs(4.0f * cosThetaI * cosThetaO));
+            if(!sampleable)
+                return { fr, InversePdfValue::invalid() };
+            const auto pdf = pdfWm / std::fmax(epsilon, 4.0f * std::fabs(dotOM)) * reflection / (reflection + transmission);
+            return { fr, InversePdfValue::fromPdf(pdf) };
+        }
+
+        const auto denominator = sqr(dotIM + dotOM / etaP);
+        auto ft = d * (1.0f - f) * g * std::fabs(dotIM * dotOM / (denominator * cosThetaI * cosThetaO));
+        if(transportMode == TransportMode::Radiance)
+            ft /= sqr(etaP);
+
+        if(!sampleable)
+            return { Rational<Spectrum>::fromScalar(ft), InversePdfValue::invalid() };
+        const auto pdf = pdfWm * std::fabs(dotIM) / denominator * transmission / (reflection + transmission);
+        return { Rational<Spectrum>::fromScalar(ft), InversePdfValue::fromPdf(pdf) };
+    }
 };
 
 // ConductorBxDF
@@ -327,6 +380,30 @@ public:
         const auto pdf = mDistribution.pdf(wo, wm) / (4.0f * absDot(wo, wm));
         return InversePdfValue::fromPdf(pdf);
     }
+
+    [[nodiscard]] std::pair<Rational<Spectrum>, InversePdfValue>
+    evaluateWithPdf(const Direction& wo, const Direction& wi, const TransportMode transportMode,
+                    const BxDFDirection sampleDirection) const noexcept override {
+        if(!sameHemisphere(wo, wi) || mDistribution.effectivelySmooth())
+            return { Rational<Spectrum>::zero(), InversePdfValue::invalid() };
+        const auto cosThetaO = absCosTheta(wo);
+        const auto cosThetaI = absCosTheta(wi);
+        const auto halfVector = wi.raw() + wo.raw();
+        if(cosThetaI == 0.0f || cosThetaO == 0.0f || glm::length2(halfVector) == 0.0f)
+            return { Rational<Spectrum>::zero(), InversePdfValue::invalid() };
+        // NOTICE: D, the masking terms and the Fresnel term are symmetric about the flip of the half vector
+        const auto wm = faceForward(Direction::fromRaw(normalize(halfVector)), Direction::positiveZ());
+        const auto cosThetaOM = absDot(wo, wm);
+        const auto d = mDistribution.evalD(wm);
+        const auto lambdaO = mDistribution.lambda(wo);
+        const auto g = rcp(1.0f + lambdaO + mDistribution.lambda(wi));
+        const auto fr = makeBSDF(fresnelComplex(cosThetaOM, mEta) * d * g / (4.0f * cosThetaI * cosThetaO));
+        if(!match(sampleDirection, BxDFDirection::Reflection))
+            return { fr, InversePdfValue::invalid() };
+        // the visible normal pdf divided by the Jacobian of the reflection, |dot(wo, wm)| cancels out
+        const auto pdf = rcp(1.0f + lambdaO) * d / (4.0f * cosThetaO);
+        return { fr, InversePdfValue::fromPdf(pdf) };
+    }
 };
 
 // TODO: double check
@@ -363,6 +440,14 @@ public:
         const auto pdf2 = mBxDF2.inversePdf(wo, wi, transportMode, sampleDirection);
         return mix(pdf1, pdf2, mWeight);
     }
+
+    [[nodiscard]] std::pair<Rational<Spectrum>, InversePdfValue>
+    evaluateWithPdf(const Direction& wo, const Direction& wi, const TransportMode transportMode,
+                    const BxDFDirection sampleDirection) const noexcept override {
+        const auto [f1, pdf1] = mBxDF1.evaluateWithPdf(wo, wi, transportMode, sampleDirection);
+        const auto [f2, pdf2] = mBxDF2.evaluateWithPdf(wo, wi, transportMode, sampleDirection);
+        return { mix(f1, f2, mWeight), mix(pdf1, pdf2, mWeight) };
+    }
 };
 
 template <typename Setting, typename T1, typename T2>
@@ -436,6 +521,35 @@ public:
         const auto pdf2 = mLayerBxDF.inversePdf(wo, wi, transportMode, sampleDirection);
         return mix(pdf1, pdf2, weight);
     }
+
+    [[nodiscard]] std::pair<Rational<Spectrum>, InversePdfValue>
+    evaluateWithPdf(const Direction& wo, const Direction& wi, const TransportMode transportMode,
+                    const BxDFDirection sampleDirection) const noexcept override {
+        const auto weight = evaluateWeight(wo, wi);
+        if(weight < 0.0f)
+            return { Rational<Spectrum>::zero(), InversePdfValue::invalid() };
+
+        const auto [f1, pdf1] = mBaseBxDF.evaluateWithPdf(wo, wi, transportMode, sampleDirection);
+        const auto [f2, pdf2] = mLayerBxDF.evaluateWithPdf(wo, wi, transportMode, sampleDirection);
+        return { mix(f1, f2, weight), mix(pdf1, pdf2, weight) };
+    }
 };
 
+// the metallic-roughness model of glTF, the dielectric base is blended with a conductor tinted by the base color
+template <typename Setting>
+auto metallicRoughnessBxDF(const typename Setting::SpectrumType& baseColor, const Float roughness, const Float metallic, const Float eta,
+                           const typename Setting::WavelengthType& sampledWavelength) {
+    using Spectrum = typename Setting::SpectrumType;
+    using EtaType = typename ConductorBxDF<Setting>::EtaType;
+
+    const auto distribution = TrowbridgeReitzDistribution<Setting>(roughness, roughness);
+    auto dielectric = SchlickMixedBxDF<Setting, LambertianBxDF<Setting>, DielectricBxDF<Setting>>{
+        LambertianBxDF<Setting>{ Rational<Spectrum>::fromRaw(baseColor) }, DielectricBxDF<Setting>{ eta, distribution }, eta
+    };
+
+    const auto conductorEta = spectrumCast<EtaType>(baseColor, sampledWavelength);
+    auto metal = ConductorBxDF<Setting>{ { conductorEta, zero<EtaType>() }, distribution };
+    return mixBxDF<Setting>(std::move(dielectric), std::move(metal), metallic);
+}
+
 PIPER_NAMESPACE_END
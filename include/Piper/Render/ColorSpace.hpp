@@ -24,8 +24,25 @@
 
 PIPER_NAMESPACE_BEGIN
 
+struct ProcessorPack;
+
+// A conversion between two color spaces resolved once, so that the hot loops skip the lookup of the processor. The conversions
+// consisting of matrices only (e.g. between the linear RGB spaces) are applied as a 3x3 matrix without calling OCIO.
+class ColorSpaceConverter final {
+    const ProcessorPack* mPack;
+
+public:
+    explicit ColorSpaceConverter(const ProcessorPack& pack) noexcept : mPack{ &pack } {}
+
+    [[nodiscard]] glm::vec3 operator()(const glm::vec3& value) const;
+    // converts the first 3 channels of each pixel in place, the adjacent pixels are pixelStride floats apart
+    void apply(float* pixels, size_t pixelCount, size_t pixelStride) const;
+};
+
+ColorSpaceConverter getRGB2StandardLinearRGBConverter(std::string_view colorSpace);
+ColorSpaceConverter getStandardLinearRGB2RGBConverter(std::string_view colorSpace);
+
 glm::vec3 convertRGB2StandardLinearRGB(const glm::vec3& valueRGB, std::string_view colorSpace);
 glm::vec3 convertStandardLinearRGB2RGB(const glm::vec3& valueStandardLinearRGB, std::string_view colorSpace);
-// TODO: batching
 
 PIPER_NAMESPACE_END
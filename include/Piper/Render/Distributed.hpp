@@ -0,0 +1,48 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <Piper/Core/RefCount.hpp>
+#include <Piper/Render/Math.hpp>
+#include <optional>
+#include <span>
+
+PIPER_NAMESPACE_BEGIN
+
+// Sample-space sharding: the coordinator hands out sample index ranges of a frame to the workers.
+// Each worker renders the whole film with the assigned samples and sends back the weighted (unnormalized) film.
+class DistributedCoordinator : public RefCountBase {
+public:
+    // accumulate the weighted film of the sample range [0, sampleCount) of the frame
+    // the ordered mode merges the chunks in the order of the sample ranges, so the result does not depend on the arrival order
+    virtual void render(uint32_t frameIdx, uint32_t sampleCount, uint32_t chunkSize, bool ordered, std::span<Float> film) = 0;
+};
+
+class DistributedWorker : public RefCountBase {
+public:
+    // returns the assigned sample range [begin, end), or std::nullopt if the frame is finished
+    virtual std::optional<std::pair<uint32_t, uint32_t>> acquire(uint32_t frameIdx) = 0;
+    virtual void submit(uint32_t frameIdx, uint32_t sampleBegin, uint32_t sampleEnd, std::span<const Float> film) = 0;
+};
+
+Ref<DistributedCoordinator> createDistributedCoordinator(uint16_t port, uint32_t workerCount);
+Ref<DistributedWorker> createDistributedWorker(std::string_view coordinator);
+
+PIPER_NAMESPACE_END
@@ -0,0 +1,94 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <Piper/Core/Context.hpp>
+#include <Piper/Render/Math.hpp>
+#include <algorithm>
+#include <vector>
+
+PIPER_NAMESPACE_BEGIN
+
+// the piecewise-constant distribution over [0,1]^2, sampled by inverting the marginal CDF over rows and the conditional CDF of the row
+class PiecewiseConstant2D final {
+    uint32_t mWidth = 0, mHeight = 0;
+    std::pmr::vector<Float> mFunction{ context().globalAllocator };     // [height][width]
+    std::pmr::vector<Float> mConditional{ context().globalAllocator };  // [height][width + 1]
+    std::pmr::vector<Float> mMarginal{ context().globalAllocator };     // [height + 1]
+    Float mIntegral = 0.0f;
+
+    // returns the continuous offset in [0, size)
+    static Float sample1D(const Float* cdf, const uint32_t size, const Float u) noexcept {
+        const auto idx = static_cast<uint32_t>(std::clamp<std::ptrdiff_t>(std::upper_bound(cdf, cdf + size + 1, u) - cdf - 1, 0,
+                                                                            static_cast<std::ptrdiff_t>(size) - 1));
+        const auto width = cdf[idx + 1] - cdf[idx];
+        const auto offset = width > 0.0f ? (u - cdf[idx]) / width : 0.5f;
+        return static_cast<Float>(idx) + std::clamp(offset, 0.0f, oneMinusEpsilon);
+    }
+
+public:
+    PiecewiseConstant2D() = default;
+    PiecewiseConstant2D(std::pmr::vector<Float> function, uint32_t width, uint32_t height);
+
+    [[nodiscard]] Float integral() const noexcept {
+        return mIntegral;
+    }
+
+    // returns the sampled point and its pdf over [0,1]^2
+    [[nodiscard]] std::pair<glm::vec2, Float> sample(const glm::vec2 u) const noexcept {
+        const auto y = sample1D(mMarginal.data(), mHeight, u.y);
+        const auto row = static_cast<uint32_t>(y);
+        const auto x = sample1D(mConditional.data() + static_cast<size_t>(row) * (mWidth + 1), mWidth, u.x);
+        const glm::vec2 res{ x / static_cast<Float>(mWidth), y / static_cast<Float>(mHeight) };
+        return { res, pdf(res) };
+    }
+
+    [[nodiscard]] Float pdf(const glm::vec2 p) const noexcept {
+        if(!(mIntegral > 0.0f))
+            return 1.0f;
+        const auto x = std::min(static_cast<uint32_t>(std::fmax(p.x, 0.0f) * static_cast<Float>(mWidth)), mWidth - 1);
+        const auto y = std::min(static_cast<uint32_t>(std::fmax(p.y, 0.0f) * static_cast<Float>(mHeight)), mHeight - 1);
+        return mFunction[static_cast<size_t>(y) * mWidth + x] / mIntegral;
+    }
+};
+
+// the equirectangular mapping of SphericalTexture::dir2TexCoord
+inline glm::vec3 equirectangularToDirection(const TexCoord texCoord) noexcept {
+    const auto azimuth = (texCoord.x - 0.5f) * twoPi;
+    const auto polar = texCoord.y * pi;
+    const auto sinPolar = std::sin(polar);
+    return { sinPolar * std::sin(azimuth), std::cos(polar), sinPolar * std::cos(azimuth) };
+}
+
+inline TexCoord directionToEquirectangular(const glm::vec3 dir) noexcept {
+    const auto azimuth = std::atan2(dir.x, dir.z);
+    const auto polar = std::acos(std::clamp(dir.y, -1.0f, 1.0f));
+    return TexCoord{ azimuth * invTwoPi + 0.5f, polar * invPi };
+}
+
+// converts the pdf over the equirectangular [0,1]^2 to the solid angle measure, 0 at the poles
+inline Float equirectangularSolidAnglePdf(const TexCoord texCoord, const Float pdf) noexcept {
+    const auto sinPolar = std::sin(texCoord.y * pi);
+    if(!(pdf > 0.0f) || !(sinPolar > 0.0f))
+        return 0.0f;
+    return pdf / (2.0f * pi * pi * sinPolar);
+}
+
+PIPER_NAMESPACE_END
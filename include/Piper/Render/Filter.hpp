@@ -20,12 +20,73 @@
 
 #pragma once
 #include <Piper/Render/Math.hpp>
+#include <algorithm>
+#include <array>
 
 PIPER_NAMESPACE_BEGIN
 
+// NOTICE: all filters are separable, evaluate(dx, dy) == evaluate1D(dx) * evaluate1D(dy)
 class Filter : public RefCountBase {
 public:
-    virtual Float evaluate(Float dx, Float dy) const noexcept = 0;
+    virtual Float evaluate1D(Float d) const noexcept = 0;
+    // the support of the filter is [-radius, radius]
+    virtual Float radius() const noexcept = 0;
+    Float evaluate(const Float dx, const Float dy) const noexcept {
+        return evaluate1D(dx) * evaluate1D(dy);
+    }
+};
+
+// Tabulated filter for the 2x2 splatting footprint.
+// For the fractional offset t in [0, 1), the weights of the pixel ix and ix + 1 are f(t) and f(t - 1).
+class FilterTable final {
+    static constexpr uint32_t size = 64;
+    std::array<glm::vec2, size + 1> mTable;
+
+public:
+    explicit FilterTable(const Filter& filter) noexcept {
+        for(uint32_t idx = 0; idx <= size; ++idx) {
+            const auto t = static_cast<Float>(idx) / static_cast<Float>(size);
+            mTable[idx] = { filter.evaluate1D(t), filter.evaluate1D(t - 1.0f) };
+        }
+    }
+
+    [[nodiscard]] glm::vec2 lookup(const Float t) const noexcept {
+        const auto pos = glm::clamp(t, 0.0f, 1.0f) * static_cast<Float>(size);
+        const auto idx = std::min(static_cast<uint32_t>(pos), size - 1);
+        return glm::mix(mTable[idx], mTable[idx + 1], pos - static_cast<Float>(idx));
+    }
+};
+
+// Filter importance sampling: the film offsets are sampled in proportion to |f|, so each sample only contributes to its own pixel.
+class FilterSampler final {
+    static constexpr uint32_t size = 256;
+    Float mRadius;
+    std::array<Float, size> mSign;
+    std::array<Float, size + 1> mCDF;
+
+public:
+    explicit FilterSampler(const Filter& filter) noexcept : mRadius{ filter.radius() } {
+        mCDF[0] = 0.0f;
+        for(uint32_t idx = 0; idx < size; ++idx) {
+            const auto d = (static_cast<Float>(idx) + 0.5f) / static_cast<Float>(size) * 2.0f * mRadius - mRadius;
+            const auto value = filter.evaluate1D(d);
+            mSign[idx] = value < 0.0f ? -1.0f : 1.0f;
+            mCDF[idx + 1] = mCDF[idx] + std::fabs(value);
+        }
+        const auto total = mCDF[size];
+        for(auto& val : mCDF)
+            val = total > 0.0f ? val / total : 0.0f;
+    }
+
+    // returns the offset from the pixel center and the sign of the filter
+    [[nodiscard]] std::pair<Float, Float> sample(const Float u) const noexcept {
+        const auto idx = static_cast<uint32_t>(std::clamp(std::upper_bound(mCDF.cbegin(), mCDF.cend(), u) - mCDF.cbegin() - 1,
+                                                          static_cast<std::ptrdiff_t>(0), static_cast<std::ptrdiff_t>(size - 1)));
+        const auto width = mCDF[idx + 1] - mCDF[idx];
+        const auto frac = width > 0.0f ? (u - mCDF[idx]) / width : 0.5f;
+        const auto d = (static_cast<Float>(idx) + frac) / static_cast<Float>(size) * 2.0f * mRadius - mRadius;
+        return { d, mSign[idx] };
+    }
 };
 
 PIPER_NAMESPACE_END
@@ -20,7 +20,9 @@
 
 #pragma once
 #include <Piper/Core/RefCount.hpp>
+#include <Piper/Core/Stats.hpp>
 #include <Piper/Render/Spectrum.hpp>
+#include <string_view>
 #include <vector>
 
 PIPER_NAMESPACE_BEGIN
@@ -31,6 +33,7 @@ enum class Channel : uint16_t {
     ShadingNormal,
     Position,
     Depth,
+    Cost,  // the mean rendering cost of the samples: CPU ticks, traced rays (extension and shadow) and extension rays (path depth)
 };
 
 constexpr size_t channelSize(const Channel x, const SpectrumType spectrumType) {
@@ -43,6 +46,8 @@ constexpr size_t channelSize(const Channel x, const SpectrumType spectrumType) {
         case Channel::ShadingNormal:
             [[fallthrough]];
         case Channel::Position:
+            [[fallthrough]];
+        case Channel::Cost:
             return 3;
 
         default:
@@ -50,10 +55,41 @@ constexpr size_t channelSize(const Channel x, const SpectrumType spectrumType) {
     }
 }
 
+// the suffixes of the components in the image files (e.g., Albedo.R, ShadingNormal.X, Depth.Z), the color channel has no prefix
+constexpr std::string_view channelComponentName(const Channel x, const size_t size, const size_t idx) {
+    constexpr std::string_view colorNames[] = { "R", "G", "B" };
+    constexpr std::string_view vectorNames[] = { "X", "Y", "Z" };
+    constexpr std::string_view costNames[] = { "Ticks", "Rays", "Depth" };
+    if(x == Channel::Depth)
+        return "Z";
+    if(x == Channel::Cost)
+        return costNames[idx];
+    if(size == 1)
+        return "Y";
+    if(x == Channel::ShadingNormal || x == Channel::Position)
+        return vectorNames[idx];
+    return colorNames[idx];
+}
+
+// the offset of the first pixel and the strides in bytes
 struct ChannelInfo final {
-    uint32_t byteStride;
-    uint32_t pixelStride;
-    uint32_t rowStride;
+    size_t byteStride;
+    size_t pixelStride;
+    size_t rowStride;
+};
+
+enum class ChannelFormat : uint8_t {
+    Float,  // 32-bit float
+    Half    // IEEE 754 binary16, for the AOVs which do not need the full precision (the color channel is always Float)
+};
+
+constexpr size_t formatSize(const ChannelFormat format) noexcept {
+    return format == ChannelFormat::Half ? sizeof(uint16_t) : sizeof(Float);
+}
+
+enum class FrameLayout : uint8_t {
+    Interleaved,  // all channels of a pixel are adjacent
+    Planar        // each channel is stored as a contiguous plane, the components of a channel (e.g., RGB) are still adjacent
 };
 
 struct FrameMetadata final {
@@ -65,8 +101,19 @@ struct FrameMetadata final {
     uint32_t pixelStride;
     SpectrumType spectrumType;
     bool isHDR;
+    FrameLayout layout = FrameLayout::Interleaved;
+    // parallel to channels, empty means all channels are stored as Float
+    std::pmr::vector<ChannelFormat> formats{};
+    FrameStats stats{};  // filled by the renderer, the derived frames keep the stats of their source
 
+    // valid for both layouts and all formats, pixelStride is the sum of the channel sizes in floats
     [[nodiscard]] ChannelInfo view(Channel channel) const;
+    [[nodiscard]] ChannelFormat format(Channel channel) const;
+    // the bytes of a channel of a pixel, padded to the alignment of Float
+    [[nodiscard]] size_t channelBytes(Channel channel) const;
+    [[nodiscard]] size_t pixelBytes() const;
+    // the size of the frame data in floats
+    [[nodiscard]] size_t storageSize() const;
 };
 
 class Frame final : public RefCountBase {
@@ -83,6 +130,21 @@ public:
     const std::pmr::vector<Float>& data() const noexcept {
         return mData;
     }
+
+    // NOTICE: only the frames from makeUnique are allowed to be modified
+    std::pmr::vector<Float>& mutableData() noexcept {
+        return mData;
+    }
+
+    // copy-on-write: the frame is reused if the caller holds the only reference, otherwise a private copy is made
+    [[nodiscard]] static Ref<Frame> makeUnique(Ref<Frame> frame) {
+        if(frame->refCount() == 1)
+            return frame;
+        return makeRefCount<Frame>(frame->mMetadata, std::pmr::vector<Float>{ frame->mData, trackedAllocator(MemoryTag::Frame) });
+    }
+
+    // the frame is returned as is if it is already in the given layout, otherwise the channels are copied to a new frame
+    [[nodiscard]] static Ref<Frame> convertLayout(Ref<Frame> frame, FrameLayout layout);
 };
 
 PIPER_NAMESPACE_END
@@ -20,22 +20,66 @@
 
 #pragma once
 #include <Piper/Render/Intersection.hpp>
+#include <Piper/Render/Ray.hpp>
 #include <Piper/Render/RenderGlobalSetting.hpp>
+#include <Piper/Render/SamplingUtil.hpp>
 
 PIPER_NAMESPACE_BEGIN
 
+// the film of the integrators choosing the pixels of their samples by themselves (e.g., MLT)
+class SplatFilm {
+public:
+    virtual ~SplatFilm() = default;
+    // the film coordinates are sampled from [x0,x1)x[y0,y1) in pixels
+    [[nodiscard]] virtual glm::vec4 bounds() const noexcept = 0;
+    // the camera ray through the film coordinate and its weight
+    virtual std::pair<Ray, Float> sample(glm::vec2 filmCoord, SampleProvider& sampler) const noexcept = 0;
+    // adds the radiance to the pixel of the film coordinate, it is safe to splat concurrently
+    virtual void splat(glm::vec2 filmCoord, const Float* radiance) noexcept = 0;
+};
+
 class IntegratorBase : public RenderVariantBase {
 public:
     virtual void preprocess() const noexcept = 0;
+    // the number of the hero wavelengths derived from each wavelength sample
+    [[nodiscard]] virtual uint32_t heroWavelengths() const noexcept = 0;
+    // called before each progressive pass of the frame, the integrators learning from the previous passes update their state here
+    virtual void beginPass(uint32_t passIdx, const Acceleration& acceleration, const LightSampler& lightSampler) noexcept {}
+    // false if the state learned by the concurrent samples depends on the scheduling
+    [[nodiscard]] virtual bool deterministic() const noexcept {
+        return true;
+    }
+    // the splatting integrators render the passes with renderFilm, estimate is only used by the previews
+    [[nodiscard]] virtual bool splatting() const noexcept {
+        return false;
+    }
+    // renders the samples [sampleBegin, sampleEnd) of each pixel, the renderer adds sampleEnd - sampleBegin to the weight of each pixel
+    virtual void renderFilm(SplatFilm& film, uint32_t sampleBegin, uint32_t sampleEnd, const Acceleration& acceleration,
+                            const LightSampler& lightSampler) const {}
     // output radiance (W/(sr*m^2))
+    // the wavelengths are sampled from wavelengthSample in [0,1) by the renderer, so a primary hit can be shared by several wavelengths
     virtual void estimate(const Ray& ray, const Intersection& intersection, const Acceleration& acceleration,
-                          const LightSampler& lightSampler, SampleProvider& sampler, Float* output) const noexcept = 0;
+                          const LightSampler& lightSampler, SampleProvider& sampler, Float wavelengthSample,
+                          Float* output) const noexcept = 0;
+    // batched version of estimate, the output stride of each ray is 3
+    virtual void estimateBatch(const RayStream& rayStream, const std::pmr::vector<Intersection>& intersections,
+                               const Acceleration& acceleration, const LightSampler& lightSampler,
+                               const std::pmr::vector<SampleProvider*>& samplers, const std::pmr::vector<Float>& wavelengthSamples,
+                               Float* output) const noexcept {
+        for(uint32_t idx = 0; idx < rayStream.size(); ++idx)
+            estimate(rayStream[idx], intersections[idx], acceleration, lightSampler, *samplers[idx], wavelengthSamples[idx],
+                     output + idx * 3);
+    }
 };
 
 template <typename Setting>
 class Integrator : public TypedRenderVariantBase<Setting, IntegratorBase> {
 public:
     PIPER_IMPORT_SETTINGS();
+
+    [[nodiscard]] uint32_t heroWavelengths() const noexcept final {
+        return heroWavelengthCount<Wavelength>();
+    }
 };
 
 PIPER_NAMESPACE_END
@@ -19,6 +19,7 @@
 */
 
 #pragma once
+#include <Piper/Render/Ray.hpp>
 #include <Piper/Render/RenderGlobalSetting.hpp>
 #include <Piper/Render/Texture.hpp>
 #include <Piper/Render/Transform.hpp>
@@ -32,20 +33,55 @@ struct SurfaceHit final {
     Normal<FrameOfReference::World> shadingNormal;   // NOTICE: always outer
     Direction<FrameOfReference::World> dpdu;
     uint32_t primitiveIdx;
+    glm::vec2 faceUV;  // the local coordinates in the primitive
     TexCoord texCoord;
     Float t;
+    Float coneWidth;          // the width of the ray cone at the hit point
+    Float texCoordFootprint;  // the width of the ray cone projected to the texture space
 
     Handle<Material> surface;
+    Handle<Light> areaLight;  // null if the surface does not emit light
+    Handle<Medium> interior;  // null if the shape does not bound a medium
+
+    // the instance and its level of detail, filled by the acceleration structure
+    uint32_t lodInstance = Ray::noInstance;
+    uint32_t lodLevel = 0;
 
     [[nodiscard]] Point<FrameOfReference::World> offsetOrigin(const bool reflection) const noexcept {
         return hit + geometryNormal.asDirection() * Distance::fromRaw(reflection ? epsilon : -epsilon);
     }
 
+    // the rays leaving the surface keep the cone width and the level of detail of the hit
+    [[nodiscard]] Ray spawnRay(const Point<FrameOfReference::World>& origin,
+                               const Direction<FrameOfReference::World>& direction) const noexcept {
+        return Ray{ origin, direction, t, coneWidth, 0.0f, lodInstance, lodLevel };
+    }
+
+    void continueRay(Ray& ray, const Point<FrameOfReference::World>& origin) const noexcept {
+        ray.origin = origin;
+        ray.lodInstance = lodInstance;
+        ray.lodLevel = lodLevel;
+    }
+
     [[nodiscard]] TextureEvaluateInfo makeTextureEvaluateInfo() const noexcept {
-        return { texCoord, t, primitiveIdx };
+        return { texCoord, t, primitiveIdx, texCoordFootprint, faceUV };
     }
 };
 
 using Intersection = std::variant<std::monostate, SurfaceHit>;
 
+// the compact record of a traced hit, the surface hit is reconstructed by Acceleration::resolve when it is shaded
+struct HitRecord final {
+    uint32_t instID;
+    uint32_t levelIdx;  // the level of detail of the instance
+    uint32_t primID;
+    glm::vec2 uv;
+    Float distance;            // infinity if missed
+    glm::vec3 geometryNormal;  // NOTICE: not normalized
+
+    [[nodiscard]] bool valid() const noexcept {
+        return distance < infinity;
+    }
+};
+
 PIPER_NAMESPACE_END
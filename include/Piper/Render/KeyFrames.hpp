@@ -50,6 +50,7 @@ struct ResolvedTransform final {
     InterpolationCurve curve = InterpolationCurve::Hold;
 
     SRTTransform operator()(Float t) const noexcept;
+    bool operator==(const ResolvedTransform& rhs) const noexcept;
 };
 
 ResolvedTransform resolveTransform(const KeyFrames& keyFrames, TimeInterval interval);
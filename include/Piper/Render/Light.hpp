@@ -23,8 +23,10 @@
 #include <Piper/Render/Radiometry.hpp>
 #include <Piper/Render/Ray.hpp>
 #include <Piper/Render/RenderGlobalSetting.hpp>
+#include <Piper/Render/SamplingUtil.hpp>
 #include <Piper/Render/SceneObject.hpp>
 #include <Piper/Render/ShadingContext.hpp>
+#include <optional>
 
 PIPER_NAMESPACE_BEGIN
 
@@ -39,6 +41,12 @@ public:
     }
 
     virtual void preprocess(const Float &sceneRadius) {}
+    // the representative location of the localized lights, used by the spatial light samplers
+    [[nodiscard]] virtual std::optional<Point<FrameOfReference::World>> position() const noexcept {
+        return std::nullopt;
+    }
+    // AreaLights only, called once by the emissive shape owning the light
+    virtual void attachShape(const Shape& shape) {}
 
     [[nodiscard]] virtual Power<MonoSpectrum> power() const noexcept = 0;
 };
@@ -49,6 +57,8 @@ struct LightLiSample final {
     Radiance<Spectrum, PdfType::Light | PdfType::LightSampler> rad;
     InversePdf<PdfType::Light> inversePdf;
     Distance distance;
+    // the outer normal of the sampled point on the area lights, zero for the others
+    Normal<FrameOfReference::World> normal = Normal<FrameOfReference::World>::fromRaw(glm::zero<glm::vec3>());
 
     static LightLiSample invalid() noexcept {
         return LightLiSample{ Direction<FrameOfReference::World>::undefined(),
@@ -67,6 +77,8 @@ struct LightLeSample final {
     Intensity<Spectrum> intensity;
     InversePdf<PdfType::LightPos> inversePdfPos;
     InversePdf<PdfType::LightDir> inversePdfDir;
+    // the outer normal of the sampled point on the area lights, zero for the others
+    Normal<FrameOfReference::World> normal = Normal<FrameOfReference::World>::fromRaw(glm::zero<glm::vec3>());
 
     static LightLeSample invalid() noexcept {
         return LightLeSample{ Ray::undefined(), Intensity<Spectrum>::undefined(), InversePdf<PdfType::LightPos>::invalid(),
@@ -88,8 +100,9 @@ public:
     virtual InversePdf<PdfType::Light> inversePdfLi(const ShadingContext<Setting>& ctx,
                                                     const Direction<FrameOfReference::World>& wi) const noexcept = 0;
     virtual LightLeSample<Spectrum> sampleLe(const ShadingContext<Setting>& ctx, SampleProvider& sampler) const noexcept = 0;
-    virtual std::pair<InversePdf<PdfType::LightPos>, InversePdf<PdfType::LightDir>> pdfLe(const ShadingContext<Setting>& ctx,
-                                                                                          const Ray& ray) const noexcept = 0;
+    // the origin of the ray is on the light, the normal is the outer normal of the area lights at the origin
+    virtual std::pair<InversePdf<PdfType::LightPos>, InversePdf<PdfType::LightDir>>
+    pdfLe(const ShadingContext<Setting>& ctx, const Ray& ray, const Normal<FrameOfReference::World>& normal) const noexcept = 0;
     // InfiniteLights only
     virtual Radiance<Spectrum> evalLe(const ShadingContext<Setting>& ctx, const Ray& ray) const noexcept {
         return Radiance<Spectrum>::zero();
@@ -98,11 +111,49 @@ public:
     virtual Radiance<Spectrum> evalL(const ShadingContext<Setting>& ctx, const Intersection& intersection) const noexcept {
         return Radiance<Spectrum>::zero();
     }
+    // AreaLights only, the solid angle pdf of sampleLi from the origin of the ray hitting the light
+    virtual InversePdf<PdfType::Light> inversePdfL(const ShadingContext<Setting>& ctx, const Intersection& intersection,
+                                                   const Ray& ray) const noexcept {
+        return InversePdf<PdfType::Light>::invalid();
+    }
 
     virtual std::pair<InversePdf<PdfType::LightPos>, InversePdf<PdfType::LightDir>>
     inversePdfLe(const ShadingContext<Setting>& ctx, const Intersection& intersection, const Ray& ray) const noexcept {
         return { InversePdf<PdfType::LightPos>::invalid(), InversePdf<PdfType::LightDir>::invalid() };
     }
+
+    // Please refer to pbrt-v4 section 12.5.
+    // The lights without a position emit from a disk covering the bounding sphere of the scene, which is perpendicular to the
+    // direction sampled by sampleLi. The radiance of the direction is the intensity of the disk.
+    [[nodiscard]] LightLeSample<Spectrum> sampleLeFromScene(const ShadingContext<Setting>& ctx,
+                                                            const Point<FrameOfReference::World>& sceneCenter, const Float sceneRadius,
+                                                            SampleProvider& sampler) const noexcept {
+        const auto sampled = sampleLi(ctx, sceneCenter, sampler);
+        if(!sampled.valid())
+            return LightLeSample<Spectrum>::invalid();
+
+        // Please refer to "Building an Orthonormal Basis, Revisited" (Duff et al. 2017)
+        const auto w = sampled.dir.raw();
+        const auto sign = std::copysign(1.0f, w.z);
+        const auto a = -1.0f / (sign + w.z);
+        const auto b = w.x * w.y * a;
+        const glm::vec3 t{ 1.0f + sign * w.x * w.x * a, sign * b, -sign * w.x };
+        const glm::vec3 s{ b, sign + w.y * w.y * a, -w.y };
+
+        const auto offset = sampleConcentricDisk(sampler.sampleVec2());
+        const auto origin = Point<FrameOfReference::World>::fromRaw(sceneCenter.raw() + sceneRadius * (w + offset.x * t + offset.y * s));
+        return LightLeSample<Spectrum>{ Ray{ origin, -sampled.dir, ctx.t }, Intensity<Spectrum>::fromRaw(sampled.rad.raw()),
+                                        InversePdf<PdfType::LightPos>::fromRaw(pi * sqr(sceneRadius)),
+                                        InversePdf<PdfType::LightDir>::fromRaw(sampled.inversePdf.raw()) };
+    }
+    // the densities of sampleLeFromScene, the direction of the delta lights has the identity inverse pdf
+    [[nodiscard]] std::pair<InversePdf<PdfType::LightPos>, InversePdf<PdfType::LightDir>>
+    pdfLeFromScene(const ShadingContext<Setting>& ctx, const Ray& ray, const Float sceneRadius) const noexcept {
+        const auto inversePdfDir = match(this->attributes(), LightAttributes::Delta) ? InversePdf<PdfType::Light>::identity() :
+                                                                                       inversePdfLi(ctx, -ray.direction);
+        return { InversePdf<PdfType::LightPos>::fromRaw(pi * sqr(sceneRadius)),
+                 InversePdf<PdfType::LightDir>::fromRaw(inversePdfDir.raw()) };
+    }
 };
 
 PIPER_NAMESPACE_END
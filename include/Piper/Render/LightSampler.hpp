@@ -21,13 +21,90 @@
 #pragma once
 
 #include <Piper/Render/Light.hpp>
+#include <algorithm>
 
 PIPER_NAMESPACE_BEGIN
 
+// O(1) sampling of a discrete distribution with Vose's alias method
+class AliasTable final {
+    struct Entry final {
+        Float threshold;
+        uint32_t alias;
+    };
+
+    std::pmr::vector<Entry> mEntries{ context().globalAllocator };
+    std::pmr::vector<Float> mProbability{ context().globalAllocator };
+
+public:
+    // the weights should be non-negative and their sum should be positive
+    void build(const std::pmr::vector<Float>& weights) {
+        const auto size = static_cast<uint32_t>(weights.size());
+        Float sum = 0.0f;
+        for(const auto weight : weights)
+            sum += weight;
+
+        mEntries.resize(size);
+        mProbability.resize(size);
+        std::pmr::vector<Float> scaled{ size, context().scopedAllocator };
+        std::pmr::vector<uint32_t> small{ context().scopedAllocator }, large{ context().scopedAllocator };
+        for(uint32_t idx = 0; idx < size; ++idx) {
+            mProbability[idx] = weights[idx] / sum;
+            scaled[idx] = mProbability[idx] * static_cast<Float>(size);
+            (scaled[idx] < 1.0f ? small : large).push_back(idx);
+        }
+
+        while(!small.empty() && !large.empty()) {
+            const auto s = small.back();
+            small.pop_back();
+            const auto l = large.back();
+            mEntries[s] = { scaled[s], l };
+            scaled[l] -= 1.0f - scaled[s];
+            if(scaled[l] < 1.0f) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // the remaining entries are full up to rounding errors
+        for(const auto idx : large)
+            mEntries[idx] = { 1.0f, idx };
+        for(const auto idx : small)
+            mEntries[idx] = { 1.0f, idx };
+    }
+
+    // the integral part of the scaled u selects the bucket and the fractional part selects the entry in it
+    [[nodiscard]] uint32_t sample(const Float u) const noexcept {
+        const auto scaled = u * static_cast<Float>(mEntries.size());
+        const auto idx = std::min(static_cast<uint32_t>(scaled), static_cast<uint32_t>(mEntries.size()) - 1);
+        const auto& entry = mEntries[idx];
+        return scaled - static_cast<Float>(idx) < entry.threshold ? idx : entry.alias;
+    }
+
+    [[nodiscard]] Float probability(const uint32_t idx) const noexcept {
+        return mProbability[idx];
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return mEntries.empty();
+    }
+};
+
 class LightSampler : public RefCountBase {
 public:
     virtual void preprocess(const std::pmr::vector<LightBase*>& lights, const Float &sceneRadius) = 0;
-    virtual std::pair<Handle<Light>, InversePdf<PdfType::LightSampler>> sample(SampleProvider& sampler) const noexcept = 0;
+    // only the lights in changed are moved or modified since the last preprocess, and the scene radius is unchanged.
+    // The samplers without incremental updates rebuild everything.
+    virtual void update(const std::pmr::vector<LightBase*>& lights, const std::span<LightBase* const> changed, const Float& sceneRadius) {
+        preprocess(lights, sceneRadius);
+    }
+    // pos and normal describe the shading point. The lights below the normal may be skipped, so a zero normal should be passed
+    // if the surface transmits light.
+    // NOTICE: a null handle with the invalid inverse pdf is returned if there are no lights
+    virtual std::pair<Handle<Light>, InversePdf<PdfType::LightSampler>>
+    sample(SampleProvider& sampler, const Point<FrameOfReference::World>& pos,
+           const Normal<FrameOfReference::World>& normal) const noexcept = 0;
+    // the inverse probability of selecting the light by sample with the same shading point, used by MIS
+    virtual InversePdf<PdfType::LightSampler> inversePdf(const LightBase* light, const Point<FrameOfReference::World>& pos,
+                                                         const Normal<FrameOfReference::World>& normal) const noexcept = 0;
     virtual std::span<const Handle<Light>> infiniteLights() const noexcept = 0;
 };
 
@@ -0,0 +1,102 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <Piper/Core/Context.hpp>
+#include <Piper/Render/Math.hpp>
+#include <functional>
+#include <limits>
+#include <vector>
+
+PIPER_NAMESPACE_BEGIN
+
+// A coarse grid of the maximum densities over the bounds of a volume. The free-flight sampling steps through the cells with a 3D DDA
+// and uses the majorant of each cell, so the tracking takes large steps in the sparse regions instead of being bounded by the global
+// maximum density.
+class MajorantGrid final {
+    glm::vec3 mLower{ 0.0f };
+    glm::vec3 mUpper{ 0.0f };
+    glm::ivec3 mResolution{ 0 };
+    std::pmr::vector<Float> mMajorants{ context().globalAllocator };
+
+    [[nodiscard]] Float majorant(const glm::ivec3& cell) const noexcept {
+        return mMajorants[(static_cast<size_t>(cell.z) * mResolution.y + cell.y) * mResolution.x + cell.x];
+    }
+
+public:
+    // maxDensity(lower, upper) returns the maximum density within the box of a cell, the cells are evaluated in parallel
+    void build(const glm::vec3& lower, const glm::vec3& upper, const glm::ivec3& resolution,
+               const std::function<Float(const glm::vec3&, const glm::vec3&)>& maxDensity);
+
+    [[nodiscard]] bool empty() const noexcept {
+        return mMajorants.empty();
+    }
+
+    // Invokes callback(t0, t1, majorant) for the cells along the ray in order, the traversal stops if the callback returns false.
+    // The segments are clipped to [0, tMax) and the bounds of the grid.
+    template <typename Callback>
+    void traverse(const glm::vec3& origin, const glm::vec3& dir, const Float tMax, Callback&& callback) const noexcept {
+        if(mMajorants.empty())
+            return;
+
+        const auto invDir = 1.0f / dir;
+        const auto ta = (mLower - origin) * invDir, tb = (mUpper - origin) * invDir;
+        const auto tMin3 = glm::min(ta, tb), tMax3 = glm::max(ta, tb);
+        const auto tNear = std::fmax(std::fmax(tMin3.x, tMin3.y), std::fmax(tMin3.z, 0.0f));
+        const auto tFar = std::fmin(std::fmin(tMax3.x, tMax3.y), std::fmin(tMax3.z, tMax));
+        if(!(tNear < tFar))
+            return;
+
+        const auto cellSize = (mUpper - mLower) / glm::vec3{ mResolution };
+        auto cell = glm::clamp(glm::ivec3{ glm::floor((origin + dir * tNear - mLower) / cellSize) }, glm::ivec3{ 0 }, mResolution - 1);
+        glm::ivec3 step;  // NOLINT(cppcoreguidelines-pro-type-member-init)
+        glm::vec3 next, delta;
+        for(glm::length_t axis = 0; axis < 3; ++axis) {
+            if(dir[axis] > 0.0f) {
+                step[axis] = 1;
+                next[axis] = (mLower[axis] + static_cast<Float>(cell[axis] + 1) * cellSize[axis] - origin[axis]) * invDir[axis];
+                delta[axis] = cellSize[axis] * invDir[axis];
+            } else if(dir[axis] < 0.0f) {
+                step[axis] = -1;
+                next[axis] = (mLower[axis] + static_cast<Float>(cell[axis]) * cellSize[axis] - origin[axis]) * invDir[axis];
+                delta[axis] = -cellSize[axis] * invDir[axis];
+            } else {
+                step[axis] = 0;
+                next[axis] = delta[axis] = std::numeric_limits<Float>::infinity();
+            }
+        }
+
+        auto t = tNear;
+        while(true) {
+            const auto axis = next.x < next.y ? (next.x < next.z ? 0 : 2) : (next.y < next.z ? 1 : 2);
+            const auto tExit = std::fmin(next[axis], tFar);
+            if(!callback(t, tExit, majorant(cell)) || tExit >= tFar)
+                return;
+
+            t = tExit;
+            cell[axis] += step[axis];
+            if(cell[axis] < 0 || cell[axis] >= mResolution[axis])
+                return;
+            next[axis] += delta[axis];
+        }
+    }
+};
+
+PIPER_NAMESPACE_END
@@ -52,6 +52,8 @@ constexpr auto oneMinusEpsilon = static_cast<Float>(0x1.fffffep-1);
 glm::vec2 parseVec2(const Ref<ConfigAttr>& node);
 glm::vec3 parseVec3(const Ref<ConfigAttr>& node);
 glm::quat parseQuat(const Ref<ConfigAttr>& node);
+// the numbers of a numeric array in row-major order, each row (a nested array or a slice of the flat array) has width numbers
+std::pmr::vector<Float> parseFloats(const Ref<ConfigAttr>& node, uint32_t width, std::pmr::memory_resource* allocator);
 void initFloatingPointEnvironment() noexcept;
 
 struct FloatingPointExceptionProbe final {
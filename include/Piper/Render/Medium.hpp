@@ -0,0 +1,85 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <Piper/Render/Radiometry.hpp>
+#include <Piper/Render/Ray.hpp>
+#include <Piper/Render/RenderGlobalSetting.hpp>
+#include <Piper/Render/Sampler.hpp>
+#include <Piper/Render/ShadingContext.hpp>
+#include <optional>
+
+PIPER_NAMESPACE_BEGIN
+
+// Please refer to https://pbr-book.org/3ed-2018/Volume_Scattering/Phase_Functions
+// NOTICE: wo points away from the scattering point, so the forward scattering has dot(wo, wi) close to -1
+inline Float henyeyGreenstein(const Float cosTheta, const Float g) noexcept {
+    const auto denom = 1.0f + g * g + 2.0f * g * cosTheta;
+    return (1.0f - g * g) / (fourPi * denom * std::sqrt(std::fmax(denom, epsilon)));
+}
+
+inline glm::vec3 sampleHenyeyGreenstein(const glm::vec3& wo, const Float g, const glm::vec2 u) noexcept {
+    Float cosTheta;
+    if(std::fabs(g) < 1e-3f)
+        cosTheta = 1.0f - 2.0f * u.x;
+    else {
+        const auto sqrTerm = (1.0f - g * g) / (1.0f + g - 2.0f * g * u.x);
+        cosTheta = -(1.0f + g * g - sqrTerm * sqrTerm) / (2.0f * g);
+    }
+    const auto sinTheta = std::sqrt(std::fmax(0.0f, 1.0f - cosTheta * cosTheta));
+    const auto phi = twoPi * u.y;
+
+    // Please refer to "Building an Orthonormal Basis, Revisited" (Duff et al. 2017)
+    const auto sign = std::copysign(1.0f, wo.z);
+    const auto a = -1.0f / (sign + wo.z);
+    const auto b = wo.x * wo.y * a;
+    const glm::vec3 t{ 1.0f + sign * wo.x * wo.x * a, sign * b, -sign * wo.x };
+    const glm::vec3 s{ b, sign + wo.y * wo.y * a, -wo.y };
+    return glm::normalize(sinTheta * std::cos(phi) * t + sinTheta * std::sin(phi) * s + cosTheta * wo);
+}
+
+// a real collision sampled along a ray segment
+template <typename Setting>
+struct MediumInteraction final {
+    PIPER_IMPORT_SETTINGS();
+
+    Point<FrameOfReference::World> pos;
+    Rational<Spectrum> albedo;  // the throughput of the collision divided by its pdf
+    Float g;                    // the anisotropy of the Henyey-Greenstein phase function
+};
+
+class MediumBase : public RenderVariantBase {};
+
+// The participating media fill the interiors of the shapes. The extinction is gray, so the free-flight distance does not depend on
+// the wavelength and only the single-scattering albedo is spectral.
+template <typename Setting>
+class Medium : public TypedRenderVariantBase<Setting, MediumBase> {
+public:
+    PIPER_IMPORT_SETTINGS();
+
+    // samples a real collision within the distance by delta tracking, std::nullopt if the ray passes the segment
+    virtual std::optional<MediumInteraction<Setting>> sample(const ShadingContext<Setting>& ctx, const Ray& ray, Distance distance,
+                                                             SampleProvider& sampler) const noexcept = 0;
+    // the unbiased estimation of the transmittance of the segment by ratio tracking
+    virtual Float transmittance(const ShadingContext<Setting>& ctx, const Ray& ray, Distance distance,
+                                SampleProvider& sampler) const noexcept = 0;
+};
+
+PIPER_NAMESPACE_END
@@ -0,0 +1,149 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <Piper/Core/Context.hpp>
+#include <Piper/Render/Math.hpp>
+#include <array>
+#include <atomic>
+#include <vector>
+
+PIPER_NAMESPACE_BEGIN
+
+// Please refer to "Practical Path Guiding for Efficient Light-Transport Simulation" (Muller et al. 2017).
+// The directions are mapped to [0,1]^2 by the cylindrical equal-area mapping, so the solid angle pdf is the pdf over [0,1]^2 / (4*pi).
+inline glm::vec2 directionToCylindrical(const glm::vec3 dir) noexcept {
+    const auto phi = std::atan2(dir.y, dir.x);
+    return { std::clamp((dir.z + 1.0f) * 0.5f, 0.0f, 1.0f), (phi < 0.0f ? phi + twoPi : phi) * invTwoPi };
+}
+
+inline glm::vec3 cylindricalToDirection(const glm::vec2 p) noexcept {
+    const auto cosTheta = 2.0f * p.x - 1.0f;
+    const auto sinTheta = std::sqrt(std::fmax(0.0f, 1.0f - cosTheta * cosTheta));
+    const auto phi = p.y * twoPi;
+    return { sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta };
+}
+
+// The directional quadtree, each node stores the energy of its four quadrants.
+// NOTICE: the topology is fixed while the samples are recorded, so the recording only needs atomic additions.
+class DirectionalQuadTree final {
+    struct Node final {
+        std::array<Float, 4> sums{};
+        std::array<uint32_t, 4> children{};  // 0 means leaf
+    };
+    std::pmr::vector<Node> mNodes{ context().globalAllocator };
+
+    // returns the quadrant of p and maps p to the quadrant
+    static uint32_t descend(glm::vec2& p) noexcept {
+        const auto x = p.x >= 0.5f ? 1U : 0U, y = p.y >= 0.5f ? 1U : 0U;
+        p = glm::clamp(p * 2.0f - glm::vec2{ static_cast<Float>(x), static_cast<Float>(y) }, 0.0f, oneMinusEpsilon);
+        return x | (y << 1);
+    }
+
+public:
+    [[nodiscard]] bool empty() const noexcept {
+        return mNodes.empty();
+    }
+
+    [[nodiscard]] Float total() const noexcept {
+        if(mNodes.empty())
+            return 0.0f;
+        const auto& sums = mNodes.front().sums;
+        return sums[0] + sums[1] + sums[2] + sums[3];
+    }
+
+    [[nodiscard]] uint32_t nodeCount() const noexcept {
+        return static_cast<uint32_t>(mNodes.size());
+    }
+
+    // a single node with four empty quadrants
+    void reset() {
+        mNodes.assign(1, Node{});
+    }
+
+    void record(glm::vec2 p, const Float value) noexcept {
+        if(mNodes.empty())
+            return;
+        uint32_t idx = 0;
+        while(true) {
+            auto& node = mNodes[idx];
+            const auto child = descend(p);
+            std::atomic_ref{ node.sums[child] }.fetch_add(value, std::memory_order_relaxed);
+            if(!node.children[child])
+                return;
+            idx = node.children[child];
+        }
+    }
+
+    // returns the sampled point and its pdf over [0,1]^2
+    [[nodiscard]] std::pair<glm::vec2, Float> sample(glm::vec2 u) const noexcept;
+    [[nodiscard]] Float pdf(glm::vec2 p) const noexcept;
+
+    // Subdivides the quadrants holding more than the given fraction of the total energy and merges the others.
+    // The energy of the returned tree is cleared.
+    [[nodiscard]] DirectionalQuadTree refine(Float threshold, uint32_t maxDepth) const;
+};
+
+// The spatial part is a hash grid over the scene with a pair of directional quadtrees per cell: the sampling tree is learned from
+// the previous pass and stays read-only, the building tree collects the samples of the current pass.
+// NOTICE: the cells are claimed by lock-free insertions during the pass, and start learning from the next pass.
+class GuidingField final {
+    struct Cell final {
+        DirectionalQuadTree sampling;
+        DirectionalQuadTree building;
+    };
+
+    std::pmr::vector<uint64_t> mKeys{ context().globalAllocator };  // 0 means empty
+    std::pmr::vector<Cell> mCells{ context().globalAllocator };
+    Float mInvCellSize = 1.0f;
+    Float mThreshold;
+    uint32_t mMaxDepth;
+
+    [[nodiscard]] uint64_t key(const glm::vec3& pos) const noexcept {
+        constexpr auto bound = static_cast<Float>(1 << 20);
+        const auto cell = glm::clamp(glm::floor(pos * mInvCellSize), -bound, bound - 1.0f) + bound;
+        return (static_cast<uint64_t>(cell.x) | (static_cast<uint64_t>(cell.y) << 21) | (static_cast<uint64_t>(cell.z) << 42)) + 1;
+    }
+    [[nodiscard]] uint32_t hash(uint64_t key) const noexcept {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        return static_cast<uint32_t>(key) & static_cast<uint32_t>(mKeys.size() - 1);
+    }
+    // returns the slot of the cell, or the capacity if the cell is missing
+    [[nodiscard]] uint32_t locate(uint64_t key) const noexcept;
+    // inserts the cell if it is missing, returns the capacity if the grid is full
+    uint32_t claim(uint64_t key) noexcept;
+
+public:
+    GuidingField(uint32_t capacity, Float threshold, uint32_t maxDepth);
+
+    // removes all cells
+    void reset(Float cellSize);
+    // the building trees become the sampling trees, then they are refined for the next pass
+    void refine();
+
+    // the learned distribution around pos, nullptr if it is not trained yet
+    [[nodiscard]] const DirectionalQuadTree* find(const glm::vec3& pos) const noexcept;
+    // records the incident radiance divided by the pdf of the direction
+    void record(const glm::vec3& pos, const glm::vec3& dir, Float value) noexcept;
+};
+
+PIPER_NAMESPACE_END
@@ -20,12 +20,16 @@
 
 #pragma once
 #include <Piper/Core/RefCount.hpp>
+#include <string_view>
 
 PIPER_NAMESPACE_BEGIN
 
 class Pipeline : public RefCountBase {
 public:
     virtual void execute() = 0;
+    // keep the scene resident and execute the jobs received from address:port until a shutdown request
+    // NOTICE: the jobs are not authenticated and may read or write any path, so only the loopback address is safe
+    virtual void serve(std::string_view address, uint16_t port) = 0;
 };
 
 PIPER_NAMESPACE_END
@@ -19,7 +19,9 @@
 */
 
 #pragma once
+#include <Piper/Core/ConfigNode.hpp>
 #include <Piper/Render/Frame.hpp>
+#include <optional>
 
 PIPER_NAMESPACE_BEGIN
 
@@ -29,6 +31,17 @@ public:
 
     virtual ChannelRequirement setup(ChannelRequirement req) = 0;
     virtual Ref<Frame> transform(Ref<Frame> frame) = 0;
+    // called after the last frame of each execution, the sinks writing several frames to one output finish it here
+    virtual void finish() {}
+    // the stateless nodes are allowed to transform several frames concurrently
+    [[nodiscard]] virtual bool stateless() const noexcept {
+        return false;
+    }
+    // the layout the kernels of the node are fast on, the frames are converted before the node if necessary
+    // nullopt means the node accesses the channels through FrameMetadata::view, so both layouts are accepted as is
+    [[nodiscard]] virtual std::optional<FrameLayout> layout() const noexcept {
+        return std::nullopt;
+    }
 };
 
 void mergeRequirement(PipelineNode::ChannelRequirement& lhs, PipelineNode::ChannelRequirement rhs);
@@ -36,6 +49,12 @@ void mergeRequirement(PipelineNode::ChannelRequirement& lhs, PipelineNode::Chann
 class SourceNode : public PipelineNode {
 public:
     virtual uint32_t frameCount() = 0;
+    // the size of the largest frame in bytes, used for bounding the frames in flight
+    virtual size_t frameBytes() = 0;
+    // server mode: the job overrides parts of the configuration, the frames are rendered again from the first one
+    virtual void applyJob(const Ref<ConfigNode>& job) = 0;
+    // the layout of the frames produced by the source, negotiated with the nodes after setup
+    virtual void setLayout(FrameLayout layout) = 0;
 };
 
 PIPER_NAMESPACE_END
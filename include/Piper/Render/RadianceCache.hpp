@@ -0,0 +1,80 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <Piper/Core/Context.hpp>
+#include <Piper/Render/Math.hpp>
+#include <optional>
+#include <vector>
+
+PIPER_NAMESPACE_BEGIN
+
+// A coarse world-space cache of the radiance leaving the surfaces, learned across the progressive passes.
+// The cells are keyed by the position and the dominant axis of the normal, so the two sides of a thin wall do not mix.
+// NOTICE: the records of a pass are accumulated by atomic additions, the learned averages are only refreshed between the passes.
+class RadianceCache final {
+    struct Cell final {
+        glm::vec3 sum{};
+        Float count = 0.0f;
+        glm::vec3 learned{};
+        bool trained = false;
+    };
+
+    std::pmr::vector<uint64_t> mKeys{ context().globalAllocator };  // 0 means empty
+    std::pmr::vector<Cell> mCells{ context().globalAllocator };
+    Float mInvCellSize = 1.0f;
+
+    [[nodiscard]] uint64_t key(const glm::vec3& pos, const glm::vec3& normal) const noexcept {
+        constexpr auto bound = static_cast<Float>(1 << 19);
+        const auto cell = glm::clamp(glm::floor(pos * mInvCellSize), -bound, bound - 1.0f) + bound;
+        const auto absNormal = glm::abs(normal);
+        const auto axis = absNormal.x > absNormal.y ? (absNormal.x > absNormal.z ? 0 : 2) : (absNormal.y > absNormal.z ? 1 : 2);
+        const auto side = static_cast<uint64_t>(axis * 2 + (normal[axis] < 0.0f ? 1 : 0));
+        return (static_cast<uint64_t>(cell.x) | (static_cast<uint64_t>(cell.y) << 20) | (static_cast<uint64_t>(cell.z) << 40) |
+                (side << 60)) +
+            1;
+    }
+    [[nodiscard]] uint32_t hash(uint64_t key) const noexcept {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        return static_cast<uint32_t>(key) & static_cast<uint32_t>(mKeys.size() - 1);
+    }
+    // returns the slot of the cell, or the capacity if the cell is missing
+    [[nodiscard]] uint32_t locate(uint64_t key) const noexcept;
+    // inserts the cell if it is missing, returns the capacity if the cache is full
+    uint32_t claim(uint64_t key) noexcept;
+
+public:
+    explicit RadianceCache(uint32_t capacity);
+
+    // removes all cells
+    void reset(Float cellSize);
+    // the averages of all records so far become the learned radiance
+    void update();
+
+    // the learned radiance around pos, std::nullopt if it is not trained yet
+    [[nodiscard]] std::optional<glm::vec3> find(const glm::vec3& pos, const glm::vec3& normal) const noexcept;
+    // The count is the number of the estimates the record stands for. The branches of a split path record their shares of the
+    // inherited vertices with zero count, so the sum over the branches is a single estimate.
+    void record(const glm::vec3& pos, const glm::vec3& normal, const glm::vec3& value, Float count = 1.0f) noexcept;
+};
+
+PIPER_NAMESPACE_END
@@ -21,6 +21,7 @@
 #pragma once
 #include <Piper/Render/RenderGlobalSetting.hpp>
 #include <Piper/Render/Transform.hpp>
+#include <limits>
 
 PIPER_NAMESPACE_BEGIN
 
@@ -29,6 +30,15 @@ struct Ray final {
     Direction<FrameOfReference::World> direction;
 
     Float t;
+    // the ray cone used to select the texture levels, the footprint width is coneWidth + coneSpread * distance
+    Float coneWidth = 0.0f;
+    Float coneSpread = 0.0f;
+    // the rays spawned from a surface stay on the level of detail of its instance, so that they never hit the other levels of the
+    // same surface (e.g., the shadow rays of a coarse level would be blocked by the finest one)
+    uint32_t lodInstance = noInstance;
+    uint32_t lodLevel = 0;
+
+    static constexpr uint32_t noInstance = std::numeric_limits<uint32_t>::max();
 
     static constexpr Ray undefined() noexcept {
         return Ray{ Point<FrameOfReference::World>::undefined(), Direction<FrameOfReference::World>::undefined(), 0.0f };
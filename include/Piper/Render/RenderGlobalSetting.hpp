@@ -96,11 +96,13 @@ public:
 using RSSMono = RenderStaticSetting<MonoSpectrum>;
 using RSSRGB = RenderStaticSetting<RGBSpectrum>;
 using RSSSpectral = RenderStaticSetting<SampledSpectrum>;
+using RSSSpectral8 = RenderStaticSetting<SampledSpectrum8>;
+using RSSSpectral16 = RenderStaticSetting<SampledSpectrum16>;
 using RSSMonoSpectral = RenderStaticSetting<MonoWavelengthSpectrum>;
 /*
 using RSSMonoPolarized = RenderStaticSetting<MuellerMatrix<MonoSpectrum>>;
 using RSSRGBPolarized = RenderStaticSetting<MuellerMatrix<RGBSpectrum>>;
-using RSSSpectralPolarized = RenderStaticSetting<MuellerMatrix<SpectralSpectrum>>;
+using RSSSpectralPolarized = RenderStaticSetting<MuellerMatrix<SampledSpectrum>>;
 */
 
 struct RenderGlobalSetting final {
@@ -108,6 +110,17 @@ struct RenderGlobalSetting final {
     SpectrumType spectrumType;
     Ref<AccelerationBuilder> accelerationBuilder;
     MonoWavelengthSpectrum sampledWavelength = MonoWavelengthSpectrum::undefined();
+    // the imported meshes are stored in the native format here, empty means disabled
+    fs::path meshCacheDirectory;
+    // the decoded texture tiles are kept within the budget (in bytes)
+    size_t textureCacheBudget = static_cast<size_t>(1) << 30;
+    // the textures are converted to tiled and mipmapped .tx files here, empty means disabled
+    fs::path textureCacheDirectory;
+    bool textureHalfFloat = false;
+    // the Ptex files manage their own cache of the face data within the budget (in bytes), PtexCacheBudget is given in MB (10^6 bytes)
+    size_t ptexCacheBudget = static_cast<size_t>(256) * 1000 * 1000;
+    // the generated code of the compiled materials (e.g. MDL) is stored here, empty means disabled
+    fs::path materialCacheDirectory;
 
     static RenderGlobalSetting& get() noexcept;
 };
@@ -125,7 +138,7 @@ auto makeVariant(const Ref<ConfigNode>& node) {
 
 #undef PIPER_VARIANT_FUNC
 
-    fatal(fmt::format("Unrecognized variant {}", variant));
+    fatal(fmt::format("Unrecognized variant {}, the variants not listed in PIPER_VARIANTS are not built", variant));
 }
 
 template <template <typename> typename Class, template <typename> typename Base>
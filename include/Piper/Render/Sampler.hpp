@@ -21,14 +21,57 @@
 #pragma once
 #include <Piper/Core/RefCount.hpp>
 #include <Piper/Render/Random.hpp>
+#include <array>
+#include <span>
+#include <tuple>
 
 PIPER_NAMESPACE_BEGIN
 
+class SampleGenerator {
+public:
+    // fill the samples of dimensions [dimBegin, dimBegin + count)
+    virtual void generate(uint64_t sequenceIndex, uint32_t dimBegin, uint32_t count, Float* res) const noexcept = 0;
+
+protected:
+    ~SampleGenerator() = default;
+};
+
 class SampleProvider final {
+public:
+    static constexpr uint32_t chunkSize = 16;
+
+private:
     std::pmr::vector<Float> mGeneratedSamples;
     uint32_t mIndex = 0;
+    uint32_t mSize = 0;
     RandomEngine mFallback;
 
+    // lazy generation
+    const SampleGenerator* mGenerator = nullptr;
+    uint64_t mSequenceIndex = 0;
+    uint32_t mNextDim = 0;
+    uint32_t mDims = 0;
+    std::array<Float, chunkSize> mChunk{};
+
+    Float* data() noexcept {
+        return mGenerator ? mChunk.data() : mGeneratedSamples.data();
+    }
+
+    SampleProvider(const SampleProvider& rhs, std::pmr::memory_resource* allocator)
+        : mGeneratedSamples{ rhs.mGeneratedSamples, allocator }, mIndex{ rhs.mIndex }, mSize{ rhs.mSize }, mFallback{ rhs.mFallback },
+          mGenerator{ rhs.mGenerator }, mSequenceIndex{ rhs.mSequenceIndex }, mNextDim{ rhs.mNextDim }, mDims{ rhs.mDims },
+          mChunk{ rhs.mChunk } {}
+
+    bool refill() noexcept {
+        if(!mGenerator || mNextDim == mDims)
+            return false;
+        mSize = std::min(chunkSize, mDims - mNextDim);
+        mGenerator->generate(mSequenceIndex, mNextDim, mSize, mChunk.data());
+        mNextDim += mSize;
+        mIndex = 0;
+        return true;
+    }
+
 public:
     SampleProvider() = default;
     ~SampleProvider() = default;
@@ -38,20 +81,50 @@ public:
             mGeneratedSamples = std::pmr::vector<Float>(1, context().scopedAllocator);
             mIndex = 1;
         }
+        mSize = static_cast<uint32_t>(mGeneratedSamples.size());
+    }
+    // generate samples on demand in small chunks without heap allocation
+    SampleProvider(const SampleGenerator& generator, const uint64_t sequenceIndex, const uint32_t dims, const uint64_t seed)
+        : mFallback{ seeding(seed) }, mGenerator{ &generator }, mSequenceIndex{ sequenceIndex }, mDims{ dims } {
+        // the last sample should be reusable when the dimensions are exhausted
+        if(!refill()) {
+            mGenerator = nullptr;
+            mGeneratedSamples = std::pmr::vector<Float>(1, context().scopedAllocator);
+            mIndex = mSize = 1;
+        }
+    }
+    // the first chunk is generated in bulk by the caller, firstChunk[dim * stride] holds the dimension dim
+    SampleProvider(const SampleGenerator& generator, const uint64_t sequenceIndex, const uint32_t dims, const uint64_t seed,
+                   const Float* firstChunk, const uint32_t stride)
+        : mFallback{ seeding(seed) }, mGenerator{ &generator }, mSequenceIndex{ sequenceIndex }, mDims{ dims } {
+        mSize = std::min(chunkSize, mDims);
+        if(mSize == 0) {
+            mGenerator = nullptr;
+            mGeneratedSamples = std::pmr::vector<Float>(1, context().scopedAllocator);
+            mIndex = mSize = 1;
+            return;
+        }
+        for(uint32_t idx = 0; idx < mSize; ++idx)
+            mChunk[idx] = firstChunk[idx * stride];
+        mNextDim = mSize;
     }
     SampleProvider(SampleProvider&&) = default;
     SampleProvider& operator=(SampleProvider&&) = default;
     SampleProvider(const SampleProvider&) = delete;
     SampleProvider& operator=(const SampleProvider&) = delete;
+    // NOTICE: copying is explicit, the copy continues the same sequence from the current dimension
+    [[nodiscard]] SampleProvider clone(std::pmr::memory_resource* allocator) const {
+        return SampleProvider{ *this, allocator };
+    }
 
     Float sample() noexcept {
-        if(mIndex == mGeneratedSamples.size())
+        if(mIndex == mSize && !refill())
             return Piper::sample(mFallback);
-        return mGeneratedSamples[mIndex++];
+        return data()[mIndex++];
     }
 
     void reuse(const Float u) noexcept {
-        mGeneratedSamples[--mIndex] = u;
+        data()[--mIndex] = u;
     }
 
     uint32_t sampleIdx(const uint32_t size) noexcept {
@@ -63,8 +136,9 @@ public:
     }
 
     glm::vec2 sampleVec2() noexcept {
-        if(mIndex + 2 <= mGeneratedSamples.size()) {
-            const glm::vec2 res = { mGeneratedSamples[mIndex], mGeneratedSamples[mIndex + 1] };
+        if(mIndex + 2 <= mSize) {
+            const auto base = data() + mIndex;
+            const glm::vec2 res = { base[0], base[1] };
             mIndex += 2;
             return res;
         }
@@ -72,9 +146,9 @@ public:
     }
 
     glm::vec4 sampleVec4() noexcept {
-        if(mIndex + 4 <= mGeneratedSamples.size()) {
-            const glm::vec4 res = { mGeneratedSamples[mIndex], mGeneratedSamples[mIndex + 1], mGeneratedSamples[mIndex + 2],
-                                    mGeneratedSamples[mIndex + 3] };
+        if(mIndex + 4 <= mSize) {
+            const auto base = data() + mIndex;
+            const glm::vec4 res = { base[0], base[1], base[2], base[3] };
             mIndex += 4;
             return res;
         }
@@ -86,6 +160,12 @@ class TileSampler : public RefCountBase {
 public:
     virtual uint32_t samples() const noexcept = 0;
     virtual std::pair<glm::vec2, SampleProvider> generate(uint32_t filmX, uint32_t filmY, uint32_t sampleIdx) const = 0;
+    // batched version of generate, each request is (filmX, filmY, sampleIdx)
+    virtual void generateBatch(const std::span<const glm::uvec3> requests, glm::vec2* filmSamples,
+                               SampleProvider* const* providers) const {
+        for(size_t idx = 0; idx < requests.size(); ++idx)
+            std::tie(filmSamples[idx], *providers[idx]) = generate(requests[idx].x, requests[idx].y, requests[idx].z);
+    }
 };
 
 class Sampler : public RefCountBase {
@@ -91,8 +91,9 @@ inline InversePdf<PdfType::None> powerHeuristic(const InversePdf<PdfType::Light
     return InversePdf<PdfType::None>::fromRaw(sqr(gPdf.raw()) / (sqr(fPdf.raw()) + sqr(gPdf.raw())));
 }
 
+// the wavelengths of a path are driven by a single sample in [0,1), so the renderer can stratify it over the pixel samples
 template <typename Wavelength, typename Spectrum>
-auto sampleWavelength(SampleProvider&) noexcept {
+auto sampleWavelength(Float) noexcept {
     return std::make_pair(Wavelength{}, identity<Spectrum>());
 }
 
@@ -101,8 +102,8 @@ auto sampleWavelength(SampleProvider&) noexcept {
 // http://wscg.zcu.cz/WSCG2009/Papers_2009/!_2009_J_WSCG_No_1-3.zip
 
 template <>
-inline auto sampleWavelength<Float, Float>(SampleProvider& sampler) noexcept {
-    const auto lambda = 538.0f - std::atanh(0.8569106254698279f - 1.8275019724092267f * sampler.sample()) * 138.88888888888889f;
+inline auto sampleWavelength<Float, Float>(const Float u) noexcept {
+    const auto lambda = 538.0f - std::atanh(0.8569106254698279f - 1.8275019724092267f * u) * 138.88888888888889f;
     if(lambda < 360.0f || lambda > 830.0f)
         return std::make_pair(lambda, 0.0f);
     const auto weight = 253.82f * sqr(std::cosh(0.0072f * (lambda - 538.0f)));
@@ -110,17 +111,59 @@ inline auto sampleWavelength<Float, Float>(SampleProvider& sampler) noexcept {
 }
 
 template <>
-inline auto sampleWavelength<MonoWavelengthSpectrum, MonoWavelengthSpectrum>(SampleProvider&) noexcept {
+inline auto sampleWavelength<MonoWavelengthSpectrum, MonoWavelengthSpectrum>(Float) noexcept {
     const auto lambda = RenderGlobalSetting::get().sampledWavelength;
     return std::make_pair(lambda, MonoWavelengthSpectrum::fromRaw(1.0f));
 }
 
+namespace Impl {
+    // the hero wavelengths are rotated by 1/N in the sample space, so they are stratified
+    template <int32_t N>
+    auto sampleHeroWavelengths(const Float u) noexcept {
+        using VecType = typename SampledSpectrumN<N>::VecType;
+        auto lambda = undefined<VecType>(), weight = undefined<VecType>();
+        for(int32_t idx = 0; idx < N; ++idx) {
+            const auto rotated = u + static_cast<Float>(idx) / static_cast<Float>(N);
+            std::tie(lambda[idx], weight[idx]) = sampleWavelength<Float, Float>(rotated < 1.0f ? rotated : rotated - 1.0f);
+        }
+        return std::make_pair(SampledSpectrumN<N>::fromRaw(lambda), SampledSpectrumN<N>::fromRaw(weight));
+    }
+}  // namespace Impl
+
+// the number of the wavelengths sampled from one wavelength sample
+template <typename Wavelength>
+constexpr uint32_t heroWavelengthCount() noexcept {
+    if constexpr(requires { Wavelength::nSamples; })
+        return static_cast<uint32_t>(Wavelength::nSamples);
+    else
+        return 1;
+}
+
+// the wavelength sample of the batch batchIdx, the N hero wavelengths of the B batches are rotated by 1/(B*N) in the sample space
+// NOTICE: a rotation by batchIdx/B would be a multiple of 1/N for B | N, which only permutes the hero wavelengths
+inline Float wavelengthBatchSample(const Float u, const uint32_t batchIdx, const uint32_t batchCount, const uint32_t heroCount) noexcept {
+    const auto rotated = u + static_cast<Float>(batchIdx) / static_cast<Float>(batchCount * heroCount);
+    return rotated < 1.0f ? rotated : rotated - 1.0f;
+}
+
+template <>
+inline auto sampleWavelength<SampledSpectrum, SampledSpectrum>(const Float u) noexcept {
+    return Impl::sampleHeroWavelengths<SampledSpectrum::nSamples>(u);
+}
+
+template <>
+inline auto sampleWavelength<SampledSpectrum8, SampledSpectrum8>(const Float u) noexcept {
+    return Impl::sampleHeroWavelengths<SampledSpectrum8::nSamples>(u);
+}
+
 template <>
-inline auto sampleWavelength<SampledSpectrum, SampledSpectrum>(SampleProvider& sampler) noexcept {
-    auto lambda = undefined<SampledSpectrum::VecType>(), weight = undefined<SampledSpectrum::VecType>();
-    for(int32_t idx = 0; idx < SampledSpectrum::nSamples; ++idx)
-        std::tie(lambda[idx], weight[idx]) = sampleWavelength<Float, Float>(sampler);
-    return std::make_pair(SampledSpectrum::fromRaw(lambda), SampledSpectrum::fromRaw(weight));
+inline auto sampleWavelength<SampledSpectrum16, SampledSpectrum16>(const Float u) noexcept {
+    return Impl::sampleHeroWavelengths<SampledSpectrum16::nSamples>(u);
+}
+
+template <typename Wavelength, typename Spectrum>
+auto sampleWavelength(SampleProvider& sampler) noexcept {
+    return sampleWavelength<Wavelength, Spectrum>(sampler.sample());
 }
 
 PIPER_NAMESPACE_END
@@ -21,6 +21,7 @@
 #pragma once
 #include <Piper/Render/KeyFrames.hpp>
 #include <Piper/Render/RenderGlobalSetting.hpp>
+#include <optional>
 
 PIPER_NAMESPACE_BEGIN
 
@@ -36,10 +37,19 @@ class SceneObject final : public RefCountBase {
     KeyFrames mKeyFrames;
     ComponentType mComponentType;
     Ref<SceneObjectComponent> mComponent;
+    std::optional<ResolvedTransform> mLastTransform;
+    std::optional<ResolvedTransform> mLastAreaLightTransform;
+    uint32_t mPendingUpdates = 0;
 
 public:
     explicit SceneObject(const Ref<ConfigNode>& node);
-    void update(TimeInterval timeInterval);
+    // returns false if the transform is unchanged and the component is left alone
+    bool update(TimeInterval timeInterval);
+    // the last update is applied again to the same buffer, since the build of the back buffer is cancelled
+    void rearmUpdate() noexcept;
+    // the area lights of the shapes are updated with the other lights, after the previous frame is finished
+    // returns false if there is no area light or its transform is unchanged
+    bool updateAreaLight(TimeInterval timeInterval);
     PrimitiveGroup* primitiveGroup() const;
     Sensor* sensor() const noexcept;
     LightBase* light() const noexcept;
@@ -22,6 +22,7 @@
 
 #include <Piper/Render/Ray.hpp>
 #include <Piper/Render/SceneObject.hpp>
+#include <span>
 
 PIPER_NAMESPACE_BEGIN
 
@@ -45,9 +46,17 @@ class Sensor : public SceneObjectComponent {
 protected:
     ResolvedTransform mTransform{};
 
+    // called after the transform of a new frame is resolved, so that the per-frame data can be precomputed
+    virtual void prepareFrame() {}
+
 public:
     virtual Float deviceAspectRatio() const noexcept = 0;
     virtual std::pair<Ray, Float> sample(glm::vec2 sensorNDC, SampleProvider& sampler) const noexcept = 0;
+    // the rays of a batch (e.g., a row of a tile) are generated at once, each sampler is consumed in the same order as the scalar version
+    virtual void sample(std::span<const glm::vec2> sensorNDC, std::span<SampleProvider* const> samplers, std::span<Ray> rays,
+                        std::span<Float> weights) const noexcept;
+    // the spread angle of the primary ray cones, the pixel size is given in the NDC space
+    [[nodiscard]] virtual Float spreadAngle(Float ndcPixelSize) const noexcept = 0;
     PrimitiveGroup* primitiveGroup() const noexcept final {
         return nullptr;
     }
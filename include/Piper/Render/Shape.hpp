@@ -24,12 +24,38 @@
 
 PIPER_NAMESPACE_BEGIN
 
+// a triangle in the object space, the normals are only used to decide the outer side of the emissive surfaces
+struct ShapeTriangle final {
+    std::array<glm::vec3, 3> positions;
+    std::array<glm::vec3, 3> normals;
+    std::array<TexCoord, 3> texCoords;
+};
+
 class Shape : public SceneObjectComponent {
 public:
     virtual Intersection generateIntersection(const Ray& ray, Distance hitDistance,
                                               const AffineTransform<FrameOfReference::Object, FrameOfReference::World>& transform,
                                               const Normal<FrameOfReference::World>& geometryNormal, glm::vec2 barycentric,
                                               uint32_t primitiveIndex) const noexcept = 0;
+
+    // the emissive shapes own an area light sampling their triangles
+    [[nodiscard]] virtual LightBase* areaLight() const noexcept {
+        return nullptr;
+    }
+    [[nodiscard]] virtual uint32_t triangleCount() const noexcept {
+        return 0;
+    }
+    [[nodiscard]] virtual ShapeTriangle triangle(uint32_t idx) const noexcept {
+        return {};
+    }
+
+    // the masked shapes are tested by the opacity during traversal, the hits are kept with the probability of the opacity
+    [[nodiscard]] virtual bool masked() const noexcept {
+        return false;
+    }
+    [[nodiscard]] virtual Float opacity(uint32_t primitiveIndex, glm::vec2 barycentric, Float t) const noexcept {
+        return 1.0f;
+    }
 };
 
 PIPER_NAMESPACE_END
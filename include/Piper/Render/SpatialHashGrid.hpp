@@ -0,0 +1,94 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <Piper/Core/Context.hpp>
+#include <Piper/Render/Math.hpp>
+#include <algorithm>
+#include <array>
+#include <vector>
+
+PIPER_NAMESPACE_BEGIN
+
+// A static spatial hash grid for the fixed-radius range search of points (photons, light vertices).
+// The cells are twice as wide as the search radius, so a query visits at most 2x2x2 cells. The points of a bucket are stored
+// contiguously in the order of the input, the hash collisions only cost some extra distance tests.
+// NOTICE: the grid is built in parallel by a counting sort with atomic counters, no locks are taken.
+class SpatialHashGrid final {
+    std::pmr::vector<uint32_t> mOffsets{ context().globalAllocator };  // the first point of each bucket, the last one is the sentinel
+    std::pmr::vector<uint32_t> mIndices{ context().globalAllocator };  // the input indices of the sorted points
+    std::pmr::vector<glm::vec3> mPoints{ context().globalAllocator };
+    Float mRadius = 0.0f;
+    Float mInvCellSize = 1.0f;
+    uint32_t mMask = 0;
+
+    [[nodiscard]] glm::ivec3 cell(const glm::vec3& pos) const noexcept {
+        constexpr auto bound = static_cast<Float>(1 << 30);
+        return glm::ivec3{ glm::clamp(glm::floor(pos * mInvCellSize), -bound, bound) };
+    }
+    [[nodiscard]] uint32_t bucket(const glm::ivec3& cell) const noexcept {
+        // Please refer to "Optimized Spatial Hashing for Collision Detection of Deformable Objects" (Teschner et al. 2003)
+        return (static_cast<uint32_t>(cell.x) * 73856093U ^ static_cast<uint32_t>(cell.y) * 19349663U ^
+                static_cast<uint32_t>(cell.z) * 83492791U) &
+            mMask;
+    }
+
+public:
+    // rebuilds the grid, the previous points are discarded
+    void build(const std::pmr::vector<glm::vec3>& points, Float radius);
+
+    [[nodiscard]] Float radius() const noexcept {
+        return mRadius;
+    }
+    [[nodiscard]] bool empty() const noexcept {
+        return mPoints.empty();
+    }
+
+    // invokes callback(index, point) for each point within the radius of pos
+    template <typename Callback>
+    void query(const glm::vec3& pos, Callback&& callback) const noexcept {
+        if(mPoints.empty())
+            return;
+
+        const auto lo = cell(pos - mRadius);
+        const auto hi = glm::min(cell(pos + mRadius), lo + 1);
+        const auto radius2 = mRadius * mRadius;
+
+        std::array<uint32_t, 8> visited;  // NOLINT(cppcoreguidelines-pro-type-member-init)
+        uint32_t count = 0;
+        for(auto z = lo.z; z <= hi.z; ++z)
+            for(auto y = lo.y; y <= hi.y; ++y)
+                for(auto x = lo.x; x <= hi.x; ++x) {
+                    const auto idx = bucket({ x, y, z });
+                    // the neighbouring cells may share a bucket
+                    if(std::find(visited.begin(), visited.begin() + count, idx) != visited.begin() + count)
+                        continue;
+                    visited[count++] = idx;
+
+                    for(auto k = mOffsets[idx]; k != mOffsets[idx + 1]; ++k) {
+                        const auto offset = mPoints[k] - pos;
+                        if(glm::dot(offset, offset) <= radius2)
+                            callback(mIndices[k], mPoints[k]);
+                    }
+                }
+    }
+};
+
+PIPER_NAMESPACE_END
@@ -20,6 +20,7 @@
 
 #pragma once
 #include <Piper/Render/Math.hpp>
+#include <array>
 #include <variant>
 
 PIPER_NAMESPACE_BEGIN
@@ -144,53 +145,137 @@ constexpr SpectrumType spectrumType<MonoSpectrum>() noexcept {
     return SpectrumType::Mono;
 }
 
-class SampledSpectrum final {
+// glm only provides vectors with up to 4 components, so the wider sets of hero wavelengths are stored in plain lanes.
+// NOTICE: the element-wise loops are vectorized to AVX2/AVX-512 registers by the compiler.
+template <int32_t N>
+struct SampledLanes final {
+    alignas(N * sizeof(Float)) std::array<Float, N> values;
+
+    SampledLanes() = default;
+    constexpr explicit SampledLanes(const Float x) noexcept {
+        values.fill(x);
+    }
+
+    static constexpr int32_t length() noexcept {
+        return N;
+    }
+    static constexpr SampledLanes undefined() noexcept {
+        return SampledLanes{ std::numeric_limits<Float>::signaling_NaN() };
+    }
+
+    constexpr Float& operator[](const int32_t idx) noexcept {
+        return values[idx];
+    }
+    constexpr Float operator[](const int32_t idx) const noexcept {
+        return values[idx];
+    }
+
+#define PIPER_SAMPLED_LANES_OP(OP)                                               \
+    constexpr SampledLanes operator OP(const SampledLanes& rhs) const noexcept { \
+        SampledLanes res;                                                        \
+        for(int32_t idx = 0; idx < N; ++idx)                                     \
+            res.values[idx] = values[idx] OP rhs.values[idx];                    \
+        return res;                                                              \
+    }                                                                            \
+    constexpr SampledLanes operator OP(const Float rhs) const noexcept {         \
+        SampledLanes res;                                                        \
+        for(int32_t idx = 0; idx < N; ++idx)                                     \
+            res.values[idx] = values[idx] OP rhs;                                \
+        return res;                                                              \
+    }                                                                            \
+    constexpr SampledLanes& operator OP##=(const SampledLanes& rhs) noexcept {   \
+        for(int32_t idx = 0; idx < N; ++idx)                                     \
+            values[idx] OP##= rhs.values[idx];                                   \
+        return *this;                                                            \
+    }                                                                            \
+    constexpr SampledLanes& operator OP##=(const Float rhs) noexcept {           \
+        for(int32_t idx = 0; idx < N; ++idx)                                     \
+            values[idx] OP##= rhs;                                               \
+        return *this;                                                            \
+    }
+
+    PIPER_SAMPLED_LANES_OP(+)
+    PIPER_SAMPLED_LANES_OP(-)
+    PIPER_SAMPLED_LANES_OP(*)
+    PIPER_SAMPLED_LANES_OP(/)
+
+#undef PIPER_SAMPLED_LANES_OP
+
+    friend constexpr SampledLanes operator*(const Float lhs, const SampledLanes& rhs) noexcept {
+        return rhs * lhs;
+    }
+};
+
+// N hero wavelengths are traced along each path, the wider variants amortize the traversal over more wavelengths
+template <int32_t N>
+class SampledSpectrumN final {
+    static_assert(N % 4 == 0);
+
 public:
-    static constexpr auto nSamples = 4;
-    using VecType = glm::vec<nSamples, Float>;
+    static constexpr auto nSamples = N;
+    using VecType = std::conditional_t<N == 4, glm::vec4, SampledLanes<N>>;
 
 private:
-    PIPER_GUARD_BASE(SampledSpectrum, VecType)
-    PIPER_GUARD_BASE_OP(SampledSpectrum)
-    PIPER_GUARD_ELEMENT_VISE_MULTIPLY(SampledSpectrum)
+    PIPER_GUARD_BASE(SampledSpectrumN, VecType)
+    PIPER_GUARD_BASE_OP(SampledSpectrumN)
+    PIPER_GUARD_ELEMENT_VISE_MULTIPLY(SampledSpectrumN)
 
     [[nodiscard]] Float firstComponent() const noexcept {
         return mValue[0];
     }
 
-    static constexpr SampledSpectrum fromScalar(const Float x) noexcept {
-        return SampledSpectrum{ VecType{ x } };
+    static constexpr SampledSpectrumN fromScalar(const Float x) noexcept {
+        return SampledSpectrumN{ VecType{ x } };
     }
 };
 
-Float luminance(const SampledSpectrum& x, const SampledSpectrum& sampledWavelengths) noexcept;
-RGBSpectrum toRGB(const SampledSpectrum& x, const SampledSpectrum& sampledWavelengths) noexcept;
+using SampledSpectrum = SampledSpectrumN<4>;
+using SampledSpectrum8 = SampledSpectrumN<8>;    // AVX2
+using SampledSpectrum16 = SampledSpectrumN<16>;  // AVX-512
 
-inline Float maxComponentValue(const SampledSpectrum& x) noexcept {
-    static_assert(SampledSpectrum::nSamples == 4);
-    const auto vec = x.raw();
-    return std::fmax(std::fmax(vec.x, vec.y), std::fmax(vec.z, vec.w));
+template <typename T>
+constexpr bool isSampledSpectrum = false;
+template <int32_t N>
+constexpr bool isSampledSpectrum<SampledSpectrumN<N>> = true;
+
+template <int32_t N>
+Float luminance(const SampledSpectrumN<N>& x, const SampledSpectrumN<N>& sampledWavelengths) noexcept;
+template <int32_t N>
+RGBSpectrum toRGB(const SampledSpectrumN<N>& x, const SampledSpectrumN<N>& sampledWavelengths) noexcept;
+
+template <int32_t N>
+Float maxComponentValue(const SampledSpectrumN<N>& x) noexcept {
+    const auto& vec = x.raw();
+    auto res = vec[0];
+    for(int32_t idx = 1; idx < N; ++idx)
+        res = std::fmax(res, vec[idx]);
+    return res;
 }
 
-template <>
-struct WavelengthType<SampledSpectrum> final {
-    using Type = SampledSpectrum;
+template <int32_t N>
+struct WavelengthType<SampledSpectrumN<N>> final {
+    using Type = SampledSpectrumN<N>;
 };
 
-template <>
-constexpr SpectrumType spectrumType<SampledSpectrum>() noexcept {
-    return SpectrumType::LinearRGB;
-}
+#define PIPER_SAMPLED_SPECTRUM_TRAITS(TYPE)                    \
+    template <>                                                \
+    constexpr SpectrumType spectrumType<TYPE>() noexcept {     \
+        return SpectrumType::LinearRGB;                        \
+    }                                                          \
+    template <>                                                \
+    constexpr TYPE zero<TYPE>() noexcept {                     \
+        return TYPE::fromScalar(0.0f);                         \
+    }                                                          \
+    template <>                                                \
+    constexpr TYPE identity<TYPE>() noexcept {                 \
+        return TYPE::fromScalar(1.0f);                         \
+    }
 
-template <>
-constexpr SampledSpectrum zero<SampledSpectrum>() noexcept {
-    return SampledSpectrum::fromScalar(0.0f);
-}
+PIPER_SAMPLED_SPECTRUM_TRAITS(SampledSpectrum)
+PIPER_SAMPLED_SPECTRUM_TRAITS(SampledSpectrum8)
+PIPER_SAMPLED_SPECTRUM_TRAITS(SampledSpectrum16)
 
-template <>
-constexpr SampledSpectrum identity<SampledSpectrum>() noexcept {
-    return SampledSpectrum::fromScalar(1.0f);
-}
+#undef PIPER_SAMPLED_SPECTRUM_TRAITS
 
 struct MonoWavelengthSpectrum final {
 private:
@@ -25,9 +25,17 @@ PIPER_NAMESPACE_BEGIN
 
 namespace Impl {
     Float fromRGB(const RGBSpectrum& u, Float wavelength) noexcept;
-    SampledSpectrum fromRGB(const RGBSpectrum& u, const SampledSpectrum& w) noexcept;
+    template <int32_t N>
+    SampledSpectrumN<N> fromRGB(const RGBSpectrum& u, const SampledSpectrumN<N>& w) noexcept;
     MonoWavelengthSpectrum fromRGB(const RGBSpectrum& u, const MonoWavelengthSpectrum& w) noexcept;
 
+    // the sigmoid-polynomial coefficients used by fromRGB, so that the upsampling of constant colors can be precomputed
+    glm::vec3 toSpectrumCoefficients(const RGBSpectrum& u) noexcept;
+    Float fromSpectrumCoefficients(const glm::vec3& coefficients, Float wavelength) noexcept;
+    template <int32_t N>
+    SampledSpectrumN<N> fromSpectrumCoefficients(const glm::vec3& coefficients, const SampledSpectrumN<N>& w) noexcept;
+    MonoWavelengthSpectrum fromSpectrumCoefficients(const glm::vec3& coefficients, const MonoWavelengthSpectrum& w) noexcept;
+
     template <SpectrumLike T, SpectrumLike U>
     struct SpectrumCastCall final {};
 
@@ -45,33 +53,33 @@ namespace Impl {
         }
     };
 
-    template <>
-    struct SpectrumCastCall<MonoSpectrum, SampledSpectrum> final {
-        static SampledSpectrum cast(const MonoSpectrum& u, const SampledSpectrum&) noexcept {
-            return SampledSpectrum::fromScalar(u);
+    template <int32_t N>
+    struct SpectrumCastCall<MonoSpectrum, SampledSpectrumN<N>> final {
+        static SampledSpectrumN<N> cast(const MonoSpectrum& u, const SampledSpectrumN<N>&) noexcept {
+            return SampledSpectrumN<N>::fromScalar(u);
         }
-        static SampledSpectrum cast(const MonoSpectrum& u, std::monostate) noexcept {
-            return SampledSpectrum::fromScalar(u);
+        static SampledSpectrumN<N> cast(const MonoSpectrum& u, std::monostate) noexcept {
+            return SampledSpectrumN<N>::fromScalar(u);
         }
     };
 
-    template <>
-    struct SpectrumCastCall<RGBSpectrum, SampledSpectrum> final {
-        static SampledSpectrum cast(const RGBSpectrum& u, const SampledSpectrum& w) noexcept {
+    template <int32_t N>
+    struct SpectrumCastCall<RGBSpectrum, SampledSpectrumN<N>> final {
+        static SampledSpectrumN<N> cast(const RGBSpectrum& u, const SampledSpectrumN<N>& w) noexcept {
             return fromRGB(u, w);
         }
     };
 
-    template <>
-    struct SpectrumCastCall<SampledSpectrum, SampledSpectrum> final {
-        static SampledSpectrum cast(const SampledSpectrum& u, const SampledSpectrum&) noexcept {
+    template <int32_t N>
+    struct SpectrumCastCall<SampledSpectrumN<N>, SampledSpectrumN<N>> final {
+        static SampledSpectrumN<N> cast(const SampledSpectrumN<N>& u, const SampledSpectrumN<N>&) noexcept {
             return u;
         }
     };
 
-    template <>
-    struct SpectrumCastCall<MonoWavelengthSpectrum, SampledSpectrum> final {
-        static SampledSpectrum cast(const MonoWavelengthSpectrum& u, const SampledSpectrum&) noexcept {
+    template <int32_t N>
+    struct SpectrumCastCall<MonoWavelengthSpectrum, SampledSpectrumN<N>> final {
+        static SampledSpectrumN<N> cast(const MonoWavelengthSpectrum& u, const SampledSpectrumN<N>&) noexcept {
             PIPER_NOT_IMPLEMENTED();
         }
     };
@@ -94,12 +102,12 @@ namespace Impl {
         }
     };
 
-    template <>
-    struct SpectrumCastCall<SampledSpectrum, MonoWavelengthSpectrum> final {
-        static SampledSpectrum cast(const SampledSpectrum& u, const SampledSpectrum&) noexcept {
+    template <int32_t N>
+    struct SpectrumCastCall<SampledSpectrumN<N>, MonoWavelengthSpectrum> final {
+        static SampledSpectrumN<N> cast(const SampledSpectrumN<N>& u, const SampledSpectrumN<N>&) noexcept {
             PIPER_NOT_IMPLEMENTED();
         }
-        static SampledSpectrum cast(const SampledSpectrum& u, const MonoWavelengthSpectrum&) noexcept {
+        static SampledSpectrumN<N> cast(const SampledSpectrumN<N>& u, const MonoWavelengthSpectrum&) noexcept {
             PIPER_NOT_IMPLEMENTED();
         }
     };
@@ -19,9 +19,14 @@
 */
 
 #pragma once
+#include <Piper/Render/KeyFrames.hpp>
 #include <Piper/Render/Radiometry.hpp>
 #include <Piper/Render/RenderGlobalSetting.hpp>
 #include <Piper/Render/Sampler.hpp>
+#include <Piper/Render/SpectralLUTUtil.hpp>
+#include <optional>
+#include <span>
+#include <typeinfo>
 
 PIPER_NAMESPACE_BEGIN
 
@@ -29,7 +34,10 @@ struct TextureEvaluateInfo {
     TexCoord texCoord;
     Float t;
     uint32_t primitiveIdx;
-    // TODO: differential
+    // the width of the ray cone footprint in the texture space, 0 means the finest level
+    Float footprint = 0.0f;
+    // the local coordinates in the primitive (the barycentric coordinates of the triangles), used by the per-face textures
+    glm::vec2 faceUV{ 0.0f };
 };
 
 // TODO: prepare for time interval
@@ -40,11 +48,72 @@ public:
     [[nodiscard]] virtual std::pair<bool, Float> evaluateOneWavelength(const TextureEvaluateInfo& info, Float wavelength) const noexcept {
         return { false, evaluate(info) };
     }
+    // the implementations may reorder the lookups of a batch to improve the locality
+    virtual void evaluateBatch(const std::span<const TextureEvaluateInfo> infos, const std::span<Float> res) const noexcept {
+        for(size_t idx = 0; idx < infos.size(); ++idx)
+            res[idx] = evaluate(infos[idx]);
+    }
+    // the value if it depends on neither the texture coordinates nor the wavelength
+    [[nodiscard]] virtual std::optional<Float> constantValue() const noexcept {
+        return std::nullopt;
+    }
 };
 
 Ref<ScalarTexture2D> getScalarTexture2D(const Ref<ConfigNode>& node, std::string_view attr, std::string_view fallbackAttr,
                                         Float defaultValue);
 
+namespace Impl {
+    Ref<RefCountBase> loadSharedTexture(std::string_view name, std::string_view attr, size_t type,
+                                        Ref<RefCountBase> (*make)(const Ref<ConfigNode>& node));
+}  // namespace Impl
+
+// The textures defined in an external file (e.g. the measured IOR in data/ior) are parsed once and shared by all materials
+// referencing the same file.
+template <typename T>
+Ref<T> loadSharedTexture(const std::string_view name, const std::string_view attr) {
+    return dynamicCast<T>(Impl::loadSharedTexture(name, attr, typeid(T).hash_code(), [](const Ref<ConfigNode>& node) {
+        return Ref<RefCountBase>{ getStaticFactory().make<T>(node) };
+    }));
+}
+
+// The textures varying over time resolve the keyframes overlapping the shutter interval once per frame, so that each
+// evaluation only blends the active pair. All living instances are prepared by prepareTimeVaryingTextures.
+class TimeVaryingTexture {
+public:
+    TimeVaryingTexture();
+    TimeVaryingTexture(const TimeVaryingTexture&) = delete;
+    TimeVaryingTexture& operator=(const TimeVaryingTexture&) = delete;
+    virtual ~TimeVaryingTexture();
+
+    virtual void prepare(TimeInterval interval) noexcept = 0;
+};
+
+// NOTICE: the textures are updated in place, so it must not be called while rendering.
+// returns false if there is no time-varying texture, so that all textured values are unchanged
+bool prepareTimeVaryingTextures(TimeInterval interval);
+
+namespace Impl {
+    // the RGB response averaged over the visible range, each group of hero wavelengths strides over the whole range
+    template <typename Spectrum, typename Callable>
+    RGBSpectrum averageRGBResponse(const uint32_t groups, Callable&& callable) {
+        constexpr auto nSamples = Spectrum::nSamples;
+        const auto groupStride = static_cast<Float>(wavelengthMax - wavelengthMin) / static_cast<Float>(groups * nSamples);
+        const auto sampleStride = groupStride * static_cast<Float>(groups);
+
+        auto res = zero<RGBSpectrum>();
+        for(uint32_t idx = 0; idx < groups; ++idx) {
+            const auto base = static_cast<Float>(wavelengthMin) + (static_cast<Float>(idx) + 0.5f) * groupStride;
+            auto lambda = undefined<typename Spectrum::VecType>();
+            for(int32_t sampleIdx = 0; sampleIdx < nSamples; ++sampleIdx)
+                lambda[sampleIdx] = base + static_cast<Float>(sampleIdx) * sampleStride;
+            const auto sampledWavelength = Spectrum::fromRaw(lambda);
+            res += toRGB(std::invoke(callable, sampledWavelength), sampledWavelength);
+        }
+        res /= static_cast<Float>(groups);
+        return res;
+    }
+}  // namespace Impl
+
 template <typename Setting>
 class SpectrumTexture2D : public TypedRenderVariantBase<Setting> {
 public:
@@ -53,6 +122,29 @@ public:
     virtual Spectrum evaluate(const TextureEvaluateInfo& info, const Wavelength& sampledWavelength) const noexcept = 0;
     [[nodiscard]] virtual std::pair<bool, Float> evaluateOneWavelength(const TextureEvaluateInfo& info,
                                                                        Float wavelength) const noexcept = 0;
+    // the implementations may reorder the lookups of a batch to improve the locality
+    virtual void evaluateBatch(const std::span<const TextureEvaluateInfo> infos, const std::span<const Wavelength> sampledWavelengths,
+                               const std::span<Spectrum> res) const noexcept {
+        for(size_t idx = 0; idx < infos.size(); ++idx)
+            res[idx] = evaluate(infos[idx], sampledWavelengths[idx]);
+    }
+    // true if the result only depends on the sampled wavelengths
+    [[nodiscard]] virtual bool isConstant() const noexcept {
+        return false;
+    }
+    // the approximated RGB reflectance for the albedo AOV, the spectral variants only evaluate a few groups of wavelengths
+    [[nodiscard]] virtual RGBSpectrum estimateRGB(const TextureEvaluateInfo& info) const noexcept {
+        if constexpr(isSampledSpectrum<Spectrum>) {
+            // the wider variants evaluate the same number of wavelengths
+            return Impl::averageRGBResponse<Spectrum>(64 / Spectrum::nSamples,
+                                                      [&](const Spectrum& sampledWavelength) { return evaluate(info, sampledWavelength); });
+        } else if constexpr(std::is_same_v<Spectrum, MonoWavelengthSpectrum>) {
+            const auto lambda = RenderGlobalSetting::get().sampledWavelength;
+            return toRGB(evaluate(info, lambda), lambda);
+        } else {
+            return toRGB(evaluate(info, Wavelength{}), Wavelength{});
+        }
+    }
 };
 
 template <typename Setting>
@@ -79,15 +171,22 @@ public:
 
     [[nodiscard]] virtual MonoSpectrum mean() const noexcept = 0;
 
+    // samples the direction of the object space, uniform by default
     virtual TextureSample<Setting> sample(SampleProvider& sampler, const Float t, const Wavelength& sampledWavelength) const noexcept {
         const auto u = sampler.sampleVec2();
-        const auto phi = u.x * twoPi;
-        const auto theta = std::acos(u.y * 2.0f - 1.0f);
+        const auto cosPolar = 1.0f - 2.0f * u.x;
+        const auto sinPolar = safeSqrt(1.0f - cosPolar * cosPolar);
+        const auto azimuth = (u.y - 0.5f) * twoPi;
+        const auto dir = Direction<FrameOfReference::Object>::fromRaw(
+            { sinPolar * std::sin(azimuth), cosPolar, sinPolar * std::cos(azimuth) });
+
+        const auto val = evaluate({ dir2TexCoord(dir), t, 0U }, sampledWavelength);
+        return TextureSample<Setting>{ dir, Rational<Spectrum, PdfType::Texture>::fromRaw(val), inversePdf(dir, t) };
+    }
 
-        return TextureSample<Setting>{ Direction<FrameOfReference::Object>::fromSphericalCoord({ theta, phi }),
-                                       Rational<Spectrum, PdfType::Texture>::fromRaw(
-                                           evaluate({ TexCoord{ u.x, phi * invPi }, t, 0U }, sampledWavelength)),
-                                       InversePdf<PdfType::Texture>::fromRaw(1.0f) };
+    [[nodiscard]] virtual InversePdf<PdfType::Texture> inversePdf(const Direction<FrameOfReference::Object>& dir,
+                                                                  const Float t) const noexcept {
+        return InversePdf<PdfType::Texture>::fromRaw(fourPi);
     }
 };
 
@@ -107,9 +206,15 @@ requires(std::is_base_of_v<ConstantTexture<Setting>, T<Setting>>) class Constant
     PIPER_IMPORT_SETTINGS();
 
     T<Setting> mImpl;
+    RGBSpectrum mRGB = zero<RGBSpectrum>();
 
 public:
-    explicit ConstantSpectrumTexture2DWrapper(const Ref<ConfigNode>& node) : mImpl{ node } {}
+    explicit ConstantSpectrumTexture2DWrapper(const Ref<ConfigNode>& node) : mImpl{ node } {
+        // the albedo of a constant spectrum is integrated once at 0.25nm steps
+        if constexpr(isSampledSpectrum<Spectrum>)
+            mRGB = Impl::averageRGBResponse<Spectrum>((wavelengthMax - wavelengthMin) * 4 / Spectrum::nSamples,
+                                                      [&](const Spectrum& sampledWavelength) { return mImpl.evaluate(sampledWavelength); });
+    }
 
     Spectrum evaluate(const TextureEvaluateInfo&, const Wavelength& sampledWavelength) const noexcept override {
         return mImpl.evaluate(sampledWavelength);
@@ -118,6 +223,70 @@ public:
     [[nodiscard]] std::pair<bool, Float> evaluateOneWavelength(const TextureEvaluateInfo&, const Float wavelength) const noexcept override {
         return mImpl.evaluateOneWavelength(wavelength);
     }
+
+    [[nodiscard]] bool isConstant() const noexcept override {
+        return true;
+    }
+
+    [[nodiscard]] RGBSpectrum estimateRGB(const TextureEvaluateInfo& info) const noexcept override {
+        if constexpr(isSampledSpectrum<Spectrum>)
+            return mRGB;
+        else
+            return SpectrumTexture2D<Setting>::estimateRGB(info);
+    }
+};
+
+// The texture inputs of the materials. The constant ones are resolved at construction, so that the evaluation skips the
+// virtual texture calls.
+class ScalarTextureInput final {
+    Ref<ScalarTexture2D> mTexture;
+    std::optional<Float> mConstant;
+
+public:
+    explicit ScalarTextureInput(Ref<ScalarTexture2D> texture) : mTexture{ std::move(texture) }, mConstant{ mTexture->constantValue() } {}
+
+    [[nodiscard]] const std::optional<Float>& constant() const noexcept {
+        return mConstant;
+    }
+
+    [[nodiscard]] Float evaluate(const TextureEvaluateInfo& info) const noexcept {
+        return mConstant ? *mConstant : mTexture->evaluate(info);
+    }
+
+    [[nodiscard]] std::pair<bool, Float> evaluateOneWavelength(const TextureEvaluateInfo& info, const Float wavelength) const noexcept {
+        return mConstant ? std::pair{ false, *mConstant } : mTexture->evaluateOneWavelength(info, wavelength);
+    }
+};
+
+template <typename Setting>
+class SpectrumTextureInput final {
+    PIPER_IMPORT_SETTINGS();
+
+    Ref<SpectrumTexture2D<Setting>> mTexture;
+    // only the non-spectral variants are resolved, the spectral ones depend on the sampled wavelengths
+    std::optional<Spectrum> mConstant;
+
+public:
+    explicit SpectrumTextureInput(Ref<SpectrumTexture2D<Setting>> texture) : mTexture{ std::move(texture) } {
+        if constexpr(!isSpectral)
+            if(mTexture->isConstant())
+                mConstant = mTexture->evaluate(TextureEvaluateInfo{ TexCoord{ 0.0f }, 0.0f, 0U }, Wavelength{});
+    }
+
+    [[nodiscard]] Spectrum evaluate(const TextureEvaluateInfo& info, const Wavelength& sampledWavelength) const noexcept {
+        if constexpr(!isSpectral)
+            if(mConstant)
+                return *mConstant;
+        return mTexture->evaluate(info, sampledWavelength);
+    }
+
+    [[nodiscard]] std::pair<bool, Float> evaluateOneWavelength(const TextureEvaluateInfo& info, const Float wavelength) const noexcept {
+        return mTexture->evaluateOneWavelength(info, wavelength);
+    }
+
+    [[nodiscard]] RGBSpectrum estimateRGB(const TextureEvaluateInfo& info) const noexcept {
+        return mTexture->estimateRGB(info);
+    }
 };
 
 template <template <typename> typename T, typename Setting>
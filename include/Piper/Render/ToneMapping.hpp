@@ -0,0 +1,55 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <Piper/Render/Math.hpp>
+#include <string_view>
+
+PIPER_NAMESPACE_BEGIN
+
+enum class ToneMappingOperator { None, Reinhard, ACES, AgX, Filmic };
+
+ToneMappingOperator parseToneMappingOperator(std::string_view name);
+
+// The tone curves work on the planar blocks of pixels (one array per channel), so that the loops without branches are vectorized
+// by the compiler. The interleaved rows of the frame are transposed into the blocks on the stack.
+constexpr uint32_t pixelBlockSize = 64;
+
+struct PixelBlock final {
+    alignas(64) Float r[pixelBlockSize];
+    alignas(64) Float g[pixelBlockSize];
+    alignas(64) Float b[pixelBlockSize];
+};
+
+template <typename Func>
+void applyPerChannel(PixelBlock& block, const uint32_t count, const Func& func) noexcept {
+    for(uint32_t idx = 0; idx < count; ++idx)
+        block.r[idx] = func(block.r[idx]);
+    for(uint32_t idx = 0; idx < count; ++idx)
+        block.g[idx] = func(block.g[idx]);
+    for(uint32_t idx = 0; idx < count; ++idx)
+        block.b[idx] = func(block.b[idx]);
+}
+
+// maps the non-negative linear radiance to the linear display range [0, 1]
+// NOTICE: whitePoint is only used by Reinhard, the infinity gives the plain one
+void applyToneCurve(PixelBlock& block, uint32_t count, ToneMappingOperator op, Float whitePoint) noexcept;
+
+PIPER_NAMESPACE_END
@@ -18,7 +18,22 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+// NOTICE: the variants excluded by PIPER_VARIANTS are neither instantiated nor registered
+#ifndef PIPER_DISABLE_VARIANT_RSSMono
 PIPER_VARIANT_FUNC(RSSMono)
+#endif
+#ifndef PIPER_DISABLE_VARIANT_RSSRGB
 PIPER_VARIANT_FUNC(RSSRGB)
+#endif
+#ifndef PIPER_DISABLE_VARIANT_RSSSpectral
 PIPER_VARIANT_FUNC(RSSSpectral)
+#endif
+#ifndef PIPER_DISABLE_VARIANT_RSSSpectral8
+PIPER_VARIANT_FUNC(RSSSpectral8)
+#endif
+#ifndef PIPER_DISABLE_VARIANT_RSSSpectral16
+PIPER_VARIANT_FUNC(RSSSpectral16)
+#endif
+#ifndef PIPER_DISABLE_VARIANT_RSSMonoSpectral
 PIPER_VARIANT_FUNC(RSSMonoSpectral)
+#endif
@@ -22,11 +22,18 @@
 #include <Piper/Core/Report.hpp>
 #include <Piper/Core/StaticFactory.hpp>
 #include <Piper/Core/Stats.hpp>
+#include <Piper/Core/Threading.hpp>
+#include <Piper/Core/Trace.hpp>
 #include <Piper/Render/Acceleration.hpp>
 #include <Piper/Render/Material.hpp>
+#include <Piper/Render/Random.hpp>
 #include <Piper/Render/Shape.hpp>
+#include <array>
+#include <bit>
 #include <embree3/rtcore.h>
+#include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <optional>
 
 PIPER_NAMESPACE_BEGIN
 
@@ -39,12 +46,15 @@ public:
     DeviceInstance() {
         initFloatingPointEnvironment();
 
-        mDevice = rtcNewDevice("start_threads=1,set_affinity=1");
+        // the threads are pinned by the render arena if it is bound to a NUMA node
+        const auto config = fmt::format("threads={},start_threads=1,set_affinity={}", threadBudget(), boundNumaNode() ? 0 : 1);
+        mDevice = rtcNewDevice(config.c_str());
         rtcSetDeviceMemoryMonitorFunction(
             mDevice,
             [](void* ptr, const ssize_t bytes, bool) {
                 auto& self = *static_cast<DeviceInstance*>(ptr);
-                self.mUsedMemory += bytes;
+                const auto usedMemory = self.mUsedMemory += bytes;
+                Peak<StatsType::AccelerationMemoryPeak>::record(static_cast<uint64_t>(std::max(usedMemory, static_cast<ssize_t>(0))));
 
                 auto& count = self.mUpdateCount;
                 const auto newCount = getMonitor().updateCount();
@@ -65,7 +75,12 @@ public:
             this);
 
         rtcSetDeviceErrorFunction(
-            mDevice, [](void*, enum RTCError code, const char* str) { fatal(fmt::format("Embree error (code = {}): {}", code, str)); },
+            mDevice,
+            [](void*, enum RTCError code, const char* str) {
+                // the builds aborted by the progress monitors are committed again later
+                if(code != RTC_ERROR_CANCELLED)
+                    fatal(fmt::format("Embree error (code = {}): {}", code, str));
+            },
             nullptr);
     }
     DeviceInstance(const DeviceInstance&) = delete;
@@ -89,40 +104,144 @@ static RTCDevice device() {
 
 static const RTCDevice forceInitBeforeMain = device();  // For option "start_threads=1"
 
-class EmbreeGeometry final : public PrimitiveGroup {
+static RTCBuildQuality convertQuality(const BuildQuality quality) noexcept {
+    switch(quality) {
+        case BuildQuality::Low:
+            return RTC_BUILD_QUALITY_LOW;
+        case BuildQuality::Medium:
+            return RTC_BUILD_QUALITY_MEDIUM;
+        default:
+            return RTC_BUILD_QUALITY_HIGH;
+    }
+}
+
+static RTCSceneFlags convertFlags(const BuildSettings& settings) noexcept {
+    auto flags = RTC_SCENE_FLAG_NONE;
+    if(settings.compact)
+        flags = flags | RTC_SCENE_FLAG_COMPACT;
+    if(settings.robust)
+        flags = flags | RTC_SCENE_FLAG_ROBUST;
+    return flags;
+}
+
+class EmbreeMesh final : public BottomLevelGeometry {
     RTCGeometry mGeometry;
     RTCScene mInstancedScene;
-    RTCGeometry mMotionBlurGeometry;
+    DisplacementFunction mDisplacement;
 
 public:
-    explicit EmbreeGeometry(const RTCGeometry geometry, const Shape* shape) : mGeometry{ geometry } {
-        rtcSetGeometryBuildQuality(mGeometry, RTC_BUILD_QUALITY_HIGH);
+    EmbreeMesh(const RTCGeometry geometry, const BuildSettings& settings, DisplacementFunction displacement = {})
+        : mGeometry{ geometry }, mDisplacement{ std::move(displacement) } {
+        rtcSetGeometryBuildQuality(mGeometry, convertQuality(settings.quality));
+        if(mDisplacement) {
+            rtcSetGeometryUserData(mGeometry, &mDisplacement);
+            rtcSetGeometryDisplacementFunction(mGeometry, [](const RTCDisplacementFunctionNArguments* args) {
+                const auto& func = *static_cast<const DisplacementFunction*>(args->geometryUserPtr);
+                for(uint32_t idx = 0; idx < args->N; ++idx) {
+                    // NOTICE: Ng is not normalized
+                    const auto normal = glm::normalize(glm::vec3{ args->Ng_x[idx], args->Ng_y[idx], args->Ng_z[idx] });
+                    const auto offset = normal * func(args->primID, { args->u[idx], args->v[idx] });
+                    args->P_x[idx] += offset.x;
+                    args->P_y[idx] += offset.y;
+                    args->P_z[idx] += offset.z;
+                }
+            });
+        }
 
-        const auto dev = device();
-        mInstancedScene = rtcNewScene(dev);
+        mInstancedScene = rtcNewScene(device());
 
-        // TODO: progress monitor
-        rtcSetSceneProgressMonitorFunction(
-            mInstancedScene, [](void* ptr, double progress) { return true; }, this);
-        rtcSetSceneBuildQuality(mInstancedScene, RTC_BUILD_QUALITY_HIGH);
-        rtcSetSceneFlags(mInstancedScene, RTC_SCENE_FLAG_COMPACT);
+        // NOTICE: the meshes are built once when the scene is loaded and shared by all jobs, so their builds are never cancelled
+        rtcSetSceneBuildQuality(mInstancedScene, convertQuality(settings.quality));
+        // the opacity filter is attached to the intersect context, so the instanced scenes must accept it
+        rtcSetSceneFlags(mInstancedScene, convertFlags(settings) | RTC_SCENE_FLAG_CONTEXT_FILTER_FUNCTION);
 
         rtcAttachGeometry(mInstancedScene, mGeometry);
 
-        mMotionBlurGeometry = rtcNewGeometry(dev, RTC_GEOMETRY_TYPE_INSTANCE);
-        rtcSetGeometryBuildQuality(mMotionBlurGeometry, RTC_BUILD_QUALITY_HIGH);
-        rtcSetGeometryInstancedScene(mMotionBlurGeometry, mInstancedScene);
-        rtcSetGeometryUserData(mMotionBlurGeometry, const_cast<Shape*>(shape));
+        // the mesh never changes after construction, so its BVH is only built once
+        rtcCommitGeometry(mGeometry);
+        rtcCommitScene(mInstancedScene);
     }
 
-    ~EmbreeGeometry() override {
-        rtcReleaseGeometry(mMotionBlurGeometry);
+    ~EmbreeMesh() override {
         rtcReleaseScene(mInstancedScene);
         rtcReleaseGeometry(mGeometry);
     }
 
-    RTCGeometry getGeometry() const noexcept {
-        return mMotionBlurGeometry;
+    [[nodiscard]] RTCScene scene() const noexcept {
+        return mInstancedScene;
+    }
+};
+
+class EmbreeGeometry;
+
+// the user data of the geometries in the top-level scenes
+class EmbreeGroup : public PrimitiveGroup {
+public:
+    [[nodiscard]] virtual RTCGeometry getGeometry(uint32_t buffer) const noexcept = 0;
+    virtual void swap() noexcept = 0;
+    [[nodiscard]] virtual bool masked() const noexcept = 0;
+    // the instance resolving the hits of the level of detail
+    [[nodiscard]] virtual const EmbreeGeometry& level(uint32_t levelIdx) const noexcept = 0;
+};
+
+class EmbreeGeometry final : public EmbreeGroup {
+    using ObjectToWorld = AffineTransform<FrameOfReference::Object, FrameOfReference::World>;
+
+    Ref<EmbreeMesh> mMesh;
+    const Shape* mShape;
+    // one instance per scene buffer, the back one is updated while the front one is traced
+    std::array<RTCGeometry, 2> mMotionBlurGeometry;
+    // the transforms of the instances without motion blur are precomputed at update time
+    std::array<std::optional<ObjectToWorld>, 2> mStaticTransform;
+    uint32_t mBack = 0;
+
+public:
+    EmbreeGeometry(Ref<EmbreeMesh> mesh, const Shape* shape, const BuildSettings& sceneSettings)
+        : mMesh{ std::move(mesh) }, mShape{ shape } {
+        // the instances are the primitives of the top-level BVH, so they follow the settings of the scene
+        const auto quality = sceneSettings.refit ? RTC_BUILD_QUALITY_REFIT : convertQuality(sceneSettings.quality);
+        for(auto& instance : mMotionBlurGeometry) {
+            instance = rtcNewGeometry(device(), RTC_GEOMETRY_TYPE_INSTANCE);
+            rtcSetGeometryBuildQuality(instance, quality);
+            rtcSetGeometryInstancedScene(instance, mMesh->scene());
+            rtcSetGeometryUserData(instance, static_cast<EmbreeGroup*>(this));
+        }
+    }
+
+    ~EmbreeGeometry() override {
+        for(const auto instance : mMotionBlurGeometry)
+            rtcReleaseGeometry(instance);
+    }
+
+    [[nodiscard]] RTCGeometry getGeometry(const uint32_t buffer) const noexcept override {
+        return mMotionBlurGeometry[buffer];
+    }
+
+    void swap() noexcept override {
+        mBack ^= 1;
+    }
+
+    [[nodiscard]] bool masked() const noexcept override {
+        return mShape->masked();
+    }
+
+    [[nodiscard]] const EmbreeGeometry& level(uint32_t) const noexcept override {
+        return *this;
+    }
+
+    [[nodiscard]] const Shape& shape() const noexcept {
+        return *mShape;
+    }
+
+    // the transform of the front instance at time t
+    [[nodiscard]] ObjectToWorld transform(const Float t) const noexcept {
+        const auto front = mBack ^ 1;
+        if(const auto& trans = mStaticTransform[front])
+            return *trans;
+
+        glm::mat4 mat;
+        rtcGetGeometryTransform(mMotionBlurGeometry[front], t, RTC_FORMAT_FLOAT4X4_COLUMN_MAJOR, glm::value_ptr(mat));
+        return ObjectToWorld{ mat };
     }
 
     void updateTransform(const ShutterKeyFrames& transform) override {
@@ -136,40 +255,348 @@ public:
             return &transSRT;
         };
 
-        rtcSetGeometryTimeStepCount(mMotionBlurGeometry, static_cast<uint32_t>(transform.size()));
+        const auto instance = mMotionBlurGeometry[mBack];
+        rtcSetGeometryTimeStepCount(instance, static_cast<uint32_t>(transform.size()));
 
         for(uint32_t idx = 0; idx < transform.size(); ++idx)
-            rtcSetGeometryTransformQuaternion(mMotionBlurGeometry, idx, convertSRT(transform[idx]));
+            rtcSetGeometryTransformQuaternion(instance, idx, convertSRT(transform[idx]));
+
+        // same as the quaternion decomposition: translation * rotation * scale
+        if(transform.size() == 1) {
+            const auto& [scale, rotation, translation] = transform.front();
+            mStaticTransform[mBack].emplace(glm::translate(glm::identity<glm::mat4>(), translation) * glm::mat4_cast(rotation) *
+                                            glm::scale(glm::identity<glm::mat4>(), scale));
+        } else
+            mStaticTransform[mBack].reset();
     }
 
     void commit() override {
-        rtcCommitGeometry(mGeometry);
-        rtcCommitScene(mInstancedScene);
-        rtcCommitGeometry(mMotionBlurGeometry);
+        rtcCommitGeometry(mMotionBlurGeometry[mBack]);
     }
 };
 
-class EmbreeScene final : public Acceleration {
-    RTCScene mScene;
+// the intersect context is extended with the traced scene, so that the filter can find the shapes of the instances
+struct EmbreeFilterContext final {
+    RTCIntersectContext ctx;
+    RTCScene scene;
+    // indexed by the ray IDs, the cones select the levels of detail
+    const Ray* rays;
+};
+
+// Stochastic opacity: the candidate hits of the masked shapes are rejected during traversal instead of tracing continuation rays, so
+// the occlusion queries see the fractional opacity as transparent shadows. The decision is a hash of the ray and the hit, so that it
+// is consistent between the queries of the same ray.
+static void opacityFilter(const RTCFilterFunctionNArguments* args) {
+    const auto& ctx = *reinterpret_cast<const EmbreeFilterContext*>(args->context);
+    const auto n = args->N;
+    for(uint32_t idx = 0; idx < n; ++idx) {
+        if(args->valid[idx] == 0)
+            continue;
+        const auto instID = RTCHitN_instID(args->hit, n, idx, 0);
+        const auto& shape =
+            static_cast<const EmbreeGroup*>(rtcGetGeometryUserData(rtcGetGeometry(ctx.scene, instID)))->level(0).shape();
+        if(!shape.masked())
+            continue;
+
+        const auto primID = RTCHitN_primID(args->hit, n, idx);
+        const glm::vec2 barycentric{ RTCHitN_u(args->hit, n, idx), RTCHitN_v(args->hit, n, idx) };
+        const auto opacity = shape.opacity(primID, barycentric, RTCRayN_time(args->ray, n, idx));
+        if(opacity >= 1.0f)
+            continue;
+
+        auto key = seeding((static_cast<uint64_t>(instID) << 32) | primID);
+        for(const auto value : { barycentric.x, barycentric.y, RTCRayN_org_x(args->ray, n, idx), RTCRayN_org_y(args->ray, n, idx),
+                                 RTCRayN_org_z(args->ray, n, idx), RTCRayN_dir_x(args->ray, n, idx), RTCRayN_dir_y(args->ray, n, idx),
+                                 RTCRayN_dir_z(args->ray, n, idx) })
+            key = seeding(key ^ std::bit_cast<uint32_t>(value));
+        if(static_cast<Float>(static_cast<double>(key) * 0x1p-64) >= opacity)
+            args->valid[idx] = 0;
+    }
+}
+
+static RTCBounds mergeBounds(const RTCBounds& lhs, const RTCBounds& rhs) noexcept {
+    return { std::fmin(lhs.lower_x, rhs.lower_x), std::fmin(lhs.lower_y, rhs.lower_y), std::fmin(lhs.lower_z, rhs.lower_z), 0.0f,
+             std::fmax(lhs.upper_x, rhs.upper_x), std::fmax(lhs.upper_y, rhs.upper_y), std::fmax(lhs.upper_z, rhs.upper_z), 0.0f };
+}
+
+static glm::vec3 boundsCenter(const RTCBounds& bounds) noexcept {
+    return (glm::vec3{ bounds.lower_x, bounds.lower_y, bounds.lower_z } + glm::vec3{ bounds.upper_x, bounds.upper_y, bounds.upper_z }) *
+        0.5f;
+}
+
+static Float boundsDiagonal(const RTCBounds& bounds) noexcept {
+    return glm::distance(glm::vec3{ bounds.lower_x, bounds.lower_y, bounds.lower_z },
+                         glm::vec3{ bounds.upper_x, bounds.upper_y, bounds.upper_z });
+}
+
+// The levels of detail of an instance, please refer to "Implementing Stochastic Levels of Detail with Microsoft DirectX Raytracing"
+// (Lloyd et al. 2020). Each level is instanced in its own scene, and the top-level scene only contains a user geometry bounding all
+// levels, which forwards the rays to the scene of the level selected for them. So the rays never traverse the unselected levels.
+class EmbreeLODGeometry final : public EmbreeGroup {
+    std::pmr::vector<Ref<EmbreeGeometry>> mLevels{ context().globalAllocator };
+    // relative to the diagonal of the finest level, non-decreasing
+    std::pmr::vector<Float> mRelativeEdgeLengths{ context().globalAllocator };
+    Float mDetailScale;
+    std::pmr::vector<std::array<RTCScene, 2>> mLevelScenes{ context().globalAllocator };
+    std::array<RTCGeometry, 2> mProxy{};
+    // the union of the bounds of all levels
+    std::array<RTCLinearBounds, 2> mBounds{};
+    // the center and the diagonal of the finest level in the world space
+    std::array<glm::vec4, 2> mExtent{};
+    uint32_t mBack = 0;
+
+    // the level only depends on the ray and the instance, so that all candidate hits of a ray are in the same level
+    [[nodiscard]] uint32_t selectLevel(const Ray& ray, const uint32_t geomID) const noexcept {
+        const auto& extent = mExtent[mBack ^ 1];
+        if(ray.lodInstance == geomID)
+            return ray.lodLevel;
+        const auto width = ray.coneWidth + ray.coneSpread * glm::distance(ray.origin.raw(), glm::vec3{ extent });
+        const auto target = width * mDetailScale / extent.w;
+
+        uint32_t levelIdx = 0;
+        while(levelIdx + 1 < mRelativeEdgeLengths.size() && mRelativeEdgeLengths[levelIdx + 1] <= target)
+            ++levelIdx;
+        if(levelIdx + 1 == mRelativeEdgeLengths.size() || target <= mRelativeEdgeLengths[levelIdx])
+            return levelIdx;
+
+        // stochastic transition, the probability of the coarser level grows linearly in the log space
+        const auto fraction = std::log(target / mRelativeEdgeLengths[levelIdx]) /
+            std::log(mRelativeEdgeLengths[levelIdx + 1] / mRelativeEdgeLengths[levelIdx]);
+        auto key = seeding(geomID);
+        for(const auto value : { ray.origin.x(), ray.origin.y(), ray.origin.z(), ray.direction.x(), ray.direction.y(), ray.direction.z() })
+            key = seeding(key ^ std::bit_cast<uint32_t>(value));
+        return static_cast<Float>(static_cast<double>(key) * 0x1p-64) < fraction ? levelIdx + 1 : levelIdx;
+    }
+
+    static const EmbreeLODGeometry& self(void* ptr) noexcept {
+        return *static_cast<const EmbreeLODGeometry*>(static_cast<const EmbreeGroup*>(ptr));
+    }
+
+    static void boundsCallback(const RTCBoundsFunctionArguments* args) {
+        const auto& lod = self(args->geometryUserPtr);
+        // called by the build of the back scene
+        const auto& bounds = lod.mBounds[lod.mBack];
+        *args->bounds_o = args->timeStep == 0 ? bounds.bounds0 : bounds.bounds1;
+    }
+
+    static void intersectCallback(const RTCIntersectFunctionNArguments* args) {
+        const auto& lod = self(args->geometryUserPtr);
+        const auto& ctx = *reinterpret_cast<const EmbreeFilterContext*>(args->context);
+        const auto n = args->N;
+        const auto rays = RTCRayHitN_RayN(args->rayhit, n);
+        const auto hits = RTCRayHitN_HitN(args->rayhit, n);
+        for(uint32_t idx = 0; idx < n; ++idx) {
+            if(args->valid[idx] == 0)
+                continue;
+            const auto levelIdx = lod.selectLevel(ctx.rays[RTCRayN_id(rays, n, idx)], args->geomID);
+            auto levelCtx = ctx;
+            levelCtx.scene = lod.mLevelScenes[levelIdx][lod.mBack ^ 1];
+
+            RTCRayHit rayHit{ { RTCRayN_org_x(rays, n, idx), RTCRayN_org_y(rays, n, idx), RTCRayN_org_z(rays, n, idx),
+                                RTCRayN_tnear(rays, n, idx), RTCRayN_dir_x(rays, n, idx), RTCRayN_dir_y(rays, n, idx),
+                                RTCRayN_dir_z(rays, n, idx), RTCRayN_time(rays, n, idx), RTCRayN_tfar(rays, n, idx),
+                                RTCRayN_mask(rays, n, idx), RTCRayN_id(rays, n, idx), RTCRayN_flags(rays, n, idx) },
+                              {} };
+            rayHit.hit.geomID = RTC_INVALID_GEOMETRY_ID;
+            rtcIntersect1(levelCtx.scene, &levelCtx.ctx, &rayHit);
+            if(rayHit.hit.geomID == RTC_INVALID_GEOMETRY_ID)
+                continue;
+
+            // the level scenes are in the world space, only the IDs are replaced
+            RTCRayN_tfar(rays, n, idx) = rayHit.ray.tfar;
+            RTCHitN_Ng_x(hits, n, idx) = rayHit.hit.Ng_x;
+            RTCHitN_Ng_y(hits, n, idx) = rayHit.hit.Ng_y;
+            RTCHitN_Ng_z(hits, n, idx) = rayHit.hit.Ng_z;
+            RTCHitN_u(hits, n, idx) = rayHit.hit.u;
+            RTCHitN_v(hits, n, idx) = rayHit.hit.v;
+            RTCHitN_primID(hits, n, idx) = rayHit.hit.primID;
+            RTCHitN_geomID(hits, n, idx) = levelIdx;
+            RTCHitN_instID(hits, n, idx, 0) = args->geomID;
+        }
+    }
+
+    static void occludedCallback(const RTCOccludedFunctionNArguments* args) {
+        const auto& lod = self(args->geometryUserPtr);
+        const auto& ctx = *reinterpret_cast<const EmbreeFilterContext*>(args->context);
+        const auto n = args->N;
+        const auto rays = args->ray;
+        for(uint32_t idx = 0; idx < n; ++idx) {
+            if(args->valid[idx] == 0)
+                continue;
+            const auto levelIdx = lod.selectLevel(ctx.rays[RTCRayN_id(rays, n, idx)], args->geomID);
+            auto levelCtx = ctx;
+            levelCtx.scene = lod.mLevelScenes[levelIdx][lod.mBack ^ 1];
+
+            RTCRay ray{ RTCRayN_org_x(rays, n, idx), RTCRayN_org_y(rays, n, idx), RTCRayN_org_z(rays, n, idx),
+                        RTCRayN_tnear(rays, n, idx), RTCRayN_dir_x(rays, n, idx), RTCRayN_dir_y(rays, n, idx),
+                        RTCRayN_dir_z(rays, n, idx), RTCRayN_time(rays, n, idx), RTCRayN_tfar(rays, n, idx),
+                        RTCRayN_mask(rays, n, idx), RTCRayN_id(rays, n, idx), RTCRayN_flags(rays, n, idx) };
+            rtcOccluded1(levelCtx.scene, &levelCtx.ctx, &ray);
+            if(ray.tfar < 0.0f)
+                RTCRayN_tfar(rays, n, idx) = -infinity;
+        }
+    }
 
 public:
-    explicit EmbreeScene(const RTCScene scene) : mScene{ scene } {
+    EmbreeLODGeometry(const std::span<const DetailLevel> levels, const Float detailScale, const BuildSettings& sceneSettings)
+        : mDetailScale{ detailScale } {
+        Float finestDiagonal = 0.0f;
+        for(const auto& [geometry, shape, edgeLength] : levels) {
+            auto mesh = dynamicCast<EmbreeMesh>(geometry);
+            if(mLevels.empty()) {
+                RTCBounds meshBounds;
+                rtcGetSceneBounds(mesh->scene(), &meshBounds);
+                finestDiagonal = std::fmax(boundsDiagonal(meshBounds), epsilon);
+            }
+            const auto relativeEdgeLength = edgeLength / finestDiagonal;
+            mRelativeEdgeLengths.push_back(mRelativeEdgeLengths.empty() ? relativeEdgeLength :
+                                                                          std::fmax(relativeEdgeLength, mRelativeEdgeLengths.back()));
+            mLevels.push_back(makeRefCount<EmbreeGeometry>(std::move(mesh), shape, sceneSettings));
+
+            auto& scenes = mLevelScenes.emplace_back();
+            for(uint32_t buffer = 0; buffer < 2; ++buffer) {
+                scenes[buffer] = rtcNewScene(device());
+                rtcSetSceneBuildQuality(scenes[buffer], convertQuality(sceneSettings.quality));
+                rtcSetSceneFlags(scenes[buffer], convertFlags(sceneSettings) | RTC_SCENE_FLAG_CONTEXT_FILTER_FUNCTION);
+                rtcAttachGeometry(scenes[buffer], mLevels.back()->getGeometry(buffer));
+            }
+        }
+
+        const auto quality = sceneSettings.refit ? RTC_BUILD_QUALITY_REFIT : convertQuality(sceneSettings.quality);
+        for(auto& proxy : mProxy) {
+            proxy = rtcNewGeometry(device(), RTC_GEOMETRY_TYPE_USER);
+            rtcSetGeometryUserPrimitiveCount(proxy, 1);
+            rtcSetGeometryBuildQuality(proxy, quality);
+            rtcSetGeometryUserData(proxy, static_cast<EmbreeGroup*>(this));
+            rtcSetGeometryBoundsFunction(proxy, boundsCallback, nullptr);
+            rtcSetGeometryIntersectFunction(proxy, intersectCallback);
+            rtcSetGeometryOccludedFunction(proxy, occludedCallback);
+        }
+    }
+
+    ~EmbreeLODGeometry() override {
+        for(const auto proxy : mProxy)
+            rtcReleaseGeometry(proxy);
+        for(const auto& scenes : mLevelScenes)
+            for(const auto scene : scenes)
+                rtcReleaseScene(scene);
+    }
+
+    [[nodiscard]] RTCGeometry getGeometry(const uint32_t buffer) const noexcept override {
+        return mProxy[buffer];
+    }
 
-        rtcSetSceneBuildQuality(mScene, RTC_BUILD_QUALITY_LOW);
-        rtcSetSceneFlags(mScene, RTC_SCENE_FLAG_DYNAMIC);
+    void swap() noexcept override {
+        mBack ^= 1;
+        for(const auto& level : mLevels)
+            level->swap();
+    }
+
+    [[nodiscard]] bool masked() const noexcept override {
+        return mLevels.front()->masked();
+    }
+
+    [[nodiscard]] const EmbreeGeometry& level(const uint32_t levelIdx) const noexcept override {
+        return *mLevels[levelIdx];
+    }
+
+    void updateTransform(const ShutterKeyFrames& transform) override {
+        for(const auto& level : mLevels)
+            level->updateTransform(transform);
+        // the linear bounds of the levels cover the motion
+        rtcSetGeometryTimeStepCount(mProxy[mBack], transform.size() > 1 ? 2U : 1U);
+    }
+
+    void commit() override {
+        auto& bounds = mBounds[mBack];
+        for(uint32_t idx = 0; idx < mLevels.size(); ++idx) {
+            mLevels[idx]->commit();
+            const auto scene = mLevelScenes[idx][mBack];
+            rtcCommitScene(scene);
+
+            RTCLinearBounds levelBounds;
+            rtcGetSceneLinearBounds(scene, &levelBounds);
+            if(idx == 0) {
+                bounds = levelBounds;
+                mExtent[mBack] = glm::vec4{ (boundsCenter(levelBounds.bounds0) + boundsCenter(levelBounds.bounds1)) * 0.5f,
+                                            (boundsDiagonal(levelBounds.bounds0) + boundsDiagonal(levelBounds.bounds1)) * 0.5f };
+            } else {
+                bounds.bounds0 = mergeBounds(bounds.bounds0, levelBounds.bounds0);
+                bounds.bounds1 = mergeBounds(bounds.bounds1, levelBounds.bounds1);
+            }
+        }
+        mExtent[mBack].w = std::fmax(mExtent[mBack].w, epsilon);
+        rtcCommitGeometry(mProxy[mBack]);
+    }
+};
+
+// NOTICE: the scene is double-buffered. The back scene can be updated and committed while the front scene is traced.
+class EmbreeScene final : public Acceleration {
+    std::array<RTCScene, 2> mScenes;
+    std::pmr::vector<EmbreeGroup*> mGroups;
+    uint32_t mFront = 1;
+    // the filter is only attached if any shape is masked
+    bool mMasked;
+    ProgressReporterHandle mBuildProgress{ "Building BVH" };
+    std::atomic_bool mBuildCancelled = false;
+
+    RTCScene scene() const noexcept {
+        return mScenes[mFront];
+    }
+
+    [[nodiscard]] EmbreeFilterContext makeContext(const RTCIntersectContextFlags flags, const Ray* rays) const noexcept {
+        EmbreeFilterContext ctx{};
+        rtcInitIntersectContext(&ctx.ctx);
+        ctx.ctx.flags = flags;
+        if(mMasked)
+            ctx.ctx.filter = opacityFilter;
+        ctx.scene = scene();
+        ctx.rays = rays;
+        return ctx;
+    }
 
-        // TODO: progress monitor
-        rtcSetSceneProgressMonitorFunction(
-            scene, [](void* ptr, double progress) { return true; }, this);
+public:
+    EmbreeScene(const std::array<RTCScene, 2>& scenes, std::pmr::vector<EmbreeGroup*> groups, const BuildSettings& settings)
+        : mScenes{ scenes }, mGroups{ std::move(groups) },
+          mMasked{ std::ranges::any_of(mGroups, [](const EmbreeGroup* group) { return group->masked(); }) } {
+        for(const auto scene : mScenes) {
+            rtcSetSceneBuildQuality(scene, convertQuality(settings.quality));
+            rtcSetSceneFlags(scene, convertFlags(settings) | RTC_SCENE_FLAG_DYNAMIC | RTC_SCENE_FLAG_CONTEXT_FILTER_FUNCTION);
+
+            rtcSetSceneProgressMonitorFunction(
+                scene,
+                [](void* ptr, const double progress) {
+                    auto& self = *static_cast<EmbreeScene*>(ptr);
+                    self.mBuildProgress.update(progress);
+                    if(cancellationRequested()) {
+                        self.mBuildCancelled = true;
+                        return false;
+                    }
+                    return true;
+                },
+                this);
+        }
     }
 
     ~EmbreeScene() override {
-        rtcReleaseScene(mScene);
+        for(const auto scene : mScenes)
+            rtcReleaseScene(scene);
+    }
+
+    Point<FrameOfReference::World> center() const noexcept override {
+        RTCLinearBounds linearBounds;
+        rtcGetSceneLinearBounds(scene(), &linearBounds);
+        constexpr auto evalCenter = [](const RTCBounds& bounds) {
+            return (glm::vec3{ bounds.lower_x, bounds.lower_y, bounds.lower_z } +
+                    glm::vec3{ bounds.upper_x, bounds.upper_y, bounds.upper_z }) *
+                0.5f;
+        };
+        return Point<FrameOfReference::World>::fromRaw((evalCenter(linearBounds.bounds0) + evalCenter(linearBounds.bounds1)) * 0.5f);
     }
 
     Float radius() const noexcept override {
         RTCLinearBounds linearBounds;
-        rtcGetSceneLinearBounds(mScene, &linearBounds);
+        rtcGetSceneLinearBounds(scene(), &linearBounds);
         constexpr auto evalRadius = [](const RTCBounds& bounds) {
             return glm::distance(glm::vec3{ bounds.lower_x, bounds.lower_y, bounds.lower_z },
                                  glm::vec3{ bounds.upper_x, bounds.upper_y, bounds.upper_z }) *
@@ -178,81 +605,102 @@ public:
         return (evalRadius(linearBounds.bounds0) + evalRadius(linearBounds.bounds1)) * 0.5f;
     }
 
-    void commit() override {
-        rtcCommitScene(mScene);
+    bool commit() override {
+        PIPER_TRACE_SPAN("CommitBVH");
+        mBuildCancelled = false;
+        rtcCommitScene(mScenes[mFront ^ 1]);
+        return !mBuildCancelled;
+    }
+
+    void swap() override {
+        mFront ^= 1;
+        for(const auto group : mGroups)
+            group->swap();
     }
 
-    Intersection processHitInfo(const Ray& ray, const RTCHit& hitInfo, const Distance distance) const {
-        if(distance.raw() < infinity) {  // NOLINT(clang-diagnostic-float-equal)
-            // surface
-            BoolCounter<StatsType::Intersection>::count(true);
+    static HitRecord makeHitRecord(const RTCRayHit& rayHit) noexcept {
+        const auto& hitInfo = rayHit.hit;
+        const auto distance = rayHit.ray.tfar;
+        BoolCounter<StatsType::Intersection>::count(distance < infinity);
+        // the geometry in the instanced scene is always the first one, the LOD instances report their levels instead
+        return { hitInfo.instID[0], hitInfo.geomID, hitInfo.primID, { hitInfo.u, hitInfo.v }, distance,
+                 { hitInfo.Ng_x, hitInfo.Ng_y, hitInfo.Ng_z } };
+    }
 
-            const auto geo = rtcGetGeometry(mScene, hitInfo.instID[0]);
-            const auto& shape = *static_cast<const Shape*>(rtcGetGeometryUserData(geo));
+    Intersection resolve(const Ray& ray, const HitRecord& hit) const {
+        if(!hit.valid())
+            return std::monostate{};
 
-            glm::mat4 mat;
-            rtcGetGeometryTransform(geo, ray.t, RTC_FORMAT_FLOAT4X4_COLUMN_MAJOR, glm::value_ptr(mat));
-            const AffineTransform<FrameOfReference::Object, FrameOfReference::World> trans{ mat };
-            // NOTICE: Ng_x/y/z are not normalized!!!
-            auto geometryNormal =
-                Normal<FrameOfReference::World>::fromRaw(glm::normalize(glm::vec3{ hitInfo.Ng_x, hitInfo.Ng_y, hitInfo.Ng_z }));
+        const auto geo = rtcGetGeometry(scene(), hit.instID);
+        const auto& group = static_cast<const EmbreeGroup*>(rtcGetGeometryUserData(geo))->level(hit.levelIdx);
+        const auto& shape = group.shape();
+        const auto trans = group.transform(ray.t);
+        auto geometryNormal = Normal<FrameOfReference::World>::fromRaw(glm::normalize(hit.geometryNormal));
 
-            if(dot(geometryNormal.asDirection(), ray.direction) > 0.0f)
-                geometryNormal = -geometryNormal;
+        if(dot(geometryNormal.asDirection(), ray.direction) > 0.0f)
+            geometryNormal = -geometryNormal;
 
-            return shape.generateIntersection(ray, distance, trans, geometryNormal, { hitInfo.u, hitInfo.v }, hitInfo.primID);
+        auto res = shape.generateIntersection(ray, Distance::fromRaw(hit.distance), trans, geometryNormal, hit.uv, hit.primID);
+        // NOTICE: the instances without levels never match the proxy geometries, so they are recorded unconditionally
+        if(const auto surface = std::get_if<SurfaceHit>(&res)) {
+            surface->lodInstance = hit.instID;
+            surface->lodLevel = hit.levelIdx;
         }
-
-        // missing
-        BoolCounter<StatsType::Intersection>::count(false);
-        return std::monostate{};
+        return res;
     }
 
     Intersection trace(const Ray& ray) const override {
-        RTCIntersectContext ctx{};  // TODO: filter
-        rtcInitIntersectContext(&ctx);
+        auto ctx = makeContext(RTC_INTERSECT_CONTEXT_FLAG_INCOHERENT, &ray);
 
         RTCRayHit hit = { { ray.origin.x(), ray.origin.y(), ray.origin.z(), epsilon, ray.direction.x(), ray.direction.y(),
                             ray.direction.z(), ray.t, infinity, 0, 0, 0 },
                           {} };
 
         FloatingPointExceptionProbe::off();
-        rtcIntersect1(mScene, &ctx, &hit);
+        rtcIntersect1(scene(), &ctx.ctx, &hit);
         FloatingPointExceptionProbe::on();
 
-        return processHitInfo(ray, hit.hit, Distance::fromRaw(hit.ray.tfar));
+        return resolve(ray, makeHitRecord(hit));
     }
 
-    std::pmr::vector<Intersection> tracePrimary(const RayStream& rayStream) const override {
-        RTCIntersectContext ctx{};  // TODO: filter
-        rtcInitIntersectContext(&ctx);
-        ctx.flags = RTC_INTERSECT_CONTEXT_FLAG_COHERENT;
+    std::pmr::vector<HitRecord> traceHits(const RayStream& rayStream, const bool coherent) const override {
+        auto ctx = makeContext(coherent ? RTC_INTERSECT_CONTEXT_FLAG_COHERENT : RTC_INTERSECT_CONTEXT_FLAG_INCOHERENT, rayStream.data());
 
         std::pmr::vector<RTCRayHit> hit{ rayStream.size(), context().scopedAllocator };
         for(uint32_t idx = 0; idx < hit.size(); ++idx) {
-            const auto& [origin, direction, t] = rayStream[idx];
+            const auto& [origin, direction, t, coneWidth, coneSpread, lodInstance, lodLevel] = rayStream[idx];
             hit[idx].ray = {
-                origin.x(), origin.y(), origin.z(), epsilon, direction.x(), direction.y(), direction.z(), t, infinity, 0, 0, 0
+                origin.x(), origin.y(), origin.z(), epsilon, direction.x(), direction.y(), direction.z(), t, infinity, 0, idx, 0
             };
         }
 
         FloatingPointExceptionProbe::off();
-        rtcIntersect1M(mScene, &ctx, hit.data(), static_cast<uint32_t>(hit.size()), sizeof(RTCRayHit));
+        rtcIntersect1M(scene(), &ctx.ctx, hit.data(), static_cast<uint32_t>(hit.size()), sizeof(RTCRayHit));
         FloatingPointExceptionProbe::on();
 
-        std::pmr::vector<Intersection> res{ rayStream.size(), context().scopedAllocator };
-
-        for(uint32_t idx = 0; idx < hit.size(); ++idx) {
-            const auto& ray = rayStream[idx];
-            res[idx] = processHitInfo(ray, hit[idx].hit, Distance::fromRaw(hit[idx].ray.tfar));
-        }
+        std::pmr::vector<HitRecord> res{ rayStream.size(), context().scopedAllocator };
+        for(uint32_t idx = 0; idx < hit.size(); ++idx)
+            res[idx] = makeHitRecord(hit[idx]);
+        return res;
+    }
 
+    std::pmr::vector<Intersection> resolve(const RayStream& rayStream, const std::span<const HitRecord> hits) const override {
+        std::pmr::vector<Intersection> res{ hits.size(), context().scopedAllocator };
+        for(uint32_t idx = 0; idx < hits.size(); ++idx)
+            res[idx] = resolve(rayStream[idx], hits[idx]);
         return res;
     }
 
+    std::pmr::vector<Intersection> tracePrimary(const RayStream& rayStream) const override {
+        return resolve(rayStream, traceHits(rayStream, true));
+    }
+
+    std::pmr::vector<Intersection> trace(const RayStream& rayStream) const override {
+        return resolve(rayStream, traceHits(rayStream, false));
+    }
+
     bool occluded(const Ray& shadowRay, const Distance dist) const override {
-        RTCIntersectContext ctx{};
-        rtcInitIntersectContext(&ctx);
+        auto ctx = makeContext(RTC_INTERSECT_CONTEXT_FLAG_INCOHERENT, &shadowRay);
 
         RTCRay ray{ shadowRay.origin.x(),
                     shadowRay.origin.y(),
@@ -267,46 +715,144 @@ public:
                     0,
                     0 };
         FloatingPointExceptionProbe::off();
-        rtcOccluded1(mScene, &ctx, &ray);
+        rtcOccluded1(scene(), &ctx.ctx, &ray);
+        FloatingPointExceptionProbe::on();
+
+        const auto res = ray.tfar < dist.raw();
+        BoolCounter<StatsType::Occlusion>::count(res);
+        return res;
+    }
+
+    std::pmr::vector<bool> occluded(const RayStream& shadowRays, const std::pmr::vector<Distance>& distances) const override {
+        auto ctx = makeContext(RTC_INTERSECT_CONTEXT_FLAG_INCOHERENT, shadowRays.data());
+
+        std::pmr::vector<RTCRay> rays{ shadowRays.size(), context().scopedAllocator };
+        for(uint32_t idx = 0; idx < rays.size(); ++idx) {
+            const auto& [origin, direction, t, coneWidth, coneSpread, lodInstance, lodLevel] = shadowRays[idx];
+            rays[idx] = {
+                origin.x(), origin.y(), origin.z(), epsilon, direction.x(), direction.y(), direction.z(), t, distances[idx].raw(), 0, idx, 0
+            };
+        }
+
+        FloatingPointExceptionProbe::off();
+        rtcOccluded1M(scene(), &ctx.ctx, rays.data(), static_cast<uint32_t>(rays.size()), sizeof(RTCRay));
         FloatingPointExceptionProbe::on();
 
-        return ray.tfar < dist.raw();
+        std::pmr::vector<bool> res{ rays.size(), context().scopedAllocator };
+        for(uint32_t idx = 0; idx < rays.size(); ++idx) {
+            res[idx] = rays[idx].tfar < distances[idx].raw();
+            BoolCounter<StatsType::Occlusion>::count(res[idx]);
+        }
+        return res;
     }
 };
 
 class EmbreeBuilder final : public AccelerationBuilder {
+    BuildSettings mSceneSettings;
+    BuildSettings mShapeSettings;
+
 public:
+    EmbreeBuilder(const BuildSettings& sceneSettings, const BuildSettings& shapeSettings)
+        : mSceneSettings{ sceneSettings }, mShapeSettings{ shapeSettings } {}
+
     uint32_t maxStepCount() const noexcept override {
         return 129u;
     }
 
-    Ref<PrimitiveGroup> buildFromTriangleMesh(const uint32_t vertices, const uint32_t faces,
-                                              const std::function<void(void*, void*)>& writeCallback,
-                                              const Shape& shape) const noexcept override {
-        const auto dev = device();
-        const auto geometry = rtcNewGeometry(dev, RTC_GEOMETRY_TYPE_TRIANGLE);
-        const auto verticesBuffer =
-            rtcSetNewGeometryBuffer(geometry, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, sizeof(glm::vec3), vertices);
-        const auto indicesBuffer = rtcSetNewGeometryBuffer(geometry, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, sizeof(glm::uvec3), faces);
-        writeCallback(verticesBuffer, indicesBuffer);
-        return makeRefCount<EmbreeGeometry>(geometry, &shape);
+    const BuildSettings& shapeSettings() const noexcept override {
+        return mShapeSettings;
+    }
+
+    Ref<BottomLevelGeometry> buildFromTriangleMesh(const std::span<const glm::vec3> vertices, const std::span<const glm::uvec3> indices,
+                                                   const BuildSettings& settings) const noexcept override {
+        const auto geometry = rtcNewGeometry(device(), RTC_GEOMETRY_TYPE_TRIANGLE);
+        rtcSetSharedGeometryBuffer(geometry, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, vertices.data(), 0, sizeof(glm::vec3),
+                                   vertices.size());
+        rtcSetSharedGeometryBuffer(geometry, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, indices.data(), 0, sizeof(glm::uvec3),
+                                   indices.size());
+        return makeRefCount<EmbreeMesh>(geometry, settings);
+    }
+
+    Ref<BottomLevelGeometry> buildFromCurves(const std::span<const glm::vec4> controlPoints, const std::span<const uint32_t> segments,
+                                             const CurveType type, const BuildSettings& settings) const noexcept override {
+        const auto geometry = rtcNewGeometry(device(), type == CurveType::Round ? RTC_GEOMETRY_TYPE_ROUND_BSPLINE_CURVE :
+                                                                                  RTC_GEOMETRY_TYPE_FLAT_BSPLINE_CURVE);
+        rtcSetSharedGeometryBuffer(geometry, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT4, controlPoints.data(), 0, sizeof(glm::vec4),
+                                   controlPoints.size());
+        rtcSetSharedGeometryBuffer(geometry, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT, segments.data(), 0, sizeof(uint32_t),
+                                   segments.size());
+        return makeRefCount<EmbreeMesh>(geometry, settings);
+    }
+
+    Ref<BottomLevelGeometry> buildFromPoints(const std::span<const glm::vec4> points, const std::span<const glm::vec3> normals,
+                                             const PointType type, const BuildSettings& settings) const noexcept override {
+        const auto geometry =
+            rtcNewGeometry(device(), type == PointType::Sphere ? RTC_GEOMETRY_TYPE_SPHERE_POINT : RTC_GEOMETRY_TYPE_ORIENTED_DISC_POINT);
+        rtcSetSharedGeometryBuffer(geometry, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT4, points.data(), 0, sizeof(glm::vec4),
+                                   points.size());
+        if(type == PointType::Disk)
+            rtcSetSharedGeometryBuffer(geometry, RTC_BUFFER_TYPE_NORMAL, 0, RTC_FORMAT_FLOAT3, normals.data(), 0, sizeof(glm::vec3),
+                                       normals.size());
+        return makeRefCount<EmbreeMesh>(geometry, settings);
+    }
+
+    Ref<BottomLevelGeometry> buildFromCylinders(const std::span<const glm::vec4> endPoints, const std::span<const uint32_t> segments,
+                                                const BuildSettings& settings) const noexcept override {
+        // the linear cones are not capped, unlike the round linear curves
+        const auto geometry = rtcNewGeometry(device(), RTC_GEOMETRY_TYPE_CONE_LINEAR_CURVE);
+        rtcSetSharedGeometryBuffer(geometry, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT4, endPoints.data(), 0, sizeof(glm::vec4),
+                                   endPoints.size());
+        rtcSetSharedGeometryBuffer(geometry, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT, segments.data(), 0, sizeof(uint32_t),
+                                   segments.size());
+        return makeRefCount<EmbreeMesh>(geometry, settings);
+    }
+
+    Ref<BottomLevelGeometry> buildFromSubdivisionMesh(const std::span<const glm::vec3> vertices, const std::span<const glm::uvec4> quads,
+                                                      const std::span<const Float> edgeLevels, DisplacementFunction displacement,
+                                                      const BuildSettings& settings) const noexcept override {
+        const auto geometry = rtcNewGeometry(device(), RTC_GEOMETRY_TYPE_SUBDIVISION);
+        // all faces are quads
+        const auto faces = static_cast<uint32_t*>(
+            rtcSetNewGeometryBuffer(geometry, RTC_BUFFER_TYPE_FACE, 0, RTC_FORMAT_UINT, sizeof(uint32_t), quads.size()));
+        std::fill_n(faces, quads.size(), 4U);
+        rtcSetSharedGeometryBuffer(geometry, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, vertices.data(), 0, sizeof(glm::vec3),
+                                   vertices.size());
+        rtcSetSharedGeometryBuffer(geometry, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT, quads.data(), 0, sizeof(uint32_t),
+                                   quads.size() * 4);
+        rtcSetSharedGeometryBuffer(geometry, RTC_BUFFER_TYPE_LEVEL, 0, RTC_FORMAT_FLOAT, edgeLevels.data(), 0, sizeof(Float),
+                                   edgeLevels.size());
+        return makeRefCount<EmbreeMesh>(geometry, settings, std::move(displacement));
+    }
+
+    Ref<PrimitiveGroup> buildInstance(const Ref<BottomLevelGeometry>& geometry, const Shape& shape) const noexcept override {
+        return makeRefCount<EmbreeGeometry>(dynamicCast<EmbreeMesh>(geometry), &shape, mSceneSettings);
+    }
+
+    Ref<PrimitiveGroup> buildLODInstance(const std::span<const DetailLevel> levels, const Float detailScale) const noexcept override {
+        return makeRefCount<EmbreeLODGeometry>(levels, detailScale, mSceneSettings);
     }
 
     Ref<Acceleration> buildScene(const std::pmr::vector<PrimitiveGroup*>& primitiveGroups) const noexcept override {
         const auto dev = device();
-        const auto scene = rtcNewScene(dev);
+        const std::array<RTCScene, 2> scenes{ rtcNewScene(dev), rtcNewScene(dev) };
+
+        std::pmr::vector<EmbreeGroup*> groups{ context().globalAllocator };
+        groups.reserve(primitiveGroups.size());
 
+        // the geometries are attached in the same order, so the geometry IDs of both scenes are identical
         for(auto& group : primitiveGroups) {
-            const auto geometry = dynamic_cast<EmbreeGeometry*>(group)->getGeometry();
-            rtcAttachGeometry(scene, geometry);
+            const auto geometry = dynamic_cast<EmbreeGroup*>(group);
+            for(uint32_t buffer = 0; buffer < 2; ++buffer)
+                rtcAttachGeometry(scenes[buffer], geometry->getGeometry(buffer));
+            groups.push_back(geometry);
         }
 
-        return makeRefCount<EmbreeScene>(scene);
+        return makeRefCount<EmbreeScene>(scenes, std::move(groups), mSceneSettings);
     }
 };
 
-Ref<AccelerationBuilder> createEmbreeBackend() {
-    return makeRefCount<EmbreeBuilder>();
+Ref<AccelerationBuilder> createEmbreeBackend(const BuildSettings& sceneSettings, const BuildSettings& shapeSettings) {
+    return makeRefCount<EmbreeBuilder>(sceneSettings, shapeSettings);
 }
 
 PIPER_NAMESPACE_END
@@ -23,14 +23,18 @@
 #include <oneapi/tbb/tbbmalloc_proxy.h>
 //
 #include <Piper/Core/Context.hpp>
+#include <Piper/Core/FileIO.hpp>
 #include <Piper/Core/Monitor.hpp>
 #include <Piper/Core/NaiveUI.hpp>
 #include <Piper/Core/Report.hpp>
 #include <Piper/Core/StaticFactory.hpp>
 #include <Piper/Core/Stats.hpp>
 #include <Piper/Core/Sync.hpp>
+#include <Piper/Core/Threading.hpp>
+#include <Piper/Core/Trace.hpp>
 #include <Piper/Render/Math.hpp>
 #include <Piper/Render/Pipeline.hpp>
+#include <atomic>
 #include <cxxopts.hpp>
 #include <fmt/chrono.h>
 #include <fmt/format.h>
@@ -39,6 +43,8 @@
 #include <ftxui/component/component_base.hpp>
 #include <ftxui/dom/elements.hpp>
 #include <ftxui/screen/color.hpp>
+#include <magic_enum.hpp>
+#include <thread>
 using namespace Piper;
 
 template <typename Callable>
@@ -56,25 +62,40 @@ void guard(Callable&& callable) noexcept {
 #endif
 }
 
-namespace Piper {
-    extern std::function<void()> renderCallback;
-}
-
 void mainGuarded(int argc, char** argv) {
     initFloatingPointEnvironment();
 
     addSearchPath(fs::path{ argv[0] } / "data");
 
-    // TODO: disable Hyper-Threading ?
-
-    std::string inputFile, outputDir, serverConfig;
+    std::string inputFile, outputDir, serverConfig, serveEndpoint, tracePath, smtPolicy;
     bool help = false;
+    bool snapshot = false;
+    bool headless = false;
+    uint32_t servePort = 0;
+    uint32_t threadCount = 0;
+    int32_t numaNode = -1;
 
     cxxopts::Options options("Piper", "A physically based renderer");
     options.add_options()("display-server", "(IP address:port) pair for tev previewing",
                           cxxopts::value<std::string>(serverConfig)->default_value("127.0.0.1:14158"))  //
         ("input", "input file", cxxopts::value<std::string>(inputFile))                                 //
         ("output", "output directory", cxxopts::value<std::string>(outputDir)->default_value(""))       //
+        ("snapshot", "reuse the compiled scene snapshot in the output directory if the inputs are unchanged",
+         cxxopts::value<bool>(snapshot)->default_value("false"))  //
+        ("serve", "keep the scene resident and render the jobs received from the port on 127.0.0.1 (0 means disabled)",
+         cxxopts::value<uint32_t>(servePort)->default_value("0"))  //
+        ("serve-endpoint", "(IP address:port) pair to receive the jobs from, the jobs are not authenticated (empty means disabled)",
+         cxxopts::value<std::string>(serveEndpoint)->default_value(""))  //
+        ("trace", "write the timeline of the rendering to a Chrome trace file (empty means disabled)",
+         cxxopts::value<std::string>(tracePath)->default_value(""))  //
+        ("threads", "the number of the render threads (0 means all available threads)",
+         cxxopts::value<uint32_t>(threadCount)->default_value("0"))  //
+        ("smt", "the policy of the simultaneous multithreading (Use/Avoid)",
+         cxxopts::value<std::string>(smtPolicy)->default_value("Use"))  //
+        ("numa", "bind the render threads to the NUMA node (-1 means no binding)",
+         cxxopts::value<int32_t>(numaNode)->default_value("-1"))  //
+        ("headless", "render without the terminal UI, the messages are only written to the log file",
+         cxxopts::value<bool>(headless)->default_value("false"))  //
         ("help", "print usage", cxxopts::value<bool>(help)->default_value("false"));
 
     const auto result = options.parse(argc, argv);
@@ -95,7 +116,16 @@ void mainGuarded(int argc, char** argv) {
     if(!fs::exists(outputBase))
         fatal(fmt::format("Failed to create output directory \"{}\"", outputDir));
 
-    logFile().open(outputBase / inputFilePath.filename().replace_extension(".log"));
+    openLogFile(outputBase / inputFilePath.filename().replace_extension(".log"));
+
+    ThreadSetting threadSetting{ threadCount };
+    if(const auto policy = magic_enum::enum_cast<SMTPolicy>(smtPolicy))
+        threadSetting.smt = *policy;
+    else
+        fatal(fmt::format("Unrecognized SMT policy \"{}\"", smtPolicy));
+    if(numaNode >= 0)
+        threadSetting.numaNode = numaNode;
+    configureThreading(threadSetting);
 
     auto& sync = getDisplayProvider();
 
@@ -110,25 +140,54 @@ void mainGuarded(int argc, char** argv) {
         fatal("Unrecognized input file");
     };
 
+    const auto snapshotPath = snapshot ? (outputBase / inputFilePath.filename().replace_extension(".pscene")).string() : std::string{};
+
+    if(!tracePath.empty())
+        startTracing();
+
     const auto render = [&] {
         info("Loading scene");
+        ConfigNode::AttrMap attrs{ { { "InputFile"sv, makeRefCount<ConfigAttr>(inputFile) },
+                                     { "OutputDir"sv, makeRefCount<ConfigAttr>(outputDir) },
+                                     { "Snapshot"sv, makeRefCount<ConfigAttr>(snapshotPath) } },
+                                   context().globalAllocator };
         const auto pipelineDesc = makeRefCount<ConfigNode>("pipeline"sv, getPipelineType(inputFilePath.extension().string()),
-                                                           ConfigNode::AttrMap{ { { "InputFile"sv, makeRefCount<ConfigAttr>(inputFile) },
-                                                                                  { "OutputDir"sv, makeRefCount<ConfigAttr>(outputDir) } },
-                                                                                context().globalAllocator },
-                                                           Ref<RefCountBase>{});
+                                                           std::move(attrs), Ref<RefCountBase>{});
         // TODO: load configuration from CLI
-        const auto pipeline = getStaticFactory().make<Pipeline>(pipelineDesc);
-        info("Rendering scene");
-        pipeline->execute();
+        const auto pipeline = [&] {
+            PIPER_TRACE_SPAN("LoadScene");
+            return getStaticFactory().make<Pipeline>(pipelineDesc);
+        }();
+        if(!serveEndpoint.empty()) {
+            const auto pos = serveEndpoint.rfind(':');
+            if(pos == std::string::npos)
+                fatal(fmt::format("The endpoint \"{}\" to serve on should be address:port", serveEndpoint));
+            auto address = std::string_view{ serveEndpoint }.substr(0, pos);
+            // the IPv6 addresses are bracketed, e.g. [::1]:14159
+            if(address.size() >= 2 && address.front() == '[' && address.back() == ']')
+                address = address.substr(1, address.size() - 2);
+            pipeline->serve(address, static_cast<uint16_t>(std::stoul(serveEndpoint.substr(pos + 1))));
+        } else if(servePort) {
+            pipeline->serve("127.0.0.1"sv, static_cast<uint16_t>(servePort));
+        } else {
+            info("Rendering scene");
+            pipeline->execute();
+        }
 
         printStats();
+        // the machine-readable report for the regression tracking lands next to the outputs
+        writeStatsReport(outputBase / inputFilePath.filename().replace_extension(".stats.json"), hashFile(inputFilePath));
+        if(!tracePath.empty())
+            writeTrace(tracePath);
     };
 
-    {
+    if(headless) {
+        guard([&] { renderArena().execute(render); });
+    } else {
         namespace ui = ftxui;
 
-        bool running = true;
+        // NOTICE: the UI is only drawn by its own thread, the workers never touch the terminal
+        std::atomic_bool running = true;
 
         // force update
         bool noProgress = true;
@@ -150,7 +209,7 @@ void mainGuarded(int argc, char** argv) {
             const auto coresPerLine = std::min(4U, static_cast<uint32_t>(std::sqrt(static_cast<double>(ref.cores.size()))));
 
             ui::Elements lines;
-            lines.reserve(ref.cores.size() / coresPerLine + 8 + ref.customStatus.size());
+            lines.reserve(ref.cores.size() / coresPerLine + 15 + ref.subsystemMemory.size() + ref.customStatus.size());
 
             for(uint32_t idx = 0; idx < ref.cores.size(); idx += coresPerLine) {
                 const auto end = idx + coresPerLine;
@@ -175,10 +234,29 @@ void mainGuarded(int argc, char** argv) {
             lines.push_back(ui::text(fmt::format(" User   Time : {:>5.1f} %", ref.userRatio * 100.0)));
             lines.push_back(ui::text(fmt::format(" Kernel Time : {:>5.1f} %", ref.kernelRatio * 100.0)));
             lines.push_back(ui::text(fmt::format(" Memory Usage: {:>5.1f} MB", static_cast<double>(ref.memoryUsage) * 1e-6)));
+            for(const auto& [tag, usage] : ref.subsystemMemory)
+                lines.push_back(ui::text(fmt::format(" {:<12}: {:>5.1f} MB (peak {:.1f} MB)", magic_enum::enum_name(tag),
+                                                     static_cast<double>(usage.live) * 1e-6, static_cast<double>(usage.peak) * 1e-6)));
             lines.push_back(ui::text(fmt::format(" I/O    Ops  : {:>5}", ref.IOOps)));
             lines.push_back(ui::text(fmt::format(" Read   Speed: {:>5.1f} MB/s", ref.readSpeed * 1e-6)));
             lines.push_back(ui::text(fmt::format(" Write  Speed: {:>5.1f} MB/s", ref.writeSpeed * 1e-6)));
             lines.push_back(ui::text(fmt::format(" Active I/O  : {:>5}", ref.activeIOThread)));
+            const auto& throughput = ref.throughput;
+            lines.push_back(ui::text(fmt::format(" Rays        : {:>5.2f} M/s ({:.1f}% hit)", throughput.raysPerSecond * 1e-6,
+                                                 throughput.hitRatio * 100.0)));
+            lines.push_back(ui::text(fmt::format(" Shadow Rays : {:>5.2f} M/s", throughput.occlusionRaysPerSecond * 1e-6)));
+            lines.push_back(ui::text(fmt::format(" Samples     : {:>5.2f} M/s", throughput.samplesPerSecond * 1e-6)));
+            lines.push_back(ui::text(fmt::format(" Tex Lookups : {:>5.2f} M/s", throughput.textureLookupsPerSecond * 1e-6)));
+            if(const auto& hardware = ref.hardwareCounters; hardware && ref.interval > 0.0) {
+                const auto cycles = static_cast<double>(std::max<uint64_t>(hardware->cycles, 1));
+                const auto ipc = static_cast<double>(hardware->instructions) / cycles;
+                // each last level cache miss is assumed to transfer a 64-byte line from the memory
+                const auto misses = static_cast<double>(hardware->cacheMisses) / ref.interval;
+                lines.push_back(ui::text(fmt::format(" IPC         : {:>5.2f}", ipc)));
+                lines.push_back(ui::text(fmt::format(" LLC Misses  : {:>5.2f} M/s (~{:.1f} GB/s)", misses * 1e-6, misses * 64.0 * 1e-9)));
+                lines.push_back(ui::text(
+                    fmt::format(" Branch Miss : {:>5.2f} M/s", static_cast<double>(hardware->branchMisses) / ref.interval * 1e-6)));
+            }
             for(auto& msg : ref.customStatus)
                 lines.push_back(ui::text(msg));
 
@@ -218,7 +296,7 @@ void mainGuarded(int argc, char** argv) {
         });
 
         auto consoleView = ui::Renderer([] {
-            auto& output = consoleOutput();
+            const auto output = consoleHistory();
 
             ui::Elements lines;
             for(auto& [type, msg] : output) {
@@ -255,39 +333,22 @@ void mainGuarded(int argc, char** argv) {
         });
 
         ui::NaiveUI screen;
-        auto lastRenderUpdate = Clock::now() - 1s;
-
-        static std::mutex mutex;
-        renderCallback = [&] {
-            const std::unique_lock guard{ mutex, std::try_to_lock };
-            if(!guard.owns_lock())
-                return;
-
-            if(const auto current = Clock::now(); current - lastRenderUpdate > 200ms) {
-                lastRenderUpdate = current;
-                screen.render(container);
-            }
-        };
-        renderCallback();
-
-        guard(render);
-        running = false;
-
-        while(running || !noProgress) {  // NOLINT(bugprone-infinite-loop)
-            screen.render(container);
+        // the finished progress bars are kept until they are hidden
+        std::thread uiThread{ [&] {
             while(true) {
-                std::this_thread::yield();
-                if(const auto current = Clock::now(); current - lastRenderUpdate > 200ms) {
-                    lastRenderUpdate = current;
+                screen.render(container);
+                if(!running && noProgress)
                     break;
-                }
+                std::this_thread::sleep_for(200ms);
             }
-        }
+        } };
 
-        renderCallback = [] {};
+        guard([&] { renderArena().execute(render); });
+        running = false;
+        uiThread.join();
     }
 
-    logFile().flush();
+    flushLog();
 
     if(sync.isSupported())
         sync.disconnect();
@@ -19,7 +19,10 @@
 */
 
 #include <Piper/Core/ConfigNode.hpp>
+#include <Piper/Core/FileIO.hpp>
+#include <oneapi/tbb/parallel_for_each.h>
 #include <simdjson.h>
+#include <deque>
 
 PIPER_NAMESPACE_BEGIN
 Ref<ConfigNode> parseNode(const simdjson::dom::object& obj, const ResolveConfiguration& config, Ref<RefCountBase> holder = {});
@@ -40,14 +43,149 @@ std::pmr::string resolveString(const std::string_view string, const ResolveConfi
     return str;
 }
 
+static bool isInclude(const simdjson::dom::element& element) {
+    if(element.type() != simdjson::dom::element_type::OBJECT)
+        return false;
+    const auto type = element.get_object().at_key("Type"sv).get_string();
+    return type.error() == simdjson::SUCCESS && type.value_unsafe() == "Include"sv;
+}
+
+struct PendingInclude final {
+    std::pmr::string path;
+    std::string base;
+    ResolveConfiguration config;
+    std::pmr::vector<std::string> inputFiles{ context().globalAllocator };
+    Ref<ConfigNode> node;
+
+    PendingInclude(const simdjson::dom::object& obj, const ResolveConfiguration& parentConfig)
+        : path{ resolveString(obj.at_key("FileName"sv), parentConfig) }, base{ fs::path{ path }.parent_path().string() },
+          config{ parentConfig, context().scopedAllocator } {
+        config["${BaseDir}"] = base;
+    }
+    // the config refers to the base directory
+    PendingInclude(const PendingInclude&) = delete;
+    PendingInclude(PendingInclude&&) = delete;
+    PendingInclude& operator=(const PendingInclude&) = delete;
+    PendingInclude& operator=(PendingInclude&&) = delete;
+    ~PendingInclude() = default;
+};
+
+// Included files are independent documents, so the large instance lists exported by the converters are parsed concurrently.
+static void parseIncludes(std::pmr::deque<PendingInclude>& includes) {
+    // the tracker is thread-local, so every include records its own input files and they are merged in order afterwards
+    const auto tracker = Impl::configInputFiles();
+
+    tbb::parallel_for_each(includes.begin(), includes.end(), [tracker](PendingInclude& include) {
+        auto& localTracker = Impl::configInputFiles();
+        const auto previous = std::exchange(localTracker, tracker ? &include.inputFiles : nullptr);
+        try {
+            include.node = parseJSONConfigNode(include.path, include.config);
+        } catch(...) {
+            localTracker = previous;
+            throw;
+        }
+        localTracker = previous;
+    });
+
+    if(tracker)
+        for(auto& include : includes)
+            tracker->insert(tracker->end(), include.inputFiles.begin(), include.inputFiles.end());
+}
+
+// 0: not a number, 1: unsigned integer, 2: other numbers
+static uint32_t numberKind(const simdjson::dom::element& element) {
+    switch(element.type()) {
+        case simdjson::dom::element_type::UINT64:
+            return 1;
+        case simdjson::dom::element_type::INT64:
+            return element.get_int64().value_unsafe() >= 0 ? 1 : 2;
+        case simdjson::dom::element_type::DOUBLE:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+template <typename T>
+static void appendNumbers(const simdjson::dom::array& array, const bool nested, std::pmr::vector<T>& values) {
+    for(const auto item : array) {
+        if(nested)
+            appendNumbers(item.get_array().value_unsafe(), false, values);
+        else if constexpr(std::is_same_v<T, uint32_t>)
+            values.push_back(static_cast<uint32_t>(item.get_uint64().value_unsafe()));
+        else
+            values.push_back(static_cast<T>(item.get_double().value_unsafe()));
+    }
+}
+
+// The arrays of numbers (or of the numeric arrays with the same length) are stored as one typed buffer, so that the inline
+// spectra and geometries do not cost one attribute per element. Returns null for the other arrays.
+static Ref<ConfigAttr> parseNumericArray(const simdjson::dom::array& array) {
+    if(array.size() == 0)
+        return {};
+
+    const auto nested = (*array.begin()).type() == simdjson::dom::element_type::ARRAY;
+    const size_t width = nested ? (*array.begin()).get_array().value_unsafe().size() : array.size();
+    uint32_t kind = 1;
+    for(const auto item : array) {
+        if(nested) {
+            if(item.type() != simdjson::dom::element_type::ARRAY)
+                return {};
+            const auto row = item.get_array().value_unsafe();
+            if(row.size() != width || width == 0)
+                return {};
+            for(const auto value : row) {
+                const auto rowKind = numberKind(value);
+                if(rowKind == 0)
+                    return {};
+                kind = std::max(kind, rowKind);
+            }
+        } else {
+            const auto itemKind = numberKind(item);
+            if(itemKind == 0)
+                return {};
+            kind = std::max(kind, itemKind);
+        }
+    }
+
+    const auto count = nested ? array.size() * width : array.size();
+    if(kind == 1) {
+        ConfigAttr::UIntArray res{ std::pmr::vector<uint32_t>{ trackedAllocator(MemoryTag::Config) }, static_cast<uint32_t>(width) };
+        res.values.reserve(count);
+        appendNumbers(array, nested, res.values);
+        return makeRefCount<ConfigAttr>(std::move(res));
+    }
+    ConfigAttr::FloatArray res{ std::pmr::vector<float>{ trackedAllocator(MemoryTag::Config) }, static_cast<uint32_t>(width) };
+    res.values.reserve(count);
+    appendNumbers(array, nested, res.values);
+    return makeRefCount<ConfigAttr>(std::move(res));
+}
+
 static Ref<ConfigAttr> parseAttr(const simdjson::dom::element& element, const ResolveConfiguration& config) {
     switch(element.type()) {
         case simdjson::dom::element_type::ARRAY: {
-            ConfigAttr::AttrArray arr{ context().globalAllocator };
             const auto arrayRef = element.get_array();
-            arr.reserve(arrayRef.size());
-            for(auto item : arrayRef)
-                arr.push_back(parseAttr(item, config));
+            if(auto numbers = parseNumericArray(arrayRef))
+                return numbers;
+            ConfigAttr::AttrArray arr{ arrayRef.size(), trackedAllocator(MemoryTag::Config) };
+
+            std::pmr::deque<PendingInclude> includes{ context().scopedAllocator };
+            std::pmr::vector<size_t> includeIndices{ context().scopedAllocator };
+            size_t idx = 0;
+            for(auto item : arrayRef) {
+                if(isInclude(item)) {
+                    includes.emplace_back(item.get_object(), config);
+                    includeIndices.push_back(idx);
+                } else
+                    arr[idx] = parseAttr(item, config);
+                ++idx;
+            }
+
+            if(!includes.empty()) {
+                parseIncludes(includes);
+                for(size_t i = 0; i < includes.size(); ++i)
+                    arr[includeIndices[i]] = makeRefCount<ConfigAttr>(std::move(includes[i].node));
+            }
             return makeRefCount<ConfigAttr>(std::move(arr));
         }
         case simdjson::dom::element_type::OBJECT:
@@ -79,39 +217,58 @@ Ref<ConfigNode> parseNode(const simdjson::dom::object& obj, const ResolveConfigu
 
     auto type = valueOr(obj.at_key("Type"sv).get_string(), "Unspecified"sv);
     if(type == "Include"sv) {
-        const auto path = resolveString(obj.at_key("FileName"sv), config);
-        ResolveConfiguration newConfig{ config, context().scopedAllocator };
-        const auto base = fs::path{ path }.parent_path().string();
-        newConfig["${BaseDir}"] = base;
-
-        return parseJSONConfigNode(path, newConfig);
+        const PendingInclude include{ obj, config };
+        return parseJSONConfigNode(include.path, include.config);
     }
 
     auto name = valueOr(obj.at_key("Name"sv).get_string(), "Unnamed"sv);
-    ConfigNode::AttrMap attrs{ context().globalAllocator };
+    ConfigNode::AttrMap attrs{ trackedAllocator(MemoryTag::Config) };
+    attrs.reserve(obj.size());
 
     for(auto& [key, value] : obj)
         if(key != "Name"sv && key != "Type"sv)
-            attrs.insert({ key, parseAttr(value, config) });
+            attrs.emplace_back(key, parseAttr(value, config));
     return makeRefCount<ConfigNode>(name, type, std::move(attrs), std::move(holder));
 }
 
-Ref<ConfigNode> parseJSONConfigNodeFromStr(const std::string_view str, const ResolveConfiguration& config) {
+// If the buffer is followed by SIMDJSON_PADDING readable bytes, simdjson parses it in place instead of making a padded copy.
+static Ref<ConfigNode> parseJSONBuffer(const std::string_view str, const bool padded, const ResolveConfiguration& config) {
     MemoryArena arena;
 
     struct Holder final : RefCountBase {
         simdjson::dom::parser parser;
     };
 
+    // the DOM copies the strings into the parser, so the input buffer is not referenced after parsing
     auto holder = makeRefCount<Holder>();
-    const auto res = holder->parser.parse(str.data(), str.size());
+    const auto res = holder->parser.parse(str.data(), str.size(), !padded);
 
     return parseNode(res.get_object(), config, std::move(holder));
 }
 
+Ref<ConfigNode> parseJSONConfigNodeFromStr(const std::string_view str, const ResolveConfiguration& config) {
+    return parseJSONBuffer(str, false, config);
+}
+
+std::pmr::vector<std::string>*& Impl::configInputFiles() noexcept {
+    static thread_local std::pmr::vector<std::string>* inputFiles = nullptr;
+    return inputFiles;
+}
+
 Ref<ConfigNode> parseJSONConfigNode(const std::string_view path, const ResolveConfiguration& config) {
-    const auto data = loadData(path);
-    return parseJSONConfigNodeFromStr(std::string_view{ reinterpret_cast<const char*>(data.data()), data.size() }, config);
+    if(const auto inputFiles = Impl::configInputFiles())
+        inputFiles->emplace_back(path);
+
+    const MappedFile file{ fs::path{ path } };
+    const auto data = file.data();
+
+    // The mapping is zero-filled up to the end of the last page. 4K is the smallest page size of all supported platforms, so the
+    // tail of the last page is readable if it is large enough. Otherwise, simdjson falls back to a padded copy.
+    constexpr size_t pageSize = 4096;
+    const auto tail = data.size() % pageSize;
+    const auto padded = tail != 0 && pageSize - tail >= SIMDJSON_PADDING;
+
+    return parseJSONBuffer(std::string_view{ reinterpret_cast<const char*>(data.data()), data.size() }, padded, config);
 }
 
 PIPER_NAMESPACE_END
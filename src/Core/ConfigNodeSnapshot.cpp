@@ -0,0 +1,327 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/ConfigNode.hpp>
+#include <Piper/Core/Report.hpp>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <optional>
+
+PIPER_NAMESPACE_BEGIN
+
+// NOTICE: bump the version after changing the layout of the snapshot
+constexpr uint32_t snapshotVersion = 2;
+
+// layout: "PSNP", version, hash of the resolve configuration, input files (path, size, modification time), root node
+namespace {
+    enum class AttrTag : uint8_t { Bool, UInt, Double, String, Array, Node, FloatArray, UIntArray };
+
+    struct InputFileInfo final {
+        uint64_t size;
+        int64_t modificationTime;
+    };
+
+    std::optional<InputFileInfo> inspect(const fs::path& path) {
+        std::error_code ec;
+        const auto size = fs::file_size(path, ec);
+        if(ec)
+            return std::nullopt;
+        const auto time = fs::last_write_time(path, ec);
+        if(ec)
+            return std::nullopt;
+        return InputFileInfo{ size, static_cast<int64_t>(time.time_since_epoch().count()) };
+    }
+
+    // FNV-1a
+    uint64_t hashConfiguration(const ResolveConfiguration& config) {
+        std::pmr::vector<std::pair<std::string_view, std::string_view>> items{ config.cbegin(), config.cend(), context().scopedAllocator };
+        std::ranges::sort(items);
+
+        uint64_t hash = 14695981039346656037ULL;
+        const auto append = [&](const std::string_view str) {
+            for(const auto ch : str) {
+                hash ^= static_cast<uint8_t>(ch);
+                hash *= 1099511628211ULL;
+            }
+            // separator
+            hash ^= 0xff;
+            hash *= 1099511628211ULL;
+        };
+        for(const auto& [key, value] : items) {
+            append(key);
+            append(value);
+        }
+        return hash;
+    }
+
+    class SnapshotWriter final {
+        std::string mData;
+
+    public:
+        template <typename T>
+        void write(const T& value) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            mData.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        void writeString(const std::string_view str) {
+            write(static_cast<uint32_t>(str.size()));
+            mData.append(str);
+        }
+
+        void writeAttr(const ConfigAttr& attr) {
+            std::visit(
+                [&]<typename T>(const T& value) {
+                    if constexpr(std::is_same_v<T, bool>) {
+                        write(AttrTag::Bool);
+                        write(value);
+                    } else if constexpr(std::is_same_v<T, uint32_t>) {
+                        write(AttrTag::UInt);
+                        write(value);
+                    } else if constexpr(std::is_same_v<T, double>) {
+                        write(AttrTag::Double);
+                        write(value);
+                    } else if constexpr(std::is_same_v<T, ConfigAttr::AttrArray>) {
+                        write(AttrTag::Array);
+                        write(static_cast<uint32_t>(value.size()));
+                        for(const auto& item : value)
+                            writeAttr(*item);
+                    } else if constexpr(std::is_same_v<T, Ref<ConfigNode>>) {
+                        write(AttrTag::Node);
+                        writeNode(*value);
+                    } else if constexpr(std::is_same_v<T, ConfigAttr::FloatArray> || std::is_same_v<T, ConfigAttr::UIntArray>) {
+                        write(std::is_same_v<T, ConfigAttr::FloatArray> ? AttrTag::FloatArray : AttrTag::UIntArray);
+                        write(value.width);
+                        write(static_cast<uint32_t>(value.values.size()));
+                        mData.append(reinterpret_cast<const char*>(value.values.data()), value.values.size() * sizeof(value.values[0]));
+                    } else {
+                        write(AttrTag::String);
+                        writeString(value);
+                    }
+                },
+                attr.value());
+        }
+
+        void writeNode(const ConfigNode& node) {
+            writeString(node.name());
+            writeString(node.type());
+            write(static_cast<uint32_t>(node.attributes().size()));
+            for(const auto& [key, value] : node.attributes()) {
+                writeString(key);
+                writeAttr(*value);
+            }
+        }
+
+        [[nodiscard]] const std::string& data() const noexcept {
+            return mData;
+        }
+    };
+
+    class SnapshotReader final {
+        std::span<const std::byte> mData;
+        size_t mOffset = 0;
+        bool mValid = true;
+        Ref<RefCountBase> mHolder;
+
+    public:
+        SnapshotReader(const std::span<const std::byte> data, Ref<RefCountBase> holder) : mData{ data }, mHolder{ std::move(holder) } {}
+
+        [[nodiscard]] bool valid() const noexcept {
+            return mValid;
+        }
+
+        template <typename T>
+        T read() {
+            T value{};
+            if(!mValid || mOffset + sizeof(T) > mData.size()) {
+                mValid = false;
+                return value;
+            }
+            memcpy(&value, mData.data() + mOffset, sizeof(T));
+            mOffset += sizeof(T);
+            return value;
+        }
+
+        // the strings point to the mapped snapshot, which is kept alive by the holder
+        std::string_view readString() {
+            const auto size = read<uint32_t>();
+            if(!mValid || mOffset + size > mData.size()) {
+                mValid = false;
+                return {};
+            }
+            const std::string_view str{ reinterpret_cast<const char*>(mData.data() + mOffset), size };
+            mOffset += size;
+            return str;
+        }
+
+        template <typename T>
+        ConfigAttr::NumericArray<T> readNumericArray() {
+            ConfigAttr::NumericArray<T> res{ std::pmr::vector<T>{ trackedAllocator(MemoryTag::Config) }, read<uint32_t>() };
+            const auto size = read<uint32_t>();
+            if(!mValid || mOffset + static_cast<size_t>(size) * sizeof(T) > mData.size()) {
+                mValid = false;
+                return res;
+            }
+            res.values.resize(size);
+            memcpy(res.values.data(), mData.data() + mOffset, static_cast<size_t>(size) * sizeof(T));
+            mOffset += static_cast<size_t>(size) * sizeof(T);
+            return res;
+        }
+
+        Ref<ConfigAttr> readAttr() {
+            switch(read<AttrTag>()) {
+                case AttrTag::Bool:
+                    return makeRefCount<ConfigAttr>(read<bool>());
+                case AttrTag::UInt:
+                    return makeRefCount<ConfigAttr>(read<uint32_t>());
+                case AttrTag::Double:
+                    return makeRefCount<ConfigAttr>(read<double>());
+                case AttrTag::String:
+                    return makeRefCount<ConfigAttr>(readString());
+                case AttrTag::Array: {
+                    const auto size = read<uint32_t>();
+                    ConfigAttr::AttrArray arr{ trackedAllocator(MemoryTag::Config) };
+                    for(uint32_t idx = 0; idx < size && mValid; ++idx)
+                        arr.push_back(readAttr());
+                    return makeRefCount<ConfigAttr>(std::move(arr));
+                }
+                case AttrTag::Node:
+                    return makeRefCount<ConfigAttr>(readNode());
+                case AttrTag::FloatArray:
+                    return makeRefCount<ConfigAttr>(readNumericArray<float>());
+                case AttrTag::UIntArray:
+                    return makeRefCount<ConfigAttr>(readNumericArray<uint32_t>());
+                default:
+                    mValid = false;
+                    return makeRefCount<ConfigAttr>(false);
+            }
+        }
+
+        Ref<ConfigNode> readNode() {
+            const auto name = readString();
+            const auto type = readString();
+            const auto size = read<uint32_t>();
+            ConfigNode::AttrMap attrs{ trackedAllocator(MemoryTag::Config) };
+            attrs.reserve(size);
+            for(uint32_t idx = 0; idx < size && mValid; ++idx) {
+                const auto key = readString();
+                attrs.emplace_back(key, readAttr());
+            }
+            return makeRefCount<ConfigNode>(name, type, std::move(attrs), mHolder);
+        }
+    };
+
+    struct SnapshotHolder final : RefCountBase {
+        MappedFile file;
+
+        explicit SnapshotHolder(const fs::path& path) : file{ path } {}
+    };
+
+    Ref<ConfigNode> loadSnapshot(const fs::path& snapshot, const uint64_t configHash) {
+        if(!fs::exists(snapshot))
+            return {};
+
+        const auto holder = makeRefCount<SnapshotHolder>(snapshot);
+        SnapshotReader reader{ holder->file.data(), holder };
+
+        if(const auto magic = reader.read<std::array<char, 4>>(); memcmp(magic.data(), "PSNP", 4) != 0 ||
+           reader.read<uint32_t>() != snapshotVersion || reader.read<uint64_t>() != configHash)
+            return {};
+
+        const auto inputCount = reader.read<uint32_t>();
+        for(uint32_t idx = 0; idx < inputCount && reader.valid(); ++idx) {
+            const auto path = reader.readString();
+            const auto stored = reader.read<InputFileInfo>();
+            const auto current = inspect(path);
+            if(!current || current->size != stored.size || current->modificationTime != stored.modificationTime)
+                return {};
+        }
+
+        auto root = reader.readNode();
+        return reader.valid() ? root : Ref<ConfigNode>{};
+    }
+
+    // write to a temporary file first, so a crash during saving never leaves a broken snapshot behind
+    void saveSnapshot(const fs::path& snapshot, const uint64_t configHash, const std::pmr::vector<std::string>& inputFiles,
+                      const ConfigNode& root) {
+        SnapshotWriter writer;
+        writer.write(std::array<char, 4>{ 'P', 'S', 'N', 'P' });
+        writer.write(snapshotVersion);
+        writer.write(configHash);
+        writer.write(static_cast<uint32_t>(inputFiles.size()));
+        for(const auto& path : inputFiles) {
+            const auto info = inspect(path);
+            if(!info) {
+                warning(fmt::format("Failed to inspect input file \"{}\", the snapshot is not saved", path));
+                return;
+            }
+            writer.writeString(path);
+            writer.write(*info);
+        }
+        writer.writeNode(root);
+
+        auto tmpPath = snapshot;
+        tmpPath += ".tmp";
+        {
+            std::ofstream out{ tmpPath, std::ios::out | std::ios::binary };
+            out.write(writer.data().data(), static_cast<std::streamsize>(writer.data().size()));
+            out.flush();
+            if(!out) {
+                warning(fmt::format("Failed to save snapshot \"{}\"", tmpPath.string()));
+                return;
+            }
+        }
+
+        std::error_code ec;
+        fs::rename(tmpPath, snapshot, ec);
+        if(ec)
+            warning(fmt::format("Failed to save snapshot \"{}\": {}", snapshot.string(), ec.message()));
+    }
+}  // namespace
+
+Ref<ConfigNode> parseJSONConfigNodeWithSnapshot(const std::string_view path, const ResolveConfiguration& config,
+                                                const fs::path& snapshot) {
+    MemoryArena arena;
+
+    const auto configHash = hashConfiguration(config);
+    if(auto root = loadSnapshot(snapshot, configHash)) {
+        info(fmt::format("Loaded scene snapshot \"{}\"", snapshot.string()));
+        return root;
+    }
+
+    std::pmr::vector<std::string> inputFiles{ context().globalAllocator };
+    auto& tracker = Impl::configInputFiles();
+    const auto previous = std::exchange(tracker, &inputFiles);
+    Ref<ConfigNode> root;
+    try {
+        root = parseJSONConfigNode(path, config);
+    } catch(...) {
+        tracker = previous;
+        throw;
+    }
+    tracker = previous;
+
+    saveSnapshot(snapshot, configHash, inputFiles, *root);
+    return root;
+}
+
+PIPER_NAMESPACE_END
@@ -21,33 +21,108 @@
 #include <Piper/Core/Context.hpp>
 #include <Piper/Core/StaticFactory.hpp>
 #include <oneapi/tbb/cache_aligned_allocator.h>
+#include <new>
 #include <oneapi/tbb/scalable_allocator.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
 
 PIPER_NAMESPACE_BEGIN
 
 tbb::affinity_partitioner globalAffinityPartitioner;
 
-class ContextStorage final {
-    Context mCtx{};
-    tbb::cache_aligned_resource mAllocator{ tbb::scalable_memory_resource() };
+// the cache-aligned scalable allocator is stateless, so a single instance is shared by all threads
+class CacheAlignedScalableResource final : public std::pmr::memory_resource {
+    static constexpr size_t cacheLineSize = 64;
+
+    void* do_allocate(const size_t bytes, const size_t alignment) override {
+        // the size is rounded up, so the last cache line is never shared with other allocations
+        const auto ptr = scalable_aligned_malloc((bytes + cacheLineSize - 1) & ~(cacheLineSize - 1), std::max(alignment, cacheLineSize));
+        if(!ptr)
+            throw std::bad_alloc{};
+        return ptr;
+    }
+    void do_deallocate(void* ptr, size_t, size_t) override {
+        scalable_aligned_free(ptr);
+    }
+    [[nodiscard]] bool do_is_equal(const memory_resource& other) const noexcept override {
+        return this == &other;
+    }
 
 public:
-    ContextStorage() {
-        std::pmr::set_default_resource(tbb::scalable_memory_resource());
+    constexpr CacheAlignedScalableResource() noexcept = default;
+};
+
+static constinit CacheAlignedScalableResource globalResource;
+
+[[maybe_unused]] static const auto defaultResource = std::pmr::set_default_resource(tbb::scalable_memory_resource());
+
+constinit thread_local Context detail::threadContext{ &globalResource, &globalResource, &globalResource, nullptr };
+
+static constexpr size_t chunkAlignment = 64;
+
+void* MonotonicArenaResource::allocateSlow(const size_t bytes, const size_t alignment) {
+    // the chunks after the current one are left by rewinding, the ones too small for the request are skipped until the next rewind
+    const auto fits = [&](const Chunk& chunk) { return chunk.size >= bytes + alignment; };
+    auto next = mCurrent ? mChunkIdx + 1 : 0;
+    while(next < mChunks.size() && !fits(mChunks[next]))
+        ++next;
+    if(next == mChunks.size()) {
+        constexpr size_t minChunkSize = 64 * 1024;
+        const auto size = std::max({ minChunkSize, mChunks.empty() ? 0 : mChunks.back().size * 2, bytes + alignment });
+        mChunks.push_back({ static_cast<std::byte*>(mUpstream->allocate(size, chunkAlignment)), size });
+    }
+
+    mChunkIdx = next;
+    mCurrent = mChunks[next].data;
+    mEnd = mCurrent + mChunks[next].size;
+    return do_allocate(bytes, alignment);
+}
+
+MonotonicArenaResource::~MonotonicArenaResource() {
+    for(const auto& [data, size] : mChunks)
+        mUpstream->deallocate(data, size, chunkAlignment);
+}
 
-        mCtx.globalObjectAllocator = &mAllocator;
-        mCtx.globalAllocator = &mAllocator;
-        mCtx.localAllocator = &mAllocator;
-        mCtx.scopedAllocator = nullptr;
+class TrackedResource final : public std::pmr::memory_resource {
+    tbb::cache_aligned_resource mUpstream{ tbb::scalable_memory_resource() };
+    std::atomic_uint64_t mLive{ 0 };
+    std::atomic_uint64_t mPeak{ 0 };
+
+    void* do_allocate(const size_t bytes, const size_t alignment) override {
+        const auto ptr = mUpstream.allocate(bytes, alignment);
+        const auto live = mLive.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        auto peak = mPeak.load(std::memory_order_relaxed);
+        while(peak < live && !mPeak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+        }
+        return ptr;
+    }
+    void do_deallocate(void* ptr, const size_t bytes, const size_t alignment) override {
+        mUpstream.deallocate(ptr, bytes, alignment);
+        mLive.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+    [[nodiscard]] bool do_is_equal(const memory_resource& other) const noexcept override {
+        return this == &other;
     }
-    Context& get() noexcept {
-        return mCtx;
+
+public:
+    [[nodiscard]] MemoryUsage usage() const noexcept {
+        return { mLive.load(std::memory_order_relaxed), mPeak.load(std::memory_order_relaxed) };
     }
 };
 
-Context& context() {
-    static thread_local ContextStorage ctx;
-    return ctx.get();
+static TrackedResource& trackedResource(const MemoryTag tag) {
+    // NOTICE: the resources are never destroyed, since the containers with static storage duration may be released after them
+    static const auto inst = new std::array<TrackedResource, 5>{};
+    return (*inst)[static_cast<size_t>(tag)];
+}
+
+std::pmr::memory_resource* trackedAllocator(const MemoryTag tag) {
+    return &trackedResource(tag);
+}
+
+MemoryUsage memoryUsage(const MemoryTag tag) {
+    return trackedResource(tag).usage();
 }
 
 PIPER_NAMESPACE_END
@@ -22,7 +22,19 @@
 #include <Piper/Core/FileIO.hpp>
 #include <Piper/Core/Report.hpp>
 #include <fstream>
+#include <mutex>
+#include <optional>
 #include <set>
+#include <unordered_map>
+
+#ifdef PIPER_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 PIPER_NAMESPACE_BEGIN
 BinaryData loadData(const fs::path& path) {
@@ -34,27 +46,131 @@ BinaryData loadData(const fs::path& path) {
     return data;
 }
 
+void prefetchFile(const fs::path& path) {
+    std::ifstream in{ path, std::ios::in | std::ios::binary };
+    // missing files are reported by the loader
+    if(!in)
+        return;
+
+    constexpr size_t chunkSize = 1 << 20;
+    const auto buffer = std::make_unique<char[]>(chunkSize);
+    while(in.read(buffer.get(), chunkSize))
+        ;
+}
+
+uint64_t hashFile(const fs::path& path) {
+    const MappedFile file{ path };
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for(const auto byte : file.data()) {
+        hash ^= static_cast<uint64_t>(byte);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+MappedFile::MappedFile(const fs::path& path) : mSize{ fs::file_size(path) } {
+    // an empty file cannot be mapped
+    if(mSize == 0)
+        return;
+
+#ifdef PIPER_WINDOWS
+    mFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(mFile == INVALID_HANDLE_VALUE)
+        fatal(fmt::format("Failed to open file \"{}\"", path.string()));
+    mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(!mMapping)
+        fatal(fmt::format("Failed to map file \"{}\"", path.string()));
+    mData = static_cast<const std::byte*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+#else
+    const auto fd = open(path.c_str(), O_RDONLY);
+    if(fd == -1)
+        fatal(fmt::format("Failed to open file \"{}\"", path.string()));
+    const auto ptr = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping is still valid after the descriptor is closed
+    close(fd);
+    if(ptr != MAP_FAILED)
+        mData = static_cast<const std::byte*>(ptr);
+#endif
+
+    if(!mData)
+        fatal(fmt::format("Failed to map file \"{}\"", path.string()));
+}
+
+MappedFile::~MappedFile() {
+    if(!mData)
+        return;
+
+#ifdef PIPER_WINDOWS
+    UnmapViewOfFile(mData);
+    CloseHandle(mMapping);
+    CloseHandle(mFile);
+#else
+    munmap(const_cast<std::byte*>(mData), mSize);
+#endif
+}
+
 std::pmr::set<fs::path>& getSearchPaths() {
     static std::pmr::set<fs::path> inst{ fs::current_path() / "data" };
     return inst;
 }
 
+// stem -> path of all files in the search paths, the first match wins like the recursive scan
+struct SearchPathIndex final {
+    std::mutex mutex;
+    std::optional<std::unordered_map<std::string, std::string>> index;
+};
+
+static SearchPathIndex& getSearchPathIndex() {
+    static SearchPathIndex inst;
+    return inst;
+}
+
 void addSearchPath(fs::path path) {
-    if(fs::exists(path))
+    if(fs::exists(path)) {
+        auto& [mutex, index] = getSearchPathIndex();
+        std::lock_guard guard{ mutex };
         getSearchPaths().insert(std::move(path));
+        index.reset();
+    }
 }
 
-std::string resolvePath(const std::string_view name) {
-    if(fs::exists(name))
-        return std::string{ name };
+void invalidateSearchPathIndex() {
+    auto& [mutex, index] = getSearchPathIndex();
+    std::lock_guard guard{ mutex };
+    index.reset();
+}
 
+static std::unordered_map<std::string, std::string> buildSearchPathIndex() {
+    std::unordered_map<std::string, std::string> res;
     for(auto& path : getSearchPaths()) {
         for(auto& item : fs::recursive_directory_iterator{ path }) {
-            if(item.is_regular_file() && item.path().stem() == name) {
-                return item.path().string();
-            }
+            if(item.is_regular_file())
+                res.emplace(item.path().stem().string(), item.path().string());
         }
     }
+    return res;
+}
+
+std::string resolvePath(const std::string_view name) {
+    if(fs::exists(name))
+        return std::string{ name };
+
+    auto& [mutex, index] = getSearchPathIndex();
+    std::lock_guard guard{ mutex };
+    const auto fresh = !index;
+    if(fresh)
+        index = buildSearchPathIndex();
+
+    const std::string key{ name };
+    if(const auto iter = index->find(key); iter != index->cend())
+        return iter->second;
+    // the file may be added after the index is built, so a stale index is rebuilt once before giving up
+    if(!fresh) {
+        index = buildSearchPathIndex();
+        if(const auto iter = index->find(key); iter != index->cend())
+            return iter->second;
+    }
 
     fatal(fmt::format("Failed to resolve file {}", name));
 }
@@ -20,6 +20,8 @@
 
 #include <Piper/Core/Context.hpp>
 #include <Piper/Core/Monitor.hpp>
+#include <atomic>
+#include <magic_enum.hpp>
 #include <memory_resource>
 #include <tbb/concurrent_unordered_map.h>
 #include <vector>
@@ -31,10 +33,15 @@
 #include <TlHelp32.h>
 #include <winternl.h>
 #elif defined(PIPER_LINUX)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
 #include <sys/sysinfo.h>
 #include <sys/times.h>
 #include <unistd.h>
+#include <array>
 #include <fstream>
+#include <oneapi/tbb/concurrent_vector.h>
+#include <oneapi/tbb/task_scheduler_observer.h>
 #include <sstream>
 #endif
 
@@ -60,7 +67,79 @@ struct CurrentCheckpoint final {
     uint64_t activeIOThread = 0;
 };
 
-extern std::function<void()> renderCallback;
+#if defined(PIPER_LINUX)
+// The counters are opened by each thread for itself when it joins the task scheduler, so that the workers are counted from their
+// first task. The descriptors are kept after the threads exit, and the final values of the exited threads are still readable.
+class PerfCounters final : public tbb::task_scheduler_observer {
+    static constexpr uint64_t events[] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+                                           PERF_COUNT_HW_BRANCH_MISSES };
+    static constexpr auto eventCount = std::size(events);
+
+    tbb::concurrent_vector<std::array<int32_t, eventCount>> mThreads;
+    std::atomic_bool mAvailable = true;
+
+    void attach() {
+        thread_local bool attached = false;
+        if(attached || !mAvailable.load(std::memory_order_relaxed))
+            return;
+        attached = true;
+
+        std::array<int32_t, eventCount> fds;
+        for(size_t idx = 0; idx < eventCount; ++idx) {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = events[idx];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            // the counters are multiplexed if there are not enough hardware counters, the values are scaled by the running time
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds[idx] = static_cast<int32_t>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if(fds[idx] < 0) {
+                for(size_t k = 0; k < idx; ++k)
+                    close(fds[k]);
+                mAvailable = false;
+                return;
+            }
+        }
+        mThreads.push_back(fds);
+    }
+
+public:
+    PerfCounters() : tbb::task_scheduler_observer{} {
+        attach();
+        observe(true);
+    }
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+    ~PerfCounters() override {
+        observe(false);
+        for(const auto& fds : mThreads)
+            for(const auto fd : fds)
+                close(fd);
+    }
+
+    void on_scheduler_entry(bool) override {
+        attach();
+    }
+
+    [[nodiscard]] std::optional<HardwareCounters> read() const {
+        if(!mAvailable.load(std::memory_order_relaxed))
+            return std::nullopt;
+
+        std::array<uint64_t, eventCount> sum{};
+        for(const auto& fds : mThreads)
+            for(size_t idx = 0; idx < eventCount; ++idx) {
+                uint64_t value[3];  // value, time enabled, time running
+                if(::read(fds[idx], value, sizeof(value)) != sizeof(value) || value[2] == 0)
+                    continue;
+                sum[idx] += static_cast<uint64_t>(static_cast<double>(value[0]) * static_cast<double>(value[1]) /
+                                                  static_cast<double>(value[2]));
+            }
+        return HardwareCounters{ sum[0], sum[1], sum[2], sum[3] };
+    }
+};
+#endif
 
 class MonitorImpl final : public Monitor {
     static constexpr auto unavailable = std::numeric_limits<uint64_t>::max();
@@ -254,14 +333,24 @@ class MonitorImpl final : public Monitor {
         res.writeSpeed = static_cast<double>(now.writeCount - last.writeCount) / (1e-9 * dt);
         res.activeIOThread = last.activeIOThread;
 
+        for(const auto tag : magic_enum::enum_values<MemoryTag>())
+            res.subsystemMemory.emplace_back(tag, memoryUsage(tag));
+
         const auto range = views::values(mCustomStatus);
         res.customStatus = { range.begin(), range.end(), context().globalAllocator };
 
         return res;
     }
 
+#if defined(PIPER_LINUX)
+    PerfCounters mPerfCounters;
+#endif
+    std::optional<HardwareCounters> mLastHardwareCounters;
+
     std::optional<CurrentCheckpoint> mLastCheckpoint;
+    CurrentCheckpoint mStartCheckpoint = checkpoint();
     uint32_t mUpdateCount = 0;
+    ThroughputMeter mThroughput;
 
 public:
     std::optional<CurrentStatus> update() override {
@@ -271,12 +360,37 @@ public:
         std::optional<CurrentStatus> res;
         if(mLastCheckpoint)
             res = diff(mLastCheckpoint.value(), current);
+        // the meter is updated every time, so that the rates cover the interval since the last update
+        const auto throughput = mThroughput.update();
+        auto hardware = hardwareCounters();
+        if(res) {
+            res->throughput = throughput;
+            res->interval = static_cast<double>(current.recordTime - mLastCheckpoint->recordTime) * 1e-9;
+            if(hardware && mLastHardwareCounters)
+                res->hardwareCounters = HardwareCounters{ hardware->cycles - mLastHardwareCounters->cycles,
+                                                          hardware->instructions - mLastHardwareCounters->instructions,
+                                                          hardware->cacheMisses - mLastHardwareCounters->cacheMisses,
+                                                          hardware->branchMisses - mLastHardwareCounters->branchMisses };
+        }
+        mLastHardwareCounters = hardware;
 
         mLastCheckpoint = std::move(current);
         return res;
     }
+    ProcessTime processTime() override {
+        const auto current = checkpoint();
+        constexpr auto toSecond = [](const uint64_t ns) { return static_cast<double>(ns) * 1e-9; };
+        return { toSecond(current.recordTime - mStartCheckpoint.recordTime), toSecond(current.userTime - mStartCheckpoint.userTime),
+                 toSecond(current.kernelTime - mStartCheckpoint.kernelTime), current.memoryUsage };
+    }
+    std::optional<HardwareCounters> hardwareCounters() override {
+#if defined(PIPER_LINUX)
+        return mPerfCounters.read();
+#else
+        return std::nullopt;
+#endif
+    }
     void updateCustomStatus(void* key, std::string message) override {
-        renderCallback();
         mCustomStatus.emplace(key, std::move(message));
     }
     uint32_t updateCount() const noexcept override {
@@ -19,40 +19,163 @@
 */
 
 #include <Piper/Core/Report.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
-#include <oneapi/tbb/spin_mutex.h>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 PIPER_NAMESPACE_BEGIN
 
-std::ofstream& logFile() {
-    static std::ofstream logFile;
-    return logFile;
-}
-
-tbb::concurrent_vector<std::pair<LogType, std::string>>& consoleOutput() {
-    static tbb::concurrent_vector<std::pair<LogType, std::string>> vec;
-    return vec;
-}
-
 const std::string& header(LogType type) {
     static const std::string headers[] = { "[INFO] "s, "[WARNING] "s, "[ERROR] "s, "[FATAL] "s };
     return headers[static_cast<uint32_t>(type)];
 }
 
-static void report(LogType type, std::string message, const bool forceSync = false) {
-    const auto& headerOfLog = header(type);
-    auto& stream = logFile();
+// A bounded multi-producer ring buffer (see "Bounded MPMC queue" by Dmitry Vyukov) drained by a single writer thread. A producer
+// only claims a slot and moves the message in, the writer wakes up periodically, so no producer ever touches the mutex unless the
+// buffer is full.
+class AsyncLogger final {
+    static constexpr size_t capacity = 4096;  // a power of two
+    static constexpr size_t historySize = 256;
+    static constexpr auto pollInterval = std::chrono::milliseconds{ 10 };
+
+    struct Slot final {
+        std::atomic_size_t sequence;
+        LogType type;
+        std::string message;
+    };
+
+    std::unique_ptr<Slot[]> mSlots{ new Slot[capacity] };
+    alignas(64) std::atomic_size_t mEnqueuePos{ 0 };
+    alignas(64) size_t mDequeuePos = 0;  // only accessed by the writer
+    std::atomic_size_t mWritten{ 0 };
+
+    // protects the stream and the history
+    std::mutex mMutex;
+    std::condition_variable mWakeUp;
+    std::condition_variable mDrained;
+    std::ofstream mStream;
+    std::deque<std::pair<LogType, std::string>> mHistory;
+    bool mStop = false;
+    std::thread mWriter;
+
+    bool drain() {
+        bool drained = false;
+        while(true) {
+            auto& slot = mSlots[mDequeuePos & (capacity - 1)];
+            if(slot.sequence.load(std::memory_order_acquire) != mDequeuePos + 1)
+                break;
+            const auto type = slot.type;
+            auto message = std::move(slot.message);
+            slot.sequence.store(mDequeuePos + capacity, std::memory_order_release);
+            ++mDequeuePos;
+
+            if(mStream)
+                mStream << header(type) << message << '\n';
+            mHistory.emplace_back(type, std::move(message));
+            if(mHistory.size() > historySize)
+                mHistory.pop_front();
+            drained = true;
+        }
+        return drained;
+    }
+
+    void run() {
+        std::unique_lock guard{ mMutex };
+        while(true) {
+            if(drain()) {
+                mWritten.store(mDequeuePos, std::memory_order_release);
+                mDrained.notify_all();
+            }
+            if(mStop)
+                break;
+            mWakeUp.wait_for(guard, pollInterval);
+        }
+        mStream.flush();
+    }
+
+public:
+    AsyncLogger() {
+        for(size_t idx = 0; idx < capacity; ++idx)
+            mSlots[idx].sequence.store(idx, std::memory_order_relaxed);
+        mWriter = std::thread{ [this] { run(); } };
+    }
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+    ~AsyncLogger() {
+        {
+            std::lock_guard guard{ mMutex };
+            mStop = true;
+        }
+        mWakeUp.notify_one();
+        mWriter.join();
+    }
+
+    void push(const LogType type, std::string message) {
+        auto pos = mEnqueuePos.load(std::memory_order_relaxed);
+        while(true) {
+            auto& slot = mSlots[pos & (capacity - 1)];
+            const auto sequence = slot.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+            if(diff == 0) {
+                if(mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.type = type;
+                    slot.message = std::move(message);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return;
+                }
+            } else {
+                // the buffer is full, the writer is woken up instead of dropping the message
+                if(diff < 0) {
+                    mWakeUp.notify_one();
+                    std::this_thread::yield();
+                }
+                pos = mEnqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void flush() {
+        const auto target = mEnqueuePos.load(std::memory_order_acquire);
+        std::unique_lock guard{ mMutex };
+        mWakeUp.notify_one();
+        mDrained.wait(guard, [&] { return mWritten.load(std::memory_order_acquire) >= target; });
+        mStream.flush();
+    }
+
+    void open(const fs::path& path) {
+        std::lock_guard guard{ mMutex };
+        mStream.open(path);
+    }
 
-    static tbb::speculative_spin_mutex mutex;
+    std::vector<std::pair<LogType, std::string>> history() {
+        std::lock_guard guard{ mMutex };
+        return { mHistory.cbegin(), mHistory.cend() };
+    }
 
-    if(stream) {
-        tbb::speculative_spin_mutex::scoped_lock guard{ mutex };
-        stream << headerOfLog << message << "\n";
-        if(forceSync)
-            stream.flush();
+    static AsyncLogger& get() {
+        static AsyncLogger inst;
+        return inst;
     }
+};
+
+std::vector<std::pair<LogType, std::string>> consoleHistory() {
+    return AsyncLogger::get().history();
+}
+
+void openLogFile(const fs::path& path) {
+    AsyncLogger::get().open(path);
+}
 
-    consoleOutput().push_back({ type, std::move(message) });
+void flushLog() {
+    AsyncLogger::get().flush();
+}
+
+static void report(const LogType type, std::string message) {
+    AsyncLogger::get().push(type, std::move(message));
 }
 
 void info(std::string message) {
@@ -65,15 +188,13 @@ void error(std::string message) {
     report(LogType::Error, std::move(message));
 }
 [[noreturn]] void fatal(std::string message) {
-    report(LogType::Fatal, std::move(message), true);
+    report(LogType::Fatal, std::move(message));
+    flushLog();
     std::abort();  // FIXME: interrupt for debugging
 }
 
-std::function renderCallback = [] {};
-
 ProgressReporter::ProgressReporter() : mStart{ Clock::now() }, mProgress{ 0.0 } {}
 void ProgressReporter::update(const double progress) noexcept {
-    renderCallback();
     mProgress = std::fmin(1.0, progress);
 
     if(mProgress > 1e-7) {
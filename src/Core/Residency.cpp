@@ -0,0 +1,110 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/Context.hpp>
+#include <Piper/Core/Residency.hpp>
+#include <algorithm>
+#include <mutex>
+
+#if defined(PIPER_WINDOWS)
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+PIPER_NAMESPACE_BEGIN
+
+static void discardPages(const std::byte* ptr, const size_t size) {
+    // only the pages fully inside the block are discarded
+    constexpr uintptr_t pageSize = 4096;
+    const auto begin = (reinterpret_cast<uintptr_t>(ptr) + pageSize - 1) & ~(pageSize - 1);
+    const auto end = (reinterpret_cast<uintptr_t>(ptr) + size) & ~(pageSize - 1);
+    if(begin >= end)
+        return;
+
+#if defined(PIPER_WINDOWS)
+    // unlocking the unlocked pages removes them from the working set
+    VirtualUnlock(reinterpret_cast<void*>(begin), end - begin);
+#else
+    madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+#endif
+}
+
+ResidencyManager& ResidencyManager::get() {
+    static ResidencyManager inst;
+    return inst;
+}
+
+uint32_t ResidencyManager::registerRegion(const std::span<const std::byte> region) {
+    const auto count = (region.size() + blockSize - 1) / blockSize;
+    const auto iter = mBlocks.grow_by(count);
+    const auto first = static_cast<uint32_t>(iter - mBlocks.begin());
+    for(size_t idx = 0; idx < count; ++idx) {
+        auto& block = mBlocks[first + idx];
+        block.ptr = region.data() + idx * blockSize;
+        block.size = std::min(blockSize, region.size() - idx * blockSize);
+    }
+    return first;
+}
+
+void ResidencyManager::unregisterRegion(const uint32_t firstBlock, const std::span<const std::byte> region) {
+    const auto count = (region.size() + blockSize - 1) / blockSize;
+    for(size_t idx = 0; idx < count; ++idx) {
+        auto& block = mBlocks[firstBlock + idx];
+        if(block.resident.exchange(false))
+            mResidentSize -= block.size;
+        block.size = 0;
+        block.ptr = nullptr;
+    }
+}
+
+void ResidencyManager::trim() {
+    static std::mutex mutex;
+    // another thread is trimming
+    const std::unique_lock guard{ mutex, std::try_to_lock };
+    if(!guard.owns_lock())
+        return;
+
+    // the blocks touched after this point are the most recently used ones
+    const auto epoch = mEpoch++;
+
+    std::pmr::vector<std::pair<uint32_t, uint32_t>> candidates{ context().localAllocator };
+    for(uint32_t idx = 0; idx < mBlocks.size(); ++idx) {
+        const auto& block = mBlocks[idx];
+        if(block.ptr && block.resident.load(std::memory_order_relaxed))
+            candidates.emplace_back(block.lastUse.load(std::memory_order_relaxed), idx);
+    }
+    std::ranges::sort(candidates);
+
+    // evict down to 90% of the budget, so that trimming is not triggered by every new block
+    const auto target = mBudget / 10 * 9;
+    for(const auto& [lastUse, idx] : candidates) {
+        if(mResidentSize <= target || lastUse == epoch)
+            break;
+        auto& block = mBlocks[idx];
+        if(!block.resident.exchange(false))
+            continue;
+        discardPages(block.ptr, block.size);
+        mResidentSize -= block.size;
+    }
+}
+
+PIPER_NAMESPACE_END
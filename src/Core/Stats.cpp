@@ -18,12 +18,15 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <Piper/Core/Monitor.hpp>
 #include <Piper/Core/Report.hpp>
 #include <Piper/Core/Stats.hpp>
 #include <fmt/chrono.h>
+#include <fmt/ranges.h>
 #include <fstream>
 #include <magic_enum.hpp>
 #include <map>
+#include <mutex>
 #include <numeric>
 #include <oneapi/tbb/concurrent_vector.h>
 #include <ranges>
@@ -57,13 +60,25 @@ LocalStatsBase::LocalStatsBase() {
     getLocalStats().push_back(this);
 }
 
-void printStats() {
-    for(const auto local : getLocalStats())
-        local->accumulate();
+// NOTICE: the local stats are accumulated only once, so that the stats are printed and dumped without double counting
+static void accumulateStats() {
+    static std::once_flag flag;
+    std::call_once(flag, [] {
+        for(const auto local : getLocalStats())
+            local->accumulate();
+    });
+}
 
+static std::pmr::map<StatsCategory, std::pmr::map<StatsType, StatsBase*>> orderedStats() {
     std::pmr::map<StatsCategory, std::pmr::map<StatsType, StatsBase*>> order{ context().globalAllocator };
     for(const auto stats : getGlobalStats())
         order[toCategory(stats->type())].insert({ stats->type(), stats });
+    return order;
+}
+
+void printStats() {
+    accumulateStats();
+    const auto order = orderedStats();
 
     info("==================[Statistics]==================");
 
@@ -73,7 +88,137 @@ void printStats() {
             base->print();
     }
 
-    logFile().flush();
+    flushLog();
+}
+
+std::string dumpStats() {
+    accumulateStats();
+
+    std::string res = "{";
+    for(const auto& [category, stats] : orderedStats()) {
+        res += fmt::format(R"({}"{}":{{)", res.size() == 1 ? "" : ",", magic_enum::enum_name(category));
+        bool first = true;
+        for(const auto base : stats | std::views::values) {
+            res += fmt::format(R"({}"{}":)", first ? "" : ",", magic_enum::enum_name(base->type()));
+            base->dump(res);
+            first = false;
+        }
+        res += '}';
+    }
+    res += '}';
+    return res;
+}
+
+void writeStatsReport(const fs::path& path, const uint64_t configHash) {
+    const auto [wallTime, userTime, kernelTime, memoryUsage] = getMonitor().processTime();
+    std::ofstream out{ path };
+    if(!out)
+        fatal(fmt::format("Failed to open stats report {}", path.string()));
+    std::string hardware = "null";
+    if(const auto counters = getMonitor().hardwareCounters())
+        hardware = fmt::format(R"({{"Cycles":{},"Instructions":{},"CacheMisses":{},"BranchMisses":{}}})", counters->cycles,
+                               counters->instructions, counters->cacheMisses, counters->branchMisses);
+    std::string memory = "{";
+    for(const auto tag : magic_enum::enum_values<MemoryTag>()) {
+        const auto [live, peak] = Piper::memoryUsage(tag);
+        memory += fmt::format(R"({}"{}":{{"Live":{},"Peak":{}}})", memory.size() == 1 ? "" : ",", magic_enum::enum_name(tag), live, peak);
+    }
+    memory += '}';
+    out << fmt::format(R"({{"ConfigHash":"{:0>16x}","WallTime":{},"UserTime":{},"KernelTime":{},"MemoryUsage":{},)"
+                       R"("SubsystemMemory":{},"HardwareCounters":{},"Stats":{}}})",
+                       configHash, wallTime, userTime, kernelTime, memoryUsage, memory, hardware, dumpStats());
+    info(fmt::format("Stats report is written to {}", path.string()));
+}
+
+LiveStats sampleLiveStats(const StatsType type) {
+    LiveStats res;
+    // NOTICE: concurrent_vector never moves the inserted elements, so the local stats registered by the new threads are safe
+    for(const auto local : getLocalStats())
+        if(const auto snapshot = local->snapshot(); snapshot && snapshot->first == type) {
+            res.count += snapshot->second.count;
+            res.positiveCount += snapshot->second.positiveCount;
+        }
+    return res;
+}
+
+Throughput ThroughputMeter::update() {
+    const auto now = std::chrono::steady_clock::now();
+    const auto dt = std::chrono::duration<double>(now - mLastTime).count();
+    mLastTime = now;
+
+    const auto rate = [dt](LiveStats& last, const StatsType type) {
+        const auto current = sampleLiveStats(type);
+        const auto delta = LiveStats{ current.count - last.count, current.positiveCount - last.positiveCount };
+        last = current;
+        return std::make_pair(dt > 0.0 ? static_cast<double>(delta.count) / dt : 0.0, delta);
+    };
+
+    Throughput res;
+    const auto [rays, rayDelta] = rate(mRays, StatsType::Intersection);
+    res.raysPerSecond = rays;
+    res.hitRatio = rayDelta.count ? static_cast<double>(rayDelta.positiveCount) / static_cast<double>(rayDelta.count) : 0.0;
+    res.occlusionRaysPerSecond = rate(mOcclusionRays, StatsType::Occlusion).first;
+    res.samplesPerSecond = rate(mSamples, StatsType::Sample).first;
+    res.textureLookupsPerSecond = rate(mTextureLookups, StatsType::Texture2D).first;
+    return res;
+}
+
+std::string formatThroughput(const Throughput& throughput) {
+    return fmt::format("{:.2f} Mrays/s ({:.1f}% hit), {:.2f} Mshadow rays/s, {:.2f} Msamples/s, {:.2f} Mtexture lookups/s",
+                       throughput.raysPerSecond * 1e-6, throughput.hitRatio * 100.0, throughput.occlusionRaysPerSecond * 1e-6,
+                       throughput.samplesPerSecond * 1e-6, throughput.textureLookupsPerSecond * 1e-6);
+}
+
+std::vector<std::pair<StatsType, LiveStats>> FrameStatsMeter::sampleAllLiveStats() {
+    std::pmr::map<StatsType, LiveStats> sum{ context().globalAllocator };
+    for(const auto local : getLocalStats())
+        if(const auto snapshot = local->snapshot()) {
+            auto& [count, positiveCount] = sum[snapshot->first];
+            count += snapshot->second.count;
+            positiveCount += snapshot->second.positiveCount;
+        }
+    return { sum.cbegin(), sum.cend() };
+}
+
+FrameStats FrameStatsMeter::finish() const {
+    FrameStats res;
+    res.renderTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - mBegin).count();
+    for(const auto& [type, current] : sampleAllLiveStats()) {
+        LiveStats delta = current;
+        // the counters registered during the frame start from zero
+        if(const auto iter = std::ranges::find(mCounters, type, &std::pair<StatsType, LiveStats>::first); iter != mCounters.cend()) {
+            delta.count -= iter->second.count;
+            delta.positiveCount -= iter->second.positiveCount;
+        }
+        res.counters.emplace_back(type, delta);
+    }
+    return res;
+}
+
+std::string dumpFrameStats(const FrameStats& stats) {
+    auto res = fmt::format(R"({{"RenderTime":{})", stats.renderTime);
+    if(const auto iter = std::ranges::find(stats.counters, StatsType::Intersection, &std::pair<StatsType, LiveStats>::first);
+       iter != stats.counters.cend() && stats.renderTime > 0.0)
+        res += fmt::format(R"(,"RaysPerSecond":{})", static_cast<double>(iter->second.count) / stats.renderTime);
+    res += R"(,"Counters":{)";
+    bool first = true;
+    for(const auto& [type, value] : stats.counters) {
+        res += fmt::format(R"({}"{}":{{"Count":{},"Positive":{}}})", first ? "" : ",", magic_enum::enum_name(type), value.count,
+                           value.positiveCount);
+        first = false;
+    }
+    res += "}";
+    if(!stats.convergence.empty()) {
+        res += R"(,"Convergence":[)";
+        first = true;
+        for(const auto& [time, samples, rmse] : stats.convergence) {
+            res += fmt::format(R"({}{{"Time":{},"Samples":{},"RMSE":{}}})", first ? "" : ",", time, samples, rmse);
+            first = false;
+        }
+        res += "]";
+    }
+    res += "}";
+    return res;
 }
 
 uint64_t rdtsc() {
@@ -118,4 +263,38 @@ void BoolCounterBase::print() {
                      mPositiveCount, 100.0 - percent, mCount - mPositiveCount, mCount));
 }
 
+void PeakBase::print() {
+    info(fmt::format("{}: {}", magic_enum::enum_name(mType), mValue));
+}
+
+void CounterBase::dump(std::string& out) const {
+    out += fmt::format(R"({{"Count":{}}})", mCount);
+}
+
+void BoolCounterBase::dump(std::string& out) const {
+    out += fmt::format(R"({{"Count":{},"Positive":{}}})", mCount, mPositiveCount);
+}
+
+void HistogramBase::dump(std::string& out) const {
+    // the trailing empty buckets are omitted
+    const auto last = std::find_if(mCount.crbegin(), mCount.crend(), [](const uint64_t val) { return val != 0; });
+    out += fmt::format(R"({{"Buckets":[{}]}})", fmt::join(mCount.cbegin(), last.base(), ","));
+}
+
+void TimerBase::dump(std::string& out) const {
+    const auto total = std::chrono::duration_cast<std::chrono::nanoseconds>(HClock::duration{ mSum }).count();
+    out += fmt::format(R"({{"Count":{},"TotalNanoseconds":{}}})", mCount, total);
+}
+
+void TickTimerBase::dump(std::string& out) const {
+    if(mValue == std::numeric_limits<uint64_t>::max())
+        out += R"({"Cycles":null})";
+    else
+        out += fmt::format(R"({{"Cycles":{}}})", mValue);
+}
+
+void PeakBase::dump(std::string& out) const {
+    out += fmt::format(R"({{"Value":{}}})", mValue);
+}
+
 PIPER_NAMESPACE_END
@@ -31,7 +31,12 @@
 #include <sdkddkver.h>
 #endif
 
+#include <array>
+#include <atomic>
 #include <boost/asio.hpp>
+#include <condition_variable>
+#include <deque>
+#include <thread>
 #include <type_traits>
 
 PIPER_NAMESPACE_BEGIN
@@ -50,7 +55,8 @@ enum class OperationType : char {
 static_assert(std::is_trivially_copyable_v<OperationType>);
 
 class OStream final {
-    BinaryData mData{ 4U, context().scopedAllocator };
+    // the messages are consumed by the I/O thread, so they are not allocated from the scoped arena
+    BinaryData mData{ 4U, context().globalAllocator };
 
 public:
     template <typename T>
@@ -74,12 +80,6 @@ public:
         return *this;
     }
 
-    OStream& operator<<(const std::span<float>& val) {
-        const auto base = reinterpret_cast<const std::byte*>(val.data());
-        mData.insert(mData.cend(), base, base + val.size_bytes());
-        return *this;
-    }
-
     OStream& operator<<(const std::string_view val) {
         const auto base = reinterpret_cast<const std::byte*>(val.data());
         mData.insert(mData.cend(), base, base + val.size() + 1);
@@ -102,37 +102,88 @@ public:
         return *this;
     }
 
-    const BinaryData& get() {
-        *reinterpret_cast<uint32_t*>(mData.data()) = static_cast<uint32_t>(mData.size());
-        return mData;
+    // the payload is sent right after the header without being copied into it, the message length covers both
+    BinaryData take(const size_t payloadBytes = 0) {
+        *reinterpret_cast<uint32_t*>(mData.data()) = static_cast<uint32_t>(mData.size() + payloadBytes);
+        return std::move(mData);
     }
 };
 
-extern std::function<void()> renderCallback;
-
+// All traffic goes through a single I/O thread, so the writes never overlap and the callers never wait for the network. The
+// droppable image updates are rejected if the queue is full, then the previews keep the regions dirty for the next flush.
 class DisplayProviderImpl final : public DisplayProvider {
+    static constexpr size_t maxQueuedMessages = 64;
+    static constexpr auto pollInterval = std::chrono::milliseconds{ 20 };
+
     boost::asio::io_context mCtx;
     boost::asio::ip::tcp::socket mSocket{ mCtx };
-    bool mConnected = false;
+    std::atomic_bool mConnected = false;
     uint16_t mUniqueID = static_cast<uint16_t>(seeding(std::chrono::high_resolution_clock::now().time_since_epoch().count()));
 
+    std::mutex mQueueMutex;
+    std::condition_variable mQueueCondition;
+    struct Message final {
+        BinaryData header;
+        std::vector<float> payload;
+        size_t payloadBytes;
+    };
+    std::deque<Message> mQueue;
+    bool mStop = false;
+    std::thread mThread;
+
+    // the previews are flushed by the I/O thread, the workers only write to their buffers
+    std::mutex mPreviewMutex;
+    std::vector<PreviewImage*> mPreviews;
+
+    // the payload owned by the message is written from its own buffer by the scatter-gather write
+    // returns false if the message is dropped
     template <typename... Args>
-    void send(Args&&... args) {
-        renderCallback();
+    bool send(const bool droppable, std::vector<float> payload, const size_t payloadSize, Args&&... args) {
+        if(!mConnected)
+            return true;
 
-        MemoryArena arena;
         OStream stream;
         (stream << ... << std::forward<Args>(args));
+        const auto payloadBytes = payloadSize * sizeof(float);
+
+        std::lock_guard guard{ mQueueMutex };
+        if(droppable && mQueue.size() >= maxQueuedMessages)
+            return false;
+        mQueue.push_back({ stream.take(payloadBytes), std::move(payload), payloadBytes });
+        mQueueCondition.notify_one();
+        return true;
+    }
 
-        auto& data = stream.get();
-
-        boost::asio::async_write(mSocket, boost::asio::buffer(data.data(), data.size()),
-                                 [this](const boost::system::error_code ec, size_t /*length*/) {
-                                     if(ec.failed()) {
-                                         error(fmt::format("Disconnected with tev: {}.", ec.message()));
-                                         mConnected = false;
-                                     }
-                                 });
+    void run() {
+        while(true) {
+            std::deque<Message> messages;
+            {
+                std::unique_lock guard{ mQueueMutex };
+                mQueueCondition.wait_for(guard, pollInterval, [&] { return mStop || !mQueue.empty(); });
+                messages.swap(mQueue);
+                if(mStop && messages.empty())
+                    return;
+            }
+
+            for(const auto& message : messages) {
+                if(!mConnected)
+                    break;
+                boost::system::error_code ec;
+                const std::array<boost::asio::const_buffer, 2> buffers{
+                    boost::asio::buffer(message.header.data(), message.header.size()),
+                    boost::asio::buffer(message.payload.data(), message.payloadBytes),
+                };
+                boost::asio::write(mSocket, buffers, ec);
+                if(ec.failed()) {
+                    error(fmt::format("Disconnected with tev: {}.", ec.message()));
+                    mConnected = false;
+                }
+            }
+
+            std::lock_guard guard{ mPreviewMutex };
+            for(const auto preview : mPreviews)
+                preview->flush();
+        }
     }
 
 public:
@@ -147,32 +198,43 @@ public:
         } else {
             info(fmt::format("Successfully connected with tev({}).", serverConfig));
             mConnected = true;
+            mThread = std::thread{ [this] { run(); } };
         }
     }
     void create(std::string_view imageName, uint32_t width, uint32_t height,
                 const std::initializer_list<std::string_view>& channels) override {
         // close(imageName);
-        send(OperationType::CreateImage, true /*grabFocus*/, imageName, width, height, static_cast<uint32_t>(channels.size()), channels);
+        send(false, {}, 0, OperationType::CreateImage, true /*grabFocus*/, imageName, width, height,
+             static_cast<uint32_t>(channels.size()), channels);
     }
-    void update(std::string_view imageName, const std::initializer_list<std::string_view>& channels,
+    bool update(std::string_view imageName, const std::initializer_list<std::string_view>& channels,
                 const std::initializer_list<uint64_t>& offsets, const std::initializer_list<uint64_t>& strides, uint32_t x, uint32_t y,
-                uint32_t width, uint32_t height, const std::span<float>& data) override {
+                uint32_t width, uint32_t height, std::vector<float> data, const bool droppable) override {
         size_t stridedImageDataSize = 0;
         for(uint32_t c = 0; c < channels.size(); ++c)
             stridedImageDataSize = std::max(stridedImageDataSize, offsets.begin()[c] + (width * height - 1) * strides.begin()[c] + 1);
 
-        const auto stridedData = data.subspan(0, stridedImageDataSize);
+        stridedImageDataSize = std::min(stridedImageDataSize, data.size());
 
-        send(OperationType::UpdateImageV3, false /*grabFocus*/, imageName, static_cast<uint32_t>(channels.size()), channels, x, y, width,
-             height, offsets, strides, stridedData);
+        return send(droppable, std::move(data), stridedImageDataSize, OperationType::UpdateImageV3, false /*grabFocus*/, imageName,
+                    static_cast<uint32_t>(channels.size()), channels, x, y, width, height, offsets, strides);
     }
     void open(std::string_view imagePath) override {
-        send(OperationType::OpenImageV2, true /*grabFocus*/, imagePath, ""sv);
+        send(false, {}, 0, OperationType::OpenImageV2, true /*grabFocus*/, imagePath, ""sv);
     }
     void close(std::string_view imageName) override {
-        send(OperationType::CloseImage, imageName);
+        send(false, {}, 0, OperationType::CloseImage, imageName);
     }
     void disconnect() override {
+        if(mThread.joinable()) {
+            {
+                std::lock_guard guard{ mQueueMutex };
+                mStop = true;
+            }
+            mQueueCondition.notify_one();
+            mThread.join();
+        }
+        mConnected = false;
         boost::system::error_code ec;
         mSocket.shutdown(boost::asio::socket_base::shutdown_both, ec);
         mSocket.close(ec);
@@ -182,6 +244,15 @@ public:
             disconnect();
     }
 
+    void addPreview(PreviewImage* preview) override {
+        std::lock_guard guard{ mPreviewMutex };
+        mPreviews.push_back(preview);
+    }
+    void removePreview(PreviewImage* preview) override {
+        std::lock_guard guard{ mPreviewMutex };
+        std::erase(mPreviews, preview);
+    }
+
     [[nodiscard]] uint16_t uniqueID() const noexcept override {
         return mUniqueID;
     }
@@ -196,4 +267,96 @@ DisplayProvider& getDisplayProvider() {
     return provider;
 }
 
+PreviewImage::PreviewImage(std::string name, const uint32_t width, const uint32_t height, const PreviewPolicy& policy)
+    : mName{ std::move(name) }, mPolicy{ policy } {
+    mPolicy.downsample = std::max(1U, mPolicy.downsample);
+    mWidth = (width + mPolicy.downsample - 1) / mPolicy.downsample;
+    mHeight = (height + mPolicy.downsample - 1) / mPolicy.downsample;
+    mData.resize(static_cast<size_t>(mWidth) * mHeight * 3);
+    resetDirtyRegion();
+    mLastUpdate = std::chrono::steady_clock::now();
+    auto& sync = getDisplayProvider();
+    sync.create(mName, mWidth, mHeight, { "r", "g", "b" });
+    sync.addPreview(this);
+}
+
+PreviewImage::~PreviewImage() {
+    // waits for the I/O thread if it is flushing this preview
+    getDisplayProvider().removePreview(this);
+    flush(true);
+}
+
+void PreviewImage::resetDirtyRegion() noexcept {
+    mDirtyX0 = mWidth;
+    mDirtyY0 = mHeight;
+    mDirtyX1 = mDirtyY1 = 0;
+}
+
+void PreviewImage::update(const uint32_t x, const uint32_t y, const std::span<const float> rgb) {
+    const auto factor = mPolicy.downsample;
+    if(y % factor != 0)
+        return;
+    const auto py = y / factor;
+    // the first preview pixel sampled in [x, x + width)
+    const auto px0 = (x + factor - 1) / factor;
+    const auto px1 = std::min(mWidth, static_cast<uint32_t>((x + rgb.size() / 3 + factor - 1) / factor));
+    if(py >= mHeight || px0 >= px1)
+        return;
+
+    std::lock_guard guard{ mMutex };
+    const auto dst = mData.data() + static_cast<size_t>(py) * mWidth * 3;
+    for(auto px = px0; px < px1; ++px)
+        std::copy_n(rgb.data() + static_cast<size_t>(px * factor - x) * 3, 3, dst + static_cast<size_t>(px) * 3);
+    mDirtyX0 = std::min(mDirtyX0, px0);
+    mDirtyX1 = std::max(mDirtyX1, px1);
+    mDirtyY0 = std::min(mDirtyY0, py);
+    mDirtyY1 = std::max(mDirtyY1, py + 1);
+}
+
+bool PreviewImage::due() const noexcept {
+    return std::chrono::steady_clock::now() - mLastUpdate >= std::chrono::milliseconds{ mPolicy.minInterval };
+}
+
+void PreviewImage::flush(const bool force) {
+    if(!force && !due())
+        return;
+    // the regions are sent in order, and the concurrent flushes are skipped rather than queued
+    std::unique_lock sendGuard{ mSendMutex, std::defer_lock };
+    if(force)
+        sendGuard.lock();
+    else if(!sendGuard.try_lock())
+        return;
+
+    std::vector<float> region;
+    uint32_t x0, y0, width, height;
+    {
+        std::lock_guard guard{ mMutex };
+        if(mDirtyX0 >= mDirtyX1 || mDirtyY0 >= mDirtyY1)
+            return;
+        if(!force && !due())
+            return;
+        x0 = mDirtyX0;
+        y0 = mDirtyY0;
+        width = mDirtyX1 - mDirtyX0;
+        height = mDirtyY1 - mDirtyY0;
+        region.resize(static_cast<size_t>(width) * height * 3);
+        for(uint32_t y = 0; y < height; ++y)
+            std::copy_n(mData.data() + (static_cast<size_t>(y0 + y) * mWidth + x0) * 3, static_cast<size_t>(width) * 3,
+                        region.data() + static_cast<size_t>(y) * width * 3);
+        resetDirtyRegion();
+        mLastUpdate = std::chrono::steady_clock::now();
+    }
+
+    auto& sync = getDisplayProvider();
+    if(sync.isSupported() &&
+       !sync.update(mName, { "r", "g", "b" }, { 0, 1, 2 }, { 3, 3, 3 }, x0, y0, width, height, std::move(region), !force)) {
+        // the pixels are still in the buffer, so only the region is restored
+        std::lock_guard guard{ mMutex };
+        mDirtyX0 = std::min(mDirtyX0, x0);
+        mDirtyY0 = std::min(mDirtyY0, y0);
+        mDirtyX1 = std::max(mDirtyX1, x0 + width);
+        mDirtyY1 = std::max(mDirtyY1, y0 + height);
+    }
+}
+
 PIPER_NAMESPACE_END
@@ -0,0 +1,101 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <Piper/Core/Report.hpp>
+#include <Piper/Core/Threading.hpp>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <oneapi/tbb/global_control.h>
+#include <oneapi/tbb/info.h>
+
+PIPER_NAMESPACE_BEGIN
+
+struct ThreadingState final {
+    tbb::task_arena arena;
+    std::unique_ptr<tbb::global_control> limit;
+    uint32_t budget = 0;
+    std::optional<int32_t> numaNode;
+};
+
+static ThreadingState& threadingState() {
+    static ThreadingState state;
+    return state;
+}
+
+void configureThreading(const ThreadSetting& setting) {
+    auto& state = threadingState();
+
+    tbb::task_arena::constraints constraints;
+    if(setting.numaNode) {
+        // NOTICE: TBB reports a single node with index -1 if tbbbind (hwloc) is unavailable
+        const auto nodes = tbb::info::numa_nodes();
+        if(std::find(nodes.cbegin(), nodes.cend(), *setting.numaNode) == nodes.cend()) {
+            if(nodes.size() == 1 && nodes.front() == tbb::task_arena::automatic)
+                warning(fmt::format("The NUMA topology is unavailable, the binding to node {} is ignored", *setting.numaNode));
+            else
+                fatal(fmt::format("The NUMA node {} is not available", *setting.numaNode));
+        } else {
+            constraints.numa_id = *setting.numaNode;
+            state.numaNode = setting.numaNode;
+        }
+    }
+    if(setting.smt == SMTPolicy::Avoid)
+        constraints.max_threads_per_core = 1;
+
+    const auto available = static_cast<uint32_t>(tbb::info::default_concurrency(constraints));
+    const auto budget = setting.threadCount ? std::min(setting.threadCount, available) : available;
+    constraints.max_concurrency = static_cast<int32_t>(budget);
+    state.arena.initialize(constraints);
+    // the implicit arenas (e.g., the ones of the other libraries) cannot oversubscribe the budget
+    state.limit = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, budget);
+    state.budget = budget;
+
+    info(fmt::format("Using {} threads (SMT: {}, NUMA node: {})", budget, setting.smt == SMTPolicy::Use ? "use"sv : "avoid"sv,
+                     state.numaNode ? fmt::format("{}", *state.numaNode) : "any"s));
+}
+
+uint32_t threadBudget() noexcept {
+    const auto budget = threadingState().budget;
+    return budget ? budget : static_cast<uint32_t>(tbb::info::default_concurrency());
+}
+
+std::optional<int32_t> boundNumaNode() noexcept {
+    return threadingState().numaNode;
+}
+
+tbb::task_arena& renderArena() {
+    return threadingState().arena;
+}
+
+static std::atomic_bool cancellationFlag = false;
+
+void requestCancellation() noexcept {
+    cancellationFlag.store(true, std::memory_order_relaxed);
+}
+
+void resetCancellation() noexcept {
+    cancellationFlag.store(false, std::memory_order_relaxed);
+}
+
+bool cancellationRequested() noexcept {
+    return cancellationFlag.load(std::memory_order_relaxed);
+}
+
+PIPER_NAMESPACE_END
@@ -0,0 +1,137 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/Report.hpp>
+#include <Piper/Core/Trace.hpp>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <oneapi/tbb/concurrent_vector.h>
+#include <vector>
+
+PIPER_NAMESPACE_BEGIN
+
+namespace detail {
+    std::atomic_bool tracingEnabled = false;
+}
+
+struct TraceEvent final {
+    std::string_view name;
+    uint64_t begin;
+    uint64_t end;
+};
+
+// the timeline of a thread is only locked by its owner and the exporter, so the lock is almost never contended
+struct ThreadTimeline final {
+    uint32_t threadIdx;
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    uint64_t dropped = 0;
+};
+
+// bounds the memory usage of a long render, about 24MB per thread
+static constexpr size_t maxEventsPerThread = 1 << 20;
+
+static tbb::concurrent_vector<ThreadTimeline*>& getTimelines() {
+    static tbb::concurrent_vector<ThreadTimeline*> inst;
+    return inst;
+}
+
+static std::chrono::steady_clock::time_point& traceBegin() {
+    static std::chrono::steady_clock::time_point inst;
+    return inst;
+}
+
+static ThreadTimeline& localTimeline() {
+    // NOTICE: the timelines are never freed, so the exporter can read the timelines of the exited threads
+    thread_local ThreadTimeline* timeline = [] {
+        const auto res = new ThreadTimeline{};
+        const auto iter = getTimelines().push_back(res);
+        res->threadIdx = static_cast<uint32_t>(iter - getTimelines().begin());
+        res->events.reserve(1024);
+        return res;
+    }();
+    return *timeline;
+}
+
+void startTracing() {
+    traceBegin() = std::chrono::steady_clock::now();
+    detail::tracingEnabled.store(true, std::memory_order_release);
+}
+
+uint64_t detail::traceTimestamp() noexcept {
+    const auto elapsed = std::chrono::steady_clock::now() - traceBegin();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+void detail::recordSpan(const std::string_view name, const uint64_t begin, const uint64_t end) noexcept {
+    auto& timeline = localTimeline();
+    std::lock_guard guard{ timeline.mutex };
+    if(timeline.events.size() < maxEventsPerThread)
+        timeline.events.push_back({ name, begin, end });
+    else
+        ++timeline.dropped;
+}
+
+static void writeEscaped(std::ofstream& out, const std::string_view str) {
+    for(const auto ch : str) {
+        if(ch == '"' || ch == '\\')
+            out << '\\' << ch;
+        else if(static_cast<unsigned char>(ch) < 0x20)
+            out << ' ';
+        else
+            out << ch;
+    }
+}
+
+void writeTrace(const fs::path& path) {
+    std::ofstream out{ path };
+    if(!out)
+        fatal(fmt::format("Failed to open trace file {}", path.string()));
+
+    out << R"({"displayTimeUnit":"ms","traceEvents":[)";
+    bool first = true;
+    uint64_t dropped = 0;
+    for(const auto timeline : getTimelines()) {
+        std::lock_guard guard{ timeline->mutex };
+        dropped += timeline->dropped;
+        if(timeline->events.empty())
+            continue;
+
+        out << (first ? "" : ",")
+            << fmt::format(R"({{"name":"thread_name","ph":"M","pid":0,"tid":{},"args":{{"name":"Thread {}"}}}})", timeline->threadIdx,
+                           timeline->threadIdx);
+        first = false;
+        // complete events in microseconds
+        for(const auto& [name, begin, end] : timeline->events) {
+            out << R"(,{"name":")";
+            writeEscaped(out, name);
+            out << fmt::format(R"(","cat":"piper","ph":"X","pid":0,"tid":{},"ts":{:.3f},"dur":{:.3f}}})", timeline->threadIdx,
+                               static_cast<double>(begin) * 1e-3, static_cast<double>(end - begin) * 1e-3);
+        }
+    }
+    out << "]}";
+
+    if(dropped)
+        warning(fmt::format("{} trace events are dropped since the timelines are full", dropped));
+    info(fmt::format("Trace is written to {}", path.string()));
+}
+
+PIPER_NAMESPACE_END
@@ -26,9 +26,12 @@ PIPER_NAMESPACE_BEGIN
 class BoxFilter final : public Filter {
 public:
     explicit BoxFilter(const Ref<ConfigNode>&) {}
-    Float evaluate(Float, Float) const noexcept override {
+    Float evaluate1D(Float) const noexcept override {
         return 1.0f;
     }
+    Float radius() const noexcept override {
+        return 0.5f;
+    }
 };
 
 PIPER_REGISTER_CLASS(BoxFilter, Filter);
@@ -25,18 +25,20 @@ PIPER_NAMESPACE_BEGIN
 
 class GaussianFilter final : public Filter {
     Float mAlpha;
+    Float mRadius;
     Float mDiff;
 
 public:
-    explicit GaussianFilter(const Ref<ConfigNode>& node) : mAlpha{ node->get("Alpha"sv)->as<Float>() } {
-        Float radius = 1.0f;
+    explicit GaussianFilter(const Ref<ConfigNode>& node) : mAlpha{ node->get("Alpha"sv)->as<Float>() }, mRadius{ 1.0f } {
         if(const auto ptr = node->tryGet("Radius"sv))
-            radius = (*ptr)->as<Float>();
-        mDiff = std::exp(-mAlpha * radius * radius);
+            mRadius = (*ptr)->as<Float>();
+        mDiff = std::exp(-mAlpha * mRadius * mRadius);
     }
-    Float evaluate(const Float dx, const Float dy) const noexcept override {
-        const auto eval = [&](const Float d) noexcept { return std::fmax(0.0f, exp(-mAlpha * d * d) - mDiff); };
-        return eval(dx) * eval(dy);
+    Float evaluate1D(const Float d) const noexcept override {
+        return std::fmax(0.0f, exp(-mAlpha * d * d) - mDiff);
+    }
+    Float radius() const noexcept override {
+        return mRadius;
     }
 };
 
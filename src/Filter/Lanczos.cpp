@@ -33,14 +33,14 @@ public:
             mRadius = (*ptr)->as<Float>();
         mInvRadius = 1.0f / mRadius;
     }
-    Float evaluate(const Float dx, const Float dy) const noexcept override {
-        const auto eval = [&](const Float d) noexcept {
-            const auto absDx = std::fabs(d);
-            const auto piAbsDx = pi * absDx;
-            const auto res = mRadius / (piAbsDx * piAbsDx) * sin(piAbsDx) * sin(piAbsDx * mInvRadius);
-            return absDx < mRadius ? (absDx > 1e-5f ? res : 1.0f) : 0.0f;
-        };
-        return eval(dx) * eval(dy);
+    Float evaluate1D(const Float d) const noexcept override {
+        const auto absDx = std::fabs(d);
+        const auto piAbsDx = pi * absDx;
+        const auto res = mRadius / (piAbsDx * piAbsDx) * sin(piAbsDx) * sin(piAbsDx * mInvRadius);
+        return absDx < mRadius ? (absDx > 1e-5f ? res : 1.0f) : 0.0f;
+    }
+    Float radius() const noexcept override {
+        return mRadius;
     }
 };
 
@@ -31,9 +31,11 @@ public:
         if(const auto ptr = node->tryGet("Radius"sv))
             mInvRadius = rcp((*ptr)->as<Float>());
     }
-    Float evaluate(const Float dx, const Float dy) const noexcept override {
-        const auto eval = [&](const Float d) noexcept { return std::fmax(0.0f, 1.0f - std::fabs(d) * mInvRadius); };
-        return eval(dx) * eval(dy);
+    Float evaluate1D(const Float d) const noexcept override {
+        return std::fmax(0.0f, 1.0f - std::fabs(d) * mInvRadius);
+    }
+    Float radius() const noexcept override {
+        return rcp(mInvRadius);
     }
 };
 
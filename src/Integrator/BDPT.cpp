@@ -0,0 +1,516 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/Stats.hpp>
+#include <Piper/Render/Acceleration.hpp>
+#include <Piper/Render/Integrator.hpp>
+#include <Piper/Render/Light.hpp>
+#include <Piper/Render/LightSampler.hpp>
+#include <Piper/Render/Material.hpp>
+#include <Piper/Render/Radiometry.hpp>
+
+PIPER_NAMESPACE_BEGIN
+
+// Please refer to "Robust Monte Carlo Methods for Light Transport Simulation" (Veach 1997) and pbrt-v3 section 16.3.
+// The light subpaths of a batch are generated into a pool and extended by tracing their rays as a single stream. Then each camera
+// subpath is connected to the light subpath with the same index, and the shadow rays of all connections are resolved in bulk.
+// NOTICE: the strategies with a single camera vertex need splatting into the film, so they are excluded from the estimator and
+// the balance heuristic. The lights without a position (infinite and directional lights) cannot start the light subpaths.
+template <typename Setting>
+class BDPTIntegrator final : public Integrator<Setting> {
+    PIPER_IMPORT_SETTINGS();
+
+    uint32_t mMaxDepth;
+
+    enum class VertexType : uint8_t { Camera, Light, Surface };
+
+    struct Vertex final {
+        VertexType type;
+        glm::vec3 pos;
+        glm::vec3 normal;  // the geometry normal of the surfaces, the outer normal of the area lights, zero for the others
+        Rational<Spectrum> beta;
+        // the area measure densities of generating this vertex from the camera side (fwd) and from the light side (rev)
+        Float pdfFwd = 0.0f;
+        Float pdfRev = 0.0f;
+        bool delta = false;
+        // the light source of the light vertices and the emission of the surface vertices
+        const Light<Setting>* light = nullptr;
+        const LightBase* lightBase = nullptr;
+        std::optional<SurfaceHit> hit;
+        std::optional<BSDF<Setting>> bsdf;
+    };
+    using Subpath = std::pmr::vector<Vertex>;
+
+    struct Walk final {
+        Ray ray;
+        Rational<Spectrum> beta;
+        Float pdfDir;  // the solid angle density of the ray direction
+        TransportMode mode;
+    };
+
+    struct PathContext final {
+        Point<FrameOfReference::World> reference;  // the shading point of the light sampler
+        Wavelength sampledWavelength;
+        Spectrum weight;
+        Radiance<Spectrum> result;
+    };
+
+    struct ShadowQuery final {
+        uint32_t pathIdx;
+        Ray shadowRay;
+        Distance distance;
+        Radiance<Spectrum> contribution;
+    };
+
+    static constexpr Float remap0(const Float x) noexcept {
+        return x != 0.0f ? x : 1.0f;
+    }
+
+    static Normal<FrameOfReference::World> zeroNormal() noexcept {
+        return Normal<FrameOfReference::World>::fromRaw(glm::zero<glm::vec3>());
+    }
+
+    static bool localLight(const LightBase& light) noexcept {
+        return !match(light.attributes(), LightAttributes::Infinite) && light.position().has_value();
+    }
+
+    static Float convertDensity(const Float pdf, const Vertex& from, const Vertex& to) noexcept {
+        const auto offset = to.pos - from.pos;
+        const auto dist2 = glm::dot(offset, offset);
+        if(!(dist2 > 0.0f))
+            return 0.0f;
+        auto res = pdf / dist2;
+        if(to.normal != glm::zero<glm::vec3>())
+            res *= std::fabs(glm::dot(to.normal, offset)) / std::sqrt(dist2);
+        return res;
+    }
+
+    static Direction<FrameOfReference::World> towards(const Vertex& from, const Vertex& to) noexcept {
+        return Direction<FrameOfReference::World>::fromRaw(glm::normalize(to.pos - from.pos));
+    }
+
+    // the density of emitting towards next from the light vertex
+    static Float pdfLight(const ShadingContext<Setting>& ctx, const Vertex& vertex, const Vertex& next) noexcept {
+        const Ray ray{ Point<FrameOfReference::World>::fromRaw(vertex.pos), towards(vertex, next), ctx.t };
+        const auto inversePdfDir = vertex.light->pdfLe(ctx, ray, Normal<FrameOfReference::World>::fromRaw(vertex.normal)).second;
+        return inversePdfDir.valid() ? convertDensity(rcp(inversePdfDir.raw()), vertex, next) : 0.0f;
+    }
+
+    // the density of selecting the light vertex as the origin of the light subpaths
+    static Float pdfLightOrigin(const ShadingContext<Setting>& ctx, const Vertex& vertex, const LightSampler& lightSampler,
+                                const PathContext& path) noexcept {
+        const auto choice = lightSampler.inversePdf(vertex.lightBase, path.reference, zeroNormal());
+        const auto dir = vertex.normal != glm::zero<glm::vec3>() ? vertex.normal : glm::vec3{ 0.0f, 0.0f, 1.0f };
+        const Ray ray{ Point<FrameOfReference::World>::fromRaw(vertex.pos), Direction<FrameOfReference::World>::fromRaw(dir), ctx.t };
+        const auto inversePdfPos = vertex.light->pdfLe(ctx, ray, Normal<FrameOfReference::World>::fromRaw(vertex.normal)).first;
+        return choice.valid() && inversePdfPos.valid() ? rcp(choice.raw() * inversePdfPos.raw()) : 0.0f;
+    }
+
+    // the density of sampling next from the vertex which is reached from prev
+    static Float pdf(const ShadingContext<Setting>& ctx, const Vertex& vertex, const Vertex* prev, const Vertex& next) noexcept {
+        if(vertex.type == VertexType::Light)
+            return pdfLight(ctx, vertex, next);
+        const auto inversePdf = vertex.bsdf->pdf(towards(vertex, *prev), towards(vertex, next));
+        return inversePdf.valid() ? convertDensity(rcp(inversePdf.raw()), vertex, next) : 0.0f;
+    }
+
+    // the emission of the surface vertices is evaluated as a light vertex, the normal is flipped to the outer side
+    static Vertex asLightVertex(const Vertex& vertex) noexcept {
+        const auto& hit = *vertex.hit;
+        const auto outer = dot(hit.geometryNormal, hit.shadingNormal) < 0.0f ? -hit.geometryNormal : hit.geometryNormal;
+        return Vertex{ VertexType::Light, vertex.pos, outer.raw(), vertex.beta, vertex.pdfFwd, vertex.pdfRev, false, vertex.light,
+                       vertex.lightBase, std::nullopt, std::nullopt };
+    }
+
+    // the correction of the adjoint BSDF with the shading normals, please refer to "Non-symmetric scattering in light transport
+    // algorithms" (Veach 1996)
+    static Float shadingNormalCorrection(const SurfaceHit& hit, const Direction<FrameOfReference::World>& wo,
+                                         const Direction<FrameOfReference::World>& wi) noexcept {
+        const auto denom = absDot(hit.geometryNormal, wo) * absDot(hit.shadingNormal, wi);
+        return denom > 0.0f ? absDot(hit.shadingNormal, wo) * absDot(hit.geometryNormal, wi) / denom : 0.0f;
+    }
+
+    // the balance heuristic over the strategies producing the same path, the connected vertices are passed explicitly
+    Float misWeight(const ShadingContext<Setting>& ctx, const Subpath& camera, const uint32_t t, const Subpath& light, const uint32_t s,
+                    const Vertex* sampled, const LightSampler& lightSampler, const PathContext& path) const noexcept {
+        if(s + t == 2)
+            return 1.0f;
+
+        const auto lightVertex = [&](const uint32_t idx) -> const Vertex& { return s == 1 && idx == 0 ? *sampled : light[idx]; };
+        const auto& pt = camera[t - 1];
+        const auto& ptMinus = camera[t - 2];
+        const auto ptLight = s == 0 ? std::optional{ asLightVertex(pt) } : std::nullopt;
+        const auto qs = s > 0 ? &lightVertex(s - 1) : nullptr;
+        const auto qsMinus = s > 1 ? &lightVertex(s - 2) : nullptr;
+
+        std::array<Float, 2> cameraRev{}, lightRev{};
+        cameraRev[0] = s > 0 ? pdf(ctx, *qs, qsMinus, pt) : pdfLightOrigin(ctx, *ptLight, lightSampler, path);
+        cameraRev[1] = s > 0 ? pdf(ctx, pt, qs, ptMinus) : pdfLight(ctx, *ptLight, ptMinus);
+        if(s > 0)
+            lightRev[0] = pdf(ctx, pt, &ptMinus, *qs);
+        if(s > 1)
+            lightRev[1] = pdf(ctx, *qs, &pt, *qsMinus);
+
+        Float sumRi = 0.0f;
+        Float ri = 1.0f;
+        for(auto idx = t - 1; idx > 1; --idx) {
+            const auto& vertex = camera[idx];
+            const auto pdfRev = idx == t - 1 ? cameraRev[0] : idx == t - 2 ? cameraRev[1] : vertex.pdfRev;
+            ri *= remap0(pdfRev) / remap0(vertex.pdfFwd);
+            const auto delta = idx != t - 1 && vertex.delta;
+            if(!delta && !camera[idx - 1].delta)
+                sumRi += ri;
+        }
+
+        ri = 1.0f;
+        const auto deltaLight = s > 0 ? match(lightVertex(0).lightBase->attributes(), LightAttributes::Delta) : false;
+        for(auto idx = s; idx-- > 0;) {
+            const auto& vertex = lightVertex(idx);
+            const auto pdfRev = idx + 1 == s ? lightRev[0] : idx + 2 == s ? lightRev[1] : vertex.pdfRev;
+            ri *= remap0(pdfRev) / remap0(vertex.pdfFwd);
+            const auto delta = idx + 1 != s && vertex.delta;
+            const auto deltaPrev = idx > 0 ? lightVertex(idx - 1).delta : deltaLight;
+            if(!delta && !deltaPrev)
+                sumRi += ri;
+        }
+
+        return 1.0f / (1.0f + sumRi);
+    }
+
+    // appends the hit to the subpath and samples the next direction, returns false if the subpath is terminated
+    bool extend(Subpath& subpath, Walk& walk, const Intersection& intersection, SampleProvider& sampler, PathContext& path,
+                const LightSampler& lightSampler, const uint32_t maxVertices) const noexcept {
+        const ShadingContext<Setting> ctx{ walk.ray.t, path.sampledWavelength };
+
+        if(intersection.index() == 0) {
+            // the camera subpaths escaping the scene reach the infinite lights, they are weighted against the light sampling only
+            if(walk.mode == TransportMode::Radiance) {
+                for(auto light : lightSampler.infiniteLights()) {
+                    const auto& typedLight = light.as<Setting>();
+                    const auto le = typedLight.evalLe(ctx, walk.ray);
+                    const auto choice = lightSampler.inversePdf(&light.getBase<LightBase>(), path.reference, zeroNormal());
+                    const auto inversePdf = typedLight.inversePdfLi(ctx, walk.ray.direction);
+                    const auto lightPdf = choice.valid() && inversePdf.valid() ? rcp(choice.raw() * inversePdf.raw()) : 0.0f;
+                    const auto weight = walk.pdfDir > 0.0f ? walk.pdfDir / (walk.pdfDir + lightPdf) : 1.0f;
+                    path.result += walk.beta * le * weight;
+                }
+            }
+            return false;
+        }
+
+        const auto& info = std::get<SurfaceHit>(intersection);
+        // the boundaries of the media are index-matched, the subpath passes through them without a vertex
+        // NOTICE: the densities are converted by the positions of the vertices, so the crossing does not change them
+        if(!info.surface.get()) {
+            info.continueRay(walk.ray, info.offsetOrigin(false));
+            return true;
+        }
+
+        const auto& prev = subpath.back();
+        Vertex vertex{ VertexType::Surface, info.hit.raw(), info.geometryNormal.raw(), walk.beta };
+        vertex.pdfFwd = convertDensity(walk.pdfDir, prev, vertex);
+        if(info.areaLight.get()) {
+            vertex.light = &info.areaLight.as<Setting>();
+            vertex.lightBase = &info.areaLight.getBase<LightBase>();
+        }
+        vertex.bsdf.emplace(info.surface.as<Setting>().evaluate(path.sampledWavelength, info));
+        vertex.hit = info;
+        subpath.push_back(std::move(vertex));
+
+        if(subpath.size() >= maxVertices)
+            return false;
+
+        auto& current = subpath.back();
+        const auto& bsdf = *current.bsdf;
+        const auto wo = -walk.ray.direction;
+        const auto sampled = bsdf.sample(sampler, wo, walk.mode);
+        if(!sampled.valid())
+            return false;
+
+        auto pdfDir = rcp(sampled.inversePdf.raw());
+        const auto reverse = bsdf.pdf(sampled.wi, wo, walk.mode);
+        auto pdfRev = reverse.valid() ? rcp(reverse.raw()) : 0.0f;
+        if(match(sampled.part, BxDFPart::Specular)) {
+            current.delta = true;
+            pdfDir = pdfRev = 0.0f;
+        }
+
+        walk.beta = walk.beta * sampled.f * (sampled.inversePdf * absDot(info.shadingNormal, sampled.wi));
+        if(walk.mode == TransportMode::Importance)
+            walk.beta = walk.beta * shadingNormalCorrection(info, wo, sampled.wi);
+        if(!(maxComponentValue(walk.beta.raw()) > 0.0f))
+            return false;
+
+        auto& prevVertex = subpath[subpath.size() - 2];
+        prevVertex.pdfRev = convertDensity(pdfRev, current, prevVertex);
+        walk.pdfDir = pdfDir;
+        walk.ray = info.spawnRay(info.offsetOrigin(match(sampled.part, BxDFPart::Reflection)), sampled.wi);
+        return true;
+    }
+
+    // extends all live subpaths by tracing their rays as a single stream
+    void walkAll(std::pmr::vector<Subpath>& subpaths, std::pmr::vector<Walk>& walks, std::pmr::vector<uint32_t>& live,
+                 std::pmr::vector<PathContext>& paths, const Acceleration& acceleration, const LightSampler& lightSampler,
+                 const std::pmr::vector<SampleProvider*>& samplers, const uint32_t maxVertices) const {
+        RayStream stream{ context().scopedAllocator };
+        std::pmr::vector<uint32_t> nextLive{ context().scopedAllocator };
+        while(!live.empty()) {
+            stream.clear();
+            for(const auto idx : live)
+                stream.push_back(walks[idx].ray);
+            const auto hits = acceleration.trace(stream);
+
+            nextLive.clear();
+            for(uint32_t k = 0; k < live.size(); ++k) {
+                const auto idx = live[k];
+                if(extend(subpaths[idx], walks[idx], hits[k], *samplers[idx], paths[idx], lightSampler, maxVertices))
+                    nextLive.push_back(idx);
+            }
+            std::swap(live, nextLive);
+        }
+    }
+
+    // the light subpath starts from a light selected without the shading point, so all strategies share the selection pdf
+    bool startLightSubpath(Subpath& subpath, Walk& walk, SampleProvider& sampler, const PathContext& path, const Float t,
+                           const LightSampler& lightSampler) const noexcept {
+        const ShadingContext<Setting> ctx{ t, path.sampledWavelength };
+        const auto [light, choice] = lightSampler.sample(sampler, path.reference, zeroNormal());
+        if(!choice.valid())
+            return false;
+        const auto& lightBase = light.getBase<LightBase>();
+        if(!localLight(lightBase))
+            return false;
+
+        const auto& typedLight = light.as<Setting>();
+        const auto sampled = typedLight.sampleLe(ctx, sampler);
+        if(!sampled.valid() || !sampled.inversePdfDir.valid())
+            return false;
+
+        const auto inversePdfPos = sampled.inversePdfPos.valid() ? sampled.inversePdfPos.raw() : 1.0f;
+        Vertex vertex{ VertexType::Light, sampled.ray.origin.raw(), sampled.normal.raw(),
+                       Rational<Spectrum>::fromRaw(sampled.intensity.raw()) * (choice.raw() * inversePdfPos) };
+        vertex.delta = match(lightBase.attributes(), LightAttributes::Delta);
+        vertex.light = &typedLight;
+        vertex.lightBase = &lightBase;
+        vertex.pdfFwd = pdfLightOrigin(ctx, vertex, lightSampler, path);
+        subpath.push_back(std::move(vertex));
+
+        const auto beta = subpath.back().beta * sampled.inversePdfDir.raw();
+        walk = Walk{ sampled.ray, beta, rcp(sampled.inversePdfDir.raw()), TransportMode::Importance };
+        return maxComponentValue(walk.beta.raw()) > 0.0f;
+    }
+
+    // s = 0: the camera subpath hits an area light
+    void connectEmission(const Subpath& camera, const uint32_t t, const Subpath& light, PathContext& path,
+                         const LightSampler& lightSampler) const noexcept {
+        const auto& pt = camera[t - 1];
+        if(!pt.light)
+            return;
+        const ShadingContext<Setting> ctx{ pt.hit->t, path.sampledWavelength };
+        const auto le = pt.light->evalL(ctx, Intersection{ *pt.hit });
+        path.result += pt.beta * le * misWeight(ctx, camera, t, light, 0, nullptr, lightSampler, path);
+    }
+
+    // s = 1: the light vertex is resampled by the light sampling of the camera vertex
+    void connectLight(const Subpath& camera, const uint32_t t, const Subpath& light, PathContext& path, SampleProvider& sampler,
+                      const LightSampler& lightSampler, const uint32_t pathIdx, std::pmr::vector<ShadowQuery>& queries) const noexcept {
+        const auto& pt = camera[t - 1];
+        if(!hasNonSpecular(pt.bsdf->part()))
+            return;
+        const auto& hit = *pt.hit;
+        const ShadingContext<Setting> ctx{ hit.t, path.sampledWavelength };
+
+        const auto [selected, choice] = lightSampler.sample(sampler, path.reference, zeroNormal());
+        if(!choice.valid())
+            return;
+        const auto& typedLight = selected.as<Setting>();
+        const auto& lightBase = selected.getBase<LightBase>();
+        const auto sampledLight = typedLight.sampleLi(ctx, hit.hit, sampler);
+        if(!sampledLight.valid())
+            return;
+
+        const auto wi = sampledLight.dir;
+        const auto wo = towards(pt, camera[t - 2]);
+        const auto f = pt.bsdf->evaluate(wo, wi) * absDot(hit.shadingNormal, wi);
+        const auto inverseLightPdf = choice * sampledLight.inversePdf;
+        const auto contribution = pt.beta * (sampledLight.rad * f * inverseLightPdf);
+        if(!(maxComponentValue(contribution.raw()) > 0.0f))
+            return;
+
+        Float weight = 1.0f;
+        if(!localLight(lightBase)) {
+            // only the BSDF sampling of the camera subpath competes with the light sampling
+            if(!match(lightBase.attributes(), LightAttributes::Delta)) {
+                const auto bsdfInversePdf = pt.bsdf->pdf(wo, wi);
+                const auto bsdfPdf = bsdfInversePdf.valid() ? rcp(bsdfInversePdf.raw()) : 0.0f;
+                const auto lightPdf = rcp(inverseLightPdf.raw());
+                weight = lightPdf / (lightPdf + bsdfPdf);
+            }
+        } else {
+            Vertex vertex{ VertexType::Light, hit.hit.raw() + wi.raw() * sampledLight.distance.raw(), sampledLight.normal.raw(),
+                           Rational<Spectrum>::identity() };
+            vertex.delta = match(lightBase.attributes(), LightAttributes::Delta);
+            vertex.light = &typedLight;
+            vertex.lightBase = &lightBase;
+            vertex.pdfFwd = pdfLightOrigin(ctx, vertex, lightSampler, path);
+            weight = misWeight(ctx, camera, t, light, 1, &vertex, lightSampler, path);
+        }
+
+        queries.push_back(ShadowQuery{ pathIdx, hit.spawnRay(hit.offsetOrigin(dot(wi, hit.geometryNormal.asDirection()) > 0.0f), wi),
+                                       sampledLight.distance, contribution * weight });
+    }
+
+    // s >= 2: the end points of both subpaths are connected by a shadow ray
+    void connectVertices(const Subpath& camera, const uint32_t t, const Subpath& light, const uint32_t s, const PathContext& path,
+                         const LightSampler& lightSampler, const uint32_t pathIdx,
+                         std::pmr::vector<ShadowQuery>& queries) const noexcept {
+        const auto& pt = camera[t - 1];
+        const auto& qs = light[s - 1];
+        if(!hasNonSpecular(pt.bsdf->part()) || !hasNonSpecular(qs.bsdf->part()))
+            return;
+
+        const auto& ptHit = *pt.hit;
+        const auto& qsHit = *qs.hit;
+        const ShadingContext<Setting> ctx{ ptHit.t, path.sampledWavelength };
+        const auto offset = qs.pos - pt.pos;
+        const auto dist2 = glm::dot(offset, offset);
+        if(!(dist2 > 0.0f))
+            return;
+        const auto dist = std::sqrt(dist2);
+        const auto wi = Direction<FrameOfReference::World>::fromRaw(offset / dist);
+
+        const auto fPt = pt.bsdf->evaluate(towards(pt, camera[t - 2]), wi);
+        const auto qsWo = towards(qs, light[s - 2]);
+        const auto fQs = qs.bsdf->evaluate(qsWo, -wi, TransportMode::Importance) * shadingNormalCorrection(qsHit, qsWo, -wi);
+        const auto g = absDot(ptHit.shadingNormal, wi) * absDot(qsHit.shadingNormal, wi) / dist2;
+        const auto throughput = pt.beta * fPt * fQs * qs.beta * g;
+        if(!(maxComponentValue(throughput.raw()) > 0.0f))
+            return;
+
+        const auto weight = misWeight(ctx, camera, t, light, s, nullptr, lightSampler, path);
+        queries.push_back(ShadowQuery{ pathIdx, ptHit.spawnRay(ptHit.offsetOrigin(dot(wi, ptHit.geometryNormal.asDirection()) > 0.0f), wi),
+                                       Distance::fromRaw(dist * (1.0f - epsilon)),
+                                       Radiance<Spectrum>::fromRaw(throughput.raw() * weight) });
+    }
+
+public:
+    explicit BDPTIntegrator(const Ref<ConfigNode>& node) : mMaxDepth{ node->get("MaxDepth"sv)->as<uint32_t>() } {}
+    void preprocess() const noexcept override {}
+
+    void estimate(const Ray& ray, const Intersection& intersection, const Acceleration& acceleration, const LightSampler& lightSampler,
+                  SampleProvider& sampler, const Float wavelengthSample, Float* output) const noexcept override {
+        RayStream rayStream{ 1, ray, context().scopedAllocator };
+        const std::pmr::vector<Intersection> intersections{ 1, intersection, context().scopedAllocator };
+        const std::pmr::vector<SampleProvider*> samplers{ 1, &sampler, context().scopedAllocator };
+        const std::pmr::vector<Float> wavelengthSamples{ 1, wavelengthSample, context().scopedAllocator };
+        estimateBatch(rayStream, intersections, acceleration, lightSampler, samplers, wavelengthSamples, output);
+    }
+
+    void estimateBatch(const RayStream& rayStream, const std::pmr::vector<Intersection>& intersections, const Acceleration& acceleration,
+                       const LightSampler& lightSampler, const std::pmr::vector<SampleProvider*>& samplers,
+                       const std::pmr::vector<Float>& wavelengthSamples, Float* output) const noexcept override {
+        const auto size = static_cast<uint32_t>(rayStream.size());
+        const auto maxLightVertices = mMaxDepth + 1, maxCameraVertices = mMaxDepth + 2;
+
+        std::pmr::vector<PathContext> paths{ context().scopedAllocator };
+        paths.reserve(size);
+        std::pmr::vector<Subpath> lightPaths{ context().scopedAllocator };
+        std::pmr::vector<Subpath> cameraPaths{ context().scopedAllocator };
+        lightPaths.reserve(size);
+        cameraPaths.reserve(size);
+        std::pmr::vector<Walk> walks{ size, Walk{ Ray::undefined(), Rational<Spectrum>::zero(), 0.0f, TransportMode::Radiance },
+                                      context().scopedAllocator };
+        std::pmr::vector<uint32_t> live{ context().scopedAllocator };
+        live.reserve(size);
+
+        for(uint32_t idx = 0; idx < size; ++idx) {
+            const auto [sampledWavelength, weight] = sampleWavelength<Wavelength, Spectrum>(wavelengthSamples[idx]);
+            paths.push_back(PathContext{ rayStream[idx].origin, sampledWavelength, weight, Radiance<Spectrum>::zero() });
+            lightPaths.emplace_back(context().scopedAllocator).reserve(maxLightVertices);
+            cameraPaths.emplace_back(context().scopedAllocator).reserve(maxCameraVertices);
+        }
+
+        // the pool of the light subpaths
+        for(uint32_t idx = 0; idx < size; ++idx)
+            if(startLightSubpath(lightPaths[idx], walks[idx], *samplers[idx], paths[idx], rayStream[idx].t, lightSampler) &&
+               maxLightVertices > 1)
+                live.push_back(idx);
+        walkAll(lightPaths, walks, live, paths, acceleration, lightSampler, samplers, maxLightVertices);
+
+        // the camera subpaths start from the traced primary rays
+        live.clear();
+        for(uint32_t idx = 0; idx < size; ++idx) {
+            auto& subpath = cameraPaths[idx];
+            subpath.push_back(
+                Vertex{ VertexType::Camera, rayStream[idx].origin.raw(), glm::zero<glm::vec3>(), Rational<Spectrum>::identity() });
+            walks[idx] = Walk{ rayStream[idx], Rational<Spectrum>::identity(), 0.0f, TransportMode::Radiance };
+            if(extend(subpath, walks[idx], intersections[idx], *samplers[idx], paths[idx], lightSampler, maxCameraVertices))
+                live.push_back(idx);
+        }
+        walkAll(cameraPaths, walks, live, paths, acceleration, lightSampler, samplers, maxCameraVertices);
+
+        std::pmr::vector<ShadowQuery> queries{ context().scopedAllocator };
+        for(uint32_t idx = 0; idx < size; ++idx) {
+            const auto& camera = cameraPaths[idx];
+            const auto& light = lightPaths[idx];
+            for(uint32_t t = 2; t <= camera.size(); ++t) {
+                for(uint32_t s = 0; s <= light.size(); ++s) {
+                    if(s + t - 2 > mMaxDepth)
+                        break;
+                    if(s == 0)
+                        connectEmission(camera, t, light, paths[idx], lightSampler);
+                    else if(s == 1)
+                        connectLight(camera, t, light, paths[idx], *samplers[idx], lightSampler, idx, queries);
+                    else
+                        connectVertices(camera, t, light, s, paths[idx], lightSampler, idx, queries);
+                }
+            }
+        }
+
+        RayStream shadowRays{ context().scopedAllocator };
+        std::pmr::vector<Distance> distances{ context().scopedAllocator };
+        shadowRays.reserve(queries.size());
+        distances.reserve(queries.size());
+        for(const auto& query : queries) {
+            shadowRays.push_back(query.shadowRay);
+            distances.push_back(query.distance);
+        }
+        if(!queries.empty()) {
+            const auto occluded = acceleration.occluded(shadowRays, distances);
+            for(uint32_t k = 0; k < queries.size(); ++k)
+                if(!occluded[k])
+                    paths[queries[k].pathIdx].result += queries[k].contribution;
+        }
+
+        for(uint32_t idx = 0; idx < size; ++idx) {
+            Histogram<StatsType::TraceDepth>::count(static_cast<uint32_t>(cameraPaths[idx].size() - 1));
+            const auto& path = paths[idx];
+            const auto out = output + idx * 3;
+            if constexpr(spectrumType<Spectrum>() == SpectrumType::Mono)
+                *out = luminance(path.result.raw() * path.weight, path.sampledWavelength);
+            else
+                *reinterpret_cast<RGBSpectrum*>(out) = toRGB(path.result.raw() * path.weight, path.sampledWavelength);
+        }
+    }
+};
+
+PIPER_REGISTER_VARIANT(BDPTIntegrator, Integrator);
+
+PIPER_NAMESPACE_END
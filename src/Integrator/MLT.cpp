@@ -0,0 +1,218 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Render/Acceleration.hpp>
+#include <Piper/Render/Integrator.hpp>
+#include <Piper/Render/Random.hpp>
+#include <Piper/Render/Sampler.hpp>
+#include <algorithm>
+#include <tbb/parallel_for.h>
+
+PIPER_NAMESPACE_BEGIN
+
+// Please refer to "A Simple and Robust Mutation Strategy for the Metropolis Light Transport Algorithm" (Kelemen et al. 2002) and
+// pbrt-v3 section 16.4.
+// The Markov chains run in the primary sample space of the whole film: the first dimensions choose the film coordinate and the
+// wavelengths, the others feed the inner integrator. The bootstrap samples estimate the normalization constant b and the initial
+// states of the chains, and each pass runs width * height * spp mutations in total, which are splatted to the film with b.
+// NOTICE: the splats are accumulated atomically, so the result depends on the scheduling.
+template <typename Setting>
+class MLTIntegrator final : public Integrator<Setting> {
+    PIPER_IMPORT_SETTINGS();
+
+    Ref<Integrator<Setting>> mIntegrator;
+    uint32_t mBootstrap = 1 << 16;
+    uint32_t mChains = 1024;
+    uint32_t mDimensions = 128;
+    Float mLargeStepProbability = 0.3f;
+
+    // the film coordinate and the wavelength sample
+    static constexpr uint32_t cameraDimensions = 3;
+
+    struct State final {
+        std::pmr::vector<Float> samples;
+        uint64_t seed;  // the fallback of the sample provider, so the evaluation is deterministic
+        glm::vec2 filmCoord;
+        glm::vec3 contribution;
+        Float target;
+    };
+
+    // the target function of the chains
+    static Float target(const glm::vec3& contribution) noexcept {
+        if constexpr(spectrumType<Spectrum>() == SpectrumType::Mono)
+            return std::fabs(contribution.x);
+        else
+            return std::fmax(std::fabs(contribution.x), std::fmax(std::fabs(contribution.y), std::fabs(contribution.z)));
+    }
+
+    [[nodiscard]] State makeState() const {
+        return State{ std::pmr::vector<Float>{ cameraDimensions + mDimensions, 0.0f, context().scopedAllocator }, 0, glm::vec2{ 0.0f },
+                      glm::vec3{ 0.0f }, 0.0f };
+    }
+
+    // the bootstrap candidates are regenerated from their seeds, so that only their targets are kept
+    static void initialize(State& state, const uint64_t seed) noexcept {
+        RandomEngine eng{ seeding(seed) };
+        for(auto& x : state.samples)
+            x = sample(eng);
+        state.seed = eng();
+    }
+
+    void evaluate(State& state, const SplatFilm& film, const glm::vec4 bounds, const Acceleration& acceleration,
+                  const LightSampler& lightSampler) const noexcept {
+        const ArenaRewindScope rewind;
+        state.filmCoord = { std::lerp(bounds.x, bounds.z, state.samples[0]), std::lerp(bounds.y, bounds.w, state.samples[1]) };
+        state.contribution = glm::vec3{ 0.0f };
+
+        SampleProvider sampler{ std::pmr::vector<Float>{ state.samples.cbegin() + cameraDimensions, state.samples.cend(),
+                                                         context().scopedAllocator },
+                                state.seed };
+        if(const auto [ray, weight] = film.sample(state.filmCoord, sampler); weight > 0.0f) {
+            std::array<Float, 3> output{};
+            mIntegrator->estimate(ray, acceleration.trace(ray), acceleration, lightSampler, sampler, state.samples[2], output.data());
+            state.contribution = glm::vec3{ output[0], output[1], output[2] } * weight;
+        }
+        state.target = target(state.contribution);
+    }
+
+    // the large steps sample the space uniformly, the small steps perturb each dimension by an exponential distribution
+    void mutate(const State& current, State& proposal, RandomEngine& eng, const bool largeStep) const noexcept {
+        constexpr Float s1 = 1.0f / 1024.0f, s2 = 1.0f / 64.0f;
+        const auto logRatio = std::log(s2 / s1);
+
+        if(largeStep) {
+            for(auto& x : proposal.samples)
+                x = sample(eng);
+            proposal.seed = eng();
+            return;
+        }
+
+        for(size_t idx = 0; idx < current.samples.size(); ++idx) {
+            const auto dv = s2 * std::exp(-logRatio * sample(eng));
+            auto x = current.samples[idx] + (sample(eng) < 0.5f ? dv : -dv);
+            x -= std::floor(x);
+            proposal.samples[idx] = std::fmin(x, oneMinusEpsilon);
+        }
+        proposal.seed = current.seed;
+    }
+
+public:
+    explicit MLTIntegrator(const Ref<ConfigNode>& node)
+        : mIntegrator{ this->template make<Integrator>(node->get("Integrator"sv)->as<Ref<ConfigNode>>()) } {
+        if(const auto ptr = node->tryGet("Bootstrap"sv))
+            mBootstrap = std::max(1U, (*ptr)->as<uint32_t>());
+        if(const auto ptr = node->tryGet("Chains"sv))
+            mChains = std::max(1U, (*ptr)->as<uint32_t>());
+        if(const auto ptr = node->tryGet("Dimensions"sv))
+            mDimensions = std::max(1U, (*ptr)->as<uint32_t>());
+        if(const auto ptr = node->tryGet("LargeStepProbability"sv))
+            mLargeStepProbability = std::clamp((*ptr)->as<Float>(), 0.0f, 1.0f);
+    }
+    void preprocess() const noexcept override {
+        mIntegrator->preprocess();
+    }
+    [[nodiscard]] bool deterministic() const noexcept override {
+        return false;
+    }
+    [[nodiscard]] bool splatting() const noexcept override {
+        return true;
+    }
+    void beginPass(const uint32_t passIdx, const Acceleration& acceleration, const LightSampler& lightSampler) noexcept override {
+        mIntegrator->beginPass(passIdx, acceleration, lightSampler);
+    }
+
+    // the coarse previews are rendered by the inner integrator
+    void estimate(const Ray& ray, const Intersection& intersection, const Acceleration& acceleration, const LightSampler& lightSampler,
+                  SampleProvider& sampler, const Float wavelengthSample, Float* output) const noexcept override {
+        mIntegrator->estimate(ray, intersection, acceleration, lightSampler, sampler, wavelengthSample, output);
+    }
+
+    void renderFilm(SplatFilm& film, const uint32_t sampleBegin, const uint32_t sampleEnd, const Acceleration& acceleration,
+                    const LightSampler& lightSampler) const override {
+        const auto bounds = film.bounds();
+        const auto mutations = static_cast<uint64_t>((bounds.z - bounds.x) * (bounds.w - bounds.y)) * (sampleEnd - sampleBegin);
+        if(mutations == 0)
+            return;
+        // the passes and the sample ranges of the distributed workers run independent chains
+        const auto seedBase = static_cast<uint64_t>(sampleBegin) << 33;
+
+        std::pmr::vector<Float> targets{ mBootstrap, context().globalAllocator };
+        tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, mBootstrap, 256 }, [&](const tbb::blocked_range<uint32_t>& range) {
+            MemoryArena arena;
+            auto state = makeState();
+            for(auto idx = range.begin(); idx != range.end(); ++idx) {
+                initialize(state, seedBase | idx);
+                evaluate(state, film, bounds, acceleration, lightSampler);
+                targets[idx] = state.target;
+            }
+        });
+
+        // the prefix sums are accumulated in order, so the normalization does not depend on the scheduling
+        std::pmr::vector<double> cdf{ mBootstrap + 1, 0.0, context().globalAllocator };
+        for(uint32_t idx = 0; idx < mBootstrap; ++idx)
+            cdf[idx + 1] = cdf[idx] + static_cast<double>(targets[idx]);
+        if(!(cdf.back() > 0.0))
+            return;
+        const auto b = static_cast<Float>(cdf.back() / static_cast<double>(mBootstrap));
+
+        const auto splat = [&](const State& state, const Float weight) {
+            const auto value = state.contribution * (b * weight / state.target);
+            film.splat(state.filmCoord, &value.x);
+        };
+
+        const auto chains = static_cast<uint32_t>(std::min<uint64_t>(mChains, mutations));
+        tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, chains, 1 }, [&](const tbb::blocked_range<uint32_t>& range) {
+            for(auto chain = range.begin(); chain != range.end(); ++chain) {
+                MemoryArena arena;
+                RandomEngine eng{ seeding(seedBase | 1ULL << 32 | chain) };
+
+                // the initial state is resampled from the candidates by their targets
+                const auto u = static_cast<double>(sample(eng)) * cdf.back();
+                const auto candidate = static_cast<uint32_t>(std::upper_bound(cdf.cbegin() + 1, cdf.cend(), u) - (cdf.cbegin() + 1));
+                auto current = makeState();
+                auto proposal = makeState();
+                initialize(current, seedBase | std::min(candidate, mBootstrap - 1));
+                evaluate(current, film, bounds, acceleration, lightSampler);
+                // the inner integrator may be not reproducible
+                if(!(current.target > 0.0f))
+                    continue;
+
+                const auto count = mutations / chains + (chain < mutations % chains ? 1 : 0);
+                for(uint64_t idx = 0; idx < count; ++idx) {
+                    mutate(current, proposal, eng, sample(eng) < mLargeStepProbability);
+                    evaluate(proposal, film, bounds, acceleration, lightSampler);
+
+                    // the expected values of both the current and the proposed states are splatted, please refer to Veach's thesis 11.5
+                    const auto accept = proposal.target > 0.0f ? std::fmin(1.0f, proposal.target / current.target) : 0.0f;
+                    if(accept < 1.0f)
+                        splat(current, 1.0f - accept);
+                    if(accept > 0.0f)
+                        splat(proposal, accept);
+                    if(sample(eng) < accept)
+                        std::swap(current, proposal);
+                }
+            }
+        });
+    }
+};
+
+PIPER_REGISTER_VARIANT(MLTIntegrator, Integrator);
+
+PIPER_NAMESPACE_END
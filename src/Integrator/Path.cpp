@@ -23,7 +23,13 @@
 #include <Piper/Render/Integrator.hpp>
 #include <Piper/Render/LightSampler.hpp>
 #include <Piper/Render/Material.hpp>
+#include <Piper/Render/Medium.hpp>
+#include <Piper/Render/PathGuiding.hpp>
+#include <Piper/Render/RadianceCache.hpp>
 #include <Piper/Render/Radiometry.hpp>
+#include <Piper/Render/SpectrumUtil.hpp>
+#include <algorithm>
+#include <limits>
 
 PIPER_NAMESPACE_BEGIN
 
@@ -32,128 +38,954 @@ class PathIntegrator final : public Integrator<Setting> {
     PIPER_IMPORT_SETTINGS();
 
     uint32_t mMaxDepth;
+    bool mWavefront = false;
+    bool mBatchOcclusion = true;
+    bool mSortByMaterial = true;
+    // the secondary rays of each wavefront bounce are binned by the direction and the origin before tracing
+    bool mReorderRays = false;
+    // the participating media are only tracked in the volumetric mode, the shadow rays then pass through the medium boundaries
+    bool mVolumetric = false;
+    static constexpr uint32_t maxBoundaryCrossings = 16;
+    // the direct illumination resamples one of the candidates for the shadow ray if there are more than one candidates
+    uint32_t mDirectCandidates = 1;
+
+    // The directional distributions learned from the previous progressive passes are mixed with the BSDF sampling by one-sample MIS.
+    // NOTICE: the training samples are recorded concurrently by the const estimators, the field is only refined between the passes.
+    mutable std::optional<GuidingField> mGuiding;
+    Float mGuidingBSDFFraction = 0.5f;
+    uint32_t mGuidingResolution = 64;
+    std::optional<uint32_t> mLastPass;
+    // Please refer to "Adjoint-driven Russian Roulette and Splitting in Light Transport Simulation" (Vorba and Krivanek 2016).
+    // The reflected radiance learned by the previous passes centers a weight window on the expected pixel value: the paths below
+    // the window are terminated by Russian roulette and the paths above it are split into several continuations.
+    mutable std::optional<RadianceCache> mRouletteCache;
+    uint32_t mRouletteResolution = 32;
+    uint32_t mMaxSplit = 8;
+    Float mWindowSize = 5.0f;
+    // The preview mode trades bias for speed: the paths end in a cache of the radiance reflected by the diffuse surfaces after their
+    // first non-specular bounce. The cells are learned lazily from the paths which keep tracing, so the cache also bootstraps the
+    // multi-bounce interreflection from itself.
+    mutable std::optional<RadianceCache> mDiffuseCache;
+    uint32_t mDiffuseCacheResolution = 128;
+    Float mCacheTrainingFraction = 0.1f;
+    // the spread angle of the ray cones after the non-specular bounces, the indirect lookups hit the coarse texture levels
+    static constexpr Float roughSpreadAngle = 0.2f;
+
+    struct DirectSample final {
+        Ray shadowRay;
+        Distance distance;
+        Radiance<Spectrum> rad;
+    };
+
+    // the normal on the side of wo, the radiance caches keep the two sides of a surface apart
+    static glm::vec3 sideNormal(const SurfaceHit& info, const Direction<FrameOfReference::World>& wo) noexcept {
+        return (dot(info.shadingNormal.asDirection(), wo) < 0.0f ? -info.shadingNormal : info.shadingNormal).raw();
+    }
+
+    // the medium on the side of dir after crossing the surface, the shapes without an interior medium keep the current one
+    // NOTICE: the media are not nested, the exterior of a medium is vacuum
+    static Handle<Medium> mediumAfter(const SurfaceHit& info, const Direction<FrameOfReference::World>& dir,
+                                      const Handle<Medium> current) noexcept {
+        if(!info.interior.get())
+            return current;
+        return dot(info.shadingNormal.asDirection(), dir) < 0.0f ? info.interior : Handle<Medium>{};
+    }
+
+    // the shadow rays pass through the boundaries of the media and are attenuated by ratio tracking, zero means occluded
+    Float transmittance(const Acceleration& acceleration, const ShadingContext<Setting>& ctx, Ray ray, Float distance,
+                        Handle<Medium> medium, SampleProvider& sampler) const noexcept {
+        Float res = 1.0f;
+        for(uint32_t crossing = 0; crossing < maxBoundaryCrossings; ++crossing) {
+            const auto intersection = acceleration.trace(ray);
+            const auto hit = std::get_if<SurfaceHit>(&intersection);
+            const auto segment = hit ? std::fmin(hit->distance.raw(), distance) : distance;
+            if(medium.get())
+                res *= medium.as<Setting>().transmittance(ctx, ray, Distance::fromRaw(segment), sampler);
+            if(!hit || hit->distance.raw() >= distance || !(res > 0.0f))
+                return res;
+            if(hit->surface.get())
+                return 0.0f;
+
+            medium = mediumAfter(*hit, ray.direction, medium);
+            hit->continueRay(ray, hit->offsetOrigin(false));
+            distance -= hit->distance.raw();
+        }
+        return 0.0f;
+    }
 
-    Radiance<Spectrum> estimateDirect(const LightSampler& lightSampler, SampleProvider& sampler, const ShadingContext<Setting>& ctx,
-                                      const SurfaceHit& info, const Acceleration& acceleration,
-                                      const Direction<FrameOfReference::World>& wo, const BSDF<Setting>& bsdf) const noexcept {
+    static glm::vec3 toOutput(const Spectrum& x, const Wavelength& sampledWavelength) noexcept {
+        if constexpr(spectrumType<Spectrum>() == SpectrumType::Mono)
+            return glm::vec3{ luminance(x, sampledWavelength) };
+        else
+            return toRGB(x, sampledWavelength).raw();
+    }
+
+    // the shading point passed to the light sampler, the area lights hit later are weighted with the same one
+    static std::pair<Point<FrameOfReference::World>, Normal<FrameOfReference::World>>
+    lightSamplingPoint(const SurfaceHit& info, const Direction<FrameOfReference::World>& wo, const BSDF<Setting>& bsdf) noexcept {
         auto hit = info.hit;
         if(match(bsdf.part(), BxDFPart::Reflection) && !match(bsdf.part(), BxDFPart::Transmission))
             hit = info.offsetOrigin(true);
         else if(!match(bsdf.part(), BxDFPart::Reflection) && match(bsdf.part(), BxDFPart::Transmission))
             hit = info.offsetOrigin(false);
 
-        const auto [selectedLight, weight] = lightSampler.sample(sampler);
+        // the lights below the surface can be skipped only if the BSDF does not transmit light
+        auto normal = Normal<FrameOfReference::World>::fromRaw(glm::zero<glm::vec3>());
+        if(!match(bsdf.part(), BxDFPart::Transmission))
+            normal = dot(info.shadingNormal.asDirection(), wo) < 0.0f ? -info.shadingNormal : info.shadingNormal;
+        return { hit, normal };
+    }
+
+    [[nodiscard]] const DirectionalQuadTree* guideOf(const SurfaceHit& info, const BSDF<Setting>& bsdf) const noexcept {
+        if(!mGuiding || match(bsdf.part(), BxDFPart::Specular))
+            return nullptr;
+        return mGuiding->find(info.hit.raw());
+    }
+
+    // the pdf of the mixture of the BSDF sampling and the guided sampling
+    [[nodiscard]] InversePdf<PdfType::BSDF> mixGuidingInversePdf(const InversePdf<PdfType::BSDF> bsdfInversePdf,
+                                                                 const DirectionalQuadTree* guide,
+                                                                 const Direction<FrameOfReference::World>& wi) const noexcept {
+        if(!guide)
+            return bsdfInversePdf;
+        const auto bsdfPdf = bsdfInversePdf.valid() ? rcp(bsdfInversePdf.raw()) : 0.0f;
+        const auto guidePdf = guide->pdf(directionToCylindrical(wi.raw())) / fourPi;
+        return InversePdf<PdfType::BSDF>::fromPdf(mGuidingBSDFFraction * bsdfPdf + (1.0f - mGuidingBSDFFraction) * guidePdf);
+    }
+
+    [[nodiscard]] InversePdf<PdfType::BSDF> scatteringInversePdf(const BSDF<Setting>& bsdf, const DirectionalQuadTree* guide,
+                                                                 const Direction<FrameOfReference::World>& wo,
+                                                                 const Direction<FrameOfReference::World>& wi) const noexcept {
+        return mixGuidingInversePdf(bsdf.pdf(wo, wi), guide, wi);
+    }
+
+    BSDFSampleResult<Setting, FrameOfReference::World> sampleScattering(const BSDF<Setting>& bsdf, const DirectionalQuadTree* guide,
+                                                                        SampleProvider& sampler, const SurfaceHit& info,
+                                                                        const Direction<FrameOfReference::World>& wo) const noexcept {
+        if(!guide)
+            return bsdf.sample(sampler, wo);
+
+        auto res = BSDFSampleResult<Setting, FrameOfReference::World>::invalid();
+        if(sampler.sample() < mGuidingBSDFFraction) {
+            res = bsdf.sample(sampler, wo);
+            if(!res.valid())
+                return res;
+        } else {
+            const auto [p, pdf] = guide->sample(sampler.sampleVec2());
+            if(!(pdf > 0.0f))
+                return res;
+            const auto wi = Direction<FrameOfReference::World>::fromRaw(cylindricalToDirection(p));
+            const auto sameSide = dot(info.shadingNormal.asDirection(), wo) * dot(info.shadingNormal.asDirection(), wi) > 0.0f;
+            res = { wi, importanceSampled<PdfType::BSDF>(bsdf.evaluate(wo, wi)), InversePdf<PdfType::BSDF>::identity(),
+                    (sameSide ? BxDFPart::Reflection : BxDFPart::Transmission) | BxDFPart::Glossy };
+        }
+        res.inversePdf = scatteringInversePdf(bsdf, guide, wo, res.wi);
+        return res;
+    }
+
+    // Please refer to "Hero Wavelength Spectral Sampling" (Wilkie et al. 2014). The BSDFs depending on the hero wavelength (e.g., the
+    // dispersive dielectrics) are evaluated again with each of the other wavelengths as the hero, so the other wavelengths keep their
+    // own values instead of being terminated. The contributions are weighted by the power heuristic over the hero wavelengths with
+    // the ratios of the path pdfs to the pdf of the sampled hero wavelength, which are all ones until a dispersive bounce.
+    using HeroBSDFs = std::pmr::vector<BSDF<Setting>>;
+
+    // the k-th BSDF is evaluated with the (k + 1)-th wavelength as the hero
+    static HeroBSDFs evaluateHeroBSDFs(const Material<Setting>& material, const SurfaceHit& info, const Wavelength& sampledWavelength,
+                                       const BSDF<Setting>& bsdf) {
+        HeroBSDFs res{ context().scopedAllocator };
+        if constexpr(isSampledSpectrum<Spectrum>) {
+            if(!bsdf.keepOneWavelength())
+                return res;
+            res.reserve(Spectrum::nSamples - 1);
+            const auto& wavelengths = sampledWavelength.raw();
+            for(int32_t k = 1; k < Spectrum::nSamples; ++k) {
+                auto rotated = wavelengths;
+                for(int32_t idx = 0; idx < Spectrum::nSamples; ++idx)
+                    rotated[idx] = wavelengths[(idx + k) % Spectrum::nSamples];
+                res.push_back(material.evaluate(Wavelength::fromRaw(rotated), info));
+            }
+        }
+        return res;
+    }
+
+    // replaces the values of the other wavelengths by the hero components of their own BSDFs
+    static Rational<Spectrum> heroValue(const Rational<Spectrum>& f, const HeroBSDFs& heroBSDFs,
+                                        const Direction<FrameOfReference::World>& wo,
+                                        const Direction<FrameOfReference::World>& wi) noexcept {
+        if constexpr(isSampledSpectrum<Spectrum>) {
+            if(heroBSDFs.empty())
+                return f;
+            auto vec = f.raw().raw();
+            for(int32_t k = 1; k < Spectrum::nSamples; ++k)
+                vec[k] = heroBSDFs[k - 1].evaluate(wo, wi).raw().raw()[0];
+            return Rational<Spectrum>::fromRaw(Spectrum::fromRaw(vec));
+        } else
+            return f;
+    }
+
+    static Float squaredSum(const Spectrum& ratios) noexcept {
+        if constexpr(isSampledSpectrum<Spectrum>) {
+            Float res = 0.0f;
+            for(int32_t idx = 0; idx < Spectrum::nSamples; ++idx)
+                res += sqr(ratios.raw()[idx]);
+            return res;
+        } else
+            return 1.0f;
+    }
+
+    // the weight of the paths without a competing technique at the last vertex
+    static Float heroWeight(const Spectrum& ratios) noexcept {
+        if constexpr(isSampledSpectrum<Spectrum>)
+            return static_cast<Float>(Spectrum::nSamples) / squaredSum(ratios);
+        else
+            return 1.0f;
+    }
+
+    // Resampled importance sampling with a streaming weighted reservoir, please refer to "Spatiotemporal reservoir resampling for
+    // real-time ray tracing with dynamic direct lighting" (Bitterli et al. 2020). The candidates are weighted by the unoccluded
+    // contribution and only the selected one is traced.
+    std::optional<DirectSample> sampleDirectResampled(const LightSampler& lightSampler, SampleProvider& sampler,
+                                                      const ShadingContext<Setting>& ctx, const SurfaceHit& info,
+                                                      const Direction<FrameOfReference::World>& wo, const BSDF<Setting>& bsdf,
+                                                      const HeroBSDFs& heroBSDFs, const Spectrum& heroRatios) const noexcept {
+        const auto [hit, normal] = lightSamplingPoint(info, wo, bsdf);
+        std::optional<DirectSample> selected;
+        Float selectedTarget = 0.0f;
+        Float weightSum = 0.0f;
+
+        for(uint32_t idx = 0; idx < mDirectCandidates; ++idx) {
+            const auto [selectedLight, lightWeight] = lightSampler.sample(sampler, hit, normal);
+            if(!lightWeight.valid())
+                return std::nullopt;
+            const auto sampledLight = selectedLight.as<Setting>().sampleLi(ctx, hit, sampler);
+            if(!sampledLight.valid()) {
+                // keep the number of the consumed dimensions stable
+                static_cast<void>(sampler.sample());
+                continue;
+            }
+
+            const auto wi = sampledLight.dir;
+            const auto f = heroValue(bsdf.evaluate(wo, wi), heroBSDFs, wo, wi) * absDot(info.shadingNormal, wi);
+            const auto contribution = Radiance<Spectrum>::fromRaw((sampledLight.rad * f).raw());
+            const auto target = maxComponentValue(contribution.raw());
+            const auto weight = target * (lightWeight * sampledLight.inversePdf).raw();
+            if(!(weight > 0.0f) || !std::isfinite(weight)) {
+                static_cast<void>(sampler.sample());
+                continue;
+            }
+
+            weightSum += weight;
+            if(sampler.sample() * weightSum < weight) {
+                selected = DirectSample{ info.spawnRay(hit, wi), sampledLight.distance, contribution };
+                selectedTarget = target;
+            }
+        }
+
+        if(!selected)
+            return std::nullopt;
+        selected->rad = selected->rad * (weightSum / (static_cast<Float>(mDirectCandidates) * selectedTarget) * heroWeight(heroRatios));
+        return selected;
+    }
+
+    // the unoccluded direct illumination and its shadow ray
+    std::optional<DirectSample> sampleDirect(const LightSampler& lightSampler, SampleProvider& sampler, const ShadingContext<Setting>& ctx,
+                                             const SurfaceHit& info, const Direction<FrameOfReference::World>& wo,
+                                             const BSDF<Setting>& bsdf, const DirectionalQuadTree* guide, const HeroBSDFs& heroBSDFs,
+                                             const Spectrum& heroRatios) const noexcept {
+        if(mDirectCandidates > 1)
+            return sampleDirectResampled(lightSampler, sampler, ctx, info, wo, bsdf, heroBSDFs, heroRatios);
+
+        const auto [hit, normal] = lightSamplingPoint(info, wo, bsdf);
+        const auto [selectedLight, weight] = lightSampler.sample(sampler, hit, normal);
+        if(!weight.valid())
+            return std::nullopt;
         const auto sampledLight = selectedLight.as<Setting>().sampleLi(ctx, hit, sampler);
         if(!sampledLight.valid())
-            return Radiance<Spectrum>::zero();
+            return std::nullopt;
 
         // for(auto& x : acceleration.occlusions()) {}
 
         const auto wi = sampledLight.dir;
+        const auto shadowRay = info.spawnRay(hit, wi);
 
-        if(acceleration.occluded(Ray{ hit, wi, ctx.t }, sampledLight.distance))
-            return Radiance<Spectrum>::zero();
-
-        const auto f = bsdf.evaluate(wo, wi) * absDot(info.shadingNormal, wi);
+        const auto cosThetaI = absDot(info.shadingNormal, wi);
         const auto inverseLightPdf = weight * sampledLight.inversePdf;
 
         // only sample BSDF
-        if(match(selectedLight.as<Setting>().attributes(), LightAttributes::Delta))
-            return sampledLight.rad * f * inverseLightPdf;
+        if(match(selectedLight.as<Setting>().attributes(), LightAttributes::Delta)) {
+            const auto f = heroValue(bsdf.evaluate(wo, wi), heroBSDFs, wo, wi) * cosThetaI;
+            return DirectSample{ shadowRay, sampledLight.distance, sampledLight.rad * f * (inverseLightPdf * heroWeight(heroRatios)) };
+        }
         // MIS
-        const auto bsdfPdf = bsdf.pdf(wo, wi);
-        const auto mixedWeight = powerHeuristic(inverseLightPdf, bsdfPdf);
-        return sampledLight.rad * f * (mixedWeight * inverseLightPdf);
-    }
-
-    template <typename T>
-    auto processResult(const T& val, bool& keepOneWavelength, const bool newKeepOneWavelength) const noexcept {
-        if constexpr(std::is_same_v<SampledSpectrum, Spectrum>) {
-            if(keepOneWavelength || !newKeepOneWavelength)
-                return val;
-            keepOneWavelength = true;
-            auto vec = glm::zero<SampledSpectrum::VecType>();
-            vec[0] = val.raw().raw()[0] * 4.0f;
-            return T::fromRaw(SampledSpectrum::fromRaw(vec));
-        } else {
-            return val;
+        const auto [bsdfValue, bsdfInversePdf] = bsdf.evaluateWithPdf(wo, wi);
+        const auto f = heroValue(bsdfValue, heroBSDFs, wo, wi) * cosThetaI;
+        const auto bsdfPdf = mixGuidingInversePdf(bsdfInversePdf, guide, wi);
+        const auto mixedWeight = [&] {
+            if constexpr(isSampledSpectrum<Spectrum>) {
+                // the BSDF sampling with each wavelength as the hero competes with the light sampling
+                Float sum = 0.0f;
+                for(int32_t k = 0; k < Spectrum::nSamples; ++k) {
+                    const auto inverseBSDFPdf =
+                        k == 0 || heroBSDFs.empty() ? bsdfPdf : mixGuidingInversePdf(heroBSDFs[k - 1].pdf(wo, wi), guide, wi);
+                    const auto ratio = inverseBSDFPdf.valid() ? inverseLightPdf.raw() / inverseBSDFPdf.raw() : 0.0f;
+                    sum += sqr(heroRatios.raw()[k]) * (1.0f + sqr(ratio));
+                }
+                return static_cast<Float>(Spectrum::nSamples) / sum;
+            } else
+                return powerHeuristic(inverseLightPdf, bsdfPdf).raw();
+        }();
+        return DirectSample{ shadowRay, sampledLight.distance, sampledLight.rad * f * (inverseLightPdf * mixedWeight) };
+    }
+
+    // the shadow rays of the wavefront mode are deferred and resolved in bulk
+    struct ShadowQuery final {
+        uint32_t pathIdx;
+        Ray shadowRay;
+        Distance distance;
+        Radiance<Spectrum> contribution;
+        // the guiding vertices recorded after the query are patched, since the contribution was collected before their bounce
+        uint32_t guidingVertexCount;
+    };
+    using ShadowQueue = std::pmr::vector<ShadowQuery>;
+
+    // NOTICE: the incident radiance is estimated by the max component, the spectral distribution is not learned
+    struct GuidingVertex final {
+        glm::vec3 position;
+        glm::vec3 direction;
+        Float throughput;  // the max component of the path throughput after the bounce
+        Float collected;   // the contributions collected before the bounce
+        Float inversePdf;
+    };
+
+    // the vertices for learning the reflected radiance, the count is zero for the vertices inherited by a branch of a split path
+    struct RouletteVertex final {
+        glm::vec3 position;
+        glm::vec3 normal;
+        Float throughput;  // the max component of the path throughput before the bounce
+        Float collected;   // the contributions collected before the bounce
+        Float count;
+    };
+
+    // the vertices for learning the diffuse radiance cache, the radiance is estimated per channel in the output space
+    struct CacheVertex final {
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec3 throughput;  // the path throughput before the bounce
+        glm::vec3 collected;   // the contributions collected before the bounce
+        Float count;
+    };
+
+    struct PathState final {
+        Ray ray;
+        Radiance<Spectrum> result;
+        Rational<Spectrum> beta;
+        Wavelength sampledWavelength;
+        Spectrum weight;
+        uint32_t depth;
+        Float etaScale;
+        // the ratios of the path pdfs with each wavelength as the hero to the pdf of the sampled hero, after and before the last bounce
+        Spectrum heroRatios;
+        Spectrum lastHeroRatios;
+        // the light sampling point of the previous bounce, the inverse pdf is invalid after the specular bounces and for the camera rays
+        Point<FrameOfReference::World> lastHit;
+        Normal<FrameOfReference::World> lastNormal;
+        InversePdf<PdfType::BSDF> lastInversePdf;
+        // the sum of the max components of the contributions and the vertices for training the guiding field
+        Float collected;
+        std::pmr::vector<GuidingVertex> guidingVertices;
+        // the max component of the expected pixel value, zero if it is unknown
+        Float pixelEstimate;
+        std::pmr::vector<RouletteVertex> rouletteVertices;
+        std::pmr::vector<CacheVertex> cacheVertices;
+        Handle<Medium> medium;  // null in vacuum
+
+        void accumulate(const Radiance<Spectrum>& contribution) noexcept {
+            result += contribution;
+            collected += maxComponentValue(contribution.raw());
+        }
+
+        // the branches of a split path share the history, but collect their own contributions
+        [[nodiscard]] PathState branch() const {
+            PathState res{ ray,
+                           Radiance<Spectrum>::zero(),
+                           beta,
+                           sampledWavelength,
+                           weight,
+                           depth,
+                           etaScale,
+                           heroRatios,
+                           lastHeroRatios,
+                           lastHit,
+                           lastNormal,
+                           lastInversePdf,
+                           collected,
+                           std::pmr::vector<GuidingVertex>{ guidingVertices, guidingVertices.get_allocator() },
+                           pixelEstimate,
+                           std::pmr::vector<RouletteVertex>{ rouletteVertices, rouletteVertices.get_allocator() },
+                           std::pmr::vector<CacheVertex>{ cacheVertices, cacheVertices.get_allocator() },
+                           medium };
+            for(auto& vertex : res.rouletteVertices)
+                vertex.count = 0.0f;
+            for(auto& vertex : res.cacheVertices)
+                vertex.count = 0.0f;
+            return res;
         }
+    };
+
+    // The emission found by the BSDF sampling is weighted against the next-event estimation. The resampled next-event estimation
+    // has no tractable pdf, so it takes over all lights it can sample instead of being weighted by MIS.
+    Float emissionWeight(const LightSampler& lightSampler, const PathState& state, const LightBase& light,
+                         const InversePdf<PdfType::Light> inverseLightPdf) const noexcept {
+        if(!state.lastInversePdf.valid() || !inverseLightPdf.valid())
+            return heroWeight(state.heroRatios);
+        const auto inversePdf = lightSampler.inversePdf(&light, state.lastHit, state.lastNormal) * inverseLightPdf;
+        if(!inversePdf.valid())
+            return heroWeight(state.heroRatios);
+        if(mDirectCandidates > 1)
+            return 0.0f;
+        if constexpr(isSampledSpectrum<Spectrum>) {
+            // the light sampling with each wavelength as the hero is done before the last bounce
+            const auto ratio = sqr(state.lastInversePdf.raw() / inversePdf.raw());
+            return static_cast<Float>(Spectrum::nSamples) /
+                (squaredSum(state.heroRatios) + ratio * squaredSum(state.lastHeroRatios));
+        } else
+            return 1.0f - powerHeuristic(inversePdf, state.lastInversePdf).raw();
     }
 
-public:
-    explicit PathIntegrator(const Ref<ConfigNode>& node) : mMaxDepth{ node->get("MaxDepth"sv)->as<uint32_t>() } {}
-    void preprocess() const noexcept override {}
-    void estimate(const Ray& rayInit, const Intersection& intersectionInit, const Acceleration& acceleration,
-                  const LightSampler& lightSampler, SampleProvider& sampler, Float* output) const noexcept override {
-        Ray ray = rayInit;
-        Intersection intersection = intersectionInit;
+    PathState initPath(const Ray& ray, const Float wavelengthSample) const noexcept {
+        const auto [sampledWavelength, weight] = sampleWavelength<Wavelength, Spectrum>(wavelengthSample);
+        const auto allocator = context().scopedAllocator;
+        return PathState{ ray,
+                          Radiance<Spectrum>::zero(),
+                          Rational<Spectrum>::identity(),
+                          sampledWavelength,
+                          weight,
+                          0,
+                          1.0f,
+                          identity<Spectrum>(),
+                          identity<Spectrum>(),
+                          ray.origin,
+                          Normal<FrameOfReference::World>::fromRaw(glm::zero<glm::vec3>()),
+                          InversePdf<PdfType::BSDF>::invalid(),
+                          0.0f,
+                          std::pmr::vector<GuidingVertex>{ allocator },
+                          0.0f,
+                          std::pmr::vector<RouletteVertex>{ allocator },
+                          std::pmr::vector<CacheVertex>{ allocator },
+                          Handle<Medium>{} };
+    }
 
-        Radiance<Spectrum> result = Radiance<Spectrum>::zero();
-        Rational<Spectrum> beta = Rational<Spectrum>::identity();
+    // Applies the weight window to the throughput and returns the number of the continuations, zero terminates the path.
+    // The center of the window is the throughput which makes the expected contribution equal to the pixel value.
+    uint32_t weightWindow(Rational<Spectrum>& beta, const Float center, const uint32_t maxSplit, SampleProvider& sampler) const noexcept {
+        const auto weight = maxComponentValue(beta.raw());
+        const auto lower = 2.0f * center / (1.0f + mWindowSize);
+        if(weight < lower) {
+            const auto survival = weight / center;
+            if(sampler.sample() >= survival)
+                return 0;
+            beta /= survival;
+            return 1;
+        }
+        if(weight > mWindowSize * lower && maxSplit > 1) {
+            const auto count = std::min(maxSplit, static_cast<uint32_t>(std::ceil(weight / center)));
+            beta /= static_cast<Float>(count);
+            return count;
+        }
+        return 1;
+    }
+
+    // samples the next direction, the classic Russian roulette is skipped if the weight window has been applied
+    bool scatter(PathState& state, const SurfaceHit& info, const BSDF<Setting>& bsdf, const HeroBSDFs& heroBSDFs,
+                 const DirectionalQuadTree* guide, const Direction<FrameOfReference::World>& wo, SampleProvider& sampler,
+                 const bool windowed) const noexcept {
+        auto& [ray, result, beta, sampledWavelength, weight, depth, etaScale, heroRatios, lastHeroRatios, lastHit, lastNormal,
+               lastInversePdf, collected, guidingVertices, pixelEstimate, rouletteVertices, cacheVertices, medium] = state;
+
+        // Spawn new ray
+        const auto sampledBSDF = sampleScattering(bsdf, guide, sampler, info, wo);
+        if(!sampledBSDF.valid())
+            return false;
+
+        if(match(sampledBSDF.part, BxDFPart::Transmission))
+            etaScale *= sqr(sampledBSDF.eta);
+
+        const auto f = heroValue(sampledBSDF.f, heroBSDFs, wo, sampledBSDF.wi);
+        beta = beta * (f * (sampledBSDF.inversePdf * absDot(info.shadingNormal, sampledBSDF.wi)));
+
+        lastHeroRatios = heroRatios;
+        if constexpr(isSampledSpectrum<Spectrum>) {
+            // the delta directions of the hero are never sampled by the other wavelengths
+            if(!heroBSDFs.empty()) {
+                auto ratios = heroRatios.raw();
+                for(int32_t k = 1; k < Spectrum::nSamples; ++k) {
+                    const auto inversePdf = mixGuidingInversePdf(heroBSDFs[k - 1].pdf(wo, sampledBSDF.wi), guide, sampledBSDF.wi);
+                    ratios[k] *= inversePdf.valid() ? sampledBSDF.inversePdf.raw() / inversePdf.raw() : 0.0f;
+                }
+                heroRatios = Spectrum::fromRaw(ratios);
+            }
+        }
 
-        // TODO: sampling wavelength by outer integrator
-        const auto [sampledWavelength, weight] = sampleWavelength<Wavelength, Spectrum>(sampler);
-        ShadingContext<Setting> ctx{ ray.t, sampledWavelength };
+        // Russian roulette
+        const auto rrBeta = maxComponentValue(beta.raw()) * etaScale;
+        if(!windowed && rrBeta < 0.95f && depth > 1) {
+            const auto q = 1.0f - rrBeta;
+            if(sampler.sample() < q)
+                return false;
+            beta /= 1.0f - q;
+        }
 
-        uint32_t depth = 0;
-        Float etaScale = 1;
-        // ReSharper disable once CppTooWideScope
-        bool keepOneWavelength = false;
+        if(hasNonSpecular(bsdf.part()) && !match(sampledBSDF.part, BxDFPart::Specular)) {
+            std::tie(lastHit, lastNormal) = lightSamplingPoint(info, wo, bsdf);
+            lastInversePdf = sampledBSDF.inversePdf;
+        } else
+            lastInversePdf = InversePdf<PdfType::BSDF>::invalid();
+
+        if(mGuiding && !match(bsdf.part(), BxDFPart::Specular))
+            guidingVertices.push_back(GuidingVertex{ info.hit.raw(), sampledBSDF.wi.raw(), maxComponentValue(beta.raw()), collected,
+                                                     sampledBSDF.inversePdf.raw() });
+
+        if(mVolumetric)
+            medium = mediumAfter(info, sampledBSDF.wi, medium);
+        info.continueRay(ray, info.offsetOrigin(match(sampledBSDF.part, BxDFPart::Reflection)));
+        ray.direction = sampledBSDF.wi;
+        // a cheap approximation of the ray differentials: the specular bounces keep the spread, the others widen it
+        ray.coneWidth = info.coneWidth;
+        if(!match(sampledBSDF.part, BxDFPart::Specular))
+            ray.coneSpread = std::fmax(ray.coneSpread, roughSpreadAngle);
+        return true;
+    }
 
-        while(true) {
-            if(intersection.index() == 0) {
-                for(auto light : lightSampler.infiniteLights())
-                    result += beta * light.as<Setting>().evalLe(ctx, ray);
-                break;
+    // the next-event estimation with the phase function is weighted against the phase sampling by MIS
+    bool scatterInMedium(PathState& state, const MediumInteraction<Setting>& collision, const Acceleration& acceleration,
+                         const LightSampler& lightSampler, SampleProvider& sampler) const noexcept {
+        auto& [ray, result, beta, sampledWavelength, weight, depth, etaScale, heroRatios, lastHeroRatios, lastHit, lastNormal,
+               lastInversePdf, collected, guidingVertices, pixelEstimate, rouletteVertices, cacheVertices, medium] = state;
+        const ShadingContext<Setting> ctx{ ray.t, sampledWavelength };
+        const auto wo = -ray.direction.raw();
+        const auto normal = Normal<FrameOfReference::World>::fromRaw(glm::zero<glm::vec3>());
+        beta = beta * collision.albedo;
+
+        const auto [selectedLight, lightWeight] = lightSampler.sample(sampler, collision.pos, normal);
+        if(lightWeight.valid()) {
+            const auto& light = selectedLight.as<Setting>();
+            if(const auto sampledLight = light.sampleLi(ctx, collision.pos, sampler); sampledLight.valid()) {
+                const auto phase = henyeyGreenstein(glm::dot(wo, sampledLight.dir.raw()), collision.g);
+                const auto inverseLightPdf = lightWeight * sampledLight.inversePdf;
+                // the phase function does not depend on the hero wavelength, so only the path before the collision is weighted
+                const auto misWeight = heroWeight(heroRatios) *
+                    (match(light.attributes(), LightAttributes::Delta) ?
+                         1.0f :
+                         powerHeuristic(inverseLightPdf, InversePdf<PdfType::BSDF>::fromPdf(phase)).raw());
+                const auto tr = transmittance(acceleration, ctx, Ray{ collision.pos, sampledLight.dir, ray.t }, sampledLight.distance.raw(),
+                                              medium, sampler);
+                if(tr > 0.0f)
+                    state.accumulate(beta * (sampledLight.rad * ((phase * misWeight * tr) * inverseLightPdf)));
             }
+        }
 
-            const auto& info = std::get<SurfaceHit>(intersection);
-            // TODO: area light
+        if(depth++ == mMaxDepth)
+            return false;
 
-            const auto& material = info.surface.as<Setting>();
-            const auto bsdf = material.evaluate(sampledWavelength, info);
+        // the phase function is sampled exactly, so the throughput is unchanged
+        const auto wi = sampleHenyeyGreenstein(wo, collision.g, sampler.sampleVec2());
+        const auto rrBeta = maxComponentValue(beta.raw()) * etaScale;
+        if(rrBeta < 0.95f && depth > 1) {
+            if(sampler.sample() >= rrBeta)
+                return false;
+            beta /= rrBeta;
+        }
 
-            const auto wo = -ray.direction;
-            // compute direct illumination using MIS
-            if(hasNonSpecular(bsdf.part()))
-                result += processResult(beta * estimateDirect(lightSampler, sampler, ctx, info, acceleration, wo, bsdf), keepOneWavelength,
-                                        bsdf.keepOneWavelength());
+        lastHit = collision.pos;
+        lastNormal = normal;
+        lastHeroRatios = heroRatios;
+        lastInversePdf = InversePdf<PdfType::BSDF>::fromPdf(henyeyGreenstein(glm::dot(wo, wi), collision.g));
+        ray.origin = collision.pos;
+        ray.lodInstance = Ray::noInstance;
+        ray.direction = Direction<FrameOfReference::World>::fromRaw(wi);
+        ray.coneSpread = std::fmax(ray.coneSpread, roughSpreadAngle);
+        return true;
+    }
 
-            if(depth++ == mMaxDepth)
-                break;
+    // returns false if the path is terminated
+    bool extendPath(PathState& state, const Intersection& intersection, const Acceleration& acceleration,
+                    const LightSampler& lightSampler, SampleProvider& sampler, ShadowQueue* shadowQueue = nullptr,
+                    const uint32_t pathIdx = 0, std::pmr::vector<PathState>* branches = nullptr) const noexcept {
+        auto& [ray, result, beta, sampledWavelength, weight, depth, etaScale, heroRatios, lastHeroRatios, lastHit, lastNormal,
+               lastInversePdf, collected, guidingVertices, pixelEstimate, rouletteVertices, cacheVertices, medium] = state;
+        const ShadingContext<Setting> ctx{ ray.t, sampledWavelength };
+
+        // the collisions in the current medium come before the surface
+        if(medium.get()) {
+            const auto distance = intersection.index() == 0 ? Distance::fromRaw(std::numeric_limits<Float>::infinity()) :
+                                                              std::get<SurfaceHit>(intersection).distance;
+            if(const auto collision = medium.as<Setting>().sample(ctx, ray, distance, sampler))
+                return scatterInMedium(state, *collision, acceleration, lightSampler, sampler);
+        }
 
-            // Spawn new ray
-            const auto sampledBSDF = bsdf.sample(sampler, wo);
-            if(!sampledBSDF.valid())
-                break;
+        if(intersection.index() == 0) {
+            for(auto light : lightSampler.infiniteLights()) {
+                const auto& typedLight = light.as<Setting>();
+                const auto inverseLightPdf = lastInversePdf.valid() ? typedLight.inversePdfLi(ctx, ray.direction) :
+                                                                      InversePdf<PdfType::Light>::invalid();
+                state.accumulate(beta * typedLight.evalLe(ctx, ray) *
+                                 emissionWeight(lightSampler, state, light.getBase<LightBase>(), inverseLightPdf));
+            }
+            return false;
+        }
 
-            if(match(sampledBSDF.part, BxDFPart::Transmission))
-                etaScale *= sqr(sampledBSDF.eta);
+        const auto& info = std::get<SurfaceHit>(intersection);
+        // the boundaries of the media are index-matched, the path passes through them without a bounce
+        if(!info.surface.get()) {
+            if(mVolumetric)
+                medium = mediumAfter(info, ray.direction, medium);
+            info.continueRay(ray, info.offsetOrigin(false));
+            return true;
+        }
+
+        if(info.areaLight.get()) {
+            const auto& light = info.areaLight.as<Setting>();
+            const auto inverseLightPdf =
+                lastInversePdf.valid() ? light.inversePdfL(ctx, intersection, ray) : InversePdf<PdfType::Light>::invalid();
+            state.accumulate(beta * light.evalL(ctx, intersection) *
+                             emissionWeight(lightSampler, state, info.areaLight.getBase<LightBase>(), inverseLightPdf));
+        }
 
-            beta = beta *
-                processResult(sampledBSDF.f * (sampledBSDF.inversePdf * absDot(info.shadingNormal, sampledBSDF.wi)), keepOneWavelength,
-                              bsdf.keepOneWavelength());
+        const auto& material = info.surface.as<Setting>();
+        const auto bsdf = material.evaluate(sampledWavelength, info);
+        const auto heroBSDFs = evaluateHeroBSDFs(material, info, sampledWavelength, bsdf);
+
+        const auto wo = -ray.direction;
+        const auto guide = guideOf(info, bsdf);
+
+        // the valid inverse pdf of the last bounce means that the path arrives by a non-specular bounce
+        if(mDiffuseCache && hasNonSpecular(bsdf.part()) && lastInversePdf.valid()) {
+            const auto normal = sideNormal(info, wo);
+            if(const auto cached = mDiffuseCache->find(info.hit.raw(), normal); cached && sampler.sample() >= mCacheTrainingFraction) {
+                state.accumulate(beta *
+                                 Radiance<Spectrum>::fromRaw(spectrumCast<Spectrum>(RGBSpectrum::fromRaw(*cached), sampledWavelength)) *
+                                 heroWeight(heroRatios));
+                return false;
+            }
+            cacheVertices.push_back(CacheVertex{ info.hit.raw(), normal, toOutput(beta.raw() * weight, sampledWavelength),
+                                                 toOutput(result.raw() * weight, sampledWavelength), 1.0f });
+        }
+
+        // the reflected radiance is everything collected after the emission of this vertex
+        std::optional<Float> reflected;
+        if(mRouletteCache && hasNonSpecular(bsdf.part())) {
+            const auto normal = sideNormal(info, wo);
+            const auto throughput = maxComponentValue(beta.raw());
+            if(const auto learned = mRouletteCache->find(info.hit.raw(), normal); learned && learned->x > 0.0f) {
+                reflected = learned->x;
+                if(!(pixelEstimate > 0.0f))
+                    pixelEstimate = collected + throughput * *reflected;
+            }
+            rouletteVertices.push_back(RouletteVertex{ info.hit.raw(), normal, throughput, collected, 1.0f });
+        }
 
-            // Russian roulette
-            const auto rrBeta = maxComponentValue(beta.raw()) * etaScale;
-            if(rrBeta < 0.95f && depth > 1) {
-                const auto q = 1.0f - rrBeta;
-                if(sampler.sample() < q)
-                    break;
-                beta /= 1.0f - q;
+        // compute direct illumination using MIS
+        if(hasNonSpecular(bsdf.part())) {
+            const auto direct = sampleDirect(lightSampler, sampler, ctx, info, wo, bsdf, guide, heroBSDFs, heroRatios);
+            const auto contribution = beta * (direct ? direct->rad : Radiance<Spectrum>::zero());
+            if(direct) {
+                if(shadowQueue)
+                    shadowQueue->push_back(ShadowQuery{ pathIdx, direct->shadowRay, direct->distance, contribution,
+                                                        static_cast<uint32_t>(guidingVertices.size()) });
+                else if(mVolumetric) {
+                    const auto tr = transmittance(acceleration, ctx, direct->shadowRay, direct->distance.raw(),
+                                                  mediumAfter(info, direct->shadowRay.direction, medium), sampler);
+                    if(tr > 0.0f)
+                        state.accumulate(contribution * tr);
+                } else if(!acceleration.occluded(direct->shadowRay, direct->distance))
+                    state.accumulate(contribution);
             }
+        }
+
+        if(depth++ == mMaxDepth)
+            return false;
+
+        uint32_t continuations = 1;
+        const auto windowed = reflected && pixelEstimate > 0.0f;
+        if(windowed) {
+            continuations = weightWindow(beta, pixelEstimate / *reflected, branches ? mMaxSplit : 1, sampler);
+            if(!continuations)
+                return false;
+        }
 
-            ray.origin = info.offsetOrigin(match(sampledBSDF.part, BxDFPart::Reflection));
-            ray.direction = sampledBSDF.wi;
-            intersection = acceleration.trace(ray);
+        for(uint32_t k = 1; k < continuations; ++k) {
+            auto branch = state.branch();
+            if(scatter(branch, info, bsdf, heroBSDFs, guide, wo, sampler, windowed))
+                branches->push_back(std::move(branch));
         }
+        return scatter(state, info, bsdf, heroBSDFs, guide, wo, sampler, windowed);
+    }
 
-        Histogram<StatsType::TraceDepth>::count(depth);
+    // records the learned quantities of a finished path or branch
+    void recordPath(const PathState& state) const noexcept {
+        Histogram<StatsType::TraceDepth>::count(state.depth);
+
+        // the radiance arriving at each vertex is the contribution collected after it divided by the throughput
+        for(const auto& vertex : state.guidingVertices)
+            if(vertex.throughput > 0.0f)
+                mGuiding->record(vertex.position, vertex.direction,
+                                 (state.collected - vertex.collected) / vertex.throughput * vertex.inversePdf);
+        for(const auto& vertex : state.rouletteVertices)
+            if(vertex.throughput > 0.0f)
+                mRouletteCache->record(vertex.position, vertex.normal,
+                                       glm::vec3{ (state.collected - vertex.collected) / vertex.throughput }, vertex.count);
+
+        if(state.cacheVertices.empty())
+            return;
+        const auto collected = toOutput(state.result.raw() * state.weight, state.sampledWavelength);
+        for(const auto& vertex : state.cacheVertices) {
+            // the channels without throughput carry no information
+            const auto inverseThroughput =
+                glm::mix(glm::vec3{ 0.0f }, 1.0f / vertex.throughput, glm::greaterThan(vertex.throughput, glm::vec3{ 0.0f }));
+            mDiffuseCache->record(vertex.position, vertex.normal, glm::max(inverseThroughput * (collected - vertex.collected), 0.0f),
+                                  vertex.count);
+        }
+    }
+
+    void finishPath(const PathState& state, Float* output) const noexcept {
+        recordPath(state);
 
         if constexpr(spectrumType<Spectrum>() == SpectrumType::Mono)
-            *output = luminance(result.raw() * weight, sampledWavelength);
+            *output = luminance(state.result.raw() * state.weight, state.sampledWavelength);
         else
-            *reinterpret_cast<RGBSpectrum*>(output) = toRGB(result.raw() * weight, sampledWavelength);
+            *reinterpret_cast<RGBSpectrum*>(output) = toRGB(state.result.raw() * state.weight, state.sampledWavelength);
+    }
+
+public:
+    explicit PathIntegrator(const Ref<ConfigNode>& node) : mMaxDepth{ node->get("MaxDepth"sv)->as<uint32_t>() } {
+        if(const auto ptr = node->tryGet("Wavefront"sv))
+            mWavefront = (*ptr)->as<bool>();
+        if(const auto ptr = node->tryGet("BatchOcclusion"sv))
+            mBatchOcclusion = (*ptr)->as<bool>();
+        if(const auto ptr = node->tryGet("SortByMaterial"sv))
+            mSortByMaterial = (*ptr)->as<bool>();
+        if(const auto ptr = node->tryGet("ReorderRays"sv))
+            mReorderRays = (*ptr)->as<bool>();
+        if(const auto ptr = node->tryGet("Volumetric"sv))
+            mVolumetric = (*ptr)->as<bool>();
+        if(const auto ptr = node->tryGet("DirectCandidates"sv))
+            mDirectCandidates = std::max(1U, (*ptr)->as<uint32_t>());
+
+        if(const auto ptr = node->tryGet("Guiding"sv)) {
+            const auto& config = (*ptr)->as<Ref<ConfigNode>>();
+            uint32_t capacity = 1 << 18, maxDepth = 20;
+            Float threshold = 0.01f;
+            if(const auto val = config->tryGet("BSDFSamplingFraction"sv))
+                mGuidingBSDFFraction = std::clamp((*val)->as<Float>(), 0.0f, 1.0f);
+            if(const auto val = config->tryGet("SpatialResolution"sv))
+                mGuidingResolution = std::max(1U, (*val)->as<uint32_t>());
+            if(const auto val = config->tryGet("Capacity"sv))
+                capacity = (*val)->as<uint32_t>();
+            if(const auto val = config->tryGet("Threshold"sv))
+                threshold = (*val)->as<Float>();
+            if(const auto val = config->tryGet("MaxDepth"sv))
+                maxDepth = std::max(1U, (*val)->as<uint32_t>());
+            mGuiding.emplace(capacity, threshold, maxDepth);
+        }
+
+        if(const auto ptr = node->tryGet("RouletteAndSplitting"sv)) {
+            const auto& config = (*ptr)->as<Ref<ConfigNode>>();
+            uint32_t capacity = 1 << 18;
+            if(const auto val = config->tryGet("SpatialResolution"sv))
+                mRouletteResolution = std::max(1U, (*val)->as<uint32_t>());
+            if(const auto val = config->tryGet("MaxSplit"sv))
+                mMaxSplit = std::max(1U, (*val)->as<uint32_t>());
+            if(const auto val = config->tryGet("WindowSize"sv))
+                mWindowSize = std::fmax(1.0f, (*val)->as<Float>());
+            if(const auto val = config->tryGet("Capacity"sv))
+                capacity = (*val)->as<uint32_t>();
+            mRouletteCache.emplace(capacity);
+        }
+
+        if(const auto ptr = node->tryGet("DiffuseCache"sv)) {
+            const auto& config = (*ptr)->as<Ref<ConfigNode>>();
+            uint32_t capacity = 1 << 20;
+            if(const auto val = config->tryGet("SpatialResolution"sv))
+                mDiffuseCacheResolution = std::max(1U, (*val)->as<uint32_t>());
+            if(const auto val = config->tryGet("TrainingFraction"sv))
+                mCacheTrainingFraction = std::clamp((*val)->as<Float>(), 0.0f, 1.0f);
+            if(const auto val = config->tryGet("Capacity"sv))
+                capacity = (*val)->as<uint32_t>();
+            mDiffuseCache.emplace(capacity);
+        }
+    }
+    void preprocess() const noexcept override {}
+    [[nodiscard]] bool deterministic() const noexcept override {
+        return !mGuiding && !mRouletteCache && !mDiffuseCache;
+    }
+    void beginPass(const uint32_t passIdx, const Acceleration& acceleration, const LightSampler& lightSampler) noexcept override {
+        // a new frame starts when the pass index does not increase
+        const auto newFrame = !mLastPass || passIdx <= *mLastPass;
+        const auto sceneSize = std::fmax(2.0f * acceleration.radius(), epsilon);
+        mLastPass = passIdx;
+
+        if(mGuiding) {
+            if(newFrame)
+                mGuiding->reset(sceneSize / static_cast<Float>(mGuidingResolution));
+            else
+                mGuiding->refine();
+        }
+        if(mRouletteCache) {
+            if(newFrame)
+                mRouletteCache->reset(sceneSize / static_cast<Float>(mRouletteResolution));
+            else
+                mRouletteCache->update();
+        }
+        if(mDiffuseCache) {
+            if(newFrame)
+                mDiffuseCache->reset(sceneSize / static_cast<Float>(mDiffuseCacheResolution));
+            else
+                mDiffuseCache->update();
+        }
+    }
+    void estimate(const Ray& ray, const Intersection& intersectionInit, const Acceleration& acceleration,
+                  const LightSampler& lightSampler, SampleProvider& sampler, const Float wavelengthSample,
+                  Float* output) const noexcept override {
+        auto state = initPath(ray, wavelengthSample);
+        Intersection intersection = intersectionInit;
+        std::pmr::vector<PathState> branches{ context().scopedAllocator };
+
+        while(extendPath(state, intersection, acceleration, lightSampler, sampler, nullptr, 0, &branches))
+            intersection = acceleration.trace(state.ray);
+
+        // the split branches are traced depth-first and merged into the pixel
+        while(!branches.empty()) {
+            auto branch = std::move(branches.back());
+            branches.pop_back();
+            intersection = acceleration.trace(branch.ray);
+            while(extendPath(branch, intersection, acceleration, lightSampler, sampler, nullptr, 0, &branches))
+                intersection = acceleration.trace(branch.ray);
+            recordPath(branch);
+            state.result += branch.result;
+        }
+
+        finishPath(state, output);
+    }
+
+    void estimateBatch(const RayStream& rayStream, const std::pmr::vector<Intersection>& intersections, const Acceleration& acceleration,
+                       const LightSampler& lightSampler, const std::pmr::vector<SampleProvider*>& samplers,
+                       const std::pmr::vector<Float>& wavelengthSamples, Float* output) const noexcept override {
+        if(!mWavefront) {
+            IntegratorBase::estimateBatch(rayStream, intersections, acceleration, lightSampler, samplers, wavelengthSamples, output);
+            return;
+        }
+
+        // wavefront mode: all live paths are extended by one bounce, then the next bounce is traced as a single ray stream
+        const auto size = static_cast<uint32_t>(rayStream.size());
+        std::pmr::vector<PathState> paths{ context().scopedAllocator };
+        paths.reserve(size);
+        std::pmr::vector<uint32_t> livePaths{ context().scopedAllocator };
+        livePaths.reserve(size);
+
+        ShadowQueue shadowQueue{ context().scopedAllocator };
+        // the shadow rays through the media are resolved one by one
+        const auto queue = mBatchOcclusion && !mVolumetric ? &shadowQueue : nullptr;
+        RayStream shadowRays{ context().scopedAllocator };
+        std::pmr::vector<Distance> distances{ context().scopedAllocator };
+
+        const auto resolveShadowRays = [&] {
+            if(shadowQueue.empty())
+                return;
+
+            shadowRays.clear();
+            distances.clear();
+            for(const auto& query : shadowQueue) {
+                shadowRays.push_back(query.shadowRay);
+                distances.push_back(query.distance);
+            }
+
+            const auto occluded = acceleration.occluded(shadowRays, distances);
+            for(uint32_t k = 0; k < shadowQueue.size(); ++k) {
+                if(occluded[k])
+                    continue;
+                const auto& query = shadowQueue[k];
+                auto& path = paths[query.pathIdx];
+                path.accumulate(query.contribution);
+                const auto value = maxComponentValue(query.contribution.raw());
+                for(auto idx = query.guidingVertexCount; idx < path.guidingVertices.size(); ++idx)
+                    path.guidingVertices[idx].collected += value;
+            }
+            shadowQueue.clear();
+        };
+
+        // the hits are shaded in bins of the same material, so each bin runs the same material code and touches the same textures
+        // the escaped rays are binned together at the front
+        std::pmr::vector<std::pair<uintptr_t, uint32_t>> shadingOrder{ context().scopedAllocator };
+        shadingOrder.reserve(size);
+        const auto binByMaterial = [&](const std::pmr::vector<Intersection>& hits) {
+            shadingOrder.clear();
+            for(uint32_t k = 0; k < hits.size(); ++k) {
+                const auto key =
+                    hits[k].index() == 0 ? uintptr_t{ 0 } : reinterpret_cast<uintptr_t>(std::get<SurfaceHit>(hits[k]).surface.get());
+                shadingOrder.emplace_back(key, k);
+            }
+            if(mSortByMaterial)
+                std::sort(shadingOrder.begin(), shadingOrder.end());
+        };
+
+        // the branches of the split paths are appended to the live paths, and merged into the pixels of their owners at the end
+        std::pmr::vector<uint32_t> owners{ context().scopedAllocator };
+        owners.reserve(size);
+        std::pmr::vector<PathState> branches{ context().scopedAllocator };
+        const auto adoptBranches = [&](const uint32_t owner, std::pmr::vector<uint32_t>& live) {
+            for(auto& branch : branches) {
+                live.push_back(static_cast<uint32_t>(paths.size()));
+                paths.push_back(std::move(branch));
+                owners.push_back(owner);
+            }
+            branches.clear();
+        };
+
+        for(uint32_t idx = 0; idx < size; ++idx) {
+            paths.push_back(initPath(rayStream[idx], wavelengthSamples[idx]));
+            owners.push_back(idx);
+        }
+
+        binByMaterial(intersections);
+        for(const auto& [key, idx] : shadingOrder) {
+            if(extendPath(paths[idx], intersections[idx], acceleration, lightSampler, *samplers[idx], queue, idx, &branches))
+                livePaths.push_back(idx);
+            adoptBranches(idx, livePaths);
+        }
+        resolveShadowRays();
+
+        RayStream stream{ context().scopedAllocator };
+        stream.reserve(livePaths.size());
+        std::pmr::vector<uint32_t> nextLivePaths{ context().scopedAllocator };
+        nextLivePaths.reserve(livePaths.size());
+
+        while(!livePaths.empty()) {
+            stream.clear();
+            for(const auto idx : livePaths)
+                stream.push_back(paths[idx].ray);
+
+            const auto hits = mReorderRays ? traceReordered(acceleration, stream) : acceleration.trace(stream);
+            binByMaterial(hits);
+
+            // compact terminated paths, the survivors keep the material order for the next bounce
+            nextLivePaths.clear();
+            for(const auto& [key, k] : shadingOrder) {
+                const auto idx = livePaths[k];
+                const auto owner = owners[idx];
+                if(extendPath(paths[idx], hits[k], acceleration, lightSampler, *samplers[owner], queue, idx, &branches))
+                    nextLivePaths.push_back(idx);
+                adoptBranches(owner, nextLivePaths);
+            }
+            std::swap(livePaths, nextLivePaths);
+            resolveShadowRays();
+        }
+
+        for(auto idx = size; idx < paths.size(); ++idx) {
+            recordPath(paths[idx]);
+            paths[owners[idx]].result += paths[idx].result;
+        }
+        for(uint32_t idx = 0; idx < size; ++idx)
+            finishPath(paths[idx], output + idx * 3);
     }
 };
 
@@ -0,0 +1,275 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/Stats.hpp>
+#include <Piper/Render/Acceleration.hpp>
+#include <Piper/Render/Integrator.hpp>
+#include <Piper/Render/Light.hpp>
+#include <Piper/Render/LightSampler.hpp>
+#include <Piper/Render/Material.hpp>
+#include <Piper/Render/Radiometry.hpp>
+#include <Piper/Render/SpatialHashGrid.hpp>
+#include <tbb/parallel_for.h>
+
+PIPER_NAMESPACE_BEGIN
+
+// Please refer to "Stochastic Progressive Photon Mapping" (Hachisuka and Jensen 2009) and pbrt-v3 section 16.2.
+// The photons of each progressive pass are traced in parallel from the light sampler and indexed by a spatial hash grid, then the
+// camera paths gather the photons at the first non-specular vertex. The direct lighting of that vertex is estimated by light sampling.
+// NOTICE: the renderer averages the passes with the same weight, so the radius of all visible points is reduced by the global sequence
+// of "Progressive Photon Mapping: A Probabilistic Approach" (Knaus and Zwicker 2011) instead of the per pixel statistics.
+template <typename Setting>
+class SPPMIntegrator final : public Integrator<Setting> {
+    PIPER_IMPORT_SETTINGS();
+
+    static constexpr uint32_t photonChunkSize = 4096;
+    static constexpr Float defaultRadiusScale = 0.002f;
+
+    // the output space of the photons, the wavelengths of the photons differ from the ones of the camera paths
+    struct Photon final {
+        glm::vec3 wi;  // towards the previous vertex
+        glm::vec3 flux;
+    };
+
+    uint32_t mMaxDepth;
+    uint32_t mPhotonsPerPass = 1 << 20;
+    std::optional<Float> mInitialRadius;
+    Float mAlpha = 2.0f / 3.0f;
+
+    SpatialHashGrid mGrid;
+    std::pmr::vector<Photon> mPhotons{ context().globalAllocator };
+    std::optional<uint32_t> mLastPass;
+    uint64_t mFrameIdx = 0;
+    Point<FrameOfReference::World> mSceneCenter = Point<FrameOfReference::World>::fromRaw(glm::zero<glm::vec3>());
+    Float mSceneRadius = 0.0f;
+
+    static Normal<FrameOfReference::World> zeroNormal() noexcept {
+        return Normal<FrameOfReference::World>::fromRaw(glm::zero<glm::vec3>());
+    }
+
+    static glm::vec3 toOutput(const Spectrum& x, const Wavelength& sampledWavelength) noexcept {
+        if constexpr(spectrumType<Spectrum>() == SpectrumType::Mono)
+            return glm::vec3{ luminance(x, sampledWavelength) };
+        else
+            return toRGB(x, sampledWavelength).raw();
+    }
+
+    void tracePhoton(const Acceleration& acceleration, const LightSampler& lightSampler, SampleProvider& sampler,
+                     std::pmr::vector<glm::vec3>& positions, std::pmr::vector<Photon>& photons) const noexcept {
+        const auto [sampledWavelength, weight] = sampleWavelength<Wavelength, Spectrum>(sampler);
+        const ShadingContext<Setting> ctx{ sampler.sample(), sampledWavelength };
+
+        const auto origin = Point<FrameOfReference::World>::fromRaw(glm::zero<glm::vec3>());
+        const auto [light, choice] = lightSampler.sample(sampler, origin, zeroNormal());
+        if(!choice.valid())
+            return;
+        // the lights without a position (e.g., the environment lights and the directional lights) emit from the scene bounds
+        const auto& typedLight = light.as<Setting>();
+        const auto emitted = light.getBase<LightBase>().position() ? typedLight.sampleLe(ctx, sampler) :
+                                                                     typedLight.sampleLeFromScene(ctx, mSceneCenter, mSceneRadius, sampler);
+        if(!emitted.valid() || !emitted.inversePdfDir.valid())
+            return;
+
+        const auto inversePdfPos = emitted.inversePdfPos.valid() ? emitted.inversePdfPos.raw() : 1.0f;
+        auto beta = Rational<Spectrum>::fromRaw(emitted.intensity.raw()) * (choice.raw() * inversePdfPos * emitted.inversePdfDir.raw());
+        auto ray = emitted.ray;
+
+        for(uint32_t depth = 0; depth < mMaxDepth; ++depth) {
+            const auto intersection = passInterfaces(acceleration, ray, acceleration.trace(ray));
+            if(intersection.index() == 0)
+                break;
+
+            const auto& info = std::get<SurfaceHit>(intersection);
+            const auto bsdf = info.surface.as<Setting>().evaluate(sampledWavelength, info);
+            const auto wo = -ray.direction;
+
+            // the first hit is the direct lighting, which is estimated by the camera paths
+            if(depth > 0 && hasNonSpecular(bsdf.part())) {
+                positions.push_back(info.hit.raw());
+                photons.push_back(Photon{ wo.raw(), toOutput(beta.raw() * weight, sampledWavelength) });
+            }
+
+            const auto sampled = bsdf.sample(sampler, wo, TransportMode::Importance);
+            if(!sampled.valid())
+                break;
+
+            const auto prevBeta = maxComponentValue(beta.raw());
+            beta = beta * sampled.f * (sampled.inversePdf * absDot(info.shadingNormal, sampled.wi));
+
+            // Russian roulette by the change of the throughput, so the photons keep similar power
+            const auto survival = std::fmin(1.0f, maxComponentValue(beta.raw()) / prevBeta);
+            if(!(survival > 0.0f) || sampler.sample() >= survival)
+                break;
+            beta /= survival;
+
+            ray = info.spawnRay(info.offsetOrigin(match(sampled.part, BxDFPart::Reflection)), sampled.wi);
+        }
+    }
+
+    void tracePhotons(const uint32_t passIdx, const Acceleration& acceleration, const LightSampler& lightSampler, const Float radius) {
+        const auto chunks = (mPhotonsPerPass + photonChunkSize - 1) / photonChunkSize;
+        std::pmr::vector<std::pmr::vector<glm::vec3>> chunkPositions{ chunks, context().globalAllocator };
+        std::pmr::vector<std::pmr::vector<Photon>> chunkPhotons{ chunks, context().globalAllocator };
+
+        // each chunk owns its output, so no synchronization is required
+        tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, chunks }, [&](const tbb::blocked_range<uint32_t>& range) {
+            for(auto chunk = range.begin(); chunk != range.end(); ++chunk) {
+                MemoryArena arena;
+                const auto begin = chunk * photonChunkSize, end = std::min(begin + photonChunkSize, mPhotonsPerPass);
+                for(auto idx = begin; idx != end; ++idx) {
+                    SampleProvider sampler{ std::pmr::vector<Float>{ context().scopedAllocator },
+                                            (mFrameIdx << 48) ^ (static_cast<uint64_t>(passIdx) << 32) ^ idx };
+                    tracePhoton(acceleration, lightSampler, sampler, chunkPositions[chunk], chunkPhotons[chunk]);
+                }
+            }
+        });
+
+        std::pmr::vector<uint32_t> offsets(chunks + 1, 0U, context().globalAllocator);
+        for(uint32_t chunk = 0; chunk < chunks; ++chunk)
+            offsets[chunk + 1] = offsets[chunk] + static_cast<uint32_t>(chunkPhotons[chunk].size());
+
+        std::pmr::vector<glm::vec3> positions{ offsets.back(), context().globalAllocator };
+        mPhotons.resize(offsets.back());
+        tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, chunks }, [&](const tbb::blocked_range<uint32_t>& range) {
+            for(auto chunk = range.begin(); chunk != range.end(); ++chunk) {
+                std::ranges::copy(chunkPositions[chunk], positions.begin() + offsets[chunk]);
+                std::ranges::copy(chunkPhotons[chunk], mPhotons.begin() + offsets[chunk]);
+            }
+        });
+
+        mGrid.build(positions, radius);
+    }
+
+    [[nodiscard]] Radiance<Spectrum> sampleDirect(const LightSampler& lightSampler, const Acceleration& acceleration,
+                                                  SampleProvider& sampler, const ShadingContext<Setting>& ctx, const SurfaceHit& info,
+                                                  const Direction<FrameOfReference::World>& wo, const BSDF<Setting>& bsdf) const noexcept {
+        const auto [selectedLight, weight] = lightSampler.sample(sampler, info.hit, zeroNormal());
+        if(!weight.valid())
+            return Radiance<Spectrum>::zero();
+        const auto sampledLight = selectedLight.as<Setting>().sampleLi(ctx, info.hit, sampler);
+        if(!sampledLight.valid())
+            return Radiance<Spectrum>::zero();
+
+        const auto wi = sampledLight.dir;
+        const auto f = bsdf.evaluate(wo, wi) * absDot(info.shadingNormal, wi);
+        const auto contribution = sampledLight.rad * f * (weight * sampledLight.inversePdf);
+        if(!(maxComponentValue(contribution.raw()) > 0.0f))
+            return Radiance<Spectrum>::zero();
+
+        const auto shadowRay = info.spawnRay(info.offsetOrigin(dot(wi, info.geometryNormal.asDirection()) > 0.0f), wi);
+        return acceleration.occluded(shadowRay, sampledLight.distance) ? Radiance<Spectrum>::zero() : contribution;
+    }
+
+public:
+    explicit SPPMIntegrator(const Ref<ConfigNode>& node) : mMaxDepth{ node->get("MaxDepth"sv)->as<uint32_t>() } {
+        if(const auto ptr = node->tryGet("PhotonsPerPass"sv))
+            mPhotonsPerPass = std::max(1U, (*ptr)->as<uint32_t>());
+        if(const auto ptr = node->tryGet("InitialRadius"sv))
+            mInitialRadius = (*ptr)->as<Float>();
+        if(const auto ptr = node->tryGet("Alpha"sv))
+            mAlpha = std::clamp((*ptr)->as<Float>(), epsilon, 1.0f);
+    }
+    void preprocess() const noexcept override {}
+    void beginPass(const uint32_t passIdx, const Acceleration& acceleration, const LightSampler& lightSampler) noexcept override {
+        // a new frame starts when the pass index does not increase
+        if(!mLastPass || passIdx <= *mLastPass)
+            ++mFrameIdx;
+        mLastPass = passIdx;
+        mSceneCenter = acceleration.center();
+        mSceneRadius = acceleration.radius();
+
+        // r_{i+1}^2 = r_i^2 * (i + alpha) / (i + 1), evaluated from the first pass so the resumed renders get the same sequence
+        auto radius2 = sqr(mInitialRadius ? *mInitialRadius : defaultRadiusScale * mSceneRadius);
+        for(uint32_t idx = 1; idx <= passIdx; ++idx)
+            radius2 *= (static_cast<Float>(idx) + mAlpha) / static_cast<Float>(idx + 1);
+
+        tracePhotons(passIdx, acceleration, lightSampler, std::fmax(std::sqrt(radius2), epsilon));
+    }
+
+    void estimate(const Ray& rayInit, const Intersection& intersectionInit, const Acceleration& acceleration,
+                  const LightSampler& lightSampler, SampleProvider& sampler, const Float wavelengthSample,
+                  Float* output) const noexcept override {
+        const auto [sampledWavelength, weight] = sampleWavelength<Wavelength, Spectrum>(wavelengthSample);
+
+        auto ray = rayInit;
+        auto intersection = passInterfaces(acceleration, ray, intersectionInit);
+        auto beta = Rational<Spectrum>::identity();
+        auto direct = Radiance<Spectrum>::zero();
+        glm::vec3 indirect{ 0.0f };
+        // the emission is only visible through the specular chains, the other paths are covered by the light sampling
+        auto specularChain = true;
+        uint32_t depth = 0;
+
+        while(true) {
+            const ShadingContext<Setting> ctx{ ray.t, sampledWavelength };
+            if(intersection.index() == 0) {
+                if(specularChain)
+                    for(auto light : lightSampler.infiniteLights())
+                        direct += beta * light.as<Setting>().evalLe(ctx, ray);
+                break;
+            }
+
+            const auto& info = std::get<SurfaceHit>(intersection);
+            if(specularChain && info.areaLight.get())
+                direct += beta * info.areaLight.as<Setting>().evalL(ctx, intersection);
+
+            const auto bsdf = info.surface.as<Setting>().evaluate(sampledWavelength, info);
+            const auto wo = -ray.direction;
+
+            // the visible point
+            if(hasNonSpecular(bsdf.part())) {
+                direct += beta * sampleDirect(lightSampler, acceleration, sampler, ctx, info, wo, bsdf);
+
+                glm::vec3 flux{ 0.0f };
+                mGrid.query(info.hit.raw(), [&](const uint32_t idx, const glm::vec3&) {
+                    const auto& photon = mPhotons[idx];
+                    const auto f = bsdf.evaluate(wo, Direction<FrameOfReference::World>::fromRaw(photon.wi));
+                    flux += toOutput((beta * f).raw() * weight, sampledWavelength) * photon.flux;
+                });
+                indirect += flux / (pi * sqr(mGrid.radius()) * static_cast<Float>(mPhotonsPerPass));
+                break;
+            }
+
+            if(depth++ == mMaxDepth)
+                break;
+
+            const auto sampled = bsdf.sample(sampler, wo);
+            if(!sampled.valid())
+                break;
+            beta = beta * sampled.f * (sampled.inversePdf * absDot(info.shadingNormal, sampled.wi));
+            specularChain = match(sampled.part, BxDFPart::Specular);
+
+            ray = info.spawnRay(info.offsetOrigin(match(sampled.part, BxDFPart::Reflection)), sampled.wi);
+            intersection = passInterfaces(acceleration, ray, acceleration.trace(ray));
+        }
+
+        Histogram<StatsType::TraceDepth>::count(depth);
+
+        const auto res = toOutput(direct.raw() * weight, sampledWavelength) + indirect;
+        if constexpr(spectrumType<Spectrum>() == SpectrumType::Mono)
+            *output = res.x;
+        else
+            *reinterpret_cast<RGBSpectrum*>(output) = RGBSpectrum::fromRaw(res);
+    }
+};
+
+PIPER_REGISTER_VARIANT(SPPMIntegrator, Integrator);
+
+PIPER_NAMESPACE_END
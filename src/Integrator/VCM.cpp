@@ -0,0 +1,491 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/Stats.hpp>
+#include <Piper/Render/Acceleration.hpp>
+#include <Piper/Render/Integrator.hpp>
+#include <Piper/Render/Light.hpp>
+#include <Piper/Render/LightSampler.hpp>
+#include <Piper/Render/Material.hpp>
+#include <Piper/Render/Radiometry.hpp>
+#include <Piper/Render/SpatialHashGrid.hpp>
+#include <tbb/parallel_for.h>
+
+PIPER_NAMESPACE_BEGIN
+
+// Please refer to "Light Transport Simulation with Vertex Connection and Merging" (Georgiev et al. 2012) and its technical report.
+// The MIS weights are evaluated by the recursive quantities dVCM, dVC and dVM of SmallVCM with the balance heuristic.
+// The light subpaths of each progressive pass are traced in parallel before the pass and stored as a structure of arrays, which is
+// indexed by a spatial hash grid for the merging. All camera samples of the pass reuse the same light vertices: each camera subpath
+// is connected to one light subpath selected uniformly and merged with the light vertices of all light subpaths.
+// NOTICE: the light tracing strategies need splatting into the film, so they are excluded from the estimator and the MIS weights.
+// The lights without a position start the light subpaths from a disk covering the scene bounds, and their direct pdfs are measured
+// in the solid angle as SmallVCM does for the background lights.
+template <typename Setting>
+class VCMIntegrator final : public Integrator<Setting> {
+    PIPER_IMPORT_SETTINGS();
+
+    static constexpr uint32_t pathChunkSize = 1024;
+    static constexpr Float defaultRadiusScale = 0.002f;
+
+    struct SubpathState final {
+        Float dVCM = 0.0f;
+        Float dVC = 0.0f;
+        Float dVM = 0.0f;
+    };
+
+    // the merging only touches the hot arrays, the surface hits are used to evaluate the BSDFs of the connections
+    // NOTICE: the throughputs are stored in the output space, the wavelengths of the light subpaths differ from the camera subpaths
+    struct LightVertices final {
+        std::pmr::vector<glm::vec3> positions{ context().globalAllocator };
+        std::pmr::vector<glm::vec3> directions{ context().globalAllocator };  // towards the previous vertex
+        std::pmr::vector<glm::vec3> throughputs{ context().globalAllocator };
+        std::pmr::vector<SubpathState> states{ context().globalAllocator };
+        std::pmr::vector<uint32_t> pathLengths{ context().globalAllocator };
+        std::pmr::vector<std::optional<SurfaceHit>> hits{ context().globalAllocator };
+
+        [[nodiscard]] uint32_t size() const noexcept {
+            return static_cast<uint32_t>(positions.size());
+        }
+        void resize(const uint32_t size) {
+            positions.resize(size);
+            directions.resize(size);
+            throughputs.resize(size);
+            states.resize(size);
+            pathLengths.resize(size);
+            hits.resize(size);
+        }
+        void copy(const LightVertices& src, const uint32_t offset) {
+            std::ranges::copy(src.positions, positions.begin() + offset);
+            std::ranges::copy(src.directions, directions.begin() + offset);
+            std::ranges::copy(src.throughputs, throughputs.begin() + offset);
+            std::ranges::copy(src.states, states.begin() + offset);
+            std::ranges::copy(src.pathLengths, pathLengths.begin() + offset);
+            std::ranges::copy(src.hits, hits.begin() + offset);
+        }
+    };
+
+    uint32_t mMaxDepth;
+    uint32_t mLightPaths = 1 << 18;
+    std::optional<Float> mInitialRadius;
+    Float mAlpha = 0.75f;
+
+    LightVertices mVertices;
+    std::pmr::vector<uint32_t> mPathOffsets{ context().globalAllocator };
+    SpatialHashGrid mGrid;
+    Float mVCWeight = 0.0f;
+    Float mVMWeight = 0.0f;
+    Float mVMNormalization = 0.0f;
+    std::optional<uint32_t> mLastPass;
+    uint64_t mFrameIdx = 0;
+    Point<FrameOfReference::World> mSceneCenter = Point<FrameOfReference::World>::fromRaw(glm::zero<glm::vec3>());
+    Float mSceneRadius = 0.0f;
+
+    static Normal<FrameOfReference::World> zeroNormal() noexcept {
+        return Normal<FrameOfReference::World>::fromRaw(glm::zero<glm::vec3>());
+    }
+    static Point<FrameOfReference::World> lightSelectionPoint() noexcept {
+        return Point<FrameOfReference::World>::fromRaw(glm::zero<glm::vec3>());
+    }
+
+    template <PdfType T>
+    static Float pdfValue(const InversePdf<T>& inversePdf) noexcept {
+        return inversePdf.valid() ? rcp(inversePdf.raw()) : 0.0f;
+    }
+
+    static glm::vec3 toOutput(const Spectrum& x, const Wavelength& sampledWavelength) noexcept {
+        if constexpr(spectrumType<Spectrum>() == SpectrumType::Mono)
+            return glm::vec3{ luminance(x, sampledWavelength) };
+        else
+            return toRGB(x, sampledWavelength).raw();
+    }
+
+    [[nodiscard]] uint32_t maxPathLength() const noexcept {
+        return mMaxDepth + 1;
+    }
+
+    // the quantities are divided by the density of generating the hit from the previous vertex
+    // NOTICE: the first hit of the lights without a position is not converted, their direct pdfs are measured in the solid angle
+    static bool reach(SubpathState& state, const SurfaceHit& info, const Direction<FrameOfReference::World>& dir,
+                      const bool finite = true) noexcept {
+        const auto cosTheta = absDot(info.shadingNormal, dir);
+        if(!(cosTheta > 0.0f))
+            return false;
+        if(finite)
+            state.dVCM *= sqr(info.distance.raw());
+        state.dVCM /= cosTheta;
+        state.dVC /= cosTheta;
+        state.dVM /= cosTheta;
+        return true;
+    }
+
+    std::optional<Ray> scatter(SubpathState& state, Rational<Spectrum>& beta, const BSDF<Setting>& bsdf, const SurfaceHit& info,
+                               const Direction<FrameOfReference::World>& wo, SampleProvider& sampler,
+                               const TransportMode mode) const noexcept {
+        const auto sampled = bsdf.sample(sampler, wo, mode);
+        if(!sampled.valid())
+            return std::nullopt;
+
+        const auto cosThetaOut = absDot(info.shadingNormal, sampled.wi);
+        beta = beta * sampled.f * (sampled.inversePdf * cosThetaOut);
+        if(!(maxComponentValue(beta.raw()) > 0.0f))
+            return std::nullopt;
+
+        if(match(sampled.part, BxDFPart::Specular)) {
+            state.dVCM = 0.0f;
+            state.dVC *= cosThetaOut;
+            state.dVM *= cosThetaOut;
+        } else {
+            const auto pdfDir = rcp(sampled.inversePdf.raw());
+            const auto pdfRev = pdfValue(bsdf.pdf(sampled.wi, wo, mode));
+            state.dVC = cosThetaOut / pdfDir * (state.dVC * pdfRev + state.dVCM + mVMWeight);
+            state.dVM = cosThetaOut / pdfDir * (state.dVM * pdfRev + state.dVCM * mVCWeight + 1.0f);
+            state.dVCM = 1.0f / pdfDir;
+        }
+        return info.spawnRay(info.offsetOrigin(match(sampled.part, BxDFPart::Reflection)), sampled.wi);
+    }
+
+    void traceLightPath(const Acceleration& acceleration, const LightSampler& lightSampler, SampleProvider& sampler,
+                        LightVertices& vertices) const noexcept {
+        const auto [sampledWavelength, weight] = sampleWavelength<Wavelength, Spectrum>(sampler);
+        const ShadingContext<Setting> ctx{ sampler.sample(), sampledWavelength };
+
+        const auto [light, choice] = lightSampler.sample(sampler, lightSelectionPoint(), zeroNormal());
+        if(!choice.valid())
+            return;
+        const auto& lightBase = light.getBase<LightBase>();
+        const auto& typedLight = light.as<Setting>();
+        const auto finite = lightBase.position().has_value();
+        const auto emitted =
+            finite ? typedLight.sampleLe(ctx, sampler) : typedLight.sampleLeFromScene(ctx, mSceneCenter, mSceneRadius, sampler);
+        if(!emitted.valid() || !emitted.inversePdfDir.valid())
+            return;
+
+        const auto choicePdf = rcp(choice.raw());
+        const auto pdfPos = emitted.inversePdfPos.valid() ? rcp(emitted.inversePdfPos.raw()) : 1.0f;
+        const auto pdfDir = rcp(emitted.inversePdfDir.raw());
+        const auto directPdf = choicePdf * (finite ? pdfPos : pdfDir);
+        const auto emissionPdf = choicePdf * pdfPos * pdfDir;
+        const auto cosLight = emitted.normal.raw() != glm::zero<glm::vec3>() ? absDot(emitted.normal, emitted.ray.direction) : 1.0f;
+
+        auto beta = Rational<Spectrum>::fromRaw(emitted.intensity.raw()) / emissionPdf;
+        SubpathState state;
+        state.dVCM = directPdf / emissionPdf;
+        state.dVC = match(lightBase.attributes(), LightAttributes::Delta) ? 0.0f : cosLight / emissionPdf;
+        state.dVM = state.dVC * mVCWeight;
+
+        auto ray = emitted.ray;
+        for(uint32_t pathLength = 1;; ++pathLength) {
+            const auto intersection = passInterfaces(acceleration, ray, acceleration.trace(ray));
+            if(intersection.index() == 0)
+                break;
+
+            const auto& info = std::get<SurfaceHit>(intersection);
+            if(!reach(state, info, ray.direction, finite || pathLength > 1))
+                break;
+
+            const auto bsdf = info.surface.as<Setting>().evaluate(sampledWavelength, info);
+            const auto wo = -ray.direction;
+            if(hasNonSpecular(bsdf.part())) {
+                vertices.positions.push_back(info.hit.raw());
+                vertices.directions.push_back(wo.raw());
+                vertices.throughputs.push_back(toOutput(beta.raw() * weight, sampledWavelength));
+                vertices.states.push_back(state);
+                vertices.pathLengths.push_back(pathLength);
+                vertices.hits.push_back(info);
+            }
+
+            // the next vertex cannot be used by any strategy within the max path length
+            if(pathLength + 2 > maxPathLength())
+                break;
+            const auto next = scatter(state, beta, bsdf, info, wo, sampler, TransportMode::Importance);
+            if(!next)
+                break;
+            ray = *next;
+        }
+    }
+
+    void traceLightPaths(const uint32_t passIdx, const Acceleration& acceleration, const LightSampler& lightSampler) {
+        const auto chunks = (mLightPaths + pathChunkSize - 1) / pathChunkSize;
+        std::pmr::vector<LightVertices> chunkVertices{ chunks, context().globalAllocator };
+        std::pmr::vector<uint32_t> pathEnds(mLightPaths, 0U, context().globalAllocator);
+
+        // each chunk owns its output, so no synchronization is required
+        tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, chunks }, [&](const tbb::blocked_range<uint32_t>& range) {
+            for(auto chunk = range.begin(); chunk != range.end(); ++chunk) {
+                MemoryArena arena;
+                const auto begin = chunk * pathChunkSize, end = std::min(begin + pathChunkSize, mLightPaths);
+                for(auto idx = begin; idx != end; ++idx) {
+                    SampleProvider sampler{ std::pmr::vector<Float>{ context().scopedAllocator },
+                                            (mFrameIdx << 48) ^ (static_cast<uint64_t>(passIdx) << 32) ^ idx };
+                    traceLightPath(acceleration, lightSampler, sampler, chunkVertices[chunk]);
+                    pathEnds[idx] = chunkVertices[chunk].size();
+                }
+            }
+        });
+
+        std::pmr::vector<uint32_t> chunkOffsets(chunks + 1, 0U, context().globalAllocator);
+        for(uint32_t chunk = 0; chunk < chunks; ++chunk)
+            chunkOffsets[chunk + 1] = chunkOffsets[chunk] + chunkVertices[chunk].size();
+
+        mVertices.resize(chunkOffsets.back());
+        mPathOffsets.assign(mLightPaths + 1, 0U);
+        tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, chunks }, [&](const tbb::blocked_range<uint32_t>& range) {
+            for(auto chunk = range.begin(); chunk != range.end(); ++chunk) {
+                mVertices.copy(chunkVertices[chunk], chunkOffsets[chunk]);
+                const auto begin = chunk * pathChunkSize, end = std::min(begin + pathChunkSize, mLightPaths);
+                for(auto idx = begin; idx != end; ++idx)
+                    mPathOffsets[idx + 1] = chunkOffsets[chunk] + pathEnds[idx];
+            }
+        });
+    }
+
+    // the camera subpath is connected to a light source
+    [[nodiscard]] Radiance<Spectrum> connectLight(const SubpathState& state, const LightSampler& lightSampler,
+                                                  const Acceleration& acceleration, SampleProvider& sampler,
+                                                  const ShadingContext<Setting>& ctx, const SurfaceHit& info,
+                                                  const Direction<FrameOfReference::World>& wo, const BSDF<Setting>& bsdf) const noexcept {
+        const auto [selected, choice] = lightSampler.sample(sampler, info.hit, zeroNormal());
+        if(!choice.valid())
+            return Radiance<Spectrum>::zero();
+        const auto& lightBase = selected.getBase<LightBase>();
+        const auto& light = selected.as<Setting>();
+        const auto sampledLight = light.sampleLi(ctx, info.hit, sampler);
+        if(!sampledLight.valid())
+            return Radiance<Spectrum>::zero();
+
+        const auto wi = sampledLight.dir;
+        const auto cosToLight = absDot(info.shadingNormal, wi);
+        const auto inverseLightPdf = choice * sampledLight.inversePdf;
+        const auto contribution = sampledLight.rad * (bsdf.evaluate(wo, wi) * cosToLight) * inverseLightPdf;
+        if(!(maxComponentValue(contribution.raw()) > 0.0f))
+            return Radiance<Spectrum>::zero();
+
+        const auto directPdf = rcp(inverseLightPdf.raw());
+        const auto delta = match(lightBase.attributes(), LightAttributes::Delta);
+        const auto wLight = delta ? 0.0f : pdfValue(bsdf.pdf(wo, wi)) / directPdf;
+        const auto normal = sampledLight.normal;
+        const Ray emission{ info.hit + wi * sampledLight.distance, -wi, ctx.t };
+        const auto [inversePdfPos, inversePdfDir] =
+            lightBase.position() ? light.pdfLe(ctx, emission, normal) : light.pdfLeFromScene(ctx, emission, mSceneRadius);
+        const auto emissionPdf = pdfValue(lightSampler.inversePdf(&lightBase, lightSelectionPoint(), zeroNormal())) *
+            (inversePdfPos.valid() ? rcp(inversePdfPos.raw()) : 1.0f) * pdfValue(inversePdfDir);
+        const auto cosAtLight = normal.raw() != glm::zero<glm::vec3>() ? absDot(normal, wi) : 1.0f;
+        const auto wCamera = cosAtLight > 0.0f ?
+            emissionPdf * cosToLight / (directPdf * cosAtLight) * (mVMWeight + state.dVCM + state.dVC * pdfValue(bsdf.pdf(wi, wo))) :
+            0.0f;
+
+        const auto shadowRay = info.spawnRay(info.offsetOrigin(dot(wi, info.geometryNormal.asDirection()) > 0.0f), wi);
+        if(acceleration.occluded(shadowRay, sampledLight.distance))
+            return Radiance<Spectrum>::zero();
+        return contribution * (1.0f / (wLight + 1.0f + wCamera));
+    }
+
+    // the camera subpath hits a light source, the light sampling was performed at prevHit
+    [[nodiscard]] Float emissionWeight(const SubpathState& state, const LightSampler& lightSampler, const LightBase& lightBase,
+                                       const Point<FrameOfReference::World>& prevHit, const Float directPdf,
+                                       const Float emissionPdf) const noexcept {
+        const auto choice = pdfValue(lightSampler.inversePdf(&lightBase, prevHit, zeroNormal()));
+        const auto emissionChoice = pdfValue(lightSampler.inversePdf(&lightBase, lightSelectionPoint(), zeroNormal()));
+        const auto wCamera = choice * directPdf * state.dVCM + emissionChoice * emissionPdf * state.dVC;
+        return 1.0f / (1.0f + wCamera);
+    }
+
+    // the camera subpath is connected to the vertices of a light subpath
+    [[nodiscard]] glm::vec3 connectVertices(const SubpathState& state, const Rational<Spectrum>& beta, const uint32_t pathLength,
+                                            const uint32_t lightPath, const Acceleration& acceleration, const ShadingContext<Setting>& ctx,
+                                            const SurfaceHit& info, const Direction<FrameOfReference::World>& wo,
+                                            const BSDF<Setting>& bsdf, const Float weight) const noexcept {
+        glm::vec3 res{ 0.0f };
+        for(auto idx = mPathOffsets[lightPath]; idx != mPathOffsets[lightPath + 1]; ++idx) {
+            if(mVertices.pathLengths[idx] + 1 + pathLength > maxPathLength())
+                break;
+
+            const auto offset = mVertices.positions[idx] - info.hit.raw();
+            const auto dist2 = glm::dot(offset, offset);
+            if(!(dist2 > 0.0f))
+                continue;
+            const auto dist = std::sqrt(dist2);
+            const auto dir = Direction<FrameOfReference::World>::fromRaw(offset / dist);
+
+            const auto& lightHit = *mVertices.hits[idx];
+            const auto lightWo = Direction<FrameOfReference::World>::fromRaw(mVertices.directions[idx]);
+            const auto lightBSDF = lightHit.surface.as<Setting>().evaluate(ctx.sampledWavelength, lightHit);
+            const auto cosCamera = absDot(info.shadingNormal, dir);
+            const auto cosLight = absDot(lightHit.shadingNormal, dir);
+            const auto f = bsdf.evaluate(wo, dir) * lightBSDF.evaluate(lightWo, -dir, TransportMode::Importance);
+            const auto g = cosCamera * cosLight / dist2;
+            if(!(maxComponentValue(f.raw()) * g > 0.0f))
+                continue;
+
+            const auto& lightState = mVertices.states[idx];
+            const auto cameraPdf = pdfValue(bsdf.pdf(wo, dir)) * cosLight / dist2;
+            const auto lightPdf = pdfValue(lightBSDF.pdf(lightWo, -dir, TransportMode::Importance)) * cosCamera / dist2;
+            const auto lightReversePdf = pdfValue(lightBSDF.pdf(-dir, lightWo, TransportMode::Importance));
+            const auto wLight = cameraPdf * (mVMWeight + lightState.dVCM + lightState.dVC * lightReversePdf);
+            const auto wCamera = lightPdf * (mVMWeight + state.dVCM + state.dVC * pdfValue(bsdf.pdf(dir, wo)));
+
+            const auto shadowRay = info.spawnRay(info.offsetOrigin(dot(dir, info.geometryNormal.asDirection()) > 0.0f), dir);
+            if(acceleration.occluded(shadowRay, Distance::fromRaw(dist * (1.0f - epsilon))))
+                continue;
+            res += toOutput((beta * f).raw() * (weight * g / (wLight + 1.0f + wCamera)), ctx.sampledWavelength) *
+                mVertices.throughputs[idx];
+        }
+        return res;
+    }
+
+    // the camera subpath is merged with the light vertices around the hit
+    [[nodiscard]] glm::vec3 mergeVertices(const SubpathState& state, const Rational<Spectrum>& beta, const uint32_t pathLength,
+                                          const ShadingContext<Setting>& ctx, const SurfaceHit& info,
+                                          const Direction<FrameOfReference::World>& wo, const BSDF<Setting>& bsdf,
+                                          const Float weight) const noexcept {
+        glm::vec3 res{ 0.0f };
+        mGrid.query(info.hit.raw(), [&](const uint32_t idx, const glm::vec3&) {
+            if(mVertices.pathLengths[idx] + pathLength > maxPathLength())
+                return;
+
+            const auto wi = Direction<FrameOfReference::World>::fromRaw(mVertices.directions[idx]);
+            const auto f = bsdf.evaluate(wo, wi);
+            if(!(maxComponentValue(f.raw()) > 0.0f))
+                return;
+
+            const auto& lightState = mVertices.states[idx];
+            const auto wLight = lightState.dVCM * mVCWeight + lightState.dVM * pdfValue(bsdf.pdf(wo, wi));
+            const auto wCamera = state.dVCM * mVCWeight + state.dVM * pdfValue(bsdf.pdf(wi, wo));
+            res += toOutput((beta * f).raw() * (weight / (wLight + 1.0f + wCamera)), ctx.sampledWavelength) * mVertices.throughputs[idx];
+        });
+        return res * mVMNormalization;
+    }
+
+public:
+    explicit VCMIntegrator(const Ref<ConfigNode>& node) : mMaxDepth{ node->get("MaxDepth"sv)->as<uint32_t>() } {
+        if(const auto ptr = node->tryGet("LightPathsPerPass"sv))
+            mLightPaths = std::max(1U, (*ptr)->as<uint32_t>());
+        if(const auto ptr = node->tryGet("InitialRadius"sv))
+            mInitialRadius = (*ptr)->as<Float>();
+        if(const auto ptr = node->tryGet("Alpha"sv))
+            mAlpha = std::clamp((*ptr)->as<Float>(), epsilon, 1.0f);
+    }
+    void preprocess() const noexcept override {}
+    void beginPass(const uint32_t passIdx, const Acceleration& acceleration, const LightSampler& lightSampler) noexcept override {
+        // a new frame starts when the pass index does not increase
+        if(!mLastPass || passIdx <= *mLastPass)
+            ++mFrameIdx;
+        mLastPass = passIdx;
+        mSceneCenter = acceleration.center();
+        mSceneRadius = acceleration.radius();
+
+        // r_i = r_1 * i^((alpha - 1) / 2)
+        const auto initialRadius = mInitialRadius ? *mInitialRadius : defaultRadiusScale * mSceneRadius;
+        const auto radius =
+            std::fmax(initialRadius * std::pow(static_cast<Float>(passIdx + 1), 0.5f * (mAlpha - 1.0f)), epsilon);
+        const auto etaVCM = pi * sqr(radius) * static_cast<Float>(mLightPaths);
+        mVMWeight = etaVCM;
+        mVCWeight = 1.0f / etaVCM;
+        mVMNormalization = 1.0f / etaVCM;
+
+        traceLightPaths(passIdx, acceleration, lightSampler);
+        mGrid.build(mVertices.positions, radius);
+    }
+
+    void estimate(const Ray& rayInit, const Intersection& intersectionInit, const Acceleration& acceleration,
+                  const LightSampler& lightSampler, SampleProvider& sampler, const Float wavelengthSample,
+                  Float* output) const noexcept override {
+        const auto [sampledWavelength, weight] = sampleWavelength<Wavelength, Spectrum>(wavelengthSample);
+        const auto lightPath = sampler.sampleIdx(mLightPaths);
+
+        auto ray = rayInit;
+        auto intersection = passInterfaces(acceleration, rayInit, intersectionInit);
+        auto beta = Rational<Spectrum>::identity();
+        auto direct = Radiance<Spectrum>::zero();
+        glm::vec3 other{ 0.0f };
+        // the light tracing strategies are excluded, so the camera subpath starts with zero quantities
+        SubpathState state;
+        auto prevHit = rayInit.origin;
+        uint32_t pathLength = 1;
+
+        for(;; ++pathLength) {
+            const ShadingContext<Setting> ctx{ ray.t, sampledWavelength };
+            if(intersection.index() == 0) {
+                for(auto light : lightSampler.infiniteLights()) {
+                    const auto& typedLight = light.as<Setting>();
+                    const auto le = typedLight.evalLe(ctx, ray);
+                    auto misWeight = 1.0f;
+                    if(pathLength != 1) {
+                        const auto [inversePdfPos, inversePdfDir] =
+                            typedLight.pdfLeFromScene(ctx, Ray{ ray.origin, -ray.direction, ctx.t }, mSceneRadius);
+                        misWeight = emissionWeight(state, lightSampler, light.getBase<LightBase>(), prevHit, pdfValue(inversePdfDir),
+                                                   pdfValue(inversePdfPos) * pdfValue(inversePdfDir));
+                    }
+                    direct += beta * le * misWeight;
+                }
+                break;
+            }
+
+            const auto& info = std::get<SurfaceHit>(intersection);
+            if(!reach(state, info, ray.direction))
+                break;
+            const auto wo = -ray.direction;
+
+            if(info.areaLight.get()) {
+                const auto& light = info.areaLight.as<Setting>();
+                const auto le = light.evalL(ctx, intersection);
+                auto misWeight = 1.0f;
+                if(pathLength != 1) {
+                    const auto outer = dot(info.geometryNormal, info.shadingNormal) < 0.0f ? -info.geometryNormal : info.geometryNormal;
+                    const auto [inversePdfPos, inversePdfDir] = light.pdfLe(ctx, Ray{ info.hit, wo, ctx.t }, outer);
+                    misWeight = emissionWeight(state, lightSampler, info.areaLight.getBase<LightBase>(), prevHit, pdfValue(inversePdfPos),
+                                               pdfValue(inversePdfPos) * pdfValue(inversePdfDir));
+                }
+                direct += beta * le * misWeight;
+            }
+
+            if(pathLength >= maxPathLength())
+                break;
+
+            const auto bsdf = info.surface.as<Setting>().evaluate(sampledWavelength, info);
+            if(hasNonSpecular(bsdf.part())) {
+                direct += beta * connectLight(state, lightSampler, acceleration, sampler, ctx, info, wo, bsdf);
+                if(!mPathOffsets.empty())
+                    other += connectVertices(state, beta, pathLength, lightPath, acceleration, ctx, info, wo, bsdf, weight);
+                other += mergeVertices(state, beta, pathLength, ctx, info, wo, bsdf, weight);
+            }
+
+            const auto next = scatter(state, beta, bsdf, info, wo, sampler, TransportMode::Radiance);
+            if(!next)
+                break;
+            prevHit = info.hit;
+            ray = *next;
+            intersection = passInterfaces(acceleration, ray, acceleration.trace(ray));
+        }
+
+        Histogram<StatsType::TraceDepth>::count(pathLength - 1);
+
+        const auto res = toOutput(direct.raw() * weight, sampledWavelength) + other;
+        if constexpr(spectrumType<Spectrum>() == SpectrumType::Mono)
+            *output = res.x;
+        else
+            *reinterpret_cast<RGBSpectrum*>(output) = RGBSpectrum::fromRaw(res);
+    }
+};
+
+PIPER_REGISTER_VARIANT(VCMIntegrator, Integrator);
+
+PIPER_NAMESPACE_END
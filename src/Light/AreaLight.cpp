@@ -0,0 +1,272 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Render/BSDF.hpp>
+#include <Piper/Render/Light.hpp>
+#include <Piper/Render/LightSampler.hpp>
+#include <Piper/Render/SamplingUtil.hpp>
+#include <Piper/Render/Shape.hpp>
+#include <Piper/Render/Texture.hpp>
+
+PIPER_NAMESPACE_BEGIN
+
+// The emission of a triangle mesh. The triangles are selected by their area times the luminance of the emission at the centroid,
+// then a point is sampled uniformly on the triangle and the pdf is converted to the solid angle measure.
+// The emitted rays start from a point sampled uniformly over the area, so the position pdf is known without the triangle.
+template <typename Setting>
+class AreaLight final : public Light<Setting> {
+    PIPER_IMPORT_SETTINGS();
+
+    Ref<SpectrumTexture2D<Setting>> mRadiance;
+    Float mScale = 1.0f;
+    bool mTwoSided = false;
+    const Shape* mShape = nullptr;
+    AliasTable mTriangles;
+    AliasTable mAreas;
+    Float mObjectPower = 0.0f;  // the power in the object space
+    Float mObjectArea = 0.0f;
+    // the center of the bounds of the triangles in the object space
+    std::optional<glm::vec3> mObjectCenter;
+    ResolvedTransform mTransform{};
+
+    struct WorldTriangle final {
+        std::array<glm::vec3, 3> positions;
+        glm::vec3 normal;  // the outer side of the face
+        Float area;
+    };
+
+    [[nodiscard]] WorldTriangle worldTriangle(const ShapeTriangle& triangle, const Float t) const noexcept {
+        const auto transform = mTransform(t);
+        WorldTriangle res{};
+        for(uint32_t idx = 0; idx < 3; ++idx)
+            res.positions[idx] = transform.rotation * (transform.scale * triangle.positions[idx]) + transform.translation;
+        const auto cross = glm::cross(res.positions[1] - res.positions[0], res.positions[2] - res.positions[0]);
+        res.area = 0.5f * glm::length(cross);
+        res.normal = res.area > 0.0f ? cross / (2.0f * res.area) : glm::zero<glm::vec3>();
+        // the winding is not reliable, so the vertex normals decide the outer side
+        const auto normalSum = triangle.normals[0] + triangle.normals[1] + triangle.normals[2];
+        const auto vertexNormal = transform.rotation * (normalSum / transform.scale);
+        if(glm::dot(res.normal, vertexNormal) < 0.0f)
+            res.normal = -res.normal;
+        return res;
+    }
+
+    [[nodiscard]] Radiance<Spectrum> radiance(const ShadingContext<Setting>& ctx, const TexCoord texCoord, const uint32_t primitiveIdx,
+                                              const glm::vec2 faceUV) const noexcept {
+        return Radiance<Spectrum>::fromRaw(mRadiance->evaluate({ texCoord, ctx.t, primitiveIdx, 0.0f, faceUV }, ctx.sampledWavelength) *
+                                           mScale);
+    }
+
+    // the area is scaled by the geometric mean of the squared scale factors
+    [[nodiscard]] Float areaScale(const Float t) const noexcept {
+        const auto scale = mTransform(t).scale;
+        return std::cbrt(sqr(scale.x * scale.y * scale.z));
+    }
+
+    [[nodiscard]] Point<FrameOfReference::World> samplePoint(const ShapeTriangle& local, const WorldTriangle& triangle, const glm::vec2 u,
+                                                            TexCoord& texCoord, glm::vec2& faceUV) const noexcept {
+        // uniform sampling of the barycentric coordinates
+        const auto su = std::sqrt(u.x);
+        const auto b0 = 1.0f - su, b1 = u.y * su, b2 = 1.0f - b0 - b1;
+        texCoord = b0 * local.texCoords[0] + b1 * local.texCoords[1] + b2 * local.texCoords[2];
+        faceUV = { b1, b2 };
+        return Point<FrameOfReference::World>::fromRaw(b0 * triangle.positions[0] + b1 * triangle.positions[1] +
+                                                       b2 * triangle.positions[2]);
+    }
+
+    [[nodiscard]] InversePdf<PdfType::Light> inversePdfOf(const uint32_t primitiveIdx, const Float area, const DistanceSquare dist2,
+                                                          const Float absCosTheta) const noexcept {
+        const auto probability = mTriangles.probability(primitiveIdx);
+        if(!(probability > 0.0f) || !(area > 0.0f) || !(absCosTheta > 0.0f))
+            return InversePdf<PdfType::Light>::invalid();
+        return InversePdf<PdfType::Light>::fromRaw(area * absCosTheta / (probability * dist2.raw()));
+    }
+
+public:
+    explicit AreaLight(const Ref<ConfigNode>& node)
+        : mRadiance{ this->template make<SpectrumTexture2D>(node->get("Radiance"sv)->as<Ref<ConfigNode>>()) } {
+        if(const auto ptr = node->tryGet("Scale"sv))
+            mScale = (*ptr)->as<Float>();
+        if(const auto ptr = node->tryGet("TwoSided"sv))
+            mTwoSided = (*ptr)->as<bool>();
+    }
+
+    [[nodiscard]] LightAttributes attributes() const noexcept override {
+        return LightAttributes::Area;
+    }
+
+    void attachShape(const Shape& shape) override {
+        mShape = &shape;
+        const auto count = shape.triangleCount();
+        if(count == 0)
+            fatal("The area light is attached to a shape without triangles");
+
+        std::pmr::vector<Float> weights{ count, context().scopedAllocator };
+        std::pmr::vector<Float> areas{ count, context().scopedAllocator };
+        Float sum = 0.0f;
+        glm::vec3 lower{ std::numeric_limits<Float>::infinity() }, upper{ -std::numeric_limits<Float>::infinity() };
+        for(uint32_t idx = 0; idx < count; ++idx) {
+            const auto [positions, normals, texCoords] = shape.triangle(idx);
+            for(const auto& position : positions) {
+                lower = glm::min(lower, position);
+                upper = glm::max(upper, position);
+            }
+            const auto area = 0.5f * glm::length(glm::cross(positions[1] - positions[0], positions[2] - positions[0]));
+            areas[idx] = area;
+            mObjectArea += area;
+            const auto centroid = (texCoords[0] + texCoords[1] + texCoords[2]) / 3.0f;
+            const auto rgb = mRadiance->estimateRGB({ centroid, 0.0f, idx, 0.0f, glm::vec2{ 1.0f / 3.0f } });
+            const auto lum = luminance(rgb, std::monostate{}) * std::fabs(mScale);
+            weights[idx] = std::isfinite(lum * area) ? std::fmax(lum * area, 0.0f) : 0.0f;
+            sum += weights[idx];
+        }
+        mObjectPower = sum * pi * (mTwoSided ? 2.0f : 1.0f);
+        mObjectCenter = (lower + upper) * 0.5f;
+
+        if(!(mObjectArea > 0.0f))
+            std::fill(areas.begin(), areas.end(), 1.0f);
+        // fallback to the area weighting if the emission is black at all centroids
+        if(!(sum > 0.0f))
+            weights = areas;
+        mTriangles.build(weights);
+        mAreas.build(areas);
+    }
+
+    void updateTransform(const KeyFrames& keyFrames, const TimeInterval timeInterval) override {
+        mTransform = resolveTransform(keyFrames, timeInterval);
+    }
+
+    LightLiSample<Spectrum> sampleLi(const ShadingContext<Setting>& ctx, const Point<FrameOfReference::World>& pos,
+                                     SampleProvider& sampler) const noexcept override {
+        const auto primitiveIdx = mTriangles.sample(sampler.sample());
+        const auto local = mShape->triangle(primitiveIdx);
+        const auto triangle = worldTriangle(local, ctx.t);
+
+        TexCoord texCoord;
+        glm::vec2 faceUV;
+        const auto lightSource = samplePoint(local, triangle, sampler.sampleVec2(), texCoord, faceUV);
+        const auto [dir, dist2] = direction(pos, lightSource);
+        const auto cosTheta = -glm::dot(triangle.normal, dir.raw());
+        if(!mTwoSided && cosTheta <= 0.0f)
+            return LightLiSample<Spectrum>::invalid();
+
+        const auto inversePdf = inversePdfOf(primitiveIdx, triangle.area, dist2, std::fabs(cosTheta));
+        if(!inversePdf.valid())
+            return LightLiSample<Spectrum>::invalid();
+
+        const auto rad = importanceSampled<PdfType::Light | PdfType::LightSampler>(radiance(ctx, texCoord, primitiveIdx, faceUV));
+        // the shadow ray stops right before the light source to avoid hitting the emitter itself
+        return LightLiSample<Spectrum>{ dir, rad, inversePdf, Distance::fromRaw(std::sqrt(dist2.raw()) * (1.0f - epsilon)),
+                                        Normal<FrameOfReference::World>::fromRaw(triangle.normal) };
+    }
+
+    InversePdf<PdfType::Light> inversePdfLi(const ShadingContext<Setting>& ctx,
+                                            const Direction<FrameOfReference::World>& wi) const noexcept override {
+        // the hit point is required, see inversePdfL
+        return InversePdf<PdfType::Light>::invalid();
+    }
+
+    Radiance<Spectrum> evalL(const ShadingContext<Setting>& ctx, const Intersection& intersection) const noexcept override {
+        const auto& hit = std::get<SurfaceHit>(intersection);
+        // the geometry normal faces the viewer while the shading normal faces the outer side
+        if(!mTwoSided && dot(hit.geometryNormal, hit.shadingNormal) <= 0.0f)
+            return Radiance<Spectrum>::zero();
+        return radiance(ctx, hit.texCoord, hit.primitiveIdx, hit.faceUV);
+    }
+
+    InversePdf<PdfType::Light> inversePdfL(const ShadingContext<Setting>& ctx, const Intersection& intersection,
+                                           const Ray& ray) const noexcept override {
+        const auto& hit = std::get<SurfaceHit>(intersection);
+        if(!mTwoSided && dot(hit.geometryNormal, hit.shadingNormal) <= 0.0f)
+            return InversePdf<PdfType::Light>::invalid();
+        const auto triangle = worldTriangle(mShape->triangle(hit.primitiveIdx), ctx.t);
+        return inversePdfOf(hit.primitiveIdx, triangle.area, DistanceSquare::fromRaw(sqr(hit.distance.raw())),
+                            absDot(hit.geometryNormal, ray.direction));
+    }
+
+    // NOTICE: the intensity is the emitted radiance times the cosine, the area measure is carried by the position pdf
+    LightLeSample<Spectrum> sampleLe(const ShadingContext<Setting>& ctx, SampleProvider& sampler) const noexcept override {
+        const auto primitiveIdx = mAreas.sample(sampler.sample());
+        const auto local = mShape->triangle(primitiveIdx);
+        const auto triangle = worldTriangle(local, ctx.t);
+        const auto probability = mAreas.probability(primitiveIdx);
+        if(!(triangle.area > 0.0f) || !(probability > 0.0f))
+            return LightLeSample<Spectrum>::invalid();
+
+        TexCoord texCoord;
+        glm::vec2 faceUV;
+        const auto lightSource = samplePoint(local, triangle, sampler.sampleVec2(), texCoord, faceUV);
+
+        // the two-sided lights select the side first
+        auto u = sampler.sampleVec2();
+        auto normal = triangle.normal;
+        if(mTwoSided) {
+            if(u.x < 0.5f) {
+                u.x *= 2.0f;
+            } else {
+                u.x = (u.x - 0.5f) * 2.0f;
+                normal = -normal;
+            }
+            u.x = std::fmin(u.x, oneMinusEpsilon);
+        }
+        const auto localDir = sampleCosineHemisphere(u);
+        const auto edge = glm::normalize(triangle.positions[1] - triangle.positions[0]);
+        const ShadingFrame frame{ Direction<FrameOfReference::World>::fromRaw(normal), Direction<FrameOfReference::World>::fromRaw(edge) };
+        const auto dir = frame(localDir);
+        const auto cosTheta = localDir.raw().z;
+        const auto inversePdfDir = cosineHemispherePdf(cosTheta);
+        if(!inversePdfDir.valid())
+            return LightLeSample<Spectrum>::invalid();
+
+        const Ray ray{ lightSource + Direction<FrameOfReference::World>::fromRaw(normal) * Distance::fromRaw(epsilon), dir, ctx.t };
+        const auto intensity = Intensity<Spectrum>::fromRaw(radiance(ctx, texCoord, primitiveIdx, faceUV).raw() * cosTheta);
+        return LightLeSample<Spectrum>{ ray, intensity, InversePdf<PdfType::LightPos>::fromRaw(triangle.area / probability),
+                                        InversePdf<PdfType::LightDir>::fromRaw(inversePdfDir.raw() * (mTwoSided ? 2.0f : 1.0f)),
+                                        Normal<FrameOfReference::World>::fromRaw(triangle.normal) };
+    }
+    std::pair<InversePdf<PdfType::LightPos>, InversePdf<PdfType::LightDir>>
+    pdfLe(const ShadingContext<Setting>& ctx, const Ray& ray, const Normal<FrameOfReference::World>& normal) const noexcept override {
+        const auto area = mObjectArea * areaScale(ctx.t);
+        auto cosTheta = dot(normal.asDirection(), ray.direction);
+        if(mTwoSided)
+            cosTheta = std::fabs(cosTheta);
+        const auto inversePdfDir = cosineHemispherePdf(cosTheta);
+        if(!(area > 0.0f) || !inversePdfDir.valid())
+            return { InversePdf<PdfType::LightPos>::invalid(), InversePdf<PdfType::LightDir>::invalid() };
+        return { InversePdf<PdfType::LightPos>::fromRaw(area),
+                 InversePdf<PdfType::LightDir>::fromRaw(inversePdfDir.raw() * (mTwoSided ? 2.0f : 1.0f)) };
+    }
+
+    // the center of the bounds of the shape at the middle of the shutter interval
+    [[nodiscard]] std::optional<Point<FrameOfReference::World>> position() const noexcept override {
+        if(!mObjectCenter)
+            return std::nullopt;
+        const auto transform = mTransform(0.5f);
+        return Point<FrameOfReference::World>::fromRaw(transform.rotation * (transform.scale * *mObjectCenter) + transform.translation);
+    }
+
+    [[nodiscard]] Power<MonoSpectrum> power() const noexcept override {
+        return Intensity<MonoSpectrum>::fromRaw(mObjectPower * areaScale(0.5f)) * SolidAngle::fromRaw(1.0f);
+    }
+};
+
+PIPER_REGISTER_VARIANT(AreaLight, Light);
+
+PIPER_NAMESPACE_END
@@ -65,8 +65,8 @@ public:
     LightLeSample<Spectrum> sampleLe(const ShadingContext<Setting>& ctx, SampleProvider& sampler) const noexcept override {
         return LightLeSample<Spectrum>::invalid();
     }
-    std::pair<InversePdf<PdfType::LightPos>, InversePdf<PdfType::LightDir>> pdfLe(const ShadingContext<Setting>& ctx,
-                                                                                  const Ray& ray) const noexcept override {
+    std::pair<InversePdf<PdfType::LightPos>, InversePdf<PdfType::LightDir>>
+    pdfLe(const ShadingContext<Setting>& ctx, const Ray& ray, const Normal<FrameOfReference::World>& normal) const noexcept override {
         return { InversePdf<PdfType::LightPos>::invalid(), InversePdf<PdfType::LightDir>::invalid() };
     }
 
@@ -0,0 +1,138 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Render/Distribution.hpp>
+#include <Piper/Render/Light.hpp>
+#include <Piper/Render/SamplingUtil.hpp>
+#include <Piper/Render/Texture.hpp>
+#include <tbb/parallel_for.h>
+
+PIPER_NAMESPACE_BEGIN
+
+// the environment map uses the equirectangular mapping of SphericalTexture::dir2TexCoord
+template <typename Setting>
+class EnvLight final : public Light<Setting> {
+    PIPER_IMPORT_SETTINGS();
+
+    Ref<SpectrumTexture2D<Setting>> mTexture;
+    Float mScale = 1.0f;
+    PiecewiseConstant2D mDistribution;
+    Float mRadianceIntegral = 0.0f;  // over the sphere
+    Float mSceneRadius = 0.0f;
+    Distance mSceneDiameter = Distance::undefined();
+    ResolvedTransform mTransform{};
+
+    static Direction<FrameOfReference::Object> texCoord2Dir(const TexCoord texCoord) noexcept {
+        return Direction<FrameOfReference::Object>::fromRaw(equirectangularToDirection(texCoord));
+    }
+
+    static TexCoord dir2TexCoord(const Direction<FrameOfReference::Object>& dir) noexcept {
+        return directionToEquirectangular(dir.raw());
+    }
+
+    [[nodiscard]] static InversePdf<PdfType::Light> inversePdfOf(const TexCoord texCoord, const Float pdf) noexcept {
+        return InversePdf<PdfType::Light>::fromPdf(equirectangularSolidAnglePdf(texCoord, pdf));
+    }
+
+    [[nodiscard]] Radiance<Spectrum> radiance(const ShadingContext<Setting>& ctx, const TexCoord texCoord) const noexcept {
+        return Radiance<Spectrum>::fromRaw(mTexture->evaluate({ texCoord, ctx.t, 0U }, ctx.sampledWavelength) * mScale);
+    }
+
+public:
+    explicit EnvLight(const Ref<ConfigNode>& node)
+        : mTexture{ this->template make<SpectrumTexture2D>(node->get("Texture"sv)->as<Ref<ConfigNode>>()) } {
+        if(const auto ptr = node->tryGet("Scale"sv))
+            mScale = (*ptr)->as<Float>();
+
+        uint32_t width = 1024;
+        if(const auto ptr = node->tryGet("DistributionResolution"sv))
+            width = std::max(2U, (*ptr)->as<uint32_t>());
+        const auto height = std::max(1U, width / 2);
+
+        // the luminance of the texels weighted by the area of the rows on the sphere
+        std::pmr::vector<Float> function{ static_cast<size_t>(width) * height, context().globalAllocator };
+        tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, height }, [&](const tbb::blocked_range<uint32_t>& range) {
+            for(auto y = range.begin(); y != range.end(); ++y) {
+                const auto v = (static_cast<Float>(y) + 0.5f) / static_cast<Float>(height);
+                const auto sinPolar = std::sin(v * pi);
+                for(uint32_t x = 0; x < width; ++x) {
+                    const TexCoord texCoord{ (static_cast<Float>(x) + 0.5f) / static_cast<Float>(width), v };
+                    // the footprint prefilters the texels covered by a cell of the distribution
+                    const auto rgb = mTexture->estimateRGB({ texCoord, 0.0f, 0U, 1.0f / static_cast<Float>(width) });
+                    const auto lum = luminance(rgb, std::monostate{}) * std::fabs(mScale);
+                    function[static_cast<size_t>(y) * width + x] = std::isfinite(lum) ? std::fmax(lum, 0.0f) * sinPolar : 0.0f;
+                }
+            }
+        });
+        mDistribution = PiecewiseConstant2D{ std::move(function), width, height };
+        // the integral over [0,1]^2 of L * sin(polar) times 2 pi^2 is the integral over the sphere
+        mRadianceIntegral = mDistribution.integral() * 2.0f * pi * pi;
+    }
+
+    [[nodiscard]] LightAttributes attributes() const noexcept override {
+        return LightAttributes::Infinite;
+    }
+
+    void updateTransform(const KeyFrames& keyFrames, const TimeInterval timeInterval) override {
+        mTransform = resolveTransform(keyFrames, timeInterval);
+    }
+
+    void preprocess(const Float& sceneRadius) override {
+        mSceneRadius = sceneRadius;
+        mSceneDiameter = Distance::fromRaw(sceneRadius * 2.0f);
+    }
+
+    LightLiSample<Spectrum> sampleLi(const ShadingContext<Setting>& ctx, const Point<FrameOfReference::World>&,
+                                     SampleProvider& sampler) const noexcept override {
+        const auto [texCoord, pdf] = mDistribution.sample(sampler.sampleVec2());
+        const auto inversePdf = inversePdfOf(texCoord, pdf);
+        if(!inversePdf.valid())
+            return LightLiSample<Spectrum>::invalid();
+        const auto dir = mTransform(ctx.t).rotateOnly(texCoord2Dir(texCoord));
+        const auto rad = importanceSampled<PdfType::Light | PdfType::LightSampler>(radiance(ctx, texCoord));
+        return LightLiSample<Spectrum>{ dir, rad, inversePdf, mSceneDiameter };
+    }
+
+    InversePdf<PdfType::Light> inversePdfLi(const ShadingContext<Setting>& ctx,
+                                            const Direction<FrameOfReference::World>& wi) const noexcept override {
+        const auto texCoord = dir2TexCoord(mTransform(ctx.t).rotateOnly(wi));
+        return inversePdfOf(texCoord, mDistribution.pdf(texCoord));
+    }
+
+    LightLeSample<Spectrum> sampleLe(const ShadingContext<Setting>& ctx, SampleProvider& sampler) const noexcept override {
+        return LightLeSample<Spectrum>::invalid();
+    }
+    std::pair<InversePdf<PdfType::LightPos>, InversePdf<PdfType::LightDir>>
+    pdfLe(const ShadingContext<Setting>& ctx, const Ray& ray, const Normal<FrameOfReference::World>& normal) const noexcept override {
+        return { InversePdf<PdfType::LightPos>::invalid(), InversePdf<PdfType::LightDir>::invalid() };
+    }
+
+    Radiance<Spectrum> evalLe(const ShadingContext<Setting>& ctx, const Ray& ray) const noexcept override {
+        return radiance(ctx, dir2TexCoord(mTransform(ctx.t).rotateOnly(ray.direction)));
+    }
+
+    [[nodiscard]] Power<MonoSpectrum> power() const noexcept override {
+        return Intensity<MonoSpectrum>::fromRaw(mRadianceIntegral) * SolidAngle::fromRaw(pi * mSceneRadius * mSceneRadius);
+    }
+};
+
+PIPER_REGISTER_VARIANT(EnvLight, Light);
+
+PIPER_NAMESPACE_END
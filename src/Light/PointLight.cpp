@@ -19,7 +19,6 @@
 */
 
 #include <Piper/Render/Light.hpp>
-#include <Piper/Render/SamplingUtil.hpp>
 #include <Piper/Render/Texture.hpp>
 
 PIPER_NAMESPACE_BEGIN
@@ -42,13 +41,17 @@ public:
         mTransform = resolveTransform(keyFrames, timeInterval);
     }
 
+    [[nodiscard]] std::optional<Point<FrameOfReference::World>> position() const noexcept override {
+        return Point<FrameOfReference::World>::fromRaw(mTransform(0.5f).translation);
+    }
+
     LightLiSample<Spectrum> sampleLi(const ShadingContext<Setting>& ctx, const Point<FrameOfReference::World>& pos,
                                      SampleProvider& sampler) const noexcept override {
         const auto transform = mTransform(ctx.t);
         const auto lightSource = Point<FrameOfReference::World>::fromRaw(transform.translation);
         const auto [dir, dist2] = direction(pos, lightSource);
         const auto intensity = Intensity<Spectrum>::fromRaw(
-            mIntensity->evaluate({ mIntensity->dir2TexCoord(transform.rotateOnly(dir)), ctx.t, 0U }, ctx.sampledWavelength));
+            mIntensity->evaluate({ mIntensity->dir2TexCoord(transform.rotateOnly(-dir)), ctx.t, 0U }, ctx.sampledWavelength));
         const auto radiance = importanceSampled<PdfType::Light | PdfType::LightSampler>(intensity.toRadiance(dist2));
         return LightLiSample<Spectrum>{ dir, radiance, InversePdf<PdfType::Light>::identity(), sqrt(dist2) };
     }
@@ -56,18 +59,21 @@ public:
                                             const Direction<FrameOfReference::World>& wi) const noexcept override {
         return InversePdf<PdfType::Light>::invalid();
     }
+    // the emission directions are importance sampled by the intensity profile
     LightLeSample<Spectrum> sampleLe(const ShadingContext<Setting>& ctx, SampleProvider& sampler) const noexcept override {
         const auto transform = mTransform(ctx.t);
-        const auto dir = sampleUniformSphere<FrameOfReference::World>(sampler.sampleVec2());
+        const auto [objDir, intensity, inversePdf] = mIntensity->sample(sampler, ctx.t, ctx.sampledWavelength);
+        if(!inversePdf.valid())
+            return LightLeSample<Spectrum>::invalid();
         const auto lightSource = Point<FrameOfReference::World>::fromRaw(transform.translation);
-        const Ray ray{ lightSource, dir, ctx.t };
-        const auto intensity = Intensity<Spectrum>::fromRaw(
-            mIntensity->evaluate({ mIntensity->dir2TexCoord(transform.rotateOnly(-dir)), ctx.t, 0U }, ctx.sampledWavelength));
-        return LightLeSample<Spectrum>{ ray, intensity, InversePdf<PdfType::LightPos>::identity(), uniformSpherePdf<PdfType::LightDir>() };
+        const Ray ray{ lightSource, transform.rotateOnly(objDir), ctx.t };
+        return LightLeSample<Spectrum>{ ray, Intensity<Spectrum>::fromRaw(intensity.raw()), InversePdf<PdfType::LightPos>::identity(),
+                                        InversePdf<PdfType::LightDir>::fromRaw(inversePdf.raw()) };
     }
-    std::pair<InversePdf<PdfType::LightPos>, InversePdf<PdfType::LightDir>> pdfLe(const ShadingContext<Setting>& ctx,
-                                                                                  const Ray& ray) const noexcept override {
-        return { InversePdf<PdfType::LightPos>::invalid(), uniformSpherePdf<PdfType::LightDir>() };
+    std::pair<InversePdf<PdfType::LightPos>, InversePdf<PdfType::LightDir>>
+    pdfLe(const ShadingContext<Setting>& ctx, const Ray& ray, const Normal<FrameOfReference::World>& normal) const noexcept override {
+        const auto inversePdf = mIntensity->inversePdf(mTransform(ctx.t).rotateOnly(ray.direction), ctx.t);
+        return { InversePdf<PdfType::LightPos>::identity(), InversePdf<PdfType::LightDir>::fromRaw(inversePdf.raw()) };
     }
 
     [[nodiscard]] Power<MonoSpectrum> power() const noexcept override {
@@ -0,0 +1,259 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/Report.hpp>
+#include <Piper/Render/Distribution.hpp>
+#include <Piper/Render/Light.hpp>
+#include <Piper/Render/SamplingUtil.hpp>
+#include <tbb/parallel_for.h>
+
+PIPER_NAMESPACE_BEGIN
+
+// Please refer to "A Practical Analytic Model for Daylight" (Preetham et al. 1999)
+class PreethamSkyModel final {
+    struct Perez final {
+        Float a, b, c, d, e;
+
+        [[nodiscard]] Float operator()(const Float cosTheta, const Float gamma) const noexcept {
+            const auto cosGamma = std::cos(gamma);
+            return (1.0f + a * std::exp(b / std::fmax(cosTheta, 1e-3f))) * (1.0f + c * std::exp(d * gamma) + e * cosGamma * cosGamma);
+        }
+    };
+
+    Perez mY, mX, mXy;
+    glm::vec3 mZenith;  // Y (kcd/m^2), x, y
+    glm::vec3 mNormalization;
+    glm::vec3 mSunDirection;
+
+public:
+    PreethamSkyModel(const glm::vec3 sunDirection, const Float turbidity) : mSunDirection{ sunDirection } {
+        const auto t = turbidity;
+        mY = { 0.1787f * t - 1.4630f, -0.3554f * t + 0.4275f, -0.0227f * t + 5.3251f, 0.1206f * t - 2.5771f, -0.0670f * t + 0.3703f };
+        mX = { -0.0193f * t - 0.2592f, -0.0665f * t + 0.0008f, -0.0004f * t + 0.2125f, -0.0641f * t - 0.8989f, -0.0033f * t + 0.0452f };
+        mXy = { -0.0167f * t - 0.2608f, -0.0950f * t + 0.0092f, -0.0079f * t + 0.2102f, -0.0441f * t - 1.6537f, -0.0109f * t + 0.0529f };
+
+        // the model is only valid for the sun above the horizon
+        const auto thetaS = std::fmin(std::acos(std::clamp(sunDirection.y, -1.0f, 1.0f)), halfPi - 1e-3f);
+        const auto chi = (4.0f / 9.0f - t / 120.0f) * (pi - 2.0f * thetaS);
+        const auto t2 = t * t, th = thetaS, th2 = th * th, th3 = th2 * th;
+        mZenith.x = std::fmax((4.0453f * t - 4.9710f) * std::tan(chi) - 0.2155f * t + 2.4192f, 0.0f);
+        mZenith.y = t2 * (0.00166f * th3 - 0.00375f * th2 + 0.00209f * th) +
+            t * (-0.02903f * th3 + 0.06377f * th2 - 0.03202f * th + 0.00394f) +
+            (0.11693f * th3 - 0.21196f * th2 + 0.06052f * th + 0.25886f);
+        mZenith.z = t2 * (0.00275f * th3 - 0.00610f * th2 + 0.00317f * th) +
+            t * (-0.04214f * th3 + 0.08970f * th2 - 0.04153f * th + 0.00516f) +
+            (0.15346f * th3 - 0.26756f * th2 + 0.06670f * th + 0.26688f);
+
+        // F(0, thetaS)
+        mNormalization = { mY(1.0f, thetaS), mX(1.0f, thetaS), mXy(1.0f, thetaS) };
+    }
+
+    // the linear sRGB radiance in kcd/m^2 of the direction above the horizon
+    [[nodiscard]] glm::vec3 evaluate(const glm::vec3 dir) const noexcept {
+        if(dir.y <= 0.0f)
+            return glm::zero<glm::vec3>();
+        const auto gamma = std::acos(std::clamp(glm::dot(dir, mSunDirection), -1.0f, 1.0f));
+        const auto lum = mZenith.x * mY(dir.y, gamma) / mNormalization.x;
+        const auto x = mZenith.y * mX(dir.y, gamma) / mNormalization.y;
+        const auto y = mZenith.z * mXy(dir.y, gamma) / mNormalization.z;
+        if(!(y > 0.0f))
+            return glm::zero<glm::vec3>();
+
+        const glm::vec3 xyz{ x / y * lum, lum, (1.0f - x - y) / y * lum };
+        const glm::vec3 rgb{ 3.2406f * xyz.x - 1.5372f * xyz.y - 0.4986f * xyz.z, -0.9689f * xyz.x + 1.8758f * xyz.y + 0.0415f * xyz.z,
+                             0.0557f * xyz.x - 0.2040f * xyz.y + 1.0570f * xyz.z };
+        return glm::max(rgb, glm::zero<glm::vec3>());
+    }
+};
+
+// The sky is baked into an equirectangular table with its sampling distribution when the light is created, so each ray only costs
+// a bilinear lookup. The sun is a separate disk sampled by a cone, the object space is Y-up.
+template <typename Setting>
+class Sky final : public Light<Setting> {
+    PIPER_IMPORT_SETTINGS();
+
+    static constexpr Float sunHalfAngle = 0.004654f;  // 0.2667 degree
+    static constexpr Float sunLuminance = 1.6e6f;     // kcd/m^2 at the zenith
+
+    uint32_t mWidth = 256, mHeight = 128;
+    std::pmr::vector<glm::vec3> mTable{ context().globalAllocator };
+    PiecewiseConstant2D mDistribution;
+    Float mScale = 1.0f;
+    glm::vec3 mSunDirection{};
+    glm::vec3 mSunTangent{}, mSunBitangent{};
+    glm::vec3 mSunRadiance{};
+    Float mCosSunHalfAngle = std::cos(sunHalfAngle);
+    Float mSunProbability = 0.0f;
+    Float mRadianceIntegral = 0.0f;  // the luminance over the sphere
+    Float mSceneRadius = 0.0f;
+    Distance mSceneDiameter = Distance::undefined();
+    ResolvedTransform mTransform{};
+
+    // the transmittance of the Rayleigh scattering and the aerosols with the relative optical air mass of Kasten and Young
+    static glm::vec3 sunTransmittance(const glm::vec3 sunDirection, const Float turbidity) noexcept {
+        const auto elevation = std::asin(std::clamp(sunDirection.y, 0.0f, 1.0f)) * 180.0f / pi;
+        const auto airMass = 1.0f / (std::sin(elevation * pi / 180.0f) + 0.50572f * std::pow(elevation + 6.07995f, -1.6364f));
+        const auto beta = std::fmax(0.04608f * turbidity - 0.04586f, 0.0f);
+        constexpr glm::vec3 lambda{ 0.61f, 0.55f, 0.465f };  // um
+        const auto rayleigh = 0.008735f * glm::pow(lambda, glm::vec3{ -4.08f });
+        const auto aerosol = beta * glm::pow(lambda, glm::vec3{ -1.3f });
+        return glm::exp(-airMass * (rayleigh + aerosol));
+    }
+
+    [[nodiscard]] glm::vec3 lookup(const TexCoord texCoord) const noexcept {
+        const auto x = texCoord.x * static_cast<Float>(mWidth) - 0.5f, y = texCoord.y * static_cast<Float>(mHeight) - 0.5f;
+        const auto x0 = std::floor(x), y0 = std::floor(y);
+        const auto ux = x - x0, uy = y - y0;
+        const auto texel = [&](const Float px, const Float py) {
+            const auto ix = (static_cast<int32_t>(px) % static_cast<int32_t>(mWidth) + static_cast<int32_t>(mWidth)) %
+                static_cast<int32_t>(mWidth);
+            const auto iy = std::clamp(static_cast<int32_t>(py), 0, static_cast<int32_t>(mHeight) - 1);
+            return mTable[static_cast<size_t>(iy) * mWidth + static_cast<size_t>(ix)];
+        };
+        return glm::mix(glm::mix(texel(x0, y0), texel(x0 + 1.0f, y0), ux), glm::mix(texel(x0, y0 + 1.0f), texel(x0 + 1.0f, y0 + 1.0f), ux),
+                        uy);
+    }
+
+    [[nodiscard]] Radiance<Spectrum> radiance(const ShadingContext<Setting>& ctx, const glm::vec3 dir) const noexcept {
+        auto rgb = lookup(directionToEquirectangular(dir));
+        if(glm::dot(dir, mSunDirection) >= mCosSunHalfAngle)
+            rgb += mSunRadiance;
+        return Radiance<Spectrum>::fromRaw(spectrumCast<Spectrum>(RGBSpectrum::fromRaw(rgb * mScale), ctx.sampledWavelength));
+    }
+
+    // the mixture of the sun cone and the sky table
+    [[nodiscard]] Float pdf(const glm::vec3 dir) const noexcept {
+        const auto texCoord = directionToEquirectangular(dir);
+        auto res = (1.0f - mSunProbability) * equirectangularSolidAnglePdf(texCoord, mDistribution.pdf(texCoord));
+        if(mSunProbability > 0.0f && glm::dot(dir, mSunDirection) >= mCosSunHalfAngle)
+            res += mSunProbability / (twoPi * (1.0f - mCosSunHalfAngle));
+        return res;
+    }
+
+public:
+    explicit Sky(const Ref<ConfigNode>& node) : mSunDirection{ glm::normalize(parseVec3(node->get("SunDirection"sv))) } {
+        Float turbidity = 3.0f;
+        if(const auto ptr = node->tryGet("Turbidity"sv))
+            turbidity = std::clamp((*ptr)->as<Float>(), 1.7f, 10.0f);
+        if(const auto ptr = node->tryGet("Scale"sv))
+            mScale = (*ptr)->as<Float>();
+        Float sunScale = 1.0f;
+        if(const auto ptr = node->tryGet("SunScale"sv))
+            sunScale = std::fmax((*ptr)->as<Float>(), 0.0f);
+        if(const auto ptr = node->tryGet("Resolution"sv)) {
+            mWidth = std::max(4U, (*ptr)->as<uint32_t>());
+            mHeight = mWidth / 2;
+        }
+        if(mSunDirection.y < 0.0f)
+            warning("The sun of the sky is below the horizon");
+
+        const PreethamSkyModel model{ mSunDirection, turbidity };
+        mTable.resize(static_cast<size_t>(mWidth) * mHeight);
+        std::pmr::vector<Float> function{ mTable.size(), context().globalAllocator };
+        tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, mHeight }, [&](const tbb::blocked_range<uint32_t>& range) {
+            for(auto y = range.begin(); y != range.end(); ++y) {
+                const auto v = (static_cast<Float>(y) + 0.5f) / static_cast<Float>(mHeight);
+                for(uint32_t x = 0; x < mWidth; ++x) {
+                    const auto idx = static_cast<size_t>(y) * mWidth + x;
+                    const TexCoord texCoord{ (static_cast<Float>(x) + 0.5f) / static_cast<Float>(mWidth), v };
+                    mTable[idx] = model.evaluate(equirectangularToDirection(texCoord));
+                    const auto lum = luminance(RGBSpectrum::fromRaw(mTable[idx]), std::monostate{}) * std::fabs(mScale);
+                    function[idx] = lum * std::sin(v * pi);
+                }
+            }
+        });
+        mDistribution = PiecewiseConstant2D{ std::move(function), mWidth, mHeight };
+        const auto skyIntegral = mDistribution.integral() * 2.0f * pi * pi;
+
+        mSunRadiance = sunLuminance * sunScale * sunTransmittance(mSunDirection, turbidity);
+        if(mSunDirection.y <= 0.0f)
+            mSunRadiance = glm::zero<glm::vec3>();
+        const auto sunSolidAngle = twoPi * (1.0f - mCosSunHalfAngle);
+        const auto sunIntegral = luminance(RGBSpectrum::fromRaw(mSunRadiance), std::monostate{}) * std::fabs(mScale) * sunSolidAngle;
+        mRadianceIntegral = skyIntegral + sunIntegral;
+        if(mRadianceIntegral > 0.0f)
+            mSunProbability = sunIntegral / mRadianceIntegral;
+        if(!(skyIntegral > 0.0f) && sunIntegral > 0.0f)
+            mSunProbability = 1.0f;
+
+        const auto ref = std::fabs(mSunDirection.x) < 0.9f ? glm::vec3{ 1.0f, 0.0f, 0.0f } : glm::vec3{ 0.0f, 1.0f, 0.0f };
+        mSunTangent = glm::normalize(glm::cross(ref, mSunDirection));
+        mSunBitangent = glm::cross(mSunDirection, mSunTangent);
+    }
+
+    [[nodiscard]] LightAttributes attributes() const noexcept override {
+        return LightAttributes::Infinite;
+    }
+
+    void updateTransform(const KeyFrames& keyFrames, const TimeInterval timeInterval) override {
+        mTransform = resolveTransform(keyFrames, timeInterval);
+    }
+
+    void preprocess(const Float& sceneRadius) override {
+        mSceneRadius = sceneRadius;
+        mSceneDiameter = Distance::fromRaw(sceneRadius * 2.0f);
+    }
+
+    LightLiSample<Spectrum> sampleLi(const ShadingContext<Setting>& ctx, const Point<FrameOfReference::World>&,
+                                     SampleProvider& sampler) const noexcept override {
+        const auto u = sampler.sample();
+        const auto v = sampler.sampleVec2();
+        glm::vec3 dir;
+        if(u < mSunProbability) {
+            const auto cosTheta = 1.0f - v.x * (1.0f - mCosSunHalfAngle);
+            const auto sinTheta = std::sqrt(std::fmax(0.0f, 1.0f - cosTheta * cosTheta));
+            const auto phi = v.y * twoPi;
+            dir = glm::normalize(cosTheta * mSunDirection + sinTheta * (std::cos(phi) * mSunTangent + std::sin(phi) * mSunBitangent));
+        } else
+            dir = equirectangularToDirection(mDistribution.sample(v).first);
+
+        const auto inversePdf = InversePdf<PdfType::Light>::fromPdf(pdf(dir));
+        if(!inversePdf.valid())
+            return LightLiSample<Spectrum>::invalid();
+        const auto rad = importanceSampled<PdfType::Light | PdfType::LightSampler>(radiance(ctx, dir));
+        const auto worldDir = mTransform(ctx.t).rotateOnly(Direction<FrameOfReference::Object>::fromRaw(dir));
+        return LightLiSample<Spectrum>{ worldDir, rad, inversePdf, mSceneDiameter };
+    }
+
+    InversePdf<PdfType::Light> inversePdfLi(const ShadingContext<Setting>& ctx,
+                                            const Direction<FrameOfReference::World>& wi) const noexcept override {
+        return InversePdf<PdfType::Light>::fromPdf(pdf(mTransform(ctx.t).rotateOnly(wi).raw()));
+    }
+
+    LightLeSample<Spectrum> sampleLe(const ShadingContext<Setting>& ctx, SampleProvider& sampler) const noexcept override {
+        return LightLeSample<Spectrum>::invalid();
+    }
+    std::pair<InversePdf<PdfType::LightPos>, InversePdf<PdfType::LightDir>>
+    pdfLe(const ShadingContext<Setting>& ctx, const Ray& ray, const Normal<FrameOfReference::World>& normal) const noexcept override {
+        return { InversePdf<PdfType::LightPos>::invalid(), InversePdf<PdfType::LightDir>::invalid() };
+    }
+
+    Radiance<Spectrum> evalLe(const ShadingContext<Setting>& ctx, const Ray& ray) const noexcept override {
+        return radiance(ctx, mTransform(ctx.t).rotateOnly(ray.direction).raw());
+    }
+
+    [[nodiscard]] Power<MonoSpectrum> power() const noexcept override {
+        return Intensity<MonoSpectrum>::fromRaw(mRadianceIntegral) * SolidAngle::fromRaw(pi * mSceneRadius * mSceneRadius);
+    }
+};
+
+PIPER_REGISTER_VARIANT(Sky, Light);
+
+PIPER_NAMESPACE_END
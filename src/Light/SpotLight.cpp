@@ -56,6 +56,10 @@ public:
         mTransform = resolveTransform(keyFrames, timeInterval);
     }
 
+    [[nodiscard]] std::optional<Point<FrameOfReference::World>> position() const noexcept override {
+        return Point<FrameOfReference::World>::fromRaw(mTransform(0.5f).translation);
+    }
+
     LightLiSample<Spectrum> sampleLi(const ShadingContext<Setting>& ctx, const Point<FrameOfReference::World>& pos,
                                      SampleProvider& sampler) const noexcept override {
         const auto transform = mTransform(ctx.t);
@@ -91,13 +95,13 @@ public:
         const auto lightSource = Point<FrameOfReference::World>::fromRaw(transform.translation);
         const Ray ray{ lightSource, dir, ctx.t };
         const auto intensity = Intensity<Spectrum>::fromRaw(
-            mIntensity->evaluate({ mIntensity->dir2TexCoord(-objDir), ctx.t, 0U }, ctx.sampledWavelength) * getDelta(objDir).value());
+            mIntensity->evaluate({ mIntensity->dir2TexCoord(objDir), ctx.t, 0U }, ctx.sampledWavelength) * getDelta(objDir).value());
         return LightLeSample<Spectrum>{ ray, intensity, InversePdf<PdfType::LightPos>::identity(),
                                         InversePdf<PdfType::LightDir>::fromRaw(twoPi * (1 - mCosTotalWidth)) };
     }
-    std::pair<InversePdf<PdfType::LightPos>, InversePdf<PdfType::LightDir>> pdfLe(const ShadingContext<Setting>& ctx,
-                                                                                  const Ray& ray) const noexcept override {
-        return { InversePdf<PdfType::LightPos>::invalid(), InversePdf<PdfType::LightDir>::fromRaw(twoPi * (1 - mCosTotalWidth)) };
+    std::pair<InversePdf<PdfType::LightPos>, InversePdf<PdfType::LightDir>>
+    pdfLe(const ShadingContext<Setting>& ctx, const Ray& ray, const Normal<FrameOfReference::World>& normal) const noexcept override {
+        return { InversePdf<PdfType::LightPos>::identity(), InversePdf<PdfType::LightDir>::fromRaw(twoPi * (1 - mCosTotalWidth)) };
     }
 
     [[nodiscard]] Power<MonoSpectrum> power() const noexcept override {
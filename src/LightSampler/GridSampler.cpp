@@ -0,0 +1,277 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Render/LightSampler.hpp>
+#include <Piper/Render/Sampler.hpp>
+#include <algorithm>
+#include <oneapi/tbb/parallel_for_each.h>
+#include <tbb/parallel_for.h>
+#include <unordered_map>
+
+PIPER_NAMESPACE_BEGIN
+
+// Each cell of a uniform grid over the localized lights keeps the most important lights for it. They are reweighted by the real
+// distance and orientation at the shading point, while a small fallback probability goes to the power distribution of all lights so
+// that every light can still be sampled everywhere.
+class GridLightSampler final : public LightSampler {
+    static constexpr uint32_t maxCellCapacity = 64;
+
+    std::pmr::vector<Handle<Light>> mLights{ context().globalAllocator };
+    std::pmr::vector<Handle<Light>> mInfiniteLights{ context().globalAllocator };
+    std::pmr::unordered_map<const LightBase*, uint32_t> mIndices{ context().globalAllocator };
+    std::pmr::vector<glm::vec3> mPositions{ context().globalAllocator };
+    std::pmr::vector<Float> mPowers{ context().globalAllocator };
+    AliasTable mFallback;
+
+    uint32_t mResolution = 0;  // 0 for automatic
+    uint32_t mCellCapacity = 32;
+    Float mFallbackProbability = 0.1f;
+    glm::vec3 mBoundsMin{}, mCellSize{};
+    glm::uvec3 mGridSize{};
+    Float mMinDistanceSquare = 0.0f;
+    // the light indices of the cells, sorted in the ascending order
+    std::pmr::vector<uint32_t> mCellLights{ context().globalAllocator };
+    uint32_t mCellStride = 0;
+
+    [[nodiscard]] uint32_t locate(const glm::vec3 pos) const noexcept {
+        const auto cell = glm::clamp(glm::ivec3{ glm::floor((pos - mBoundsMin) / mCellSize) }, glm::ivec3{ 0 },
+                                     glm::ivec3{ mGridSize } - 1);
+        return (static_cast<uint32_t>(cell.z) * mGridSize.y + static_cast<uint32_t>(cell.y)) * mGridSize.x + static_cast<uint32_t>(cell.x);
+    }
+
+    static Float clampPower(const LightBase* light) noexcept {
+        const auto power = light->power().raw();
+        return std::isfinite(power) ? std::fmax(power, 0.0f) : 0.0f;
+    }
+
+    static glm::vec3 lightPosition(const LightBase* light) noexcept {
+        const auto position = light->position();
+        return position ? position->raw() : glm::vec3{ std::numeric_limits<Float>::infinity() };
+    }
+
+    // the table is emptied if there are no lights, so the stale lights of the last build cannot be selected
+    void buildFallback() {
+        Float sum = 0.0f;
+        for(const auto power : mPowers)
+            sum += power;
+        if(!(sum > 0.0f))
+            mFallback.build(std::pmr::vector<Float>(mPowers.size(), 1.0f, context().scopedAllocator));
+        else
+            mFallback.build(mPowers);
+    }
+
+    void buildGrid() {
+        mCellLights.clear();
+        mCellStride = 0;
+
+        std::pmr::vector<uint32_t> localized{ context().scopedAllocator };
+        auto boundsMin = glm::vec3{ std::numeric_limits<Float>::max() }, boundsMax = -boundsMin;
+        for(uint32_t idx = 0; idx < static_cast<uint32_t>(mLights.size()); ++idx) {
+            if(mPowers[idx] > 0.0f && glm::all(glm::isfinite(mPositions[idx]))) {
+                localized.push_back(idx);
+                boundsMin = glm::min(boundsMin, mPositions[idx]);
+                boundsMax = glm::max(boundsMax, mPositions[idx]);
+            }
+        }
+        if(localized.empty()) {
+            mGridSize = glm::uvec3{ 0 };
+            return;
+        }
+
+        const auto count = static_cast<uint32_t>(localized.size());
+        const auto resolution =
+            mResolution ? mResolution : std::clamp(static_cast<uint32_t>(std::cbrt(static_cast<Float>(count))), 1U, 64U);
+        const auto extent = glm::max(boundsMax - boundsMin, glm::vec3{ 1e-3f * std::fmax(1.0f, glm::length(boundsMax - boundsMin)) });
+        // the cells are roughly cubic
+        const auto longest = std::fmax(extent.x, std::fmax(extent.y, extent.z));
+        mGridSize = glm::clamp(glm::uvec3{ glm::ceil(extent / longest * static_cast<Float>(resolution)) }, glm::uvec3{ 1 },
+                               glm::uvec3{ resolution });
+        mBoundsMin = boundsMin;
+        mCellSize = extent / glm::vec3{ mGridSize };
+        const auto halfDiagonalSquare = 0.25f * glm::dot(mCellSize, mCellSize);
+        mMinDistanceSquare = 1e-4f * halfDiagonalSquare;
+
+        const auto cells = mGridSize.x * mGridSize.y * mGridSize.z;
+        const auto capacity = std::min(mCellCapacity, count);
+        mCellStride = capacity;
+        mCellLights.resize(static_cast<size_t>(cells) * capacity);
+
+        tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, cells }, [&](const tbb::blocked_range<uint32_t>& range) {
+            std::pmr::vector<std::pair<Float, uint32_t>> candidates{ context().scopedAllocator };
+            candidates.resize(count);
+            for(auto cell = range.begin(); cell != range.end(); ++cell) {
+                const glm::uvec3 coord{ cell % mGridSize.x, (cell / mGridSize.x) % mGridSize.y, cell / (mGridSize.x * mGridSize.y) };
+                const auto center = mBoundsMin + (glm::vec3{ coord } + 0.5f) * mCellSize;
+                // the importance is bounded by clamping the distance to the extent of the cell
+                for(uint32_t idx = 0; idx < count; ++idx) {
+                    const auto light = localized[idx];
+                    const auto diff = mPositions[light] - center;
+                    candidates[idx] = { mPowers[light] / std::fmax(glm::dot(diff, diff), halfDiagonalSquare), light };
+                }
+                std::nth_element(candidates.begin(), candidates.begin() + (capacity - 1), candidates.end(), std::greater<>{});
+
+                const auto base = mCellLights.data() + static_cast<size_t>(cell) * capacity;
+                for(uint32_t idx = 0; idx < capacity; ++idx)
+                    base[idx] = candidates[idx].second;
+                std::sort(base, base + capacity);
+            }
+        });
+    }
+
+    struct CellWeights final {
+        std::array<Float, maxCellCapacity> values;
+        const uint32_t* lights;
+        uint32_t count;
+        Float sum;
+    };
+
+    // the candidates of the cell reweighted by the real distance and orientation
+    void evaluateCell(const Point<FrameOfReference::World>& pos, const Normal<FrameOfReference::World>& normal,
+                      CellWeights& weights) const noexcept {
+        weights.lights = nullptr;
+        weights.count = 0;
+        weights.sum = 0.0f;
+        if(!mGridSize.x)
+            return;
+
+        const auto cell = locate(pos.raw());
+        weights.count = mCellStride;
+        weights.lights = mCellLights.data() + static_cast<size_t>(cell) * mCellStride;
+        const auto cullBackFace = normal.raw() != glm::zero<glm::vec3>();
+        for(uint32_t idx = 0; idx < weights.count; ++idx) {
+            const auto light = weights.lights[idx];
+            const auto diff = mPositions[light] - pos.raw();
+            auto weight = mPowers[light] / std::fmax(glm::dot(diff, diff), mMinDistanceSquare);
+            if(cullBackFace && glm::dot(diff, normal.raw()) <= 0.0f)
+                weight = 0.0f;
+            weights.values[idx] = weight;
+            weights.sum += weight;
+        }
+    }
+
+    // the probability of selecting the light by either strategy
+    [[nodiscard]] Float probability(const CellWeights& weights, const uint32_t light) const noexcept {
+        if(!(weights.sum > 0.0f))
+            return mFallback.probability(light);
+        Float cellWeight = 0.0f;
+        if(const auto iter = std::lower_bound(weights.lights, weights.lights + weights.count, light);
+           iter != weights.lights + weights.count && *iter == light)
+            cellWeight = weights.values[static_cast<size_t>(iter - weights.lights)];
+        return mFallbackProbability * mFallback.probability(light) + (1.0f - mFallbackProbability) * cellWeight / weights.sum;
+    }
+
+public:
+    explicit GridLightSampler(const Ref<ConfigNode>& node) {
+        if(const auto ptr = node->tryGet("Resolution"sv))
+            mResolution = (*ptr)->as<uint32_t>();
+        if(const auto ptr = node->tryGet("CellCapacity"sv))
+            mCellCapacity = std::clamp((*ptr)->as<uint32_t>(), 1U, maxCellCapacity);
+        if(const auto ptr = node->tryGet("FallbackProbability"sv))
+            mFallbackProbability = std::clamp((*ptr)->as<Float>(), 1e-3f, 1.0f);
+    }
+
+    void preprocess(const std::pmr::vector<LightBase*>& lights, const Float& sceneRadius) override {
+        mLights.clear();
+        mInfiniteLights.clear();
+        mIndices.clear();
+        mPositions.clear();
+        mPowers.clear();
+
+        for(const auto light : lights) {
+            light->preprocess(sceneRadius);
+            mIndices.emplace(light, static_cast<uint32_t>(mLights.size()));
+            mLights.push_back(Handle<Light>{ light });
+            if(match(light->attributes(), LightAttributes::Infinite))
+                mInfiniteLights.push_back(Handle<Light>{ light });
+            mPowers.push_back(clampPower(light));
+            mPositions.push_back(lightPosition(light));
+        }
+        buildFallback();
+        buildGrid();
+    }
+    // only the changed lights are preprocessed again, the grid is rebuilt if any power or position is changed
+    void update(const std::pmr::vector<LightBase*>&, const std::span<LightBase* const> changed, const Float& sceneRadius) override {
+        tbb::parallel_for_each(changed.begin(), changed.end(), [&](LightBase* light) { light->preprocess(sceneRadius); });
+
+        bool powerChanged = false, positionChanged = false;
+        for(const auto light : changed) {
+            const auto idx = mIndices.at(light);
+            if(const auto power = clampPower(light); power != mPowers[idx]) {
+                mPowers[idx] = power;
+                powerChanged = true;
+            }
+            if(const auto position = lightPosition(light); position != mPositions[idx]) {
+                mPositions[idx] = position;
+                positionChanged = true;
+            }
+        }
+        if(powerChanged)
+            buildFallback();
+        if(powerChanged || positionChanged)
+            buildGrid();
+    }
+
+    std::pair<Handle<Light>, InversePdf<PdfType::LightSampler>>
+    sample(SampleProvider& sampler, const Point<FrameOfReference::World>& pos,
+           const Normal<FrameOfReference::World>& normal) const noexcept override {
+        CellWeights weights;  // NOLINT(cppcoreguidelines-pro-type-member-init)
+        evaluateCell(pos, normal, weights);
+
+        const auto fallbackProbability = weights.sum > 0.0f ? mFallbackProbability : 1.0f;
+        auto u = sampler.sample();
+        if(mFallback.empty())
+            return { Handle<Light>{}, InversePdf<PdfType::LightSampler>::invalid() };
+        uint32_t selected;
+        if(u < fallbackProbability)
+            selected = mFallback.sample(std::fmin(u / fallbackProbability, oneMinusEpsilon));
+        else {
+            u = (u - fallbackProbability) / (1.0f - fallbackProbability) * weights.sum;
+            uint32_t idx = 0;
+            while(idx + 1 < weights.count && u >= weights.values[idx]) {
+                u -= weights.values[idx];
+                ++idx;
+            }
+            // skip the culled lights at the end
+            while(idx > 0 && weights.values[idx] == 0.0f)
+                --idx;
+            selected = weights.lights[idx];
+        }
+
+        return { mLights[selected], InversePdf<PdfType::LightSampler>::fromRaw(rcp(probability(weights, selected))) };
+    }
+
+    InversePdf<PdfType::LightSampler> inversePdf(const LightBase* light, const Point<FrameOfReference::World>& pos,
+                                                 const Normal<FrameOfReference::World>& normal) const noexcept override {
+        const auto iter = mIndices.find(light);
+        if(iter == mIndices.cend())
+            return InversePdf<PdfType::LightSampler>::invalid();
+        CellWeights weights;  // NOLINT(cppcoreguidelines-pro-type-member-init)
+        evaluateCell(pos, normal, weights);
+        return InversePdf<PdfType::LightSampler>::fromPdf(probability(weights, iter->second));
+    }
+
+    std::span<const Handle<Light>> infiniteLights() const noexcept override {
+        return { mInfiniteLights.data(), mInfiniteLights.size() };
+    }
+};
+
+PIPER_REGISTER_CLASS(GridLightSampler, LightSampler);
+
+PIPER_NAMESPACE_END
@@ -0,0 +1,109 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Render/LightSampler.hpp>
+#include <Piper/Render/Sampler.hpp>
+#include <oneapi/tbb/parallel_for_each.h>
+#include <unordered_map>
+
+PIPER_NAMESPACE_BEGIN
+
+class PowerLightSampler final : public LightSampler {
+    std::pmr::vector<Handle<Light>> mLights{ context().globalAllocator };
+    std::pmr::vector<Handle<Light>> mInfiniteLights{ context().globalAllocator };
+    std::pmr::unordered_map<const LightBase*, uint32_t> mIndices{ context().globalAllocator };
+    std::pmr::vector<Float> mPowers{ context().globalAllocator };
+    AliasTable mAliasTable;
+
+    static Float clampPower(const LightBase* light) noexcept {
+        const auto power = light->power().raw();
+        return std::isfinite(power) ? std::fmax(power, 0.0f) : 0.0f;
+    }
+
+    void buildAliasTable() {
+        Float sum = 0.0f;
+        for(const auto power : mPowers)
+            sum += power;
+
+        if(!(sum > 0.0f)) {
+            if(!mPowers.empty())
+                warning("All lights have zero power. Fallback to the uniform light sampling.");
+            mAliasTable.build(std::pmr::vector<Float>(mPowers.size(), 1.0f, context().scopedAllocator));
+        } else
+            mAliasTable.build(mPowers);
+    }
+
+public:
+    explicit PowerLightSampler(const Ref<ConfigNode>&) {}
+    void preprocess(const std::pmr::vector<LightBase*>& lights, const Float& sceneRadius) override {
+        mLights.clear();
+        mInfiniteLights.clear();
+        mIndices.clear();
+        mPowers.clear();
+        mLights.reserve(lights.size());
+        mPowers.reserve(lights.size());
+
+        for(const auto light : lights) {
+            light->preprocess(sceneRadius);
+            mIndices.emplace(light, static_cast<uint32_t>(mLights.size()));
+            mLights.push_back(Handle<Light>{ light });
+            if(match(light->attributes(), LightAttributes::Infinite))
+                mInfiniteLights.push_back(Handle<Light>{ light });
+            mPowers.push_back(clampPower(light));
+        }
+        buildAliasTable();
+    }
+    // only the changed lights are preprocessed again, the O(n) alias table is rebuilt if any power is changed
+    void update(const std::pmr::vector<LightBase*>&, const std::span<LightBase* const> changed, const Float& sceneRadius) override {
+        tbb::parallel_for_each(changed.begin(), changed.end(), [&](LightBase* light) { light->preprocess(sceneRadius); });
+
+        bool powerChanged = false;
+        for(const auto light : changed) {
+            auto& power = mPowers[mIndices.at(light)];
+            if(const auto newPower = clampPower(light); newPower != power) {
+                power = newPower;
+                powerChanged = true;
+            }
+        }
+        if(powerChanged)
+            buildAliasTable();
+    }
+    std::pair<Handle<Light>, InversePdf<PdfType::LightSampler>> sample(SampleProvider& sampler, const Point<FrameOfReference::World>&,
+                                                                      const Normal<FrameOfReference::World>&) const noexcept override {
+        const auto u = sampler.sample();
+        if(mAliasTable.empty())
+            return { Handle<Light>{}, InversePdf<PdfType::LightSampler>::invalid() };
+        const auto idx = mAliasTable.sample(u);
+        return { mLights[idx], InversePdf<PdfType::LightSampler>::fromRaw(rcp(mAliasTable.probability(idx))) };
+    }
+    InversePdf<PdfType::LightSampler> inversePdf(const LightBase* light, const Point<FrameOfReference::World>&,
+                                                 const Normal<FrameOfReference::World>&) const noexcept override {
+        const auto iter = mIndices.find(light);
+        return iter == mIndices.cend() ? InversePdf<PdfType::LightSampler>::invalid() :
+                                         InversePdf<PdfType::LightSampler>::fromPdf(mAliasTable.probability(iter->second));
+    }
+    std::span<const Handle<Light>> infiniteLights() const noexcept override {
+        return { mInfiniteLights.data(), mInfiniteLights.size() };
+    }
+};
+
+PIPER_REGISTER_CLASS(PowerLightSampler, LightSampler);
+
+PIPER_NAMESPACE_END
@@ -20,6 +20,7 @@
 
 #include <Piper/Render/LightSampler.hpp>
 #include <Piper/Render/Sampler.hpp>
+#include <oneapi/tbb/parallel_for_each.h>
 
 PIPER_NAMESPACE_BEGIN
 
@@ -31,6 +32,7 @@ public:
     explicit UniformLightSampler(const Ref<ConfigNode>&) {}
     void preprocess(const std::pmr::vector<LightBase*>& lights, const Float &sceneRadius) override {
         mLights.clear();
+        mInfiniteLights.clear();
         mLights.reserve(lights.size());
         for(const auto light : lights) {
             light->preprocess(sceneRadius);
@@ -39,10 +41,23 @@ public:
                 mInfiniteLights.push_back(Handle<Light>{ light });
         }
     }
-    std::pair<Handle<Light>, InversePdf<PdfType::LightSampler>> sample(SampleProvider& sampler) const noexcept override {
+    // the selection probabilities do not depend on the lights
+    void update(const std::pmr::vector<LightBase*>&, const std::span<LightBase* const> changed, const Float& sceneRadius) override {
+        tbb::parallel_for_each(changed.begin(), changed.end(), [&](LightBase* light) { light->preprocess(sceneRadius); });
+    }
+    std::pair<Handle<Light>, InversePdf<PdfType::LightSampler>> sample(SampleProvider& sampler, const Point<FrameOfReference::World>&,
+                                                                      const Normal<FrameOfReference::World>&) const noexcept override {
+        if(mLights.empty()) {
+            static_cast<void>(sampler.sample());
+            return { Handle<Light>{}, InversePdf<PdfType::LightSampler>::invalid() };
+        }
         const auto idx = sampler.sampleIdx(static_cast<uint32_t>(mLights.size()));
         return { mLights[idx], InversePdf<PdfType::LightSampler>::fromRaw(static_cast<Float>(mLights.size())) };
     }
+    InversePdf<PdfType::LightSampler> inversePdf(const LightBase*, const Point<FrameOfReference::World>&,
+                                                 const Normal<FrameOfReference::World>&) const noexcept override {
+        return InversePdf<PdfType::LightSampler>::fromRaw(static_cast<Float>(mLights.size()));
+    }
     std::span<const Handle<Light>> infiniteLights() const noexcept override {
         return { mInfiniteLights.data(), mInfiniteLights.size() };
     }
@@ -26,49 +26,79 @@
 
 PIPER_NAMESPACE_BEGIN
 
+// Nested BxDFs are stored inline when they fit, so that two wrappers still fit into the BxDF storage of a BSDF.
+// Larger ones (e.g. nested mixtures) fall back to the scoped allocator.
+// NOTICE: BxDFs are relocated bytewise, so the wrapper never points into itself and derives the address on each call
 template <typename Setting>
 class BSDFWrapper final : public BxDF<Setting> {
     PIPER_IMPORT_SETTINGS();
     PIPER_IMPORT_SHADING();
 
-    std::pmr::memory_resource* mAllocator;
-    BSDF<Setting>* mBSDF;
+    static constexpr uint32_t inlineSize = 80;
+    static constexpr uint32_t inlineAlignment = 16;
+
+    // nullptr if the BxDF is stored inline
+    std::byte* mHeapStorage = nullptr;
+    alignas(inlineAlignment) std::byte mInlineStorage[inlineSize];
+    std::pmr::memory_resource* mAllocator = nullptr;
+    // 0 if the BxDF has been moved out
+    uint32_t mSize;
+    uint32_t mAlignment;
+
+    [[nodiscard]] const BxDF<Setting>* bxdf() const noexcept {
+        return reinterpret_cast<const BxDF<Setting>*>(mHeapStorage ? mHeapStorage : mInlineStorage);
+    }
 
 public:
-    explicit BSDFWrapper(BSDF<Setting> bsdf)
-        : mAllocator{ context().scopedAllocator }, mBSDF{ static_cast<BSDF<Setting>*>(
-                                                       mAllocator->allocate(sizeof(bsdf), alignof(BSDF<Setting>))) } {
-        new(mBSDF) BSDF<Setting>{ std::move(bsdf) };
+    explicit BSDFWrapper(BSDF<Setting> bsdf) : mSize{ bsdf.bxdfSize() }, mAlignment{ bsdf.bxdfAlignment() } {
+        if(mSize > inlineSize || mAlignment > inlineAlignment) {
+            mAllocator = context().scopedAllocator;
+            mHeapStorage = static_cast<std::byte*>(mAllocator->allocate(mSize, mAlignment));
+        }
+        bsdf.relocateBxDF(mHeapStorage ? mHeapStorage : mInlineStorage);
     }
 
     BSDFWrapper(const BSDFWrapper&) = delete;
     BSDFWrapper(BSDFWrapper&& rhs) noexcept
-        : mAllocator{ std::exchange(rhs.mAllocator, nullptr) }, mBSDF{ std::exchange(rhs.mBSDF, nullptr) } {}
+        : mHeapStorage{ std::exchange(rhs.mHeapStorage, nullptr) }, mAllocator{ rhs.mAllocator }, mSize{ std::exchange(rhs.mSize, 0U) },
+          mAlignment{ rhs.mAlignment } {
+        if(!mHeapStorage && mSize)
+            memcpy(mInlineStorage, rhs.mInlineStorage, mSize);
+    }
     BSDFWrapper& operator=(const BSDFWrapper&) = delete;
     BSDFWrapper& operator=(BSDFWrapper&&) = delete;
 
     ~BSDFWrapper() override {
-        if(mBSDF)
-            mAllocator->deallocate(mBSDF, sizeof(BSDF<Setting>), alignof(BSDF<Setting>));
+        if(!mSize)
+            return;
+        std::destroy_at(bxdf());
+        if(mHeapStorage)
+            mAllocator->deallocate(mHeapStorage, mSize, mAlignment);
     }
 
     [[nodiscard]] BxDFPart part() const noexcept override {
-        return mBSDF->cast()->part();
+        return bxdf()->part();
     }
 
     [[nodiscard]] Rational<Spectrum> evaluate(const Direction& wo, const Direction& wi,
                                               TransportMode transportMode) const noexcept override {
-        return mBSDF->cast()->evaluate(wo, wi, transportMode);
+        return bxdf()->evaluate(wo, wi, transportMode);
     }
 
     BSDFSample sample(SampleProvider& sampler, const Direction& wo, TransportMode transportMode = TransportMode::Radiance,
                       BxDFDirection sampleDirection = BxDFDirection::All) const noexcept override {
-        return mBSDF->cast()->sample(sampler, wo, transportMode, sampleDirection);
+        return bxdf()->sample(sampler, wo, transportMode, sampleDirection);
     }
 
     [[nodiscard]] InversePdfValue inversePdf(const Direction& wo, const Direction& wi, TransportMode transportMode,
                                              BxDFDirection sampleDirection = BxDFDirection::All) const noexcept override {
-        return mBSDF->cast()->inversePdf(wo, wi, transportMode, sampleDirection);
+        return bxdf()->inversePdf(wo, wi, transportMode, sampleDirection);
+    }
+
+    [[nodiscard]] std::pair<Rational<Spectrum>, InversePdfValue>
+    evaluateWithPdf(const Direction& wo, const Direction& wi, const TransportMode transportMode,
+                    const BxDFDirection sampleDirection = BxDFDirection::All) const noexcept override {
+        return bxdf()->evaluateWithPdf(wo, wi, transportMode, sampleDirection);
     }
 };
 
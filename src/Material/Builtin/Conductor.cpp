@@ -29,47 +29,50 @@ class Conductor final : public Material<Setting> {
     PIPER_IMPORT_SETTINGS();
     PIPER_IMPORT_SHADING();
 
-    Ref<SpectrumTexture2D<Setting>> mEta, mK;
-    Ref<ScalarTexture2D> mRoughnessU, mRoughnessV;
+    SpectrumTextureInput<Setting> mEta, mK;
+    ScalarTextureInput mRoughnessU, mRoughnessV;
     bool mRemapRoughness = true;
+    // the remapped roughness of the constant inputs
+    std::optional<std::pair<Float, Float>> mAlpha;
 
-    auto evaluateEta(const Ref<SpectrumTexture2D<Setting>>& eta, const TextureEvaluateInfo& info,
+    auto evaluateEta(const SpectrumTextureInput<Setting>& eta, const TextureEvaluateInfo& info,
                      const Wavelength& sampledWavelength) const noexcept {
         if constexpr(isSpectral) {
-            return eta->evaluateOneWavelength(info, sampledWavelength.firstComponent());
+            return eta.evaluateOneWavelength(info, sampledWavelength.firstComponent());
         } else {
-            return std::pair<bool, Spectrum>{ false, eta->evaluate(info, sampledWavelength) };
+            return std::pair<bool, Spectrum>{ false, eta.evaluate(info, sampledWavelength) };
         }
     }
 
-public:
-    explicit Conductor(const Ref<ConfigNode>& node) {
-        if(const auto ptr = node->tryGet("Material"sv)) {
-            const ResolveConfiguration configuration;
-            const auto path = resolvePath((*ptr)->as<std::string_view>());
-            const auto subNode = parseJSONConfigNode(path, configuration);
-
-            mEta = this->template make<SpectrumTexture2D>(subNode->get("Eta"sv)->as<Ref<ConfigNode>>());
-            mK = this->template make<SpectrumTexture2D>(subNode->get("K"sv)->as<Ref<ConfigNode>>());
-        } else {
-            mEta = this->template make<SpectrumTexture2D>(node->get("Eta"sv)->as<Ref<ConfigNode>>());
-            mK = this->template make<SpectrumTexture2D>(node->get("K"sv)->as<Ref<ConfigNode>>());
-        }
+    static Ref<SpectrumTexture2D<Setting>> loadEta(const Ref<ConfigNode>& node, const std::string_view attr) {
+        if(const auto ptr = node->tryGet("Material"sv))
+            return loadSharedTexture<SpectrumTexture2D<Setting>>((*ptr)->as<std::string_view>(), attr);
+        return getStaticFactory().make<SpectrumTexture2D<Setting>>(node->get(attr)->as<Ref<ConfigNode>>());
+    }
 
-        mRoughnessU = getScalarTexture2D(node, "RoughnessU"sv, "Roughness"sv, 0.0f);
-        mRoughnessV = getScalarTexture2D(node, "RoughnessV"sv, "Roughness"sv, 0.0f);
+    [[nodiscard]] std::pair<Float, Float> remap(Float roughnessU, Float roughnessV) const noexcept {
+        if(mRemapRoughness) {
+            roughnessU = TrowbridgeReitzDistribution<Setting>::roughnessToAlpha(roughnessU);
+            roughnessV = TrowbridgeReitzDistribution<Setting>::roughnessToAlpha(roughnessV);
+        }
+        return { roughnessU, roughnessV };
+    }
 
+public:
+    explicit Conductor(const Ref<ConfigNode>& node)
+        : mEta{ loadEta(node, "Eta"sv) }, mK{ loadEta(node, "K"sv) },
+          mRoughnessU{ getScalarTexture2D(node, "RoughnessU"sv, "Roughness"sv, 0.0f) }, mRoughnessV{ getScalarTexture2D(
+                                                                                             node, "RoughnessV"sv, "Roughness"sv, 0.0f) } {
         if(const auto ptr = node->tryGet("RemapRoughness"sv))
             mRemapRoughness = (*ptr)->as<bool>();
+        if(mRoughnessU.constant() && mRoughnessV.constant())
+            mAlpha = remap(*mRoughnessU.constant(), *mRoughnessV.constant());
     }
 
     BSDF<Setting> evaluate(const Wavelength& sampledWavelength, const SurfaceHit& intersection) const noexcept override {
         const auto textureEvaluateInfo = intersection.makeTextureEvaluateInfo();
-        auto roughnessU = mRoughnessU->evaluate(textureEvaluateInfo), roughnessV = mRoughnessV->evaluate(textureEvaluateInfo);
-        if(mRemapRoughness) {
-            roughnessU = TrowbridgeReitzDistribution<Setting>::roughnessToAlpha(roughnessU);
-            roughnessV = TrowbridgeReitzDistribution<Setting>::roughnessToAlpha(roughnessV);
-        }
+        const auto [roughnessU, roughnessV] =
+            mAlpha ? *mAlpha : remap(mRoughnessU.evaluate(textureEvaluateInfo), mRoughnessV.evaluate(textureEvaluateInfo));
 
         const auto [keepOneWavelengthEta, eta] = evaluateEta(mEta, textureEvaluateInfo, sampledWavelength);
         const auto [keepOneWavelengthK, k] = evaluateEta(mK, textureEvaluateInfo, sampledWavelength);
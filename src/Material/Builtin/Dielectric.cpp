@@ -29,43 +29,48 @@ class Dielectric final : public Material<Setting> {
     PIPER_IMPORT_SETTINGS();
     PIPER_IMPORT_SHADING();
 
-    Ref<ScalarTexture2D> mEta;
-    Ref<ScalarTexture2D> mRoughnessU, mRoughnessV;
+    ScalarTextureInput mEta;
+    ScalarTextureInput mRoughnessU, mRoughnessV;
     bool mRemapRoughness = true;
+    // the remapped roughness of the constant inputs
+    std::optional<std::pair<Float, Float>> mAlpha;
 
-    auto evaluateEta(const Ref<ScalarTexture2D>& eta, const TextureEvaluateInfo& info, const Wavelength& sampledWavelength) const noexcept {
+    auto evaluateEta(const ScalarTextureInput& eta, const TextureEvaluateInfo& info, const Wavelength& sampledWavelength) const noexcept {
         if constexpr(isSpectral) {
-            return eta->evaluateOneWavelength(info, sampledWavelength.firstComponent());
+            return eta.evaluateOneWavelength(info, sampledWavelength.firstComponent());
         } else {
-            return std::pair{ false, eta->evaluate(info) };
+            return std::pair{ false, eta.evaluate(info) };
         }
     }
 
-public:
-    explicit Dielectric(const Ref<ConfigNode>& node) {
-        if(const auto ptr = node->tryGet("Material"sv)) {
-            const ResolveConfiguration configuration;
-            const auto path = resolvePath((*ptr)->as<std::string_view>());
-            const auto subNode = parseJSONConfigNode(path, configuration);
-
-            mEta = getStaticFactory().make<ScalarTexture2D>(subNode->get("Eta"sv)->as<Ref<ConfigNode>>());
-        } else
-            mEta = getScalarTexture2D(node, "Eta"sv, ""sv, 1.5f);
+    static Ref<ScalarTexture2D> loadEta(const Ref<ConfigNode>& node) {
+        if(const auto ptr = node->tryGet("Material"sv))
+            return loadSharedTexture<ScalarTexture2D>((*ptr)->as<std::string_view>(), "Eta"sv);
+        return getScalarTexture2D(node, "Eta"sv, ""sv, 1.5f);
+    }
 
-        mRoughnessU = getScalarTexture2D(node, "RoughnessU"sv, "Roughness"sv, 0.0f);
-        mRoughnessV = getScalarTexture2D(node, "RoughnessV"sv, "Roughness"sv, 0.0f);
+    [[nodiscard]] std::pair<Float, Float> remap(Float roughnessU, Float roughnessV) const noexcept {
+        if(mRemapRoughness) {
+            roughnessU = TrowbridgeReitzDistribution<Setting>::roughnessToAlpha(roughnessU);
+            roughnessV = TrowbridgeReitzDistribution<Setting>::roughnessToAlpha(roughnessV);
+        }
+        return { roughnessU, roughnessV };
+    }
 
+public:
+    explicit Dielectric(const Ref<ConfigNode>& node)
+        : mEta{ loadEta(node) }, mRoughnessU{ getScalarTexture2D(node, "RoughnessU"sv, "Roughness"sv, 0.0f) },
+          mRoughnessV{ getScalarTexture2D(node, "RoughnessV"sv, "Roughness"sv, 0.0f) } {
         if(const auto ptr = node->tryGet("RemapRoughness"sv))
             mRemapRoughness = (*ptr)->as<bool>();
+        if(mRoughnessU.constant() && mRoughnessV.constant())
+            mAlpha = remap(*mRoughnessU.constant(), *mRoughnessV.constant());
     }
 
     BSDF<Setting> evaluate(const Wavelength& sampledWavelength, const SurfaceHit& intersection) const noexcept override {
         const auto textureEvaluateInfo = intersection.makeTextureEvaluateInfo();
-        auto roughnessU = mRoughnessU->evaluate(textureEvaluateInfo), roughnessV = mRoughnessV->evaluate(textureEvaluateInfo);
-        if(mRemapRoughness) {
-            roughnessU = TrowbridgeReitzDistribution<Setting>::roughnessToAlpha(roughnessU);
-            roughnessV = TrowbridgeReitzDistribution<Setting>::roughnessToAlpha(roughnessV);
-        }
+        const auto [roughnessU, roughnessV] =
+            mAlpha ? *mAlpha : remap(mRoughnessU.evaluate(textureEvaluateInfo), mRoughnessV.evaluate(textureEvaluateInfo));
 
         const auto [keepOneWavelength, eta] = evaluateEta(mEta, textureEvaluateInfo, sampledWavelength);
 
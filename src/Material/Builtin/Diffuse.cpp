@@ -20,7 +20,6 @@
 
 #include <Piper/Render/BxDFs.hpp>
 #include <Piper/Render/Material.hpp>
-#include <Piper/Render/SpectralLUTUtil.hpp>
 #include <Piper/Render/Texture.hpp>
 
 PIPER_NAMESPACE_BEGIN
@@ -44,26 +43,7 @@ public:
     }
 
     [[nodiscard]] RGBSpectrum estimateAlbedo(const SurfaceHit& intersection) const noexcept override {
-        const auto textureEvaluateInfo = intersection.makeTextureEvaluateInfo();
-        if constexpr(std::is_same_v<Spectrum, SampledSpectrum>) {
-            auto res = zero<RGBSpectrum>();
-
-            for(uint32_t idx = wavelengthMin; idx < wavelengthMax; ++idx) {
-                const auto base = static_cast<Float>(idx);
-                const auto sampledWavelength = SampledSpectrum::fromRaw({ base, base + 0.25f, base + 0.5f, base + 0.75f });
-                const auto albedo = toRGB(mReflectance->evaluate(textureEvaluateInfo, sampledWavelength), sampledWavelength);
-                res += albedo;
-            }
-
-            res /= wavelengthMax - wavelengthMin;
-
-            return res;
-        } else if constexpr(std::is_same_v<Spectrum, MonoWavelengthSpectrum>) {
-            const auto lambda = RenderGlobalSetting::get().sampledWavelength;
-            return toRGB(mReflectance->evaluate(textureEvaluateInfo, lambda), lambda);
-        } else {
-            return toRGB(mReflectance->evaluate(textureEvaluateInfo, Wavelength{}), Wavelength{});
-        }
+        return mReflectance->estimateRGB(intersection.makeTextureEvaluateInfo());
     }
 };
 
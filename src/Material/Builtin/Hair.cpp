@@ -0,0 +1,334 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <Piper/Render/BxDFs.hpp>
+#include <Piper/Render/Material.hpp>
+#include <Piper/Render/Scattering.hpp>
+#include <Piper/Render/SpectrumUtil.hpp>
+
+PIPER_NAMESPACE_BEGIN
+
+// Please refer to "A Practical and Controllable Hair and Fur Model for Production Path Tracing" (Chiang et al. 2016) and
+// https://pbr-book.org/3ed-2018/Light_Transport_II_Volume_Rendering/Hair_Scattering
+// the lobes R, TT, TRT are modeled separately and the higher order ones are merged into one lobe
+constexpr uint32_t maxHairLobe = 3;
+
+static Float besselI0(const Float x) noexcept {
+    Float res = 0.0f, x2i = 1.0f;
+    int64_t factorial = 1, pow4 = 1;
+    for(int64_t i = 0; i < 10; ++i) {
+        if(i > 1)
+            factorial *= i;
+        res += x2i / (static_cast<Float>(pow4) * sqr(static_cast<Float>(factorial)));
+        x2i *= x * x;
+        pow4 *= 4;
+    }
+    return res;
+}
+
+static Float logBesselI0(const Float x) noexcept {
+    if(x > 12.0f)
+        return x + 0.5f * (-std::log(twoPi) + std::log(rcp(x)) + rcp(8.0f * x));
+    return std::log(besselI0(x));
+}
+
+// the longitudinal scattering function Mp
+static Float longitudinal(const Float cosThetaI, const Float cosThetaO, const Float sinThetaI, const Float sinThetaO,
+                          const Float v) noexcept {
+    const auto a = cosThetaI * cosThetaO / v, b = sinThetaI * sinThetaO / v;
+    // the low roughness is evaluated in the log space to prevent overflow
+    if(v <= 0.1f)
+        return std::exp(logBesselI0(a) - b - rcp(v) + 0.6931f + std::log(rcp(2.0f * v)));
+    return std::exp(-b) * besselI0(a) / (std::sinh(rcp(v)) * 2.0f * v);
+}
+
+static Float logistic(const Float x, const Float s) noexcept {
+    const auto e = std::exp(-std::fabs(x) / s);
+    return e / (s * sqr(1.0f + e));
+}
+
+static Float logisticCDF(const Float x, const Float s) noexcept {
+    return rcp(1.0f + std::exp(-x / s));
+}
+
+static Float trimmedLogistic(const Float x, const Float s, const Float a, const Float b) noexcept {
+    return logistic(x, s) / (logisticCDF(b, s) - logisticCDF(a, s));
+}
+
+static Float sampleTrimmedLogistic(const Float u, const Float s, const Float a, const Float b) noexcept {
+    const auto k = logisticCDF(b, s) - logisticCDF(a, s);
+    return std::clamp(-s * std::log(rcp(u * k + logisticCDF(a, s)) - 1.0f), a, b);
+}
+
+// the azimuthal offset of the lobe p
+static Float azimuthOffset(const uint32_t p, const Float gammaO, const Float gammaT) noexcept {
+    return 2.0f * static_cast<Float>(p) * gammaT - 2.0f * gammaO + static_cast<Float>(p) * pi;
+}
+
+// the azimuthal scattering function Np
+static Float azimuthal(const Float phi, const uint32_t p, const Float s, const Float gammaO, const Float gammaT) noexcept {
+    auto dphi = phi - azimuthOffset(p, gammaO, gammaT);
+    while(dphi > pi)
+        dphi -= twoPi;
+    while(dphi < -pi)
+        dphi += twoPi;
+    return trimmedLogistic(dphi, s, -pi, pi);
+}
+
+// the absorption coefficients are in RGB, the lobes are upsampled to the sampled wavelengths after attenuation
+using HairLobes = std::array<glm::vec3, maxHairLobe + 1>;
+
+// the attenuation function Ap
+static HairLobes attenuation(const Float cosThetaO, const Float eta, const Float h, const glm::vec3& transmittance) noexcept {
+    HairLobes res;
+    const auto f = fresnelDielectric(cosThetaO * safeSqrt(1.0f - h * h), eta);
+    res[0] = glm::vec3{ f };
+    res[1] = sqr(1.0f - f) * transmittance;
+    for(uint32_t p = 2; p < maxHairLobe; ++p)
+        res[p] = res[p - 1] * transmittance * f;
+    res[maxHairLobe] = res[maxHairLobe - 1] * f * transmittance / (1.0f - transmittance * f);
+    return res;
+}
+
+// the mapping of the azimuthal roughness to the absorption of the hair with the given color
+static Float colorToAbsorption(const Float betaN) noexcept {
+    return 5.969f - 0.215f * betaN + 2.532f * sqr(betaN) - 10.73f * std::pow(betaN, 3.0f) + 5.574f * std::pow(betaN, 4.0f) +
+        0.245f * std::pow(betaN, 5.0f);
+}
+
+template <typename Setting>
+class HairBxDF final : public BxDF<Setting> {
+    PIPER_IMPORT_SETTINGS();
+    PIPER_IMPORT_SHADING();
+
+    Wavelength mSampledWavelength;
+    glm::vec3 mSigmaA;
+    Float mH, mGammaO, mEta, mS;
+    std::array<Float, maxHairLobe + 1> mV;
+    // the scale tilts of the lobes: alpha, 2 * alpha and 4 * alpha
+    std::array<Float, 3> mSin2kAlpha, mCos2kAlpha;
+
+    [[nodiscard]] std::pair<Float, Float> tilt(const uint32_t p, const Float sinThetaO, const Float cosThetaO) const noexcept {
+        switch(p) {
+            case 0:
+                return { sinThetaO * mCos2kAlpha[1] - cosThetaO * mSin2kAlpha[1],
+                         std::fabs(cosThetaO * mCos2kAlpha[1] + sinThetaO * mSin2kAlpha[1]) };
+            case 1:
+                return { sinThetaO * mCos2kAlpha[0] + cosThetaO * mSin2kAlpha[0],
+                         std::fabs(cosThetaO * mCos2kAlpha[0] - sinThetaO * mSin2kAlpha[0]) };
+            case 2:
+                return { sinThetaO * mCos2kAlpha[2] + cosThetaO * mSin2kAlpha[2],
+                         std::fabs(cosThetaO * mCos2kAlpha[2] - sinThetaO * mSin2kAlpha[2]) };
+            default:
+                return { sinThetaO, cosThetaO };
+        }
+    }
+
+    // the refracted azimuth gammaT and the transmittance of a single path through the fiber
+    [[nodiscard]] std::pair<Float, glm::vec3> refract(const Float sinThetaO, const Float cosThetaO) const noexcept {
+        const auto sinThetaT = sinThetaO / mEta;
+        const auto cosThetaT = safeSqrt(1.0f - sqr(sinThetaT));
+        const auto etaP = std::sqrt(sqr(mEta) - sqr(sinThetaO)) / cosThetaO;
+        const auto sinGammaT = std::clamp(mH / etaP, -1.0f, 1.0f);
+        const auto cosGammaT = safeSqrt(1.0f - sqr(sinGammaT));
+        return { std::asin(sinGammaT), glm::exp(-mSigmaA * (2.0f * cosGammaT / cosThetaT)) };
+    }
+
+    [[nodiscard]] std::array<Float, maxHairLobe + 1> lobePdf(const HairLobes& lobes) const noexcept {
+        std::array<Float, maxHairLobe + 1> res;
+        Float sum = 0.0f;
+        for(uint32_t p = 0; p <= maxHairLobe; ++p)
+            sum += res[p] = glm::dot(lobes[p], glm::vec3{ 0.2126f, 0.7152f, 0.0722f });
+        for(auto& pdf : res)
+            pdf = sum > 0.0f ? pdf / sum : rcp(static_cast<Float>(maxHairLobe + 1));
+        return res;
+    }
+
+    [[nodiscard]] Rational<Spectrum> upsample(const glm::vec3& lobe) const noexcept {
+        return Rational<Spectrum>::fromRaw(spectrumCast<Spectrum>(RGBSpectrum::fromRaw(lobe), mSampledWavelength));
+    }
+
+    [[nodiscard]] static BxDFDirection direction(const Direction& wo, const Direction& wi) noexcept {
+        return sameHemisphere(wo, wi) ? BxDFDirection::Reflection : BxDFDirection::Transmission;
+    }
+
+    [[nodiscard]] Float pdf(const Direction& wo, const Direction& wi) const noexcept {
+        const auto sinThetaO = wo.x(), cosThetaO = safeSqrt(1.0f - sqr(sinThetaO));
+        const auto sinThetaI = wi.x(), cosThetaI = safeSqrt(1.0f - sqr(sinThetaI));
+        const auto phi = std::atan2(wi.z(), wi.y()) - std::atan2(wo.z(), wo.y());
+        const auto [gammaT, transmittance] = refract(sinThetaO, cosThetaO);
+        const auto lobes = lobePdf(attenuation(cosThetaO, mEta, mH, transmittance));
+
+        Float res = 0.0f;
+        for(uint32_t p = 0; p < maxHairLobe; ++p) {
+            const auto [sinThetaOp, cosThetaOp] = tilt(p, sinThetaO, cosThetaO);
+            res += longitudinal(cosThetaI, cosThetaOp, sinThetaI, sinThetaOp, mV[p]) * lobes[p] * azimuthal(phi, p, mS, mGammaO, gammaT);
+        }
+        res += longitudinal(cosThetaI, cosThetaO, sinThetaI, sinThetaO, mV[maxHairLobe]) * lobes[maxHairLobe] * invTwoPi;
+        return res;
+    }
+
+public:
+    // h is the offset across the width of the fiber, the shading frame is (tangent, width, normal)
+    HairBxDF(const Wavelength& sampledWavelength, const Float h, const Float eta, const glm::vec3& sigmaA, const Float betaM,
+             const Float betaN, const Float alpha)
+        : mSampledWavelength{ sampledWavelength }, mSigmaA{ sigmaA }, mH{ h }, mGammaO{ std::asin(std::clamp(h, -1.0f, 1.0f)) },
+          mEta{ eta } {
+        mV[0] = sqr(0.726f * betaM + 0.812f * sqr(betaM) + 3.7f * std::pow(betaM, 20.0f));
+        mV[1] = 0.25f * mV[0];
+        mV[2] = 4.0f * mV[0];
+        for(uint32_t p = 3; p <= maxHairLobe; ++p)
+            mV[p] = mV[2];
+
+        constexpr auto sqrtPiOver8 = 0.626657069f;
+        mS = sqrtPiOver8 * (0.265f * betaN + 1.194f * sqr(betaN) + 5.372f * std::pow(betaN, 22.0f));
+
+        mSin2kAlpha[0] = std::sin(glm::radians(alpha));
+        mCos2kAlpha[0] = safeSqrt(1.0f - sqr(mSin2kAlpha[0]));
+        for(uint32_t i = 1; i < 3; ++i) {
+            mSin2kAlpha[i] = 2.0f * mCos2kAlpha[i - 1] * mSin2kAlpha[i - 1];
+            mCos2kAlpha[i] = sqr(mCos2kAlpha[i - 1]) - sqr(mSin2kAlpha[i - 1]);
+        }
+    }
+
+    [[nodiscard]] BxDFPart part() const noexcept override {
+        return BxDFPart::GlossyReflection | BxDFPart::GlossyTransmission;
+    }
+
+    Rational<Spectrum> evaluate(const Direction& wo, const Direction& wi, TransportMode transportMode) const noexcept override {
+        const auto sinThetaO = wo.x(), cosThetaO = safeSqrt(1.0f - sqr(sinThetaO));
+        const auto sinThetaI = wi.x(), cosThetaI = safeSqrt(1.0f - sqr(sinThetaI));
+        const auto phi = std::atan2(wi.z(), wi.y()) - std::atan2(wo.z(), wo.y());
+        const auto [gammaT, transmittance] = refract(sinThetaO, cosThetaO);
+        const auto lobes = attenuation(cosThetaO, mEta, mH, transmittance);
+
+        auto res = Rational<Spectrum>::zero();
+        for(uint32_t p = 0; p < maxHairLobe; ++p) {
+            const auto [sinThetaOp, cosThetaOp] = tilt(p, sinThetaO, cosThetaO);
+            res += upsample(lobes[p]) *
+                (longitudinal(cosThetaI, cosThetaOp, sinThetaI, sinThetaOp, mV[p]) * azimuthal(phi, p, mS, mGammaO, gammaT));
+        }
+        res += upsample(lobes[maxHairLobe]) * (longitudinal(cosThetaI, cosThetaO, sinThetaI, sinThetaO, mV[maxHairLobe]) * invTwoPi);
+
+        // the integrators apply the cosine term of the shading normal
+        if(const auto cosTheta = absCosTheta(wi); cosTheta > 0.0f)
+            res = res * rcp(cosTheta);
+        return res;
+    }
+
+    BSDFSample sample(SampleProvider& sampler, const Direction& wo, const TransportMode transportMode,
+                      const BxDFDirection sampleDirection) const noexcept override {
+        const auto sinThetaO = wo.x(), cosThetaO = safeSqrt(1.0f - sqr(sinThetaO));
+        const auto phiO = std::atan2(wo.z(), wo.y());
+        const auto [gammaT, transmittance] = refract(sinThetaO, cosThetaO);
+        const auto lobes = lobePdf(attenuation(cosThetaO, mEta, mH, transmittance));
+
+        auto u0 = sampler.sampleVec2();
+        auto u1 = sampler.sampleVec2();
+        uint32_t p = 0;
+        for(; p < maxHairLobe; ++p) {
+            if(u0.x < lobes[p])
+                break;
+            u0.x -= lobes[p];
+        }
+
+        // sample Mp for thetaI
+        const auto [sinThetaOp, cosThetaOp] = tilt(p, sinThetaO, cosThetaO);
+        u1.x = std::fmax(u1.x, 1e-5f);
+        const auto cosTheta = 1.0f + mV[p] * std::log(u1.x + (1.0f - u1.x) * std::exp(-2.0f / mV[p]));
+        const auto sinTheta = safeSqrt(1.0f - sqr(cosTheta));
+        const auto sinThetaI = std::clamp(-cosTheta * sinThetaOp + sinTheta * std::cos(twoPi * u1.y) * cosThetaOp, -1.0f, 1.0f);
+        const auto cosThetaI = safeSqrt(1.0f - sqr(sinThetaI));
+
+        // sample Np for phiI
+        const auto dphi =
+            p < maxHairLobe ? azimuthOffset(p, mGammaO, gammaT) + sampleTrimmedLogistic(u0.y, mS, -pi, pi) : twoPi * u0.y;
+        const auto phiI = phiO + dphi;
+        const auto wi = Direction::fromRaw({ sinThetaI, cosThetaI * std::cos(phiI), cosThetaI * std::sin(phiI) });
+
+        const auto side = direction(wo, wi);
+        const auto inversePdf = InversePdfValue::fromPdf(pdf(wo, wi));
+        if(!match(sampleDirection, side) || !inversePdf.valid())
+            return BSDFSample::invalid();
+        return { wi, importanceSampled<PdfType::BSDF>(evaluate(wo, wi, transportMode)), inversePdf,
+                 side == BxDFDirection::Reflection ? BxDFPart::GlossyReflection : BxDFPart::GlossyTransmission };
+    }
+
+    [[nodiscard]] InversePdfValue inversePdf(const Direction& wo, const Direction& wi, const TransportMode transportMode,
+                                             const BxDFDirection sampleDirection) const noexcept override {
+        if(!match(sampleDirection, direction(wo, wi)))
+            return InversePdfValue::invalid();
+        return InversePdfValue::fromPdf(pdf(wo, wi));
+    }
+};
+
+// the fibers are expected to be curves, whose texCoord.y is the offset across the width
+template <typename Setting>
+class Hair final : public Material<Setting> {
+    PIPER_IMPORT_SETTINGS();
+    PIPER_IMPORT_SHADING();
+
+    Float mEta = 1.55f;
+    Float mBetaM = 0.3f;
+    Float mBetaN = 0.3f;
+    // the tilt of the cuticle scales in degrees
+    Float mAlpha = 2.0f;
+    glm::vec3 mSigmaA;
+
+public:
+    explicit Hair(const Ref<ConfigNode>& node) {
+        if(const auto ptr = node->tryGet("Eta"sv))
+            mEta = (*ptr)->as<Float>();
+        if(const auto ptr = node->tryGet("BetaM"sv))
+            mBetaM = std::clamp((*ptr)->as<Float>(), 0.0f, 1.0f);
+        if(const auto ptr = node->tryGet("BetaN"sv))
+            mBetaN = std::clamp((*ptr)->as<Float>(), 0.0f, 1.0f);
+        if(const auto ptr = node->tryGet("Alpha"sv))
+            mAlpha = (*ptr)->as<Float>();
+
+        // the absorption is given directly, by the color or by the concentrations of the melanins
+        if(const auto ptr = node->tryGet("Absorption"sv))
+            mSigmaA = glm::max(parseVec3(*ptr), glm::vec3{ 0.0f });
+        else if(const auto colorPtr = node->tryGet("Color"sv)) {
+            const auto color = glm::clamp(parseVec3(*colorPtr), glm::vec3{ 1e-4f }, glm::vec3{ 1.0f });
+            mSigmaA = glm::pow(glm::log(color) / colorToAbsorption(mBetaN), glm::vec3{ 2.0f });
+        } else {
+            Float eumelanin = 1.3f, pheomelanin = 0.0f;
+            if(const auto eumelaninPtr = node->tryGet("Eumelanin"sv))
+                eumelanin = (*eumelaninPtr)->as<Float>();
+            if(const auto pheomelaninPtr = node->tryGet("Pheomelanin"sv))
+                pheomelanin = (*pheomelaninPtr)->as<Float>();
+            mSigmaA = eumelanin * glm::vec3{ 0.419f, 0.697f, 1.37f } + pheomelanin * glm::vec3{ 0.187f, 0.4f, 1.05f };
+        }
+    }
+
+    BSDF<Setting> evaluate(const Wavelength& sampledWavelength, const SurfaceHit& intersection) const noexcept override {
+        const auto h = std::clamp(2.0f * intersection.texCoord.y - 1.0f, -1.0f, 1.0f);
+        return BSDF<Setting>{ ShadingFrame{ intersection.shadingNormal.asDirection(), intersection.dpdu },
+                              HairBxDF<Setting>{ sampledWavelength, h, mEta, mSigmaA, mBetaM, mBetaN, mAlpha } };
+    }
+
+    [[nodiscard]] RGBSpectrum estimateAlbedo(const SurfaceHit&) const noexcept override {
+        return RGBSpectrum::fromRaw(glm::exp(-glm::sqrt(mSigmaA) * colorToAbsorption(mBetaN)));
+    }
+};
+
+PIPER_REGISTER_VARIANT(Hair, Material);
+
+PIPER_NAMESPACE_END
@@ -0,0 +1,392 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/FileIO.hpp>
+#include <Piper/Core/Report.hpp>
+#include <Piper/Render/BxDFs.hpp>
+#include <Piper/Render/Material.hpp>
+#include <Piper/Render/Texture.hpp>
+#include <algorithm>
+
+PIPER_NAMESPACE_BEGIN
+
+// The tabulated isotropic BSDF (little endian):
+//   char[4] "PBTF", uint32 thetaO, thetaI, phi, channels, float lambdaMin, lambdaMax
+//   float values[thetaO][thetaI][phi][channels]
+// The directions are measured in the shading frame with wo flipped to the upper hemisphere. The vertices of the grid are uniformly
+// spaced over thetaO in [0, pi/2], thetaI in [0, pi] (the lower half is the transmission) and the difference of the azimuths in
+// [0, pi]. The values exclude the cosine term. 3 channels are linear RGB, the others are uniformly spaced over [lambdaMin, lambdaMax].
+class TabulatedBSDFData final {
+    uint32_t mThetaO = 0, mThetaI = 0, mPhi = 0, mChannels = 0;
+    Float mLambdaMin = 0.0f, mLambdaMax = 0.0f;
+    std::pmr::vector<Float> mValues{ context().globalAllocator };
+    // the piecewise-constant importance sampling tables over the cells of (thetaI, phi) for each vertex of thetaO
+    std::pmr::vector<Float> mMarginal{ context().globalAllocator };     // [thetaO][thetaI cells + 1]
+    std::pmr::vector<Float> mConditional{ context().globalAllocator };  // [thetaO][thetaI cells][phi cells + 1]
+    bool mTransmission = false;
+
+    [[nodiscard]] const Float* entry(const uint32_t o, const uint32_t i, const uint32_t p) const noexcept {
+        return mValues.data() + ((static_cast<size_t>(o) * mThetaI + i) * mPhi + p) * mChannels;
+    }
+
+    [[nodiscard]] Float lumaOf(const Float* values) const noexcept {
+        if(mChannels == 3)
+            return 0.2126f * values[0] + 0.7152f * values[1] + 0.0722f * values[2];
+        Float sum = 0.0f;
+        for(uint32_t c = 0; c < mChannels; ++c)
+            sum += values[c];
+        return sum / static_cast<Float>(mChannels);
+    }
+
+    [[nodiscard]] Float cellCosTheta(const uint32_t i) const noexcept {
+        return std::cos(static_cast<Float>(i) * pi / static_cast<Float>(mThetaI - 1));
+    }
+
+    [[nodiscard]] Float phiStep() const noexcept {
+        return pi / static_cast<Float>(mPhi - 1);
+    }
+
+    [[nodiscard]] uint32_t nearestThetaO(const Float cosThetaO) const noexcept {
+        const auto x = std::acos(std::clamp(cosThetaO, 0.0f, 1.0f)) / halfPi * static_cast<Float>(mThetaO - 1);
+        return std::min(static_cast<uint32_t>(x + 0.5f), mThetaO - 1);
+    }
+
+    void buildSamplingTables() {
+        const auto cellsI = mThetaI - 1, cellsP = mPhi - 1;
+        mMarginal.assign(static_cast<size_t>(mThetaO) * (cellsI + 1), 0.0f);
+        mConditional.assign(static_cast<size_t>(mThetaO) * cellsI * (cellsP + 1), 0.0f);
+
+        for(uint32_t o = 0; o < mThetaO; ++o) {
+            auto marginal = mMarginal.data() + static_cast<size_t>(o) * (cellsI + 1);
+            for(uint32_t i = 0; i < cellsI; ++i) {
+                // the weights are proportional to f * |cos| over the solid angle of each cell
+                const auto cosA = cellCosTheta(i), cosB = cellCosTheta(i + 1);
+                const auto measure = std::fabs(cosA - cosB) * std::fabs(0.5f * (cosA + cosB));
+                auto conditional = mConditional.data() + (static_cast<size_t>(o) * cellsI + i) * (cellsP + 1);
+                for(uint32_t p = 0; p < cellsP; ++p) {
+                    const auto luma = lumaOf(entry(o, i, p)) + lumaOf(entry(o, i + 1, p)) + lumaOf(entry(o, i, p + 1)) +
+                        lumaOf(entry(o, i + 1, p + 1));
+                    conditional[p + 1] = conditional[p] + std::fmax(luma, 0.0f) * 0.25f * measure;
+                }
+                marginal[i + 1] = marginal[i] + conditional[cellsP];
+                if(conditional[cellsP] > 0.0f)
+                    for(uint32_t p = 1; p <= cellsP; ++p)
+                        conditional[p] /= conditional[cellsP];
+            }
+            if(marginal[cellsI] > 0.0f)
+                for(uint32_t i = 1; i <= cellsI; ++i)
+                    marginal[i] /= marginal[cellsI];
+        }
+    }
+
+    // returns the index of the cell and remaps u into it
+    static uint32_t sampleCDF(const Float* cdf, const uint32_t cells, Float& u) noexcept {
+        const auto idx = static_cast<uint32_t>(std::clamp<std::ptrdiff_t>(std::upper_bound(cdf, cdf + cells + 1, u) - cdf - 1, 0,
+                                                                            static_cast<std::ptrdiff_t>(cells) - 1));
+        const auto width = cdf[idx + 1] - cdf[idx];
+        u = width > 0.0f ? std::clamp((u - cdf[idx]) / width, 0.0f, oneMinusEpsilon) : 0.5f;
+        return idx;
+    }
+
+public:
+    explicit TabulatedBSDFData(const std::string_view path) {
+        const auto data = loadData(path);
+        struct Header final {
+            char magic[4];
+            uint32_t thetaO, thetaI, phi, channels;
+            float lambdaMin, lambdaMax;
+        } header{};
+        if(data.size() < sizeof(Header))
+            fatal(fmt::format("Invalid tabulated BSDF \"{}\"", path));
+        memcpy(&header, data.data(), sizeof(Header));
+        if(std::string_view{ header.magic, 4 } != "PBTF"sv || header.thetaO < 1 || header.thetaI < 2 || header.phi < 2 ||
+           header.channels < 2 || (header.channels != 3 && !(header.lambdaMin < header.lambdaMax)))
+            fatal(fmt::format("Invalid tabulated BSDF \"{}\"", path));
+
+        mThetaO = header.thetaO;
+        mThetaI = header.thetaI;
+        mPhi = header.phi;
+        mChannels = header.channels;
+        mLambdaMin = header.lambdaMin;
+        mLambdaMax = header.lambdaMax;
+
+        const auto count = static_cast<size_t>(mThetaO) * mThetaI * mPhi * mChannels;
+        if(data.size() != sizeof(Header) + count * sizeof(float))
+            fatal(fmt::format("Invalid tabulated BSDF \"{}\": expect {} values", path, count));
+        mValues.resize(count);
+        memcpy(mValues.data(), data.data() + sizeof(Header), count * sizeof(float));
+
+        for(uint32_t o = 0; o < mThetaO && !mTransmission; ++o)
+            for(uint32_t i = (mThetaI + 1) / 2; i < mThetaI && !mTransmission; ++i)
+                for(uint32_t p = 0; p < mPhi; ++p)
+                    mTransmission |= lumaOf(entry(o, i, p)) > 0.0f;
+
+        buildSamplingTables();
+    }
+
+    [[nodiscard]] bool isRGB() const noexcept {
+        return mChannels == 3;
+    }
+
+    [[nodiscard]] bool hasTransmission() const noexcept {
+        return mTransmission;
+    }
+
+    // the spectral tables are reduced to RGB for the non-spectral variants
+    template <typename Callable>
+    void convertToRGB(Callable&& toRGB) {
+        std::pmr::vector<Float> rgb{ static_cast<size_t>(mThetaO) * mThetaI * mPhi * 3, context().globalAllocator };
+        for(size_t idx = 0; idx * mChannels < mValues.size(); ++idx) {
+            const auto value = std::invoke(toRGB, std::span<const Float>{ mValues.data() + idx * mChannels, mChannels });
+            rgb[idx * 3 + 0] = value.raw().r;
+            rgb[idx * 3 + 1] = value.raw().g;
+            rgb[idx * 3 + 2] = value.raw().b;
+        }
+        mValues = std::move(rgb);
+        mChannels = 3;
+    }
+
+    // the value of a spectral entry at the given wavelength
+    [[nodiscard]] Float interpolateChannel(const Float* values, const Float lambda) const noexcept {
+        const auto x = std::clamp((lambda - mLambdaMin) / (mLambdaMax - mLambdaMin), 0.0f, 1.0f) * static_cast<Float>(mChannels - 1);
+        const auto c = std::min(static_cast<uint32_t>(x), mChannels - 2);
+        const auto u = x - static_cast<Float>(c);
+        return values[c] * (1.0f - u) + values[c + 1] * u;
+    }
+
+    [[nodiscard]] Float interpolateChannel(const std::span<const Float> values, const Float lambda) const noexcept {
+        return interpolateChannel(values.data(), lambda);
+    }
+
+    // the corners of the trilinear interpolation
+    struct Corners final {
+        std::array<const Float*, 8> values;
+        std::array<Float, 8> weights;
+    };
+
+    // wo and wi are flipped so that wo lies in the upper hemisphere
+    [[nodiscard]] Corners locate(const glm::vec3 wo, const glm::vec3 wi) const noexcept {
+        const auto thetaO = std::acos(std::clamp(wo.z, 0.0f, 1.0f));
+        const auto thetaI = std::acos(std::clamp(wi.z, -1.0f, 1.0f));
+        auto phi = std::fabs(std::atan2(wi.y, wi.x) - std::atan2(wo.y, wo.x));
+        if(phi > pi)
+            phi = twoPi - phi;
+
+        const auto split = [](const Float x, const uint32_t size) {
+            const auto scaled = std::clamp(x, 0.0f, 1.0f) * static_cast<Float>(size - 1);
+            const auto idx = std::min(static_cast<uint32_t>(scaled), size > 1 ? size - 2 : 0U);
+            return std::pair{ idx, size > 1 ? scaled - static_cast<Float>(idx) : 0.0f };
+        };
+        const auto [o, uo] = split(thetaO / halfPi, mThetaO);
+        const auto [i, ui] = split(thetaI / pi, mThetaI);
+        const auto [p, up] = split(phi / pi, mPhi);
+        const auto o1 = std::min(o + 1, mThetaO - 1);
+
+        Corners corners{};
+        for(uint32_t k = 0; k < 8; ++k) {
+            const auto bo = (k & 1) != 0, bi = (k & 2) != 0, bp = (k & 4) != 0;
+            corners.values[k] = entry(bo ? o1 : o, i + bi, p + bp);
+            corners.weights[k] = (bo ? uo : 1.0f - uo) * (bi ? ui : 1.0f - ui) * (bp ? up : 1.0f - up);
+        }
+        return corners;
+    }
+
+    [[nodiscard]] glm::vec3 gatherRGB(const Corners& corners) const noexcept {
+        auto res = glm::zero<glm::vec3>();
+        for(uint32_t k = 0; k < 8; ++k)
+            res += corners.weights[k] * glm::vec3{ corners.values[k][0], corners.values[k][1], corners.values[k][2] };
+        return res;
+    }
+
+    [[nodiscard]] Float gather(const Corners& corners, const Float lambda) const noexcept {
+        Float res = 0.0f;
+        for(uint32_t k = 0; k < 8; ++k)
+            res += corners.weights[k] * interpolateChannel(corners.values[k], lambda);
+        return res;
+    }
+
+    // the integral of f * |cos| over the sphere of wi for the vertex o of thetaO, per channel
+    // NOTICE: the range of the azimuth difference is mirrored, so the cells cover 2 * phiStep
+    [[nodiscard]] std::pmr::vector<Float> directionalAlbedo(const uint32_t o) const {
+        std::pmr::vector<Float> res{ mChannels, 0.0f, context().globalAllocator };
+        for(uint32_t i = 0; i + 1 < mThetaI; ++i) {
+            const auto cosA = cellCosTheta(i), cosB = cellCosTheta(i + 1);
+            const auto measure = std::fabs(cosA - cosB) * std::fabs(0.5f * (cosA + cosB)) * 2.0f * phiStep();
+            for(uint32_t p = 0; p + 1 < mPhi; ++p) {
+                const std::array corners{ entry(o, i, p), entry(o, i + 1, p), entry(o, i, p + 1), entry(o, i + 1, p + 1) };
+                for(uint32_t c = 0; c < mChannels; ++c)
+                    res[c] += 0.25f * (corners[0][c] + corners[1][c] + corners[2][c] + corners[3][c]) * measure;
+            }
+        }
+        return res;
+    }
+
+    // returns the flipped wi and its pdf
+    [[nodiscard]] std::pair<glm::vec3, Float> sample(const glm::vec3 wo, glm::vec4 u) const noexcept {
+        const auto cellsI = mThetaI - 1, cellsP = mPhi - 1;
+        const auto o = nearestThetaO(wo.z);
+        const auto marginal = mMarginal.data() + static_cast<size_t>(o) * (cellsI + 1);
+        if(marginal[cellsI] <= 0.0f)
+            return { glm::vec3{ 0.0f }, 0.0f };
+
+        const auto i = sampleCDF(marginal, cellsI, u.x);
+        const auto conditional = mConditional.data() + (static_cast<size_t>(o) * cellsI + i) * (cellsP + 1);
+        const auto p = sampleCDF(conditional, cellsP, u.y);
+
+        // the sign of the azimuth difference is chosen by the remapped u.x
+        const auto sign = u.x < 0.5f ? 1.0f : -1.0f;
+        const auto cosA = cellCosTheta(i), cosB = cellCosTheta(i + 1);
+        const auto cosThetaI = cosA + (cosB - cosA) * u.z;
+        const auto sinThetaI = std::sqrt(std::fmax(0.0f, 1.0f - cosThetaI * cosThetaI));
+        const auto phi = std::atan2(wo.y, wo.x) + sign * (static_cast<Float>(p) + u.w) * phiStep();
+
+        const auto pdf = (marginal[i + 1] - marginal[i]) * (conditional[p + 1] - conditional[p]) /
+            (2.0f * phiStep() * std::fabs(cosA - cosB));
+        return { { sinThetaI * std::cos(phi), sinThetaI * std::sin(phi), cosThetaI }, pdf };
+    }
+
+    [[nodiscard]] Float pdf(const glm::vec3 wo, const glm::vec3 wi) const noexcept {
+        const auto cellsI = mThetaI - 1, cellsP = mPhi - 1;
+        const auto o = nearestThetaO(wo.z);
+        const auto marginal = mMarginal.data() + static_cast<size_t>(o) * (cellsI + 1);
+        if(marginal[cellsI] <= 0.0f)
+            return 0.0f;
+
+        const auto thetaI = std::acos(std::clamp(wi.z, -1.0f, 1.0f));
+        auto phi = std::fabs(std::atan2(wi.y, wi.x) - std::atan2(wo.y, wo.x));
+        if(phi > pi)
+            phi = twoPi - phi;
+        const auto i = std::min(static_cast<uint32_t>(thetaI / pi * static_cast<Float>(cellsI)), cellsI - 1);
+        const auto p = std::min(static_cast<uint32_t>(phi / pi * static_cast<Float>(cellsP)), cellsP - 1);
+        const auto conditional = mConditional.data() + (static_cast<size_t>(o) * cellsI + i) * (cellsP + 1);
+
+        const auto cosA = cellCosTheta(i), cosB = cellCosTheta(i + 1);
+        return (marginal[i + 1] - marginal[i]) * (conditional[p + 1] - conditional[p]) / (2.0f * phiStep() * std::fabs(cosA - cosB));
+    }
+};
+
+template <typename Setting>
+class TabulatedBxDF final : public BxDF<Setting> {
+    PIPER_IMPORT_SETTINGS();
+    PIPER_IMPORT_SHADING();
+
+    const TabulatedBSDFData* mData;
+    Wavelength mSampledWavelength;
+
+    [[nodiscard]] Rational<Spectrum> lookup(const glm::vec3 wo, const glm::vec3 wi) const noexcept {
+        const auto corners = mData->locate(wo, wi);
+        if constexpr(isSampledSpectrum<Spectrum> || std::is_same_v<Spectrum, MonoWavelengthSpectrum>) {
+            if(!mData->isRGB()) {
+                // the corners are shared by all wavelengths, only the interpolation along the channels differs per lane
+                auto res = mSampledWavelength.raw();
+                if constexpr(isSampledSpectrum<Spectrum>) {
+                    for(int32_t idx = 0; idx < Spectrum::nSamples; ++idx)
+                        res[idx] = mData->gather(corners, res[idx]);
+                } else
+                    res = mData->gather(corners, res);
+                return Rational<Spectrum>::fromRaw(Spectrum::fromRaw(res));
+            }
+        }
+        const auto rgb = RGBSpectrum::fromRaw(glm::max(mData->gatherRGB(corners), glm::zero<glm::vec3>()));
+        return Rational<Spectrum>::fromRaw(spectrumCast<Spectrum>(rgb, mSampledWavelength));
+    }
+
+public:
+    TabulatedBxDF(const TabulatedBSDFData& data, const Wavelength& sampledWavelength)
+        : mData{ &data }, mSampledWavelength{ sampledWavelength } {}
+
+    [[nodiscard]] BxDFPart part() const noexcept override {
+        return mData->hasTransmission() ? BxDFPart::GlossyReflection | BxDFPart::GlossyTransmission : BxDFPart::GlossyReflection;
+    }
+
+    Rational<Spectrum> evaluate(const Direction& wo, const Direction& wi, TransportMode) const noexcept override {
+        const auto flip = wo.z() < 0.0f ? -1.0f : 1.0f;
+        const glm::vec3 flipZ{ 1.0f, 1.0f, flip };
+        return lookup(wo.raw() * flipZ, wi.raw() * flipZ);
+    }
+
+    BSDFSample sample(SampleProvider& sampler, const Direction& wo, const TransportMode transportMode,
+                      const BxDFDirection sampleDirection) const noexcept override {
+        const auto flip = wo.z() < 0.0f ? -1.0f : 1.0f;
+        const glm::vec3 flipZ{ 1.0f, 1.0f, flip };
+        const auto [wiRaw, pdf] = mData->sample(wo.raw() * flipZ, sampler.sampleVec4());
+        if(pdf <= 0.0f)
+            return BSDFSample::invalid();
+
+        const auto wi = Direction::fromRaw(wiRaw * flipZ);
+        const auto reflection = sameHemisphere(wo, wi);
+        if(!match(sampleDirection, reflection ? BxDFDirection::Reflection : BxDFDirection::Transmission))
+            return BSDFSample::invalid();
+        return { wi, importanceSampled<PdfType::BSDF>(evaluate(wo, wi, transportMode)), InversePdfValue::fromPdf(pdf),
+                 reflection ? BxDFPart::GlossyReflection : BxDFPart::GlossyTransmission };
+    }
+
+    [[nodiscard]] InversePdfValue inversePdf(const Direction& wo, const Direction& wi, TransportMode,
+                                             const BxDFDirection sampleDirection) const noexcept override {
+        if(!match(sampleDirection, sameHemisphere(wo, wi) ? BxDFDirection::Reflection : BxDFDirection::Transmission))
+            return InversePdfValue::invalid();
+        const auto flip = wo.z() < 0.0f ? -1.0f : 1.0f;
+        const glm::vec3 flipZ{ 1.0f, 1.0f, flip };
+        return InversePdfValue::fromPdf(mData->pdf(wo.raw() * flipZ, wi.raw() * flipZ));
+    }
+};
+
+template <typename Setting>
+class Tabulated final : public Material<Setting> {
+    PIPER_IMPORT_SETTINGS();
+    PIPER_IMPORT_SHADING();
+
+    TabulatedBSDFData mData;
+    RGBSpectrum mAlbedo = RGBSpectrum::undefined();
+
+public:
+    explicit Tabulated(const Ref<ConfigNode>& node) : mData{ node->get("FilePath"sv)->as<std::string_view>() } {
+        const auto toRGB = [&](const std::span<const Float> values) {
+            return Impl::averageRGBResponse<SampledSpectrum>(16, [&](const SampledSpectrum& sampledWavelength) {
+                auto res = sampledWavelength.raw();
+                for(int32_t idx = 0; idx < SampledSpectrum::nSamples; ++idx)
+                    res[idx] = mData.interpolateChannel(values, res[idx]);
+                return SampledSpectrum::fromRaw(res);
+            });
+        };
+        if constexpr(!isSpectral) {
+            if(!mData.isRGB())
+                mData.convertToRGB(toRGB);
+        }
+
+        // the hits carry no outgoing direction, so the albedo is estimated at normal incidence
+        const auto albedo = mData.directionalAlbedo(0);
+        const auto rgb = mData.isRGB() ? glm::vec3{ albedo[0], albedo[1], albedo[2] } : toRGB(albedo).raw();
+        mAlbedo = RGBSpectrum::fromRaw(glm::clamp(rgb, glm::zero<glm::vec3>(), glm::one<glm::vec3>()));
+    }
+
+    BSDF<Setting> evaluate(const Wavelength& sampledWavelength, const SurfaceHit& intersection) const noexcept override {
+        return BSDF<Setting>{ ShadingFrame{ intersection.shadingNormal.asDirection(), intersection.dpdu },
+                              TabulatedBxDF<Setting>{ mData, sampledWavelength } };
+    }
+
+    [[nodiscard]] RGBSpectrum estimateAlbedo(const SurfaceHit&) const noexcept override {
+        return mAlbedo;
+    }
+};
+
+PIPER_REGISTER_VARIANT(Tabulated, Material);
+
+PIPER_NAMESPACE_END
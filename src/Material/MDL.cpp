@@ -0,0 +1,424 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifdef PIPER_WITH_MDL
+
+#include <Piper/Core/FileIO.hpp>
+#include <Piper/Core/Report.hpp>
+#include <Piper/Render/Material.hpp>
+#include <Piper/Render/SpectrumUtil.hpp>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+#include <mi/mdl_sdk.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+// Please refer to https://raytracing-docs.nvidia.com/mdl/api/index.html
+
+PIPER_NAMESPACE_BEGIN
+
+namespace mdl = mi::neuraylib;
+
+// the BSDF of a material compiled by the native backend, the indices of the generated functions are fixed by translate_material_df
+struct MDLCompiledMaterial final {
+    mi::base::Handle<const mdl::ITarget_code> code;
+    static constexpr mi::Size bsdfInit = 0, bsdfSample = 1, bsdfEvaluate = 2, bsdfPdf = 3;
+};
+
+class MDLRuntime final {
+    void* mLibrary = nullptr;
+    mi::base::Handle<mdl::INeuray> mNeuray;
+    mi::base::Handle<mdl::ITransaction> mTransaction;
+    mi::base::Handle<mdl::IMdl_factory> mFactory;
+    mi::base::Handle<mdl::IMdl_impexp_api> mImpExp;
+    mi::base::Handle<mdl::IMdl_backend> mBackend;
+    std::string mVersion;
+
+    std::mutex mMutex;
+    std::unordered_map<std::string, std::unique_ptr<MDLCompiledMaterial>> mMaterials;
+
+    static void* loadSymbol(void* library, const char* name) {
+#ifdef _WIN32
+        return reinterpret_cast<void*>(GetProcAddress(static_cast<HMODULE>(library), name));
+#else
+        return dlsym(library, name);
+#endif
+    }
+
+    static void checkContext(const mdl::IMdl_execution_context* ctx, const std::string_view what) {
+        std::string messages;
+        for(mi::Size idx = 0; idx < ctx->get_messages_count(); ++idx) {
+            const mi::base::Handle<const mdl::IMessage> message{ ctx->get_message(idx) };
+            messages += fmt::format("\n{}", message->get_string());
+        }
+        if(ctx->get_error_messages_count())
+            fatal(fmt::format("MDL: failed to {}{}", what, messages));
+        if(!messages.empty())
+            warning(fmt::format("MDL: {}{}", what, messages));
+    }
+
+    MDLRuntime() {
+        const auto libraryName = "libmdl_sdk" MI_BASE_DLL_FILE_EXT;
+#ifdef _WIN32
+        mLibrary = LoadLibraryA(libraryName);
+#else
+        mLibrary = dlopen(libraryName, RTLD_LAZY);
+#endif
+        if(!mLibrary)
+            fatal(fmt::format("MDL: failed to load {}", libraryName));
+
+        mNeuray = mi::base::Handle<mdl::INeuray>{ mdl::mi_factory<mdl::INeuray>(loadSymbol(mLibrary, "mi_factory")) };
+        if(!mNeuray)
+            fatal("MDL: incompatible MDL SDK");
+
+        const mi::base::Handle<mdl::IMdl_configuration> config{ mNeuray->get_api_component<mdl::IMdl_configuration>() };
+        config->add_mdl_system_paths();
+        config->add_mdl_user_paths();
+        const mi::base::Handle<mdl::IPlugin_configuration> plugins{ mNeuray->get_api_component<mdl::IPlugin_configuration>() };
+        if(plugins->load_plugin_library("nv_openimageio" MI_BASE_DLL_FILE_EXT) != 0)
+            warning("MDL: failed to load the image plugin, the textures of MDL materials are unavailable");
+
+        if(mNeuray->start() != 0)
+            fatal("MDL: failed to start the MDL SDK");
+        mVersion = mNeuray->get_version();
+
+        const mi::base::Handle<mdl::IDatabase> database{ mNeuray->get_api_component<mdl::IDatabase>() };
+        const mi::base::Handle<mdl::IScope> scope{ database->get_global_scope() };
+        mTransaction = mi::base::Handle<mdl::ITransaction>{ scope->create_transaction() };
+        mFactory = mi::base::Handle<mdl::IMdl_factory>{ mNeuray->get_api_component<mdl::IMdl_factory>() };
+        mImpExp = mi::base::Handle<mdl::IMdl_impexp_api>{ mNeuray->get_api_component<mdl::IMdl_impexp_api>() };
+
+        const mi::base::Handle<mdl::IMdl_backend_api> backendApi{ mNeuray->get_api_component<mdl::IMdl_backend_api>() };
+        mBackend = mi::base::Handle<mdl::IMdl_backend>{ backendApi->get_backend(mdl::IMdl_backend_api::MB_NATIVE) };
+        mBackend->set_option("num_texture_spaces", "1");
+        mBackend->set_option("num_texture_results", "16");
+        mBackend->set_option("use_builtin_resource_handler", "on");
+        mBackend->set_option("opt_level", "2");
+    }
+
+public:
+    MDLRuntime(const MDLRuntime&) = delete;
+    MDLRuntime(MDLRuntime&&) = delete;
+    MDLRuntime& operator=(const MDLRuntime&) = delete;
+    MDLRuntime& operator=(MDLRuntime&&) = delete;
+    ~MDLRuntime() = default;
+
+    const MDLCompiledMaterial& compile(const std::string_view moduleName, const std::string_view materialName,
+                                       const std::string_view searchPath) {
+        const auto key = fmt::format("{}::{}", moduleName, materialName);
+
+        std::lock_guard guard{ mMutex };
+        if(const auto iter = mMaterials.find(key); iter != mMaterials.cend())
+            return *iter->second;
+
+        if(!searchPath.empty()) {
+            const mi::base::Handle<mdl::IMdl_configuration> config{ mNeuray->get_api_component<mdl::IMdl_configuration>() };
+            config->add_mdl_path(resolvePath(searchPath).c_str());
+        }
+
+        const mi::base::Handle<mdl::IMdl_execution_context> ctx{ mFactory->create_execution_context() };
+        const auto moduleNameStr = std::string{ moduleName };
+        mImpExp->load_module(mTransaction.get(), moduleNameStr.c_str(), ctx.get());
+        checkContext(ctx.get(), fmt::format("load module {}", moduleName));
+
+        const mi::base::Handle<const mi::IString> dbModuleName{ mFactory->get_db_module_name(moduleNameStr.c_str()) };
+        const mi::base::Handle<const mdl::IModule> module{ mTransaction->access<mdl::IModule>(dbModuleName->get_c_str()) };
+        const auto dbMaterialName = fmt::format("{}::{}", dbModuleName->get_c_str(), materialName);
+        const mi::base::Handle<const mi::IArray> overloads{ module->get_function_overloads(dbMaterialName.c_str()) };
+        if(!overloads || overloads->get_length() == 0)
+            fatal(fmt::format("MDL: material {} is not found", key));
+        const mi::base::Handle<const mi::IString> overload{ overloads->get_element<mi::IString>(0) };
+
+        const mi::base::Handle<const mdl::IFunction_definition> definition{ mTransaction->access<mdl::IFunction_definition>(
+            overload->get_c_str()) };
+        mi::Sint32 result = 0;
+        const mi::base::Handle<mdl::IFunction_call> call{ definition->create_function_call(nullptr, &result) };
+        if(result != 0)
+            fatal(fmt::format("MDL: failed to instantiate material {} with the default arguments", key));
+
+        // the instance compilation folds the arguments into the generated code
+        const mi::base::Handle<const mdl::IMaterial_instance> instance{ call->get_interface<mdl::IMaterial_instance>() };
+        const mi::base::Handle<const mdl::ICompiled_material> compiled{
+            instance->create_compiled_material(mdl::IMaterial_instance::DEFAULT_OPTIONS, ctx.get())
+        };
+        checkContext(ctx.get(), fmt::format("compile material {}", key));
+
+        auto material = std::make_unique<MDLCompiledMaterial>();
+        material->code = loadOrTranslate(compiled.get(), ctx.get(), key);
+        return *mMaterials.emplace(key, std::move(material)).first->second;
+    }
+
+    static MDLRuntime& get() {
+        // never destroyed, the generated code may be still referenced by the materials at exit
+        static auto* inst = new MDLRuntime;
+        return *inst;
+    }
+
+private:
+    // the generated code is cached on disk by the hash of the compiled material and the version of the SDK
+    mi::base::Handle<const mdl::ITarget_code> loadOrTranslate(const mdl::ICompiled_material* compiled, mdl::IMdl_execution_context* ctx,
+                                                                const std::string_view key) {
+        const auto& cacheDirectory = RenderGlobalSetting::get().materialCacheDirectory;
+        fs::path cachePath;
+        if(!cacheDirectory.empty()) {
+            const auto hash = compiled->get_hash();
+            const auto versionHash = std::hash<std::string>{}(mVersion);
+            cachePath = cacheDirectory /
+                fmt::format("{:08x}{:08x}{:08x}{:08x}-{:016x}.mdlc", hash.m_id1, hash.m_id2, hash.m_id3, hash.m_id4, versionHash);
+
+            if(fs::exists(cachePath)) {
+                const MappedFile file{ cachePath };
+                const auto data = file.data();
+                const mi::base::Handle<const mdl::ITarget_code> code{ mBackend->deserialize_target_code(
+                    mTransaction.get(), reinterpret_cast<const mi::Uint8*>(data.data()), data.size(), ctx) };
+                if(code && ctx->get_error_messages_count() == 0)
+                    return code;
+                warning(fmt::format("MDL: ignore the invalid cache {} of material {}", cachePath.string(), key));
+            }
+        }
+
+        const mi::base::Handle<const mdl::ITarget_code> code{ mBackend->translate_material_df(mTransaction.get(), compiled,
+                                                                                           "surface.scattering", "bsdf", ctx) };
+        checkContext(ctx, fmt::format("generate the native code of material {}", key));
+
+        if(!cachePath.empty()) {
+            const mi::base::Handle<const mdl::IBuffer> buffer{ code->serialize(ctx) };
+            if(buffer) {
+                std::ofstream out{ cachePath, std::ios::binary };
+                out.write(reinterpret_cast<const char*>(buffer->get_data()), static_cast<std::streamsize>(buffer->get_data_size()));
+                if(!out)
+                    warning(fmt::format("MDL: failed to save the cache {}", cachePath.string()));
+            }
+        }
+        return code;
+    }
+};
+
+template <typename Setting>
+class MDLBxDF final : public BxDF<Setting> {
+    PIPER_IMPORT_SETTINGS();
+    PIPER_IMPORT_SHADING();
+
+    const MDLCompiledMaterial* mMaterial;
+    glm::vec3 mPosition;
+    glm::vec3 mGeometryNormal;
+    glm::vec3 mTexCoord;
+    Float mTime;
+    Wavelength mSampledWavelength;
+
+    static mdl::tct_float3 toMDL(const glm::vec3 x) noexcept {
+        return { x.x, x.y, x.z };
+    }
+    static glm::vec3 fromMDL(const mdl::tct_float3 x) noexcept {
+        return { x.x, x.y, x.z };
+    }
+
+    // the state is built in the shading frame: the shading normal is +Z and the tangents are +X/+Y
+    struct State final {
+        mdl::tct_float3 texCoord, tangentU, tangentV;
+        mdl::tct_float4 textureResults[16];
+        mdl::Shading_state_material state;
+    };
+
+    bool initState(State& s) const noexcept {
+        static constexpr mdl::tct_float4 identity[3] = { { 1.0f, 0.0f, 0.0f, 0.0f },
+                                                         { 0.0f, 1.0f, 0.0f, 0.0f },
+                                                         { 0.0f, 0.0f, 1.0f, 0.0f } };
+        s.texCoord = toMDL(mTexCoord);
+        s.tangentU = { 1.0f, 0.0f, 0.0f };
+        s.tangentV = { 0.0f, 1.0f, 0.0f };
+
+        auto& state = s.state;
+        state = {};
+        state.normal = { 0.0f, 0.0f, 1.0f };
+        state.geom_normal = toMDL(mGeometryNormal);
+        state.position = toMDL(mPosition);
+        state.animation_time = mTime;
+        state.text_coords = &s.texCoord;
+        state.tangent_u = &s.tangentU;
+        state.tangent_v = &s.tangentV;
+        state.text_results = s.textureResults;
+        state.ro_data_segment = nullptr;
+        state.world_to_object = identity;
+        state.object_to_world = identity;
+        state.object_id = 0;
+        state.meters_per_scene_unit = 1.0f;
+        return mMaterial->code->execute_bsdf_init(MDLCompiledMaterial::bsdfInit, state, nullptr, nullptr) == 0;
+    }
+
+    // the native backend only produces RGB, it is upsampled for the spectral variants
+    Rational<Spectrum> convert(const glm::vec3 rgb) const noexcept {
+        return Rational<Spectrum>::fromRaw(
+            spectrumCast<Spectrum>(RGBSpectrum::fromRaw(glm::max(rgb, glm::zero<glm::vec3>())), mSampledWavelength));
+    }
+
+    // the incoming direction lies on the other side if wo is inside the material
+    static void setIOR(mdl::tct_float3& ior1, mdl::tct_float3& ior2, const Direction& wo) noexcept {
+        constexpr mdl::tct_float3 vacuum{ 1.0f, 1.0f, 1.0f };
+        constexpr mdl::tct_float3 material{ MI_NEURAYLIB_BSDF_USE_MATERIAL_IOR, 0.0f, 0.0f };
+        ior1 = wo.z() >= 0.0f ? vacuum : material;
+        ior2 = wo.z() >= 0.0f ? material : vacuum;
+    }
+
+public:
+    MDLBxDF(const MDLCompiledMaterial& material, const glm::vec3 position, const glm::vec3 geometryNormal, const glm::vec3 texCoord,
+            const Float time, const Wavelength& sampledWavelength)
+        : mMaterial{ &material }, mPosition{ position }, mGeometryNormal{ geometryNormal }, mTexCoord{ texCoord }, mTime{ time },
+          mSampledWavelength{ sampledWavelength } {}
+
+    [[nodiscard]] BxDFPart part() const noexcept override {
+        return BxDFPart::All;
+    }
+
+    // NOTICE: the MDL BSDFs include the cosine term of the incoming direction
+    Rational<Spectrum> evaluate(const Direction& wo, const Direction& wi, TransportMode) const noexcept override {
+        State s;
+        const auto cosThetaI = absCosTheta(wi);
+        if(cosThetaI == 0.0f || !initState(s))
+            return Rational<Spectrum>::zero();
+
+        mdl::Bsdf_evaluate_data<mdl::DF_HSM_NONE> data{};
+        setIOR(data.ior1, data.ior2, wo);
+        data.k1 = toMDL(wo.raw());
+        data.k2 = toMDL(wi.raw());
+        if(mMaterial->code->execute_bsdf_evaluate(MDLCompiledMaterial::bsdfEvaluate, &data, s.state, nullptr, nullptr) != 0)
+            return Rational<Spectrum>::zero();
+        return convert((fromMDL(data.bsdf_diffuse) + fromMDL(data.bsdf_glossy)) / cosThetaI);
+    }
+
+    BSDFSample sample(SampleProvider& sampler, const Direction& wo, TransportMode,
+                      const BxDFDirection sampleDirection) const noexcept override {
+        return sample(sampler.sampleVec4(), wo, sampleDirection);
+    }
+
+    BSDFSample sample(const glm::vec4 u, const Direction& wo, const BxDFDirection sampleDirection) const noexcept {
+        State s;
+        if(!initState(s))
+            return BSDFSample::invalid();
+
+        mdl::Bsdf_sample_data data{};
+        setIOR(data.ior1, data.ior2, wo);
+        data.k1 = toMDL(wo.raw());
+        data.xi = { u.x, u.y, u.z, u.w };
+        if(mMaterial->code->execute_bsdf_sample(MDLCompiledMaterial::bsdfSample, &data, s.state, nullptr, nullptr) != 0 ||
+           data.event_type == mdl::BSDF_EVENT_ABSORB)
+            return BSDFSample::invalid();
+
+        const auto wi = Direction::fromRaw(glm::normalize(fromMDL(data.k2)));
+        const auto cosThetaI = absCosTheta(wi);
+        const auto reflection = (data.event_type & mdl::BSDF_EVENT_REFLECTION) != 0;
+        if(cosThetaI == 0.0f || !match(sampleDirection, reflection ? BxDFDirection::Reflection : BxDFDirection::Transmission))
+            return BSDFSample::invalid();
+
+        auto part = reflection ? BxDFPart::Reflection : BxDFPart::Transmission;
+        if(data.event_type & mdl::BSDF_EVENT_DIFFUSE)
+            part = part | BxDFPart::Diffuse;
+        else if(data.event_type & mdl::BSDF_EVENT_GLOSSY)
+            part = part | BxDFPart::Glossy;
+        else
+            part = part | BxDFPart::Specular;
+
+        // bsdf_over_pdf = f * cos / pdf, the specular events have no meaningful pdf
+        const auto weight = fromMDL(data.bsdf_over_pdf) / cosThetaI;
+        const auto pdf = match(part, BxDFPart::Specular) ? 1.0f : data.pdf;
+        return { wi, importanceSampled<PdfType::BSDF>(convert(weight * pdf)), InversePdfValue::fromPdf(pdf), part };
+    }
+
+    [[nodiscard]] InversePdfValue inversePdf(const Direction& wo, const Direction& wi, TransportMode,
+                                             const BxDFDirection sampleDirection) const noexcept override {
+        if(!match(sampleDirection, sameHemisphere(wo, wi) ? BxDFDirection::Reflection : BxDFDirection::Transmission))
+            return InversePdfValue::invalid();
+        State s;
+        if(!initState(s))
+            return InversePdfValue::invalid();
+
+        mdl::Bsdf_pdf_data data{};
+        setIOR(data.ior1, data.ior2, wo);
+        data.k1 = toMDL(wo.raw());
+        data.k2 = toMDL(wi.raw());
+        if(mMaterial->code->execute_bsdf_pdf(MDLCompiledMaterial::bsdfPdf, &data, s.state, nullptr, nullptr) != 0)
+            return InversePdfValue::invalid();
+        return InversePdfValue::fromPdf(data.pdf);
+    }
+};
+
+template <typename Setting>
+class MDL final : public Material<Setting> {
+    PIPER_IMPORT_SETTINGS();
+    PIPER_IMPORT_SHADING();
+
+    const MDLCompiledMaterial* mMaterial;
+
+    template <typename BxDFSetting>
+    [[nodiscard]] MDLBxDF<BxDFSetting> makeBxDF(const typename BxDFSetting::WavelengthType& sampledWavelength,
+                                                const SurfaceHit& intersection, const ShadingFrame& frame) const noexcept {
+        return MDLBxDF<BxDFSetting>{ *mMaterial,
+                                 intersection.hit.raw(),
+                                 frame(intersection.geometryNormal.asDirection()).raw(),
+                                 glm::vec3{ intersection.texCoord, 0.0f },
+                                 intersection.t,
+                                 sampledWavelength };
+    }
+
+public:
+    explicit MDL(const Ref<ConfigNode>& node) {
+        std::string_view searchPath;
+        if(const auto ptr = node->tryGet("SearchPath"sv))
+            searchPath = (*ptr)->as<std::string_view>();
+        mMaterial = &MDLRuntime::get().compile(node->get("Module"sv)->as<std::string_view>(),
+                                               node->get("Material"sv)->as<std::string_view>(), searchPath);
+    }
+
+    BSDF<Setting> evaluate(const Wavelength& sampledWavelength, const SurfaceHit& intersection) const noexcept override {
+        const ShadingFrame frame{ intersection.shadingNormal.asDirection(), intersection.dpdu };
+        return BSDF<Setting>{ frame, makeBxDF<Setting>(sampledWavelength, intersection, frame) };
+    }
+
+    // the mean of a few stratified samples at normal incidence, the RGB result of the native code is used directly
+    [[nodiscard]] RGBSpectrum estimateAlbedo(const SurfaceHit& intersection) const noexcept override {
+        const ShadingFrame frame{ intersection.shadingNormal.asDirection(), intersection.dpdu };
+        const auto bxdf = makeBxDF<RSSRGB>(std::monostate{}, intersection, frame);
+        const auto wo = Direction::fromRaw(glm::vec3{ 0.0f, 0.0f, 1.0f });
+
+        constexpr uint32_t samples = 4;
+        auto sum = glm::zero<glm::vec3>();
+        for(uint32_t idx = 0; idx < samples * samples; ++idx) {
+            const glm::vec4 u{ (static_cast<Float>(idx % samples) + 0.5f) / static_cast<Float>(samples),
+                               (static_cast<Float>(idx / samples) + 0.5f) / static_cast<Float>(samples), 0.5f, 0.5f };
+            const auto res = bxdf.sample(u, wo, BxDFDirection::All);
+            if(res.valid())
+                sum += res.f.raw().raw() * (res.inversePdf.raw() * absCosTheta(res.wi));
+        }
+        return RGBSpectrum::fromRaw(sum / static_cast<Float>(samples * samples));
+    }
+};
+
+PIPER_REGISTER_VARIANT(MDL, Material);
+
+PIPER_NAMESPACE_END
+
+#endif
@@ -0,0 +1,543 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifdef PIPER_WITH_MATERIALX
+
+#include <Piper/Core/Report.hpp>
+#include <Piper/Render/BxDFs.hpp>
+#include <Piper/Render/Material.hpp>
+#include <Piper/Render/Texture.hpp>
+#include <bit>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+
+#include <MaterialXCore/Document.h>
+#include <MaterialXFormat/XmlIo.h>
+
+// Please refer to https://materialx.org/Specification.html
+
+PIPER_NAMESPACE_BEGIN
+
+namespace mx = MaterialX;
+
+namespace {
+    // The node graph of an input is compiled into a linear program, each instruction writes the register at its own index.
+    // All components are evaluated in RGB, the scalars are broadcast and the 2D vectors live in xy.
+    enum class Op : uint8_t {
+        Constant,
+        TexCoord,
+        Image,  // a: texcoord, imm: image
+        Add,
+        Subtract,
+        Multiply,
+        Divide,
+        Power,
+        Min,
+        Max,
+        Dot,
+        Abs,      // a
+        Extract,  // a, imm: channel
+        Mix,      // a: fg, b: bg, c: mix
+        Clamp,    // a: in, b: low, c: high
+        Combine   // a, b, c
+    };
+
+    constexpr uint32_t operandCount(const Op op) noexcept {
+        switch(op) {
+            case Op::Constant:
+                [[fallthrough]];
+            case Op::TexCoord:
+                return 0;
+            case Op::Image:
+                [[fallthrough]];
+            case Op::Abs:
+                [[fallthrough]];
+            case Op::Extract:
+                return 1;
+            case Op::Mix:
+                [[fallthrough]];
+            case Op::Clamp:
+                [[fallthrough]];
+            case Op::Combine:
+                return 3;
+            default:
+                return 2;
+        }
+    }
+
+    struct Instruction final {
+        Op op;
+        uint32_t imm = 0;
+        std::array<uint32_t, 3> operands{};
+        glm::vec3 value{};
+    };
+
+    glm::vec3 apply(const Instruction& inst, const glm::vec3 a, const glm::vec3 b, const glm::vec3 c) noexcept {
+        switch(inst.op) {
+            case Op::Add:
+                return a + b;
+            case Op::Subtract:
+                return a - b;
+            case Op::Multiply:
+                return a * b;
+            case Op::Divide:
+                return a / b;
+            case Op::Power:
+                return glm::pow(a, b);
+            case Op::Min:
+                return glm::min(a, b);
+            case Op::Max:
+                return glm::max(a, b);
+            case Op::Dot:
+                return glm::vec3{ glm::dot(a, b) };
+            case Op::Abs:
+                return glm::abs(a);
+            case Op::Extract:
+                return glm::vec3{ a[static_cast<glm::length_t>(inst.imm)] };
+            case Op::Mix:
+                return glm::mix(b, a, c);
+            case Op::Clamp:
+                return glm::clamp(a, b, c);
+            case Op::Combine:
+                return { a.x, b.x, c.x };
+            default:
+                PIPER_UNREACHABLE();
+        }
+    }
+
+    struct ImageDesc final {
+        std::string path;
+        std::string_view wrap;
+        std::string colorSpace;
+    };
+
+    class Program final {
+        static constexpr uint32_t maxInstructions = 128;
+
+        std::pmr::vector<Instruction> mCode{ context().globalAllocator };
+        std::pmr::vector<Ref<SpectrumTexture2D<RSSRGB>>> mImages{ context().globalAllocator };
+
+    public:
+        Program(const std::pmr::vector<Instruction>& code, const std::pmr::vector<ImageDesc>& images) {
+            if(code.size() > maxInstructions)
+                fatal(fmt::format("MaterialX: the node graph is too large ({} instructions after folding)", code.size()));
+            mCode.assign(code.cbegin(), code.cend());
+
+            // the images are fetched in RGB regardless of the variant, the results are upsampled by the material
+            for(const auto& [path, wrap, colorSpace] : images) {
+                ConfigNode::AttrMap attrs{ context().globalAllocator };
+                attrs.emplace_back("FilePath"sv, makeRefCount<ConfigAttr>(std::pmr::string{ path, context().globalAllocator }));
+                attrs.emplace_back("Wrap"sv, makeRefCount<ConfigAttr>(wrap));
+                if(!colorSpace.empty())
+                    attrs.emplace_back("ColorSpace"sv, makeRefCount<ConfigAttr>(std::pmr::string{ colorSpace, context().globalAllocator }));
+                const auto node = makeRefCount<ConfigNode>("MaterialXImage"sv, "BitMap"sv, std::move(attrs), Ref<RefCountBase>{});
+                mImages.push_back(getStaticFactory().make<SpectrumTexture2D<RSSRGB>>(node));
+            }
+        }
+
+        [[nodiscard]] glm::vec3 run(const TextureEvaluateInfo& info) const noexcept {
+            std::array<glm::vec3, maxInstructions> regs;  // NOLINT(cppcoreguidelines-pro-type-member-init)
+            for(uint32_t idx = 0; idx < mCode.size(); ++idx) {
+                const auto& inst = mCode[idx];
+                const auto& [a, b, c] = inst.operands;
+                switch(inst.op) {
+                    case Op::Constant:
+                        regs[idx] = inst.value;
+                        break;
+                    case Op::TexCoord:
+                        regs[idx] = glm::vec3{ info.texCoord, 0.0f };
+                        break;
+                    case Op::Image: {
+                        auto imageInfo = info;
+                        imageInfo.texCoord = glm::vec2{ regs[a] };
+                        regs[idx] = mImages[inst.imm]->evaluate(imageInfo, std::monostate{}).raw();
+                    } break;
+                    default:
+                        regs[idx] = apply(inst, regs[a], regs[b], regs[c]);
+                        break;
+                }
+            }
+            return regs[mCode.size() - 1];
+        }
+    };
+
+    // identical programs are shared by all materials
+    class ProgramRegistry final {
+        std::mutex mMutex;
+        std::unordered_map<std::string, std::unique_ptr<Program>> mPrograms;
+
+    public:
+        const Program& intern(const std::pmr::vector<Instruction>& code, const std::pmr::vector<ImageDesc>& images) {
+            std::string key;
+            key.reserve(code.size() * sizeof(Instruction));
+            for(const auto& inst : code) {
+                const std::array<uint32_t, 8> words{ static_cast<uint32_t>(inst.op),
+                                                     inst.imm,
+                                                     inst.operands[0],
+                                                     inst.operands[1],
+                                                     inst.operands[2],
+                                                     std::bit_cast<uint32_t>(inst.value.x),
+                                                     std::bit_cast<uint32_t>(inst.value.y),
+                                                     std::bit_cast<uint32_t>(inst.value.z) };
+                key.append(reinterpret_cast<const char*>(words.data()), sizeof(words));
+            }
+            for(const auto& [path, wrap, colorSpace] : images)
+                key += fmt::format("|{}#{}#{}", path, wrap, colorSpace);
+
+            std::lock_guard guard{ mMutex };
+            auto& program = mPrograms[key];
+            if(!program)
+                program = std::make_unique<Program>(code, images);
+            return *program;
+        }
+
+        static ProgramRegistry& get() {
+            // never destroyed, since releasing the textures requires the thread-local context
+            static auto* inst = new ProgramRegistry;
+            return *inst;
+        }
+    };
+
+    // an input is either a folded constant or a shared program
+    struct CompiledInput final {
+        const Program* program = nullptr;
+        glm::vec3 value{};
+
+        [[nodiscard]] bool isConstant() const noexcept {
+            return program == nullptr;
+        }
+
+        [[nodiscard]] glm::vec3 evaluate(const TextureEvaluateInfo& info) const noexcept {
+            return program ? program->run(info) : value;
+        }
+    };
+
+    glm::vec3 toVec3(const mx::ValuePtr& value, const glm::vec3 fallback) {
+        if(!value)
+            return fallback;
+        if(value->isA<float>())
+            return glm::vec3{ value->asA<float>() };
+        if(value->isA<int>())
+            return glm::vec3{ static_cast<Float>(value->asA<int>()) };
+        if(value->isA<bool>())
+            return glm::vec3{ value->asA<bool>() ? 1.0f : 0.0f };
+        if(value->isA<mx::Color3>()) {
+            const auto x = value->asA<mx::Color3>();
+            return { x[0], x[1], x[2] };
+        }
+        if(value->isA<mx::Vector2>()) {
+            const auto x = value->asA<mx::Vector2>();
+            return { x[0], x[1], 0.0f };
+        }
+        if(value->isA<mx::Vector3>()) {
+            const auto x = value->asA<mx::Vector3>();
+            return { x[0], x[1], x[2] };
+        }
+        if(value->isA<mx::Color4>()) {
+            const auto x = value->asA<mx::Color4>();
+            return { x[0], x[1], x[2] };
+        }
+        if(value->isA<mx::Vector4>()) {
+            const auto x = value->asA<mx::Vector4>();
+            return { x[0], x[1], x[2] };
+        }
+        fatal(fmt::format("MaterialX: unsupported value type {}", value->getTypeString()));
+    }
+
+    class GraphCompiler final {
+        fs::path mBaseDirectory;
+        std::pmr::vector<Instruction> mCode{ context().scopedAllocator };
+        std::pmr::vector<ImageDesc> mImages{ context().scopedAllocator };
+        std::unordered_map<const mx::Element*, uint32_t> mVisited;
+
+        static bool isConnected(const mx::InputPtr& input) {
+            return input && (input->getConnectedOutput() || input->getConnectedNode() || input->getInterfaceInput());
+        }
+
+        uint32_t push(const Instruction& inst) {
+            mCode.push_back(inst);
+            return static_cast<uint32_t>(mCode.size() - 1);
+        }
+
+        // the constant subgraphs are folded while emitting
+        uint32_t emit(const Op op, const uint32_t a, const uint32_t b = 0, const uint32_t c = 0, const uint32_t imm = 0) {
+            Instruction inst{ op, imm, { a, b, c } };
+            const auto count = operandCount(op);
+            // the image lookups are never folded
+            bool constant = op != Op::Image;
+            for(uint32_t idx = 0; idx < count; ++idx)
+                constant &= mCode[inst.operands[idx]].op == Op::Constant;
+            if(constant)
+                return constantOf(apply(inst, mCode[a].value, mCode[count > 1 ? b : a].value, mCode[count > 2 ? c : a].value));
+            return push(inst);
+        }
+
+        uint32_t resolveImage(const mx::NodePtr& node) {
+            const auto file = node->getInput("file");
+            if(!file || !file->hasValue())
+                fatal(fmt::format("MaterialX: image node {} has no file", node->getName()));
+            fs::path path = file->getResolvedValueString();
+            if(path.is_relative())
+                path = mBaseDirectory / path;
+
+            std::string_view wrap = "Periodic"sv;
+            if(const auto mode = node->getInput("uaddressmode"); mode && mode->hasValue()) {
+                const auto str = mode->getValueString();
+                if(str == "clamp")
+                    wrap = "Clamp"sv;
+                else if(str == "constant")
+                    wrap = "Black"sv;
+                else if(str != "periodic")
+                    warning(fmt::format("MaterialX: address mode {} of image {} is treated as periodic", str, node->getName()));
+            }
+
+            mImages.push_back(ImageDesc{ path.string(), wrap, file->getActiveColorSpace() });
+            return static_cast<uint32_t>(mImages.size() - 1);
+        }
+
+        uint32_t compileNode(const mx::NodePtr& node) {
+            if(const auto iter = mVisited.find(node.get()); iter != mVisited.cend())
+                return iter->second;
+
+            const auto& category = node->getCategory();
+            const auto in = [&](const char* name, const Float fallback) {
+                return compileInput(node->getInput(name), glm::vec3{ fallback });
+            };
+            const auto binary = [&](const Op op, const Float fallback1, const Float fallback2) {
+                return emit(op, in("in1", fallback1), in("in2", fallback2));
+            };
+
+            uint32_t res;
+            if(category == "constant" || category == "convert" || category == "dot")
+                res = category == "constant" ? in("value", 0.0f) : in("in", 0.0f);
+            else if(category == "texcoord")
+                res = push(Instruction{ Op::TexCoord });
+            else if(category == "image" || category == "tiledimage") {
+                const auto texCoordInput = node->getInput("texcoord");
+                auto texCoord = isConnected(texCoordInput) ? compileInput(texCoordInput, {}) : push(Instruction{ Op::TexCoord });
+                if(category == "tiledimage")
+                    texCoord = emit(Op::Subtract, emit(Op::Multiply, texCoord, in("uvtiling", 1.0f)), in("uvoffset", 0.0f));
+                res = emit(Op::Image, texCoord, 0, 0, resolveImage(node));
+            } else if(category == "place2d") {
+                // NOTICE: the rotation is ignored
+                const auto pivot = in("pivot", 0.0f);
+                auto texCoord = emit(Op::Subtract, in("texcoord", 0.0f), pivot);
+                texCoord = emit(Op::Divide, texCoord, in("scale", 1.0f));
+                res = emit(Op::Subtract, emit(Op::Add, texCoord, pivot), in("offset", 0.0f));
+            } else if(category == "add")
+                res = binary(Op::Add, 0.0f, 0.0f);
+            else if(category == "subtract")
+                res = binary(Op::Subtract, 0.0f, 0.0f);
+            else if(category == "multiply")
+                res = binary(Op::Multiply, 0.0f, 1.0f);
+            else if(category == "divide")
+                res = binary(Op::Divide, 0.0f, 1.0f);
+            else if(category == "power")
+                res = binary(Op::Power, 0.0f, 1.0f);
+            else if(category == "min")
+                res = binary(Op::Min, 0.0f, 0.0f);
+            else if(category == "max")
+                res = binary(Op::Max, 0.0f, 0.0f);
+            else if(category == "dotproduct")
+                res = binary(Op::Dot, 0.0f, 0.0f);
+            else if(category == "absval")
+                res = emit(Op::Abs, in("in", 0.0f));
+            else if(category == "invert")
+                res = emit(Op::Subtract, in("amount", 1.0f), in("in", 0.0f));
+            else if(category == "mix")
+                res = emit(Op::Mix, in("fg", 0.0f), in("bg", 0.0f), in("mix", 0.0f));
+            else if(category == "clamp")
+                res = emit(Op::Clamp, in("in", 0.0f), in("low", 0.0f), in("high", 1.0f));
+            else if(category == "extract") {
+                const auto index = node->getInput("index");
+                const auto channel = index && index->hasValue() ? index->getValue()->asA<int>() : 0;
+                res = emit(Op::Extract, in("in", 0.0f), 0, 0, static_cast<uint32_t>(std::clamp(channel, 0, 2)));
+            } else if(category == "combine2" || category == "combine3")
+                res = emit(Op::Combine, in("in1", 0.0f), in("in2", 0.0f), in("in3", 0.0f));
+            else if(category == "luminance")
+                res = emit(Op::Dot, in("in", 0.0f), compileInput(node->getInput("lumacoeffs"), { 0.2722287f, 0.6740818f, 0.0536895f }));
+            else
+                fatal(fmt::format("MaterialX: unsupported node {} ({})", node->getName(), category));
+
+            mVisited.emplace(node.get(), res);
+            return res;
+        }
+
+    public:
+        explicit GraphCompiler(fs::path baseDirectory) : mBaseDirectory{ std::move(baseDirectory) } {}
+
+        uint32_t constantOf(const glm::vec3 value) {
+            return push(Instruction{ Op::Constant, 0, {}, value });
+        }
+
+        uint32_t multiply(const uint32_t a, const uint32_t b) {
+            return emit(Op::Multiply, a, b);
+        }
+
+        uint32_t compileInput(const mx::InputPtr& input, const glm::vec3 fallback) {
+            if(!input)
+                return constantOf(fallback);
+            if(const auto output = input->getConnectedOutput())
+                if(const auto upstream = output->getConnectedNode())
+                    return compileNode(upstream);
+            if(const auto upstream = input->getConnectedNode())
+                return compileNode(upstream);
+            if(const auto interfaceInput = input->getInterfaceInput())
+                return compileInput(interfaceInput, fallback);
+            return constantOf(toVec3(input->getValue(), fallback));
+        }
+
+        // the unreachable instructions left by folding are dropped before the program is shared
+        CompiledInput finish(const uint32_t root) {
+            if(mCode[root].op == Op::Constant)
+                return CompiledInput{ nullptr, mCode[root].value };
+
+            std::pmr::vector<uint32_t> remap(root + 1, std::numeric_limits<uint32_t>::max(), context().scopedAllocator);
+            std::pmr::vector<bool> used(root + 1, false, context().scopedAllocator);
+            used[root] = true;
+            for(auto idx = root + 1; idx-- > 0;)
+                if(used[idx])
+                    for(uint32_t k = 0; k < operandCount(mCode[idx].op); ++k)
+                        used[mCode[idx].operands[k]] = true;
+
+            std::pmr::vector<Instruction> code{ context().scopedAllocator };
+            std::pmr::vector<ImageDesc> images{ context().scopedAllocator };
+            for(uint32_t idx = 0; idx <= root; ++idx) {
+                if(!used[idx])
+                    continue;
+                auto inst = mCode[idx];
+                for(uint32_t k = 0; k < operandCount(inst.op); ++k)
+                    inst.operands[k] = remap[inst.operands[k]];
+                if(inst.op == Op::Image) {
+                    images.push_back(mImages[inst.imm]);
+                    inst.imm = static_cast<uint32_t>(images.size() - 1);
+                }
+                remap[idx] = static_cast<uint32_t>(code.size());
+                code.push_back(inst);
+            }
+
+            return CompiledInput{ &ProgramRegistry::get().intern(code, images) };
+        }
+    };
+
+    struct ShadingModel final {
+        const char* baseColor;
+        Float baseColorDefault;
+        const char* baseWeight;  // nullptr if the model has no weight
+        Float baseWeightDefault;
+        const char* roughness;
+        Float roughnessDefault;
+        const char* metallic;
+        Float metallicDefault;
+        const char* ior;
+    };
+
+    const ShadingModel* findShadingModel(const std::string& category) {
+        static const std::unordered_map<std::string, ShadingModel> models = {
+            { "standard_surface", { "base_color", 1.0f, "base", 0.8f, "specular_roughness", 0.2f, "metalness", 0.0f, "specular_IOR" } },
+            { "open_pbr_surface",
+              { "base_color", 0.8f, "base_weight", 1.0f, "specular_roughness", 0.3f, "base_metalness", 0.0f, "specular_ior" } },
+            { "UsdPreviewSurface", { "diffuseColor", 0.18f, nullptr, 1.0f, "roughness", 0.5f, "metallic", 0.0f, "ior" } },
+            { "gltf_pbr", { "base_color", 1.0f, nullptr, 1.0f, "roughness", 1.0f, "metallic", 1.0f, "ior" } },
+        };
+        const auto iter = models.find(category);
+        return iter == models.cend() ? nullptr : &iter->second;
+    }
+}  // namespace
+
+// The surface shader of a MaterialX material is mapped to the metallic-roughness model. Each input graph is compiled into one
+// program evaluated without per-node dispatch, and the constant inputs are folded at load time.
+template <typename Setting>
+class MaterialXMaterial final : public Material<Setting> {
+    PIPER_IMPORT_SETTINGS();
+    PIPER_IMPORT_SHADING();
+
+    CompiledInput mBaseColor;
+    CompiledInput mRoughness;
+    CompiledInput mMetallic;
+    Float mEta = 1.5f;
+
+public:
+    explicit MaterialXMaterial(const Ref<ConfigNode>& node) {
+        const fs::path path = node->get("FilePath"sv)->as<std::string_view>();
+        const auto doc = mx::createDocument();
+        try {
+            mx::readFromXmlFile(doc, mx::FilePath{ path.string() });
+        } catch(const std::exception& ex) {
+            fatal(fmt::format("MaterialX: failed to load {}: {}", path.string(), ex.what()));
+        }
+
+        mx::NodePtr material;
+        const auto materials = doc->getMaterialNodes();
+        if(const auto ptr = node->tryGet("Material"sv)) {
+            const auto name = (*ptr)->as<std::string_view>();
+            for(const auto& candidate : materials)
+                if(candidate->getName() == name)
+                    material = candidate;
+        } else if(!materials.empty())
+            material = materials.front();
+        if(!material)
+            fatal(fmt::format("MaterialX: no matching material in {}", path.string()));
+
+        const auto shaders = mx::getShaderNodes(material, mx::SURFACE_SHADER_TYPE_STRING);
+        if(shaders.empty())
+            fatal(fmt::format("MaterialX: material {} has no surface shader", material->getName()));
+        const auto& shader = shaders.front();
+        const auto model = findShadingModel(shader->getCategory());
+        if(!model)
+            fatal(fmt::format("MaterialX: unsupported surface shader {}", shader->getCategory()));
+
+        GraphCompiler compiler{ path.parent_path() };
+        auto baseColor = compiler.compileInput(shader->getInput(model->baseColor), glm::vec3{ model->baseColorDefault });
+        if(model->baseWeight)
+            baseColor = compiler.multiply(baseColor, compiler.compileInput(shader->getInput(model->baseWeight),
+                                                                           glm::vec3{ model->baseWeightDefault }));
+        mBaseColor = compiler.finish(baseColor);
+        mRoughness = compiler.finish(compiler.compileInput(shader->getInput(model->roughness), glm::vec3{ model->roughnessDefault }));
+        mMetallic = compiler.finish(compiler.compileInput(shader->getInput(model->metallic), glm::vec3{ model->metallicDefault }));
+
+        const auto eta = compiler.finish(compiler.compileInput(shader->getInput(model->ior), glm::vec3{ 1.5f }));
+        if(eta.isConstant())
+            mEta = eta.value.x;
+        else
+            warning(fmt::format("MaterialX: the varying IOR of material {} is replaced by 1.5", material->getName()));
+    }
+
+    BSDF<Setting> evaluate(const Wavelength& sampledWavelength, const SurfaceHit& intersection) const noexcept override {
+        const auto textureEvaluateInfo = intersection.makeTextureEvaluateInfo();
+        const auto rgb = RGBSpectrum::fromRaw(glm::max(mBaseColor.evaluate(textureEvaluateInfo), glm::zero<glm::vec3>()));
+        const auto baseColor = spectrumCast<Spectrum>(rgb, sampledWavelength);
+        const auto roughness = std::clamp(mRoughness.evaluate(textureEvaluateInfo).x, 0.0f, 1.0f);
+        const auto metallic = std::clamp(mMetallic.evaluate(textureEvaluateInfo).x, 0.0f, 1.0f);
+        return BSDF<Setting>{ ShadingFrame{ intersection.shadingNormal.asDirection(), intersection.dpdu },
+                              metallicRoughnessBxDF<Setting>(baseColor, roughness, metallic, mEta, sampledWavelength), false };
+    }
+
+    [[nodiscard]] RGBSpectrum estimateAlbedo(const SurfaceHit& intersection) const noexcept override {
+        return RGBSpectrum::fromRaw(glm::max(mBaseColor.evaluate(intersection.makeTextureEvaluateInfo()), glm::zero<glm::vec3>()));
+    }
+};
+
+PIPER_REGISTER_VARIANT_IMPL("MaterialX", MaterialXMaterial, Material, MaterialXMaterial);
+
+PIPER_NAMESPACE_END
+
+#endif
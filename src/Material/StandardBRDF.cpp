@@ -31,9 +31,9 @@ class StandardBRDF final : public Material<Setting> {
     PIPER_IMPORT_SETTINGS();
     PIPER_IMPORT_SHADING();
 
-    Ref<SpectrumTexture2D<Setting>> mBaseColor;
-    Ref<ScalarTexture2D> mRoughness;
-    Ref<ScalarTexture2D> mMetallic;
+    SpectrumTextureInput<Setting> mBaseColor;
+    ScalarTextureInput mRoughness;
+    ScalarTextureInput mMetallic;
     Float mEta = 1.5f;
 
 public:
@@ -48,19 +48,11 @@ public:
 
     BSDF<Setting> evaluate(const Wavelength& sampledWavelength, const SurfaceHit& intersection) const noexcept override {
         const auto textureEvaluateInfo = intersection.makeTextureEvaluateInfo();
-        const auto baseColor = mBaseColor->evaluate(textureEvaluateInfo, sampledWavelength);
-        const auto roughness = mRoughness->evaluate(textureEvaluateInfo);
-        const auto metallic = mMetallic->evaluate(textureEvaluateInfo);
-        const auto distribution = TrowbridgeReitzDistribution<Setting>(roughness, roughness);
-
-        auto dielectric = SchlickMixedBxDF<Setting, LambertianBxDF<Setting>, DielectricBxDF<Setting>>{
-            LambertianBxDF<Setting>{ Rational<Spectrum>::fromRaw(baseColor) }, DielectricBxDF<Setting>{ mEta, distribution }, mEta
-        };
-
-        const auto eta = spectrumCast<typename ConductorBxDF<Setting>::EtaType>(baseColor, sampledWavelength);
-        auto metal = ConductorBxDF<Setting>{ { eta, zero<typename ConductorBxDF<Setting>::EtaType>() }, distribution };
+        const auto baseColor = mBaseColor.evaluate(textureEvaluateInfo, sampledWavelength);
+        const auto roughness = mRoughness.evaluate(textureEvaluateInfo);
+        const auto metallic = mMetallic.evaluate(textureEvaluateInfo);
         return BSDF<Setting>{ ShadingFrame{ intersection.shadingNormal.asDirection(), intersection.dpdu },
-                              mixBxDF<Setting>(std::move(dielectric), std::move(metal), metallic), false };
+                              metallicRoughnessBxDF<Setting>(baseColor, roughness, metallic, mEta, sampledWavelength), false };
     }
 
     [[nodiscard]] RGBSpectrum estimateAlbedo(const SurfaceHit&) const noexcept override {
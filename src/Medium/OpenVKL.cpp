@@ -0,0 +1,186 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/FileIO.hpp>
+#include <Piper/Render/MajorantGrid.hpp>
+#include <Piper/Render/Math.hpp>
+#include <Piper/Render/Medium.hpp>
+#include <Piper/Render/SpectrumUtil.hpp>
+#include <mutex>
+#include <openvkl/openvkl.h>
+
+PIPER_NAMESPACE_BEGIN
+
+// the CPU device is shared by all volumes and lives until the process exits
+static VKLDevice openVKLDevice() {
+    static std::once_flag flag;
+    static VKLDevice device = nullptr;
+    std::call_once(flag, [] {
+        vklInit();
+        device = vklNewDevice("cpu");
+        if(!device)
+            fatal("Failed to create the OpenVKL CPU device");
+        vklCommitDevice(device);
+    });
+    return device;
+}
+
+// A heterogeneous medium backed by an OpenVKL structured regular volume. The densities are raw 32-bit floats (x varies fastest) and
+// the grid is placed in the world space by its origin and spacing, the shape owning the medium only bounds it.
+// NOTICE: OpenVKL cannot read VDB files by itself, so the sparse volumes need to be resampled to the structured regular grids.
+template <typename Setting>
+class OpenVKLVolume final : public Medium<Setting> {
+    PIPER_IMPORT_SETTINGS();
+
+    MappedFile mFile;
+    std::span<const Float> mDensities;
+    glm::ivec3 mDimensions;
+    glm::vec3 mOrigin;
+    glm::vec3 mSpacing;
+    Float mDensityScale = 1.0f;
+    glm::vec3 mAlbedo{ 0.8f };
+    Float mAnisotropy = 0.0f;
+
+    VKLVolume mVolume = nullptr;
+    VKLSampler mSampler = nullptr;
+    MajorantGrid mMajorants;
+
+    [[nodiscard]] Float density(const glm::vec3& pos) const noexcept {
+        return vklComputeSample(&mSampler, reinterpret_cast<const vkl_vec3f*>(&pos), 0, 0.0f);
+    }
+
+    // the trilinear interpolation is bounded by the voxels around the box
+    [[nodiscard]] Float maxDensity(const glm::vec3& lower, const glm::vec3& upper) const noexcept {
+        const auto lo = glm::clamp(glm::ivec3{ glm::floor((lower - mOrigin) / mSpacing) }, glm::ivec3{ 0 }, mDimensions - 1);
+        const auto hi = glm::clamp(glm::ivec3{ glm::ceil((upper - mOrigin) / mSpacing) }, glm::ivec3{ 0 }, mDimensions - 1);
+        Float res = 0.0f;
+        for(auto z = lo.z; z <= hi.z; ++z)
+            for(auto y = lo.y; y <= hi.y; ++y)
+                for(auto x = lo.x; x <= hi.x; ++x)
+                    res = std::fmax(res, mDensities[(static_cast<size_t>(z) * mDimensions.y + y) * mDimensions.x + x]);
+        return res;
+    }
+
+public:
+    explicit OpenVKLVolume(const Ref<ConfigNode>& node)
+        : mFile{ node->get("Path"sv)->as<std::string_view>() }, mDimensions{ parseVec3(node->get("Dimensions"sv)) },
+          mOrigin{ parseVec3(node->get("Origin"sv)) }, mSpacing{ parseVec3(node->get("Spacing"sv)) } {
+        if(const auto ptr = node->tryGet("Density"sv))
+            mDensityScale = (*ptr)->as<Float>();
+        if(const auto ptr = node->tryGet("Albedo"sv))
+            mAlbedo = glm::clamp(parseVec3(*ptr), 0.0f, 1.0f);
+        if(const auto ptr = node->tryGet("Anisotropy"sv))
+            mAnisotropy = std::clamp((*ptr)->as<Float>(), -0.99f, 0.99f);
+        uint32_t majorantResolution = 16;
+        if(const auto ptr = node->tryGet("MajorantResolution"sv))
+            majorantResolution = std::max(1U, (*ptr)->as<uint32_t>());
+
+        const auto count = static_cast<size_t>(mDimensions.x) * mDimensions.y * mDimensions.z;
+        if(glm::any(glm::lessThan(mDimensions, glm::ivec3{ 2 })) || mFile.data().size() != count * sizeof(Float))
+            fatal(fmt::format("Invalid volume {}: expect {} voxels", node->get("Path"sv)->as<std::string_view>(), count));
+        mDensities = { reinterpret_cast<const Float*>(mFile.data().data()), count };
+
+        const auto device = openVKLDevice();
+        mVolume = vklNewVolume(device, "structuredRegular");
+        vklSetVec3i(mVolume, "dimensions", mDimensions.x, mDimensions.y, mDimensions.z);
+        vklSetVec3f(mVolume, "gridOrigin", mOrigin.x, mOrigin.y, mOrigin.z);
+        vklSetVec3f(mVolume, "gridSpacing", mSpacing.x, mSpacing.y, mSpacing.z);
+        vklSetFloat(mVolume, "background", 0.0f);
+        // the mapped file outlives the volume, so the data is shared instead of copied
+        const auto data = vklNewData(device, count, VKL_FLOAT, mDensities.data(), VKL_DATA_SHARED_BUFFER, 0);
+        vklSetData(mVolume, "data", data);
+        vklRelease(data);
+        vklCommit(mVolume);
+        mSampler = vklNewSampler(mVolume);
+        vklCommit(mSampler);
+
+        // the cells are roughly cubic, the longest axis gets the full resolution
+        const auto extent = glm::vec3{ mDimensions - 1 } * mSpacing;
+        const auto cellSize = std::fmax(std::fmax(extent.x, extent.y), extent.z) / static_cast<Float>(majorantResolution);
+        const auto resolution = glm::max(glm::ivec3{ glm::ceil(extent / cellSize) }, glm::ivec3{ 1 });
+        mMajorants.build(mOrigin, mOrigin + extent, resolution,
+                         [this](const glm::vec3& lower, const glm::vec3& upper) { return maxDensity(lower, upper); });
+    }
+    OpenVKLVolume(const OpenVKLVolume&) = delete;
+    OpenVKLVolume& operator=(const OpenVKLVolume&) = delete;
+    ~OpenVKLVolume() override {
+        vklRelease(mSampler);
+        vklRelease(mVolume);
+    }
+
+    // Please refer to "Monte Carlo Methods for Volumetric Light Transport Simulation" (Novak et al. 2018)
+    std::optional<MediumInteraction<Setting>> sample(const ShadingContext<Setting>& ctx, const Ray& ray, const Distance distance,
+                                                     SampleProvider& sampler) const noexcept override {
+        const auto origin = ray.origin.raw(), dir = ray.direction.raw();
+        std::optional<MediumInteraction<Setting>> res;
+        mMajorants.traverse(origin, dir, distance.raw(), [&](const Float t0, const Float t1, const Float majorant) {
+            const auto sigmaMajorant = majorant * mDensityScale;
+            if(!(sigmaMajorant > 0.0f))
+                return true;
+            // the exponential distribution is memoryless, so the tracking restarts at the boundary of each cell
+            for(auto t = t0;;) {
+                t -= std::log1p(-sampler.sample()) / sigmaMajorant;
+                if(t >= t1)
+                    return true;
+                const auto pos = origin + dir * t;
+                // delta tracking: the null collisions are rejected with the probability of the fictitious density
+                if(sampler.sample() * majorant < density(pos)) {
+                    res = MediumInteraction<Setting>{
+                        Point<FrameOfReference::World>::fromRaw(pos),
+                        Rational<Spectrum>::fromRaw(spectrumCast<Spectrum>(RGBSpectrum::fromRaw(mAlbedo), ctx.sampledWavelength)),
+                        mAnisotropy
+                    };
+                    return false;
+                }
+            }
+        });
+        return res;
+    }
+
+    Float transmittance(const ShadingContext<Setting>&, const Ray& ray, const Distance distance,
+                        SampleProvider& sampler) const noexcept override {
+        const auto origin = ray.origin.raw(), dir = ray.direction.raw();
+        Float res = 1.0f;
+        mMajorants.traverse(origin, dir, distance.raw(), [&](const Float t0, const Float t1, const Float majorant) {
+            const auto sigmaMajorant = majorant * mDensityScale;
+            if(!(sigmaMajorant > 0.0f))
+                return true;
+            for(auto t = t0;;) {
+                t -= std::log1p(-sampler.sample()) / sigmaMajorant;
+                if(t >= t1)
+                    return true;
+                // ratio tracking, the low transmittance is terminated by Russian roulette
+                res *= 1.0f - std::fmin(density(origin + dir * t) / majorant, 1.0f);
+                if(res < 0.1f) {
+                    if(sampler.sample() >= 0.5f) {
+                        res = 0.0f;
+                        return false;
+                    }
+                    res *= 2.0f;
+                }
+            }
+        });
+        return res;
+    }
+};
+
+PIPER_REGISTER_VARIANT(OpenVKLVolume, Medium);
+
+PIPER_NAMESPACE_END
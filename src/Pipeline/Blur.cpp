@@ -0,0 +1,350 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/StaticFactory.hpp>
+#include <Piper/Render/PipelineNode.hpp>
+#include <oneapi/tbb/blocked_range2d.h>
+#include <oneapi/tbb/parallel_for.h>
+
+PIPER_NAMESPACE_BEGIN
+
+// the color channel is copied into a packed image, so the inner loops of all passes run over the contiguous floats
+struct PackedImage final {
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;
+    std::pmr::vector<Float> data;
+
+    PackedImage(const uint32_t w, const uint32_t h, const uint32_t c)
+        : width{ w }, height{ h }, channels{ c }, data(static_cast<size_t>(w) * h * c, context().scopedAllocator) {}
+
+    [[nodiscard]] Float* row(const uint32_t y) noexcept {
+        return data.data() + static_cast<size_t>(y) * width * channels;
+    }
+    [[nodiscard]] const Float* row(const uint32_t y) const noexcept {
+        return data.data() + static_cast<size_t>(y) * width * channels;
+    }
+};
+
+// the columns are processed in strips of this many floats, so that a strip of all rows in flight stays in the cache
+constexpr uint32_t columnStripSize = 256;
+constexpr uint32_t rowGrainSize = 16;
+
+static std::pmr::vector<Float> gaussianWeights(const Float sigma, const uint32_t radius) {
+    std::pmr::vector<Float> weights(2 * radius + 1, context().scopedAllocator);
+    Float sum = 0.0f;
+    for(uint32_t idx = 0; idx < weights.size(); ++idx) {
+        const auto x = static_cast<Float>(idx) - static_cast<Float>(radius);
+        sum += weights[idx] = std::exp(-x * x / (2.0f * sigma * sigma));
+    }
+    for(auto& weight : weights)
+        weight /= sum;
+    return weights;
+}
+
+// the borders are clamped to the edge
+static void convolveRows(const PackedImage& src, PackedImage& dst, const std::pmr::vector<Float>& weights) {
+    const auto radius = static_cast<int32_t>(weights.size() / 2);
+    const auto width = static_cast<int32_t>(src.width), channels = src.channels;
+    tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, src.height, rowGrainSize }, [&](const tbb::blocked_range<uint32_t>& range) {
+        for(auto y = range.begin(); y != range.end(); ++y) {
+            const auto in = src.row(y);
+            const auto out = dst.row(y);
+            for(int32_t x = 0; x < width; ++x) {
+                Float sum[3] = {};
+                for(int32_t k = -radius; k <= radius; ++k) {
+                    const auto pixel = in + static_cast<size_t>(std::clamp(x + k, 0, width - 1)) * channels;
+                    const auto weight = weights[k + radius];
+                    for(uint32_t c = 0; c < channels; ++c)
+                        sum[c] += weight * pixel[c];
+                }
+                std::copy_n(sum, channels, out + static_cast<size_t>(x) * channels);
+            }
+        }
+    });
+}
+
+// the rows are accumulated per output row, so the inner loop runs across the columns of the strip
+static void convolveColumns(const PackedImage& src, PackedImage& dst, const std::pmr::vector<Float>& weights) {
+    const auto radius = static_cast<int32_t>(weights.size() / 2);
+    const auto height = static_cast<int32_t>(src.height);
+    const auto rowSize = src.width * src.channels;
+    tbb::parallel_for(tbb::blocked_range2d<uint32_t>{ 0, src.height, rowGrainSize, 0, rowSize, columnStripSize },
+                      [&](const tbb::blocked_range2d<uint32_t>& range) {
+                          const auto begin = range.cols().begin(), end = range.cols().end();
+                          for(auto y = range.rows().begin(); y != range.rows().end(); ++y) {
+                              const auto out = dst.row(y);
+                              std::fill(out + begin, out + end, 0.0f);
+                              for(int32_t k = -radius; k <= radius; ++k) {
+                                  const auto in = src.row(static_cast<uint32_t>(std::clamp(static_cast<int32_t>(y) + k, 0, height - 1)));
+                                  const auto weight = weights[k + radius];
+                                  for(auto idx = begin; idx != end; ++idx)
+                                      out[idx] += weight * in[idx];
+                              }
+                          }
+                      });
+}
+
+// the running sum makes the cost independent of the radius
+static void boxRows(const PackedImage& src, PackedImage& dst, const uint32_t radius) {
+    const auto width = static_cast<int32_t>(src.width), channels = src.channels, r = static_cast<int32_t>(radius);
+    const auto scale = 1.0f / static_cast<Float>(2 * radius + 1);
+    tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, src.height, rowGrainSize }, [&](const tbb::blocked_range<uint32_t>& range) {
+        for(auto y = range.begin(); y != range.end(); ++y) {
+            const auto in = src.row(y);
+            const auto out = dst.row(y);
+            const auto pixel = [&](const int32_t x) { return in + static_cast<size_t>(std::clamp(x, 0, width - 1)) * channels; };
+            // the accumulation is done in double to avoid the drift of the running sum on the wide rows
+            double sum[3] = {};
+            for(int32_t k = -r; k <= r; ++k)
+                for(uint32_t c = 0; c < channels; ++c)
+                    sum[c] += pixel(k)[c];
+            for(int32_t x = 0; x < width; ++x) {
+                for(uint32_t c = 0; c < channels; ++c)
+                    out[static_cast<size_t>(x) * channels + c] = static_cast<Float>(sum[c]) * scale;
+                const auto add = pixel(x + r + 1), sub = pixel(x - r);
+                for(uint32_t c = 0; c < channels; ++c)
+                    sum[c] += add[c] - sub[c];
+            }
+        }
+    });
+}
+
+static void boxColumns(const PackedImage& src, PackedImage& dst, const uint32_t radius) {
+    const auto height = static_cast<int32_t>(src.height), r = static_cast<int32_t>(radius);
+    const auto rowSize = src.width * src.channels;
+    const auto scale = 1.0f / static_cast<Float>(2 * radius + 1);
+    const auto row = [&](const int32_t y) { return src.row(static_cast<uint32_t>(std::clamp(y, 0, height - 1))); };
+    tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, rowSize, columnStripSize }, [&](const tbb::blocked_range<uint32_t>& range) {
+        // NOTICE: the partitioner may merge the chunks, so the range is processed in strips of the size of the running sums
+        for(auto begin = range.begin(); begin < range.end(); begin += columnStripSize) {
+            const auto end = std::min(range.end(), begin + columnStripSize);
+            double sum[columnStripSize] = {};
+            for(int32_t k = -r; k <= r; ++k) {
+                const auto in = row(k);
+                for(auto idx = begin; idx != end; ++idx)
+                    sum[idx - begin] += in[idx];
+            }
+            for(int32_t y = 0; y < height; ++y) {
+                const auto out = dst.row(static_cast<uint32_t>(y));
+                const auto add = row(y + r + 1), sub = row(y - r);
+                for(auto idx = begin; idx != end; ++idx) {
+                    out[idx] = static_cast<Float>(sum[idx - begin]) * scale;
+                    sum[idx - begin] += add[idx] - sub[idx];
+                }
+            }
+        }
+    });
+}
+
+// 2x2 average, the last row/column of the odd sizes is clamped
+static PackedImage downsample(const PackedImage& src) {
+    PackedImage dst{ std::max(1U, src.width / 2), std::max(1U, src.height / 2), src.channels };
+    const auto channels = src.channels;
+    tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, dst.height, rowGrainSize }, [&](const tbb::blocked_range<uint32_t>& range) {
+        for(auto y = range.begin(); y != range.end(); ++y) {
+            const auto in0 = src.row(std::min(2 * y, src.height - 1)), in1 = src.row(std::min(2 * y + 1, src.height - 1));
+            const auto out = dst.row(y);
+            for(uint32_t x = 0; x < dst.width; ++x) {
+                const auto x0 = static_cast<size_t>(std::min(2 * x, src.width - 1)) * channels;
+                const auto x1 = static_cast<size_t>(std::min(2 * x + 1, src.width - 1)) * channels;
+                for(uint32_t c = 0; c < channels; ++c)
+                    out[x * channels + c] = 0.25f * (in0[x0 + c] + in0[x1 + c] + in1[x0 + c] + in1[x1 + c]);
+            }
+        }
+    });
+    return dst;
+}
+
+// bilinear upsampling of src, which is accumulated to dst with the given weight
+template <typename Func>
+static void upsample(const PackedImage& src, const uint32_t width, const uint32_t height, const Func& accumulate) {
+    const auto channels = src.channels;
+    const auto scaleX = static_cast<Float>(src.width) / static_cast<Float>(width);
+    const auto scaleY = static_cast<Float>(src.height) / static_cast<Float>(height);
+    tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, height, rowGrainSize }, [&](const tbb::blocked_range<uint32_t>& range) {
+        for(auto y = range.begin(); y != range.end(); ++y) {
+            const auto fy = std::clamp((static_cast<Float>(y) + 0.5f) * scaleY - 0.5f, 0.0f, static_cast<Float>(src.height - 1));
+            const auto y0 = static_cast<uint32_t>(fy), y1 = std::min(y0 + 1, src.height - 1);
+            const auto ty = fy - static_cast<Float>(y0);
+            const auto in0 = src.row(y0), in1 = src.row(y1);
+            for(uint32_t x = 0; x < width; ++x) {
+                const auto fx = std::clamp((static_cast<Float>(x) + 0.5f) * scaleX - 0.5f, 0.0f, static_cast<Float>(src.width - 1));
+                const auto x0 = static_cast<uint32_t>(fx), x1 = std::min(x0 + 1, src.width - 1);
+                const auto tx = fx - static_cast<Float>(x0);
+                Float value[3];
+                for(uint32_t c = 0; c < channels; ++c) {
+                    const auto top = glm::mix(in0[x0 * channels + c], in0[x1 * channels + c], tx);
+                    const auto bottom = glm::mix(in1[x0 * channels + c], in1[x1 * channels + c], tx);
+                    value[c] = glm::mix(top, bottom, ty);
+                }
+                accumulate(x, y, value);
+            }
+        }
+    });
+}
+
+enum class BlurKernel { Gaussian, Box, Bloom };
+
+// The blurs are separable, so the cost per pixel is linear in the radius for the Gaussian kernel and constant for the box kernel.
+// The bloom is built from the mip chain of the bright pixels instead of a wide kernel, each level is blurred by a small Gaussian
+// and they are accumulated from the coarsest one.
+class Blur final : public PipelineNode {
+    BlurKernel mKernel = BlurKernel::Gaussian;
+    Float mRadius = 3.0f;  // in pixels, the Gaussian kernel is truncated at 3 sigma
+    Float mThreshold = 1.0f;
+    Float mIntensity = 0.1f;
+    uint32_t mLevels = 6;
+
+    void gaussian(PackedImage& image, const Float sigma) const {
+        const auto radius = static_cast<uint32_t>(std::ceil(3.0f * sigma));
+        if(radius == 0)
+            return;
+        const auto weights = gaussianWeights(sigma, radius);
+        PackedImage tmp{ image.width, image.height, image.channels };
+        convolveRows(image, tmp, weights);
+        convolveColumns(tmp, image, weights);
+    }
+
+    void box(PackedImage& image, const uint32_t radius) const {
+        if(radius == 0)
+            return;
+        PackedImage tmp{ image.width, image.height, image.channels };
+        boxRows(image, tmp, radius);
+        boxColumns(tmp, image, radius);
+    }
+
+    // returns the bloom at the half resolution
+    [[nodiscard]] PackedImage bloom(const PackedImage& image) const {
+        PackedImage bright{ image.width, image.height, image.channels };
+        const auto threshold = mThreshold;
+        tbb::parallel_for(tbb::blocked_range<size_t>{ 0, image.data.size() }, [&](const tbb::blocked_range<size_t>& range) {
+            for(auto idx = range.begin(); idx != range.end(); ++idx)
+                bright.data[idx] = std::fmax(image.data[idx] - threshold, 0.0f);
+        });
+
+        std::pmr::vector<PackedImage> levels{ context().scopedAllocator };
+        levels.reserve(mLevels);
+        levels.push_back(downsample(bright));
+        while(levels.size() < mLevels && levels.back().width > 1 && levels.back().height > 1)
+            levels.push_back(downsample(levels.back()));
+        for(auto& level : levels)
+            gaussian(level, 1.5f);
+
+        for(auto idx = levels.size() - 1; idx > 0; --idx) {
+            auto& dst = levels[idx - 1];
+            upsample(levels[idx], dst.width, dst.height, [&](const uint32_t x, const uint32_t y, const Float* value) {
+                const auto out = dst.row(y) + static_cast<size_t>(x) * dst.channels;
+                for(uint32_t c = 0; c < dst.channels; ++c)
+                    out[c] += value[c];
+            });
+        }
+        return std::move(levels.front());
+    }
+
+public:
+    explicit Blur(const Ref<ConfigNode>& node) {
+        if(const auto ptr = node->tryGet("Kernel"sv)) {
+            const auto name = (*ptr)->as<std::string_view>();
+            if(name == "Gaussian"sv)
+                mKernel = BlurKernel::Gaussian;
+            else if(name == "Box"sv)
+                mKernel = BlurKernel::Box;
+            else if(name == "Bloom"sv)
+                mKernel = BlurKernel::Bloom;
+            else
+                fatal(fmt::format("Unrecognized blur kernel \"{}\"", name));
+        }
+        if(const auto ptr = node->tryGet("Radius"sv))
+            mRadius = std::fmax((*ptr)->as<Float>(), 0.0f);
+        if(const auto ptr = node->tryGet("Threshold"sv))
+            mThreshold = std::fmax((*ptr)->as<Float>(), 0.0f);
+        if(const auto ptr = node->tryGet("Intensity"sv))
+            mIntensity = (*ptr)->as<Float>();
+        if(const auto ptr = node->tryGet("Levels"sv))
+            mLevels = std::max(1U, (*ptr)->as<uint32_t>());
+    }
+    [[nodiscard]] bool stateless() const noexcept override {
+        return true;
+    }
+    // the color plane is read contiguously without touching the other channels
+    [[nodiscard]] std::optional<FrameLayout> layout() const noexcept override {
+        return FrameLayout::Planar;
+    }
+
+    ChannelRequirement setup(ChannelRequirement req) override {
+        if(!req.contains(Channel::Color))
+            req[Channel::Color] = false;
+        return req;
+    }
+
+    Ref<Frame> transform(Ref<Frame> frame) override {
+        MemoryArena arena;
+        auto res = Frame::makeUnique(std::move(frame));
+        const auto& metadata = res->metadata();
+        const auto [offset, pixelStride, rowStride] = metadata.view(Channel::Color);
+        const auto base = reinterpret_cast<std::byte*>(res->mutableData().data()) + offset;
+        const auto channels = metadata.spectrumType == SpectrumType::Mono ? 1U : 3U;
+        const auto pixel = [&](const uint32_t x, const uint32_t y) {
+            return reinterpret_cast<Float*>(base + static_cast<size_t>(y) * rowStride + static_cast<size_t>(x) * pixelStride);
+        };
+
+        PackedImage image{ metadata.width, metadata.height, channels };
+        tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, metadata.height, rowGrainSize }, [&](const tbb::blocked_range<uint32_t>& range) {
+            for(auto y = range.begin(); y != range.end(); ++y)
+                for(uint32_t x = 0; x < metadata.width; ++x)
+                    std::copy_n(pixel(x, y), channels, image.row(y) + static_cast<size_t>(x) * channels);
+        });
+
+        const auto writeBack = [&](const PackedImage& src) {
+            tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, metadata.height, rowGrainSize },
+                              [&](const tbb::blocked_range<uint32_t>& range) {
+                                  for(auto y = range.begin(); y != range.end(); ++y)
+                                      for(uint32_t x = 0; x < metadata.width; ++x)
+                                          std::copy_n(src.row(y) + static_cast<size_t>(x) * channels, channels, pixel(x, y));
+                              });
+        };
+
+        switch(mKernel) {
+            case BlurKernel::Gaussian:
+                gaussian(image, mRadius / 3.0f);
+                writeBack(image);
+                break;
+            case BlurKernel::Box:
+                box(image, static_cast<uint32_t>(mRadius));
+                writeBack(image);
+                break;
+            case BlurKernel::Bloom: {
+                const auto intensity = mIntensity;
+                upsample(bloom(image), metadata.width, metadata.height, [&](const uint32_t x, const uint32_t y, const Float* value) {
+                    const auto out = pixel(x, y);
+                    for(uint32_t c = 0; c < channels; ++c)
+                        out[c] += intensity * value[c];
+                });
+            } break;
+        }
+
+        return res;
+    }
+};
+
+PIPER_REGISTER_CLASS(Blur, PipelineNode);
+
+PIPER_NAMESPACE_END
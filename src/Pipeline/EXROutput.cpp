@@ -17,91 +17,151 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
-
-#include <OpenEXR/ImfRgbaFile.h>
+#include <OpenEXR/ImfChannelList.h>
+#include <OpenEXR/ImfFrameBuffer.h>
+#include <OpenEXR/ImfHeader.h>
+#include <OpenEXR/ImfOutputFile.h>
+#include <OpenEXR/ImfThreading.h>
 #include <Piper/Core/StaticFactory.hpp>
 #include <Piper/Core/Sync.hpp>
+#include <Piper/Core/Threading.hpp>
+#include <Piper/Render/ColorSpace.hpp>
 #include <Piper/Render/PipelineNode.hpp>
 #include <magic_enum.hpp>
+#include <mutex>
 #include <oneapi/tbb/parallel_for.h>
+#include <optional>
 
 PIPER_NAMESPACE_BEGIN
 
+// All channels of a frame are written to a single EXR file, the color channel is stored as RGB (or Y) and the others are stored as
+// layers (e.g., Albedo.R, ShadingNormal.X, Depth.Z). The slices refer to the frame directly, so the film is never repacked.
 class EXROutput final : public PipelineNode {
     std::pmr::string mOutputPath;
+    // the color channel is converted from the standard linear RGB before writing if it is specified
+    std::optional<ColorSpaceConverter> mConverter;
+    Imf::Compression mCompression = Imf::ZIP_COMPRESSION;
+    bool mHalfFloat = true;  // the geometric channels (position and depth) are always stored in full precision
+    std::pmr::vector<Channel> mChannels{ context().globalAllocator };
+
+    static Imf::Compression parseCompression(const std::string_view name) {
+        constexpr std::pair<std::string_view, Imf::Compression> compressions[] = {
+            { "None"sv, Imf::NO_COMPRESSION },   { "RLE"sv, Imf::RLE_COMPRESSION },   { "ZIPS"sv, Imf::ZIPS_COMPRESSION },
+            { "ZIP"sv, Imf::ZIP_COMPRESSION },   { "PIZ"sv, Imf::PIZ_COMPRESSION },   { "PXR24"sv, Imf::PXR24_COMPRESSION },
+            { "B44"sv, Imf::B44_COMPRESSION },   { "B44A"sv, Imf::B44A_COMPRESSION }, { "DWAA"sv, Imf::DWAA_COMPRESSION },
+            { "DWAB"sv, Imf::DWAB_COMPRESSION },
+        };
+        for(const auto& [key, value] : compressions)
+            if(key == name)
+                return value;
+        fatal(fmt::format("Unrecognized EXR compression \"{}\"", name));
+    }
 
 public:
     explicit EXROutput(const Ref<ConfigNode>& node)
-        : mOutputPath{ node->get("OutputPath"sv)->as<std::string_view>(), context().globalAllocator } {}
+        : mOutputPath{ node->get("OutputPath"sv)->as<std::string_view>(), context().globalAllocator } {
+        if(const auto ptr = node->tryGet("ColorSpace"sv))
+            mConverter = getStandardLinearRGB2RGBConverter((*ptr)->as<std::string_view>());
+        if(const auto ptr = node->tryGet("Compression"sv))
+            mCompression = parseCompression((*ptr)->as<std::string_view>());
+        if(const auto ptr = node->tryGet("HalfFloat"sv))
+            mHalfFloat = (*ptr)->as<bool>();
+
+        // the color channel is requested by default, the AOVs are written as layers if they are listed
+        if(const auto ptr = node->tryGet("Channels"sv)) {
+            for(const auto& channel : (*ptr)->as<ConfigAttr::AttrArray>())
+                mChannels.push_back(magic_enum::enum_cast<Channel>(channel->as<std::string_view>()).value());
+        } else
+            mChannels.push_back(Channel::Color);
+
+        // the scanline blocks are compressed by the global thread pool of OpenEXR
+        static std::once_flag flag;
+        std::call_once(flag, [] { Imf::setGlobalThreadCount(static_cast<int32_t>(threadBudget())); });
+    }
+    // the output path is resolved per frame
+    [[nodiscard]] bool stateless() const noexcept override {
+        return true;
+    }
+
     ChannelRequirement setup(const ChannelRequirement req) override {
         if(!req.empty())
             fatal("EXROutput is a sink node");
-        return { { { Channel::Color, false } }, context().globalAllocator };
+        ChannelRequirement res{ context().globalAllocator };
+        for(const auto channel : mChannels)
+            res[channel] = false;
+        return res;
     }
 
     Ref<Frame> transform(const Ref<Frame> frame) override {
         MemoryArena arena;
         const auto& metadata = frame->metadata();
-        uint32_t stride = 0;
+        if(!metadata.isHDR)
+            fatal("LDR images are not supported by EXR output node.");
 
         const auto frameIdx = std::to_string(metadata.frameIdx);
         const auto actionIdx = std::to_string(metadata.actionIdx);
         ResolveConfiguration pathResolver{ context().scopedAllocator };
         pathResolver["${FrameIdx}"] = frameIdx;
         pathResolver["${ActionIdx}"] = actionIdx;
+        const auto fileName = resolveString(mOutputPath, pathResolver);
 
-        for(const auto channel : metadata.channels) {
-            pathResolver["${Channel}"] = magic_enum::enum_name(channel);
+        Imf::Header header{ static_cast<int32_t>(metadata.width), static_cast<int32_t>(metadata.height) };
+        header.compression() = mCompression;
+        Imf::FrameBuffer frameBuffer;
 
-            if(channel != Channel::Color) {
-                info(fmt::format("Channel {} is skipped by EXR output node.", magic_enum::enum_name(channel)));
-                stride += channelSize(channel, metadata.spectrumType);
+        const auto pixelCount = static_cast<size_t>(metadata.width) * metadata.height;
+        const auto mono = metadata.spectrumType == SpectrumType::Mono;
+        const auto base = reinterpret_cast<char*>(const_cast<Float*>(frame->data().data()));
+
+        // the converted color is the only scratch buffer
+        std::pmr::vector<float> rgb{ context().scopedAllocator };
+        for(const auto channel : metadata.channels) {
+            if(std::ranges::find(mChannels, channel) == mChannels.cend())
                 continue;
-            }
 
-            if(!metadata.isHDR)
-                fatal("LDR images are not supported by EXR output node.");
-
-            const auto pixelCount = metadata.width * metadata.height;
-            std::pmr::vector<Imf::Rgba> buffer{ pixelCount, context().scopedAllocator };
-            const auto base = frame->data().data() + static_cast<size_t>(stride);
-
-            if(metadata.spectrumType == SpectrumType::LinearRGB) {
-                tbb::parallel_for(
-                    tbb::blocked_range<uint32_t>{ 0, pixelCount },
-                    [&](const tbb::blocked_range<uint32_t>& range) {
-                        for(auto idx = range.begin(); idx != range.end(); ++idx) {
-                            const auto src = base + static_cast<size_t>(idx * metadata.pixelStride);
-                            buffer[idx] = Imf::Rgba{ src[0], src[1], src[2] };
-                        }
-                    },
-                    globalAffinityPartitioner);
-            } else {
-                tbb::parallel_for(
-                    tbb::blocked_range<uint32_t>{ 0, pixelCount },
-                    [&](const tbb::blocked_range<uint32_t>& range) {
-                        for(auto idx = range.begin(); idx != range.end(); ++idx) {
-                            const auto src = base + static_cast<size_t>(idx * metadata.pixelStride);
-                            buffer[idx] = Imf::Rgba{ src[0], src[0], src[0] };
-                        }
-                    },
-                    globalAffinityPartitioner);
+            const auto size = static_cast<uint32_t>(channelSize(channel, metadata.spectrumType));
+            const auto view = metadata.view(channel);
+            auto channelBase = base + view.byteStride;
+            auto channelStride = view.pixelStride;
+
+            if(channel == Channel::Color && !mono && mConverter) {
+                rgb.resize(pixelCount * 3);
+                const auto src = channelBase;
+                tbb::parallel_for(tbb::blocked_range<size_t>{ 0, pixelCount }, [&](const tbb::blocked_range<size_t>& range) {
+                    for(auto idx = range.begin(); idx != range.end(); ++idx)
+                        std::copy_n(reinterpret_cast<const Float*>(src + idx * channelStride), 3, rgb.data() + idx * 3);
+                });
+                mConverter->apply(rgb.data(), pixelCount, 3);
+                channelBase = reinterpret_cast<char*>(rgb.data());
+                channelStride = 3 * sizeof(float);
             }
 
-            const auto fileName = resolveString(mOutputPath, pathResolver);
-            {
-                Imf::RgbaOutputFile file{ fileName.c_str(), static_cast<int32_t>(metadata.width), static_cast<int32_t>(metadata.height),
-                                          metadata.spectrumType == SpectrumType::LinearRGB ? Imf::WRITE_RGB : Imf::WRITE_Y };
-                file.setFrameBuffer(buffer.data(), 1, metadata.width);
-                file.writePixels(static_cast<int32_t>(metadata.height));
+            // the channels stored in half precision are written as is
+            const auto storedHalf = metadata.format(channel) == ChannelFormat::Half;
+            const auto storageType = storedHalf ? Imf::HALF : Imf::FLOAT;
+            // the tick counts of the cost channel overflow half precision
+            const auto geometric = channel == Channel::Position || channel == Channel::Depth || channel == Channel::Cost;
+            const auto pixelType = storedHalf || (mHalfFloat && !geometric) ? Imf::HALF : Imf::FLOAT;
+
+            const auto prefix = channel == Channel::Color ? std::string{} : fmt::format("{}.", magic_enum::enum_name(channel));
+            for(uint32_t idx = 0; idx < size; ++idx) {
+                const auto name = prefix + std::string{ channelComponentName(channel, size, idx) };
+                header.channels().insert(name, Imf::Channel{ pixelType });
+                frameBuffer.insert(name,
+                                   Imf::Slice{ storageType, channelBase + idx * formatSize(metadata.format(channel)), channelStride,
+                                               channelStride * metadata.width });
             }
+        }
 
-            auto& sync = getDisplayProvider();
-            sync.open(fs::absolute(fileName).generic_string());
-
-            stride += channelSize(channel, metadata.spectrumType);
+        {
+            Imf::OutputFile file{ fileName.c_str(), header };
+            file.setFrameBuffer(frameBuffer);
+            file.writePixels(static_cast<int32_t>(metadata.height));
         }
 
+        auto& sync = getDisplayProvider();
+        sync.open(fs::absolute(fileName).generic_string());
+
         return {};
     }
 };
@@ -18,25 +18,172 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <OpenImageIO/imageio.h>
 #include <Piper/Core/StaticFactory.hpp>
+#include <Piper/Core/Sync.hpp>
+#include <Piper/Core/Threading.hpp>
+#include <Piper/Render/ColorSpace.hpp>
 #include <Piper/Render/PipelineNode.hpp>
+#include <Piper/Render/Random.hpp>
+#include <Piper/Render/ToneMapping.hpp>
+#include <mutex>
+#include <oneapi/tbb/parallel_for.h>
+#include <optional>
 
 PIPER_NAMESPACE_BEGIN
 
+enum class TransferFunction { Linear, sRGB, Rec709 };
+
+// The color channel is tone mapped, encoded and quantized in a single pass over the frame, so the only buffer is the 8-bit image.
+// The scanlines are processed in parallel, and each row is transposed into the pixel blocks of the shared tone curves on the stack.
 class LDROutput final : public PipelineNode {
     std::pmr::string mOutputPath;
+    std::optional<ColorSpaceConverter> mConverter;
+    Float mExposure = 1.0f;
+    ToneMappingOperator mToneCurve = ToneMappingOperator::None;
+    Float mWhitePoint = std::numeric_limits<Float>::infinity();  // for Reinhard, the plain one by default
+    TransferFunction mTransfer = TransferFunction::sRGB;
+    bool mDither = true;
+    uint32_t mQuality = 95;  // only used by JPEG
+
+    [[nodiscard]] Float encode(const Float x) const noexcept {
+        switch(mTransfer) {
+            case TransferFunction::Linear:
+                return x;
+            case TransferFunction::sRGB:
+                return x <= 0.0031308f ? 12.92f * x : 1.055f * std::pow(x, 1.0f / 2.4f) - 0.055f;
+            case TransferFunction::Rec709:
+                return x < 0.018f ? 4.5f * x : 1.099f * std::pow(x, 0.45f) - 0.099f;
+        }
+        PIPER_UNREACHABLE();
+    }
+
+    // the triangular noise of one LSB hides the banding of the smooth gradients
+    [[nodiscard]] static Float dither(const uint64_t seed) noexcept {
+        const auto bits = seeding(seed);
+        constexpr auto scale = 0x1p-32f;
+        return (static_cast<Float>(static_cast<uint32_t>(bits)) + static_cast<Float>(static_cast<uint32_t>(bits >> 32))) * scale - 1.0f;
+    }
+
+    static TransferFunction parseTransferFunction(const std::string_view name) {
+        constexpr std::pair<std::string_view, TransferFunction> functions[] = { { "Linear"sv, TransferFunction::Linear },
+                                                                                 { "sRGB"sv, TransferFunction::sRGB },
+                                                                                 { "Rec709"sv, TransferFunction::Rec709 } };
+        for(const auto& [key, value] : functions)
+            if(key == name)
+                return value;
+        fatal(fmt::format("Unrecognized transfer function \"{}\"", name));
+    }
 
 public:
     explicit LDROutput(const Ref<ConfigNode>& node)
-        : mOutputPath{ node->get("OutputPath"sv)->as<std::string_view>(), context().globalAllocator } {}
+        : mOutputPath{ node->get("OutputPath"sv)->as<std::string_view>(), context().globalAllocator } {
+        if(const auto ptr = node->tryGet("ColorSpace"sv))
+            mConverter = getStandardLinearRGB2RGBConverter((*ptr)->as<std::string_view>());
+        // in stops
+        if(const auto ptr = node->tryGet("Exposure"sv))
+            mExposure = std::exp2((*ptr)->as<Float>());
+        if(const auto ptr = node->tryGet("ToneCurve"sv))
+            mToneCurve = parseToneMappingOperator((*ptr)->as<std::string_view>());
+        if(const auto ptr = node->tryGet("WhitePoint"sv))
+            mWhitePoint = std::fmax((*ptr)->as<Float>(), epsilon);
+        if(const auto ptr = node->tryGet("TransferFunction"sv))
+            mTransfer = parseTransferFunction((*ptr)->as<std::string_view>());
+        if(const auto ptr = node->tryGet("Dither"sv))
+            mDither = (*ptr)->as<bool>();
+        if(const auto ptr = node->tryGet("Quality"sv))
+            mQuality = std::clamp((*ptr)->as<uint32_t>(), 1U, 100U);
+
+        static std::once_flag flag;
+        std::call_once(flag, [] { OIIO::attribute("threads", static_cast<int32_t>(threadBudget())); });
+    }
+    // the output path is resolved per frame
+    [[nodiscard]] bool stateless() const noexcept override {
+        return true;
+    }
+
     ChannelRequirement setup(const ChannelRequirement req) override {
         if(!req.empty())
             fatal("LDROutput is a sink node");
         return { { { Channel::Color, false } }, context().globalAllocator };
     }
 
-    Ref<Frame> transform(Ref<Frame> frame) override {
-        PIPER_NOT_IMPLEMENTED();
+    Ref<Frame> transform(const Ref<Frame> frame) override {
+        MemoryArena arena;
+        const auto& metadata = frame->metadata();
+
+        const auto frameIdx = std::to_string(metadata.frameIdx);
+        const auto actionIdx = std::to_string(metadata.actionIdx);
+        ResolveConfiguration pathResolver{ context().scopedAllocator };
+        pathResolver["${FrameIdx}"] = frameIdx;
+        pathResolver["${ActionIdx}"] = actionIdx;
+        const auto fileName = resolveString(mOutputPath, pathResolver);
+
+        const auto mono = metadata.spectrumType == SpectrumType::Mono;
+        const auto channels = mono ? 1U : 3U;
+        const auto [offset, pixelStride, rowStride] = metadata.view(Channel::Color);
+        const auto base = frame->data().data();
+        const auto width = metadata.width;
+
+        // the LDR frames are already encoded, so only the quantization is applied
+        const auto hdr = metadata.isHDR;
+        std::pmr::vector<uint8_t> image(static_cast<size_t>(width) * metadata.height * channels, context().scopedAllocator);
+        const auto seed = (static_cast<uint64_t>(metadata.actionIdx) << 32) | metadata.frameIdx;
+
+        tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, metadata.height }, [&](const tbb::blocked_range<uint32_t>& range) {
+            PixelBlock block;
+            for(auto y = range.begin(); y != range.end(); ++y) {
+                const auto row = reinterpret_cast<const std::byte*>(base) + offset + static_cast<size_t>(y) * rowStride;
+                const auto dst = image.data() + static_cast<size_t>(y) * width * channels;
+                for(uint32_t x = 0; x < width; x += pixelBlockSize) {
+                    const auto count = std::min(pixelBlockSize, width - x);
+                    for(uint32_t idx = 0; idx < count; ++idx) {
+                        const auto src = reinterpret_cast<const Float*>(row + static_cast<size_t>(x + idx) * pixelStride);
+                        glm::vec3 rgb{ src[0] };
+                        if(!mono)
+                            rgb = { src[0], src[1], src[2] };
+                        if(hdr && mConverter && !mono)
+                            rgb = (*mConverter)(rgb);
+                        block.r[idx] = rgb.x;
+                        block.g[idx] = rgb.y;
+                        block.b[idx] = rgb.z;
+                    }
+                    if(hdr) {
+                        applyPerChannel(block, count, [this](const Float v) { return std::fmax(v * mExposure, 0.0f); });
+                        applyToneCurve(block, count, mToneCurve, mWhitePoint);
+                        applyPerChannel(block, count, [this](const Float v) { return encode(v); });
+                    }
+
+                    for(uint32_t idx = 0; idx < count; ++idx) {
+                        const Float value[3] = { block.r[idx], block.g[idx], block.b[idx] };
+                        const auto pixelIdx = static_cast<uint64_t>(y) * width + x + idx;
+                        for(uint32_t channel = 0; channel < channels; ++channel) {
+                            auto v = std::clamp(value[channel], 0.0f, 1.0f) * 255.0f;
+                            if(mDither)
+                                v += dither(seeding(seed ^ (pixelIdx * channels + channel)));
+                            dst[(x + idx) * channels + channel] = static_cast<uint8_t>(std::clamp(v + 0.5f, 0.0f, 255.0f));
+                        }
+                    }
+                }
+            }
+        });
+
+        const auto output = OIIO::ImageOutput::create(fileName);
+        if(!output)
+            fatal(fmt::format("Failed to create the image output for {}: {}", fileName, OIIO::geterror()));
+        OIIO::ImageSpec spec{ static_cast<int32_t>(width), static_cast<int32_t>(metadata.height), static_cast<int32_t>(channels),
+                              OIIO::TypeDesc::UINT8 };
+        // the quality is only meaningful for JPEG, the other formats keep their default (lossless) compression
+        if(std::string_view{ output->format_name() } == "jpeg"sv)
+            spec.attribute("Compression", fmt::format("jpeg:{}", mQuality));
+        if(mTransfer == TransferFunction::sRGB)
+            spec.attribute("oiio:ColorSpace", "sRGB");
+        if(!output->open(fileName, spec) || !output->write_image(OIIO::TypeDesc::UINT8, image.data()) || !output->close())
+            fatal(fmt::format("Failed to write {}: {}", fileName, output->geterror()));
+
+        auto& sync = getDisplayProvider();
+        sync.open(fs::absolute(fileName).generic_string());
+
         return {};
     }
 };
@@ -20,6 +20,7 @@
 
 #include <OpenImageDenoise/oidn.hpp>
 #include <Piper/Core/StaticFactory.hpp>
+#include <Piper/Core/Threading.hpp>
 #include <Piper/Render/PipelineNode.hpp>
 #include <magic_enum.hpp>
 #include <unordered_set>
@@ -27,13 +28,60 @@
 PIPER_NAMESPACE_BEGIN
 
 class IntelOpenImageDenoiser final : public PipelineNode {
-    oidn::DeviceRef mDevice = oidn::newDevice();
+    oidn::DeviceRef mDevice;
     bool mEnable = true;
+    // OIDN splits the image into tiles internally if the estimated memory usage exceeds the budget, 0 means the default one
+    uint32_t mMaxMemory = 0;  // in MB
+
+    // the committed filters are reused by the frames with the same layout, only the image pointers are updated per frame
+    struct Filters final {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t pixelStride = 0;
+        bool hdr = false;
+        FrameLayout layout = FrameLayout::Interleaved;
+        oidn::FilterRef albedo;
+        oidn::FilterRef normal;
+        oidn::FilterRef color;
+    };
+    Filters mFilters;
+
+    oidn::FilterRef newFilter() {
+        auto filter = mDevice.newFilter("RT");
+        if(mMaxMemory)
+            filter.set("maxMemoryMB", static_cast<int32_t>(mMaxMemory));
+        return filter;
+    }
+
+    static void setImage(oidn::FilterRef& filter, const char* name, float* data, const FrameMetadata& metadata, const Channel channel) {
+        const auto view = metadata.view(channel);
+        const auto format = metadata.format(channel) == ChannelFormat::Half ? oidn::Format::Half3 : oidn::Format::Float3;
+        filter.setImage(name, data, format, metadata.width, metadata.height, view.byteStride, view.pixelStride, view.rowStride);
+    }
 
 public:
     explicit IntelOpenImageDenoiser(const Ref<ConfigNode>& node) {
         if(const auto enable = node->tryGet("Enable"sv))
             mEnable = (*enable)->as<bool>();
+        if(const auto ptr = node->tryGet("MaxMemory"sv))
+            mMaxMemory = (*ptr)->as<uint32_t>();
+
+        auto deviceType = oidn::DeviceType::Default;
+        if(const auto ptr = node->tryGet("Device"sv)) {
+            const auto name = (*ptr)->as<std::string_view>();
+            if(const auto type = magic_enum::enum_cast<oidn::DeviceType>(name))
+                deviceType = *type;
+            else
+                fatal(fmt::format("Unrecognized OIDN device type \"{}\"", name));
+        }
+        mDevice = oidn::newDevice(deviceType);
+        // the thread count is only meaningful for the CPU devices, 0 means all hardware threads
+        auto threads = threadBudget();
+        if(const auto ptr = node->tryGet("Threads"sv))
+            threads = (*ptr)->as<uint32_t>();
+        mDevice.set("numThreads", static_cast<int32_t>(threads));
+        if(boundNumaNode())
+            mDevice.set("setAffinity", false);
 
         mDevice.setErrorFunction([](void*, const oidn::Error code, const char* message) {
             fatal(fmt::format("[ERROR] {}: {}", magic_enum::enum_name(code), message));
@@ -44,66 +92,65 @@ public:
         if(!mEnable)
             return frame;
 
-        const auto& metadata = frame->metadata();
-        if(metadata.spectrumType == SpectrumType::Mono) {
+        if(frame->metadata().spectrumType == SpectrumType::Mono) {
             warning("Cannot denoise mono image. Skipped.");
             return frame;
         }
 
-        const std::pmr::unordered_set<Channel> channels{ metadata.channels.cbegin(), metadata.channels.cend(), 16, context().localAllocator};
-        std::pmr::vector<oidn::FilterRef> filters{ context().localAllocator };
-        const auto base = const_cast<float*>(frame->data().data());
-        auto data = frame->data();
-        constexpr auto format = oidn::Format::Float3;
-
-        if(channels.contains(Channel::Albedo)) {
-            auto filter = mDevice.newFilter("RT");
-            const auto view = metadata.view(Channel::Albedo);
-            filter.setImage("albedo", base, format, metadata.width, metadata.height, view.byteStride, view.pixelStride, view.rowStride);
-            filter.setImage("output", data.data(), format, metadata.width, metadata.height, view.byteStride, view.pixelStride,
-                            view.rowStride);
-            filter.commit();
-            filters.push_back(std::move(filter));
+        // the filters are applied in place, the auxiliary channels are denoised before the color channel which reads them
+        auto res = Frame::makeUnique(std::move(frame));
+        const auto& metadata = res->metadata();
+
+        const std::pmr::unordered_set<Channel> channels{ metadata.channels.cbegin(), metadata.channels.cend(), 16,
+                                                         context().localAllocator };
+        const auto hasAlbedo = channels.contains(Channel::Albedo), hasNormal = channels.contains(Channel::ShadingNormal),
+                   hasColor = channels.contains(Channel::Color);
+
+        auto& filters = mFilters;
+        if(filters.width != metadata.width || filters.height != metadata.height || filters.pixelStride != metadata.pixelStride ||
+           filters.hdr != metadata.isHDR || filters.layout != metadata.layout || static_cast<bool>(filters.albedo) != hasAlbedo ||
+           static_cast<bool>(filters.normal) != hasNormal || static_cast<bool>(filters.color) != hasColor) {
+            filters = { metadata.width, metadata.height, metadata.pixelStride, metadata.isHDR, metadata.layout };
+            if(hasAlbedo)
+                filters.albedo = newFilter();
+            if(hasNormal)
+                filters.normal = newFilter();
+            if(hasColor) {
+                filters.color = newFilter();
+                filters.color.set("hdr", metadata.isHDR);
+                // the auxiliary images fed to the color filter are the prefiltered ones
+                filters.color.set("cleanAux", hasAlbedo && hasNormal);
+            }
         }
 
-        if(channels.contains(Channel::ShadingNormal)) {
-            auto filter = mDevice.newFilter("RT");
-            const auto view = metadata.view(Channel::ShadingNormal);
-            filter.setImage("normal", base, format, metadata.width, metadata.height, view.byteStride, view.pixelStride, view.rowStride);
-            filter.setImage("output", data.data(), format, metadata.width, metadata.height, view.byteStride, view.pixelStride,
-                            view.rowStride);
-            filter.commit();
-            filters.push_back(std::move(filter));
-        }
+        const auto data = res->mutableData().data();
 
-        if(channels.contains(Channel::Color)) {
-            auto filter = mDevice.newFilter("RT");
-            const auto view = metadata.view(Channel::Color);
-            filter.setImage("color", base, format, metadata.width, metadata.height, view.byteStride, view.pixelStride, view.rowStride);
-            filter.setImage("output", data.data(), format, metadata.width, metadata.height, view.byteStride, view.pixelStride,
-                            view.rowStride);
-            filter.set("hdr", metadata.isHDR);
-
-            if(channels.contains(Channel::Albedo) && channels.contains(Channel::ShadingNormal)) {
-                // FIXME: prefilter doesn't work
-                // filter.set("cleanAux", true);
-                const auto albedoView = metadata.view(Channel::Albedo);
-                filter.setImage("albedo", data.data(), format, metadata.width, metadata.height, albedoView.byteStride,
-                                albedoView.pixelStride, albedoView.rowStride);
-
-                const auto normalView = metadata.view(Channel::ShadingNormal);
-                filter.setImage("normal", data.data(), format, metadata.width, metadata.height, normalView.byteStride,
-                                normalView.pixelStride, normalView.rowStride);
+        // the auxiliary channels are prefiltered once per frame, then the color filter reads the clean ones in place
+        if(hasAlbedo) {
+            setImage(filters.albedo, "albedo", data, metadata, Channel::Albedo);
+            setImage(filters.albedo, "output", data, metadata, Channel::Albedo);
+            filters.albedo.commit();
+        }
+        if(hasNormal) {
+            setImage(filters.normal, "normal", data, metadata, Channel::ShadingNormal);
+            setImage(filters.normal, "output", data, metadata, Channel::ShadingNormal);
+            filters.normal.commit();
+        }
+        if(hasColor) {
+            setImage(filters.color, "color", data, metadata, Channel::Color);
+            setImage(filters.color, "output", data, metadata, Channel::Color);
+            if(hasAlbedo && hasNormal) {
+                setImage(filters.color, "albedo", data, metadata, Channel::Albedo);
+                setImage(filters.color, "normal", data, metadata, Channel::ShadingNormal);
             }
-
-            filter.commit();
-            filters.push_back(std::move(filter));
+            filters.color.commit();
         }
 
-        for(auto& filter : filters)
-            filter.execute();
+        for(auto* filter : { &filters.albedo, &filters.normal, &filters.color })
+            if(*filter)
+                filter->execute();
 
-        return makeRefCount<Frame>(metadata, std::move(data));
+        return res;
     }
 
     ChannelRequirement setup(ChannelRequirement req) override {
@@ -21,13 +21,23 @@
 #include <Piper/Core/StaticFactory.hpp>
 #include <Piper/Core/Sync.hpp>
 #include <Piper/Render/PipelineNode.hpp>
+#include <optional>
 
 PIPER_NAMESPACE_BEGIN
 
+// Sends the finished frames to the display. The frames arriving within the interval of the last update are dropped, so a slow
+// connection never throttles the pipeline.
 class Preview final : public PipelineNode {
+    PreviewPolicy mPolicy;
+    std::optional<PreviewImage> mImage;
+    uint32_t mWidth = 0, mHeight = 0;
+
 public:
     explicit Preview(const Ref<ConfigNode>& node) {
-        PIPER_NOT_IMPLEMENTED();
+        if(const auto ptr = node->tryGet("Interval"sv))
+            mPolicy.minInterval = (*ptr)->as<uint32_t>();
+        if(const auto ptr = node->tryGet("Downsample"sv))
+            mPolicy.downsample = std::max(1U, (*ptr)->as<uint32_t>());
     }
     ChannelRequirement setup(const ChannelRequirement req) override {
         if(!req.empty())
@@ -35,8 +45,36 @@ public:
         return { { { Channel::Color, false } }, context().globalAllocator };
     }
 
-    Ref<Frame> transform(Ref<Frame> frame) override {
-        PIPER_NOT_IMPLEMENTED();
+    Ref<Frame> transform(const Ref<Frame> frame) override {
+        auto& sync = getDisplayProvider();
+        if(!sync.isSupported())
+            return {};
+
+        const auto& metadata = frame->metadata();
+        if(!mImage || mWidth != metadata.width || mHeight != metadata.height) {
+            mWidth = metadata.width;
+            mHeight = metadata.height;
+            mImage.emplace(fmt::format("Task_{:0>4x}_Preview", sync.uniqueID()), mWidth, mHeight, mPolicy);
+        } else if(!mImage->due())
+            return {};
+
+        MemoryArena arena;
+        const auto [offset, pixelStride, rowStride] = metadata.view(Channel::Color);
+        const auto base = reinterpret_cast<const std::byte*>(frame->data().data()) + offset;
+        const auto mono = metadata.spectrumType == SpectrumType::Mono;
+        std::pmr::vector<float> row{ static_cast<size_t>(metadata.width) * 3, context().scopedAllocator };
+        // the skipped rows of the downsampled image are never read
+        for(uint32_t y = 0; y < metadata.height; y += mPolicy.downsample) {
+            const auto line = base + static_cast<size_t>(y) * rowStride;
+            for(uint32_t x = 0; x < metadata.width; ++x) {
+                const auto src = reinterpret_cast<const Float*>(line + static_cast<size_t>(x) * pixelStride);
+                for(uint32_t k = 0; k < 3; ++k)
+                    row[x * 3 + k] = src[mono ? 0 : k];
+            }
+            mImage->update(0, y, row);
+        }
+        mImage->flush(true);
+
         return {};
     }
 };
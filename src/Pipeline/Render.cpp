@@ -18,9 +18,16 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <OpenImageIO/imageio.h>
+#include <Piper/Core/FileIO.hpp>
+#include <Piper/Core/Residency.hpp>
 #include <Piper/Core/StaticFactory.hpp>
+#include <Piper/Core/Stats.hpp>
 #include <Piper/Core/Sync.hpp>
+#include <Piper/Core/Threading.hpp>
+#include <Piper/Core/Trace.hpp>
 #include <Piper/Render/Acceleration.hpp>
+#include <Piper/Render/Distributed.hpp>
 #include <Piper/Render/Filter.hpp>
 #include <Piper/Render/Integrator.hpp>
 #include <Piper/Render/LightSampler.hpp>
@@ -28,20 +35,88 @@
 #include <Piper/Render/PipelineNode.hpp>
 #include <Piper/Render/RenderGlobalSetting.hpp>
 #include <Piper/Render/Sampler.hpp>
+#include <Piper/Render/SamplingUtil.hpp>
 #include <Piper/Render/SceneObject.hpp>
 #include <Piper/Render/Sensor.hpp>
+#include <Piper/Render/Texture.hpp>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <glm/gtc/packing.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <magic_enum.hpp>
 #ifdef _DEBUG
 #include <oneapi/tbb/global_control.h>
 #endif
 #include <oneapi/tbb/parallel_for_each.h>
+#include <oneapi/tbb/parallel_reduce.h>
 #include <oneapi/tbb/spin_mutex.h>
+#include <oneapi/tbb/task_arena.h>
+#include <oneapi/tbb/task_group.h>
 #include <ranges>
+#include <shared_mutex>
+#include <stdexcept>
 #include <unordered_set>
 
 PIPER_NAMESPACE_BEGIN
 
+struct AdaptiveSampling final {
+    uint32_t minSamples = 16;
+    uint32_t batchSize = 16;
+    Float threshold = 0.01f;  // relative standard error
+};
+
+struct ProgressiveRendering final {
+    uint32_t samplesPerPass = 4;
+    double timeBudget = std::numeric_limits<double>::infinity();  // seconds
+    Float targetError = 0.0f;                                       // mean relative standard error, 0 means disabled
+    // the converged image compared with the color channel after each pass, empty means disabled
+    std::pmr::vector<Float> reference{ context().globalAllocator };
+    uint32_t referenceChannels = 0;
+};
+
+// the first three channels of the image are kept, it must have the same resolution as the frame
+static void loadReference(ProgressiveRendering& progressive, const std::string_view path, const uint32_t width, const uint32_t height) {
+    const auto input = OIIO::ImageInput::open(std::string{ path });
+    if(!input)
+        fatal(fmt::format("Failed to open the reference image \"{}\": {}", path, OIIO::geterror()));
+    const auto& spec = input->spec();
+    if(static_cast<uint32_t>(spec.width) != width || static_cast<uint32_t>(spec.height) != height)
+        fatal(fmt::format("The resolution of the reference image \"{}\" is {}x{}, expect {}x{}", path, spec.width, spec.height, width,
+                          height));
+    progressive.referenceChannels = static_cast<uint32_t>(std::min(spec.nchannels, 3));
+    progressive.reference.resize(static_cast<size_t>(width) * height * progressive.referenceChannels);
+    if(!input->read_image(0, 0, 0, static_cast<int32_t>(progressive.referenceChannels), OIIO::TypeDesc::FLOAT,
+                          progressive.reference.data()))
+        fatal(fmt::format("Failed to read the reference image \"{}\": {}", path, input->geterror()));
+}
+
+enum class TileOrder { Spiral, Morton, Hilbert };
+
+// NOTICE: the samples are fully determined by their indices, so the state of the sampler is the current pass
+struct CheckpointHeader final {
+    uint32_t frameIdx;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixelStride;
+    uint32_t tileSize;
+    uint32_t tileCount;
+    uint32_t samplesPerPass;
+    uint32_t passIdx;
+
+    bool compatible(const CheckpointHeader& rhs) const noexcept {
+        return frameIdx == rhs.frameIdx && width == rhs.width && height == rhs.height && pixelStride == rhs.pixelStride &&
+            tileSize == rhs.tileSize && tileCount == rhs.tileCount && samplesPerPass == rhs.samplesPerPass;
+    }
+};
+
+// only the tiles covering the region are rendered, the rest of the frame is taken from the previous result
+struct RegionOfInterest final {
+    RenderRECT rect;
+    std::pmr::string base{ context().globalAllocator };  // a checkpoint or an image written by EXROutput, ${FrameIdx} is resolved
+    Ref<Sampler> sampler;                                   // null means the sampler of the action
+};
+
 struct FrameAction final {
     uint32_t width = 0;
     uint32_t height = 0;
@@ -55,28 +130,115 @@ struct FrameAction final {
 
     std::pmr::vector<Channel> channels{ context().globalAllocator };
     uint32_t channelTotalSize = 0;
+    std::pmr::vector<Channel> halfChannels{ context().globalAllocator };
 
+    // the sensor is resolved by name again when the server replaces it
+    std::pmr::string sensorName{ context().globalAllocator };
     Sensor* sensor = nullptr;
+    FitMode fitMode = FitMode::Fill;
     SensorNDCAffineTransform transform{};
     RenderRECT rect{};
+
+    std::optional<AdaptiveSampling> adaptive;
+    std::optional<ProgressiveRendering> progressive;
+
+    uint32_t tileSize = 0;  // 0 means automatic
+    std::optional<TileOrder> tileOrder;
+
+    // look-dev mode: the primary hits are cached and only shaded again while the sensor and the geometry stay fixed
+    bool relight = false;
+    // the display receives 1 spp passes at 1/8, 1/4 and 1/2 of the resolution before the full resolution passes
+    bool coarsePreview = false;
+
+    std::optional<RegionOfInterest> roi;
+};
+
+// the film of the splatting integrators, the splats of the concurrent samples are accumulated atomically
+// NOTICE: the splats are box-filtered, they only contribute to the pixel of their film coordinate
+class FilmSplatter final : public SplatFilm {
+    Float* mFilmData;
+    uint32_t mWidth, mPixelStride, mColorOffset, mColorSize;
+    RenderRECT mRect;
+    SensorNDCAffineTransform mTransform;
+    const Sensor* mSensor;
+    Float mSpreadAngle;
+
+public:
+    FilmSplatter(Float* filmData, const uint32_t width, const uint32_t pixelStride, const uint32_t colorOffset, const uint32_t colorSize,
+                 const RenderRECT rect, const SensorNDCAffineTransform& transform, const Sensor* sensor)
+        : mFilmData{ filmData }, mWidth{ width }, mPixelStride{ pixelStride }, mColorOffset{ colorOffset }, mColorSize{ colorSize },
+          mRect{ rect }, mTransform{ transform }, mSensor{ sensor }, mSpreadAngle{ sensor->spreadAngle(std::abs(transform.sy)) } {}
+
+    [[nodiscard]] glm::vec4 bounds() const noexcept override {
+        return { static_cast<Float>(mRect.left), static_cast<Float>(mRect.top), static_cast<Float>(mRect.left + mRect.width),
+                 static_cast<Float>(mRect.top + mRect.height) };
+    }
+    std::pair<Ray, Float> sample(const glm::vec2 filmCoord, SampleProvider& sampler) const noexcept override {
+        auto [ray, weight] = mSensor->sample(mTransform.toNDC(filmCoord), sampler);
+        ray.coneSpread = mSpreadAngle;
+        return { ray, weight };
+    }
+    void splat(const glm::vec2 filmCoord, const Float* radiance) noexcept override {
+        const auto x = std::clamp(static_cast<uint32_t>(std::fmax(filmCoord.x, 0.0f)), mRect.left, mRect.left + mRect.width - 1);
+        const auto y = std::clamp(static_cast<uint32_t>(std::fmax(filmCoord.y, 0.0f)), mRect.top, mRect.top + mRect.height - 1);
+        const auto dst = mFilmData + (static_cast<size_t>(y) * mWidth + x) * mPixelStride + mColorOffset;
+        for(uint32_t k = 0; k < mColorSize; ++k)
+            std::atomic_ref<Float>{ dst[k] }.fetch_add(radiance[k], std::memory_order_relaxed);
+    }
 };
 
-Ref<AccelerationBuilder> createEmbreeBackend();
+Ref<AccelerationBuilder> createEmbreeBackend(const BuildSettings& sceneSettings, const BuildSettings& shapeSettings);
 
 class Renderer final : public SourceNode {
     ChannelRequirement mRequirement;
     std::pmr::vector<Ref<SceneObject>> mSceneObjects{ context().globalAllocator };
+    // the scene objects without geometries (sensors and lights) by name, they can be replaced by the jobs in server mode
+    std::pmr::unordered_map<std::pmr::string, size_t> mNamedObjects{ context().globalAllocator };
+    // the components may refer to the config trees of the jobs
+    std::pmr::vector<Ref<ConfigNode>> mJobs{ context().globalAllocator };
     std::pmr::vector<LightBase*> mLights{ context().globalAllocator };
     std::pmr::vector<FrameAction> mActions{ context().globalAllocator };
     Ref<Acceleration> mAcceleration;
 
     Ref<IntegratorBase> mIntegrator;
     Ref<LightSampler> mLightSampler;
+    // the light sampler is rebuilt from scratch if the light list, the light sampler or the scene radius is changed
+    bool mLightsDirty = true;
+    Float mLightSceneRadius = 0.0f;
     Ref<Filter> mFilter;
+    std::optional<FilterTable> mFilterTable;
+    std::optional<FilterSampler> mFilterSampler;
 
     ProgressReporterHandle mProgressReporter{ "Rendering" };
     uint32_t mFrameCount = 0, mTotalFrameCount = 0;
 
+    // the geometries of the next frame are committed to the back buffer of the acceleration while the current frame is rendered
+    bool mOverlapSceneUpdate = true;
+    // the number of wavelength batches estimated for each camera ray, useful for the spectral variants
+    uint32_t mWavelengthBatches = 1;
+    // the film does not depend on the thread count, the scheduling and the wall time
+    bool mDeterministic = false;
+
+    Ref<DistributedCoordinator> mCoordinator;
+    Ref<DistributedWorker> mWorker;
+    uint32_t mDistributedWorkerCount = 0, mDistributedChunkSize = 0;
+    PreviewPolicy mPreviewPolicy;
+    FrameLayout mLayout = FrameLayout::Interleaved;
+    tbb::task_group mSceneUpdate;
+    std::optional<uint32_t> mPreparedFrame;
+
+    // periodic snapshots of the accumulated film, the finished tiles of the current pass and their aprons
+    fs::path mCheckpointDir;
+    double mCheckpointInterval = 600.0;  // seconds
+
+    // measured rendering time of each tile in the last frame of each action, used for balancing the next frame
+    std::pmr::vector<std::pmr::vector<double>> mTileCost{ context().globalAllocator };
+
+    // whether the geometries have been committed since the last frame
+    std::atomic_bool mGeometryDirty = true;
+    // the back buffer of the acceleration is committed again if its last build is cancelled
+    bool mGeometryStale = false;
+
     static std::pmr::vector<glm::uvec2> generateSpiralTiles(const uint32_t tileX, const uint32_t tileY) {
         std::pmr::vector<glm::uvec2> res{ context().globalAllocator };
         res.reserve(tileX * tileY);
@@ -119,104 +281,337 @@ class Renderer final : public SourceNode {
         return res;
     }
 
+    // walk a space-filling curve over the smallest power-of-two square which covers the tile grid
+    template <typename Decode>
+    static std::pmr::vector<glm::uvec2> generateCurveTiles(const uint32_t tileX, const uint32_t tileY, Decode&& decode) {
+        std::pmr::vector<glm::uvec2> res{ context().globalAllocator };
+        res.reserve(tileX * tileY);
+
+        uint32_t order = 1;
+        while(order < std::max(tileX, tileY))
+            order <<= 1;
+
+        for(uint64_t idx = 0; idx < static_cast<uint64_t>(order) * order; ++idx) {
+            const auto tile = decode(order, static_cast<uint32_t>(idx));
+            if(tile.x < tileX && tile.y < tileY)
+                res.push_back(tile);
+        }
+
+        assert(res.size() == tileX * tileY);
+
+        return res;
+    }
+
+    static std::pmr::vector<glm::uvec2> generateMortonTiles(const uint32_t tileX, const uint32_t tileY) {
+        return generateCurveTiles(tileX, tileY, [](uint32_t, const uint32_t code) {
+            glm::uvec2 res{ 0, 0 };
+            for(uint32_t bit = 0; bit < 16; ++bit) {
+                res.x |= ((code >> (2 * bit)) & 1) << bit;
+                res.y |= ((code >> (2 * bit + 1)) & 1) << bit;
+            }
+            return res;
+        });
+    }
+
+    static std::pmr::vector<glm::uvec2> generateHilbertTiles(const uint32_t tileX, const uint32_t tileY) {
+        return generateCurveTiles(tileX, tileY, [](const uint32_t order, uint32_t code) {
+            glm::uvec2 res{ 0, 0 };
+            for(uint32_t s = 1; s < order; s <<= 1) {
+                const auto rx = 1 & (code >> 1);
+                const auto ry = 1 & (code ^ rx);
+                if(ry == 0) {
+                    if(rx == 1)
+                        res = glm::uvec2{ s - 1 } - res;
+                    std::swap(res.x, res.y);
+                }
+                res.x += s * rx;
+                res.y += s * ry;
+                code >>= 2;
+            }
+            return res;
+        });
+    }
+
+    // pick the largest tile which still leaves enough tiles for load balancing, but keeps enough work per tile
+    // NOTICE: the aprons are merged by tiles, so the deterministic mode assumes a fixed concurrency
+    uint32_t selectTileSize(const uint32_t width, const uint32_t height, const uint32_t spp, const bool display) const {
+        constexpr uint32_t deterministicConcurrency = 64;
+        const auto concurrency = mDeterministic ? deterministicConcurrency : static_cast<uint32_t>(tbb::this_task_arena::max_concurrency());
+        const auto minTileCount = 8 * concurrency;
+        constexpr uint32_t minTileSize = 8, maxTileSize = 128, minSamplesPerTile = 1 << 14;
+
+        const auto tileCount = [&](const uint32_t size) { return ((width + size - 1) / size) * ((height + size - 1) / size); };
+
+        uint32_t size = maxTileSize;
+        while(size > minTileSize && tileCount(size) < minTileCount)
+            size >>= 1;
+        while(size < maxTileSize && size * size * spp < minSamplesPerTile)
+            size <<= 1;
+
+        // fewer display updates
+        if(display)
+            size = std::max(size, 64U);
+
+        return size;
+    }
+
+    // visit the 1-pixel border of a tile
+    template <typename Callable>
+    static void forEachApronPixel(const uint32_t tileWidth, const uint32_t tileHeight, Callable&& callable) {
+        uint32_t idx = 0;
+        for(uint32_t x = 0; x < tileWidth; ++x) {
+            callable(x, 0U, idx++);
+            callable(x, tileHeight - 1, idx++);
+        }
+        for(uint32_t y = 1; y + 1 < tileHeight; ++y) {
+            callable(0U, y, idx++);
+            callable(tileWidth - 1, y, idx++);
+        }
+    }
+
+    // the offset of each channel in a pixel, the weight is stored at offset 0
+    struct ChannelSlot final {
+        Channel channel;
+        uint32_t offset;
+    };
+
     struct PrimaryRay final {
         glm::vec2 filmCoord{};
         SampleProvider sampleProvider;
         Float weight = 0.0f;
+        Float luminance = 0.0f;
     };
 
-    void tracePrimary(std::pmr::vector<PrimaryRay>& primaryRays, const RayStream& rayStream, const uint32_t tileWidth, const Float x0,
-                      const Float y0, Float* tileData, const std::pmr::vector<Channel>& channels, const uint32_t pixelStride,
-                      const uint32_t usedSpectrumSize, const Float shutterTime) const {
-        const auto intersections = mAcceleration->tracePrimary(rayStream);
+    // the primary rays of a batch before shading, the sample providers are cloned right after the sensor sampling
+    // NOTICE: only the compact hit records are kept, the surface hits are reconstructed with the edited materials when relighting
+    struct RelightBatch final {
+        std::pmr::vector<PrimaryRay> primaryRays{ context().globalAllocator };
+        RayStream rays{ context().globalAllocator };
+        std::pmr::vector<HitRecord> hits{ context().globalAllocator };
+        uint32_t row = 0;
+    };
+    using RelightTile = std::pmr::vector<RelightBatch>;
+
+    static void clonePrimaryRays(const std::pmr::vector<PrimaryRay>& src, std::pmr::vector<PrimaryRay>& dst,
+                                 std::pmr::memory_resource* allocator) {
+        dst.clear();
+        dst.reserve(src.size());
+        for(const auto& ray : src)
+            dst.push_back(PrimaryRay{ ray.filmCoord, ray.sampleProvider.clone(allocator), ray.weight, ray.luminance });
+    }
 
+    // the batches of each pass and tile, the cache is dropped once the frame layout, the sensor or the geometries are changed
+    struct RelightCache final {
+        uint32_t actionIdx;
+        uint32_t tileSize;
+        uint32_t sampleCount;
+        uint32_t samplesPerPass;
+        std::pmr::vector<RelightTile> tiles{ context().globalAllocator };
+    };
+    std::optional<RelightCache> mRelightCache;
+
+    void shadePrimary(std::pmr::vector<PrimaryRay>& primaryRays, const RayStream& rayStream, const std::span<const HitRecord> hits,
+                      const uint32_t tileWidth, const Float x0, const Float y0, Float* tileData, const std::span<const ChannelSlot> layout,
+                      const uint32_t pixelStride, const uint32_t usedSpectrumSize) const {
+        Counter<StatsType::Sample>::count(primaryRays.size());
+        // the depth and the position only read the hit records, so the surface hits are not reconstructed for them
+        std::pmr::vector<Intersection> intersections{ context().scopedAllocator };
+        if(std::ranges::any_of(layout,
+                               [](const ChannelSlot& slot) { return slot.channel != Channel::Depth && slot.channel != Channel::Position; }))
+            intersections = mAcceleration->resolve(rayStream, hits);
         const auto locale = [&](const uint32_t x, const uint32_t y, const uint32_t offset) noexcept -> Float& {
             return tileData[(x + y * tileWidth) * pixelStride + offset];
         };
 
         const auto raySize = static_cast<uint32_t>(primaryRays.size());
-        for(uint32_t rayIdx = 0; rayIdx < raySize; ++rayIdx) {
-            auto& payload = primaryRays[rayIdx];
-            const auto& ray = rayStream[rayIdx];
-            const auto& intersection = intersections[rayIdx];
-
-            const auto coordOffset = payload.filmCoord - glm::vec2{ x0 + 0.5f, y0 + 0.5f };
-            const auto ix = static_cast<uint32_t>(coordOffset.x);
-            const auto iy = static_cast<uint32_t>(coordOffset.y);
 
-            const auto evalWeight = [&](const uint32_t x, const uint32_t y) noexcept {
-                return mFilter->evaluate(coordOffset.x - static_cast<Float>(x), coordOffset.y - static_cast<Float>(y)) * payload.weight;
+        std::pmr::vector<Float> radiance{ context().scopedAllocator };
+        // ticks, traced rays and extension rays of each sample
+        std::pmr::vector<Float> cost{ context().scopedAllocator };
+        const auto measureCost = std::ranges::find(layout, Channel::Cost, &ChannelSlot::channel) != layout.end();
+        // AOV-only fast path: the integrator is skipped entirely without the color and cost channels
+        if(measureCost || std::ranges::find(layout, Channel::Color, &ChannelSlot::channel) != layout.end()) {
+            std::pmr::vector<SampleProvider*> samplers{ raySize, context().scopedAllocator };
+            for(uint32_t rayIdx = 0; rayIdx < raySize; ++rayIdx)
+                samplers[rayIdx] = &primaryRays[rayIdx].sampleProvider;
+
+            // the wavelength sample is drawn from the same dimension by all pixel samples, so it is stratified by the sampler
+            std::pmr::vector<Float> wavelengthSamples{ raySize, context().scopedAllocator };
+            for(uint32_t rayIdx = 0; rayIdx < raySize; ++rayIdx)
+                wavelengthSamples[rayIdx] = primaryRays[rayIdx].sampleProvider.sample();
+
+            if(measureCost)
+                cost.resize(raySize * 3, 0.0f);
+            const auto estimate = [&](const std::pmr::vector<Float>& samples, Float* output) {
+                if(!measureCost) {
+                    mIntegrator->estimateBatch(rayStream, intersections, *mAcceleration, *mLightSampler, samplers, samples, output);
+                    return;
+                }
+                // the samples are estimated one by one, so that the cost is attributed to their pixels
+                for(uint32_t rayIdx = 0; rayIdx < raySize; ++rayIdx) {
+                    const auto extensionBegin = BoolCounter<StatsType::Intersection>::localCount();
+                    const auto shadowBegin = BoolCounter<StatsType::Occlusion>::localCount();
+                    const auto begin = rdtsc();
+                    mIntegrator->estimate(rayStream[rayIdx], intersections[rayIdx], *mAcceleration, *mLightSampler, *samplers[rayIdx],
+                                          samples[rayIdx], output + rayIdx * 3);
+                    const auto ticks = rdtsc() - begin;
+                    const auto extension = BoolCounter<StatsType::Intersection>::localCount() - extensionBegin;
+                    const auto shadow = BoolCounter<StatsType::Occlusion>::localCount() - shadowBegin;
+
+                    const auto dst = cost.data() + rayIdx * 3;
+                    dst[0] += static_cast<Float>(ticks);
+                    dst[1] += static_cast<Float>(extension + shadow);
+                    dst[2] = std::fmax(dst[2], static_cast<Float>(extension));
+                }
             };
 
-            const std::tuple<uint32_t, uint32_t, Float> points[4] = {
-                { ix, iy, evalWeight(ix, iy) },
-                { ix + 1, iy, evalWeight(ix + 1, iy) },
-                { ix, iy + 1, evalWeight(ix, iy + 1) },
-                { ix + 1, iy + 1, evalWeight(ix + 1, iy + 1) },
-            };
+            radiance.resize(raySize * 3);
+            if(mWavelengthBatches == 1) {
+                estimate(wavelengthSamples, radiance.data());
+            } else {
+                // the camera rays and the primary hits are shared by the batches, the wavelengths of the batches interleave
+                std::ranges::fill(radiance, 0.0f);
+                std::pmr::vector<Float> batchRadiance{ raySize * 3, context().scopedAllocator };
+                std::pmr::vector<Float> batchSamples{ raySize, context().scopedAllocator };
+                const auto batchWeight = 1.0f / static_cast<Float>(mWavelengthBatches);
+                const auto heroCount = mIntegrator->heroWavelengths();
+                for(uint32_t batch = 0; batch < mWavelengthBatches; ++batch) {
+                    for(uint32_t rayIdx = 0; rayIdx < raySize; ++rayIdx)
+                        batchSamples[rayIdx] = wavelengthBatchSample(wavelengthSamples[rayIdx], batch, mWavelengthBatches, heroCount);
+                    estimate(batchSamples, batchRadiance.data());
+                    for(size_t k = 0; k < radiance.size(); ++k)
+                        radiance[k] += batchRadiance[k] * batchWeight;
+                }
+            }
 
-            for(auto [x, y, w] : points)
-                locale(x, y, 0) += w;
+            for(uint32_t rayIdx = 0; rayIdx < raySize; ++rayIdx) {
+                const auto base = radiance.data() + rayIdx * 3;
+                primaryRays[rayIdx].luminance = usedSpectrumSize == 1 ?
+                    base[0] :
+                    luminance(RGBSpectrum::fromRaw(glm::vec3{ base[0], base[1], base[2] }), std::monostate{});
+            }
+        }
 
-            uint32_t offset = 1;
+        struct Footprint final {
+            std::tuple<uint32_t, uint32_t, Float> points[4];
+            uint32_t size;
+        };
+        std::pmr::vector<Footprint> footprints{ raySize, context().scopedAllocator };
 
-            const auto writeData = [&](const Float* base, const uint32_t size) {
-                for(auto [x, y, w] : points) {
-                    for(uint32_t i = 0; i < size; ++i)
-                        locale(x, y, i + offset) += w * base[i];
-                }
-                offset += size;
-            };
+        for(uint32_t rayIdx = 0; rayIdx < raySize; ++rayIdx) {
+            const auto& payload = primaryRays[rayIdx];
+            auto& [points, size] = footprints[rayIdx];
+
+            if(mFilterSampler) {
+                points[0] = { static_cast<uint32_t>(payload.filmCoord.x - x0), static_cast<uint32_t>(payload.filmCoord.y - y0),
+                              payload.weight };
+                size = 1;
+            } else {
+                const auto coordOffset = payload.filmCoord - glm::vec2{ x0 + 0.5f, y0 + 0.5f };
+                const auto ix = static_cast<uint32_t>(coordOffset.x);
+                const auto iy = static_cast<uint32_t>(coordOffset.y);
+
+                const auto wx = mFilterTable->lookup(coordOffset.x - static_cast<Float>(ix)) * payload.weight;
+                const auto wy = mFilterTable->lookup(coordOffset.y - static_cast<Float>(iy));
+
+                points[0] = { ix, iy, wx.x * wy.x };
+                points[1] = { ix + 1, iy, wx.y * wy.x };
+                points[2] = { ix, iy + 1, wx.x * wy.y };
+                points[3] = { ix + 1, iy + 1, wx.y * wy.y };
+                size = 4;
+            }
 
-            for(const auto channel : channels) {
-                switch(channel) {
-                    case Channel::Color: {
-                        Float base[3];
-                        mIntegrator->estimate(ray, intersection, *mAcceleration, *mLightSampler, payload.sampleProvider, base);
-                        // TODO: convert radiance to irradiance (W/(m^2)) or energy density (J/pixel) ?
-                        writeData(base, usedSpectrumSize);
-                    } break;
-                    case Channel::Albedo: {
-                        auto base = glm::zero<glm::vec3>();
+            for(auto [x, y, w] : std::span{ points, size })
+                locale(x, y, 0) += w;
+        }
 
-                        if(intersection.index() == 1) {
-                            const auto& hit = std::get<SurfaceHit>(intersection);
-                            const auto albedo = hit.surface.getBase<MaterialBase>().estimateAlbedo(hit);
-                            if(usedSpectrumSize == 1) {
-                                base.x = luminance(albedo, std::monostate{});
-                            } else
-                                base = albedo.raw();
-                        }
+        // the channel dispatch is hoisted out of the ray loop, and the writes are unrolled with the compile-time channel size
+        const auto splat = [&]<uint32_t Size>(std::integral_constant<uint32_t, Size>, const uint32_t offset, auto&& fetch) {
+            for(uint32_t rayIdx = 0; rayIdx < raySize; ++rayIdx) {
+                std::array<Float, Size> value;
+                fetch(rayIdx, value.data());
+
+                const auto& [points, size] = footprints[rayIdx];
+                for(auto [x, y, w] : std::span{ points, size }) {
+                    const auto dst = &locale(x, y, offset);
+                    for(uint32_t i = 0; i < Size; ++i)
+                        dst[i] += w * value[i];
+                }
+            }
+        };
+        const auto dispatchSpectrum = [&](auto&& func) {
+            if(usedSpectrumSize == 1)
+                func(std::integral_constant<uint32_t, 1>{});
+            else
+                func(std::integral_constant<uint32_t, 3>{});
+        };
 
-                        writeData(glm::value_ptr(base), usedSpectrumSize);
-                    } break;
-                    case Channel::ShadingNormal: {
+        for(const auto [channel, offset] : layout) {
+            switch(channel) {
+                case Channel::Color: {
+                    // TODO: convert radiance to irradiance (W/(m^2)) or energy density (J/pixel) ?
+                    dispatchSpectrum([&](const auto size) {
+                        constexpr auto channelWidth = std::remove_cvref_t<decltype(size)>::value;
+                        splat(size, offset,
+                              [&](const uint32_t rayIdx, Float* dst) { std::copy_n(radiance.data() + rayIdx * 3, channelWidth, dst); });
+                    });
+                } break;
+                case Channel::Albedo: {
+                    dispatchSpectrum([&](const auto size) {
+                        constexpr auto channelWidth = std::remove_cvref_t<decltype(size)>::value;
+                        splat(size, offset, [&](const uint32_t rayIdx, Float* dst) {
+                            auto base = glm::zero<glm::vec3>();
+
+                            if(const auto& intersection = intersections[rayIdx];
+                               intersection.index() == 1 && std::get<SurfaceHit>(intersection).surface.get()) {
+                                const auto& hit = std::get<SurfaceHit>(intersection);
+                                const auto albedo = hit.surface.getBase<MaterialBase>().estimateAlbedo(hit);
+                                if constexpr(channelWidth == 1)
+                                    base.x = luminance(albedo, std::monostate{});
+                                else
+                                    base = albedo.raw();
+                            }
+
+                            std::copy_n(glm::value_ptr(base), channelWidth, dst);
+                        });
+                    });
+                } break;
+                case Channel::ShadingNormal: {
+                    splat(std::integral_constant<uint32_t, 3>{}, offset, [&](const uint32_t rayIdx, Float* dst) {
                         auto base = glm::zero<glm::vec3>();
 
                         // FIXME: use material's shading normal
 
-                        if(intersection.index() == 1) {
+                        if(const auto& intersection = intersections[rayIdx]; intersection.index() == 1) {
                             const auto& hit = std::get<SurfaceHit>(intersection);
                             const auto normal = dot(hit.geometryNormal, hit.shadingNormal) >= 0.0f ? hit.shadingNormal : -hit.shadingNormal;
                             base = normal.raw();
                         }
 
-                        writeData(glm::value_ptr(base), 3);
-                    } break;
-                    case Channel::Position: {
-                        Point<FrameOfReference::World> point = ray.origin + ray.direction * Distance::fromRaw(1e5f);
-                        if(const auto ptr = std::get_if<SurfaceHit>(&intersection))
-                            point = ptr->hit;
-
-                        writeData(glm::value_ptr(glm::vec3{ point.x(), point.y(), point.z() }), 3);
-                    } break;
-                    case Channel::Depth: {
-                        Float distance = 1e5f;
-                        if(const auto ptr = std::get_if<SurfaceHit>(&intersection))
-                            distance = ptr->distance.raw();
-                        writeData(&distance, 1);
-                    } break;
-                }
+                        std::copy_n(glm::value_ptr(base), 3, dst);
+                    });
+                } break;
+                case Channel::Position: {
+                    splat(std::integral_constant<uint32_t, 3>{}, offset, [&](const uint32_t rayIdx, Float* dst) {
+                        const auto& ray = rayStream[rayIdx];
+                        const auto& hit = hits[rayIdx];
+                        const auto point = ray.origin + ray.direction * Distance::fromRaw(hit.valid() ? hit.distance : 1e5f);
+
+                        dst[0] = point.x();
+                        dst[1] = point.y();
+                        dst[2] = point.z();
+                    });
+                } break;
+                case Channel::Depth: {
+                    splat(std::integral_constant<uint32_t, 1>{}, offset, [&](const uint32_t rayIdx, Float* dst) {
+                        const auto& hit = hits[rayIdx];
+                        dst[0] = hit.valid() ? hit.distance : 1e5f;
+                    });
+                } break;
+                case Channel::Cost: {
+                    splat(std::integral_constant<uint32_t, 3>{}, offset,
+                          [&](const uint32_t rayIdx, Float* dst) { std::copy_n(cost.data() + rayIdx * 3, 3, dst); });
+                } break;
             }
         }
     }
@@ -224,45 +619,108 @@ class Renderer final : public SourceNode {
     std::pmr::vector<Float> renderTile(const std::pmr::vector<Channel>& channels, const uint32_t pixelStride, const int32_t x0,
                                        const int32_t y0, const uint32_t tileWidth, const uint32_t tileHeight, const int32_t width,
                                        const int32_t height, const SensorNDCAffineTransform& transform, const Sensor* sensor,
-                                       const Ref<TileSampler>& sampler, const Float shutterTime, const std ::string_view imageName) {
+                                       const Ref<TileSampler>& sampler, const Float shutterTime, PreviewImage* preview,
+                                       const std::optional<AdaptiveSampling>& adaptive, const uint32_t sampleBegin,
+                                       const uint32_t sampleEnd, glm::dvec2* pixelStats, RelightTile* relight) {
         std::pmr::vector<Float> tileData{ tileWidth * tileHeight * pixelStride, context().scopedAllocator };
 
         const auto sampleXEnd = tileWidth - 2;
         const auto sampleYEnd = tileHeight - 2;
-        const auto sampleCount = sampler->samples();
+        const auto sampleCount = sampleEnd - sampleBegin;
 
         std::pmr::vector<PrimaryRay> primaryRays{ context().scopedAllocator };
         RayStream stream;
+        const auto spreadAngle = sensor->spreadAngle(std::abs(transform.sy));
+
+        // the film samples of a batch are prepared first, then the sensor generates all rays at once
+        std::pmr::vector<glm::vec2> sensorNDC{ context().scopedAllocator };
+        std::pmr::vector<SampleProvider*> sensorSamplers{ context().scopedAllocator };
+        std::pmr::vector<Float> sensorWeights{ context().scopedAllocator };
+        std::pmr::vector<glm::uvec3> sampleRequests{ context().scopedAllocator };
+        std::pmr::vector<glm::vec2> filmSamples{ context().scopedAllocator };
+        const auto resizeBatch = [&](const uint32_t size) {
+            primaryRays.resize(size);
+            stream.resize(size);
+            sensorNDC.resize(size);
+            sensorSamplers.resize(size);
+            sensorWeights.resize(size);
+            sampleRequests.resize(size);
+            filmSamples.resize(size);
+        };
 
+        // the samples of a batch are generated at once when all rays are prepared
         const auto prepareRay = [&](const uint32_t filmX, const uint32_t filmY, const uint32_t sampleIdx, const uint32_t rayIdx) {
-            auto [sample, sampleProvider] = sampler->generate(filmX, filmY, sampleIdx);
+            sampleRequests[rayIdx] = { filmX, filmY, sampleBegin + sampleIdx };
+            sensorSamplers[rayIdx] = &primaryRays[rayIdx].sampleProvider;
+        };
 
+        const auto finishRay = [&](const uint32_t rayIdx) {
+            const auto sample = filmSamples[rayIdx];
             auto& payload = primaryRays[rayIdx];
             payload.filmCoord = sample;
-            payload.sampleProvider = std::move(sampleProvider);
-            const auto sensorNDC = transform.toNDC(sample);
-            const auto [ray, weight] = sensor->sample(sensorNDC, payload.sampleProvider);
-            payload.weight = weight;
-            stream[rayIdx] = ray;
+
+            // the ray is shot through the offset sampled from the filter, but the sample is still recorded in its own pixel
+            auto rayCoord = sample;
+            Float filterWeight = 1.0f;
+            if(mFilterSampler) {
+                const auto pixel = glm::floor(sample);
+                const auto [dx, sx] = mFilterSampler->sample(sample.x - pixel.x);
+                const auto [dy, sy] = mFilterSampler->sample(sample.y - pixel.y);
+                rayCoord = pixel + 0.5f + glm::vec2{ dx, dy };
+                filterWeight = sx * sy;
+            }
+
+            sensorNDC[rayIdx] = transform.toNDC(rayCoord);
+            payload.weight = filterWeight;
+        };
+
+        const auto generateRays = [&](const uint32_t count) {
+            sampler->generateBatch({ sampleRequests.data(), count }, filmSamples.data(), sensorSamplers.data());
+            for(uint32_t idx = 0; idx < count; ++idx)
+                finishRay(idx);
+            sensor->sample({ sensorNDC.data(), count }, { sensorSamplers.data(), count }, { stream.data(), count },
+                           { sensorWeights.data(), count });
+            for(uint32_t idx = 0; idx < count; ++idx) {
+                primaryRays[idx].weight *= sensorWeights[idx];
+                stream[idx].coneSpread = spreadAngle;
+            }
+        };
+
+        // NOTICE: the primary rays only hit the interior pixels, which are owned by this tile
+        const auto accumulateStats = [&] {
+            if(!pixelStats)
+                return;
+            for(const auto& payload : primaryRays) {
+                const auto x = static_cast<int32_t>(std::floor(payload.filmCoord.x));
+                const auto y = static_cast<int32_t>(std::floor(payload.filmCoord.y));
+                if(x < 0 || x >= width || y < 0 || y >= height)
+                    continue;
+                const auto lum = static_cast<double>(payload.luminance);
+                pixelStats[y * width + x] += glm::dvec2{ lum, lum * lum };
+            }
         };
 
-        auto& sync = getDisplayProvider();
         const auto usedSpectrumSize = spectrumSize(RenderGlobalSetting::get().spectrumType);
-        const auto colorStride = [&] {
-            uint32_t res = 1;
+        const auto tileX0 = static_cast<Float>(x0), tileY0 = static_cast<Float>(y0);
+
+        std::pmr::vector<ChannelSlot> layout{ context().scopedAllocator };
+        layout.reserve(channels.size());
+        uint32_t colorStride = 1;
+        {
+            uint32_t offset = 1;
             for(const auto channel : channels) {
                 if(channel == Channel::Color)
-                    break;
-                res += channelSize(channel, RenderGlobalSetting::get().spectrumType);
+                    colorStride = offset;
+                layout.push_back({ channel, offset });
+                offset += channelSize(channel, RenderGlobalSetting::get().spectrumType);
             }
-            return res;
-        }();
+        }
         const uint32_t colorOffset[3] = { colorStride, usedSpectrumSize == 3 ? colorStride + 1 : colorStride,
                                           usedSpectrumSize == 3 ? colorStride + 2 : colorStride };
         std::pmr::vector<Float> lineData{ tileWidth * 3, context().scopedAllocator };
 
         const auto syncTile = [&](const uint32_t h) {
-            if(!sync.isSupported())
+            if(!preview)
                 return;
             const auto y = y0 + static_cast<int32_t>(h);
             if(y < 0 || y >= height)
@@ -284,41 +742,120 @@ class Renderer final : public SourceNode {
                     dst[k] = src[colorOffset[k]] * weight;
             }
 
-            sync.update(imageName, { "r", "g", "b" }, { 0, 1, 2 }, { 3, 3, 3 }, lx, y, rx - lx, 1,
-                        std::span{ lineData.data(), (rx - lx) * 3ULL });
+            preview->update(static_cast<uint32_t>(lx), static_cast<uint32_t>(y),
+                            std::span<const float>{ lineData.data() + (lx - x0) * 3, (rx - lx) * 3ULL });
+        };
+
+        // the batches are recorded before shading, since shading consumes the sample providers
+        const auto trace = [&](const uint32_t row) {
+            const auto hits = [&] {
+                PIPER_TRACE_SAMPLED_SPAN("TracePrimary", 64);
+                return mAcceleration->traceHits(stream, true);
+            }();
+            if(relight) {
+                auto& batch = relight->emplace_back();
+                clonePrimaryRays(primaryRays, batch.primaryRays, context().globalAllocator);
+                batch.rays.assign(stream.cbegin(), stream.cend());
+                batch.hits.assign(hits.cbegin(), hits.cend());
+                batch.row = row;
+            }
+            PIPER_TRACE_SAMPLED_SPAN("ShadePrimary", 64);
+            shadePrimary(primaryRays, stream, hits, tileWidth, tileX0, tileY0, tileData.data(), layout, pixelStride,
+                         usedSpectrumSize);
         };
 
-        if(sampleCount * sampleXEnd > 1024) {
-            primaryRays.resize(sampleCount);
-            stream.resize(sampleCount);
+        // the temporaries of each batch (sample providers, intersections, integrator states) are released at once by rewinding the
+        // arena of the tile, the batch buffers are resized before the rewind scopes so that they are never reclaimed
+        if(relight && !relight->empty()) {
+            // the cached primary hits are shaded again, neither the sensor nor the acceleration structure is queried
+            for(size_t idx = 0; idx < relight->size(); ++idx) {
+                const auto& batch = (*relight)[idx];
+                clonePrimaryRays(batch.primaryRays, primaryRays, context().scopedAllocator);
+                const ArenaRewindScope rewind;
+                shadePrimary(primaryRays, batch.rays, batch.hits, tileWidth, tileX0, tileY0, tileData.data(), layout, pixelStride,
+                             usedSpectrumSize);
+                accumulateStats();
+                if(idx + 1 == relight->size() || (*relight)[idx + 1].row != batch.row)
+                    syncTile(batch.row);
+            }
+        } else if(adaptive && std::ranges::find(channels, Channel::Color) != channels.cend()) {
+            const auto minSamples = std::max(1U, std::min(adaptive->minSamples, sampleCount));
+
+            // trace per pixel until the relative standard error of the luminance is below the threshold
+            for(uint32_t y = 1; y <= sampleYEnd; ++y) {
+                for(uint32_t x = 1; x <= sampleXEnd; ++x) {
+                    const auto filmX = x0 + x, filmY = y0 + y;
+
+                    uint32_t spp = 0;
+                    double sum = 0.0, sumSquare = 0.0;
+                    bool converged = false;
+
+                    while(spp < sampleCount) {
+                        const auto count = std::min(spp == 0 ? minSamples : adaptive->batchSize, sampleCount - spp);
+                        resizeBatch(count);
+                        const ArenaRewindScope rewind;
+
+                        for(uint32_t idx = 0; idx < count; ++idx)
+                            prepareRay(filmX, filmY, spp + idx, idx);
+                        generateRays(count);
+
+                        trace(y - 1);
+
+                        for(const auto& payload : primaryRays) {
+                            const auto lum = static_cast<double>(payload.luminance);
+                            sum += lum;
+                            sumSquare += lum * lum;
+                        }
+                        spp += count;
+
+                        if(spp >= 2 && spp < sampleCount) {
+                            const auto n = static_cast<double>(spp);
+                            const auto mean = sum / n;
+                            const auto variance = std::max(0.0, (sumSquare - sum * mean) / (n - 1.0));
+                            if(std::sqrt(variance / n) <= static_cast<double>(adaptive->threshold) * std::max(mean, 1e-3)) {
+                                converged = true;
+                                break;
+                            }
+                        }
+                    }
+
+                    BoolCounter<StatsType::AdaptiveTermination>::count(converged);
+                }
+                syncTile(y - 1);
+            }
+        } else if(sampleCount * sampleXEnd > 1024) {
+            resizeBatch(sampleCount);
 
             // trace per pixel
             for(uint32_t y = 1; y <= sampleYEnd; ++y) {
                 for(uint32_t x = 1; x <= sampleXEnd; ++x) {
                     const auto filmX = x0 + x, filmY = y0 + y;
+                    const ArenaRewindScope rewind;
 
                     for(uint32_t sampleIdx = 0; sampleIdx < sampleCount; ++sampleIdx)
                         prepareRay(filmX, filmY, sampleIdx, sampleIdx);
+                    generateRays(sampleCount);
 
-                    tracePrimary(primaryRays, stream, tileWidth, static_cast<Float>(x0), static_cast<Float>(y0), tileData.data(), channels,
-                                 pixelStride, usedSpectrumSize, shutterTime);
+                    trace(y - 1);
+                    accumulateStats();
                 }
                 syncTile(y - 1);
             }
         } else {
-            primaryRays.resize(sampleCount * sampleXEnd);
-            stream.resize(sampleCount * sampleXEnd);
+            resizeBatch(sampleCount * sampleXEnd);
 
             // trace whole line
             for(uint32_t y = 1; y <= sampleYEnd; ++y) {
+                const ArenaRewindScope rewind;
                 for(uint32_t x = 1; x <= sampleXEnd; ++x) {
                     const auto filmX = x0 + x, filmY = y0 + y;
                     for(uint32_t sampleIdx = 0; sampleIdx < sampleCount; ++sampleIdx)
                         prepareRay(filmX, filmY, sampleIdx, sampleIdx + sampleCount * (x - 1));
                 }
+                generateRays(sampleCount * sampleXEnd);
 
-                tracePrimary(primaryRays, stream, tileWidth, static_cast<Float>(x0), static_cast<Float>(y0), tileData.data(), channels,
-                             pixelStride, usedSpectrumSize, shutterTime);
+                trace(y - 1);
+                accumulateStats();
 
                 syncTile(y - 1);
             }
@@ -329,120 +866,996 @@ class Renderer final : public SourceNode {
         return tileData;
     }
 
-    Ref<Frame> render(const uint32_t actionIdx, const uint32_t frameIdx) {
-        auto& sync = getDisplayProvider();
+    // a 1 spp pass at 1/scale of the resolution, each coarse pixel is replicated to its block in the preview
+    // NOTICE: the bands are independent, so the filter footprints crossing the band boundaries are dropped
+    void renderPreviewPass(const FrameAction& action, const uint32_t frameIdx, const uint32_t scale, const Float shutterTime,
+                           PreviewImage& preview) {
+        const auto width = (action.width + scale - 1) / scale, height = (action.height + scale - 1) / scale;
+        const auto left = action.rect.left / scale, top = action.rect.top / scale;
+        const auto right = std::min(width, (action.rect.left + action.rect.width + scale - 1) / scale);
+        const auto bottom = std::min(height, (action.rect.top + action.rect.height + scale - 1) / scale);
+        if(left >= right || top >= bottom)
+            return;
+
+        const auto tileSampler = action.sampler->prepare(frameIdx, width, height, action.frameCount);
+        auto transform = action.transform;
+        transform.sx *= static_cast<Float>(scale);
+        transform.sy *= static_cast<Float>(scale);
+
+        const std::pmr::vector<Channel> channels{ { Channel::Color }, context().globalAllocator };
+        const auto colorSize = static_cast<uint32_t>(channelSize(Channel::Color, RenderGlobalSetting::get().spectrumType));
+        const auto pixelStride = colorSize + 1;
+        const auto tileWidth = right - left + 2;
+        const auto lx = left * scale, rx = std::min(right * scale, action.width);
+
+        constexpr uint32_t bandHeight = 8;
+        tbb::parallel_for(
+            tbb::blocked_range<uint32_t>(top, bottom, bandHeight),
+            [&](const tbb::blocked_range<uint32_t>& r) {
+                FloatingPointExceptionProbe::on();
+                MemoryArena arena;
+                const auto tileHeight = static_cast<uint32_t>(r.size()) + 2;
+                const auto res = renderTile(channels, pixelStride, static_cast<int32_t>(left) - 1, static_cast<int32_t>(r.begin()) - 1,
+                                            tileWidth, tileHeight, static_cast<int32_t>(width), static_cast<int32_t>(height), transform,
+                                            action.sensor, tileSampler, shutterTime, nullptr, std::nullopt, 0, 1, nullptr, nullptr);
+
+                std::pmr::vector<float> lineData{ (right - left) * scale * 3, context().scopedAllocator };
+                for(auto y = r.begin(); y != r.end(); ++y) {
+                    for(auto x = left; x < right; ++x) {
+                        const auto src = res.data() + ((y - r.begin() + 1) * tileWidth + (x - left + 1)) * pixelStride;
+                        const auto weight = src[0] > 1e-5f ? rcp(src[0]) : 0.0f;
+                        const auto dst = lineData.data() + (x - left) * scale * 3;
+                        for(uint32_t k = 0; k < 3; ++k)
+                            dst[k] = src[1 + (colorSize == 3 ? k : 0)] * weight;
+                        for(uint32_t i = 1; i < scale; ++i)
+                            std::copy_n(dst, 3, dst + i * 3);
+                    }
+                    for(auto py = y * scale; py < std::min((y + 1) * scale, action.height); ++py)
+                        preview.update(lx, py, std::span<const float>{ lineData.data(), (rx - lx) * 3ULL });
+                }
+                FloatingPointExceptionProbe::off();
+            });
+        preview.flush(true);
+    }
 
-        const uint32_t tileSize = sync.isSupported() ? 128 : 32;
+    static bool loadCheckpoint(const fs::path& path, CheckpointHeader& header, std::pmr::vector<Float>& filmData,
+                               std::pmr::vector<uint8_t>& finishedTiles, std::pmr::vector<std::pmr::vector<Float>>& aprons) {
+        std::ifstream in{ path, std::ios::in | std::ios::binary };
+        if(!in)
+            return false;
 
+        const auto invalid = [&] {
+            warning(fmt::format("Invalid checkpoint \"{}\"", path.string()));
+            return false;
+        };
+
+        CheckpointHeader stored{};
+        if(char magic[4]; !in.read(magic, 4) || memcmp(magic, "PCKP", 4) != 0 ||
+           !in.read(reinterpret_cast<char*>(&stored), sizeof(stored)) || !stored.compatible(header))
+            return invalid();
+
+        if(!in.read(reinterpret_cast<char*>(filmData.data()), static_cast<std::streamsize>(filmData.size() * sizeof(Float))) ||
+           !in.read(reinterpret_cast<char*>(finishedTiles.data()), static_cast<std::streamsize>(finishedTiles.size())))
+            return invalid();
+
+        for(size_t idx = 0; idx < finishedTiles.size(); ++idx) {
+            if(!finishedTiles[idx])
+                continue;
+            uint64_t size = 0;
+            if(!in.read(reinterpret_cast<char*>(&size), sizeof(size)))
+                return invalid();
+            aprons[idx].resize(size);
+            if(!in.read(reinterpret_cast<char*>(aprons[idx].data()), static_cast<std::streamsize>(size * sizeof(Float))))
+                return invalid();
+        }
+
+        header.passIdx = stored.passIdx;
+        return true;
+    }
+
+    // write to a temporary file first, so a crash during saving never destroys the previous checkpoint
+    static void saveCheckpoint(const fs::path& path, const CheckpointHeader& header, const std::pmr::vector<Float>& filmData,
+                               const std::pmr::vector<uint8_t>& finishedTiles, const std::pmr::vector<std::pmr::vector<Float>>& aprons) {
+        auto tmpPath = path;
+        tmpPath += ".tmp";
+
+        {
+            std::ofstream out{ tmpPath, std::ios::out | std::ios::binary };
+            out.write("PCKP", 4);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(filmData.data()), static_cast<std::streamsize>(filmData.size() * sizeof(Float)));
+            out.write(reinterpret_cast<const char*>(finishedTiles.data()), static_cast<std::streamsize>(finishedTiles.size()));
+            for(size_t idx = 0; idx < finishedTiles.size(); ++idx) {
+                if(!finishedTiles[idx])
+                    continue;
+                const uint64_t size = aprons[idx].size();
+                out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+                out.write(reinterpret_cast<const char*>(aprons[idx].data()), static_cast<std::streamsize>(size * sizeof(Float)));
+            }
+            out.flush();
+            if(!out) {
+                warning(fmt::format("Failed to save checkpoint \"{}\"", tmpPath.string()));
+                return;
+            }
+        }
+
+        std::error_code ec;
+        fs::rename(tmpPath, path, ec);
+        if(ec)
+            warning(fmt::format("Failed to save checkpoint \"{}\": {}", path.string(), ec.message()));
+    }
+
+    // the checkpoints keep the weighted sums of the film, the resolved images are treated as the samples of unit weight
+    // NOTICE: the aprons of the unfinished pass of a checkpoint are dropped, their pixels are still consistent with fewer samples
+    std::pmr::vector<Float> loadRegionBase(const uint32_t actionIdx, const uint32_t frameIdx) const {
         const auto& action = mActions[actionIdx];
+        const auto pixelStride = action.channelTotalSize + 1;
+        const auto pixelCount = static_cast<size_t>(action.width) * action.height;
+
+        const auto frame = std::to_string(frameIdx), actionName = std::to_string(actionIdx);
+        ResolveConfiguration resolver{ context().scopedAllocator };
+        resolver["${FrameIdx}"] = frame;
+        resolver["${ActionIdx}"] = actionName;
+        const auto path = resolveString(action.roi->base, resolver);
 
-        std::string imageName;
-        if(sync.isSupported() && std::ranges::find(action.channels, Channel::Color) != action.channels.cend()) {
-            imageName = fmt::format("Task_{:0>4x}_Action_{}_Frame_{}", sync.uniqueID(), actionIdx, frameIdx);
-            sync.create(imageName, action.width, action.height, { "r", "g", "b" });
+        std::pmr::vector<Float> res{ pixelCount * pixelStride, trackedAllocator(MemoryTag::Film) };
+        {
+            std::ifstream in{ fs::path{ path }, std::ios::in | std::ios::binary };
+            if(!in)
+                fatal(fmt::format("Failed to open the base of the region of interest \"{}\"", path));
+            if(char magic[4]; in.read(magic, 4) && memcmp(magic, "PCKP", 4) == 0) {
+                CheckpointHeader stored{};
+                if(!in.read(reinterpret_cast<char*>(&stored), sizeof(stored)) || stored.width != action.width ||
+                   stored.height != action.height || stored.pixelStride != pixelStride)
+                    fatal(fmt::format("The checkpoint \"{}\" does not match the frame", path));
+                if(!in.read(reinterpret_cast<char*>(res.data()), static_cast<std::streamsize>(res.size() * sizeof(Float))))
+                    fatal(fmt::format("Invalid checkpoint \"{}\"", path));
+                return res;
+            }
         }
 
-        const auto tileX = (action.rect.width + tileSize - 1) / tileSize;
-        const auto tileY = (action.rect.height + tileSize - 1) / tileSize;
-        const auto shutterTime = action.shutterClose - action.shutterOpen;
+        const auto input = OIIO::ImageInput::open(std::string{ path });
+        if(!input)
+            fatal(fmt::format("Failed to open the base of the region of interest \"{}\": {}", path, OIIO::geterror()));
+        const auto& spec = input->spec();
+        if(static_cast<uint32_t>(spec.width) != action.width || static_cast<uint32_t>(spec.height) != action.height)
+            fatal(fmt::format("The resolution of the base image \"{}\" is {}x{}, expect {}x{}", path, spec.width, spec.height,
+                              action.width, action.height));
+        const auto channels = static_cast<size_t>(spec.nchannels);
+        std::pmr::vector<float> image{ pixelCount * channels, context().scopedAllocator };
+        if(!input->read_image(0, 0, 0, spec.nchannels, OIIO::TypeDesc::FLOAT, image.data()))
+            fatal(fmt::format("Failed to read the base image \"{}\": {}", path, input->geterror()));
+
+        const auto spectrumType = RenderGlobalSetting::get().spectrumType;
+        for(size_t idx = 0; idx < pixelCount; ++idx)
+            res[idx * pixelStride] = 1.0f;
+        uint32_t offset = 1;
+        for(const auto channel : action.channels) {
+            const auto size = channelSize(channel, spectrumType);
+            const auto prefix = channel == Channel::Color ? std::string{} : fmt::format("{}.", magic_enum::enum_name(channel));
+            for(size_t k = 0; k < size; ++k) {
+                const auto name = prefix + std::string{ channelComponentName(channel, size, k) };
+                const auto src = spec.channelindex(name);
+                if(src < 0) {
+                    warning(fmt::format("The base image \"{}\" has no channel {}, it is black outside the region", path, name));
+                    continue;
+                }
+                for(size_t idx = 0; idx < pixelCount; ++idx)
+                    res[idx * pixelStride + offset + k] = image[idx * channels + static_cast<size_t>(src)];
+            }
+            offset += static_cast<uint32_t>(size);
+        }
+        return res;
+    }
 
-        info(fmt::format("Updating scene for action {}, frame {}", actionIdx, frameIdx));
+    static TimeInterval shutterInterval(const FrameAction& action, const uint32_t frameIdx) {
+        return { static_cast<Float>(action.begin + static_cast<double>(frameIdx) / action.fps + action.shutterOpen),
+                 static_cast<Float>(action.begin + static_cast<double>(frameIdx) / action.fps + action.shutterClose) };
+    }
 
-        const TimeInterval shutterInterval{
-            static_cast<Float>(action.begin + static_cast<double>(frameIdx) / action.fps + action.shutterOpen),
-            static_cast<Float>(action.begin + static_cast<double>(frameIdx) / action.fps + action.shutterClose)
-        };
+    std::pair<uint32_t, uint32_t> locateFrame(uint32_t frameIdx) const {
+        uint32_t idx = 0;
+        while(frameIdx >= mActions[idx].frameCount) {
+            frameIdx -= mActions[idx].frameCount;
+            ++idx;
+        }
+        return { idx, frameIdx };
+    }
 
-        tbb::parallel_for_each(mSceneObjects, [&](const auto& object) { object->update(shutterInterval); });
+    void updateGeometry(const TimeInterval interval) {
+        PIPER_TRACE_SPAN("UpdateGeometry");
+        std::pmr::vector<SceneObject*> updated{ context().globalAllocator };
+        tbb::spin_mutex updatedMutex;
+        tbb::parallel_for_each(mSceneObjects, [&](const auto& object) {
+            if(object->primitiveGroup() && object->update(interval)) {
+                const tbb::spin_mutex::scoped_lock guard{ updatedMutex };
+                updated.push_back(object.get());
+            }
+        });
+
+        // the back buffer is still up to date if no instance is changed
+        if(!updated.empty() || mGeometryStale) {
+            mGeometryStale = !mAcceleration->commit();
+            mGeometryDirty = true;
+            // the back buffer is not swapped in, so it receives the same updates again
+            if(mGeometryStale)
+                for(const auto object : updated)
+                    object->rearmUpdate();
+        }
+    }
+
+    // the film is resolved in place, so that no second full-resolution buffer is allocated
+    Ref<Frame> resolveFrame(const uint32_t actionIdx, const uint32_t frameIdx, std::pmr::vector<Float> filmData,
+                            const FrameStatsMeter& frameStats, std::vector<ConvergencePoint> convergence = {}) {
+        const auto& action = mActions[actionIdx];
+        const auto pixelStride = action.channelTotalSize + 1;
+        const auto pixelCount = static_cast<size_t>(action.width) * action.height;
+
+        tbb::parallel_for(
+            tbb::blocked_range<size_t>{ 0, pixelCount },
+            [&](const tbb::blocked_range<size_t>& range) {
+                for(auto idx = range.begin(); idx != range.end(); ++idx) {
+                    const auto base = filmData.data() + idx * pixelStride;
+                    if(base[0] < 1e-9f) {
+                        std::fill_n(base + 1, action.channelTotalSize, 0.0f);
+                        continue;
+                    }
+
+                    const auto inverse = rcp(base[0]);
+                    for(uint32_t k = 0; k < action.channelTotalSize; ++k)
+                        base[k + 1] *= inverse;
+                }
+            },
+            globalAffinityPartitioner);
+
+        auto metadata = makeMetadata(actionIdx, frameIdx);
+        metadata.stats = frameStats.finish();
+        metadata.stats.convergence = std::move(convergence);
+
+        if(mLayout == FrameLayout::Planar || !metadata.formats.empty()) {
+            // the channels are scattered to a new frame (converted to half if requested), the weighted film is released after that
+            std::pmr::vector<Float> data(metadata.storageSize(), trackedAllocator(MemoryTag::Frame));
+            const auto dstBase = reinterpret_cast<std::byte*>(data.data());
+            uint32_t offset = 1;
+            for(const auto channel : action.channels) {
+                const auto size = channelSize(channel, metadata.spectrumType);
+                const auto half = metadata.format(channel) == ChannelFormat::Half;
+                const auto [byteOffset, dstPixelStride, dstRowStride] = metadata.view(channel);
+                tbb::parallel_for(tbb::blocked_range<size_t>{ 0, pixelCount }, [&](const tbb::blocked_range<size_t>& range) {
+                    for(auto idx = range.begin(); idx != range.end(); ++idx) {
+                        const auto src = filmData.data() + idx * pixelStride + offset;
+                        const auto dst = dstBase + byteOffset + idx * dstPixelStride;
+                        if(half) {
+                            for(size_t k = 0; k < size; ++k) {
+                                const auto value = glm::packHalf1x16(src[k]);
+                                std::memcpy(dst + k * sizeof(uint16_t), &value, sizeof(uint16_t));
+                            }
+                        } else
+                            std::memcpy(dst, src, size * sizeof(Float));
+                    }
+                });
+                offset += static_cast<uint32_t>(size);
+            }
+            return makeRefCount<Frame>(std::move(metadata), std::move(data));
+        }
+
+        // squeeze out the weights, the destination of each pixel never overtakes its source
+        for(size_t idx = 0; idx < pixelCount; ++idx)
+            std::copy_n(filmData.data() + idx * pixelStride + 1, action.channelTotalSize, filmData.data() + idx * action.channelTotalSize);
+        filmData.resize(pixelCount * action.channelTotalSize);
+
+        return makeRefCount<Frame>(std::move(metadata), std::move(filmData));
+    }
+
+    // the coordinator only merges the weighted films from the workers
+    Ref<Frame> merge(const uint32_t actionIdx, const uint32_t frameIdx) {
+        const auto& action = mActions[actionIdx];
+        info(fmt::format("Merging action {}, frame {}", actionIdx, frameIdx));
+        const FrameStatsMeter frameStats;
 
-        mAcceleration->commit();
+        const auto sampleCount = action.sampler->prepare(frameIdx, action.width, action.height, action.frameCount)->samples();
+        // the sums of the chunks are rounded differently, so the deterministic chunks do not depend on the worker count
+        const auto chunkWorkers = mDeterministic ? 4U : mDistributedWorkerCount;
+        const auto chunkSize = mDistributedChunkSize ? mDistributedChunkSize : std::max(1U, sampleCount / (4 * chunkWorkers));
 
-        mLightSampler->preprocess(mLights, mAcceleration->radius());
+        std::pmr::vector<Float> filmData{ action.width * action.height * (action.channelTotalSize + 1), trackedAllocator(MemoryTag::Film) };
+        mCoordinator->render(mFrameCount - 1, sampleCount, chunkSize, mDeterministic, filmData);
+
+        return resolveFrame(actionIdx, frameIdx, std::move(filmData), frameStats);
+    }
+
+    Ref<Frame> render(const uint32_t actionIdx, const uint32_t frameIdx) {
+        auto& sync = getDisplayProvider();
+        const FrameStatsMeter frameStats;
+
+        const auto& action = mActions[actionIdx];
+
+        const auto& sampler = action.roi && action.roi->sampler ? action.roi->sampler : action.sampler;
+        const auto tileSampler = sampler->prepare(frameIdx, action.width, action.height, action.frameCount);
+        const auto sampleCount = tileSampler->samples();
+        const auto samplesPerPass = action.progressive ? std::min(action.progressive->samplesPerPass, sampleCount) : sampleCount;
+        const auto passCount = std::max(1U, (sampleCount + samplesPerPass - 1) / std::max(1U, samplesPerPass));
+
+        // the samples in the 1-pixel ring around the region of interest are also splatted into it, so the ring is rendered as well
+        const auto rect = [&] {
+            if(!action.roi)
+                return action.rect;
+            const auto& roi = action.roi->rect;
+            const auto left = std::max(roi.left, action.rect.left + 1) - 1, top = std::max(roi.top, action.rect.top + 1) - 1;
+            const auto right = std::min(roi.left + roi.width + 1, action.rect.left + action.rect.width);
+            const auto bottom = std::min(roi.top + roi.height + 1, action.rect.top + action.rect.height);
+            return RenderRECT{ left, top, right - left, bottom - top };
+        }();
+
+        const auto tileSize =
+            action.tileSize ? action.tileSize : selectTileSize(rect.width, rect.height, samplesPerPass, sync.isSupported());
+
+        // the rest of the dirty region is sent when the frame is finished
+        std::optional<PreviewImage> preview;
+        if(sync.isSupported() && std::ranges::find(action.channels, Channel::Color) != action.channels.cend())
+            preview.emplace(fmt::format("Task_{:0>4x}_Action_{}_Frame_{}", sync.uniqueID(), actionIdx, frameIdx), action.width,
+                            action.height, mPreviewPolicy);
+
+        const auto tileX = (rect.width + tileSize - 1) / tileSize;
+        const auto tileY = (rect.height + tileSize - 1) / tileSize;
+        const auto shutterTime = action.shutterClose - action.shutterOpen;
+
+        info(fmt::format("Updating scene for action {}, frame {}", actionIdx, frameIdx));
+
+        const auto globalFrameIdx = mFrameCount - 1;
+        const auto interval = shutterInterval(action, frameIdx);
+
+        if(mPreparedFrame == globalFrameIdx)
+            mSceneUpdate.wait();
+        else
+            updateGeometry(interval);
+        mPreparedFrame.reset();
+        // the front buffer is kept only if the back buffer is not built, the pending updates of the instances rely on it
+        if(!mGeometryStale)
+            mAcceleration->swap();
+        // the cancelled frames are skipped by the following nodes
+        if(cancellationRequested())
+            return {};
+        const auto geometryChanged = mGeometryDirty.exchange(false);
+
+        // lights and sensors are updated in place, so they cannot be prepared before the previous frame is finished
+        std::atomic_bool sensorChanged = false;
+        std::pmr::vector<LightBase*> changedLights{ context().scopedAllocator };
+        tbb::spin_mutex changedLightsMutex;
+        tbb::parallel_for_each(mSceneObjects, [&](const auto& object) {
+            bool changed;
+            if(!object->primitiveGroup()) {
+                changed = object->update(interval);
+                if(changed && object->sensor() == action.sensor)
+                    sensorChanged = true;
+            } else
+                changed = object->updateAreaLight(interval);
+
+            if(const auto light = object->light(); changed && light) {
+                const tbb::spin_mutex::scoped_lock guard{ changedLightsMutex };
+                changedLights.push_back(light);
+            }
+        });
+        // NOTICE: the lights referring to the time-varying textures are unknown, so all lights are treated as changed
+        const auto texturesChanged = prepareTimeVaryingTextures(interval);
+
+        if(const auto sceneRadius = mAcceleration->radius(); mLightsDirty || texturesChanged || sceneRadius != mLightSceneRadius) {
+            mLightSampler->preprocess(mLights, sceneRadius);
+            mLightsDirty = false;
+            mLightSceneRadius = sceneRadius;
+        } else if(!changedLights.empty())
+            mLightSampler->update(mLights, changedLights, sceneRadius);
         mIntegrator->preprocess();
 
+        if(mOverlapSceneUpdate && globalFrameIdx + 1 < mTotalFrameCount) {
+            const auto [nextActionIdx, nextFrameIdx] = locateFrame(globalFrameIdx + 1);
+            const auto nextInterval = shutterInterval(mActions[nextActionIdx], nextFrameIdx);
+            mPreparedFrame = globalFrameIdx + 1;
+            mSceneUpdate.run([this, nextInterval] { updateGeometry(nextInterval); });
+        }
+
         info(fmt::format("Rendering scene for action {}, frame {}", actionIdx, frameIdx));
+        ThroughputMeter throughput;
+
+        // the spiral order shows the center of the image first in the display, the others are cache-coherent
+        const auto tileOrder = action.tileOrder.value_or(sync.isSupported() ? TileOrder::Spiral : TileOrder::Hilbert);
+        const std::pmr::vector<glm::uvec2> blocks = [&] {
+            switch(tileOrder) {
+                case TileOrder::Morton:
+                    return generateMortonTiles(tileX, tileY);
+                case TileOrder::Hilbert:
+                    return generateHilbertTiles(tileX, tileY);
+                default:
+                    return generateSpiralTiles(tileX, tileY);
+            }
+        }();
+
+        // the time-varying textures, the lights and the integrator are allowed to change between the relit frames
+        if(action.relight && !mWorker) {
+            if(mRelightCache && mRelightCache->actionIdx == actionIdx && mRelightCache->tileSize == tileSize &&
+               mRelightCache->sampleCount == sampleCount && mRelightCache->samplesPerPass == samplesPerPass && !geometryChanged &&
+               !sensorChanged)
+                info("Reusing the cached primary hits");
+            else {
+                mRelightCache.emplace(RelightCache{ actionIdx, tileSize, sampleCount, samplesPerPass });
+                mRelightCache->tiles.resize(static_cast<size_t>(passCount) * blocks.size());
+            }
+        } else
+            mRelightCache.reset();
 
-        const std::pmr::vector<glm::uvec2> blocks = generateSpiralTiles(tileX, tileY);
+        auto& tileCost = mTileCost[actionIdx];
+        if(tileCost.size() != blocks.size())
+            tileCost.assign(blocks.size(), 0.0);
 
         const auto progressBase = static_cast<double>(mFrameCount - 1) / static_cast<double>(mTotalFrameCount),
-                   progressIncr = static_cast<double>((tileX * tileY + 1) * mTotalFrameCount);
+                   progressIncr = static_cast<double>((tileX * tileY * passCount + 1) * mTotalFrameCount);
 
         const auto pixelStride = action.channelTotalSize + 1;
-        std::pmr::vector<std::atomic<Float>> filmData{ action.width * action.height * pixelStride, context().globalAllocator };
+        std::pmr::vector<Float> filmData{ action.width * action.height * pixelStride, trackedAllocator(MemoryTag::Film) };
+        // NOTICE: the interior of each tile is owned by exactly one tile, so it is written without synchronization.
+        // The aprons overlap with the neighbouring tiles and are merged after all tiles are finished.
+        std::pmr::vector<std::pmr::vector<Float>> aprons{ blocks.size(), trackedAllocator(MemoryTag::Film) };
+
+        // per-pixel luminance sum and square sum, used for estimating the noise level in progressive mode
+        std::pmr::vector<glm::dvec2> pixelStats{ context().globalAllocator };
+        if(action.progressive && action.progressive->targetError > 0.0f) {
+            if(std::ranges::find(action.channels, Channel::Color) != action.channels.cend())
+                pixelStats.resize(static_cast<size_t>(action.width) * action.height);
+            else
+                warning("Target error of progressive rendering requires the color channel");
+        }
+
+        // loaded before rendering, so that an invalid base fails early
+        std::pmr::vector<Float> roiBase{ context().globalAllocator };
+        if(action.roi)
+            roiBase = loadRegionBase(actionIdx, frameIdx);
+
+        // the finished tiles of the current pass, their aprons are not merged yet
+        std::pmr::vector<uint8_t> finishedTiles(blocks.size(), 0, context().globalAllocator);
+        CheckpointHeader checkpoint{
+            globalFrameIdx, action.width, action.height, pixelStride, tileSize, static_cast<uint32_t>(blocks.size()), samplesPerPass, 0
+        };
+        fs::path checkpointPath;
+        bool resumed = false;
+        std::shared_mutex checkpointMutex;
+        tbb::spin_mutex checkpointWriter;
+        auto lastCheckpoint = std::chrono::steady_clock::now();
+
+        // the region of interest may be based on the checkpoint of the same frame, so it is never checkpointed
+        if(!mCheckpointDir.empty() && !mWorker && !action.roi) {
+            checkpointPath = mCheckpointDir / fmt::format("checkpoint_{}.bin", globalFrameIdx);
+            resumed = loadCheckpoint(checkpointPath, checkpoint, filmData, finishedTiles, aprons);
+            if(resumed)
+                info(fmt::format("Resuming frame {} from pass {} ({} tiles finished)", globalFrameIdx, checkpoint.passIdx,
+                                 std::ranges::count(finishedTiles, 1)));
+        }
+
+        const auto tryCheckpoint = [&](const uint32_t passIdx) {
+            if(checkpointPath.empty() || !checkpointWriter.try_lock())
+                return;
+            std::lock_guard writer{ checkpointWriter, std::adopt_lock };
+
+            if(std::chrono::duration<double>(std::chrono::steady_clock::now() - lastCheckpoint).count() < mCheckpointInterval)
+                return;
+
+            std::unique_lock guard{ checkpointMutex };
+            auto header = checkpoint;
+            header.passIdx = passIdx;
+            saveCheckpoint(checkpointPath, header, filmData, finishedTiles, aprons);
+            lastCheckpoint = std::chrono::steady_clock::now();
+        };
 
         tbb::speculative_spin_mutex mutex;
 
         std::uint32_t tileCount = 0;
-        const auto tileSampler = action.sampler->prepare(frameIdx, action.width, action.height, action.frameCount);
 
 #ifdef _DEBUG
         tbb::global_control limit{ tbb::global_control::max_allowed_parallelism, 1 };
 #endif
 
-        const auto processTile = [&](const glm::uvec2 tile) {
+        const auto tileRect = [&](const glm::uvec2 tile) {
+            const auto x0 = static_cast<int32_t>(rect.left + tile.x * tileSize) - 1;
+            const auto y0 = static_cast<int32_t>(rect.top + tile.y * tileSize) - 1;
+            const auto x1 = 1 + static_cast<int32_t>(std::min(rect.left + rect.width, rect.left + (tile.x + 1) * tileSize));
+            const auto y1 = 1 + static_cast<int32_t>(std::min(rect.top + rect.height, rect.top + (tile.y + 1) * tileSize));
+            return std::make_tuple(x0, y0, x1, y1);
+        };
+
+        const auto width = static_cast<int32_t>(action.width), height = static_cast<int32_t>(action.height);
+
+        std::pmr::vector<double> frameTileCost{ blocks.size(), 0.0, context().globalAllocator };
+
+        const auto processTile = [&](const uint32_t blockIdx, const uint32_t passIdx, const uint32_t sampleBegin,
+                                     const uint32_t sampleEnd) {
+            if(finishedTiles[blockIdx] || cancellationRequested())
+                return;
+
+            PIPER_TRACE_SPAN("RenderTile");
             MemoryArena arena;
+            const auto tileBegin = std::chrono::steady_clock::now();
 
-            const auto x0 = static_cast<int32_t>(action.rect.left + tile.x * tileSize) - 1;
-            const auto y0 = static_cast<int32_t>(action.rect.top + tile.y * tileSize) - 1;
-            const auto x1 =
-                1 + std::min(static_cast<int32_t>(action.rect.width), static_cast<int32_t>(action.rect.left + (tile.x + 1) * tileSize));
-            const auto y1 =
-                1 + std::min(static_cast<int32_t>(action.rect.height), static_cast<int32_t>(action.rect.top + (tile.y + 1) * tileSize));
+            const auto [x0, y0, x1, y1] = tileRect(blocks[blockIdx]);
 
             const uint32_t tileWidth = x1 - x0, tileHeight = y1 - y0;
             const auto res = renderTile(action.channels, pixelStride, x0, y0, tileWidth, tileHeight, action.width, action.height,
-                                        action.transform, action.sensor, tileSampler, static_cast<Float>(shutterTime), imageName);
-
-            for(auto y = static_cast<uint32_t>(std::max(y0, 0)); y < std::min(static_cast<uint32_t>(y1), action.height); ++y)
-                for(auto x = static_cast<uint32_t>(std::max(x0, 0)); x < std::min(static_cast<uint32_t>(x1), action.width); ++x) {
-                    const auto px = x - x0, py = y - y0;
-                    const auto src = res.data() + (py * tileWidth + px) * pixelStride;
-                    const auto dst = filmData.data() + (y * action.width + x) * pixelStride;
-                    for(uint32_t k = 0; k < pixelStride; ++k)
-                        dst[k] += src[k];
+                                        action.transform, action.sensor, tileSampler, static_cast<Float>(shutterTime),
+                                        preview ? &*preview : nullptr, action.adaptive, sampleBegin, sampleEnd,
+                                        pixelStats.empty() ? nullptr : pixelStats.data(),
+                                        mRelightCache ? &mRelightCache->tiles[passIdx * blocks.size() + blockIdx] : nullptr);
+
+            {
+                // the tiles are written to disjoint regions, the exclusive lock is only taken by checkpointing
+                std::shared_lock guard{ checkpointMutex };
+
+                for(auto y = std::max(y0 + 1, 0); y < std::min(y1 - 1, height); ++y)
+                    for(auto x = std::max(x0 + 1, 0); x < std::min(x1 - 1, width); ++x) {
+                        const auto px = x - x0, py = y - y0;
+                        const auto src = res.data() + (py * tileWidth + px) * pixelStride;
+                        const auto dst = filmData.data() + (y * action.width + x) * pixelStride;
+                        for(uint32_t k = 0; k < pixelStride; ++k)
+                            dst[k] += src[k];
+                    }
+
+                // the samples never leave their own pixels with filter importance sampling
+                if(!mFilterSampler) {
+                    auto& apron = aprons[blockIdx];
+                    apron.resize(2 * (tileWidth + tileHeight - 2) * pixelStride);
+                    forEachApronPixel(tileWidth, tileHeight, [&](const uint32_t px, const uint32_t py, const uint32_t idx) {
+                        std::copy_n(res.data() + (py * tileWidth + px) * pixelStride, pixelStride, apron.data() + idx * pixelStride);
+                    });
                 }
 
+                finishedTiles[blockIdx] = 1;
+            }
+
+            tryCheckpoint(passIdx);
+
+            frameTileCost[blockIdx] += std::chrono::duration<double>(std::chrono::steady_clock::now() - tileBegin).count();
+
             decltype(mutex)::scoped_lock guard{ mutex };
             mProgressReporter.update(progressBase + (++tileCount) / progressIncr);
         };
 
-        std::atomic_uint32_t currentBlockIdx = 0;
+        // split the curve into contiguous chunks of similar cost, so that each worker walks a coherent range of tiles
+        const auto chunkBounds = [&] {
+            const auto chunkCount = std::min(blocks.size(), static_cast<size_t>(4 * tbb::this_task_arena::max_concurrency()));
+            double total = 0.0;
+            for(const auto cost : tileCost)
+                total += cost;
+            const auto costOf = [&](const size_t idx) { return total > 0.0 ? tileCost[idx] : 1.0; };
+            if(total <= 0.0)
+                total = static_cast<double>(blocks.size());
+
+            std::pmr::vector<uint32_t> res{ context().globalAllocator };
+            res.reserve(chunkCount + 1);
+            res.push_back(0);
+            double prefix = 0.0;
+            for(size_t idx = 0; idx + 1 < blocks.size(); ++idx) {
+                prefix += costOf(idx);
+                if(res.size() < chunkCount && prefix * static_cast<double>(chunkCount) >= total * static_cast<double>(res.size()))
+                    res.push_back(static_cast<uint32_t>(idx + 1));
+            }
+            res.push_back(static_cast<uint32_t>(blocks.size()));
+            return res;
+        }();
 
-        tbb::parallel_for(
-            tbb::blocked_range<size_t>(0, blocks.size()),
-            [&](const tbb::blocked_range<size_t>& r) {
-                FloatingPointExceptionProbe::on();
-                for(size_t k = r.begin(); k != r.end(); ++k) {
-                    const auto idx = currentBlockIdx++;
-                    processTile(blocks[idx]);
+        // the offset of the color channel in a pixel
+        const auto colorSize = static_cast<uint32_t>(channelSize(Channel::Color, RenderGlobalSetting::get().spectrumType));
+        const auto colorOffset = [&] {
+            uint32_t offset = 1;
+            for(const auto channel : action.channels) {
+                if(channel == Channel::Color)
+                    break;
+                offset += static_cast<uint32_t>(channelSize(channel, RenderGlobalSetting::get().spectrumType));
+            }
+            return offset;
+        }();
+        if(mIntegrator->splatting()) {
+            if(std::ranges::find(action.channels, Channel::Color) == action.channels.cend())
+                fatal("The splatting integrator requires the color channel");
+            if(action.channels.size() != 1)
+                warning("The splatting integrator only renders the color channel, the other channels are black");
+        }
+
+        // the splatting integrators render the color of the whole region at once, each pixel receives the weight of the pass
+        const auto renderSplatPass = [&](const uint32_t sampleBegin, const uint32_t sampleEnd) {
+            FilmSplatter film{ filmData.data(), action.width, pixelStride, colorOffset, colorSize, rect, action.transform, action.sensor };
+            mIntegrator->renderFilm(film, sampleBegin, sampleEnd, *mAcceleration, *mLightSampler);
+
+            const auto weight = static_cast<Float>(sampleEnd - sampleBegin);
+            std::pmr::vector<float> lineData{ rect.width * 3ULL, context().globalAllocator };
+            for(auto y = rect.top; y < rect.top + rect.height; ++y) {
+                for(auto x = rect.left; x < rect.left + rect.width; ++x) {
+                    const auto pixel = filmData.data() + (static_cast<size_t>(y) * action.width + x) * pixelStride;
+                    pixel[0] += weight;
+                    const auto dst = lineData.data() + (x - rect.left) * 3;
+                    for(uint32_t k = 0; k < 3; ++k)
+                        dst[k] = pixel[colorOffset + (colorSize == 3 ? k : 0)] / pixel[0];
                 }
-                FloatingPointExceptionProbe::off();
-            },
-            globalAffinityPartitioner);
+                if(preview)
+                    preview->update(rect.left, y, std::span<const float>{ lineData.data(), lineData.size() });
+            }
+            mProgressReporter.update(progressBase + static_cast<double>(sampleEnd) / static_cast<double>(sampleCount * mTotalFrameCount));
+        };
 
-        std::pmr::vector<Float> weightedFilm{ action.width * action.height * action.channelTotalSize, context().globalAllocator };
+        const auto renderPass = [&](const uint32_t passIdx, const uint32_t sampleBegin, const uint32_t sampleEnd) {
+            if(mIntegrator->splatting()) {
+                renderSplatPass(sampleBegin, sampleEnd);
+                return;
+            }
+            if(tileOrder == TileOrder::Spiral) {
+                std::atomic_uint32_t currentBlockIdx = 0;
+
+                tbb::parallel_for(
+                    tbb::blocked_range<size_t>(0, blocks.size()),
+                    [&](const tbb::blocked_range<size_t>& r) {
+                        FloatingPointExceptionProbe::on();
+                        for(size_t k = r.begin(); k != r.end(); ++k)
+                            processTile(currentBlockIdx++, passIdx, sampleBegin, sampleEnd);
+                        FloatingPointExceptionProbe::off();
+                    },
+                    globalAffinityPartitioner);
+            } else {
+                tbb::parallel_for(
+                    tbb::blocked_range<size_t>(0, chunkBounds.size() - 1, 1),
+                    [&](const tbb::blocked_range<size_t>& r) {
+                        FloatingPointExceptionProbe::on();
+                        for(size_t chunk = r.begin(); chunk != r.end(); ++chunk)
+                            for(auto k = chunkBounds[chunk]; k != chunkBounds[chunk + 1]; ++k)
+                                processTile(k, passIdx, sampleBegin, sampleEnd);
+                        FloatingPointExceptionProbe::off();
+                    },
+                    globalAffinityPartitioner);
+            }
 
-        tbb::parallel_for(
-            tbb::blocked_range<uint32_t>{ 0, action.width * action.height },
-            [&](const tbb::blocked_range<uint32_t>& range) {
-                for(uint32_t idx = range.begin(); idx != range.end(); ++idx) {
-                    const auto base = filmData.data() + idx * pixelStride;
-                    if(base[0] < 1e-9f)
-                        continue;
-                    const auto dst = weightedFilm.data() + idx * action.channelTotalSize;
+            // the aprons of tiles with the same parity never overlap
+            for(uint32_t parity = 0; parity < 4 && !mFilterSampler; ++parity) {
+                tbb::parallel_for(
+                    tbb::blocked_range<size_t>(0, blocks.size()),
+                    [&](const tbb::blocked_range<size_t>& r) {
+                        for(size_t idx = r.begin(); idx != r.end(); ++idx) {
+                            const auto tile = blocks[idx];
+                            if(((tile.x & 1) | ((tile.y & 1) << 1)) != parity)
+                                continue;
+
+                            const auto [x0, y0, x1, y1] = tileRect(tile);
+                            const auto& apron = aprons[idx];
+                            const auto tileWidth = static_cast<uint32_t>(x1 - x0), tileHeight = static_cast<uint32_t>(y1 - y0);
+                            forEachApronPixel(tileWidth, tileHeight, [&](const uint32_t px, const uint32_t py, const uint32_t ringIdx) {
+                                const auto x = x0 + static_cast<int32_t>(px), y = y0 + static_cast<int32_t>(py);
+                                if(x < 0 || x >= width || y < 0 || y >= height)
+                                    return;
+                                const auto src = apron.data() + ringIdx * pixelStride;
+                                const auto dst = filmData.data() + (y * action.width + x) * pixelStride;
+                                for(uint32_t k = 0; k < pixelStride; ++k)
+                                    dst[k] += src[k];
+                            });
+                        }
+                    },
+                    globalAffinityPartitioner);
+            }
 
-                    const auto inverse = rcp(base[0].load());
-                    for(uint32_t k = 0; k < action.channelTotalSize; ++k)
-                        dst[k] = base[k + 1].load() * inverse;
+            std::ranges::fill(finishedTiles, 0);
+        };
+
+        // mean relative standard error of the pixel luminance, the black pixels are skipped since they are converged trivially
+        // NOTICE: the partition of the reduction is fixed, so the termination does not depend on the scheduling
+        const auto estimateError = [&](const uint32_t spp) {
+            const auto n = static_cast<double>(spp);
+            const auto [sum, count] = tbb::parallel_deterministic_reduce(
+                tbb::blocked_range<size_t>{ 0, pixelStats.size(), 4096 }, std::pair<double, size_t>{ 0.0, 0 },
+                [&](const tbb::blocked_range<size_t>& range, std::pair<double, size_t> res) {
+                    for(size_t idx = range.begin(); idx != range.end(); ++idx) {
+                        const auto stats = pixelStats[idx];
+                        if(stats.x <= 0.0)
+                            continue;
+                        const auto mean = stats.x / n;
+                        const auto variance = std::max(0.0, (stats.y - stats.x * mean) / (n - 1.0));
+                        res.first += std::sqrt(variance / n) / std::max(mean, 1e-3);
+                        ++res.second;
+                    }
+                    return res;
+                },
+                [](const std::pair<double, size_t> lhs, const std::pair<double, size_t> rhs) {
+                    return std::pair<double, size_t>{ lhs.first + rhs.first, lhs.second + rhs.second };
+                },
+                tbb::simple_partitioner{});
+            return count ? sum / static_cast<double>(count) : 0.0;
+        };
+
+        // the coarse passes only update the display, the integrator state learned by them is reset by the first full pass
+        if(action.coarsePreview && preview && !resumed && !mWorker && !action.roi) {
+            for(const auto scale : { 8U, 4U, 2U }) {
+                if(cancellationRequested())
+                    break;
+                mIntegrator->beginPass(0, *mAcceleration, *mLightSampler);
+                renderPreviewPass(action, frameIdx, scale, static_cast<Float>(shutterTime), *preview);
+            }
+            info(fmt::format("Coarse preview of action {}, frame {} is sent", actionIdx, frameIdx));
+        }
+
+        const auto renderBegin = std::chrono::steady_clock::now();
+
+        // the time-to-quality curve, the time spent on comparing with the reference is excluded
+        std::vector<ConvergencePoint> convergence;
+        double convergenceOverhead = 0.0;
+        const auto recordConvergence = [&](const uint32_t samples) {
+            const auto& reference = action.progressive->reference;
+            const auto referenceChannels = action.progressive->referenceChannels;
+            const auto begin = std::chrono::steady_clock::now();
+            const auto channels = std::min(referenceChannels, colorSize);
+            // the pixels outside the region of interest only receive the base after the last pass
+            const auto region = action.roi ? action.roi->rect : RenderRECT{ 0, 0, action.width, action.height };
+            const auto sum = tbb::parallel_reduce(
+                tbb::blocked_range<uint32_t>{ region.top, region.top + region.height }, 0.0,
+                [&](const tbb::blocked_range<uint32_t>& range, double res) {
+                    for(auto y = range.begin(); y != range.end(); ++y)
+                        for(auto x = region.left; x < region.left + region.width; ++x) {
+                            const auto idx = static_cast<size_t>(y) * action.width + x;
+                            const auto pixel = filmData.data() + idx * pixelStride;
+                            const auto inverse = pixel[0] > 1e-9f ? rcp(pixel[0]) : 0.0f;
+                            for(uint32_t k = 0; k < channels; ++k)
+                                res += sqr(
+                                    static_cast<double>(pixel[colorOffset + k] * inverse - reference[idx * referenceChannels + k]));
+                        }
+                    return res;
+                },
+                std::plus<>{});
+            const auto rmse = std::sqrt(sum / static_cast<double>(static_cast<size_t>(region.width) * region.height * channels));
+            const auto end = std::chrono::steady_clock::now();
+            const auto time = std::chrono::duration<double>(begin - renderBegin).count() - convergenceOverhead;
+            convergenceOverhead += std::chrono::duration<double>(end - begin).count();
+            convergence.push_back({ time, samples, rmse });
+        };
+        const auto trackConvergence = action.progressive && !action.progressive->reference.empty();
+        if(trackConvergence && std::ranges::find(action.channels, Channel::Color) == action.channels.cend())
+            fatal("The reference image of progressive rendering requires the color channel");
+
+        if(mWorker) {
+            // the workers render disjoint sample ranges of a single pass
+            mIntegrator->beginPass(0, *mAcceleration, *mLightSampler);
+            std::pmr::vector<Float> accumulated{ filmData.size(), trackedAllocator(MemoryTag::Film) };
+            while(const auto range = mWorker->acquire(globalFrameIdx)) {
+                renderPass(0, range->first, range->second);
+                mWorker->submit(globalFrameIdx, range->first, range->second, filmData);
+                for(size_t idx = 0; idx < filmData.size(); ++idx) {
+                    accumulated[idx] += filmData[idx];
+                    filmData[idx] = 0.0f;
                 }
-            },
-            globalAffinityPartitioner);
+            }
+            filmData = std::move(accumulated);
+        }
+
+        // the pixel statistics are not checkpointed, so the resumed pass is excluded from the error estimation
+        uint32_t statsBegin = 0;
+        for(uint32_t passIdx = checkpoint.passIdx; passIdx < passCount && !mWorker; ++passIdx) {
+            const auto passBegin = std::chrono::steady_clock::now();
+            const auto sampleBegin = passIdx * samplesPerPass;
+            const auto sampleEnd = std::min(sampleBegin + samplesPerPass, sampleCount);
+            mIntegrator->beginPass(passIdx, *mAcceleration, *mLightSampler);
+            renderPass(passIdx, sampleBegin, sampleEnd);
+
+            if(cancellationRequested()) {
+                // the cached batches of the unfinished tiles are missing
+                mRelightCache.reset();
+                info(fmt::format("Action {}, frame {} is cancelled in pass {}", actionIdx, frameIdx, passIdx));
+                return {};
+            }
+
+            if(std::exchange(resumed, false)) {
+                std::ranges::fill(pixelStats, glm::dvec2{ 0.0 });
+                statsBegin = sampleEnd;
+            }
+            if(trackConvergence)
+                recordConvergence(sampleEnd);
+
+            if(!action.progressive || passIdx + 1 == passCount)
+                break;
+
+            // stop before the pass which is expected to miss the deadline
+            const auto now = std::chrono::steady_clock::now();
+            const auto elapsed = std::chrono::duration<double>(now - renderBegin).count() - convergenceOverhead;
+            const auto passTime = std::chrono::duration<double>(now - passBegin).count();
+            if(elapsed + passTime > action.progressive->timeBudget) {
+                info(fmt::format("Time budget reached after {} samples per pixel ({:.2f}s)", sampleEnd, elapsed));
+                break;
+            }
+
+            if(!pixelStats.empty() && sampleEnd >= statsBegin + 2) {
+                const auto error = estimateError(sampleEnd - statsBegin);
+                if(error <= static_cast<double>(action.progressive->targetError)) {
+                    info(fmt::format("Target error reached after {} samples per pixel (error = {:.4f})", sampleEnd, error));
+                    break;
+                }
+            }
+        }
+
+        tileCost = std::move(frameTileCost);
+
+        // the pixels inside the region have received all of their samples, the others (including the ring) keep the base
+        if(action.roi) {
+            const auto& roi = action.roi->rect;
+            tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, action.height }, [&](const tbb::blocked_range<uint32_t>& range) {
+                for(auto y = range.begin(); y != range.end(); ++y)
+                    for(uint32_t x = 0; x < action.width; ++x) {
+                        if(roi.left <= x && x < roi.left + roi.width && roi.top <= y && y < roi.top + roi.height)
+                            continue;
+                        const auto offset = (static_cast<size_t>(y) * action.width + x) * pixelStride;
+                        std::copy_n(roiBase.data() + offset, pixelStride, filmData.data() + offset);
+                    }
+            });
+        }
+
+        if(!checkpointPath.empty()) {
+            std::error_code ec;
+            fs::remove(checkpointPath, ec);
+        }
 
         mProgressReporter.update(static_cast<double>(mFrameCount) / static_cast<double>(mTotalFrameCount));
+        info(fmt::format("Action {}, frame {}: {}", actionIdx, frameIdx, formatThroughput(throughput.update())));
+
+        return resolveFrame(actionIdx, frameIdx, std::move(filmData), frameStats, std::move(convergence));
+    }
+
+    void loadIntegrator(const Ref<ConfigNode>& node) {
+        mIntegrator = makeVariant<IntegratorBase, Integrator>(node);
+        if(mDeterministic && !mIntegrator->deterministic())
+            warning("The integrator learns from the racing updates of the concurrent samples, its result is not reproducible");
+    }
+
+    Sensor* tryFindSensor(const std::string_view name) const {
+        if(const auto iter = mNamedObjects.find(std::pmr::string{ name, context().globalAllocator }); iter != mNamedObjects.cend())
+            return mSceneObjects[iter->second]->sensor();
+        return nullptr;
+    }
+
+    Sensor* findSensor(const std::string_view name) const {
+        if(const auto sensor = tryFindSensor(name))
+            return sensor;
+        fatal(fmt::format("Unrecognized sensor \"{}\"", name));
+    }
+
+    [[nodiscard]] FrameMetadata makeMetadata(const uint32_t actionIdx, const uint32_t frameIdx) const {
+        const auto& action = mActions[actionIdx];
+        FrameMetadata res{ action.width, action.height, actionIdx, frameIdx, action.channels, action.channelTotalSize,
+                           RenderGlobalSetting::get().spectrumType, true, mLayout };
+        if(!action.halfChannels.empty()) {
+            res.formats.reserve(action.channels.size());
+            for(const auto channel : action.channels) {
+                const auto half = std::ranges::find(action.halfChannels, channel) != action.halfChannels.cend();
+                res.formats.push_back(half ? ChannelFormat::Half : ChannelFormat::Float);
+            }
+        }
+        return res;
+    }
+
+    static void addChannel(FrameAction& action, const Channel channel) {
+        action.channels.push_back(channel);
+        action.channelTotalSize += channelSize(channel, RenderGlobalSetting::get().spectrumType);
+    }
+
+    void addAction(const Ref<ConfigNode>& attrs) {
+        FrameAction res;
+        res.width = attrs->get("Width"sv)->as<uint32_t>();
+        res.height = attrs->get("Height"sv)->as<uint32_t>();
+        res.frameCount = attrs->get("FrameCount"sv)->as<uint32_t>();
+
+        res.sampler = getStaticFactory().make<Sampler>(attrs->get("Sampler"sv)->as<Ref<ConfigNode>>());
+
+        res.begin = attrs->get("Begin"sv)->as<double>();
+        res.fps = attrs->get("FPS"sv)->as<double>();
+        res.shutterOpen = attrs->get("ShutterOpen"sv)->as<double>();
+        res.shutterClose = attrs->get("ShutterClose"sv)->as<double>();
+
+        const auto& channels = attrs->get("Channels"sv)->as<ConfigAttr::AttrArray>();
+        res.channels.reserve(channels.size());
+        for(auto& channel : channels)
+            addChannel(res, magic_enum::enum_cast<Channel>(channel->as<std::string_view>()).value());
+        // the channels required by the following pipeline nodes
+        for(const auto channel : mRequirement | std::views::keys)
+            if(std::ranges::find(res.channels, channel) == res.channels.cend())
+                addChannel(res, channel);
+
+        res.sensorName = attrs->get("Sensor"sv)->as<std::string_view>();
+        res.sensor = findSensor(res.sensorName);
+
+        if(const auto ptr = attrs->tryGet("AdaptiveSampling"sv)) {
+            const auto& config = (*ptr)->as<Ref<ConfigNode>>();
+            AdaptiveSampling adaptive;
+            if(const auto minSamples = config->tryGet("MinSamples"sv))
+                adaptive.minSamples = (*minSamples)->as<uint32_t>();
+            if(const auto batchSize = config->tryGet("BatchSize"sv))
+                adaptive.batchSize = std::max(1U, (*batchSize)->as<uint32_t>());
+            if(const auto threshold = config->tryGet("Threshold"sv))
+                adaptive.threshold = (*threshold)->as<Float>();
+            res.adaptive = adaptive;
+        }
 
-        return makeRefCount<Frame>(FrameMetadata{ action.width, action.height, actionIdx, frameIdx, action.channels,
-                                                  action.channelTotalSize, RenderGlobalSetting::get().spectrumType, true },
-                                   std::move(weightedFilm));
+        if(const auto ptr = attrs->tryGet("Progressive"sv)) {
+            const auto& config = (*ptr)->as<Ref<ConfigNode>>();
+            ProgressiveRendering progressive;
+            if(const auto samplesPerPass = config->tryGet("SamplesPerPass"sv))
+                progressive.samplesPerPass = std::max(1U, (*samplesPerPass)->as<uint32_t>());
+            if(const auto timeBudget = config->tryGet("TimeBudget"sv))
+                progressive.timeBudget = (*timeBudget)->as<double>();
+            if(const auto targetError = config->tryGet("TargetError"sv))
+                progressive.targetError = (*targetError)->as<Float>();
+            if(const auto reference = config->tryGet("Reference"sv))
+                loadReference(progressive, (*reference)->as<std::string_view>(), res.width, res.height);
+            if(mDeterministic && std::isfinite(progressive.timeBudget)) {
+                warning("The time budget of progressive rendering is ignored in the deterministic mode");
+                progressive.timeBudget = std::numeric_limits<double>::infinity();
+            }
+            res.progressive = std::move(progressive);
+
+            if(res.adaptive) {
+                warning("Adaptive sampling is ignored in progressive mode");
+                res.adaptive.reset();
+            }
+        }
+
+        if(const auto ptr = attrs->tryGet("Relight"sv))
+            res.relight = (*ptr)->as<bool>();
+        if(res.relight && res.adaptive) {
+            // the sample counts of the adaptive pixels depend on the shading results
+            warning("Relight mode is ignored with adaptive sampling");
+            res.relight = false;
+        }
+
+        if(const auto ptr = attrs->tryGet("CoarsePreview"sv))
+            res.coarsePreview = (*ptr)->as<bool>();
+
+        if(const auto ptr = attrs->tryGet("TileSize"sv))
+            res.tileSize = (*ptr)->as<uint32_t>();
+        // the AOVs stored in half precision after the film is resolved, the accumulation is always in full precision
+        if(const auto ptr = attrs->tryGet("HalfChannels"sv)) {
+            for(auto& channel : (*ptr)->as<ConfigAttr::AttrArray>()) {
+                const auto value = magic_enum::enum_cast<Channel>(channel->as<std::string_view>()).value();
+                if(value == Channel::Color || value == Channel::Cost)
+                    warning(fmt::format("The {} channel is always stored in full precision", magic_enum::enum_name(value)));
+                else
+                    res.halfChannels.push_back(value);
+            }
+        }
+
+        if(const auto ptr = attrs->tryGet("TileOrder"sv))
+            res.tileOrder = magic_enum::enum_cast<TileOrder>((*ptr)->as<std::string_view>()).value();
+
+        if(const auto ptr = attrs->tryGet("FitMode"sv))
+            res.fitMode = magic_enum::enum_cast<FitMode>((*ptr)->as<std::string_view>()).value();
+
+        auto [transform, rect] = calcRenderRECT(res.width, res.height, res.sensor->deviceAspectRatio(), res.fitMode);
+
+        res.transform = transform;
+        res.rect = rect;
+
+        if(const auto ptr = attrs->tryGet("RegionOfInterest"sv)) {
+            const auto& config = (*ptr)->as<Ref<ConfigNode>>();
+            RegionOfInterest roi;
+            roi.rect = { config->get("Left"sv)->as<uint32_t>(), config->get("Top"sv)->as<uint32_t>(),
+                         config->get("Width"sv)->as<uint32_t>(), config->get("Height"sv)->as<uint32_t>() };
+            roi.base = config->get("Base"sv)->as<std::string_view>();
+            // e.g., the same sampler with more samples per pixel
+            if(const auto sampler = config->tryGet("Sampler"sv))
+                roi.sampler = getStaticFactory().make<Sampler>((*sampler)->as<Ref<ConfigNode>>());
+
+            // the region is clipped by the rendered area of the sensor fit
+            const auto left = std::max(roi.rect.left, rect.left), top = std::max(roi.rect.top, rect.top);
+            const auto right = std::min(roi.rect.left + roi.rect.width, rect.left + rect.width);
+            const auto bottom = std::min(roi.rect.top + roi.rect.height, rect.top + rect.height);
+            if(left >= right || top >= bottom)
+                fatal("The region of interest is outside the rendered area");
+            roi.rect = { left, top, right - left, bottom - top };
+
+            if(mCoordinator || mWorker)
+                warning("The region of interest is ignored in distributed rendering");
+            else
+                res.roi = std::move(roi);
+        }
+
+        mActions.push_back(res);
+        mTileCost.emplace_back();
+        mTotalFrameCount += res.frameCount;
     }
 
 public:
@@ -459,105 +1872,287 @@ public:
         if(settings.variant.find("MonoSpectral") != std::pmr::string::npos)
             settings.sampledWavelength = MonoWavelengthSpectrum::fromRaw(node->get("SampledWavelength"sv)->as<Float>());
 
-        settings.accelerationBuilder = createEmbreeBackend();
+        // drafts prefer fast low-quality builds, animations prefer refitting the top-level BVH between frames
+        BuildSettings sceneSettings{ BuildQuality::Low, false, false, false };
+        BuildSettings shapeSettings{ BuildQuality::High, true, false, false };
+        if(const auto ptr = node->tryGet("Acceleration"sv)) {
+            const auto& accel = (*ptr)->as<Ref<ConfigNode>>();
+            if(const auto scene = accel->tryGet("Scene"sv))
+                sceneSettings = parseBuildSettings((*scene)->as<Ref<ConfigNode>>(), sceneSettings);
+            if(const auto shape = accel->tryGet("Shape"sv))
+                shapeSettings = parseBuildSettings((*shape)->as<Ref<ConfigNode>>(), shapeSettings);
+        }
+        settings.accelerationBuilder = createEmbreeBackend(sceneSettings, shapeSettings);
+
+        if(const auto ptr = node->tryGet("MeshCache"sv)) {
+            settings.meshCacheDirectory = (*ptr)->as<std::string_view>();
+            fs::create_directories(settings.meshCacheDirectory);
+        }
+        // the shading attributes are paged from the mesh cache within the budget (in MB)
+        if(const auto ptr = node->tryGet("OutOfCoreBudget"sv))
+            ResidencyManager::get().setBudget(static_cast<size_t>((*ptr)->as<double>() * 1e6));
+        // the decoded texture tiles are cached within the budget (in MB)
+        if(const auto ptr = node->tryGet("TextureCacheBudget"sv))
+            settings.textureCacheBudget = static_cast<size_t>((*ptr)->as<double>() * 1e6);
+        if(const auto ptr = node->tryGet("TextureCache"sv)) {
+            settings.textureCacheDirectory = (*ptr)->as<std::string_view>();
+            fs::create_directories(settings.textureCacheDirectory);
+        }
+        if(const auto ptr = node->tryGet("TextureHalfFloat"sv))
+            settings.textureHalfFloat = (*ptr)->as<bool>();
+        // the face data of the Ptex textures is cached within the budget (in MB)
+        if(const auto ptr = node->tryGet("PtexCacheBudget"sv))
+            settings.ptexCacheBudget = static_cast<size_t>((*ptr)->as<double>() * 1e6);
+        if(const auto ptr = node->tryGet("MaterialCache"sv)) {
+            settings.materialCacheDirectory = (*ptr)->as<std::string_view>();
+            fs::create_directories(settings.materialCacheDirectory);
+        }
 
         const auto& objects = node->get("Scene"sv)->as<ConfigAttr::AttrArray>();
         mSceneObjects.reserve(objects.size());
 
-        std::pmr::unordered_map<std::string_view, Sensor*> sensors{ context().localAllocator };
-
         {
             tbb::speculative_spin_mutex mutex;
 
             std::pmr::vector<PrimitiveGroup*> groups{ context().localAllocator };
 
-            tbb::parallel_for_each(objects, [&](const Ref<ConfigAttr>& attr) {
+            // staged loading: this thread reads the mesh files ahead of the workers, which decode the meshes and build the BLASes,
+            // so the I/O-bound and the CPU-bound stages overlap
+            struct PendingObject final {
+                const Ref<ConfigNode>* node;
+                std::optional<fs::path> path;
+                uintmax_t size;
+            };
+            std::pmr::vector<PendingObject> pending{ context().localAllocator };
+            pending.reserve(objects.size());
+            for(const auto& attr : objects) {
                 const auto& ref = attr->as<Ref<ConfigNode>>();
+                std::optional<fs::path> path;
+                uintmax_t size = 0;
+                if(ref->get("ComponentType"sv)->as<std::string_view>() == "Shape"sv) {
+                    const auto& component = ref->get("Component"sv)->as<Ref<ConfigNode>>();
+                    if(const auto ptr = component->tryGet("Path"sv)) {
+                        path = (*ptr)->as<std::string_view>();
+                        std::error_code ec;
+                        size = fs::file_size(*path, ec);
+                        if(ec)
+                            size = 0;
+                    }
+                }
+                pending.push_back({ &ref, std::move(path), size });
+            }
+            // the largest meshes go first to avoid a long tail
+            std::ranges::stable_sort(pending, std::greater<>{}, &PendingObject::size);
+
+            ProgressReporterHandle loadingProgress{ "Loading scene" };
+            std::atomic_uint32_t loadedCount = 0;
+            tbb::task_group loading;
 
+            const auto load = [&](const Ref<ConfigNode>& ref) {
                 auto object = makeRefCount<SceneObject>(ref);
+                loadingProgress.update(static_cast<double>(++loadedCount) / static_cast<double>(pending.size()));
                 decltype(mutex)::scoped_lock guard{ mutex };
 
                 if(const auto group = object->primitiveGroup())
                     groups.push_back(group);
+                else
+                    mNamedObjects.emplace(std::pmr::string{ ref->name(), context().globalAllocator }, mSceneObjects.size());
 
                 if(const auto light = object->light())
                     mLights.push_back(light);
-                else if(auto sensor = object->sensor())
-                    sensors.insert({ ref->name(), sensor });
 
                 mSceneObjects.push_back(std::move(object));
-            });
+            };
+
+            for(const auto& item : pending) {
+                if(item.path)
+                    prefetchFile(*item.path);
+                loading.run([&load, &item] { load(*item.node); });
+            }
+            loading.wait();
 
             mAcceleration = settings.accelerationBuilder->buildScene(groups);
         }
 
-        mIntegrator = makeVariant<IntegratorBase, Integrator>(node->get("Integrator"sv)->as<Ref<ConfigNode>>());
+        if(const auto ptr = node->tryGet("Deterministic"sv))
+            mDeterministic = (*ptr)->as<bool>();
+        loadIntegrator(node->get("Integrator"sv)->as<Ref<ConfigNode>>());
         mLightSampler = getStaticFactory().make<LightSampler>(node->get("LightSampler"sv)->as<Ref<ConfigNode>>());
         mFilter = getStaticFactory().make<Filter>(node->get("Filter"sv)->as<Ref<ConfigNode>>());
+        mFilterTable.emplace(*mFilter);
+        if(const auto ptr = node->tryGet("FilterImportanceSampling"sv); ptr && (*ptr)->as<bool>())
+            mFilterSampler.emplace(*mFilter);
+        if(const auto ptr = node->tryGet("OverlapSceneUpdate"sv))
+            mOverlapSceneUpdate = (*ptr)->as<bool>();
+        if(const auto ptr = node->tryGet("WavelengthBatches"sv))
+            mWavelengthBatches = std::max(1U, (*ptr)->as<uint32_t>());
+
+        if(const auto ptr = node->tryGet("Checkpoint"sv)) {
+            const auto& config = (*ptr)->as<Ref<ConfigNode>>();
+            mCheckpointDir = config->get("Directory"sv)->as<std::string_view>();
+            if(const auto interval = config->tryGet("Interval"sv))
+                mCheckpointInterval = (*interval)->as<double>();
+            fs::create_directories(mCheckpointDir);
+        }
 
-        for(auto& action : node->get("Action"sv)->as<ConfigAttr::AttrArray>()) {
-            const auto& attrs = action->as<Ref<ConfigNode>>();
-            FrameAction res;
-            res.width = attrs->get("Width"sv)->as<uint32_t>();
-            res.height = attrs->get("Height"sv)->as<uint32_t>();
-            res.frameCount = attrs->get("FrameCount"sv)->as<uint32_t>();
-
-            res.sampler = getStaticFactory().make<Sampler>(attrs->get("Sampler"sv)->as<Ref<ConfigNode>>());
-
-            res.begin = attrs->get("Begin"sv)->as<double>();
-            res.fps = attrs->get("FPS"sv)->as<double>();
-            res.shutterOpen = attrs->get("ShutterOpen"sv)->as<double>();
-            res.shutterClose = attrs->get("ShutterClose"sv)->as<double>();
-
-            const auto& channels = attrs->get("Channels"sv)->as<ConfigAttr::AttrArray>();
-            res.channels.reserve(channels.size());
-            for(auto& channel : channels) {
-                const auto channelEnum = magic_enum::enum_cast<Channel>(channel->as<std::string_view>()).value();
-                const auto size = channelSize(channelEnum, RenderGlobalSetting::get().spectrumType);
-                res.channels.push_back(channelEnum);
-                res.channelTotalSize += size;
-            }
-
-            res.sensor = sensors.find(attrs->get("Sensor"sv)->as<std::string_view>())->second;
-
-            auto fitMode = FitMode::Fill;
-            if(const auto ptr = attrs->tryGet("FitMode"sv))
-                fitMode = magic_enum::enum_cast<FitMode>((*ptr)->as<std::string_view>()).value();
+        if(const auto ptr = node->tryGet("Preview"sv)) {
+            const auto& config = (*ptr)->as<Ref<ConfigNode>>();
+            if(const auto interval = config->tryGet("Interval"sv))
+                mPreviewPolicy.minInterval = (*interval)->as<uint32_t>();
+            if(const auto downsample = config->tryGet("Downsample"sv))
+                mPreviewPolicy.downsample = std::max(1U, (*downsample)->as<uint32_t>());
+        }
 
-            auto [transform, rect] = calcRenderRECT(res.width, res.height, res.sensor->deviceAspectRatio(), fitMode);
+        if(const auto ptr = node->tryGet("Distributed"sv)) {
+            const auto& config = (*ptr)->as<Ref<ConfigNode>>();
+            const auto role = config->get("Role"sv)->as<std::string_view>();
+            if(role == "Coordinator"sv) {
+                mDistributedWorkerCount = std::max(1U, config->get("Workers"sv)->as<uint32_t>());
+                if(const auto chunkSize = config->tryGet("ChunkSize"sv))
+                    mDistributedChunkSize = (*chunkSize)->as<uint32_t>();
+                mCoordinator =
+                    createDistributedCoordinator(static_cast<uint16_t>(config->get("Port"sv)->as<uint32_t>()), mDistributedWorkerCount);
+            } else if(role == "Worker"sv) {
+                mWorker = createDistributedWorker(config->get("Coordinator"sv)->as<std::string_view>());
+            } else
+                fatal(fmt::format("Unrecognized distributed role \"{}\"", role));
+        }
 
-            res.transform = transform;
-            res.rect = rect;
+        for(auto& action : node->get("Action"sv)->as<ConfigAttr::AttrArray>())
+            addAction(action->as<Ref<ConfigNode>>());
+    }
 
-            mActions.push_back(res);
-            mTotalFrameCount += res.frameCount;
-        }
+    ~Renderer() override {
+        mSceneUpdate.wait();
     }
 
     Ref<Frame> transform(Ref<Frame>) override {
-        uint32_t idx = 0;
-        uint32_t frameIdx = mFrameCount;
-        while(frameIdx >= mActions[idx].frameCount) {
-            frameIdx -= mActions[idx].frameCount;
-            ++idx;
-        }
+        const auto [idx, frameIdx] = locateFrame(mFrameCount);
         ++mFrameCount;
 
+        if(mCoordinator) {
+            auto frame = merge(idx, frameIdx);
+            mProgressReporter.update(static_cast<double>(mFrameCount) / static_cast<double>(mTotalFrameCount));
+            return frame;
+        }
         return render(idx, frameIdx);
     }
     uint32_t frameCount() override {
         return mTotalFrameCount;
     }
+    size_t frameBytes() override {
+        size_t res = 0;
+        for(uint32_t idx = 0; idx < mActions.size(); ++idx)
+            res = std::max(res, makeMetadata(idx, 0).storageSize() * sizeof(Float));
+        return res;
+    }
     ChannelRequirement setup(ChannelRequirement req) override {
         for(auto& action : mActions) {
             for(const auto channel : req | std::views::keys)
-                if(std::ranges::find(action.channels, channel) == action.channels.cend()) {
-                    action.channels.push_back(channel);
-                    action.channelTotalSize += channelSize(channel, RenderGlobalSetting::get().spectrumType);
-                }
+                if(std::ranges::find(action.channels, channel) == action.channels.cend())
+                    addChannel(action, channel);
         }
+        mRequirement = std::move(req);
         return {};
     }
+    void setLayout(const FrameLayout layout) override {
+        mLayout = layout;
+    }
+    // NOTICE: the invalid jobs are rejected by exceptions before anything is changed, so that the server keeps running
+    void applyJob(const Ref<ConfigNode>& job) override {
+        if(mCoordinator || mWorker)
+            throw std::runtime_error{ "Server mode is not supported in distributed rendering" };
+        mSceneUpdate.wait();
+        // the job may refer to the files written after the last scene update
+        invalidateSearchPathIndex();
+
+        // the sensors and the lights are replaced or added by name, the geometries and the BVHs are kept
+        std::pmr::vector<std::pair<std::pmr::string, Ref<SceneObject>>> objects{ context().globalAllocator };
+        if(const auto ptr = job->tryGet("Scene"sv)) {
+            for(const auto& attr : (*ptr)->as<ConfigAttr::AttrArray>()) {
+                const auto& ref = attr->as<Ref<ConfigNode>>();
+                if(ref->get("ComponentType"sv)->as<std::string_view>() == "Shape"sv)
+                    throw std::runtime_error{ fmt::format("Shape \"{}\" cannot be replaced in server mode", ref->name()) };
+                objects.emplace_back(std::pmr::string{ ref->name(), context().globalAllocator }, makeRefCount<SceneObject>(ref));
+            }
+        }
+        const auto sensorAvailable = [&](const std::string_view name) {
+            if(const auto iter = std::ranges::find(objects, name, [](const auto& object) { return std::string_view{ object.first }; });
+               iter != objects.cend())
+                return iter->second->sensor() != nullptr;
+            return tryFindSensor(name) != nullptr;
+        };
+
+        const auto actions = job->tryGet("Action"sv);
+        if(actions) {
+            for(auto& action : (*actions)->as<ConfigAttr::AttrArray>())
+                if(const auto name = action->as<Ref<ConfigNode>>()->get("Sensor"sv)->as<std::string_view>(); !sensorAvailable(name))
+                    throw std::runtime_error{ fmt::format("Unrecognized sensor \"{}\"", name) };
+        } else {
+            for(const auto& action : mActions)
+                if(!sensorAvailable(action.sensorName))
+                    throw std::runtime_error{ fmt::format("Sensor \"{}\" is still used by the actions", action.sensorName) };
+        }
+
+        mJobs.push_back(job);
+        if(!objects.empty()) {
+            for(auto& [name, object] : objects) {
+                if(const auto iter = mNamedObjects.find(name); iter != mNamedObjects.end())
+                    mSceneObjects[iter->second] = std::move(object);
+                else {
+                    mNamedObjects.emplace(std::move(name), mSceneObjects.size());
+                    mSceneObjects.push_back(std::move(object));
+                }
+            }
+
+            mLights.clear();
+            for(const auto& object : mSceneObjects)
+                if(const auto light = object->light())
+                    mLights.push_back(light);
+            mLightsDirty = true;
+
+            // the replaced sensors are released, so the actions refer to the new ones
+            for(auto& action : mActions) {
+                action.sensor = findSensor(action.sensorName);
+                const auto [transform, rect] =
+                    calcRenderRECT(action.width, action.height, action.sensor->deviceAspectRatio(), action.fitMode);
+                action.transform = transform;
+                action.rect = rect;
+                if(action.roi) {
+                    auto& roi = action.roi->rect;
+                    const auto left = std::max(roi.left, rect.left), top = std::max(roi.top, rect.top);
+                    const auto right = std::min(roi.left + roi.width, rect.left + rect.width);
+                    const auto bottom = std::min(roi.top + roi.height, rect.top + rect.height);
+                    if(left >= right || top >= bottom) {
+                        warning("The region of interest is outside the rendered area of the new sensor, the full frame is rendered");
+                        action.roi.reset();
+                    } else
+                        roi = { left, top, right - left, bottom - top };
+                }
+            }
+            // the cached primary hits depend on the sensors, and the lights are shaded with them
+            mRelightCache.reset();
+        }
+
+        if(const auto ptr = job->tryGet("Integrator"sv))
+            loadIntegrator((*ptr)->as<Ref<ConfigNode>>());
+        if(const auto ptr = job->tryGet("LightSampler"sv)) {
+            mLightSampler = getStaticFactory().make<LightSampler>((*ptr)->as<Ref<ConfigNode>>());
+            mLightsDirty = true;
+        }
+
+        if(actions) {
+            mActions.clear();
+            mTileCost.clear();
+            mRelightCache.reset();
+            mTotalFrameCount = 0;
+            for(auto& action : (*actions)->as<ConfigAttr::AttrArray>())
+                addAction(action->as<Ref<ConfigNode>>());
+        }
+
+        mFrameCount = 0;
+        mPreparedFrame.reset();
+    }
 };
 
 PIPER_REGISTER_CLASS(Renderer, PipelineNode);
@@ -0,0 +1,66 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/StaticFactory.hpp>
+#include <Piper/Render/PipelineNode.hpp>
+#include <fstream>
+
+PIPER_NAMESPACE_BEGIN
+
+// Writes the stats of each frame as a JSON file (e.g., next to the images with the same path pattern), so that the render farm
+// tracks the performance of the frames. The per-run report is written by the CLI.
+class StatsOutput final : public PipelineNode {
+    std::pmr::string mOutputPath;
+
+public:
+    explicit StatsOutput(const Ref<ConfigNode>& node)
+        : mOutputPath{ node->get("OutputPath"sv)->as<std::string_view>(), context().globalAllocator } {}
+    ChannelRequirement setup(const ChannelRequirement req) override {
+        if(!req.empty())
+            fatal("StatsOutput is a sink node");
+        return ChannelRequirement{ context().globalAllocator };
+    }
+    [[nodiscard]] bool stateless() const noexcept override {
+        return true;
+    }
+
+    Ref<Frame> transform(const Ref<Frame> frame) override {
+        MemoryArena arena;
+        const auto& metadata = frame->metadata();
+
+        const auto frameIdx = std::to_string(metadata.frameIdx);
+        const auto actionIdx = std::to_string(metadata.actionIdx);
+        ResolveConfiguration pathResolver{ context().scopedAllocator };
+        pathResolver["${FrameIdx}"] = frameIdx;
+        pathResolver["${ActionIdx}"] = actionIdx;
+        const auto fileName = resolveString(mOutputPath, pathResolver);
+
+        std::ofstream out{ fileName.c_str() };
+        if(!out)
+            fatal(fmt::format("Failed to open stats file {}", fileName));
+        out << fmt::format(R"({{"ActionIdx":{},"FrameIdx":{},"Width":{},"Height":{},"Stats":{}}})", metadata.actionIdx, metadata.frameIdx,
+                           metadata.width, metadata.height, dumpFrameStats(metadata.stats));
+        return {};
+    }
+};
+
+PIPER_REGISTER_CLASS(StatsOutput, PipelineNode);
+
+PIPER_NAMESPACE_END
@@ -0,0 +1,193 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/FileIO.hpp>
+#include <Piper/Core/StaticFactory.hpp>
+#include <Piper/Render/PipelineNode.hpp>
+#include <Piper/Render/ToneMapping.hpp>
+#include <fstream>
+#include <oneapi/tbb/parallel_for.h>
+#include <sstream>
+
+PIPER_NAMESPACE_BEGIN
+
+// a 3D LUT in the Adobe/Resolve cube format, the red index varies fastest
+class LUT3D final {
+    uint32_t mSize = 0;
+    glm::vec3 mDomainMin{ 0.0f };
+    glm::vec3 mDomainMax{ 1.0f };
+    std::pmr::vector<glm::vec3> mTable{ context().globalAllocator };
+
+    [[nodiscard]] const glm::vec3& at(const uint32_t r, const uint32_t g, const uint32_t b) const noexcept {
+        return mTable[(static_cast<size_t>(b) * mSize + g) * mSize + r];
+    }
+
+public:
+    explicit LUT3D(const std::string_view path) {
+        std::ifstream in{ resolvePath(path) };
+        if(!in)
+            fatal(fmt::format("Failed to open LUT {}", path));
+
+        for(std::string line; std::getline(in, line);) {
+            if(const auto pos = line.find('#'); pos != std::string::npos)
+                line.resize(pos);
+            std::istringstream stream{ line };
+            std::string keyword;
+            if(!(stream >> keyword))
+                continue;
+            if(keyword == "LUT_3D_SIZE") {
+                stream >> mSize;
+                mTable.reserve(static_cast<size_t>(mSize) * mSize * mSize);
+            } else if(keyword == "DOMAIN_MIN")
+                stream >> mDomainMin.x >> mDomainMin.y >> mDomainMin.z;
+            else if(keyword == "DOMAIN_MAX")
+                stream >> mDomainMax.x >> mDomainMax.y >> mDomainMax.z;
+            else if(keyword == "LUT_1D_SIZE")
+                fatal(fmt::format("1D LUT {} is not supported", path));
+            else if(std::isdigit(static_cast<unsigned char>(keyword.front())) || keyword.front() == '-' || keyword.front() == '.') {
+                glm::vec3 value;
+                std::istringstream entry{ line };
+                if(!(entry >> value.x >> value.y >> value.z))
+                    fatal(fmt::format("Invalid LUT {}: {}", path, line));
+                mTable.push_back(value);
+            }
+            // the other keywords (e.g., TITLE) are ignored
+        }
+
+        if(mSize < 2 || mTable.size() != static_cast<size_t>(mSize) * mSize * mSize)
+            fatal(fmt::format("Invalid LUT {}: expect {}^3 entries but got {}", path, mSize, mTable.size()));
+    }
+
+    // trilinear interpolation, the input out of the domain is clamped
+    void apply(PixelBlock& block, const uint32_t count) const noexcept {
+        const auto scale = static_cast<Float>(mSize - 1) / (mDomainMax - mDomainMin);
+        const auto maxIdx = mSize - 2;
+        for(uint32_t idx = 0; idx < count; ++idx) {
+            const glm::vec3 value{ block.r[idx], block.g[idx], block.b[idx] };
+            const auto pos = glm::clamp((value - mDomainMin) * scale, 0.0f, static_cast<Float>(mSize - 1));
+            const auto base = glm::min(glm::uvec3{ pos }, glm::uvec3{ maxIdx });
+            const auto t = pos - glm::vec3{ base };
+
+            const auto lerpG = [&](const uint32_t b) {
+                const auto c0 = glm::mix(at(base.x, base.y, b), at(base.x + 1, base.y, b), t.x);
+                const auto c1 = glm::mix(at(base.x, base.y + 1, b), at(base.x + 1, base.y + 1, b), t.x);
+                return glm::mix(c0, c1, t.y);
+            };
+            const auto res = glm::mix(lerpG(base.z), lerpG(base.z + 1), t.z);
+            block.r[idx] = res.x;
+            block.g[idx] = res.y;
+            block.b[idx] = res.z;
+        }
+    }
+};
+
+// The color channel is mapped to the display range in place. The output is still linear (and marked as HDR), so the LDR output
+// with the curve "None" only applies the transfer function.
+class ToneMapping final : public PipelineNode {
+    ToneMappingOperator mOperator = ToneMappingOperator::ACES;
+    Float mExposure = 1.0f;
+    Float mWhitePoint = std::numeric_limits<Float>::infinity();  // for Reinhard, the plain one by default
+    std::optional<LUT3D> mLUT;                                    // the show LUT applied after the curve
+
+    void apply(PixelBlock& block, const uint32_t count) const noexcept {
+        if(mExposure != 1.0f)
+            applyPerChannel(block, count, [this](const Float x) { return x * mExposure; });
+        applyPerChannel(block, count, [](const Float x) { return std::fmax(x, 0.0f); });
+
+        applyToneCurve(block, count, mOperator, mWhitePoint);
+
+        if(mLUT)
+            mLUT->apply(block, count);
+    }
+
+public:
+    explicit ToneMapping(const Ref<ConfigNode>& node) {
+        if(const auto ptr = node->tryGet("Operator"sv))
+            mOperator = parseToneMappingOperator((*ptr)->as<std::string_view>());
+        // in stops
+        if(const auto ptr = node->tryGet("Exposure"sv))
+            mExposure = std::exp2((*ptr)->as<Float>());
+        if(const auto ptr = node->tryGet("WhitePoint"sv))
+            mWhitePoint = std::fmax((*ptr)->as<Float>(), epsilon);
+        if(const auto ptr = node->tryGet("LUT"sv))
+            mLUT.emplace((*ptr)->as<std::string_view>());
+    }
+    [[nodiscard]] bool stateless() const noexcept override {
+        return true;
+    }
+    // the color plane is read contiguously without touching the other channels
+    [[nodiscard]] std::optional<FrameLayout> layout() const noexcept override {
+        return FrameLayout::Planar;
+    }
+
+    ChannelRequirement setup(ChannelRequirement req) override {
+        if(!req.contains(Channel::Color))
+            req[Channel::Color] = false;
+        return req;
+    }
+
+    Ref<Frame> transform(Ref<Frame> frame) override {
+        if(!frame->metadata().isHDR) {
+            warning("The frame is already tone mapped. Skipped.");
+            return frame;
+        }
+
+        auto res = Frame::makeUnique(std::move(frame));
+        const auto& metadata = res->metadata();
+        const auto [offset, pixelStride, rowStride] = metadata.view(Channel::Color);
+        const auto base = reinterpret_cast<std::byte*>(res->mutableData().data()) + offset;
+        const auto mono = metadata.spectrumType == SpectrumType::Mono;
+
+        tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, metadata.height }, [&](const tbb::blocked_range<uint32_t>& range) {
+            PixelBlock block;
+            for(auto y = range.begin(); y != range.end(); ++y) {
+                const auto row = base + static_cast<size_t>(y) * rowStride;
+                for(uint32_t x = 0; x < metadata.width; x += pixelBlockSize) {
+                    const auto count = std::min(pixelBlockSize, metadata.width - x);
+                    const auto pixel = [&](const uint32_t idx) {
+                        return reinterpret_cast<Float*>(row + static_cast<size_t>(x + idx) * pixelStride);
+                    };
+
+                    for(uint32_t idx = 0; idx < count; ++idx) {
+                        const auto src = pixel(idx);
+                        block.r[idx] = src[0];
+                        block.g[idx] = mono ? src[0] : src[1];
+                        block.b[idx] = mono ? src[0] : src[2];
+                    }
+                    apply(block, count);
+                    for(uint32_t idx = 0; idx < count; ++idx) {
+                        const auto dst = pixel(idx);
+                        dst[0] = block.r[idx];
+                        if(!mono) {
+                            dst[1] = block.g[idx];
+                            dst[2] = block.b[idx];
+                        }
+                    }
+                }
+            }
+        });
+
+        return res;
+    }
+};
+
+PIPER_REGISTER_CLASS(ToneMapping, PipelineNode);
+
+PIPER_NAMESPACE_END
@@ -0,0 +1,310 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifdef PIPER_WITH_FFMPEG
+
+#include <Piper/Core/StaticFactory.hpp>
+#include <Piper/Core/Threading.hpp>
+#include <Piper/Render/PipelineNode.hpp>
+#include <map>
+#include <oneapi/tbb/parallel_for.h>
+#include <optional>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+
+PIPER_NAMESPACE_BEGIN
+
+static std::string avError(const int code) {
+    char buffer[AV_ERROR_MAX_STRING_SIZE];
+    av_strerror(code, buffer, sizeof(buffer));
+    return buffer;
+}
+
+static void checkAV(const int code, const std::string_view what) {
+    if(code < 0)
+        fatal(fmt::format("Failed to {}: {}", what, avError(code)));
+}
+
+struct VideoSettings final {
+    std::string codec = "libx264";
+    std::optional<AVPixelFormat> pixelFormat;  // the first format supported by the codec by default
+    AVRational frameRate{ 24, 1 };
+    int64_t bitRate = 0;  // 0 means the rate control of the codec (e.g., the CRF of x264)
+    std::string options;  // the private options of the codec, e.g., "preset=fast:crf=20"
+};
+
+// A single video file, the RGB frames are converted to the pixel format of the encoder by swscale.
+// NOTICE: the chroma subsampled formats require even sizes, so the last row/column of the odd frames is cropped.
+class VideoEncoder final {
+    AVFormatContext* mFormat = nullptr;
+    AVCodecContext* mCodec = nullptr;
+    AVStream* mStream = nullptr;
+    AVFrame* mFrame = nullptr;
+    AVPacket* mPacket = nullptr;
+    SwsContext* mScale = nullptr;
+    uint32_t mWidth, mHeight;
+    int64_t mPts = 0;
+
+    void drain(const AVFrame* frame) {
+        checkAV(avcodec_send_frame(mCodec, frame), "send the frame to the encoder");
+        while(true) {
+            const auto res = avcodec_receive_packet(mCodec, mPacket);
+            if(res == AVERROR(EAGAIN) || res == AVERROR_EOF)
+                return;
+            checkAV(res, "encode the frame");
+            av_packet_rescale_ts(mPacket, mCodec->time_base, mStream->time_base);
+            mPacket->stream_index = mStream->index;
+            // the packet is unreferenced by the muxer
+            checkAV(av_interleaved_write_frame(mFormat, mPacket), "write the packet");
+        }
+    }
+
+public:
+    VideoEncoder(const std::string& path, const uint32_t width, const uint32_t height, const VideoSettings& settings)
+        : mWidth{ width }, mHeight{ height } {
+        checkAV(avformat_alloc_output_context2(&mFormat, nullptr, nullptr, path.c_str()), "create the container of " + path);
+
+        const auto codec = avcodec_find_encoder_by_name(settings.codec.c_str());
+        if(!codec)
+            fatal(fmt::format("Unrecognized video encoder \"{}\"", settings.codec));
+        mStream = avformat_new_stream(mFormat, nullptr);
+        mCodec = avcodec_alloc_context3(codec);
+        if(!mStream || !mCodec)
+            fatal("Failed to allocate the video stream");
+
+        mCodec->width = static_cast<int32_t>(width & ~1U);
+        mCodec->height = static_cast<int32_t>(height & ~1U);
+        mCodec->framerate = settings.frameRate;
+        mCodec->time_base = av_inv_q(settings.frameRate);
+        mCodec->pix_fmt = settings.pixelFormat.value_or(codec->pix_fmts ? codec->pix_fmts[0] : AV_PIX_FMT_YUV420P);
+        mCodec->bit_rate = settings.bitRate;
+        // the software encoders share the thread budget of the renderer
+        mCodec->thread_count = static_cast<int32_t>(threadBudget());
+        if(mFormat->oformat->flags & AVFMT_GLOBALHEADER)
+            mCodec->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+        AVDictionary* options = nullptr;
+        if(!settings.options.empty())
+            checkAV(av_dict_parse_string(&options, settings.options.c_str(), "=", ":", 0), "parse the encoder options");
+        const auto res = avcodec_open2(mCodec, codec, &options);
+        av_dict_free(&options);
+        checkAV(res, fmt::format("open the video encoder \"{}\"", settings.codec));
+
+        checkAV(avcodec_parameters_from_context(mStream->codecpar, mCodec), "set the stream parameters");
+        mStream->time_base = mCodec->time_base;
+        if(!(mFormat->oformat->flags & AVFMT_NOFILE))
+            checkAV(avio_open(&mFormat->pb, path.c_str(), AVIO_FLAG_WRITE), "open " + path);
+        checkAV(avformat_write_header(mFormat, nullptr), "write the header of " + path);
+
+        mFrame = av_frame_alloc();
+        mPacket = av_packet_alloc();
+        if(!mFrame || !mPacket)
+            fatal("Failed to allocate the video frame");
+        mFrame->format = mCodec->pix_fmt;
+        mFrame->width = mCodec->width;
+        mFrame->height = mCodec->height;
+        checkAV(av_frame_get_buffer(mFrame, 0), "allocate the video frame");
+
+        mScale = sws_getContext(mCodec->width, mCodec->height, AV_PIX_FMT_RGB24, mCodec->width, mCodec->height, mCodec->pix_fmt,
+                                SWS_BICUBIC, nullptr, nullptr, nullptr);
+        if(!mScale)
+            fatal("Failed to create the pixel format converter");
+    }
+    VideoEncoder(const VideoEncoder&) = delete;
+    VideoEncoder& operator=(const VideoEncoder&) = delete;
+    ~VideoEncoder() {
+        // flush the delayed packets
+        drain(nullptr);
+        av_write_trailer(mFormat);
+        if(!(mFormat->oformat->flags & AVFMT_NOFILE))
+            avio_closep(&mFormat->pb);
+
+        sws_freeContext(mScale);
+        av_packet_free(&mPacket);
+        av_frame_free(&mFrame);
+        avcodec_free_context(&mCodec);
+        avformat_free_context(mFormat);
+    }
+
+    [[nodiscard]] bool compatible(const uint32_t width, const uint32_t height) const noexcept {
+        return mWidth == width && mHeight == height;
+    }
+
+    // rgb: 3 bytes per pixel, the rows are packed
+    void encode(const std::span<const uint8_t> rgb) {
+        checkAV(av_frame_make_writable(mFrame), "reuse the video frame");
+        const uint8_t* const src[] = { rgb.data() };
+        const int32_t srcStride[] = { static_cast<int32_t>(mWidth * 3) };
+        sws_scale(mScale, src, srcStride, 0, mCodec->height, mFrame->data, mFrame->linesize);
+        mFrame->pts = mPts++;
+        drain(mFrame);
+    }
+};
+
+// The frames are tone mapped by exposure and the transfer function, quantized and streamed into a video file per action, so that
+// the animation previews need neither intermediate images nor a second encoding pass. The filmic curves are applied by the
+// ToneMapping node before this one.
+// NOTICE: the frames completed out of order wait in a small reorder buffer. If the buffer is full, the missing frames are skipped.
+class VideoOutput final : public PipelineNode {
+    std::pmr::string mOutputPath;
+    VideoSettings mSettings;
+    Float mExposure = 1.0f;
+    bool mRec709 = true;  // the transfer function of HDTV, or sRGB otherwise
+    uint32_t mReorderCapacity = 8;
+
+    // (actionIdx, frameIdx) -> frame
+    std::map<std::pair<uint32_t, uint32_t>, Ref<Frame>> mPending;
+    std::optional<VideoEncoder> mEncoder;
+    std::pair<uint32_t, uint32_t> mNext{ 0, 0 };
+
+    [[nodiscard]] Float encodeTransfer(const Float x) const noexcept {
+        if(mRec709)
+            return x < 0.018f ? 4.5f * x : 1.099f * std::pow(x, 0.45f) - 0.099f;
+        return x <= 0.0031308f ? 12.92f * x : 1.055f * std::pow(x, 1.0f / 2.4f) - 0.055f;
+    }
+
+    void write(const Frame& frame) {
+        MemoryArena arena;
+        const auto& metadata = frame.metadata();
+        const auto key = std::make_pair(metadata.actionIdx, metadata.frameIdx);
+
+        // each action is an individual video
+        if(!mEncoder || key.first != mNext.first || !mEncoder->compatible(metadata.width, metadata.height)) {
+            if(mEncoder && key.first == mNext.first)
+                fatal("The frames of a video must have the same resolution");
+            mEncoder.reset();
+            ResolveConfiguration pathResolver{ context().scopedAllocator };
+            const auto actionIdx = std::to_string(key.first);
+            pathResolver["${ActionIdx}"] = actionIdx;
+            const auto path = resolveString(mOutputPath, pathResolver);
+            mEncoder.emplace(std::string{ path }, metadata.width, metadata.height, mSettings);
+            info(fmt::format("Encoding action {} to {}", key.first, path));
+        } else if(key.second != mNext.second)
+            warning(fmt::format("Frames [{}, {}) of action {} are missing in the video", mNext.second, key.second, key.first));
+        mNext = { key.first, key.second + 1 };
+
+        const auto mono = metadata.spectrumType == SpectrumType::Mono;
+        const auto [offset, pixelStride, rowStride] = metadata.view(Channel::Color);
+        const auto base = reinterpret_cast<const std::byte*>(frame.data().data());
+        const auto width = metadata.width;
+        const auto hdr = metadata.isHDR;
+
+        std::pmr::vector<uint8_t> image(static_cast<size_t>(width) * metadata.height * 3, context().scopedAllocator);
+        tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, metadata.height }, [&](const tbb::blocked_range<uint32_t>& range) {
+            for(auto y = range.begin(); y != range.end(); ++y) {
+                const auto row = base + offset + static_cast<size_t>(y) * rowStride;
+                const auto dst = image.data() + static_cast<size_t>(y) * width * 3;
+                for(uint32_t x = 0; x < width; ++x) {
+                    const auto src = reinterpret_cast<const Float*>(row + static_cast<size_t>(x) * pixelStride);
+                    for(uint32_t idx = 0; idx < 3; ++idx) {
+                        auto v = src[mono ? 0 : idx];
+                        if(hdr)
+                            v = encodeTransfer(std::fmax(v * mExposure, 0.0f));
+                        dst[x * 3 + idx] = static_cast<uint8_t>(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+                    }
+                }
+            }
+        });
+
+        mEncoder->encode(image);
+    }
+
+    // the frames are written in order, the gaps are only skipped when the buffer is full
+    void flush(const bool force) {
+        while(!mPending.empty()) {
+            const auto iter = mPending.begin();
+            const auto [actionIdx, frameIdx] = iter->first;
+            const auto successor = iter->first == mNext || (actionIdx > mNext.first && frameIdx == 0);
+            if(!successor && !force && mPending.size() <= mReorderCapacity)
+                return;
+            write(*iter->second);
+            mPending.erase(iter);
+        }
+    }
+
+public:
+    explicit VideoOutput(const Ref<ConfigNode>& node)
+        : mOutputPath{ node->get("OutputPath"sv)->as<std::string_view>(), context().globalAllocator } {
+        if(const auto ptr = node->tryGet("Codec"sv))
+            mSettings.codec = (*ptr)->as<std::string_view>();
+        if(const auto ptr = node->tryGet("PixelFormat"sv)) {
+            const auto name = std::string{ (*ptr)->as<std::string_view>() };
+            const auto format = av_get_pix_fmt(name.c_str());
+            if(format == AV_PIX_FMT_NONE)
+                fatal(fmt::format("Unrecognized pixel format \"{}\"", name));
+            mSettings.pixelFormat = format;
+        }
+        if(const auto ptr = node->tryGet("FPS"sv))
+            mSettings.frameRate = av_d2q((*ptr)->as<double>(), 100000);
+        // in Mbps
+        if(const auto ptr = node->tryGet("BitRate"sv))
+            mSettings.bitRate = static_cast<int64_t>((*ptr)->as<double>() * 1e6);
+        if(const auto ptr = node->tryGet("Options"sv))
+            mSettings.options = (*ptr)->as<std::string_view>();
+        // in stops
+        if(const auto ptr = node->tryGet("Exposure"sv))
+            mExposure = std::exp2((*ptr)->as<Float>());
+        if(const auto ptr = node->tryGet("TransferFunction"sv)) {
+            const auto name = (*ptr)->as<std::string_view>();
+            if(name != "Rec709"sv && name != "sRGB"sv)
+                fatal(fmt::format("Unrecognized transfer function \"{}\"", name));
+            mRec709 = name == "Rec709"sv;
+        }
+        if(const auto ptr = node->tryGet("ReorderBuffer"sv))
+            mReorderCapacity = (*ptr)->as<uint32_t>();
+    }
+
+    ChannelRequirement setup(const ChannelRequirement req) override {
+        if(!req.empty())
+            fatal("VideoOutput is a sink node");
+        return { { { Channel::Color, false } }, context().globalAllocator };
+    }
+
+    Ref<Frame> transform(const Ref<Frame> frame) override {
+        const auto& metadata = frame->metadata();
+        const auto key = std::make_pair(metadata.actionIdx, metadata.frameIdx);
+        if(key < mNext) {
+            warning(fmt::format("Frame {} of action {} arrives too late for the video", key.second, key.first));
+            return {};
+        }
+
+        mPending.emplace(key, frame);
+        flush(false);
+        return {};
+    }
+
+    // the source may be executed again from the first frame (e.g., by a job in server mode)
+    void finish() override {
+        flush(true);
+        mEncoder.reset();
+        mNext = { 0, 0 };
+    }
+};
+
+PIPER_REGISTER_CLASS(VideoOutput, PipelineNode);
+
+PIPER_NAMESPACE_END
+
+#endif
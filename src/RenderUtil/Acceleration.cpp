@@ -0,0 +1,117 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/ConfigNode.hpp>
+#include <Piper/Core/Context.hpp>
+#include <Piper/Core/Report.hpp>
+#include <Piper/Render/Acceleration.hpp>
+#include <algorithm>
+#include <magic_enum.hpp>
+#include <ranges>
+
+PIPER_NAMESPACE_BEGIN
+
+std::string BuildSettings::key() const {
+    return fmt::format("{}{}{}{}", magic_enum::enum_name(quality), compact ? "|Compact" : "", robust ? "|Robust" : "",
+                       refit ? "|Refit" : "");
+}
+
+BuildSettings parseBuildSettings(const Ref<ConfigNode>& node, BuildSettings settings) {
+    if(const auto ptr = node->tryGet("Quality"sv)) {
+        const auto quality = (*ptr)->as<std::string_view>();
+        if(const auto value = magic_enum::enum_cast<BuildQuality>(quality))
+            settings.quality = *value;
+        else
+            fatal(fmt::format("Unrecognized build quality {}", quality));
+    }
+    if(const auto ptr = node->tryGet("Compact"sv))
+        settings.compact = (*ptr)->as<bool>();
+    if(const auto ptr = node->tryGet("Robust"sv))
+        settings.robust = (*ptr)->as<bool>();
+    if(const auto ptr = node->tryGet("Refit"sv))
+        settings.refit = (*ptr)->as<bool>();
+    return settings;
+}
+
+static uint32_t expandBits(uint32_t x) noexcept {
+    x = (x | (x << 16)) & 0x030000ffU;
+    x = (x | (x << 8)) & 0x0300f00fU;
+    x = (x | (x << 4)) & 0x030c30c3U;
+    return (x | (x << 2)) & 0x09249249U;
+}
+
+std::pmr::vector<Intersection> traceReordered(const Acceleration& acceleration, const RayStream& rayStream) {
+    // the sorting does not pay off for the tiny streams
+    constexpr size_t minStreamSize = 64;
+    if(rayStream.size() < minStreamSize)
+        return acceleration.trace(rayStream);
+
+    auto lower = glm::vec3{ infinity }, upper = glm::vec3{ -infinity };
+    for(const auto& ray : rayStream) {
+        lower = glm::min(lower, ray.origin.raw());
+        upper = glm::max(upper, ray.origin.raw());
+    }
+    const auto scale = 1023.0f / glm::max(upper - lower, glm::vec3{ 1e-6f });
+
+    // the direction octant is the most significant part of the key, so that the rays of a bin go through the same BVH children
+    // the 3 bits of the octant and the 30 bits of the Morton code do not fit in 32 bits
+    std::pmr::vector<std::pair<uint64_t, uint32_t>> order{ rayStream.size(), context().scopedAllocator };
+    for(uint32_t idx = 0; idx < rayStream.size(); ++idx) {
+        const auto& ray = rayStream[idx];
+        const auto cell = glm::uvec3{ glm::clamp((ray.origin.raw() - lower) * scale, 0.0f, 1023.0f) };
+        const auto dir = ray.direction.raw();
+        const auto octant = (dir.x < 0.0f ? 4U : 0U) | (dir.y < 0.0f ? 2U : 0U) | (dir.z < 0.0f ? 1U : 0U);
+        const auto morton = expandBits(cell.x) << 2 | expandBits(cell.y) << 1 | expandBits(cell.z);
+        order[idx] = { static_cast<uint64_t>(octant) << 30 | morton, idx };
+    }
+    std::sort(order.begin(), order.end());
+
+    RayStream sorted{ context().scopedAllocator };
+    sorted.reserve(rayStream.size());
+    for(const auto idx : order | std::views::values)
+        sorted.push_back(rayStream[idx]);
+    const auto sortedHits = acceleration.traceHits(sorted, true);
+
+    // only the compact records are scattered back, the surface hits are reconstructed in the original order
+    std::pmr::vector<HitRecord> hits{ rayStream.size(), context().scopedAllocator };
+    for(uint32_t k = 0; k < order.size(); ++k)
+        hits[order[k].second] = sortedHits[k];
+    return acceleration.resolve(rayStream, hits);
+}
+
+Intersection passInterfaces(const Acceleration& acceleration, const Ray& ray, Intersection intersection) {
+    auto continued = ray;
+    auto travelled = 0.0f;
+    while(true) {
+        const auto hit = std::get_if<SurfaceHit>(&intersection);
+        if(!hit)
+            return intersection;
+        if(hit->surface.get()) {
+            hit->distance = Distance::fromRaw(hit->distance.raw() + travelled);
+            return intersection;
+        }
+
+        travelled += hit->distance.raw();
+        hit->continueRay(continued, hit->offsetOrigin(false));
+        intersection = acceleration.trace(continued);
+    }
+}
+
+PIPER_NAMESPACE_END
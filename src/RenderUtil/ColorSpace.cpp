@@ -22,42 +22,79 @@
 #include <Piper/Render/ColorSpace.hpp>
 #include <Piper/Render/Spectrum.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <optional>
 #include <tbb/concurrent_unordered_map.h>
+#include <tbb/parallel_for.h>
 
 namespace color = OCIO_NAMESPACE;
 
 PIPER_NAMESPACE_BEGIN
 
+// the optimized transform is collapsed into an affine RGB transform if it only consists of matrices
+static std::optional<std::pair<glm::mat3, glm::vec3>> extractMatrix(const color::ConstProcessorRcPtr& processor) {
+    const auto group = processor->getOptimizedProcessor(color::OPTIMIZATION_VERY_GOOD)->createGroupTransform();
+
+    glm::dmat3 mat{ 1.0 };
+    glm::dvec3 offset{ 0.0 };
+    for(int idx = 0; idx < group->getNumTransforms(); ++idx) {
+        const auto transform = std::dynamic_pointer_cast<const color::MatrixTransform>(group->getTransform(idx));
+        if(!transform || transform->getDirection() != color::TRANSFORM_DIR_FORWARD)
+            return std::nullopt;
+
+        double m44[16], offset4[4];
+        transform->getMatrix(m44);
+        transform->getOffset(offset4);
+        // the alpha channel must not be mixed into RGB
+        if(m44[3] != 0.0 || m44[7] != 0.0 || m44[11] != 0.0)
+            return std::nullopt;
+
+        // NOTICE: OCIO matrices are row-major
+        glm::dmat3 step;
+        for(int32_t row = 0; row < 3; ++row)
+            for(int32_t col = 0; col < 3; ++col)
+                step[col][row] = m44[row * 4 + col];
+
+        mat = step * mat;
+        offset = step * offset + glm::dvec3{ offset4[0], offset4[1], offset4[2] };
+    }
+    return std::make_pair(glm::mat3{ mat }, glm::vec3{ offset });
+}
+
 struct ProcessorPack final {
     color::ConstProcessorRcPtr processor;
     color::ConstCPUProcessorRcPtr cpuFloatProcessor;
+    std::optional<std::pair<glm::mat3, glm::vec3>> matrix;
 
     explicit ProcessorPack(color::ConstProcessorRcPtr ptr)
         : processor{ std::move(ptr) }, cpuFloatProcessor{ processor->getOptimizedCPUProcessor(color::BIT_DEPTH_F32, color::BIT_DEPTH_F32,
-                                                                                              color::OPTIMIZATION_VERY_GOOD) } {}
+                                                                                              color::OPTIMIZATION_VERY_GOOD) },
+          matrix{ extractMatrix(processor) } {}
 };
 
 class ColorSpaceConvertContext final {
     color::ConstConfigRcPtr mConfig;
-    tbb::concurrent_unordered_map<std::string_view, ProcessorPack> mToStandardLinearRGB;
-    tbb::concurrent_unordered_map<std::string_view, ProcessorPack> mToRGB;
+    // NOTICE: the keys are owned by the map, since the names passed in may be released after the lookup
+    tbb::concurrent_unordered_map<std::string, ProcessorPack> mToStandardLinearRGB;
+    tbb::concurrent_unordered_map<std::string, ProcessorPack> mToRGB;
 
 public:
     ColorSpaceConvertContext() : mConfig{ color::GetCurrentConfig() } {}
     const ProcessorPack& getRGB2StandardLinearRGB(std::string_view colorSpace) {
-        auto iter = mToStandardLinearRGB.find(colorSpace);
+        std::string key{ colorSpace };
+        auto iter = mToStandardLinearRGB.find(key);
         if(iter == mToStandardLinearRGB.cend()) {
-            iter =
-                mToStandardLinearRGB.emplace(colorSpace, ProcessorPack{ mConfig->getProcessor(colorSpace.data(), nameOfStandardLinearRGB) })
-                    .first;
+            auto processor = mConfig->getProcessor(key.c_str(), nameOfStandardLinearRGB);
+            iter = mToStandardLinearRGB.emplace(std::move(key), ProcessorPack{ std::move(processor) }).first;
         }
         return iter->second;
     }
 
     const ProcessorPack& getStandardLinearRGB2RGB(std::string_view colorSpace) {
-        auto iter = mToRGB.find(colorSpace);
+        std::string key{ colorSpace };
+        auto iter = mToRGB.find(key);
         if(iter == mToRGB.cend()) {
-            iter = mToRGB.emplace(colorSpace, ProcessorPack{ mConfig->getProcessor(nameOfStandardLinearRGB, colorSpace.data()) }).first;
+            auto processor = mConfig->getProcessor(nameOfStandardLinearRGB, key.c_str());
+            iter = mToRGB.emplace(std::move(key), ProcessorPack{ std::move(processor) }).first;
         }
         return iter->second;
     }
@@ -68,18 +105,61 @@ static ColorSpaceConvertContext& colorContext() {
     return ctx;
 }
 
-glm::vec3 convertRGB2StandardLinearRGB(const glm::vec3& valueRGB, const std::string_view colorSpace) {
-    glm::vec3 res = valueRGB;
-    const auto& processor = colorContext().getRGB2StandardLinearRGB(colorSpace);
-    processor.cpuFloatProcessor->applyRGB(glm::value_ptr(res));
+glm::vec3 ColorSpaceConverter::operator()(const glm::vec3& value) const {
+    if(mPack->matrix)
+        return mPack->matrix->first * value + mPack->matrix->second;
+
+    glm::vec3 res = value;
+    mPack->cpuFloatProcessor->applyRGB(glm::value_ptr(res));
     return res;
 }
 
+void ColorSpaceConverter::apply(float* pixels, const size_t pixelCount, const size_t pixelStride) const {
+    // the large images are split into chunks converted in parallel
+    constexpr size_t chunkSize = 1 << 14;
+    tbb::parallel_for(tbb::blocked_range<size_t>{ 0, pixelCount, chunkSize }, [&](const tbb::blocked_range<size_t>& range) {
+        const auto base = pixels + range.begin() * pixelStride;
+        const auto count = range.size();
+
+        if(mPack->matrix) {
+            const auto& [mat, offset] = *mPack->matrix;
+            for(size_t idx = 0; idx < count; ++idx) {
+                const auto ptr = base + idx * pixelStride;
+                const auto res = mat * glm::vec3{ ptr[0], ptr[1], ptr[2] } + offset;
+                ptr[0] = res.x;
+                ptr[1] = res.y;
+                ptr[2] = res.z;
+            }
+            return;
+        }
+
+        const auto xStride = static_cast<ptrdiff_t>(pixelStride * sizeof(float));
+        color::PackedImageDesc desc{ base,
+                                     static_cast<long>(count),
+                                     1,
+                                     color::CHANNEL_ORDERING_RGB,
+                                     color::BIT_DEPTH_F32,
+                                     static_cast<ptrdiff_t>(sizeof(float)),
+                                     xStride,
+                                     xStride * static_cast<ptrdiff_t>(count) };
+        mPack->cpuFloatProcessor->apply(desc);
+    });
+}
+
+ColorSpaceConverter getRGB2StandardLinearRGBConverter(const std::string_view colorSpace) {
+    return ColorSpaceConverter{ colorContext().getRGB2StandardLinearRGB(colorSpace) };
+}
+
+ColorSpaceConverter getStandardLinearRGB2RGBConverter(const std::string_view colorSpace) {
+    return ColorSpaceConverter{ colorContext().getStandardLinearRGB2RGB(colorSpace) };
+}
+
+glm::vec3 convertRGB2StandardLinearRGB(const glm::vec3& valueRGB, const std::string_view colorSpace) {
+    return getRGB2StandardLinearRGBConverter(colorSpace)(valueRGB);
+}
+
 glm::vec3 convertStandardLinearRGB2RGB(const glm::vec3& valueStandardLinearRGB, const std::string_view colorSpace) {
-    glm::vec3 res = valueStandardLinearRGB;
-    const auto& processor = colorContext().getStandardLinearRGB2RGB(colorSpace);
-    processor.cpuFloatProcessor->applyRGB(glm::value_ptr(res));
-    return res;
+    return getStandardLinearRGB2RGBConverter(colorSpace)(valueStandardLinearRGB);
 }
 
 PIPER_NAMESPACE_END
@@ -0,0 +1,239 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/Report.hpp>
+#include <Piper/Render/Distributed.hpp>
+
+#ifdef PIPER_WINDOWS
+// ReSharper disable once CppUnusedIncludeDirective
+#include <sdkddkver.h>
+#endif
+
+#include <algorithm>
+#include <boost/asio.hpp>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+PIPER_NAMESPACE_BEGIN
+
+enum class MessageType : uint32_t { Request, Assign, Finish, Result };
+
+struct MessageHeader final {
+    uint32_t magic;
+    MessageType type;
+    uint32_t frameIdx;
+    uint32_t sampleBegin;
+    uint32_t sampleEnd;
+    uint32_t reserved;
+    uint64_t payloadSize;  // in bytes
+};
+
+static_assert(std::is_trivially_copyable_v<MessageHeader>);
+
+static constexpr uint32_t messageMagic = 0x52504950;  // "PIPR"
+
+using boost::asio::ip::tcp;
+
+static void sendMessage(tcp::socket& socket, const MessageType type, const uint32_t frameIdx, const uint32_t sampleBegin = 0,
+                        const uint32_t sampleEnd = 0, const std::span<const Float> payload = {}) {
+    const MessageHeader header{ messageMagic, type, frameIdx, sampleBegin, sampleEnd, 0, payload.size_bytes() };
+    boost::asio::write(socket, boost::asio::buffer(&header, sizeof(header)));
+    if(!payload.empty())
+        boost::asio::write(socket, boost::asio::buffer(payload.data(), payload.size_bytes()));
+}
+
+static MessageHeader receiveHeader(tcp::socket& socket, const MessageType expected, const uint32_t frameIdx) {
+    MessageHeader header{};
+    boost::asio::read(socket, boost::asio::buffer(&header, sizeof(header)));
+    if(header.magic != messageMagic)
+        throw std::runtime_error{ "Invalid message" };
+    if(header.frameIdx != frameIdx)
+        throw std::runtime_error{ fmt::format("Frame mismatch (expect {}, but got {})", frameIdx, header.frameIdx) };
+    if(header.type != expected && !(expected == MessageType::Assign && header.type == MessageType::Finish))
+        throw std::runtime_error{ "Unexpected message type" };
+    return header;
+}
+
+class DistributedCoordinatorImpl final : public DistributedCoordinator {
+    boost::asio::io_context mCtx;
+    std::pmr::vector<tcp::socket> mWorkers{ context().globalAllocator };
+
+public:
+    DistributedCoordinatorImpl(const uint16_t port, const uint32_t workerCount) {
+        tcp::acceptor acceptor{ mCtx, tcp::endpoint{ tcp::v4(), port } };
+        info(fmt::format("Waiting for {} workers on port {}", workerCount, port));
+
+        mWorkers.reserve(workerCount);
+        for(uint32_t idx = 0; idx < workerCount; ++idx) {
+            mWorkers.push_back(acceptor.accept());
+            info(fmt::format("Worker {} connected from {}", idx, mWorkers.back().remote_endpoint().address().to_string()));
+        }
+    }
+
+    void render(const uint32_t frameIdx, const uint32_t sampleCount, const uint32_t chunkSize, const bool ordered,
+                const std::span<Float> film) override {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<std::pair<uint32_t, uint32_t>> chunks;
+        uint32_t inFlight = 0;
+        // the early results in the ordered mode, keyed by the first sample of the chunk
+        // NOTICE: each result is a full film, so the workers stop taking new chunks while there are too many of them
+        std::map<uint32_t, std::pair<uint32_t, std::pmr::vector<Float>>> pending;
+        uint32_t mergedEnd = 0;
+        const auto maxPending = mWorkers.size();
+
+        for(uint32_t begin = 0; begin < sampleCount; begin += chunkSize)
+            chunks.emplace_back(begin, std::min(begin + chunkSize, sampleCount));
+
+        std::pmr::vector<bool> alive(mWorkers.size(), true, context().globalAllocator);
+
+        // the workers are bounded by the network, so they are served by dedicated threads instead of the TBB workers
+        const auto serve = [&](const size_t workerIdx) {
+            auto& socket = mWorkers[workerIdx];
+            std::pmr::vector<Float> buffer{ film.size(), context().globalAllocator };
+            std::optional<std::pair<uint32_t, uint32_t>> chunk;
+
+            try {
+                while(true) {
+                    receiveHeader(socket, MessageType::Request, frameIdx);
+
+                    {
+                        std::unique_lock guard{ mutex };
+                        // the chunks of the failed workers are reassigned, so wait until all chunks are finished
+                        // the queue is sorted, so the chunk which unblocks the ordered merge is always available
+                        cv.wait(guard, [&] {
+                            if(chunks.empty())
+                                return inFlight == 0;
+                            return !ordered || pending.size() < maxPending || chunks.front().first == mergedEnd;
+                        });
+                        if(chunks.empty())
+                            break;
+                        chunk = chunks.front();
+                        chunks.pop_front();
+                        ++inFlight;
+                    }
+
+                    sendMessage(socket, MessageType::Assign, frameIdx, chunk->first, chunk->second);
+
+                    const auto header = receiveHeader(socket, MessageType::Result, frameIdx);
+                    if(header.sampleBegin != chunk->first || header.sampleEnd != chunk->second || header.payloadSize != film.size_bytes())
+                        throw std::runtime_error{ "Mismatched result" };
+                    boost::asio::read(socket, boost::asio::buffer(buffer.data(), film.size_bytes()));
+
+                    {
+                        std::lock_guard guard{ mutex };
+                        if(ordered) {
+                            pending.emplace(chunk->first,
+                                            std::make_pair(chunk->second, std::pmr::vector<Float>{ buffer, context().globalAllocator }));
+                            for(auto iter = pending.begin(); iter != pending.end() && iter->first == mergedEnd;) {
+                                const auto& result = iter->second.second;
+                                for(size_t idx = 0; idx < film.size(); ++idx)
+                                    film[idx] += result[idx];
+                                mergedEnd = iter->second.first;
+                                iter = pending.erase(iter);
+                            }
+                        } else {
+                            for(size_t idx = 0; idx < film.size(); ++idx)
+                                film[idx] += buffer[idx];
+                        }
+                        chunk.reset();
+                        --inFlight;
+                    }
+                    cv.notify_all();
+                }
+
+                sendMessage(socket, MessageType::Finish, frameIdx);
+            } catch(const std::exception& ex) {
+                warning(fmt::format("Worker {} failed: {}", workerIdx, ex.what()));
+
+                {
+                    std::lock_guard guard{ mutex };
+                    alive[workerIdx] = false;
+                    if(chunk) {
+                        chunks.insert(std::upper_bound(chunks.begin(), chunks.end(), *chunk), *chunk);
+                        --inFlight;
+                    }
+                }
+                cv.notify_all();
+            }
+        };
+
+        {
+            std::pmr::vector<std::thread> threads{ context().globalAllocator };
+            threads.reserve(mWorkers.size());
+            for(size_t idx = 0; idx < mWorkers.size(); ++idx)
+                threads.emplace_back(serve, idx);
+            for(auto& thread : threads)
+                thread.join();
+        }
+
+        std::pmr::vector<tcp::socket> workers{ context().globalAllocator };
+        for(size_t idx = 0; idx < mWorkers.size(); ++idx)
+            if(alive[idx])
+                workers.push_back(std::move(mWorkers[idx]));
+        mWorkers = std::move(workers);
+
+        if(!chunks.empty())
+            fatal(fmt::format("All workers failed while rendering frame {}", frameIdx));
+    }
+};
+
+class DistributedWorkerImpl final : public DistributedWorker {
+    boost::asio::io_context mCtx;
+    tcp::socket mSocket{ mCtx };
+
+public:
+    explicit DistributedWorkerImpl(const std::string_view coordinator) {
+        tcp::resolver resolver{ mCtx };
+        const auto pos = coordinator.find(':');
+        const auto endpoint = resolver.resolve(coordinator.substr(0, pos), coordinator.substr(pos + 1));
+        boost::system::error_code ec;
+        boost::asio::connect(mSocket, endpoint, ec);
+        if(ec.failed())
+            fatal(fmt::format("Failed to connect with the coordinator({}). {}.", coordinator, ec.message()));
+        info(fmt::format("Successfully connected with the coordinator({}).", coordinator));
+    }
+
+    std::optional<std::pair<uint32_t, uint32_t>> acquire(const uint32_t frameIdx) override {
+        sendMessage(mSocket, MessageType::Request, frameIdx);
+        const auto header = receiveHeader(mSocket, MessageType::Assign, frameIdx);
+        if(header.type == MessageType::Finish)
+            return std::nullopt;
+        return std::make_pair(header.sampleBegin, header.sampleEnd);
+    }
+
+    void submit(const uint32_t frameIdx, const uint32_t sampleBegin, const uint32_t sampleEnd, const std::span<const Float> film) override {
+        sendMessage(mSocket, MessageType::Result, frameIdx, sampleBegin, sampleEnd, film);
+    }
+};
+
+Ref<DistributedCoordinator> createDistributedCoordinator(const uint16_t port, const uint32_t workerCount) {
+    return makeRefCount<DistributedCoordinatorImpl>(port, workerCount);
+}
+
+Ref<DistributedWorker> createDistributedWorker(const std::string_view coordinator) {
+    return makeRefCount<DistributedWorkerImpl>(coordinator);
+}
+
+PIPER_NAMESPACE_END
@@ -0,0 +1,55 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Render/Distribution.hpp>
+#include <tbb/parallel_for.h>
+
+PIPER_NAMESPACE_BEGIN
+
+PiecewiseConstant2D::PiecewiseConstant2D(std::pmr::vector<Float> function, const uint32_t width, const uint32_t height)
+    : mWidth{ width }, mHeight{ height }, mFunction{ std::move(function) } {
+    mConditional.resize(static_cast<size_t>(height) * (width + 1));
+    mMarginal.resize(height + 1);
+    std::pmr::vector<Float> rowIntegral{ height, context().scopedAllocator };
+
+    tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, height }, [&](const tbb::blocked_range<uint32_t>& range) {
+        for(auto y = range.begin(); y != range.end(); ++y) {
+            const auto func = mFunction.data() + static_cast<size_t>(y) * width;
+            const auto cdf = mConditional.data() + static_cast<size_t>(y) * (width + 1);
+            cdf[0] = 0.0f;
+            for(uint32_t x = 0; x < width; ++x)
+                cdf[x + 1] = cdf[x] + func[x];
+            const auto sum = cdf[width];
+            for(uint32_t x = 1; x <= width; ++x)
+                cdf[x] = sum > 0.0f ? cdf[x] / sum : static_cast<Float>(x) / static_cast<Float>(width);
+            rowIntegral[y] = sum / static_cast<Float>(width);
+        }
+    });
+
+    mMarginal[0] = 0.0f;
+    for(uint32_t y = 0; y < height; ++y)
+        mMarginal[y + 1] = mMarginal[y] + rowIntegral[y];
+    const auto sum = mMarginal[height];
+    for(uint32_t y = 1; y <= height; ++y)
+        mMarginal[y] = sum > 0.0f ? mMarginal[y] / sum : static_cast<Float>(y) / static_cast<Float>(height);
+    mIntegral = sum / static_cast<Float>(height);
+}
+
+PIPER_NAMESPACE_END
@@ -25,29 +25,88 @@
 
 PIPER_NAMESPACE_BEGIN
 
-ShutterKeyFrames generateTransform(const KeyFrames& keyFrames, const TimeInterval interval, const uint32_t maxCount) {
+// the transform at t, the first and the last segments are extrapolated
+static SRTTransform sampleTransform(const KeyFrames& keyFrames, const Float t) {
     constexpr auto cmp = [](const Float x, const KeyFrame& y) { return x < y.t; };
 
-    auto next = std::upper_bound(keyFrames.cbegin(), keyFrames.cend(), interval.begin, cmp);
+    if(keyFrames.size() == 1)
+        return keyFrames.front().transform;
+    auto next = std::upper_bound(keyFrames.cbegin(), keyFrames.cend(), t, cmp);
     if(next == keyFrames.cbegin())
         next = std::next(next);
+    else if(next == keyFrames.cend())
+        next = std::prev(next);
     const auto base = std::prev(next);
 
-    std::pmr::vector<SRTTransform> res;
-    const auto sample = [&](const Float t) {
-        switch(base->curve) {
-            case InterpolationCurve::Linear:
-                return lerp(base->transform, next->transform, (t - base->t) / (next->t - base->t));
-            default:
-                return base->transform;
-        }
-    };
-
     switch(base->curve) {
         case InterpolationCurve::Linear:
-            return { { sample(interval.begin), sample(interval.end) }, context().globalAllocator };
+            return lerp(base->transform, next->transform, (t - base->t) / (next->t - base->t));
         default:
-            return { { base->transform }, context().globalAllocator };
+            return base->transform;
+    }
+}
+
+// the translation/scale error in the object units and the rotation error in radians
+static Float transformError(const SRTTransform& lhs, const SRTTransform& rhs) noexcept {
+    const auto angle = 2.0f * std::acos(std::fmin(1.0f, std::fabs(glm::dot(lhs.rotation, rhs.rotation))));
+    const auto scale = glm::abs(lhs.scale - rhs.scale);
+    return std::fmax(std::fmax(glm::distance(lhs.translation, rhs.translation), angle), std::fmax(std::fmax(scale.x, scale.y), scale.z));
+}
+
+// The backend interpolates the uniform time steps with lerp/slerp like the keyframes, so a single linear segment is exact with two
+// steps. The shutters crossing keyframes are refined by doubling the step count until the interpolation error at the midpoints and
+// the crossed keyframes is within the precision of the keyframes.
+ShutterKeyFrames generateTransform(const KeyFrames& keyFrames, const TimeInterval interval, const uint32_t maxCount) {
+    constexpr auto cmp = [](const Float x, const KeyFrame& y) { return x < y.t; };
+    constexpr auto defaultPrecision = 1e-3f;
+
+    const auto first = std::upper_bound(keyFrames.cbegin(), keyFrames.cend(), interval.begin, cmp);
+    const auto last = std::lower_bound(first, keyFrames.cend(), interval.end, [](const KeyFrame& x, const Float y) { return x.t < y; });
+    // the keyframes of the segments overlapping the shutter
+    const auto lower = first == keyFrames.cbegin() ? first : std::prev(first);
+    const auto upper = last == keyFrames.cend() ? last : std::next(last);
+    auto precision = std::numeric_limits<Float>::max();
+    for(auto iter = lower; iter != upper; ++iter)
+        precision = std::fmin(precision, iter->precision > 0.0f ? iter->precision : defaultPrecision);
+
+    const auto begin = sampleTransform(keyFrames, interval.begin);
+    const auto end = sampleTransform(keyFrames, interval.end);
+    const auto duration = interval.end - interval.begin;
+
+    // static intervals collapse to a single step
+    auto moving = duration > 0.0f && transformError(begin, end) > 0.0f;
+    for(auto iter = first; !moving && iter != last; ++iter)
+        moving = transformError(begin, iter->transform) > 0.0f;
+    if(!moving)
+        return { { begin }, context().globalAllocator };
+
+    ShutterKeyFrames res{ context().globalAllocator };
+    const auto maxSteps = std::max(maxCount, 2U);
+    for(uint32_t count = 2;; count = (count - 1) * 2 + 1) {
+        count = std::min(count, maxSteps);
+
+        res.clear();
+        for(uint32_t idx = 0; idx < count; ++idx)
+            res.push_back(idx + 1 == count ? end :
+                                             sampleTransform(keyFrames, interval.begin + duration * static_cast<Float>(idx) /
+                                                                 static_cast<Float>(count - 1)));
+        if(count == maxSteps)
+            return res;
+
+        const auto step = duration / static_cast<Float>(count - 1);
+        const auto error = [&](const Float t) {
+            const auto u = std::clamp((t - interval.begin) / step, 0.0f, static_cast<Float>(count - 1));
+            const auto idx = std::min(static_cast<uint32_t>(u), count - 2);
+            return transformError(lerp(res[idx], res[idx + 1], u - static_cast<Float>(idx)), sampleTransform(keyFrames, t));
+        };
+
+        auto accurate = true;
+        for(uint32_t idx = 0; accurate && idx + 1 < count; ++idx)
+            accurate = error(interval.begin + step * (static_cast<Float>(idx) + 0.5f)) <= precision;
+        for(auto iter = first; accurate && iter != last; ++iter)
+            accurate = error(iter->t) <= precision;
+        if(accurate)
+            return res;
     }
 }
 
@@ -109,6 +168,15 @@ ResolvedTransform resolveTransform(const KeyFrames& keyFrames, const TimeInterva
     }
 }
 
+bool ResolvedTransform::operator==(const ResolvedTransform& rhs) const noexcept {
+    constexpr auto equal = [](const SRTTransform& lhs, const SRTTransform& rhs) {
+        return lhs.scale == rhs.scale && lhs.rotation == rhs.rotation && lhs.translation == rhs.translation;
+    };
+    // transformEnd is unused by the hold curve
+    return curve == rhs.curve && equal(transformBegin, rhs.transformBegin) &&
+        (curve == InterpolationCurve::Hold || equal(transformEnd, rhs.transformEnd));
+}
+
 SRTTransform ResolvedTransform::operator()(const Float t) const noexcept {
     switch(curve) {
         case InterpolationCurve::Linear:
@@ -0,0 +1,45 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Render/MajorantGrid.hpp>
+#include <tbb/parallel_for.h>
+
+PIPER_NAMESPACE_BEGIN
+
+void MajorantGrid::build(const glm::vec3& lower, const glm::vec3& upper, const glm::ivec3& resolution,
+                         const std::function<Float(const glm::vec3&, const glm::vec3&)>& maxDensity) {
+    mLower = lower;
+    mUpper = upper;
+    mResolution = glm::max(resolution, glm::ivec3{ 1 });
+    mMajorants.resize(static_cast<size_t>(mResolution.x) * mResolution.y * mResolution.z);
+
+    const auto cellSize = (mUpper - mLower) / glm::vec3{ mResolution };
+    tbb::parallel_for(tbb::blocked_range<int32_t>{ 0, mResolution.z }, [&](const tbb::blocked_range<int32_t>& range) {
+        for(auto z = range.begin(); z != range.end(); ++z)
+            for(int32_t y = 0; y < mResolution.y; ++y)
+                for(int32_t x = 0; x < mResolution.x; ++x) {
+                    const auto cellLower = mLower + glm::vec3{ x, y, z } * cellSize;
+                    mMajorants[(static_cast<size_t>(z) * mResolution.y + y) * mResolution.x + x] =
+                        maxDensity(cellLower, cellLower + cellSize);
+                }
+    });
+}
+
+PIPER_NAMESPACE_END
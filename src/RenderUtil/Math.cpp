@@ -21,6 +21,7 @@
 #include <Piper/Core/ConfigNode.hpp>
 #include <Piper/Core/Report.hpp>
 #include <Piper/Render/Math.hpp>
+#include <array>
 #include <glm/gtc/quaternion.hpp>
 #include <pmmintrin.h>
 #include <xmmintrin.h>
@@ -54,27 +55,84 @@ void initFloatingPointEnvironment() noexcept {
     _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
 }
 
-glm::vec2 parseVec2(const Ref<ConfigAttr>& node) {
+// the typed arrays are copied directly, the arrays built by the converters are still converted element by element
+// returns false if the size does not match
+static bool copyFloats(const Ref<ConfigAttr>& node, const size_t size, Float* output) {
+    if(const auto arr = node->numericArray<float>()) {
+        if(arr->values.size() != size)
+            return false;
+        std::ranges::copy(arr->values, output);
+        return true;
+    }
+    if(const auto arr = node->numericArray<uint32_t>()) {
+        if(arr->values.size() != size)
+            return false;
+        std::ranges::transform(arr->values, output, [](const uint32_t x) { return static_cast<Float>(x); });
+        return true;
+    }
+
+    // the nested arrays are flattened
     const auto& arr = node->as<ConfigAttr::AttrArray>();
-    if(arr.size() != 2)
-        fatal("Bad vector2");
+    if(arr.empty() || !arr.front()->isArray()) {
+        if(arr.size() != size)
+            return false;
+        std::ranges::transform(arr, output, [](const Ref<ConfigAttr>& item) { return item->as<Float>(); });
+        return true;
+    }
+    const auto width = size / arr.size();
+    if(arr.size() * width != size)
+        return false;
+    for(size_t idx = 0; idx < arr.size(); ++idx)
+        if(!copyFloats(arr[idx], width, output + idx * width))
+            return false;
+    return true;
+}
 
-    return { arr[0]->as<Float>(), arr[1]->as<Float>() };
+template <size_t Size>
+static std::array<Float, Size> parseFixedFloats(const Ref<ConfigAttr>& node, const std::string_view name) {
+    std::array<Float, Size> res{};
+    if(!copyFloats(node, Size, res.data()))
+        fatal(fmt::format("Bad {}", name));
+    return res;
 }
 
-glm::vec3 parseVec3(const Ref<ConfigAttr>& node) {
-    const auto& arr = node->as<ConfigAttr::AttrArray>();
-    if(arr.size() != 3)
-        fatal("Bad vector3");
+glm::vec2 parseVec2(const Ref<ConfigAttr>& node) {
+    const auto res = parseFixedFloats<2>(node, "vector2"sv);
+    return { res[0], res[1] };
+}
 
-    return { arr[0]->as<Float>(), arr[1]->as<Float>(), arr[2]->as<Float>() };
+glm::vec3 parseVec3(const Ref<ConfigAttr>& node) {
+    const auto res = parseFixedFloats<3>(node, "vector3"sv);
+    return { res[0], res[1], res[2] };
 }
 
 glm::quat parseQuat(const Ref<ConfigAttr>& node) {
-    const auto& arr = node->as<ConfigAttr::AttrArray>();
-    if(arr.size() != 4)
-        fatal("Bad quaternion");
-    return glm::quat{ arr[0]->as<Float>(), arr[1]->as<Float>(), arr[2]->as<Float>(), arr[3]->as<Float>() };
+    const auto res = parseFixedFloats<4>(node, "quaternion"sv);
+    return glm::quat{ res[0], res[1], res[2], res[3] };
+}
+
+std::pmr::vector<Float> parseFloats(const Ref<ConfigAttr>& node, const uint32_t width, std::pmr::memory_resource* allocator) {
+    // the nested arrays must have exactly width numbers, the rows of the fallback are counted by the top-level elements
+    const auto typedWidth = [](const auto* arr) { return arr->width == arr->values.size() ? 0U : arr->width; };
+    uint32_t nestedWidth = 0;
+    size_t size;
+    if(const auto arr = node->numericArray<float>()) {
+        size = arr->values.size();
+        nestedWidth = typedWidth(arr);
+    } else if(const auto arr = node->numericArray<uint32_t>()) {
+        size = arr->values.size();
+        nestedWidth = typedWidth(arr);
+    } else {
+        const auto& items = node->as<ConfigAttr::AttrArray>();
+        const auto nested = !items.empty() && items.front()->isArray();
+        size = nested ? items.size() * width : items.size();
+        nestedWidth = nested ? width : 0;
+    }
+
+    std::pmr::vector<Float> res{ size, allocator };
+    if(width == 0 || size % width != 0 || (nestedWidth && nestedWidth != width) || !copyFloats(node, size, res.data()))
+        fatal(fmt::format("Bad array of {} numbers per row", width));
+    return res;
 }
 
 PIPER_NAMESPACE_END
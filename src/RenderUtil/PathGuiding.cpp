@@ -0,0 +1,205 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Render/PathGuiding.hpp>
+#include <algorithm>
+#include <bit>
+#include <tbb/parallel_for.h>
+
+PIPER_NAMESPACE_BEGIN
+
+std::pair<glm::vec2, Float> DirectionalQuadTree::sample(glm::vec2 u) const noexcept {
+    glm::vec2 origin{ 0.0f };
+    Float size = 1.0f;
+    Float pdf = 1.0f;
+    uint32_t idx = 0;
+
+    while(!mNodes.empty()) {
+        const auto& sums = mNodes[idx].sums;
+        const auto total = sums[0] + sums[1] + sums[2] + sums[3];
+        if(!(total > 0.0f))
+            break;
+
+        // the column is selected by u.x and the row by u.y, so the stratification of u is preserved
+        const auto left = sums[0] + sums[2];
+        const auto x = u.x * total < left ? 0U : 1U;
+        const auto column = x ? total - left : left;
+        u.x = x ? (u.x * total - left) / column : u.x * total / left;
+        const auto bottom = sums[x];
+        const auto y = u.y * column < bottom ? 0U : 1U;
+        u.y = y ? (u.y * column - bottom) / (column - bottom) : u.y * column / bottom;
+        u = glm::clamp(u, 0.0f, oneMinusEpsilon);
+
+        const auto child = x | (y << 1);
+        pdf *= 4.0f * sums[child] / total;
+        size *= 0.5f;
+        origin += glm::vec2{ static_cast<Float>(x), static_cast<Float>(y) } * size;
+        if(!mNodes[idx].children[child])
+            break;
+        idx = mNodes[idx].children[child];
+    }
+
+    return { origin + u * size, pdf };
+}
+
+Float DirectionalQuadTree::pdf(glm::vec2 p) const noexcept {
+    Float pdf = 1.0f;
+    uint32_t idx = 0;
+
+    while(!mNodes.empty()) {
+        const auto& sums = mNodes[idx].sums;
+        const auto total = sums[0] + sums[1] + sums[2] + sums[3];
+        if(!(total > 0.0f))
+            break;
+        const auto child = descend(p);
+        if(!(sums[child] > 0.0f))
+            return 0.0f;
+        pdf *= 4.0f * sums[child] / total;
+        if(!mNodes[idx].children[child])
+            break;
+        idx = mNodes[idx].children[child];
+    }
+
+    return pdf;
+}
+
+DirectionalQuadTree DirectionalQuadTree::refine(const Float threshold, const uint32_t maxDepth) const {
+    DirectionalQuadTree res;
+    res.reset();
+    const auto total = this->total();
+    if(!(total > 0.0f))
+        return res;
+
+    struct Item final {
+        uint32_t oldIdx;  // 0 means the quadrant was a leaf in the old tree
+        uint32_t newIdx;
+        uint32_t depth;
+        std::array<Float, 4> sums;
+    };
+    std::pmr::vector<Item> stack{ context().scopedAllocator };
+    stack.push_back({ 0, 0, 1, mNodes.front().sums });
+
+    while(!stack.empty()) {
+        const auto item = stack.back();
+        stack.pop_back();
+        if(item.depth >= maxDepth)
+            continue;
+
+        for(uint32_t child = 0; child < 4; ++child) {
+            if(!(item.sums[child] > total * threshold))
+                continue;
+
+            const auto newIdx = static_cast<uint32_t>(res.mNodes.size());
+            res.mNodes.emplace_back();
+            res.mNodes[item.newIdx].children[child] = newIdx;
+
+            // the energy of the old leaves is assumed to be uniform over their quadrants
+            const auto oldIdx = item.oldIdx || item.depth == 1 ? mNodes[item.oldIdx].children[child] : 0U;
+            const auto quarter = item.sums[child] * 0.25f;
+            stack.push_back({ oldIdx, newIdx, item.depth + 1,
+                              oldIdx ? mNodes[oldIdx].sums : std::array<Float, 4>{ quarter, quarter, quarter, quarter } });
+        }
+    }
+
+    return res;
+}
+
+GuidingField::GuidingField(const uint32_t capacity, const Float threshold, const uint32_t maxDepth)
+    : mThreshold{ threshold }, mMaxDepth{ maxDepth } {
+    const auto size = std::bit_ceil(std::max(capacity, 1024U));
+    mKeys.resize(size);
+    mCells.resize(size);
+}
+
+void GuidingField::reset(const Float cellSize) {
+    mInvCellSize = 1.0f / cellSize;
+    std::ranges::fill(mKeys, 0);
+    tbb::parallel_for(tbb::blocked_range<size_t>{ 0, mCells.size() }, [&](const tbb::blocked_range<size_t>& range) {
+        for(auto idx = range.begin(); idx != range.end(); ++idx)
+            mCells[idx] = Cell{};
+    });
+}
+
+void GuidingField::refine() {
+    tbb::parallel_for(tbb::blocked_range<size_t>{ 0, mCells.size() }, [&](const tbb::blocked_range<size_t>& range) {
+        for(auto idx = range.begin(); idx != range.end(); ++idx) {
+            if(!mKeys[idx])
+                continue;
+
+            auto& cell = mCells[idx];
+            // the cells claimed in the previous pass start learning now
+            if(cell.building.empty())
+                cell.building.reset();
+            else if(cell.building.total() > 0.0f) {
+                cell.sampling = cell.building;
+                cell.building = cell.building.refine(mThreshold, mMaxDepth);
+            }
+        }
+    });
+}
+
+// the cells are found by linear probing, the probe sequence is bounded to keep the lookups cheap in a crowded grid
+static constexpr uint32_t maxProbeCount = 32;
+
+uint32_t GuidingField::locate(const uint64_t key) const noexcept {
+    const auto mask = static_cast<uint32_t>(mKeys.size() - 1);
+    auto slot = hash(key);
+    for(uint32_t k = 0; k < maxProbeCount; ++k, slot = (slot + 1) & mask) {
+        const auto current = std::atomic_ref{ const_cast<uint64_t&>(mKeys[slot]) }.load(std::memory_order_relaxed);  // NOLINT
+        if(current == key)
+            return slot;
+        if(!current)
+            break;
+    }
+    return static_cast<uint32_t>(mKeys.size());
+}
+
+uint32_t GuidingField::claim(const uint64_t key) noexcept {
+    const auto mask = static_cast<uint32_t>(mKeys.size() - 1);
+    auto slot = hash(key);
+    for(uint32_t k = 0; k < maxProbeCount; ++k, slot = (slot + 1) & mask) {
+        std::atomic_ref entry{ mKeys[slot] };
+        auto current = entry.load(std::memory_order_relaxed);
+        if(!current && entry.compare_exchange_strong(current, key, std::memory_order_relaxed))
+            return slot;
+        if(current == key)
+            return slot;
+    }
+    return static_cast<uint32_t>(mKeys.size());
+}
+
+const DirectionalQuadTree* GuidingField::find(const glm::vec3& pos) const noexcept {
+    const auto slot = locate(key(pos));
+    if(slot == mKeys.size())
+        return nullptr;
+    const auto& sampling = mCells[slot].sampling;
+    return sampling.total() > 0.0f ? &sampling : nullptr;
+}
+
+void GuidingField::record(const glm::vec3& pos, const glm::vec3& dir, const Float value) noexcept {
+    if(!(value > 0.0f) || !std::isfinite(value))
+        return;
+    const auto slot = claim(key(pos));
+    if(slot == mKeys.size())
+        return;
+    mCells[slot].building.record(directionToCylindrical(dir), value);
+}
+
+PIPER_NAMESPACE_END
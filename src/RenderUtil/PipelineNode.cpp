@@ -21,6 +21,7 @@
 #include <Piper/Core/Report.hpp>
 #include <Piper/Render/Frame.hpp>
 #include <Piper/Render/PipelineNode.hpp>
+#include <oneapi/tbb/parallel_for.h>
 
 PIPER_NAMESPACE_BEGIN
 
@@ -34,18 +35,76 @@ void mergeRequirement(PipelineNode::ChannelRequirement& lhs, PipelineNode::Chann
             lhs[channel] = required;
 }
 
+ChannelFormat FrameMetadata::format(const Channel channel) const {
+    if(formats.empty())
+        return ChannelFormat::Float;
+    const auto iter = std::ranges::find(channels, channel);
+    if(iter == channels.cend())
+        fatal("Required channel doesn't exist.");
+    return formats[static_cast<size_t>(iter - channels.cbegin())];
+}
+
+size_t FrameMetadata::channelBytes(const Channel channel) const {
+    const auto bytes = channelSize(channel, spectrumType) * formatSize(format(channel));
+    return (bytes + sizeof(Float) - 1) / sizeof(Float) * sizeof(Float);
+}
+
+size_t FrameMetadata::pixelBytes() const {
+    size_t res = 0;
+    for(const auto c : channels)
+        res += channelBytes(c);
+    return res;
+}
+
+size_t FrameMetadata::storageSize() const {
+    return static_cast<size_t>(width) * height * pixelBytes() / sizeof(Float);
+}
+
 ChannelInfo FrameMetadata::view(const Channel channel) const {
-    uint32_t stride = 0;
+    size_t offset = 0;
+    bool found = false;
     for(const auto c : channels) {
-        if(channel == c)
+        if(channel == c) {
+            found = true;
             break;
-        stride += channelSize(c, spectrumType);
+        }
+        offset += channelBytes(c);
     }
 
-    if(stride == pixelStride)
+    if(!found)
         fatal("Required channel doesn't exist.");
-    constexpr uint32_t scalarSize = sizeof(Float);
-    return ChannelInfo{ stride * scalarSize, pixelStride * scalarSize, pixelStride * width * scalarSize };
+    if(layout == FrameLayout::Planar) {
+        const auto size = channelBytes(channel);
+        return ChannelInfo{ offset * width * height, size, size * width };
+    }
+    const auto stride = pixelBytes();
+    return ChannelInfo{ offset, stride, stride * width };
+}
+
+Ref<Frame> Frame::convertLayout(Ref<Frame> frame, const FrameLayout layout) {
+    if(frame->metadata().layout == layout)
+        return frame;
+
+    const auto& src = frame->metadata();
+    auto metadata = src;
+    metadata.layout = layout;
+    std::pmr::vector<Float> data(metadata.storageSize(), trackedAllocator(MemoryTag::Frame));
+
+    const auto srcBase = reinterpret_cast<const std::byte*>(frame->data().data());
+    const auto dstBase = reinterpret_cast<std::byte*>(data.data());
+    for(const auto channel : src.channels) {
+        const auto from = src.view(channel), to = metadata.view(channel);
+        const auto size = src.channelBytes(channel);
+        tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, src.height }, [&](const tbb::blocked_range<uint32_t>& range) {
+            for(auto y = range.begin(); y != range.end(); ++y) {
+                const auto srcRow = srcBase + from.byteStride + y * from.rowStride;
+                const auto dstRow = dstBase + to.byteStride + y * to.rowStride;
+                for(uint32_t x = 0; x < src.width; ++x)
+                    std::copy_n(srcRow + x * from.pixelStride, size, dstRow + x * to.pixelStride);
+            }
+        });
+    }
+    return makeRefCount<Frame>(std::move(metadata), std::move(data));
 }
 
 PIPER_NAMESPACE_END
@@ -0,0 +1,102 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Render/RadianceCache.hpp>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <tbb/parallel_for.h>
+
+PIPER_NAMESPACE_BEGIN
+
+RadianceCache::RadianceCache(const uint32_t capacity) {
+    const auto size = std::bit_ceil(std::max(capacity, 1024U));
+    mKeys.resize(size);
+    mCells.resize(size);
+}
+
+void RadianceCache::reset(const Float cellSize) {
+    mInvCellSize = 1.0f / cellSize;
+    std::ranges::fill(mKeys, 0);
+    std::ranges::fill(mCells, Cell{});
+}
+
+void RadianceCache::update() {
+    tbb::parallel_for(tbb::blocked_range<size_t>{ 0, mCells.size() }, [&](const tbb::blocked_range<size_t>& range) {
+        for(auto idx = range.begin(); idx != range.end(); ++idx) {
+            auto& cell = mCells[idx];
+            if(!mKeys[idx] || !(cell.count > 0.0f))
+                continue;
+            cell.learned = cell.sum / cell.count;
+            cell.trained = true;
+        }
+    });
+}
+
+// the cells are found by linear probing, the probe sequence is bounded to keep the lookups cheap in a crowded cache
+static constexpr uint32_t maxProbeCount = 32;
+
+uint32_t RadianceCache::locate(const uint64_t key) const noexcept {
+    const auto mask = static_cast<uint32_t>(mKeys.size() - 1);
+    auto slot = hash(key);
+    for(uint32_t k = 0; k < maxProbeCount; ++k, slot = (slot + 1) & mask) {
+        const auto current = std::atomic_ref{ const_cast<uint64_t&>(mKeys[slot]) }.load(std::memory_order_relaxed);  // NOLINT
+        if(current == key)
+            return slot;
+        if(!current)
+            break;
+    }
+    return static_cast<uint32_t>(mKeys.size());
+}
+
+uint32_t RadianceCache::claim(const uint64_t key) noexcept {
+    const auto mask = static_cast<uint32_t>(mKeys.size() - 1);
+    auto slot = hash(key);
+    for(uint32_t k = 0; k < maxProbeCount; ++k, slot = (slot + 1) & mask) {
+        std::atomic_ref entry{ mKeys[slot] };
+        auto current = entry.load(std::memory_order_relaxed);
+        if(!current && entry.compare_exchange_strong(current, key, std::memory_order_relaxed))
+            return slot;
+        if(current == key)
+            return slot;
+    }
+    return static_cast<uint32_t>(mKeys.size());
+}
+
+std::optional<glm::vec3> RadianceCache::find(const glm::vec3& pos, const glm::vec3& normal) const noexcept {
+    const auto slot = locate(key(pos, normal));
+    if(slot == mKeys.size() || !mCells[slot].trained)
+        return std::nullopt;
+    return mCells[slot].learned;
+}
+
+void RadianceCache::record(const glm::vec3& pos, const glm::vec3& normal, const glm::vec3& value, const Float count) noexcept {
+    if(glm::any(glm::isnan(value)) || glm::any(glm::isinf(value)))
+        return;
+    const auto slot = claim(key(pos, normal));
+    if(slot == mKeys.size())
+        return;
+    auto& cell = mCells[slot];
+    for(glm::length_t k = 0; k < 3; ++k)
+        std::atomic_ref{ cell.sum[k] }.fetch_add(value[k], std::memory_order_relaxed);
+    std::atomic_ref{ cell.count }.fetch_add(count, std::memory_order_relaxed);
+}
+
+PIPER_NAMESPACE_END
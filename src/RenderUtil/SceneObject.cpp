@@ -18,6 +18,7 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <Piper/Render/Acceleration.hpp>
 #include <Piper/Render/Light.hpp>
 #include <Piper/Render/SceneObject.hpp>
 #include <Piper/Render/Sensor.hpp>
@@ -46,9 +47,36 @@ SceneObject::SceneObject(const Ref<ConfigNode>& node)
     }
 }
 
-// ReSharper disable once CppMemberFunctionMayBeConst
-void SceneObject::update(const TimeInterval timeInterval) {
+bool SceneObject::update(const TimeInterval timeInterval) {
+    // every buffer of the acceleration structure needs to see a new transform once
+    if(const auto transform = resolveTransform(mKeyFrames, timeInterval); mLastTransform != transform) {
+        mLastTransform = transform;
+        mPendingUpdates = PrimitiveGroup::bufferCount;
+    }
+    if(mPendingUpdates == 0)
+        return false;
+
+    --mPendingUpdates;
     mComponent->updateTransform(mKeyFrames, timeInterval);
+    return true;
+}
+
+void SceneObject::rearmUpdate() noexcept {
+    mPendingUpdates = std::min(mPendingUpdates + 1, PrimitiveGroup::bufferCount);
+}
+
+bool SceneObject::updateAreaLight(const TimeInterval timeInterval) {
+    if(mComponentType != ComponentType::Shape)
+        return false;
+    const auto light = dynamic_cast<Shape*>(mComponent.get())->areaLight();
+    if(!light)
+        return false;
+    if(const auto transform = resolveTransform(mKeyFrames, timeInterval); mLastAreaLightTransform != transform)
+        mLastAreaLightTransform = transform;
+    else
+        return false;
+    light->updateTransform(mKeyFrames, timeInterval);
+    return true;
 }
 
 PrimitiveGroup* SceneObject::primitiveGroup() const {
@@ -60,7 +88,14 @@ Sensor* SceneObject::sensor() const noexcept {
 }
 
 LightBase* SceneObject::light() const noexcept {
-    return mComponentType == ComponentType::Light ? dynamic_cast<LightBase*>(mComponent.get()) : nullptr;
+    switch(mComponentType) {
+        case ComponentType::Light:
+            return dynamic_cast<LightBase*>(mComponent.get());
+        case ComponentType::Shape:
+            return dynamic_cast<Shape*>(mComponent.get())->areaLight();
+        default:
+            return nullptr;
+    }
 }
 
 PIPER_NAMESPACE_END
@@ -63,6 +63,13 @@ std::pair<SensorNDCAffineTransform, RenderRECT> calcRenderRECT(const uint32_t wi
 
 void Sensor::updateTransform(const KeyFrames& keyFrames, const TimeInterval timeInterval) {
     mTransform = resolveTransform(keyFrames, timeInterval);
+    prepareFrame();
+}
+
+void Sensor::sample(const std::span<const glm::vec2> sensorNDC, const std::span<SampleProvider* const> samplers, const std::span<Ray> rays,
+                    const std::span<Float> weights) const noexcept {
+    for(size_t idx = 0; idx < sensorNDC.size(); ++idx)
+        std::tie(rays[idx], weights[idx]) = sample(sensorNDC[idx], *samplers[idx]);
 }
 
 glm::vec2 parseSensorSize(const Ref<ConfigAttr>& attr) {
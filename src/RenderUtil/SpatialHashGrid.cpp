@@ -0,0 +1,78 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Render/SpatialHashGrid.hpp>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_scan.h>
+
+PIPER_NAMESPACE_BEGIN
+
+void SpatialHashGrid::build(const std::pmr::vector<glm::vec3>& points, const Float radius) {
+    const auto size = static_cast<uint32_t>(points.size());
+    mRadius = radius;
+    mInvCellSize = 0.5f / radius;
+    // about one bucket per point keeps the chains short
+    const auto buckets = std::bit_ceil(std::max(size, 1U));
+    mMask = buckets - 1;
+
+    std::pmr::vector<uint32_t> keys{ size, context().globalAllocator };
+    mOffsets.assign(buckets + 1, 0);
+    tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, size }, [&](const tbb::blocked_range<uint32_t>& range) {
+        for(auto idx = range.begin(); idx != range.end(); ++idx) {
+            keys[idx] = bucket(cell(points[idx]));
+            std::atomic_ref{ mOffsets[keys[idx] + 1] }.fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    tbb::parallel_scan(
+        tbb::blocked_range<uint32_t>{ 0, buckets + 1 }, 0U,
+        [&](const tbb::blocked_range<uint32_t>& range, uint32_t sum, const bool isFinalScan) {
+            for(auto idx = range.begin(); idx != range.end(); ++idx) {
+                sum += mOffsets[idx];
+                if(isFinalScan)
+                    mOffsets[idx] = sum;
+            }
+            return sum;
+        },
+        [](const uint32_t lhs, const uint32_t rhs) { return lhs + rhs; });
+
+    std::pmr::vector<uint32_t> cursors{ mOffsets.cbegin(), mOffsets.cend() - 1, context().globalAllocator };
+    mIndices.resize(size);
+    mPoints.resize(size);
+    tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, size }, [&](const tbb::blocked_range<uint32_t>& range) {
+        for(auto idx = range.begin(); idx != range.end(); ++idx)
+            mIndices[std::atomic_ref{ cursors[keys[idx]] }.fetch_add(1, std::memory_order_relaxed)] = idx;
+    });
+
+    // restores the input order inside the buckets, so the results do not depend on the scheduling
+    tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, buckets }, [&](const tbb::blocked_range<uint32_t>& range) {
+        for(auto idx = range.begin(); idx != range.end(); ++idx) {
+            const auto begin = mIndices.begin() + mOffsets[idx], end = mIndices.begin() + mOffsets[idx + 1];
+            std::sort(begin, end);
+            for(auto iter = begin; iter != end; ++iter)
+                mPoints[static_cast<size_t>(iter - mIndices.begin())] = points[*iter];
+        }
+    });
+}
+
+PIPER_NAMESPACE_END
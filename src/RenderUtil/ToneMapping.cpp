@@ -0,0 +1,124 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/Report.hpp>
+#include <Piper/Render/ToneMapping.hpp>
+#include <algorithm>
+
+PIPER_NAMESPACE_BEGIN
+
+ToneMappingOperator parseToneMappingOperator(const std::string_view name) {
+    constexpr std::pair<std::string_view, ToneMappingOperator> operators[] = {
+        { "None"sv, ToneMappingOperator::None }, { "Reinhard"sv, ToneMappingOperator::Reinhard },
+        { "ACES"sv, ToneMappingOperator::ACES }, { "AgX"sv, ToneMappingOperator::AgX },
+        { "Filmic"sv, ToneMappingOperator::Filmic },
+    };
+    for(const auto& [key, value] : operators)
+        if(key == name)
+            return value;
+    fatal(fmt::format("Unrecognized tone mapping operator \"{}\"", name));
+}
+
+static void applyMatrix(PixelBlock& block, const uint32_t count, const Float (&m)[3][3]) noexcept {
+    for(uint32_t idx = 0; idx < count; ++idx) {
+        const auto r = block.r[idx], g = block.g[idx], b = block.b[idx];
+        block.r[idx] = m[0][0] * r + m[0][1] * g + m[0][2] * b;
+        block.g[idx] = m[1][0] * r + m[1][1] * g + m[1][2] * b;
+        block.b[idx] = m[2][0] * r + m[2][1] * g + m[2][2] * b;
+    }
+}
+
+// extended Reinhard, the input equal to the white point is mapped to one
+static void reinhard(PixelBlock& block, const uint32_t count, const Float whitePoint) noexcept {
+    const auto invWhite2 = 1.0f / (whitePoint * whitePoint);
+    applyPerChannel(block, count, [invWhite2](const Float x) { return x * (1.0f + x * invWhite2) / (1.0f + x); });
+}
+
+// Please refer to https://github.com/TheRealMJP/BakingLab/blob/master/BakingLab/ACES.hlsl (fitted by Stephen Hill)
+static void acesFitted(PixelBlock& block, const uint32_t count) noexcept {
+    constexpr Float inputMatrix[3][3] = { { 0.59719f, 0.35458f, 0.04823f },
+                                          { 0.07600f, 0.90834f, 0.01566f },
+                                          { 0.02840f, 0.13383f, 0.83777f } };
+    constexpr Float outputMatrix[3][3] = { { 1.60475f, -0.53108f, -0.07367f },
+                                           { -0.10208f, 1.10813f, -0.00605f },
+                                           { -0.00327f, -0.07276f, 1.07602f } };
+    applyMatrix(block, count, inputMatrix);
+    // the combined RRT and ODT
+    applyPerChannel(block, count, [](const Float x) {
+        const auto a = x * (x + 0.0245786f) - 0.000090537f;
+        const auto b = x * (0.983729f * x + 0.4329510f) + 0.238081f;
+        return a / b;
+    });
+    applyMatrix(block, count, outputMatrix);
+}
+
+// Please refer to https://iolite-engine.com/blog_posts/minimal_agx_implementation (fitted by Benjamin Wrensch)
+static void agx(PixelBlock& block, const uint32_t count) noexcept {
+    constexpr Float inset[3][3] = { { 0.842479062253094f, 0.0784335999999992f, 0.0792237451477643f },
+                                    { 0.0423282422610123f, 0.878468636469772f, 0.0791661274605434f },
+                                    { 0.0423756549057051f, 0.0784336f, 0.879142973793104f } };
+    constexpr Float outset[3][3] = { { 1.19687900512017f, -0.0980208811401368f, -0.0990297440797205f },
+                                     { -0.0528968517574562f, 1.15190312990417f, -0.0989611768448433f },
+                                     { -0.0529716355144438f, -0.0980434501171241f, 1.15107367414103f } };
+    constexpr Float minEV = -12.47393f, maxEV = 4.026069f;
+
+    applyMatrix(block, count, inset);
+    applyPerChannel(block, count, [](const Float v) {
+        const auto x = std::clamp((std::log2(std::fmax(v, 1e-10f)) - minEV) / (maxEV - minEV), 0.0f, 1.0f);
+        const auto x2 = x * x, x4 = x2 * x2;
+        return 15.5f * x4 * x2 - 40.14f * x4 * x + 31.96f * x4 - 6.868f * x2 * x + 0.4298f * x2 + 0.1191f * x - 0.00232f;
+    });
+    applyMatrix(block, count, outset);
+    // the sigmoid is fitted in the display encoding, so it is linearized to keep the output of all operators linear
+    applyPerChannel(block, count, [](const Float x) { return std::pow(std::fmax(x, 0.0f), 2.2f); });
+}
+
+// Please refer to http://filmicworlds.com/blog/filmic-tonemapping-operators/ (John Hable)
+static void filmic(PixelBlock& block, const uint32_t count) noexcept {
+    constexpr auto curve = [](const Float x) {
+        constexpr Float a = 0.15f, b = 0.50f, c = 0.10f, d = 0.20f, e = 0.02f, f = 0.30f;
+        return (x * (a * x + c * b) + d * e) / (x * (a * x + b) + d * f) - e / f;
+    };
+    constexpr Float exposureBias = 2.0f, whitePoint = 11.2f;
+    const auto whiteScale = 1.0f / curve(whitePoint);
+    applyPerChannel(block, count, [&](const Float x) { return curve(x * exposureBias) * whiteScale; });
+}
+
+void applyToneCurve(PixelBlock& block, const uint32_t count, const ToneMappingOperator op, const Float whitePoint) noexcept {
+    switch(op) {
+        case ToneMappingOperator::None:
+            break;
+        case ToneMappingOperator::Reinhard:
+            reinhard(block, count, whitePoint);
+            break;
+        case ToneMappingOperator::ACES:
+            acesFitted(block, count);
+            break;
+        case ToneMappingOperator::AgX:
+            agx(block, count);
+            break;
+        case ToneMappingOperator::Filmic:
+            filmic(block, count);
+            break;
+    }
+    applyPerChannel(block, count, [](const Float x) { return std::clamp(x, 0.0f, 1.0f); });
+}
+
+PIPER_NAMESPACE_END
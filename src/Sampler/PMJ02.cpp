@@ -0,0 +1,269 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/Report.hpp>
+#include <Piper/Core/StaticFactory.hpp>
+#include <Piper/Render/Sampler.hpp>
+#include <oneapi/tbb/parallel_for.h>
+
+PIPER_NAMESPACE_BEGIN
+
+// Please refer to "Progressive Multi-Jittered Sample Sequences" (Christensen et al. 2018)
+// NOTICE: the pmj02 sequences are (0,2)-sequences in base 2, so each set is generated by the Owen scrambled first two Sobol dimensions
+// instead of the stochastic construction. Please refer to "Practical Hash-based Owen Scrambling" (Burley 2020)
+
+static uint32_t laineKarrasPermutation(uint32_t x, const uint32_t seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cU;
+    x ^= x * 0xb82f1e52U;
+    x ^= x * 0xc7afe638U;
+    x ^= x * 0x8d22f6e6U;
+    return x;
+}
+
+static uint32_t nestedUniformScramble(const uint32_t x, const uint32_t seed) {
+    return glm::bitfieldReverse(laineKarrasPermutation(glm::bitfieldReverse(x), seed));
+}
+
+static uint32_t sobol1(uint32_t index) {
+    uint32_t res = 0;
+    for(uint32_t v = 1U << 31; index; index >>= 1, v ^= v >> 1)
+        if(index & 1)
+            res ^= v;
+    return res;
+}
+
+static Float toUnitFloat(const uint32_t x) {
+    return std::fmin(oneMinusEpsilon, static_cast<Float>(x) * 0x1p-32f);
+}
+
+// Please refer to "The void-and-cluster method for dither array generation" (Ulichney 1993)
+// the ranks of the toroidal blue noise mask are normalized to (0,1)
+static void generateBlueNoise(const uint32_t logSize, const uint64_t seed, std::pmr::vector<Float>& res) {
+    const auto size = 1U << logSize, mask = size - 1, count = size * size;
+    constexpr auto sigma = 1.5f;
+
+    std::pmr::vector<Float> kernel{ count, context().scopedAllocator };
+    for(uint32_t y = 0; y < size; ++y)
+        for(uint32_t x = 0; x < size; ++x) {
+            const auto dx = static_cast<Float>(std::min(x, size - x)), dy = static_cast<Float>(std::min(y, size - y));
+            kernel[(y << logSize) | x] = std::exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+        }
+
+    std::pmr::vector<Float> energy{ count, 0.0f, context().scopedAllocator };
+    std::pmr::vector<uint8_t> pattern{ count, 0, context().scopedAllocator };
+    const auto toggle = [&](const uint32_t idx, const bool set) {
+        const auto px = idx & mask, py = idx >> logSize;
+        const auto sign = set ? 1.0f : -1.0f;
+        for(uint32_t y = 0; y < size; ++y)
+            for(uint32_t x = 0; x < size; ++x)
+                energy[(((py + y) & mask) << logSize) | ((px + x) & mask)] += sign * kernel[(y << logSize) | x];
+        pattern[idx] = set;
+    };
+    const auto tightestCluster = [&] {
+        uint32_t best = 0;
+        auto bestEnergy = -std::numeric_limits<Float>::infinity();
+        for(uint32_t idx = 0; idx < count; ++idx)
+            if(pattern[idx] && energy[idx] > bestEnergy)
+                best = idx, bestEnergy = energy[idx];
+        return best;
+    };
+    const auto largestVoid = [&] {
+        uint32_t best = 0;
+        auto bestEnergy = std::numeric_limits<Float>::infinity();
+        for(uint32_t idx = 0; idx < count; ++idx)
+            if(!pattern[idx] && energy[idx] < bestEnergy)
+                best = idx, bestEnergy = energy[idx];
+        return best;
+    };
+
+    RandomEngine eng{ seed };
+    const auto initial = count / 10;
+    for(uint32_t placed = 0; placed < initial;) {
+        if(const auto idx = static_cast<uint32_t>(eng() % count); !pattern[idx]) {
+            toggle(idx, true);
+            ++placed;
+        }
+    }
+    // the initial pattern is relaxed until moving the tightest cluster does not change it
+    for(uint32_t iter = 0; iter < count; ++iter) {
+        const auto cluster = tightestCluster();
+        toggle(cluster, false);
+        const auto hole = largestVoid();
+        toggle(hole, true);
+        if(hole == cluster)
+            break;
+    }
+
+    std::pmr::vector<uint32_t> rank{ count, context().scopedAllocator };
+    const auto initialEnergy = energy;
+    const auto initialPattern = pattern;
+    for(auto idx = initial; idx-- > 0;) {
+        const auto cluster = tightestCluster();
+        toggle(cluster, false);
+        rank[cluster] = idx;
+    }
+    energy = initialEnergy;
+    pattern = initialPattern;
+    for(auto idx = initial; idx < count; ++idx) {
+        const auto hole = largestVoid();
+        toggle(hole, true);
+        rank[hole] = idx;
+    }
+
+    res.resize(count);
+    for(uint32_t idx = 0; idx < count; ++idx)
+        res[idx] = (static_cast<Float>(rank[idx]) + 0.5f) / static_cast<Float>(count);
+}
+
+constexpr uint32_t logSetCount = 5;
+constexpr uint32_t blueNoiseLogSize = 6;
+
+// the sample sets and the blue noise mask are built once and shared read-only by the tile samplers of all frames
+struct PMJ02Tables final : public RefCountBase {
+    uint32_t logSampleCount;
+    std::pmr::vector<glm::vec2> samples{ context().globalAllocator };
+    std::pmr::vector<Float> blueNoise{ context().globalAllocator };  // empty if the blue noise is disabled
+
+    PMJ02Tables(const uint32_t sampleCount, const bool useBlueNoise)
+        : logSampleCount{ static_cast<uint32_t>(std::bit_width(std::max(sampleCount, 1U) - 1)) } {
+        const auto size = 1U << logSampleCount;
+        samples.resize(static_cast<size_t>(size) << logSetCount);
+
+        tbb::parallel_for(
+            tbb::blocked_range<uint32_t>{ 0, 1U << logSetCount },
+            [&](const tbb::blocked_range<uint32_t>& range) {
+                for(auto set = range.begin(); set != range.end(); ++set) {
+                    const auto seed = seeding(set);
+                    const auto seedX = static_cast<uint32_t>(seed), seedY = static_cast<uint32_t>(seed >> 32);
+                    const auto base = static_cast<size_t>(set) << logSampleCount;
+                    for(uint32_t idx = 0; idx < size; ++idx)
+                        samples[base + idx] = { toUnitFloat(nestedUniformScramble(glm::bitfieldReverse(idx), seedX)),
+                                                toUnitFloat(nestedUniformScramble(sobol1(idx), seedY)) };
+                }
+            },
+            globalAffinityPartitioner);
+
+        if(useBlueNoise)
+            generateBlueNoise(blueNoiseLogSize, seeding(size), blueNoise);
+    }
+};
+
+class PMJ02TileSampler final : public TileSampler, public SampleGenerator {
+    uint32_t mDims;
+    uint32_t mSampleCount;
+    uint64_t mSeed;
+    Ref<PMJ02Tables> mTables;
+
+    // the sequence index packs the pixel and the sample index
+    static constexpr uint32_t sampleBits = 24;
+    static constexpr uint32_t coordBits = 20;
+
+    // the dimension pair dim of the sample, O(1) lookup without allocation
+    [[nodiscard]] glm::vec2 sample2D(const uint32_t filmX, const uint32_t filmY, const uint32_t sampleIdx,
+                                     const uint32_t dim) const noexcept {
+        const auto& tables = *mTables;
+        const auto dimHash = seeding(mSeed + dim);
+        const auto pixelHash = seeding(dimHash ^ ((static_cast<uint64_t>(filmY) << 32) | filmX));
+
+        // NOTICE: xor keeps each aligned power-of-two block of the indices, so the prefixes are still stratified
+        const auto set = static_cast<uint32_t>(pixelHash >> (64 - logSetCount));
+        const auto index = (sampleIdx ^ static_cast<uint32_t>(pixelHash)) & ((1U << tables.logSampleCount) - 1);
+        const auto u = tables.samples[(static_cast<size_t>(set) << tables.logSampleCount) | index];
+
+        // the Cranley-Patterson rotation decorrelates the pixels, the blue noise mask is offset by each dimension pair
+        glm::vec2 shift;
+        if(!tables.blueNoise.empty()) {
+            constexpr auto mask = (1U << blueNoiseLogSize) - 1;
+            const auto lookup = [&](const uint32_t offset) {
+                const auto x = (filmX + offset) & mask, y = (filmY + (offset >> blueNoiseLogSize)) & mask;
+                return tables.blueNoise[(y << blueNoiseLogSize) | x];
+            };
+            shift = { lookup(static_cast<uint32_t>(dimHash)), lookup(static_cast<uint32_t>(dimHash >> 32)) };
+        } else {
+            shift = { toUnitFloat(static_cast<uint32_t>(pixelHash >> 16)), toUnitFloat(static_cast<uint32_t>(seeding(pixelHash))) };
+        }
+
+        const auto res = u + shift;
+        return glm::min(res - glm::floor(res), glm::vec2{ oneMinusEpsilon });
+    }
+
+public:
+    PMJ02TileSampler(const uint32_t dims, const uint32_t sampleCount, const uint64_t seed, Ref<PMJ02Tables> tables)
+        : mDims{ dims }, mSampleCount{ sampleCount }, mSeed{ seed }, mTables{ std::move(tables) } {}
+
+    uint32_t samples() const noexcept override {
+        return mSampleCount;
+    }
+
+    std::pair<glm::vec2, SampleProvider> generate(const uint32_t filmX, const uint32_t filmY, const uint32_t sampleIdx) const override {
+        const auto sequenceIndex = (static_cast<uint64_t>(filmY) << (coordBits + sampleBits)) |
+            (static_cast<uint64_t>(filmX) << sampleBits) | sampleIdx;
+        const auto pixelSample = glm::vec2{ filmX, filmY } + sample2D(filmX, filmY, sampleIdx, 0);
+        return { pixelSample, SampleProvider{ *this, sequenceIndex, mDims, sequenceIndex ^ mSeed } };
+    }
+
+    void generate(const uint64_t sequenceIndex, const uint32_t dimBegin, const uint32_t count, Float* res) const noexcept override {
+        const auto sampleIdx = static_cast<uint32_t>(sequenceIndex & ((1U << sampleBits) - 1));
+        const auto filmX = static_cast<uint32_t>((sequenceIndex >> sampleBits) & ((1U << coordBits) - 1));
+        const auto filmY = static_cast<uint32_t>(sequenceIndex >> (coordBits + sampleBits));
+
+        // the consecutive dimensions form the pmj02 pairs, the pair 0 is used by the pixel sample
+        const auto dimEnd = dimBegin + count;
+        for(auto dim = dimBegin; dim < dimEnd;) {
+            const auto u = sample2D(filmX, filmY, sampleIdx, 1 + dim / 2);
+            for(auto k = dim & 1; k < 2 && dim < dimEnd; ++k, ++dim)
+                res[dim - dimBegin] = u[static_cast<int>(k)];
+        }
+    }
+};
+
+class PMJ02Sampler final : public Sampler {
+    uint32_t mSampleCount;
+    uint32_t mProvidedDims = 1024;
+    uint32_t mScramble = 0;
+    Ref<PMJ02Tables> mTables;
+
+public:
+    explicit PMJ02Sampler(const Ref<ConfigNode>& node) : mSampleCount{ node->get("SampleCount"sv)->as<uint32_t>() } {
+        if(const auto ptr = node->tryGet("ProvidedDims"sv))
+            mProvidedDims = (*ptr)->as<uint32_t>();
+        if(const auto ptr = node->tryGet("Scramble"sv))
+            mScramble = (*ptr)->as<uint32_t>();
+        bool blueNoise = true;
+        if(const auto ptr = node->tryGet("BlueNoise"sv))
+            blueNoise = (*ptr)->as<bool>();
+        if(mSampleCount > (1U << 24))
+            fatal(fmt::format("The sample count {} of PMJ02Sampler should not be greater than 2^24", mSampleCount));
+
+        mTables = makeRefCount<PMJ02Tables>(mSampleCount, blueNoise);
+    }
+
+    Ref<TileSampler> prepare(const uint32_t frameIdx, const uint32_t width, const uint32_t height, uint32_t) override {
+        if(std::max(width, height) > (1U << 20))
+            fatal(fmt::format("The resolution {}x{} is not supported by PMJ02Sampler", width, height));
+        // only the seed changes between frames
+        return makeRefCount<PMJ02TileSampler>(mProvidedDims, mSampleCount, seeding(mScramble + frameIdx), mTables);
+    }
+};
+
+PIPER_REGISTER_CLASS(PMJ02Sampler, Sampler);
+
+PIPER_NAMESPACE_END
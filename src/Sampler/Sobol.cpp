@@ -18,10 +18,15 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <Piper/Core/Report.hpp>
 #include <Piper/Core/StaticFactory.hpp>
 #include <Piper/Render/Sampler.hpp>
+#include <fstream>
+#include <oneapi/tbb/parallel_for.h>
 
 extern "C" void sobolKernel(const uint32_t* matrix, float* res, const uint32_t dims, uint32_t index);
+extern "C" void sobolBatchKernel(const uint32_t* matrix, const uint32_t* indices, uint32_t count, uint32_t dimBegin, uint32_t dims,
+                                 uint32_t scramble, float* res);
 
 PIPER_NAMESPACE_BEGIN
 
@@ -51,51 +56,173 @@ struct Sobol final {
 
 using LUT = std::pmr::vector<uint32_t>;
 
-class SobolTileSampler final : public TileSampler {
+// pixel-inversion tables, independent of the scramble
+struct SobolLUT final : public RefCountBase {
+    uint32_t logSize;
+    uint32_t sampleCount;
+    LUT c0Lower{ context().globalAllocator }, c0Upper{ context().globalAllocator }, c0LowerInverse{ context().globalAllocator },
+        c1Lower{ context().globalAllocator }, c1Upper{ context().globalAllocator }, c1UpperInverse{ context().globalAllocator };
+
+    [[nodiscard]] std::array<LUT*, 6> tables() noexcept {
+        return { &c0Lower, &c0Upper, &c0LowerInverse, &c1Lower, &c1Upper, &c1UpperInverse };
+    }
+
+    SobolLUT(const uint32_t logSizeOfTable, const uint32_t sampleCountOfTable, const std::string_view cacheDir)
+        : logSize{ logSizeOfTable }, sampleCount{ sampleCountOfTable } {
+        const auto size = 1U << logSize;
+        const auto count = size * sampleCount;
+        for(const auto table : tables())
+            table->resize(count);
+
+        fs::path path;
+        if(!cacheDir.empty()) {
+            path = fs::path{ cacheDir } / fmt::format("sobol_{}_{}.lut", logSize, sampleCount);
+            if(load(path))
+                return;
+        }
+
+        tbb::parallel_for(
+            tbb::blocked_range<uint32_t>{ 0, sampleCount },
+            [&](const tbb::blocked_range<uint32_t>& range) {
+                for(uint32_t idx = range.begin(); idx != range.end(); ++idx) {
+                    const auto base = idx * size;
+                    const auto shift = idx << (logSize << 1);
+
+                    for(uint32_t i = 0; i < size; ++i) {
+                        const auto j = vanDerCorput(i, 0);
+                        c0Lower[base + i] = j;
+                        c0LowerInverse[base + (j >> (32 - logSize))] = i;
+                        c0Upper[base + i] = vanDerCorput((i << logSize) | shift, 0);
+
+                        c1Lower[base + i] = sobol(i, 0);
+                        const auto k = sobol((i << logSize) | shift, 0);
+                        c1Upper[base + i] = k;
+                        c1UpperInverse[base + (k >> (32 - logSize))] = i;
+                    }
+                }
+            },
+            globalAffinityPartitioner);
+
+        if(!path.empty())
+            save(path);
+    }
+
+    bool load(const fs::path& path) {
+        std::ifstream in{ path, std::ios::in | std::ios::binary };
+        if(!in)
+            return false;
+
+        uint32_t header[2];
+        if(char magic[4]; !in.read(magic, 4) || memcmp(magic, "SOBL", 4) != 0 ||
+           !in.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != logSize || header[1] != sampleCount) {
+            warning(fmt::format("Invalid Sobol LUT cache \"{}\"", path.string()));
+            return false;
+        }
+
+        for(const auto table : tables())
+            if(!in.read(reinterpret_cast<char*>(table->data()), static_cast<std::streamsize>(table->size() * sizeof(uint32_t)))) {
+                warning(fmt::format("Invalid Sobol LUT cache \"{}\"", path.string()));
+                return false;
+            }
+        return true;
+    }
+
+    void save(const fs::path& path) {
+        std::ofstream out{ path, std::ios::out | std::ios::binary };
+        const uint32_t header[2] = { logSize, sampleCount };
+        out.write("SOBL", 4);
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+        for(const auto table : tables())
+            out.write(reinterpret_cast<const char*>(table->data()), static_cast<std::streamsize>(table->size() * sizeof(uint32_t)));
+        out.flush();
+        if(!out)
+            warning(fmt::format("Failed to save Sobol LUT cache \"{}\"", path.string()));
+    }
+};
+
+class SobolTileSampler final : public TileSampler, public SampleGenerator {
     uint32_t mDims;
     uint32_t mSampleCount;
     uint32_t mLogSize;
     uint32_t mSize;
     uint32_t mScramble;
+    bool mLazy;
 
     const uint32_t* mMatrix32;
-    LUT mC0Lower, mC0Upper, mC0LowerInverse, mC1Lower, mC1Upper, mC1UpperInverse;
-
-public:
-    SobolTileSampler(uint32_t dims, uint32_t sampleCount, uint32_t logSize, uint32_t scramble, const uint32_t* matrix32, LUT c0Lower,
-                     LUT c0Upper, LUT c0LowerInverse, LUT c1Lower, LUT c1Upper, LUT c1UpperInverse)
-        : mDims{ dims }, mSampleCount{ sampleCount }, mLogSize{ logSize }, mSize{ 1U << logSize }, mScramble{ scramble },
-          mMatrix32{ matrix32 }, mC0Lower{ std::move(c0Lower) }, mC0Upper{ std::move(c0Upper) },
-          mC0LowerInverse{ std::move(c0LowerInverse) }, mC1Lower{ std::move(c1Lower) }, mC1Upper{ std::move(c1Upper) }, mC1UpperInverse{
-              std::move(c1UpperInverse)
-          } {}
+    Ref<SobolLUT> mLUT;
 
-    uint32_t samples() const noexcept override {
-        return mSampleCount;
-    }
-
-    std::pair<glm::vec2, SampleProvider> generate(const uint32_t filmX, const uint32_t filmY, const uint32_t sampleIdx) const override {
+    // the sample in the pixel and its Sobol index
+    [[nodiscard]] std::pair<glm::vec2, uint32_t> locate(const uint32_t filmX, const uint32_t filmY,
+                                                        const uint32_t sampleIdx) const noexcept {
+        const auto& lut = *mLUT;
         const auto px = filmX ^ (mScramble >> (32 - mLogSize));
         const auto py = filmY ^ (mScramble >> (32 - mLogSize));
         const auto base = sampleIdx * mSize;
 
-        const auto lower = mC0LowerInverse[base + px];
-        const auto delta = py ^ (mC1Lower[base + lower] >> (32 - mLogSize));
-        const auto upper = mC1UpperInverse[base + delta];
+        const auto lower = lut.c0LowerInverse[base + px];
+        const auto delta = py ^ (lut.c1Lower[base + lower] >> (32 - mLogSize));
+        const auto upper = lut.c1UpperInverse[base + delta];
         const auto index = ((upper << mLogSize) | lower) | (sampleIdx << (mLogSize << 1));
-        const auto x = mC0Lower[base + lower] ^ mC0Upper[base + upper] ^ mScramble;
-        const auto y = mC1Lower[base + lower] ^ mC1Upper[base + upper] ^ mScramble;
+        const auto x = lut.c0Lower[base + lower] ^ lut.c0Upper[base + upper] ^ mScramble;
+        const auto y = lut.c1Lower[base + lower] ^ lut.c1Upper[base + upper] ^ mScramble;
 
         const auto rx = static_cast<Float>(x) / static_cast<Float>(1ULL << (32 - mLogSize));
         const auto ry = static_cast<Float>(y) / static_cast<Float>(1ULL << (32 - mLogSize));
+        return { glm::vec2{ rx, ry }, index };
+    }
 
+public:
+    SobolTileSampler(const uint32_t dims, const uint32_t scramble, const bool lazy, const uint32_t* matrix32, Ref<SobolLUT> lut)
+        : mDims{ dims }, mSampleCount{ lut->sampleCount }, mLogSize{ lut->logSize }, mSize{ 1U << lut->logSize }, mScramble{ scramble },
+          mLazy{ lazy }, mMatrix32{ matrix32 }, mLUT{ std::move(lut) } {}
+
+    uint32_t samples() const noexcept override {
+        return mSampleCount;
+    }
+
+    std::pair<glm::vec2, SampleProvider> generate(const uint32_t filmX, const uint32_t filmY, const uint32_t sampleIdx) const override {
+        const auto [sample, index] = locate(filmX, filmY, sampleIdx);
+
+        if(mDims && mLazy)
+            return { sample, SampleProvider{ *this, index, mDims, index } };
         if(mDims) {
             std::pmr::vector<Float> samples{ mDims, std::bit_cast<Float>(mScramble), context().scopedAllocator };
             sobolKernel(mMatrix32, samples.data(), mDims, index);
 
-            return { glm::vec2{ rx, ry }, SampleProvider{ std::move(samples), index } };
+            return { sample, SampleProvider{ std::move(samples), index } };
         }
-        return { glm::vec2{ rx, ry }, SampleProvider{ {}, index } };
+        return { sample, SampleProvider{ {}, index } };
+    }
+
+    // the dimensions consumed first (all dimensions in the eager mode) of the whole batch are generated by one kernel call
+    void generateBatch(const std::span<const glm::uvec3> requests, glm::vec2* filmSamples,
+                       SampleProvider* const* providers) const override {
+        const auto count = static_cast<uint32_t>(requests.size());
+        std::pmr::vector<uint32_t> indices{ count, context().scopedAllocator };
+        for(uint32_t idx = 0; idx < count; ++idx)
+            std::tie(filmSamples[idx], indices[idx]) = locate(requests[idx].x, requests[idx].y, requests[idx].z);
+
+        const auto dims = mLazy ? std::min(mDims, SampleProvider::chunkSize) : mDims;
+        std::pmr::vector<Float> columns{ static_cast<size_t>(dims) * count, context().scopedAllocator };
+        if(dims)
+            sobolBatchKernel(mMatrix32, indices.data(), count, 0, dims, mScramble, columns.data());
+
+        for(uint32_t idx = 0; idx < count; ++idx) {
+            const auto index = indices[idx];
+            if(mDims && mLazy) {
+                *providers[idx] = SampleProvider{ *this, index, mDims, index, columns.data() + idx, count };
+            } else {
+                std::pmr::vector<Float> samples{ dims, context().scopedAllocator };
+                for(uint32_t dim = 0; dim < dims; ++dim)
+                    samples[dim] = columns[static_cast<size_t>(dim) * count + idx];
+                *providers[idx] = SampleProvider{ std::move(samples), index };
+            }
+        }
+    }
+
+    void generate(const uint64_t sequenceIndex, const uint32_t dimBegin, const uint32_t count, Float* res) const noexcept override {
+        std::fill_n(res, count, std::bit_cast<Float>(mScramble));
+        sobolKernel(mMatrix32 + dimBegin, res, count, static_cast<uint32_t>(sequenceIndex));
     }
 };
 
@@ -103,7 +230,10 @@ class SobolSampler final : public Sampler {
     uint32_t mSampleCount;
     uint32_t mProvidedDims = matrixDims - 2;
     uint32_t mScramble = 0;
+    bool mLazy = true;
+    std::pmr::string mLUTCacheDir{ context().globalAllocator };
     LUT mMatrix32{ context().globalAllocator };
+    Ref<SobolLUT> mLUT;
 
 public:
     explicit SobolSampler(const Ref<ConfigNode>& node) : mSampleCount{ node->get("SampleCount"sv)->as<uint32_t>() } {
@@ -111,6 +241,10 @@ public:
             mProvidedDims = (*ptr)->as<uint32_t>();
         if(const auto ptr = node->tryGet("Scramble"sv))
             mScramble = (*ptr)->as<uint32_t>();
+        if(const auto ptr = node->tryGet("LazyGeneration"sv))
+            mLazy = (*ptr)->as<bool>();
+        if(const auto ptr = node->tryGet("LUTCacheDir"sv))
+            mLUTCacheDir = (*ptr)->as<std::string_view>();
         mMatrix32.resize(matrixDims * 32);
         for(uint32_t idx = 2; idx < matrixDims; ++idx)
             for(uint32_t k = 0; k < 32; ++k)
@@ -120,33 +254,12 @@ public:
     Ref<TileSampler> prepare(const uint32_t frameIdx, const uint32_t width, const uint32_t height, uint32_t) override {
         const auto scramble = static_cast<uint32_t>(seeding(mScramble + frameIdx));
         const auto logSize = static_cast<uint32_t>(std::ceil(std::log2(std::max(width, height))));
-        const auto size = 1U << logSize;
-        const auto count = size * mSampleCount;
-        const auto allocator = context().globalAllocator;
-
-        LUT c0Lower{ count, allocator }, c0Upper{ count, allocator }, c0LowerInverse{ count, allocator }, c1Lower{ count, allocator },
-            c1Upper{ count, allocator }, c1UpperInverse{ count, allocator };
-
-        for(uint32_t idx = 0; idx < mSampleCount; ++idx) {
-            const auto base = idx * size;
-            const auto shift = idx << (logSize << 1);
 
-            for(uint32_t i = 0; i < size; ++i) {
-                const auto j = vanDerCorput(i, 0);
-                c0Lower[base + i] = j;
-                c0LowerInverse[base + (j >> (32 - logSize))] = i;
-                c0Upper[base + i] = vanDerCorput((i << logSize) | shift, 0);
-
-                c1Lower[base + i] = sobol(i, 0);
-                const auto k = sobol((i << logSize) | shift, 0);
-                c1Upper[base + i] = k;
-                c1UpperInverse[base + (k >> (32 - logSize))] = i;
-            }
-        }
+        // only the scramble changes between frames
+        if(!mLUT || mLUT->logSize != logSize)
+            mLUT = makeRefCount<SobolLUT>(logSize, mSampleCount, mLUTCacheDir);
 
-        return makeRefCount<SobolTileSampler>(mProvidedDims, mSampleCount, logSize, scramble, mMatrix32.data(), std::move(c0Lower),
-                                              std::move(c0Upper), std::move(c0LowerInverse), std::move(c1Lower), std::move(c1Upper),
-                                              std::move(c1UpperInverse));
+        return makeRefCount<SobolTileSampler>(mProvidedDims, scramble, mLazy, mMatrix32.data(), mLUT);
     }
 };
 
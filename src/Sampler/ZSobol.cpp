@@ -0,0 +1,157 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/Report.hpp>
+#include <Piper/Core/StaticFactory.hpp>
+#include <Piper/Render/Sampler.hpp>
+
+PIPER_NAMESPACE_BEGIN
+
+// Please refer to "Screen-Space Blue-Noise Diffusion of Monte Carlo Sampling Error via Hierarchical Ordering of Pixels"
+// (Ahmed and Wonka 2020) and the ZSobolSampler of pbrt-v4
+// NOTICE: the global Sobol index is derived from the Morton code of the pixel, no table is needed
+
+static uint64_t leftShift2(uint64_t x) {
+    x &= 0xffffffff;
+    x = (x ^ (x << 16)) & 0x0000ffff0000ffff;
+    x = (x ^ (x << 8)) & 0x00ff00ff00ff00ff;
+    x = (x ^ (x << 4)) & 0x0f0f0f0f0f0f0f0f;
+    x = (x ^ (x << 2)) & 0x3333333333333333;
+    x = (x ^ (x << 1)) & 0x5555555555555555;
+    return x;
+}
+
+static uint64_t encodeMorton2(const uint32_t x, const uint32_t y) {
+    return (leftShift2(y) << 1) | leftShift2(x);
+}
+
+static uint32_t sobol1(uint32_t index) {
+    uint32_t res = 0;
+    for(uint32_t v = 1U << 31; index; index >>= 1, v ^= v >> 1)
+        if(index & 1)
+            res ^= v;
+    return res;
+}
+
+// Please refer to "Practical Hash-based Owen Scrambling" (Burley 2020)
+static uint32_t fastOwenScramble(uint32_t x, const uint32_t seed) {
+    x = glm::bitfieldReverse(x);
+    x ^= x * 0x3d20adeaU;
+    x += seed;
+    x *= (seed >> 16) | 1;
+    x ^= x * 0x05526c56U;
+    x ^= x * 0x53a22864U;
+    return glm::bitfieldReverse(x);
+}
+
+static Float toUnitFloat(const uint32_t x) {
+    return std::fmin(oneMinusEpsilon, static_cast<Float>(x) * 0x1p-32f);
+}
+
+// all permutations of the base-4 digits
+constexpr uint8_t digitPermutations[24][4] = {
+    { 0, 1, 2, 3 }, { 0, 1, 3, 2 }, { 0, 2, 1, 3 }, { 0, 2, 3, 1 }, { 0, 3, 2, 1 }, { 0, 3, 1, 2 }, { 1, 0, 2, 3 }, { 1, 0, 3, 2 },
+    { 1, 2, 0, 3 }, { 1, 2, 3, 0 }, { 1, 3, 2, 0 }, { 1, 3, 0, 2 }, { 2, 1, 0, 3 }, { 2, 1, 3, 0 }, { 2, 0, 1, 3 }, { 2, 0, 3, 1 },
+    { 2, 3, 0, 1 }, { 2, 3, 1, 0 }, { 3, 1, 2, 0 }, { 3, 1, 0, 2 }, { 3, 2, 1, 0 }, { 3, 2, 0, 1 }, { 3, 0, 2, 1 }, { 3, 0, 1, 2 }
+};
+
+class ZSobolTileSampler final : public TileSampler, public SampleGenerator {
+    uint32_t mDims;
+    uint32_t mSampleCount;
+    uint32_t mLog2SampleCount;
+    uint32_t mBase4Digits;
+    uint64_t mSeed;
+
+    // the base-4 digits of the Morton index are shuffled by the permutations hashed from the higher digits
+    [[nodiscard]] uint64_t sampleIndex(const uint64_t mortonIndex, const uint32_t dim) const noexcept {
+        const auto dimSalt = 0x55555555ULL * dim;
+        const bool oddLog2 = mLog2SampleCount & 1;
+        uint64_t res = 0;
+        for(auto idx = static_cast<int32_t>(mBase4Digits) - 1; idx >= static_cast<int32_t>(oddLog2); --idx) {
+            const auto shift = 2 * idx - static_cast<int32_t>(oddLog2);
+            const auto digit = (mortonIndex >> shift) & 3;
+            const auto perm = (seeding((mortonIndex >> (shift + 2)) ^ dimSalt) >> 24) % 24;
+            res |= static_cast<uint64_t>(digitPermutations[perm][digit]) << shift;
+        }
+        // the last binary digit for the odd power of 2 sample count
+        if(oddLog2)
+            res |= (mortonIndex & 1) ^ (seeding((mortonIndex >> 1) ^ dimSalt) & 1);
+        return res;
+    }
+
+    [[nodiscard]] glm::vec2 sample2D(const uint64_t mortonIndex, const uint32_t dim) const noexcept {
+        // NOTICE: the 32-bit generator matrices ignore the index bits above 32, which only select the coarse screen regions
+        const auto index = static_cast<uint32_t>(sampleIndex(mortonIndex, dim));
+        const auto hash = seeding(mSeed ^ seeding(dim));
+        return { toUnitFloat(fastOwenScramble(glm::bitfieldReverse(index), static_cast<uint32_t>(hash))),
+                 toUnitFloat(fastOwenScramble(sobol1(index), static_cast<uint32_t>(hash >> 32))) };
+    }
+
+public:
+    ZSobolTileSampler(const uint32_t dims, const uint32_t sampleCount, const uint32_t logResolution, const uint64_t seed)
+        : mDims{ dims }, mSampleCount{ sampleCount }, mLog2SampleCount{ static_cast<uint32_t>(std::bit_width(sampleCount - 1)) },
+          mBase4Digits{ logResolution + (mLog2SampleCount + 1) / 2 }, mSeed{ seed } {}
+
+    uint32_t samples() const noexcept override {
+        return mSampleCount;
+    }
+
+    std::pair<glm::vec2, SampleProvider> generate(const uint32_t filmX, const uint32_t filmY, const uint32_t sampleIdx) const override {
+        const auto mortonIndex = (encodeMorton2(filmX, filmY) << mLog2SampleCount) | sampleIdx;
+        const auto pixelSample = glm::vec2{ filmX, filmY } + sample2D(mortonIndex, 0);
+        return { pixelSample, SampleProvider{ *this, mortonIndex, mDims, mortonIndex ^ mSeed } };
+    }
+
+    void generate(const uint64_t sequenceIndex, const uint32_t dimBegin, const uint32_t count, Float* res) const noexcept override {
+        // the consecutive dimensions form the Sobol pairs, the pair 0 is used by the pixel sample
+        const auto dimEnd = dimBegin + count;
+        for(auto dim = dimBegin; dim < dimEnd;) {
+            const auto u = sample2D(sequenceIndex, 2 + (dim & ~1U));
+            for(auto k = dim & 1; k < 2 && dim < dimEnd; ++k, ++dim)
+                res[dim - dimBegin] = u[static_cast<int>(k)];
+        }
+    }
+};
+
+class ZSobolSampler final : public Sampler {
+    uint32_t mSampleCount;
+    uint32_t mProvidedDims = 1024;
+    uint32_t mScramble = 0;
+
+public:
+    explicit ZSobolSampler(const Ref<ConfigNode>& node) : mSampleCount{ node->get("SampleCount"sv)->as<uint32_t>() } {
+        if(const auto ptr = node->tryGet("ProvidedDims"sv))
+            mProvidedDims = (*ptr)->as<uint32_t>();
+        if(const auto ptr = node->tryGet("Scramble"sv))
+            mScramble = (*ptr)->as<uint32_t>();
+        if(mSampleCount == 0 || mSampleCount > (1U << 24))
+            fatal(fmt::format("The sample count {} of ZSobolSampler should be in [1, 2^24]", mSampleCount));
+    }
+
+    Ref<TileSampler> prepare(const uint32_t frameIdx, const uint32_t width, const uint32_t height, uint32_t) override {
+        const auto logResolution = static_cast<uint32_t>(std::bit_width(std::max(width, height) - 1));
+        // only the seed changes between frames
+        return makeRefCount<ZSobolTileSampler>(mProvidedDims, mSampleCount, logResolution, seeding(mScramble + frameIdx));
+    }
+};
+
+PIPER_REGISTER_CLASS(ZSobolSampler, Sampler);
+
+PIPER_NAMESPACE_END
@@ -0,0 +1,1252 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/ConfigNode.hpp>
+#include <Piper/Core/FileIO.hpp>
+#include <Piper/Core/Report.hpp>
+#include <Piper/Core/StaticFactory.hpp>
+#include <Piper/Render/Math.hpp>
+#include <Piper/Render/Pipeline.hpp>
+#include <Piper/Render/Spectrum.hpp>
+#include <bit>
+#include <charconv>
+#include <fstream>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <list>
+#include <map>
+#include <mutex>
+#include <oneapi/tbb/task_group.h>
+#include <set>
+#include <thread>
+
+PIPER_NAMESPACE_BEGIN
+
+RGBSpectrum temperatureToSpectrum(Float temperature) noexcept;
+
+// Please refer to https://pbrt.org/fileformat-v4
+// The scene is converted to the same description as the JSON scenes, except that the meshes are referenced by their paths, so that
+// the vertices never go through the config nodes and the PLY files are loaded by the mesh cache like the other meshes.
+namespace {
+    Ref<ConfigAttr> toAttr(const double value) {
+        return makeRefCount<ConfigAttr>(value);
+    }
+    Ref<ConfigAttr> toAttr(const uint32_t value) {
+        return makeRefCount<ConfigAttr>(value);
+    }
+    Ref<ConfigAttr> toAttr(const bool value) {
+        return makeRefCount<ConfigAttr>(value);
+    }
+    Ref<ConfigAttr> toAttr(const std::string_view value) {
+        return makeRefCount<ConfigAttr>(std::pmr::string{ value, context().globalAllocator });
+    }
+    Ref<ConfigAttr> toAttr(Ref<ConfigNode> value) {
+        return makeRefCount<ConfigAttr>(std::move(value));
+    }
+    Ref<ConfigAttr> toAttr(ConfigAttr::AttrArray value) {
+        return makeRefCount<ConfigAttr>(std::move(value));
+    }
+    Ref<ConfigAttr> makeArray(const std::initializer_list<Ref<ConfigAttr>> items) {
+        return toAttr(ConfigAttr::AttrArray{ items, trackedAllocator(MemoryTag::Config) });
+    }
+    template <glm::length_t N>
+    Ref<ConfigAttr> toAttr(const glm::vec<N, Float>& value) {
+        ConfigAttr::AttrArray arr{ trackedAllocator(MemoryTag::Config) };
+        for(glm::length_t idx = 0; idx < N; ++idx)
+            arr.push_back(toAttr(static_cast<double>(value[idx])));
+        return toAttr(std::move(arr));
+    }
+
+    // NOTICE: the names and the types are views, so only the literals are used
+    Ref<ConfigNode> makeNode(const std::string_view type, ConfigNode::AttrMap attrs, const std::string_view name = "Unnamed"sv) {
+        return makeRefCount<ConfigNode>(name, type, std::move(attrs), Ref<RefCountBase>{});
+    }
+    Ref<ConfigNode> makeNode(const std::string_view type, const std::initializer_list<ConfigNode::AttrMap::value_type> attrs,
+                             const std::string_view name = "Unnamed"sv) {
+        return makeNode(type, ConfigNode::AttrMap{ attrs, trackedAllocator(MemoryTag::Config) }, name);
+    }
+
+    Ref<ConfigNode> makeRGB(const glm::vec3 value) {
+        return makeNode("RGBSpectrumTexture"sv, { { "Value"sv, toAttr(value) }, { "ColorSpace"sv, toAttr("lin_rec709"sv) } });
+    }
+
+    [[nodiscard]] bool isQuoted(const std::string_view token) noexcept {
+        return token.size() >= 2 && token.front() == '"';
+    }
+    [[nodiscard]] std::string_view unquote(const std::string_view token) noexcept {
+        return token.substr(1, token.size() - 2);
+    }
+
+    // A zero-copy tokenizer over the mapped file, the tokens are the views of the mapping and nothing is buffered except one token
+    // of lookahead.
+    // NOTICE: the escape sequences in the strings are not supported
+    class Tokenizer final {
+        std::string_view mPath;
+        std::string_view mData;
+        size_t mPos = 0;
+        std::optional<std::string_view> mPeeked;
+
+        [[nodiscard]] static bool isDelimiter(const char ch) noexcept {
+            return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n' || ch == '[' || ch == ']' || ch == '"' || ch == '#';
+        }
+
+        std::optional<std::string_view> read() {
+            while(mPos < mData.size()) {
+                if(const auto ch = mData[mPos]; ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n')
+                    ++mPos;
+                else if(ch == '#')
+                    mPos = std::min(mData.find('\n', mPos), mData.size());
+                else
+                    break;
+            }
+            if(mPos == mData.size())
+                return std::nullopt;
+
+            const auto begin = mPos;
+            if(const auto ch = mData[mPos]; ch == '[' || ch == ']')
+                ++mPos;
+            else if(ch == '"') {
+                const auto end = mData.find('"', begin + 1);
+                if(end == std::string_view::npos)
+                    error("Unterminated string");
+                mPos = end + 1;
+            } else
+                while(mPos < mData.size() && !isDelimiter(mData[mPos]))
+                    ++mPos;
+            return mData.substr(begin, mPos - begin);
+        }
+
+    public:
+        Tokenizer(const std::string_view path, const std::string_view data) : mPath{ path }, mData{ data } {}
+
+        std::optional<std::string_view> next() {
+            if(mPeeked)
+                return std::exchange(mPeeked, std::nullopt);
+            return read();
+        }
+        std::optional<std::string_view> peek() {
+            if(!mPeeked)
+                mPeeked = read();
+            return mPeeked;
+        }
+        std::string_view expect() {
+            const auto token = next();
+            if(!token)
+                error("Unexpected end of file");
+            return *token;
+        }
+
+        // the line number is only counted on errors
+        [[noreturn]] void error(const std::string_view message) const {
+            const auto line = std::count(mData.begin(), mData.begin() + static_cast<ptrdiff_t>(std::min(mPos, mData.size())), '\n') + 1;
+            fatal(fmt::format("{}:{}: {}", mPath, line, message));
+        }
+    };
+
+    struct Parameter final {
+        std::string_view type;
+        std::string_view name;
+        std::vector<double> numbers;
+        std::vector<std::string_view> strings;  // the unquoted strings and the bools
+    };
+
+    class ParameterList final {
+        std::vector<Parameter> mParameters;
+
+    public:
+        void clear() noexcept {
+            mParameters.clear();
+        }
+        Parameter& add() {
+            return mParameters.emplace_back();
+        }
+
+        [[nodiscard]] const Parameter* find(const std::string_view name) const noexcept {
+            for(auto& param : mParameters)
+                if(param.name == name)
+                    return &param;
+            return nullptr;
+        }
+        [[nodiscard]] double getNumber(const std::string_view name, const double fallback) const noexcept {
+            const auto param = find(name);
+            return param && !param->numbers.empty() ? param->numbers.front() : fallback;
+        }
+        [[nodiscard]] std::span<const double> getNumbers(const std::string_view name) const noexcept {
+            if(const auto param = find(name))
+                return param->numbers;
+            return {};
+        }
+        [[nodiscard]] std::string_view getString(const std::string_view name, const std::string_view fallback) const noexcept {
+            const auto param = find(name);
+            return param && !param->strings.empty() ? param->strings.front() : fallback;
+        }
+        [[nodiscard]] bool getBool(const std::string_view name, const bool fallback) const noexcept {
+            const auto param = find(name);
+            return param && !param->strings.empty() ? param->strings.front() == "true"sv : fallback;
+        }
+        [[nodiscard]] glm::vec3 getVec3(const std::string_view name, const glm::vec3 fallback) const noexcept {
+            const auto numbers = getNumbers(name);
+            if(numbers.size() != 3)
+                return fallback;
+            return { numbers[0], numbers[1], numbers[2] };
+        }
+    };
+
+    using TransformPair = std::array<glm::mat4, 2>;  // at the start time and the end time
+
+    struct InstanceShape final {
+        Ref<ConfigNode> component;
+        TransformPair transform;
+    };
+
+    // the named definitions are global in pbrt-v4, the imported files get their own copies
+    struct Definitions final {
+        std::map<std::string, Ref<ConfigNode>, std::less<>> materials;
+        std::map<std::string, Ref<ConfigNode>, std::less<>> spectrumTextures;
+        std::map<std::string, Ref<ConfigAttr>, std::less<>> floatTextures;
+        std::map<std::string, TransformPair, std::less<>> coordinateSystems;
+        std::map<std::string, std::vector<InstanceShape>, std::less<>> objects;
+    };
+
+    struct GraphicsState final {
+        TransformPair transform{ glm::mat4{ 1.0f }, glm::mat4{ 1.0f } };
+        uint32_t activeTransforms = 3;    // bit 0: the start transform, bit 1: the end transform
+        Ref<ConfigNode> material;         // null for the interface material
+        Ref<ConfigNode> areaLight;
+        bool reverseOrientation = false;
+        bool transformOnly = false;  // pushed by the deprecated TransformBegin
+    };
+
+    struct CameraDesc final {
+        std::string type = "perspective";
+        glm::vec3 eye{ 0.0f }, forward{ 0.0f, 0.0f, 1.0f }, up{ 0.0f, 1.0f, 0.0f };
+        double fov = 90.0;
+        double lensRadius = 0.0;
+        double focalDistance = 1e6;
+        std::string lensFile;
+        double apertureDiameter = 1.0;
+        double focusDistance = 10.0;
+        double shutterOpen = 0.0, shutterClose = 1.0;
+    };
+
+    // the options before WorldBegin
+    struct RenderOptions final {
+        CameraDesc camera;
+        bool hasCamera = false;
+        uint32_t width = 1280, height = 720;
+        double diagonal = 35.0;
+        std::string fileName = "pbrt.exr";
+        uint32_t sampleCount = 16;
+        std::string sampler = "zsobol";
+        Ref<ConfigNode> integrator;
+        Ref<ConfigNode> lightSampler;
+        Ref<ConfigNode> filter;
+    };
+
+    struct SharedState final {
+        fs::path baseDir;  // pbrt-v4 resolves all relative paths against the directory of the main file
+        fs::path meshDir;
+        // pbrt is left-handed, the world is mirrored if the camera basis would be mirrored in Piper
+        glm::mat4 handedness{ 1.0f };
+        std::array<double, 2> transformTimes{ 0.0, 1.0 };
+        RenderOptions options;
+        tbb::task_group tasks;
+
+        std::mutex mutex;
+        std::set<std::string, std::less<>> warnings;
+
+        [[nodiscard]] std::string resolve(const std::string_view name) const {
+            const fs::path path{ name };
+            return (path.is_absolute() ? path : baseDir / path).string();
+        }
+
+        // the unsupported features are reported once instead of once per shape
+        void warnOnce(const std::string_view key, const std::string_view message) {
+            {
+                std::lock_guard guard{ mutex };
+                if(!warnings.emplace(key).second)
+                    return;
+            }
+            warning(std::string{ message });
+        }
+    };
+
+    struct ImportTask;
+
+    struct ParseResult final {
+        std::vector<Ref<ConfigAttr>> objects;
+        std::list<ImportTask> imports;  // spliced in order after all imports are parsed
+
+        void flatten(ConfigAttr::AttrArray& output);
+    };
+
+    struct ImportTask final {
+        std::string path;
+        GraphicsState state;
+        Definitions definitions;
+        ParseResult result;
+    };
+
+    void ParseResult::flatten(ConfigAttr::AttrArray& output) {
+        output.insert(output.end(), objects.begin(), objects.end());
+        for(auto& task : imports)
+            task.result.flatten(output);
+    }
+
+    // pbrt uses the general matrices, but the keyframes of Piper only support the scale-rotation-translation transforms
+    std::optional<std::tuple<glm::vec3, glm::quat, glm::vec3>> decompose(const glm::mat4& matrix, bool& exact) {
+        const glm::vec3 translation{ matrix[3] };
+        glm::mat3 linear{ matrix };
+        glm::vec3 scale{ glm::length(linear[0]), glm::length(linear[1]), glm::length(linear[2]) };
+        if(scale.x == 0.0f || scale.y == 0.0f || scale.z == 0.0f)  // NOLINT(clang-diagnostic-float-equal)
+            return std::nullopt;
+        if(glm::determinant(linear) < 0.0f)
+            scale.x = -scale.x;
+        for(glm::length_t idx = 0; idx < 3; ++idx)
+            linear[idx] /= scale[idx];
+
+        constexpr auto tolerance = 1e-3f;
+        exact = std::fabs(glm::dot(linear[0], linear[1])) < tolerance && std::fabs(glm::dot(linear[0], linear[2])) < tolerance &&
+            std::fabs(glm::dot(linear[1], linear[2])) < tolerance && std::fabs(matrix[0][3]) < tolerance &&
+            std::fabs(matrix[1][3]) < tolerance && std::fabs(matrix[2][3]) < tolerance && std::fabs(matrix[3][3] - 1.0f) < tolerance;
+        return std::make_tuple(scale, glm::normalize(glm::quat_cast(linear)), translation);
+    }
+
+    // Please refer to LookAt in pbrt-v4 src/pbrt/util/transform.cpp
+    glm::mat4 lookAt(const glm::vec3 eye, const glm::vec3 look, const glm::vec3 up) {
+        const auto dir = glm::normalize(look - eye);
+        const auto right = glm::normalize(glm::cross(glm::normalize(up), dir));
+        const auto newUp = glm::cross(dir, right);
+        const glm::mat4 worldFromCamera{ glm::vec4{ right, 0.0f }, glm::vec4{ newUp, 0.0f }, glm::vec4{ dir, 0.0f },
+                                         glm::vec4{ eye, 1.0f } };
+        return glm::inverse(worldFromCamera);
+    }
+
+    // The inline meshes are written to the binary PLY files named by their contents, so that they are imported and cached like the
+    // other meshes and the following runs map them from the mesh cache directly.
+    std::string saveMesh(const fs::path& directory, const std::span<const double> positions, const std::span<const uint32_t> indices,
+                         const std::span<const double> normals, const std::span<const double> texCoords) {
+        static_assert(std::endian::native == std::endian::little);
+
+        const auto verticesCount = positions.size() / 3;
+        const auto hasNormals = normals.size() == positions.size();
+        const auto hasTexCoords = texCoords.size() == verticesCount * 2;
+
+        std::string blob = fmt::format("ply\nformat binary_little_endian 1.0\nelement vertex {}\n"
+                                       "property float x\nproperty float y\nproperty float z\n",
+                                       verticesCount);
+        if(hasNormals)
+            blob += "property float nx\nproperty float ny\nproperty float nz\n";
+        if(hasTexCoords)
+            blob += "property float u\nproperty float v\n";
+        blob += fmt::format("element face {}\nproperty list uchar int vertex_indices\nend_header\n", indices.size() / 3);
+
+        const auto append = [&]<typename T>(const T value) { blob.append(reinterpret_cast<const char*>(&value), sizeof(T)); };
+        for(size_t idx = 0; idx < verticesCount; ++idx) {
+            for(size_t k = 0; k < 3; ++k)
+                append(static_cast<float>(positions[idx * 3 + k]));
+            if(hasNormals)
+                for(size_t k = 0; k < 3; ++k)
+                    append(static_cast<float>(normals[idx * 3 + k]));
+            if(hasTexCoords)
+                for(size_t k = 0; k < 2; ++k)
+                    append(static_cast<float>(texCoords[idx * 2 + k]));
+        }
+        for(size_t idx = 0; idx + 2 < indices.size(); idx += 3) {
+            append(static_cast<uint8_t>(3));
+            for(size_t k = 0; k < 3; ++k)
+                append(static_cast<int32_t>(indices[idx + k]));
+        }
+
+        // FNV-1a, the same as hashFile
+        uint64_t hash = 14695981039346656037ULL;
+        for(const auto ch : blob) {
+            hash ^= static_cast<uint8_t>(ch);
+            hash *= 1099511628211ULL;
+        }
+
+        const auto path = directory / fmt::format("pbrt-{:016x}.ply", hash);
+        if(!fs::exists(path)) {
+            // the same mesh may be written by several imports at once
+            auto tmpPath = path;
+            tmpPath += fmt::format(".{:016x}.tmp", std::hash<std::thread::id>{}(std::this_thread::get_id()));
+            {
+                std::ofstream out{ tmpPath, std::ios::out | std::ios::binary };
+                out.write(blob.data(), static_cast<std::streamsize>(blob.size()));
+                out.flush();
+                if(!out)
+                    fatal(fmt::format("Failed to save mesh \"{}\"", tmpPath.string()));
+            }
+            std::error_code ec;
+            fs::rename(tmpPath, path, ec);
+            if(ec && !fs::exists(path))
+                fatal(fmt::format("Failed to save mesh \"{}\": {}", path.string(), ec.message()));
+        }
+        return path.string();
+    }
+
+    class Parser final {
+        SharedState& mShared;
+        Definitions& mDefinitions;
+        ParseResult& mResult;
+        bool mInWorld;
+
+        Tokenizer* mTokenizer = nullptr;
+        ParameterList mParameters;
+        GraphicsState mState;
+        std::vector<GraphicsState> mStack;
+        std::vector<InstanceShape>* mCurrentObject = nullptr;
+
+        double parseNumber(std::string_view token) const {
+            if(token.starts_with('+'))
+                token.remove_prefix(1);
+            double value = 0.0;
+            if(const auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), value);
+               ec != std::errc{} || ptr != token.data() + token.size())
+                mTokenizer->error(fmt::format("Expect a number instead of \"{}\"", token));
+            return value;
+        }
+        double nextNumber() {
+            return parseNumber(mTokenizer->expect());
+        }
+        std::string_view nextString() {
+            const auto token = mTokenizer->expect();
+            if(!isQuoted(token))
+                mTokenizer->error(fmt::format("Expect a string instead of \"{}\"", token));
+            return unquote(token);
+        }
+        // the matrices may be bracketed or not
+        glm::mat4 nextMatrix() {
+            const auto bracketed = mTokenizer->peek() == "["sv;
+            if(bracketed)
+                mTokenizer->next();
+            std::array<float, 16> values;  // NOLINT(cppcoreguidelines-pro-type-member-init)
+            for(auto& value : values)
+                value = static_cast<float>(nextNumber());
+            if(bracketed && mTokenizer->expect() != "]"sv)
+                mTokenizer->error("Expect 16 numbers in the matrix");
+            // the values are column-major, the same as glm
+            return glm::make_mat4(values.data());
+        }
+
+        void addValue(Parameter& param, const std::string_view token) const {
+            if(isQuoted(token))
+                param.strings.push_back(unquote(token));
+            else if(token == "true"sv || token == "false"sv)
+                param.strings.push_back(token);
+            else
+                param.numbers.push_back(parseNumber(token));
+        }
+
+        // the parameters follow the positional arguments until the next directive
+        const ParameterList& parseParameters() {
+            mParameters.clear();
+            while(true) {
+                const auto token = mTokenizer->peek();
+                if(!token || !isQuoted(*token))
+                    break;
+                mTokenizer->next();
+
+                auto& param = mParameters.add();
+                const auto decl = unquote(*token);
+                const auto typeBegin = decl.find_first_not_of(" \t"sv);
+                const auto typeEnd = decl.find_first_of(" \t"sv, typeBegin);
+                const auto nameBegin = decl.find_first_not_of(" \t"sv, typeEnd);
+                if(typeBegin == std::string_view::npos || nameBegin == std::string_view::npos)
+                    mTokenizer->error(fmt::format("Bad parameter declaration \"{}\"", decl));
+                param.type = decl.substr(typeBegin, typeEnd - typeBegin);
+                param.name = decl.substr(nameBegin, decl.find_last_not_of(" \t"sv) + 1 - nameBegin);
+
+                if(const auto value = mTokenizer->expect(); value == "["sv) {
+                    for(auto item = mTokenizer->expect(); item != "]"sv; item = mTokenizer->expect())
+                        addValue(param, item);
+                } else
+                    addValue(param, value);
+            }
+            return mParameters;
+        }
+
+        void warnOnce(const std::string_view key, const std::string_view message) const {
+            mShared.warnOnce(key, message);
+        }
+
+        template <typename Func>
+        void applyTransform(Func&& func) {
+            for(uint32_t idx = 0; idx < 2; ++idx)
+                if(mState.activeTransforms & (1U << idx))
+                    mState.transform[idx] = func(mState.transform[idx]);
+        }
+
+        [[nodiscard]] Ref<ConfigAttr> makeKeyFrames(const TransformPair& transform) const {
+            ConfigAttr::AttrArray keyFrames{ trackedAllocator(MemoryTag::Config) };
+            const auto motion = transform[0] != transform[1];
+            for(uint32_t idx = 0; idx < (motion ? 2U : 1U); ++idx) {
+                bool exact = true;
+                const auto srt = decompose(mShared.handedness * transform[idx], exact);
+                if(!srt) {
+                    warnOnce("DegenerateTransform"sv, "The degenerate transforms are replaced by the identity"sv);
+                } else if(!exact)
+                    warnOnce("SkewTransform"sv, "The skew and the projective parts of the transforms are dropped"sv);
+                const auto [scale, rotation, translation] =
+                    srt.value_or(std::make_tuple(glm::vec3{ 1.0f }, glm::identity<glm::quat>(), glm::vec3{ 0.0f }));
+                // NOTICE: the last keyframe holds, so the shutter interval may exceed the transform times
+                keyFrames.push_back(toAttr(makeNode(
+                    "KeyFrame"sv,
+                    { { "Time"sv, toAttr(mShared.transformTimes[idx]) },
+                      { "InterpolationCurve"sv, toAttr(motion && idx == 0 ? "Linear"sv : "Hold"sv) },
+                      { "Scale"sv, toAttr(scale) },
+                      { "Rotation"sv, toAttr(glm::vec4{ rotation.w, rotation.x, rotation.y, rotation.z }) },
+                      { "Translation"sv, toAttr(translation) } })));
+            }
+            return toAttr(std::move(keyFrames));
+        }
+
+        void emit(const std::string_view componentType, const TransformPair& transform, Ref<ConfigNode> component,
+                  const std::string_view name) {
+            mResult.objects.push_back(toAttr(makeNode("SceneObject"sv,
+                                                      { { "ComponentType"sv, toAttr(componentType) },
+                                                        { "KeyFrames"sv, makeKeyFrames(transform) },
+                                                        { "Component"sv, toAttr(std::move(component)) } },
+                                                      name)));
+        }
+
+        [[nodiscard]] std::optional<glm::vec3> rgbOf(const Parameter& param) const {
+            if(param.type == "rgb"sv && param.numbers.size() == 3)
+                return glm::vec3{ param.numbers[0], param.numbers[1], param.numbers[2] };
+            if(param.type == "float"sv && !param.numbers.empty())
+                return glm::vec3{ static_cast<Float>(param.numbers.front()) };
+            // pbrt normalizes the blackbody spectra by their peaks
+            if(param.type == "blackbody"sv && !param.numbers.empty()) {
+                const auto rgb = temperatureToSpectrum(static_cast<Float>(param.numbers.front())).raw();
+                const auto peak = std::fmax(rgb.x, std::fmax(rgb.y, rgb.z));
+                return peak > 0.0f ? rgb / peak : rgb;
+            }
+            warnOnce(fmt::format("Spectrum.{}.{}", param.type, param.name),
+                     fmt::format("The {} value of parameter \"{}\" is not supported, the default value is used", param.type, param.name));
+            return std::nullopt;
+        }
+
+        [[nodiscard]] Ref<ConfigNode> spectrumTexture(const ParameterList& params, const std::string_view name, const glm::vec3 fallback,
+                                                      const Float scale = 1.0f) const {
+            const auto param = params.find(name);
+            if(param && param->type == "texture"sv && !param->strings.empty()) {
+                if(const auto iter = mDefinitions.spectrumTextures.find(param->strings.front());
+                   iter != mDefinitions.spectrumTextures.cend())
+                    return iter->second;
+                warnOnce(fmt::format("Texture.{}", param->strings.front()),
+                         fmt::format("Undefined spectrum texture \"{}\"", param->strings.front()));
+            } else if(param)
+                if(const auto rgb = rgbOf(*param))
+                    return makeRGB(*rgb * scale);
+            return makeRGB(fallback * scale);
+        }
+
+        [[nodiscard]] Ref<ConfigAttr> floatTexture(const ParameterList& params, const std::string_view name, const double fallback) const {
+            const auto param = params.find(name);
+            if(param && param->type == "texture"sv && !param->strings.empty()) {
+                if(const auto iter = mDefinitions.floatTextures.find(param->strings.front()); iter != mDefinitions.floatTextures.cend())
+                    return iter->second;
+                warnOnce(fmt::format("Texture.{}", param->strings.front()),
+                         fmt::format("Undefined float texture \"{}\"", param->strings.front()));
+            } else if(param && !param->numbers.empty())
+                return toAttr(param->numbers.front());
+            return toAttr(fallback);
+        }
+
+        void addRoughness(ConfigNode::AttrMap& attrs, const ParameterList& params, const std::string_view prefix) const {
+            const auto name = [&](const std::string_view attr) { return fmt::format("{}{}", prefix, attr); };
+            attrs.emplace_back("Roughness"sv, floatTexture(params, name("roughness"sv), 0.0));
+            if(params.find(name("uroughness"sv)))
+                attrs.emplace_back("RoughnessU"sv, floatTexture(params, name("uroughness"sv), 0.0));
+            if(params.find(name("vroughness"sv)))
+                attrs.emplace_back("RoughnessV"sv, floatTexture(params, name("vroughness"sv), 0.0));
+            attrs.emplace_back("RemapRoughness"sv, toAttr(params.getBool(name("remaproughness"sv), true)));
+        }
+
+        [[nodiscard]] Ref<ConfigNode> makeConductor(const ParameterList& params, const std::string_view prefix) const {
+            ConfigNode::AttrMap attrs{ trackedAllocator(MemoryTag::Config) };
+            const auto eta = params.find(fmt::format("{}eta", prefix));
+            const auto k = params.find(fmt::format("{}k", prefix));
+            // the measured metals of pbrt are named "metal-<Name>-eta" and "metal-<Name>-k", the same names as data/ior
+            constexpr auto metalPrefix = "metal-"sv, metalSuffix = "-eta"sv;
+            if(eta && eta->type == "spectrum"sv && !eta->strings.empty() && eta->strings.front().starts_with(metalPrefix) &&
+               eta->strings.front().ends_with(metalSuffix)) {
+                const auto metal = eta->strings.front();
+                attrs.emplace_back("Material"sv,
+                                   toAttr(metal.substr(metalPrefix.size(), metal.size() - metalPrefix.size() - metalSuffix.size())));
+            } else if(eta && k && eta->type != "spectrum"sv && k->type != "spectrum"sv) {
+                attrs.emplace_back("Eta"sv, toAttr(spectrumTexture(params, eta->name, glm::vec3{ 1.0f })));
+                attrs.emplace_back("K"sv, toAttr(spectrumTexture(params, k->name, glm::vec3{ 0.0f })));
+            } else {
+                if(eta || k || params.find(fmt::format("{}reflectance", prefix)))
+                    warnOnce("Conductor"sv, "Only the measured metals and the RGB eta and k are supported by conductor, copper is used"sv);
+                attrs.emplace_back("Material"sv, toAttr("Cu"sv));
+            }
+            addRoughness(attrs, params, prefix);
+            return makeNode("Conductor"sv, std::move(attrs));
+        }
+
+        [[nodiscard]] Ref<ConfigNode> makeDiffuse(const ParameterList& params) const {
+            return makeNode("Diffuse"sv, { { "Reflectance"sv, toAttr(spectrumTexture(params, "reflectance"sv, glm::vec3{ 0.5f })) } });
+        }
+
+        // the materials without counterparts are approximated by the closest ones
+        [[nodiscard]] Ref<ConfigNode> makeMaterial(const std::string_view type, const ParameterList& params) const {
+            if(type == "interface"sv)
+                return {};
+            if(type == "diffuse"sv)
+                return makeDiffuse(params);
+            if(type == "conductor"sv)
+                return makeConductor(params, ""sv);
+            if(type == "coatedconductor"sv) {
+                warnOnce("Material.coatedconductor"sv, "The coating of coatedconductor is ignored"sv);
+                return makeConductor(params, "conductor."sv);
+            }
+            if(type == "coateddiffuse"sv) {
+                warnOnce("Material.coateddiffuse"sv, "The coating of coateddiffuse is ignored"sv);
+                return makeDiffuse(params);
+            }
+            if(type == "dielectric"sv || type == "thindielectric"sv) {
+                if(type == "thindielectric"sv)
+                    warnOnce("Material.thindielectric"sv, "The thin dielectrics are converted to the dielectrics"sv);
+                ConfigNode::AttrMap attrs{ trackedAllocator(MemoryTag::Config) };
+                auto eta = 1.5;
+                if(const auto param = params.find("eta"sv); param && param->type == "float"sv && !param->numbers.empty())
+                    eta = param->numbers.front();
+                else if(param)
+                    warnOnce("Dielectric"sv, "The dispersive dielectrics are not supported, the index of refraction 1.5 is used"sv);
+                attrs.emplace_back("Eta"sv, toAttr(eta));
+                addRoughness(attrs, params, ""sv);
+                return makeNode("Dielectric"sv, std::move(attrs));
+            }
+            if(type == "mix"sv) {
+                warnOnce("Material.mix"sv, "The mixed materials are replaced by their first components"sv);
+                const auto name = params.getString("materials"sv, ""sv);
+                if(const auto iter = mDefinitions.materials.find(name); iter != mDefinitions.materials.cend())
+                    return iter->second;
+            } else
+                warnOnce(fmt::format("Material.{}", type),
+                         fmt::format("Material \"{}\" is not supported, it is replaced by diffuse", type));
+            return makeDiffuse(ParameterList{});
+        }
+
+        void defineTexture(const std::string_view name, const std::string_view type, const std::string_view texClass,
+                           const ParameterList& params) {
+            const auto isSpectrum = type == "spectrum"sv || type == "color"sv;
+            if(!isSpectrum && type != "float"sv)
+                mTokenizer->error(fmt::format("Unrecognized texture type \"{}\"", type));
+
+            if(texClass == "constant"sv) {
+                if(isSpectrum)
+                    mDefinitions.spectrumTextures.insert_or_assign(std::string{ name },
+                                                                   spectrumTexture(params, "value"sv, glm::vec3{ 1.0f }));
+                else
+                    mDefinitions.floatTextures.insert_or_assign(std::string{ name }, floatTexture(params, "value"sv, 1.0));
+            } else if(texClass == "scale"sv && isSpectrum) {
+                // only the constant scales are folded
+                const auto scale = params.getNumber("scale"sv, 1.0);
+                if(params.find("scale"sv) && params.find("scale"sv)->type == "texture"sv)
+                    warnOnce("Texture.scale"sv, "The textured scales are not supported"sv);
+                mDefinitions.spectrumTextures.insert_or_assign(
+                    std::string{ name }, spectrumTexture(params, "tex"sv, glm::vec3{ 1.0f }, static_cast<Float>(scale)));
+            } else if(texClass == "checkerboard"sv) {
+                const auto size = toAttr(glm::vec2{ 1.0 / params.getNumber("uscale"sv, 1.0), 1.0 / params.getNumber("vscale"sv, 1.0) });
+                if(isSpectrum)
+                    mDefinitions.spectrumTextures.insert_or_assign(
+                        std::string{ name },
+                        makeNode("CheckerBoard"sv,
+                                 { { "White"sv, toAttr(spectrumTexture(params, "tex1"sv, glm::vec3{ 1.0f })) },
+                                   { "Black"sv, toAttr(spectrumTexture(params, "tex2"sv, glm::vec3{ 0.0f })) },
+                                   { "Size"sv, size } }));
+                else
+                    mDefinitions.floatTextures.insert_or_assign(
+                        std::string{ name },
+                        toAttr(makeNode("CheckerBoard"sv,
+                                        { { "White"sv, floatTexture(params, "tex1"sv, 1.0) },
+                                          { "Black"sv, floatTexture(params, "tex2"sv, 0.0) },
+                                          { "Size"sv, size } })));
+            } else if(texClass == "imagemap"sv && isSpectrum) {
+                const auto wrap = params.getString("wrap"sv, "repeat"sv);
+                mDefinitions.spectrumTextures.insert_or_assign(
+                    std::string{ name },
+                    makeNode("BitMap"sv,
+                             { { "FilePath"sv, toAttr(mShared.resolve(params.getString("filename"sv, ""sv))) },
+                               { "Wrap"sv, toAttr(wrap == "black"sv ? "Black"sv : wrap == "clamp"sv ? "Clamp"sv : "Periodic"sv) } }));
+            } else
+                warnOnce(fmt::format("Texture.{}.{}", type, texClass),
+                         fmt::format("The {} texture \"{}\" is not supported, the textures of this class are undefined", type, texClass));
+        }
+
+        [[nodiscard]] Ref<ConfigNode> makeMeshComponent(std::string path) const {
+            ConfigNode::AttrMap attrs{ trackedAllocator(MemoryTag::Config) };
+            attrs.emplace_back("Path"sv, toAttr(path));
+            if(mState.material)
+                attrs.emplace_back("Surface"sv, toAttr(mState.material));
+            if(mState.areaLight) {
+                if(mCurrentObject)
+                    warnOnce("InstancedAreaLight"sv, "The area lights in the object instances are ignored"sv);
+                else {
+                    attrs.emplace_back("Emission"sv, toAttr(mState.areaLight));
+                    if(mState.reverseOrientation)
+                        warnOnce("ReverseOrientation"sv, "ReverseOrientation is ignored by the area lights"sv);
+                }
+            }
+            return makeNode("TriangleMesh"sv, std::move(attrs));
+        }
+
+        void shape(const std::string_view type, const ParameterList& params) {
+            if(!mState.material) {
+                warnOnce("Interface"sv, "The shapes with the interface material are skipped since the media are not imported"sv);
+                return;
+            }
+            if(params.find("alpha"sv))
+                warnOnce("Alpha"sv, "The alpha cutouts are not supported"sv);
+
+            std::string path;
+            if(type == "plymesh"sv) {
+                if(params.find("displacement"sv))
+                    warnOnce("Displacement"sv, "The displacement of the PLY meshes is ignored"sv);
+                path = mShared.resolve(params.getString("filename"sv, ""sv));
+            } else if(type == "trianglemesh"sv || type == "bilinearmesh"sv) {
+                const auto positions = params.getNumbers("P"sv);
+                const auto rawIndices = params.getNumbers("indices"sv);
+                std::vector<uint32_t> indices;
+                if(rawIndices.empty()) {
+                    // a single triangle or a single patch may omit the indices
+                    for(uint32_t idx = 0; idx < positions.size() / 3; ++idx)
+                        indices.push_back(idx);
+                } else
+                    for(const auto index : rawIndices)
+                        indices.push_back(static_cast<uint32_t>(index));
+
+                if(type == "bilinearmesh"sv) {
+                    // the vertices of a patch are p00, p10, p01 and p11
+                    std::vector<uint32_t> triangles;
+                    triangles.reserve(indices.size() / 4 * 6);
+                    for(size_t idx = 0; idx + 3 < indices.size(); idx += 4)
+                        for(const auto corner : { 0, 1, 3, 0, 3, 2 })
+                            triangles.push_back(indices[idx + corner]);
+                    indices = std::move(triangles);
+                }
+                if(positions.empty() || indices.size() % 3 != 0 ||
+                   std::ranges::any_of(indices, [&](const uint32_t index) { return index >= positions.size() / 3; }))
+                    mTokenizer->error(fmt::format("Invalid {}", type));
+                path = saveMesh(mShared.meshDir, positions, indices, params.getNumbers("N"sv), params.getNumbers("uv"sv));
+            } else {
+                warnOnce(fmt::format("Shape.{}", type), fmt::format("Shape \"{}\" is not supported, it is skipped", type));
+                return;
+            }
+
+            auto component = makeMeshComponent(std::move(path));
+            if(mCurrentObject)
+                mCurrentObject->push_back({ std::move(component), mState.transform });
+            else
+                emit("Shape"sv, mState.transform, std::move(component), "Shape"sv);
+        }
+
+        void lightSource(const std::string_view type, const ParameterList& params) {
+            const auto scale = static_cast<Float>(params.getNumber("scale"sv, 1.0));
+            if(params.find("power"sv))
+                warnOnce("LightPower"sv, "The power normalization of the lights is ignored"sv);
+            const auto from = params.getVec3("from"sv, glm::vec3{ 0.0f });
+            const auto to = params.getVec3("to"sv, glm::vec3{ 0.0f, 0.0f, 1.0f });
+
+            if(type == "point"sv) {
+                const auto intensity = spectrumTexture(params, "I"sv, glm::vec3{ 1.0f }, scale);
+                auto transform = mState.transform;
+                for(auto& matrix : transform)
+                    matrix = glm::translate(matrix, from);
+                emit("Light"sv, transform, makeNode("PointLight"sv, { { "Intensity"sv, toAttr(intensity) } }), "Light"sv);
+            } else if(type == "spot"sv) {
+                const auto intensity = spectrumTexture(params, "I"sv, glm::vec3{ 1.0f }, scale);
+                const auto coneAngle = glm::radians(params.getNumber("coneangle"sv, 30.0));
+                const auto coneDelta = glm::radians(params.getNumber("conedelta"sv, 5.0));
+                // the spot lights of Piper point to +z
+                const auto lightFromObject = glm::inverse(lookAt(from, to, std::fabs(glm::normalize(to - from).y) < 0.99f ?
+                                                                     glm::vec3{ 0.0f, 1.0f, 0.0f } :
+                                                                     glm::vec3{ 1.0f, 0.0f, 0.0f }));
+                auto transform = mState.transform;
+                for(auto& matrix : transform)
+                    matrix = matrix * lightFromObject;
+                emit("Light"sv, transform,
+                     makeNode("SpotLight"sv,
+                              { { "Intensity"sv, toAttr(intensity) },
+                                { "TotalWidth"sv, toAttr(coneAngle) },
+                                { "FalloffStart"sv, toAttr(std::fmax(coneAngle - coneDelta, 0.0)) } }),
+                     "Light"sv);
+            } else if(type == "distant"sv) {
+                const auto radiance = spectrumTexture(params, "L"sv, glm::vec3{ 1.0f }, scale);
+                // the direction of the light travelling in the world space
+                const auto direction = glm::normalize(glm::mat3{ mShared.handedness * mState.transform[0] } * (to - from));
+                emit("Light"sv, { glm::mat4{ 1.0f }, glm::mat4{ 1.0f } },
+                     makeNode("DirectionalLight"sv, { { "Intensity"sv, toAttr(radiance) }, { "Direction"sv, toAttr(direction) } }),
+                     "Light"sv);
+            } else if(type == "infinite"sv) {
+                // NOTICE: pbrt-v4 uses the equal-area octahedral mapping instead of the equirectangular mapping of EnvLight
+                if(params.find("filename"sv)) {
+                    warnOnce("InfiniteLightImage"sv, "The image infinite lights are not supported, they are skipped"sv);
+                    return;
+                }
+                emit("Light"sv, mState.transform,
+                     makeNode("EnvLight"sv,
+                              { { "Texture"sv, toAttr(spectrumTexture(params, "L"sv, glm::vec3{ 1.0f })) },
+                                { "Scale"sv, toAttr(static_cast<double>(scale)) } }),
+                     "Light"sv);
+            } else
+                warnOnce(fmt::format("Light.{}", type), fmt::format("Light \"{}\" is not supported, it is skipped", type));
+        }
+
+        void areaLightSource(const std::string_view type, const ParameterList& params) {
+            if(type != "diffuse"sv)
+                mTokenizer->error(fmt::format("Unrecognized area light \"{}\"", type));
+            if(params.find("filename"sv))
+                warnOnce("AreaLightImage"sv, "The image area lights are not supported"sv);
+            mState.areaLight = makeNode("AreaLight"sv,
+                                        { { "Radiance"sv, toAttr(spectrumTexture(params, "L"sv, glm::vec3{ 1.0f })) },
+                                          { "Scale"sv, toAttr(params.getNumber("scale"sv, 1.0)) },
+                                          { "TwoSided"sv, toAttr(params.getBool("twosided"sv, false)) } });
+        }
+
+        void camera(const std::string_view type, const ParameterList& params) {
+            auto& desc = mShared.options.camera;
+            desc.type = type;
+
+            const auto worldFromCamera = glm::inverse(mState.transform[0]);
+            const glm::vec3 eye{ worldFromCamera[3] };
+            const auto forward = glm::normalize(glm::vec3{ worldFromCamera * glm::vec4{ 0.0f, 0.0f, 1.0f, 0.0f } });
+            const auto up = glm::normalize(glm::vec3{ worldFromCamera * glm::vec4{ 0.0f, 1.0f, 0.0f, 0.0f } });
+            const auto right = glm::vec3{ worldFromCamera * glm::vec4{ 1.0f, 0.0f, 0.0f, 0.0f } };
+            // ThinLens uses right = cross(forward, up), the world is mirrored if the camera of pbrt has the other handedness
+            const auto mirrored = glm::dot(right, glm::cross(forward, up)) < 0.0f;
+            mShared.handedness = glm::scale(glm::mat4{ 1.0f }, glm::vec3{ mirrored ? -1.0f : 1.0f, 1.0f, 1.0f });
+            const glm::mat3 mirror{ mShared.handedness };
+            desc.eye = mirror * eye;
+            desc.forward = mirror * forward;
+            desc.up = mirror * up;
+
+            desc.fov = params.getNumber("fov"sv, 90.0);
+            desc.lensRadius = params.getNumber("lensradius"sv, 0.0);
+            desc.focalDistance = params.getNumber("focaldistance"sv, 1e6);
+            desc.lensFile = mShared.resolve(params.getString("lensfile"sv, ""sv));
+            desc.apertureDiameter = params.getNumber("aperturediameter"sv, 1.0);
+            desc.focusDistance = params.getNumber("focusdistance"sv, 10.0);
+            desc.shutterOpen = params.getNumber("shutteropen"sv, 0.0);
+            desc.shutterClose = params.getNumber("shutterclose"sv, 1.0);
+            if(type != "perspective"sv && type != "realistic"sv)
+                warnOnce("Camera"sv, fmt::format("Camera \"{}\" is not supported, it is replaced by the perspective camera", type));
+
+            mShared.options.hasCamera = true;
+            mDefinitions.coordinateSystems.insert_or_assign("camera", TransformPair{ worldFromCamera, worldFromCamera });
+        }
+
+        void film(const ParameterList& params) {
+            auto& options = mShared.options;
+            options.width = static_cast<uint32_t>(params.getNumber("xresolution"sv, 1280.0));
+            options.height = static_cast<uint32_t>(params.getNumber("yresolution"sv, 720.0));
+            options.diagonal = params.getNumber("diagonal"sv, 35.0);
+            options.fileName = params.getString("filename"sv, "pbrt.exr"sv);
+            if(params.find("cropwindow"sv) || params.find("pixelbounds"sv))
+                warnOnce("Crop"sv, "The crop windows are ignored"sv);
+        }
+
+        void pixelFilter(const std::string_view type, const ParameterList& params) {
+            auto& filter = mShared.options.filter;
+            if(type == "gaussian"sv) {
+                const auto sigma = params.getNumber("sigma"sv, 0.5);
+                filter = makeNode("GaussianFilter"sv,
+                                  { { "Alpha"sv, toAttr(1.0 / (2.0 * sigma * sigma)) },
+                                    { "Radius"sv, toAttr(params.getNumber("radius"sv, 1.5)) } });
+            } else if(type == "box"sv)
+                filter = makeNode("BoxFilter"sv, {});
+            else if(type == "triangle"sv)
+                filter = makeNode("TriangleFilter"sv, { { "Radius"sv, toAttr(params.getNumber("radius"sv, 2.0)) } });
+            else if(type == "sinc"sv)
+                filter = makeNode("LanczosFilter"sv, { { "Radius"sv, toAttr(params.getNumber("radius"sv, 4.0)) } });
+            else
+                warnOnce("Filter"sv, fmt::format("Filter \"{}\" is not supported, the gaussian filter is used", type));
+        }
+
+        void integrator(const std::string_view type, const ParameterList& params) {
+            auto& options = mShared.options;
+            ConfigNode::AttrMap attrs{ trackedAllocator(MemoryTag::Config) };
+            attrs.emplace_back("MaxDepth"sv, toAttr(static_cast<uint32_t>(params.getNumber("maxdepth"sv, 5.0))));
+            auto name = "PathIntegrator"sv;
+            if(type == "bdpt"sv)
+                name = "BDPTIntegrator"sv;
+            else if(type == "volpath"sv)
+                attrs.emplace_back("Volumetric"sv, toAttr(true));
+            else if(type != "path"sv)
+                warnOnce("Integrator"sv, fmt::format("Integrator \"{}\" is not supported, the path integrator is used", type));
+            options.integrator = makeNode(name, std::move(attrs));
+
+            const auto lightSampler = params.getString("lightsampler"sv, "bvh"sv);
+            options.lightSampler = makeNode(lightSampler == "uniform"sv ? "UniformLightSampler"sv : "PowerLightSampler"sv, {});
+        }
+
+        void requireOptions(const std::string_view directive) const {
+            if(mInWorld)
+                mTokenizer->error(fmt::format("{} is not allowed after WorldBegin", directive));
+        }
+
+        void import(const std::string_view fileName) {
+            if(!mInWorld || mCurrentObject) {
+                // the options and the object definitions need to be parsed in order
+                parseFile(mShared.resolve(fileName));
+                return;
+            }
+            // the imported files are independent of the rest of the scene, so they are parsed concurrently with copies of the state
+            auto& task = mResult.imports.emplace_back(ImportTask{ mShared.resolve(fileName), mState, mDefinitions, {} });
+            auto& shared = mShared;
+            shared.tasks.run([&shared, &task] {
+                Parser parser{ shared, task.definitions, task.result, true };
+                parser.mState = task.state;
+                parser.parseFile(task.path);
+            });
+        }
+
+        void directive(const std::string_view name) {
+            if(name == "AttributeBegin"sv || name == "TransformBegin"sv) {
+                mStack.push_back(mState);
+                mStack.back().transformOnly = name == "TransformBegin"sv;
+            } else if(name == "AttributeEnd"sv || name == "TransformEnd"sv) {
+                if(mStack.empty())
+                    mTokenizer->error(fmt::format("Unmatched {}", name));
+                if(mStack.back().transformOnly) {
+                    mState.transform = mStack.back().transform;
+                    mState.activeTransforms = mStack.back().activeTransforms;
+                } else
+                    mState = std::move(mStack.back());
+                mStack.pop_back();
+            } else if(name == "Identity"sv)
+                applyTransform([](const glm::mat4&) { return glm::mat4{ 1.0f }; });
+            else if(name == "Translate"sv) {
+                glm::vec3 offset;
+                for(glm::length_t k = 0; k < 3; ++k)
+                    offset[k] = static_cast<Float>(nextNumber());
+                applyTransform([&](const glm::mat4& m) { return glm::translate(m, offset); });
+            } else if(name == "Scale"sv) {
+                glm::vec3 scale;
+                for(glm::length_t k = 0; k < 3; ++k)
+                    scale[k] = static_cast<Float>(nextNumber());
+                applyTransform([&](const glm::mat4& m) { return glm::scale(m, scale); });
+            } else if(name == "Rotate"sv) {
+                const auto angle = glm::radians(static_cast<Float>(nextNumber()));
+                glm::vec3 axis;
+                for(glm::length_t k = 0; k < 3; ++k)
+                    axis[k] = static_cast<Float>(nextNumber());
+                applyTransform([&](const glm::mat4& m) { return glm::rotate(m, angle, axis); });
+            } else if(name == "LookAt"sv) {
+                std::array<glm::vec3, 3> args;  // NOLINT(cppcoreguidelines-pro-type-member-init)
+                for(auto& arg : args)
+                    for(glm::length_t k = 0; k < 3; ++k)
+                        arg[k] = static_cast<Float>(nextNumber());
+                const auto matrix = lookAt(args[0], args[1], args[2]);
+                applyTransform([&](const glm::mat4& m) { return m * matrix; });
+            } else if(name == "Transform"sv) {
+                const auto matrix = nextMatrix();
+                applyTransform([&](const glm::mat4&) { return matrix; });
+            } else if(name == "ConcatTransform"sv) {
+                const auto matrix = nextMatrix();
+                applyTransform([&](const glm::mat4& m) { return m * matrix; });
+            } else if(name == "CoordinateSystem"sv)
+                mDefinitions.coordinateSystems.insert_or_assign(std::string{ nextString() }, mState.transform);
+            else if(name == "CoordSysTransform"sv) {
+                const auto system = nextString();
+                if(const auto iter = mDefinitions.coordinateSystems.find(system); iter != mDefinitions.coordinateSystems.cend())
+                    mState.transform = iter->second;
+                else
+                    warnOnce(fmt::format("CoordinateSystem.{}", system), fmt::format("Undefined coordinate system \"{}\"", system));
+            } else if(name == "ActiveTransform"sv) {
+                const auto which = mTokenizer->expect();
+                mState.activeTransforms = which == "StartTime"sv ? 1U : which == "EndTime"sv ? 2U : 3U;
+            } else if(name == "TransformTimes"sv) {
+                requireOptions(name);
+                mShared.transformTimes[0] = nextNumber();
+                mShared.transformTimes[1] = nextNumber();
+            } else if(name == "ReverseOrientation"sv)
+                mState.reverseOrientation = !mState.reverseOrientation;
+            else if(name == "Camera"sv) {
+                requireOptions(name);
+                const auto type = nextString();
+                camera(type, parseParameters());
+            } else if(name == "Film"sv) {
+                requireOptions(name);
+                nextString();
+                film(parseParameters());
+            } else if(name == "Sampler"sv) {
+                requireOptions(name);
+                mShared.options.sampler = nextString();
+                mShared.options.sampleCount = static_cast<uint32_t>(parseParameters().getNumber("pixelsamples"sv, 16.0));
+            } else if(name == "PixelFilter"sv) {
+                requireOptions(name);
+                const auto type = nextString();
+                pixelFilter(type, parseParameters());
+            } else if(name == "Integrator"sv) {
+                requireOptions(name);
+                const auto type = nextString();
+                integrator(type, parseParameters());
+            } else if(name == "Accelerator"sv || name == "ColorSpace"sv || name == "Option"sv) {
+                // the acceleration structures are built by the backend, and the scene color space is always linear Rec.709
+                if(name != "Option"sv)
+                    nextString();
+                parseParameters();
+            } else if(name == "WorldBegin"sv) {
+                requireOptions(name);
+                if(!mShared.options.hasCamera) {
+                    warning("The scene has no camera, the default perspective camera is used");
+                    camera("perspective"sv, ParameterList{});
+                }
+                mInWorld = true;
+                mState.transform = { glm::mat4{ 1.0f }, glm::mat4{ 1.0f } };
+                mDefinitions.coordinateSystems.insert_or_assign("world", mState.transform);
+            } else if(name == "WorldEnd"sv) {
+                // pbrt-v3 compatibility
+            } else if(name == "Attribute"sv) {
+                nextString();
+                parseParameters();
+                warnOnce("Attribute"sv, "The default parameters of Attribute are ignored"sv);
+            } else if(name == "Shape"sv) {
+                const auto type = nextString();
+                shape(type, parseParameters());
+            } else if(name == "ObjectBegin"sv) {
+                mStack.push_back(mState);
+                mCurrentObject = &mDefinitions.objects[std::string{ nextString() }];
+            } else if(name == "ObjectEnd"sv) {
+                if(!mCurrentObject || mStack.empty())
+                    mTokenizer->error("Unmatched ObjectEnd");
+                mCurrentObject = nullptr;
+                mState = std::move(mStack.back());
+                mStack.pop_back();
+            } else if(name == "ObjectInstance"sv) {
+                const auto object = nextString();
+                const auto iter = mDefinitions.objects.find(object);
+                if(iter == mDefinitions.objects.cend())
+                    mTokenizer->error(fmt::format("Undefined object \"{}\"", object));
+                for(const auto& [component, transform] : iter->second)
+                    emit("Shape"sv, { mState.transform[0] * transform[0], mState.transform[1] * transform[1] }, component, "Shape"sv);
+            } else if(name == "LightSource"sv) {
+                const auto type = nextString();
+                lightSource(type, parseParameters());
+            } else if(name == "AreaLightSource"sv) {
+                const auto type = nextString();
+                areaLightSource(type, parseParameters());
+            } else if(name == "Material"sv) {
+                const auto type = nextString();
+                mState.material = makeMaterial(type, parseParameters());
+            } else if(name == "MakeNamedMaterial"sv) {
+                const auto material = nextString();
+                const auto& params = parseParameters();
+                mDefinitions.materials.insert_or_assign(std::string{ material }, makeMaterial(params.getString("type"sv, ""sv), params));
+            } else if(name == "NamedMaterial"sv) {
+                const auto material = nextString();
+                if(const auto iter = mDefinitions.materials.find(material); iter != mDefinitions.materials.cend())
+                    mState.material = iter->second;
+                else
+                    mTokenizer->error(fmt::format("Undefined material \"{}\"", material));
+            } else if(name == "Texture"sv) {
+                const auto texture = nextString();
+                const auto type = nextString();
+                const auto texClass = nextString();
+                defineTexture(texture, type, texClass, parseParameters());
+            } else if(name == "MakeNamedMedium"sv) {
+                nextString();
+                parseParameters();
+                warnOnce("Medium"sv, "The participating media are not imported"sv);
+            } else if(name == "MediumInterface"sv) {
+                nextString();
+                if(const auto token = mTokenizer->peek(); token && isQuoted(*token))
+                    mTokenizer->next();
+            } else if(name == "Include"sv)
+                parseFile(mShared.resolve(nextString()));
+            else if(name == "Import"sv)
+                import(nextString());
+            else
+                mTokenizer->error(fmt::format("Unrecognized directive \"{}\"", name));
+        }
+
+    public:
+        Parser(SharedState& shared, Definitions& definitions, ParseResult& result, const bool inWorld)
+            : mShared{ shared }, mDefinitions{ definitions }, mResult{ result }, mInWorld{ inWorld } {
+            mState.material = makeDiffuse(ParameterList{});
+        }
+
+        void parseFile(const std::string& path) {
+            if(path.ends_with(".gz"sv))
+                fatal(fmt::format("The compressed scene {} is not supported", path));
+
+            const MappedFile file{ fs::path{ path } };
+            const auto data = file.data();
+            Tokenizer tokenizer{ path, std::string_view{ reinterpret_cast<const char*>(data.data()), data.size() } };
+            const auto previous = std::exchange(mTokenizer, &tokenizer);
+            while(const auto token = tokenizer.next())
+                directive(*token);
+            mTokenizer = previous;
+        }
+    };
+
+    Ref<ConfigNode> makeSensor(const RenderOptions& options) {
+        const auto& camera = options.camera;
+        const auto aspect = static_cast<double>(options.width) / static_cast<double>(options.height);
+        const auto lookAt = camera.eye + camera.forward * static_cast<Float>(camera.type == "realistic"sv ? camera.focusDistance :
+                                                                                                             camera.focalDistance);
+
+        if(camera.type == "realistic"sv) {
+            // the film diagonal in millimeters
+            const auto height = options.diagonal / std::sqrt(1.0 + aspect * aspect);
+            return makeNode("Realistic"sv,
+                            { { "SensorSize"sv, toAttr(glm::vec2{ height * aspect, height }) },
+                              { "LookAt"sv, toAttr(lookAt) },
+                              { "UpRef"sv, toAttr(camera.up) },
+                              { "LensFile"sv, toAttr(camera.lensFile) },
+                              { "ApertureDiameter"sv, toAttr(camera.apertureDiameter) },
+                              { "FocusDistance"sv, toAttr(camera.focusDistance) } });
+        }
+
+        // The field of view of pbrt is the angle of the shorter axis. The sensor is 24mm on the shorter axis, and the focal length is
+        // chosen so that the film distance of ThinLens focused on the focal distance matches the field of view.
+        constexpr auto shortSide = 24.0;
+        const auto sensorSize = aspect >= 1.0 ? glm::vec2{ shortSide * aspect, shortSide } : glm::vec2{ shortSide, shortSide / aspect };
+        const auto filmDistance = shortSide * 0.5e-3 / std::tan(glm::radians(camera.fov) * 0.5);
+        const auto focalLength = 1.0 / (1.0 / filmDistance + 1.0 / camera.focalDistance);
+        const auto fStop = camera.lensRadius > 0.0 ? focalLength / (2.0 * camera.lensRadius) : 1e8;
+        return makeNode("ThinLens"sv,
+                        { { "SensorSize"sv, toAttr(sensorSize) },
+                          { "LookAt"sv, toAttr(lookAt) },
+                          { "UpRef"sv, toAttr(camera.up) },
+                          { "FocalLength"sv, toAttr(focalLength * 1e3) },
+                          { "FStop"sv, toAttr(fStop) } });
+    }
+}  // namespace
+
+// The pbrt-v4 scenes are converted to the same pipeline as the JSON scenes: a renderer and an output for the film.
+class PBRTv4Pipeline final : public Pipeline {
+    Ref<Pipeline> mPipeline;
+
+public:
+    explicit PBRTv4Pipeline(const Ref<ConfigNode>& config) {
+        const auto path = config->get("InputFile"sv)->as<std::string_view>();
+        const fs::path outputDir{ config->get("OutputDir"sv)->as<std::string_view>() };
+
+        SharedState shared;
+        shared.baseDir = fs::path{ path }.parent_path();
+        // the inline meshes live next to the native meshes, so both of them are reused by the following runs
+        shared.meshDir = outputDir / "MeshCache";
+        fs::create_directories(shared.meshDir);
+
+        Definitions definitions;
+        ParseResult result;
+        Parser parser{ shared, definitions, result, false };
+        try {
+            parser.parseFile(std::string{ path });
+        } catch(...) {
+            shared.tasks.wait();
+            throw;
+        }
+        shared.tasks.wait();
+
+        auto& options = shared.options;
+
+        ConfigAttr::AttrArray scene{ trackedAllocator(MemoryTag::Config) };
+        result.flatten(scene);
+        info(fmt::format("Imported {} scene objects from {}", scene.size(), path));
+
+        const auto& camera = options.camera;
+        scene.push_back(toAttr(makeNode(
+            "SceneObject"sv,
+            { { "ComponentType"sv, toAttr("Sensor"sv) },
+              { "KeyFrames"sv,
+                makeArray({ toAttr(makeNode("KeyFrame"sv,
+                                            { { "Time"sv, toAttr(0.0) },
+                                              { "InterpolationCurve"sv, toAttr("Hold"sv) },
+                                              { "Translation"sv, toAttr(camera.eye) } })) }) },
+              { "Component"sv, toAttr(makeSensor(options)) } },
+            "Camera"sv)));
+
+        if(!options.integrator)
+            options.integrator = makeNode("PathIntegrator"sv, { { "MaxDepth"sv, toAttr(5U) } });
+        if(!options.lightSampler)
+            options.lightSampler = makeNode("PowerLightSampler"sv, {});
+        if(!options.filter)
+            options.filter = makeNode("GaussianFilter"sv, { { "Alpha"sv, toAttr(2.0) }, { "Radius"sv, toAttr(1.5) } });
+
+        // the zsobol and pmj02 samplers are mapped to their counterparts, the others are replaced by the Sobol sampler
+        Ref<ConfigNode> sampler;
+        if(options.sampler == "zsobol"sv)
+            sampler = makeNode("ZSobolSampler"sv, { { "SampleCount"sv, toAttr(options.sampleCount) } });
+        else if(options.sampler.starts_with("pmj02"sv))
+            sampler = makeNode("PMJ02Sampler"sv,
+                               { { "SampleCount"sv, toAttr(options.sampleCount) },
+                                 { "BlueNoise"sv, toAttr(options.sampler == "pmj02bn"sv) } });
+        else
+            sampler = makeNode("SobolSampler"sv, { { "SampleCount"sv, toAttr(options.sampleCount) } });
+        const auto action = makeNode("Action"sv,
+                                     { { "Width"sv, toAttr(options.width) },
+                                       { "Height"sv, toAttr(options.height) },
+                                       { "FrameCount"sv, toAttr(1U) },
+                                       { "Sampler"sv, toAttr(sampler) },
+                                       { "Begin"sv, toAttr(0.0) },
+                                       { "FPS"sv, toAttr(1.0) },
+                                       { "ShutterOpen"sv, toAttr(camera.shutterOpen) },
+                                       { "ShutterClose"sv, toAttr(camera.shutterClose) },
+                                       { "Channels"sv, makeArray({ toAttr("Color"sv) }) },
+                                       { "Sensor"sv, toAttr("Camera"sv) } });
+
+        ConfigAttr::AttrArray nodes{ trackedAllocator(MemoryTag::Config) };
+        nodes.push_back(toAttr(makeNode("Renderer"sv,
+                                        { { "Variant"sv, toAttr("RSSRGB"sv) },
+                                          { "Scene"sv, toAttr(std::move(scene)) },
+                                          { "Integrator"sv, toAttr(options.integrator) },
+                                          { "LightSampler"sv, toAttr(options.lightSampler) },
+                                          { "Filter"sv, toAttr(options.filter) },
+                                          { "MeshCache"sv, toAttr(shared.meshDir.string()) },
+                                          { "Action"sv, makeArray({ toAttr(action) }) } },
+                                        "Renderer"sv)));
+
+        // the film of pbrt is written to the output directory, the LDR images are tone mapped first
+        const auto outputPath = toAttr((outputDir / fs::path{ options.fileName }.filename()).string());
+        if(fs::path{ options.fileName }.extension() == ".exr"sv)
+            nodes.push_back(
+                toAttr(makeNode("EXROutput"sv, { { "PrevNode"sv, toAttr("Renderer"sv) }, { "OutputPath"sv, outputPath } }, "Output"sv)));
+        else {
+            nodes.push_back(toAttr(makeNode("ToneMapping"sv, { { "PrevNode"sv, toAttr("Renderer"sv) } }, "ToneMapping"sv)));
+            nodes.push_back(
+                toAttr(makeNode("LDROutput"sv, { { "PrevNode"sv, toAttr("ToneMapping"sv) }, { "OutputPath"sv, outputPath } }, "Output"sv)));
+        }
+
+        const auto description = makeNode("PipelineDescription"sv, { { "Pipeline"sv, toAttr(std::move(nodes)) } });
+        mPipeline = getStaticFactory().make<Pipeline>(makeNode("PiperPipeline"sv,
+                                                               { { "InputFile"sv, toAttr(path) },
+                                                                 { "OutputDir"sv, toAttr(outputDir.string()) },
+                                                                 { "Description"sv, toAttr(description) } },
+                                                               "pipeline"sv));
+    }
+
+    void execute() override {
+        mPipeline->execute();
+    }
+    void serve(const std::string_view address, const uint16_t port) override {
+        mPipeline->serve(address, port);
+    }
+};
+
+PIPER_REGISTER_CLASS(PBRTv4Pipeline, Pipeline);
+
+PIPER_NAMESPACE_END
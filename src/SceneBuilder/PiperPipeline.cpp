@@ -18,17 +18,49 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <Piper/Core/Report.hpp>
 #include <Piper/Core/StaticFactory.hpp>
+#include <Piper/Core/Threading.hpp>
+#include <Piper/Core/Trace.hpp>
 #include <Piper/Render/Pipeline.hpp>
 #include <Piper/Render/PipelineNode.hpp>
+
+#ifdef PIPER_WINDOWS
+// ReSharper disable once CppUnusedIncludeDirective
+#include <sdkddkver.h>
+#endif
+
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <istream>
+#include <mutex>
 #include <oneapi/tbb/flow_graph.h>
 #include <ranges>
+#include <thread>
 
 PIPER_NAMESPACE_BEGIN
 
 class PiperPipeline final : public Pipeline {
     static constexpr auto noPrevNode = std::numeric_limits<uint32_t>::max();
-    std::pmr::vector<std::pair<Ref<PipelineNode>, uint32_t>> mNodes{ context().localAllocator };
+    struct NodeDesc final {
+        Ref<PipelineNode> node;
+        uint32_t prev;
+        uint32_t concurrency;
+        std::pmr::string name;  // the span name of the node in the trace
+    };
+    std::pmr::vector<NodeDesc> mNodes{ context().localAllocator };
+    // the frames between the source and the sinks, each of them holds at least one full-resolution film
+    uint32_t mMaxFramesInFlight = 2;
+    size_t mMemoryBudget = 0;  // in bytes, 0 means unlimited
+    // the jobs in server mode are resolved with the same configuration as the input file
+    std::pmr::string mBaseDir{ context().globalAllocator };
+    std::pmr::string mOutputDir{ context().globalAllocator };
+    ResolveConfiguration mResolveConfig{ context().globalAllocator };
 
 public:
     explicit PiperPipeline(const Ref<ConfigNode>& config) {
@@ -36,12 +68,27 @@ public:
 
         const auto path = config->get("InputFile"sv)->as<std::string_view>();
         // TODO: load configuration from CLI
-        ResolveConfiguration cfg{ context().globalAllocator };
-        const auto base = fs::path{ path }.parent_path().string();
-        cfg.insert({ "${BaseDir}"sv, base });
-        cfg.insert({ "${OutputDir}"sv, config->get("OutputDir"sv)->as<std::string_view>() });
+        auto& cfg = mResolveConfig;
+        mBaseDir = fs::path{ path }.parent_path().string();
+        mOutputDir = config->get("OutputDir"sv)->as<std::string_view>();
+        cfg.insert({ "${BaseDir}"sv, mBaseDir });
+        cfg.insert({ "${OutputDir}"sv, mOutputDir });
+
+        // the importers of the other scene formats (e.g., pbrt) pass the converted description directly
+        Ref<ConfigNode> pipelineDesc;
+        if(const auto ptr = config->tryGet("Description"sv))
+            pipelineDesc = (*ptr)->as<Ref<ConfigNode>>();
+        else {
+            std::string_view snapshot;
+            if(const auto ptr = config->tryGet("Snapshot"sv))
+                snapshot = (*ptr)->as<std::string_view>();
+            pipelineDesc = snapshot.empty() ? parseJSONConfigNode(path, cfg) : parseJSONConfigNodeWithSnapshot(path, cfg, snapshot);
+        }
+        if(const auto ptr = pipelineDesc->tryGet("MaxFramesInFlight"sv))
+            mMaxFramesInFlight = std::max(1U, (*ptr)->as<uint32_t>());
+        if(const auto ptr = pipelineDesc->tryGet("MemoryBudget"sv))
+            mMemoryBudget = static_cast<size_t>((*ptr)->as<double>() * 1e6);
 
-        const auto pipelineDesc = parseJSONConfigNode(path, cfg);
         const auto pipeline = pipelineDesc->get("Pipeline"sv);
         const auto nodes = pipeline->as<ConfigAttr::AttrArray>();
         mNodes.reserve(nodes.size());
@@ -51,13 +98,29 @@ public:
         uint32_t idx = 0;
         for(auto& node : nodes) {
             const auto& desc = node->as<Ref<ConfigNode>>();
+            // a node may be consumed by several nodes, the branches share the same immutable frames
             auto prevNode = noPrevNode;
-            if(auto prev = desc->tryGet("PrevNode"sv))
-                prevNode = nodeMapping.find((*prev)->as<std::string_view>())->second;
+            if(auto prev = desc->tryGet("PrevNode"sv)) {
+                const auto name = (*prev)->as<std::string_view>();
+                const auto iter = nodeMapping.find(name);
+                if(iter == nodeMapping.cend())
+                    fatal(fmt::format("The previous node \"{}\" of pipeline node \"{}\" is not defined before it", name, desc->name()));
+                prevNode = iter->second;
+            } else if(idx != 0)
+                fatal(fmt::format("Pipeline node \"{}\" has no input, only the first node is the source", desc->name()));
 
             auto pipelineNode = getStaticFactory().make<PipelineNode>(desc);
+            uint32_t concurrency = 1;
+            if(const auto ptr = desc->tryGet("Concurrency"sv)) {
+                concurrency = std::max(1U, (*ptr)->as<uint32_t>());
+                if(concurrency > 1 && !pipelineNode->stateless()) {
+                    warning(fmt::format("Pipeline node \"{}\" is stateful, so its frames are processed one by one", desc->name()));
+                    concurrency = 1;
+                }
+            }
             nodeMapping.insert({ desc->name(), idx });
-            mNodes.push_back({ std::move(pipelineNode), prevNode });
+            mNodes.push_back({ std::move(pipelineNode), prevNode, concurrency,
+                               std::pmr::string{ desc->name(), context().globalAllocator } });
             ++idx;
         }
     }
@@ -70,7 +133,7 @@ public:
                 mNodes.size(), PipelineNode::ChannelRequirement{ context().globalAllocator }, context().scopedAllocator);
 
             for(int32_t idx = static_cast<int32_t>(mNodes.size()) - 1; idx >= 0; --idx) {
-                const auto& [node, prev] = mNodes[idx];
+                const auto& [node, prev, concurrency, name] = mNodes[idx];
                 auto req = node->setup(requirements[idx]);
                 if(prev != noPrevNode)
                     mergeRequirement(requirements[prev], std::move(req));
@@ -78,33 +141,245 @@ public:
                     fatal("Source node should require nothing.");
             }
 
-            if(mNodes.front().second != noPrevNode)
+            if(mNodes.front().prev != noPrevNode)
                 fatal("No pipeline source");
+
+            // the source produces the layout most of the nodes prefer, so that the frames are converted as little as possible
+            int32_t planar = 0;
+            for(const auto& desc : mNodes)
+                if(const auto layout = desc.node->layout())
+                    planar += *layout == FrameLayout::Planar ? 1 : -1;
+            dynamic_cast<SourceNode*>(mNodes.front().node.get())
+                ->setLayout(planar > 0 ? FrameLayout::Planar : FrameLayout::Interleaved);
         }
 
-        const auto frameCount = dynamic_cast<SourceNode*>(mNodes.front().first.get())->frameCount();
+        const auto source = dynamic_cast<SourceNode*>(mNodes.front().node.get());
+        const auto frameCount = source->frameCount();
+
+        // the films of a frame in flight are held by at most two nodes at once (the input and the output of a transform)
+        auto framesInFlight = mMaxFramesInFlight;
+        if(const auto frameBytes = source->frameBytes(); mMemoryBudget && frameBytes)
+            framesInFlight = std::clamp(static_cast<uint32_t>(mMemoryBudget / (2 * frameBytes)), 1U, framesInFlight);
 
         tbb::flow::graph g;
 
-        std::pmr::vector<tbb::flow::function_node<Ref<Frame>, Ref<Frame>>> nodes{ context().localAllocator };
+        // the frames are tracked by tickets, since the sinks return nothing
+        // NOTICE: the flow graph passes the messages by const reference, the frame is moved out of it so that the single consumer
+        // holds the only reference and transforms the frame in place
+        struct FrameToken final {
+            uint32_t ticket = 0;
+            mutable Ref<Frame> frame;
+        };
+
+        // the source is pulled only when the limiter has a free slot, so the finished frames never queue without bound
+        uint32_t nextTicket = 0;
+        tbb::flow::input_node<FrameToken> input{ g, [&](tbb::flow_control& control) {
+                                                    if(nextTicket == frameCount || cancellationRequested()) {
+                                                        control.stop();
+                                                        return FrameToken{};
+                                                    }
+                                                    return FrameToken{ nextTicket++, {} };
+                                                } };
+        tbb::flow::limiter_node<FrameToken> limiter{ g, framesInFlight };
+        tbb::flow::make_edge(input, limiter);
+
+        // the successors of a node are spawned as separate tasks, so the independent branches run concurrently
+        std::pmr::vector<tbb::flow::function_node<FrameToken, FrameToken>> nodes{ context().localAllocator };
         nodes.reserve(mNodes.size());
+        std::pmr::vector<bool> hasSuccessor(mNodes.size(), false, context().localAllocator);
         for(auto& node : mNodes) {
-            nodes.push_back({ g, 1, [&](Ref<Frame> frames) {
+            const auto isSource = node.prev == noPrevNode;
+            nodes.push_back({ g, node.concurrency, [&, isSource](const FrameToken& token) {
+                                 // the frames cancelled by the source (or in flight when the job is cancelled) are skipped
+                                 if(cancellationRequested() || (!isSource && !token.frame))
+                                     return FrameToken{ token.ticket, {} };
                                  try {
-                                     return node.first->transform(std::move(frames));
+                                     PIPER_TRACE_SPAN(node.name);
+                                     // the conversion happens only at the boundaries between the nodes preferring different layouts
+                                     if(const auto layout = node.node->layout(); layout && token.frame)
+                                         token.frame = Frame::convertLayout(std::move(token.frame), *layout);
+                                     return FrameToken{ token.ticket, node.node->transform(std::move(token.frame)) };
                                  } catch(const std::exception& ex) {
                                      fatal(fmt::format("{}: {}", typeid(ex).name(), ex.what()));
                                  }
                              } });
             auto& inserted = nodes.back();
-            if(node.second != noPrevNode)
-                tbb::flow::make_edge(nodes[node.second], inserted);
+            if(node.prev != noPrevNode) {
+                tbb::flow::make_edge(nodes[node.prev], inserted);
+                hasSuccessor[node.prev] = true;
+            }
         }
+        tbb::flow::make_edge(limiter, nodes.front());
 
-        for(uint32_t idx = 0; idx < frameCount; ++idx)
-            nodes.front().try_put({});
+        // the slot of a frame is returned to the limiter after all sinks have released it
+        const auto sinkCount = static_cast<uint32_t>(std::ranges::count(hasSuccessor, false));
+        std::pmr::vector<std::atomic_uint32_t> pendingSinks(frameCount, context().localAllocator);
+        for(auto& pending : pendingSinks)
+            pending.store(sinkCount, std::memory_order_relaxed);
 
+        using ReleaseNode = tbb::flow::multifunction_node<FrameToken, std::tuple<tbb::flow::continue_msg>>;
+        ReleaseNode release{ g, tbb::flow::unlimited, [&](const FrameToken& token, ReleaseNode::output_ports_type& ports) {
+                                if(pendingSinks[token.ticket].fetch_sub(1) == 1)
+                                    std::get<0>(ports).try_put(tbb::flow::continue_msg{});
+                            } };
+        for(size_t idx = 0; idx < nodes.size(); ++idx)
+            if(!hasSuccessor[idx])
+                tbb::flow::make_edge(nodes[idx], release);
+        tbb::flow::make_edge(tbb::flow::output_port<0>(release), limiter.decrementer());
+
+        input.activate();
         g.wait_for_all();
+
+        for(const auto& desc : mNodes)
+            desc.node->finish();
+    }
+
+    // Each job is a JSON object in a single line, and each of them is answered with a single line of JSON. For example,
+    // {"Action": [...], "Scene": [...], "Integrator": {...}} renders again with new actions, sensors/lights or integrator,
+    // {"Cancel": true} stops the running job and {"Shutdown": true} stops the server.
+    // NOTICE: a job received while another one is running supersedes it, the superseded job is answered with "Cancelled".
+    void serve(const std::string_view address, const uint16_t port) override {
+        using boost::asio::ip::tcp;
+
+        const auto source = dynamic_cast<SourceNode*>(mNodes.front().node.get());
+
+        boost::system::error_code ec;
+        const auto bindAddress = boost::asio::ip::make_address(address, ec);
+        if(ec.failed())
+            fatal(fmt::format("Invalid address \"{}\" to serve on. {}.", address, ec.message()));
+        if(!bindAddress.is_loopback())
+            warning(fmt::format("The jobs received on {} are not authenticated, any client reaching it can read and write the files",
+                                address));
+
+        boost::asio::io_context ctx;
+        tcp::acceptor acceptor{ ctx, tcp::endpoint{ bindAddress, port } };
+        info(fmt::format("Waiting for jobs on {}:{}", address, port));
+
+        while(true) {
+            auto socket = acceptor.accept();
+            info(fmt::format("Client connected from {}", socket.remote_endpoint().address().to_string()));
+
+            // NOTICE: the socket is only touched by the I/O thread, the answers and the shutdown are posted to it
+            const auto reply = [&](const std::string& message) {
+                std::promise<void> written;
+                boost::asio::post(ctx, [&] {
+                    // the answers to a disconnected client are dropped
+                    boost::system::error_code ec;
+                    boost::asio::write(socket, boost::asio::buffer(message + '\n'), ec);
+                    written.set_value();
+                });
+                written.get_future().wait();
+            };
+
+            // the lines are read in the background, so that the running job is cancelled as soon as the next one arrives
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::deque<std::string> lines;
+            bool closed = false, busy = false;
+            boost::asio::streambuf buffer;
+            std::function<void()> readLine = [&] {
+                boost::asio::async_read_until(socket, buffer, '\n', [&](const boost::system::error_code& ec, size_t) {
+                    if(ec.failed()) {
+                        // nobody waits for the result of a disconnected client
+                        const std::lock_guard guard{ mutex };
+                        closed = true;
+                        if(busy)
+                            requestCancellation();
+                        cv.notify_one();
+                        return;
+                    }
+
+                    std::string line;
+                    std::getline(std::istream{ &buffer }, line);
+                    if(line.find_first_not_of(" \t\r"sv) != std::string::npos) {
+                        const std::lock_guard guard{ mutex };
+                        lines.push_back(std::move(line));
+                        if(busy)
+                            requestCancellation();
+                        cv.notify_one();
+                    }
+                    readLine();
+                });
+            };
+
+            ctx.restart();
+            auto work = boost::asio::make_work_guard(ctx);
+            readLine();
+            std::jthread io{ [&] { ctx.run(); } };
+
+            bool shutdown = false;
+            while(!shutdown) {
+                std::string line;
+                bool superseded;
+                {
+                    std::unique_lock guard{ mutex };
+                    cv.wait(guard, [&] { return closed || !lines.empty(); });
+                    if(lines.empty())
+                        break;
+                    line = std::move(lines.front());
+                    lines.pop_front();
+                    superseded = !lines.empty();
+                    busy = true;
+                    // the flag is raised again by any line received from now on
+                    resetCancellation();
+                }
+                const auto finish = [&](const std::string& message) {
+                    {
+                        const std::lock_guard guard{ mutex };
+                        busy = false;
+                    }
+                    reply(message);
+                };
+
+                Ref<ConfigNode> job;
+                try {
+                    job = parseJSONConfigNodeFromStr(line, mResolveConfig);
+                } catch(const std::exception& ex) {
+                    warning(fmt::format("Invalid job: {}", ex.what()));
+                    finish(R"({"Status":"Invalid"})");
+                    continue;
+                }
+
+                if(const auto ptr = job->tryGet("Shutdown"sv); ptr && (*ptr)->as<bool>()) {
+                    finish(R"({"Status":"Shutdown"})");
+                    shutdown = true;
+                    continue;
+                }
+                if(const auto ptr = job->tryGet("Cancel"sv); ptr && (*ptr)->as<bool>()) {
+                    finish(R"({"Status":"Idle"})");
+                    continue;
+                }
+                if(superseded) {
+                    finish(R"({"Status":"Cancelled","Frames":0,"Seconds":0.000})");
+                    continue;
+                }
+
+                const auto begin = std::chrono::steady_clock::now();
+                try {
+                    source->applyJob(job);
+                } catch(const std::exception& ex) {
+                    warning(fmt::format("Rejected job: {}", ex.what()));
+                    finish(R"({"Status":"Invalid"})");
+                    continue;
+                }
+                execute();
+                const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+                finish(fmt::format(R"({{"Status":"{}","Frames":{},"Seconds":{:.3f}}})",
+                                   cancellationRequested() ? "Cancelled"sv : "Finished"sv, source->frameCount(), elapsed));
+            }
+
+            // abort the pending read, the I/O thread returns once no more work is left
+            boost::asio::post(ctx, [&] {
+                boost::system::error_code ec;
+                socket.close(ec);
+            });
+            work.reset();
+            io.join();
+            info("Client disconnected");
+            if(shutdown)
+                return;
+        }
     }
 };
 
@@ -0,0 +1,441 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/Report.hpp>
+#include <Piper/Render/Math.hpp>
+#include <Piper/Render/Sampler.hpp>
+#include <Piper/Render/Sensor.hpp>
+#include <algorithm>
+#include <fstream>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <tbb/parallel_for.h>
+#include <unordered_map>
+
+PIPER_NAMESPACE_BEGIN
+
+// the lens space: the film is at z = 0 and the elements are along -z, all lengths are in meters
+struct LensElementInterface final {
+    Float curvatureRadius;  // 0 for the aperture stop
+    Float thickness;
+    Float eta;  // 0 for the air
+    Float apertureRadius;
+};
+
+struct LensRay final {
+    glm::vec3 origin;
+    glm::vec3 direction;
+};
+
+struct PupilBounds final {
+    glm::vec2 lower;
+    glm::vec2 upper;
+
+    [[nodiscard]] Float area() const noexcept {
+        const auto extent = glm::max(upper - lower, glm::vec2{ 0.0f });
+        return extent.x * extent.y;
+    }
+};
+
+// the focused lens system with the exit pupil bounds of the film radii
+struct LensTable final : RefCountBase {
+    std::pmr::vector<LensElementInterface> elements{ context().globalAllocator };
+    std::pmr::vector<PupilBounds> exitPupilBounds{ context().globalAllocator };
+    Float effectiveFocalLength = 0.0f;
+};
+
+static std::pmr::vector<LensElementInterface> loadLensFile(const std::string_view path, const Float apertureDiameter) {
+    std::ifstream in{ std::string{ path } };
+    if(!in)
+        fatal(fmt::format("Failed to open lens file {}", path));
+
+    // the lens files of pbrt: curvature radius, thickness, index of refraction and aperture diameter in millimeters per line
+    std::pmr::vector<LensElementInterface> elements{ context().globalAllocator };
+    for(std::string line; std::getline(in, line);) {
+        if(const auto pos = line.find('#'); pos != std::string::npos)
+            line.resize(pos);
+        std::istringstream stream{ line };
+        LensElementInterface element{};
+        Float diameter;
+        if(!(stream >> element.curvatureRadius))
+            continue;
+        if(!(stream >> element.thickness >> element.eta >> diameter))
+            fatal(fmt::format("Invalid lens file {}: {}", path, line));
+
+        if(element.curvatureRadius == 0.0f && apertureDiameter > 0.0f) {
+            if(apertureDiameter > diameter)
+                warning(fmt::format("The aperture diameter {}mm is larger than the maximum {}mm of lens {}", apertureDiameter, diameter,
+                                    path));
+            else
+                diameter = apertureDiameter;
+        }
+        elements.push_back({ element.curvatureRadius * 1e-3f, element.thickness * 1e-3f, element.eta, diameter * 0.5e-3f });
+    }
+    if(elements.empty())
+        fatal(fmt::format("Invalid lens file {}: no elements", path));
+    return elements;
+}
+
+static bool intersectSphericalElement(const Float radius, const Float zCenter, const LensRay& ray, Float& t, glm::vec3& normal) noexcept {
+    const auto origin = ray.origin - glm::vec3{ 0.0f, 0.0f, zCenter };
+    const auto a = glm::dot(ray.direction, ray.direction);
+    const auto b = 2.0f * glm::dot(ray.direction, origin);
+    const auto c = glm::dot(origin, origin) - radius * radius;
+    const auto discriminant = b * b - 4.0f * a * c;
+    if(discriminant < 0.0f)
+        return false;
+    const auto root = std::sqrt(discriminant);
+    const auto q = b < 0.0f ? -0.5f * (b - root) : -0.5f * (b + root);
+    auto t0 = q / a, t1 = c / q;
+    if(t0 > t1)
+        std::swap(t0, t1);
+
+    // the closer one is used for the convex side facing the ray
+    t = (ray.direction.z > 0.0f) != (radius < 0.0f) ? t0 : t1;
+    if(!(t >= 0.0f))
+        return false;
+    normal = glm::normalize(origin + t * ray.direction);
+    if(glm::dot(normal, ray.direction) > 0.0f)
+        normal = -normal;
+    return true;
+}
+
+static bool refract(const glm::vec3& wi, const glm::vec3& normal, const Float eta, glm::vec3& wt) noexcept {
+    const auto cosThetaI = glm::dot(normal, wi);
+    const auto sin2ThetaT = eta * eta * std::fmax(0.0f, 1.0f - cosThetaI * cosThetaI);
+    if(sin2ThetaT >= 1.0f)
+        return false;
+    wt = -eta * wi + (eta * cosThetaI - std::sqrt(1.0f - sin2ThetaT)) * normal;
+    return true;
+}
+
+// Please refer to https://pbr-book.org/3ed-2018/Camera_Models/Realistic_Cameras
+class LensSystem final {
+    std::span<const LensElementInterface> mElements;
+
+public:
+    explicit LensSystem(const std::span<const LensElementInterface> elements) : mElements{ elements } {}
+
+    [[nodiscard]] Float rearZ() const noexcept {
+        return mElements.back().thickness;
+    }
+    [[nodiscard]] Float frontZ() const noexcept {
+        Float res = 0.0f;
+        for(const auto& element : mElements)
+            res += element.thickness;
+        return res;
+    }
+    [[nodiscard]] Float rearRadius() const noexcept {
+        return mElements.back().apertureRadius;
+    }
+
+    // the rays are in the camera space (+z towards the scene), the lens space flips z
+    bool traceFromFilm(const LensRay& cameraRay, LensRay* out) const noexcept {
+        Float elementZ = 0.0f;
+        LensRay ray{ cameraRay.origin * glm::vec3{ 1.0f, 1.0f, -1.0f }, cameraRay.direction * glm::vec3{ 1.0f, 1.0f, -1.0f } };
+        for(auto idx = static_cast<int32_t>(mElements.size()) - 1; idx >= 0; --idx) {
+            const auto& element = mElements[idx];
+            elementZ -= element.thickness;
+
+            Float t;
+            glm::vec3 normal;
+            const auto isStop = element.curvatureRadius == 0.0f;
+            if(isStop) {
+                if(ray.direction.z >= 0.0f)
+                    return false;
+                t = (elementZ - ray.origin.z) / ray.direction.z;
+            } else if(!intersectSphericalElement(element.curvatureRadius, elementZ + element.curvatureRadius, ray, t, normal))
+                return false;
+
+            const auto hit = ray.origin + t * ray.direction;
+            if(hit.x * hit.x + hit.y * hit.y > element.apertureRadius * element.apertureRadius)
+                return false;
+            ray.origin = hit;
+
+            if(!isStop) {
+                const auto etaI = element.eta != 0.0f ? element.eta : 1.0f;
+                const auto etaT = idx > 0 && mElements[idx - 1].eta != 0.0f ? mElements[idx - 1].eta : 1.0f;
+                if(!refract(-glm::normalize(ray.direction), normal, etaI / etaT, ray.direction))
+                    return false;
+            }
+        }
+        if(out)
+            *out = { ray.origin * glm::vec3{ 1.0f, 1.0f, -1.0f }, ray.direction * glm::vec3{ 1.0f, 1.0f, -1.0f } };
+        return true;
+    }
+
+    bool traceFromScene(const LensRay& cameraRay, LensRay* out) const noexcept {
+        auto elementZ = -frontZ();
+        LensRay ray{ cameraRay.origin * glm::vec3{ 1.0f, 1.0f, -1.0f }, cameraRay.direction * glm::vec3{ 1.0f, 1.0f, -1.0f } };
+        for(size_t idx = 0; idx < mElements.size(); ++idx) {
+            const auto& element = mElements[idx];
+
+            Float t;
+            glm::vec3 normal;
+            const auto isStop = element.curvatureRadius == 0.0f;
+            if(isStop)
+                t = (elementZ - ray.origin.z) / ray.direction.z;
+            else if(!intersectSphericalElement(element.curvatureRadius, elementZ + element.curvatureRadius, ray, t, normal))
+                return false;
+
+            const auto hit = ray.origin + t * ray.direction;
+            if(hit.x * hit.x + hit.y * hit.y > element.apertureRadius * element.apertureRadius)
+                return false;
+            ray.origin = hit;
+
+            if(!isStop) {
+                const auto etaI = idx == 0 || mElements[idx - 1].eta == 0.0f ? 1.0f : mElements[idx - 1].eta;
+                const auto etaT = element.eta != 0.0f ? element.eta : 1.0f;
+                if(!refract(-glm::normalize(ray.direction), normal, etaI / etaT, ray.direction))
+                    return false;
+            }
+            elementZ += element.thickness;
+        }
+        if(out)
+            *out = { ray.origin * glm::vec3{ 1.0f, 1.0f, -1.0f }, ray.direction * glm::vec3{ 1.0f, 1.0f, -1.0f } };
+        return true;
+    }
+
+    // the principal plane and the focal point of the paraxial rays
+    static std::pair<Float, Float> cardinalPoints(const LensRay& in, const LensRay& out) noexcept {
+        const auto tf = -out.origin.x / out.direction.x;
+        const auto tp = (in.origin.x - out.origin.x) / out.direction.x;
+        return { -(out.origin.z + tp * out.direction.z), -(out.origin.z + tf * out.direction.z) };
+    }
+
+    // the principal planes and the focal points of the scene side and the film side
+    [[nodiscard]] std::pair<glm::vec2, glm::vec2> thickLensApproximation(const Float filmDiagonal) const {
+        const auto x = 1e-3f * filmDiagonal;
+        glm::vec2 pz, fz;
+
+        const LensRay sceneRay{ { x, 0.0f, frontZ() + 1.0f }, { 0.0f, 0.0f, -1.0f } };
+        LensRay filmRay;
+        if(!traceFromScene(sceneRay, &filmRay))
+            fatal("Unable to trace the paraxial ray from the scene side of the lens");
+        std::tie(pz.x, fz.x) = cardinalPoints(sceneRay, filmRay);
+
+        filmRay = { { x, 0.0f, rearZ() - 1.0f }, { 0.0f, 0.0f, 1.0f } };
+        LensRay outRay;
+        if(!traceFromFilm(filmRay, &outRay))
+            fatal("Unable to trace the paraxial ray from the film side of the lens");
+        std::tie(pz.y, fz.y) = cardinalPoints(filmRay, outRay);
+        return { pz, fz };
+    }
+
+    // the offset of the film so that the plane at the focus distance is sharp, and the effective focal length
+    [[nodiscard]] std::pair<Float, Float> focus(const Float focusDistance, const Float filmDiagonal) const {
+        const auto [pz, fz] = thickLensApproximation(filmDiagonal);
+        const auto f = fz.x - pz.x;
+        const auto z = -focusDistance;
+        const auto c = (pz.y - z - pz.x) * (pz.y - z - 4.0f * f - pz.x);
+        if(c <= 0.0f)
+            fatal(fmt::format("The focus distance {}m is too short for the lens", focusDistance));
+        return { 0.5f * (pz.y - z + pz.x - std::sqrt(c)), std::fabs(f) };
+    }
+
+    [[nodiscard]] PupilBounds boundExitPupil(const Float filmX0, const Float filmX1, const uint32_t samples) const noexcept {
+        constexpr auto radicalInverse = [](uint32_t base, uint32_t idx) {
+            const auto invBase = 1.0f / static_cast<Float>(base);
+            Float res = 0.0f, factor = invBase;
+            for(; idx; idx /= base, factor *= invBase)
+                res += static_cast<Float>(idx % base) * factor;
+            return res;
+        };
+
+        const auto rearRadius = 1.5f * this->rearRadius();
+        PupilBounds bounds{ glm::vec2{ infinity }, glm::vec2{ -infinity } };
+        uint32_t exiting = 0;
+        for(uint32_t idx = 0; idx < samples; ++idx) {
+            const glm::vec3 film{ glm::mix(filmX0, filmX1, (static_cast<Float>(idx) + 0.5f) / static_cast<Float>(samples)), 0.0f, 0.0f };
+            const glm::vec2 rear{ glm::mix(-rearRadius, rearRadius, radicalInverse(2, idx)),
+                                  glm::mix(-rearRadius, rearRadius, radicalInverse(3, idx)) };
+            const auto inside = glm::all(glm::greaterThanEqual(rear, bounds.lower)) && glm::all(glm::lessThanEqual(rear, bounds.upper));
+            if(inside || traceFromFilm({ film, glm::vec3{ rear, rearZ() } - film }, nullptr)) {
+                bounds.lower = glm::min(bounds.lower, rear);
+                bounds.upper = glm::max(bounds.upper, rear);
+                ++exiting;
+            }
+        }
+        // the whole projected rear element is conservative
+        if(exiting == 0)
+            return { glm::vec2{ -rearRadius }, glm::vec2{ rearRadius } };
+        const auto expand = 2.0f * std::sqrt(8.0f) * rearRadius / std::sqrt(static_cast<Float>(samples));
+        return { bounds.lower - expand, bounds.upper + expand };
+    }
+};
+
+// the focused lens tables are shared by the sensors with the same lens, aperture, focus and film
+// NOTICE: an animated focus creates a table per frame, so only the recently used tables are kept. The sensors hold their own
+// references, hence evicting a table in use is safe.
+class LensTableCache final {
+    struct Entry final {
+        Ref<LensTable> table;
+        uint64_t lastUse;
+    };
+
+    static constexpr size_t maxTables = 16;
+    std::mutex mMutex;
+    std::pmr::unordered_map<std::pmr::string, Entry> mTables{ context().globalAllocator };
+    uint64_t mTick = 0;
+
+    void evict() {
+        while(mTables.size() > maxTables)
+            mTables.erase(std::min_element(mTables.begin(), mTables.end(),
+                                           [](const auto& lhs, const auto& rhs) { return lhs.second.lastUse < rhs.second.lastUse; }));
+    }
+
+public:
+    static LensTableCache& get() {
+        static LensTableCache inst;
+        return inst;
+    }
+
+    Ref<LensTable> load(const std::string_view path, const Float apertureDiameter, const Float focusDistance, const Float filmDiagonal,
+                        const uint32_t pupilSamples) {
+        std::pmr::string key{ fmt::format("{}#{}#{}#{}#{}", path, apertureDiameter, focusDistance, filmDiagonal, pupilSamples),
+                              context().globalAllocator };
+        {
+            std::lock_guard guard{ mMutex };
+            if(const auto iter = mTables.find(key); iter != mTables.end()) {
+                iter->second.lastUse = ++mTick;
+                return iter->second.table;
+            }
+        }
+
+        auto table = makeRefCount<LensTable>();
+        table->elements = loadLensFile(path, apertureDiameter);
+        const auto [delta, effectiveFocalLength] = LensSystem{ table->elements }.focus(focusDistance, filmDiagonal);
+        table->elements.back().thickness += delta;
+        table->effectiveFocalLength = effectiveFocalLength;
+
+        const LensSystem lens{ table->elements };
+
+        constexpr uint32_t radii = 64;
+        table->exitPupilBounds.resize(radii);
+        tbb::parallel_for(tbb::blocked_range<uint32_t>{ 0, radii }, [&](const tbb::blocked_range<uint32_t>& range) {
+            for(auto idx = range.begin(); idx != range.end(); ++idx) {
+                const auto r0 = static_cast<Float>(idx) / static_cast<Float>(radii) * filmDiagonal * 0.5f;
+                const auto r1 = static_cast<Float>(idx + 1) / static_cast<Float>(radii) * filmDiagonal * 0.5f;
+                table->exitPupilBounds[idx] = lens.boundExitPupil(r0, r1, pupilSamples);
+            }
+        });
+
+        std::lock_guard guard{ mMutex };
+        const auto [iter, inserted] = mTables.emplace(std::move(key), Entry{ std::move(table), 0 });
+        iter->second.lastUse = ++mTick;
+        auto result = iter->second.table;
+        evict();
+        return result;
+    }
+};
+
+// A multi-element lens camera. The rays are generated from the film towards the exit pupil of the film radius and traced through
+// the elements, the vignetted ones get the zero weight.
+class Realistic final : public Sensor {
+    glm::vec2 mSensorSize;
+    Point<FrameOfReference::World> mLookAt;
+    Direction<FrameOfReference::World> mUpRef;
+    std::string mLensFile;
+    Float mApertureDiameter = 0.0f;  // in millimeters, 0 means the maximum aperture of the lens
+    std::optional<Float> mFocusDistance;  // in meters, the distance to the look-at point by default
+    uint32_t mPupilSamples = 1U << 18;
+    Ref<LensTable> mTable;
+
+    [[nodiscard]] glm::vec3 sampleExitPupil(const glm::vec2 film, const glm::vec2 lensSample, Float& boundsArea) const noexcept {
+        const auto& bounds = mTable->exitPupilBounds;
+        const auto filmRadius = glm::length(film);
+        const auto diagonal = glm::length(mSensorSize);
+        const auto idx =
+            std::min(static_cast<size_t>(filmRadius / (diagonal * 0.5f) * static_cast<Float>(bounds.size())), bounds.size() - 1);
+        const auto& pupil = bounds[idx];
+        boundsArea = pupil.area();
+
+        // the bounds are computed along +x, so they are rotated to the direction of the film point
+        const auto lens = glm::mix(pupil.lower, pupil.upper, lensSample);
+        const auto sinTheta = filmRadius != 0.0f ? film.y / filmRadius : 0.0f;
+        const auto cosTheta = filmRadius != 0.0f ? film.x / filmRadius : 1.0f;
+        return { cosTheta * lens.x - sinTheta * lens.y, sinTheta * lens.x + cosTheta * lens.y, mTable->elements.back().thickness };
+    }
+
+protected:
+    void prepareFrame() override {
+        // the film is focused once per frame, the tables of the same focus are reused from the cache
+        const auto focusDistance = mFocusDistance ? *mFocusDistance : glm::distance(mTransform(0.0f).translation, mLookAt.raw());
+        mTable = LensTableCache::get().load(mLensFile, mApertureDiameter, focusDistance, glm::length(mSensorSize), mPupilSamples);
+    }
+
+public:
+    explicit Realistic(const Ref<ConfigNode>& node)
+        : mSensorSize{ parseSensorSize(node->get("SensorSize"sv)) },
+          mLookAt{ Point<FrameOfReference::World>::fromRaw(parseVec3(node->get("LookAt"sv))) },
+          mUpRef{ Direction<FrameOfReference::World>::fromRaw(glm::normalize(parseVec3(node->get("UpRef"sv)))) },
+          mLensFile{ node->get("LensFile"sv)->as<std::string_view>() } {
+        if(const auto ptr = node->tryGet("ApertureDiameter"sv))
+            mApertureDiameter = (*ptr)->as<Float>();
+        if(const auto ptr = node->tryGet("FocusDistance"sv))
+            mFocusDistance = (*ptr)->as<Float>();
+        if(const auto ptr = node->tryGet("PupilSamples"sv))
+            mPupilSamples = std::max(1U, (*ptr)->as<uint32_t>());
+    }
+
+    Float deviceAspectRatio() const noexcept override {
+        return mSensorSize.x / mSensorSize.y;
+    }
+
+    std::pair<Ray, Float> sample(const glm::vec2 sensorNDC, SampleProvider& sampler) const noexcept override {
+        const auto t = sampler.sample();
+        const auto lensSample = sampler.sampleVec2();
+
+        const auto base = Point<FrameOfReference::World>::fromRaw(mTransform(t).translation);
+        const auto [forward, dist] = direction(base, mLookAt);
+        const auto right = Direction<FrameOfReference::World>::fromRaw(glm::normalize(cross(forward, mUpRef).raw()));
+        const auto up = cross(right, forward);
+
+        // the camera space: x = right, y = up, z = forward, the image is flipped on the film
+        const glm::vec3 film{ mSensorSize.x * (0.5f - sensorNDC.x), mSensorSize.y * (sensorNDC.y - 0.5f), 0.0f };
+        Float boundsArea;
+        const auto rear = sampleExitPupil(film, lensSample, boundsArea);
+        const LensRay filmRay{ film, rear - film };
+
+        LensRay out;
+        if(!LensSystem{ mTable->elements }.traceFromFilm(filmRay, &out))
+            return { Ray{ base, forward, t }, 0.0f };
+
+        const auto toWorld = [&](const glm::vec3& x) { return right.raw() * x.x + up.raw() * x.y + forward.raw() * x.z; };
+        const auto origin = Point<FrameOfReference::World>::fromRaw(base.raw() + toWorld(out.origin));
+        const auto rayDir = Direction<FrameOfReference::World>::fromRaw(glm::normalize(toWorld(out.direction)));
+
+        // the cos^4 falloff and the area of the pupil bounds relative to the on-axis one
+        const auto cosTheta = glm::normalize(filmRay.direction).z;
+        const auto weight = sqr(sqr(cosTheta)) * boundsArea / mTable->exitPupilBounds.front().area();
+        return { Ray{ origin, rayDir, t }, weight };
+    }
+
+    [[nodiscard]] Float spreadAngle(const Float ndcPixelSize) const noexcept override {
+        return mSensorSize.y * ndcPixelSize / mTable->effectiveFocalLength;
+    }
+};
+
+PIPER_REGISTER_CLASS(Realistic, Sensor);
+
+PIPER_NAMESPACE_END
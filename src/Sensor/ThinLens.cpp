@@ -21,6 +21,7 @@
 #include <Piper/Render/Sampler.hpp>
 #include <Piper/Render/SamplingUtil.hpp>
 #include <Piper/Render/Sensor.hpp>
+#include <optional>
 
 PIPER_NAMESPACE_BEGIN
 
@@ -31,6 +32,51 @@ class ThinLens final : public Sensor {
     Distance mFocalLength;
     Distance mApertureRadius;
 
+    // the camera basis only depends on the position of the camera
+    struct Frame final {
+        Point<FrameOfReference::World> base;
+        Direction<FrameOfReference::World> forward, right, up;
+        Distance focalDistance;
+        Point<FrameOfReference::World> lensCenter;
+    };
+    // the frame of a camera without translation during the shutter is shared by all rays
+    std::optional<Frame> mStaticFrame;
+
+    [[nodiscard]] Frame evalFrame(const Float t) const noexcept {
+        const auto base = Point<FrameOfReference::World>::fromRaw(mTransform(t).translation);
+
+        const auto [forward, dist] = direction(base, mLookAt);
+        const auto right = cross(forward, mUpRef);
+        const auto up = cross(right, forward);
+        // TODO:AF/MF mode support
+        const auto focalDistance = dot(forward, mLookAt - base);
+        const auto filmDistance = rcp(rcp(mFocalLength) - rcp(focalDistance));
+        return { base, forward, right, up, focalDistance, base + forward * filmDistance };
+    }
+
+    [[nodiscard]] Ray generate(const Frame& frame, const glm::vec2 sensorNDC, const Float t, const glm::vec2 lensSample) const noexcept {
+        const auto& [base, forward, right, up, focalDistance, lensCenter] = frame;
+        const auto filmHit = base + right * Distance::fromRaw(mSensorSize.x * (0.5f - sensorNDC.x)) +
+            up * Distance::fromRaw(mSensorSize.y * (sensorNDC.y - 0.5f));
+
+        const auto lensOffset = sampleUniformDisk(lensSample);
+        const auto lensHit = lensCenter + right * (mApertureRadius * lensOffset.x) + up * (mApertureRadius * lensOffset.y);
+        const auto dir = lensCenter - filmHit;
+        const auto planeOfFocusHit = lensCenter + dir * (focalDistance * rcp(dot(forward, dir)));
+
+        const auto [rayDir, _] = direction(lensHit, planeOfFocusHit);
+        return Ray{ lensHit, rayDir, t };
+    }
+
+protected:
+    void prepareFrame() override {
+        const auto& [transformBegin, transformEnd, curve] = mTransform;
+        if(curve == InterpolationCurve::Hold || transformBegin.translation == transformEnd.translation)
+            mStaticFrame = evalFrame(0.0f);
+        else
+            mStaticFrame.reset();
+    }
+
 public:
     explicit ThinLens(const Ref<ConfigNode>& node)
         : mSensorSize{ parseSensorSize(node->get("SensorSize"sv)) }, mLookAt{ Point<FrameOfReference::World>::fromRaw(
@@ -45,26 +91,34 @@ public:
     }
     std::pair<Ray, Float> sample(const glm::vec2 sensorNDC, SampleProvider& sampler) const noexcept override {
         const auto t = sampler.sample();
-        const auto base = Point<FrameOfReference::World>::fromRaw(mTransform(t).translation);
-
-        const auto [forward, dist] = direction(base, mLookAt);
-        const auto right = cross(forward, mUpRef);
-        const auto up = cross(right, forward);
-        const auto filmHit = base + right * Distance::fromRaw(mSensorSize.x * (0.5f - sensorNDC.x)) +
-            up * Distance::fromRaw(mSensorSize.y * (sensorNDC.y - 0.5f));
-        // TODO:AF/MF mode support
-        const auto focalDistance = dot(forward, mLookAt - base);
-        const auto filmDistance = rcp(rcp(mFocalLength) - rcp(focalDistance));
-        const auto lensCenter = base + forward * filmDistance;
+        const auto lensSample = sampler.sampleVec2();
+        return { generate(mStaticFrame ? *mStaticFrame : evalFrame(t), sensorNDC, t, lensSample), 1.0f };
+    }
 
-        const auto lensOffset = sampleUniformDisk(sampler.sampleVec2());
-        const auto lensHit = lensCenter + right * (mApertureRadius * lensOffset.x) + up * (mApertureRadius * lensOffset.y);
-        const auto dir = lensCenter - filmHit;
-        const auto planeOfFocusHit = lensCenter + dir * (focalDistance * rcp(dot(forward, dir)));
+    void sample(const std::span<const glm::vec2> sensorNDC, const std::span<SampleProvider* const> samplers, const std::span<Ray> rays,
+                const std::span<Float> weights) const noexcept override {
+        if(!mStaticFrame) {
+            Sensor::sample(sensorNDC, samplers, rays, weights);
+            return;
+        }
 
-        const auto [rayDir, _] = direction(lensHit, planeOfFocusHit);
+        // the samples are drawn first, so that the ray setup is a tight loop over the shared frame
+        std::pmr::vector<glm::vec3> samples{ sensorNDC.size(), context().scopedAllocator };
+        for(size_t idx = 0; idx < sensorNDC.size(); ++idx) {
+            auto& sampler = *samplers[idx];
+            const auto t = sampler.sample();
+            samples[idx] = { t, sampler.sampleVec2() };
+        }
+        const auto& frame = *mStaticFrame;
+        for(size_t idx = 0; idx < sensorNDC.size(); ++idx) {
+            rays[idx] = generate(frame, sensorNDC[idx], samples[idx].x, { samples[idx].y, samples[idx].z });
+            weights[idx] = 1.0f;
+        }
+    }
 
-        return { Ray{ lensHit, rayDir, t }, 1.0f };
+    [[nodiscard]] Float spreadAngle(const Float ndcPixelSize) const noexcept override {
+        // the film distance is close to the focal length unless the focus is very close
+        return mSensorSize.y * ndcPixelSize / mFocalLength.raw();
     }
 };
 
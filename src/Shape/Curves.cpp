@@ -0,0 +1,195 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <Piper/Core/FileIO.hpp>
+#include <Piper/Render/Acceleration.hpp>
+#include <Piper/Render/Material.hpp>
+#include <Piper/Render/Shape.hpp>
+
+PIPER_NAMESPACE_BEGIN
+
+// Please refer to http://www.cemyuksel.com/research/hairmodels/
+struct HairFileHeader final {
+    char signature[4];
+    uint32_t hairCount;
+    uint32_t pointCount;
+    uint32_t arrays;
+    uint32_t defaultSegments;
+    Float defaultThickness;
+    Float defaultTransparency;
+    Float defaultColor[3];
+    char info[88];
+};
+static_assert(sizeof(HairFileHeader) == 128);
+
+enum class HairFileArray : uint32_t { Segments = 1 << 0, Points = 1 << 1, Thickness = 1 << 2, Transparency = 1 << 3, Color = 1 << 4 };
+
+// the arrays of the hair file are not aligned
+template <typename T>
+static T readElement(const std::byte* base, const size_t idx) noexcept {
+    T res;
+    memcpy(&res, base + idx * sizeof(T), sizeof(T));
+    return res;
+}
+
+static CurveType parseCurveType(const std::string_view type) {
+    if(type == "Round"sv)
+        return CurveType::Round;
+    if(type == "Flat"sv)
+        return CurveType::Flat;
+    fatal(fmt::format("Unrecognized curve type {}", type));
+}
+
+// the strands of the hair file are converted to uniform cubic B-splines, one segment per span of the polylines
+class Curves final : public Shape {
+    std::pmr::vector<glm::vec4> mControlPoints{ trackedAllocator(MemoryTag::Geometry) };
+    std::pmr::vector<uint32_t> mSegments{ trackedAllocator(MemoryTag::Geometry) };
+    CurveType mType;
+
+    // NOTICE: the geometry references the buffers above, so it must be released first
+    Ref<BottomLevelGeometry> mGeometry;
+    Ref<PrimitiveGroup> mPrimitiveGroup;
+    Ref<MaterialBase> mSurface;
+
+    void load(const std::string_view path) {
+        const MappedFile file{ path };
+        const auto data = file.data();
+
+        HairFileHeader header{};
+        if(data.size() < sizeof(header))
+            fatal(fmt::format("Invalid hair file {}", path));
+        memcpy(&header, data.data(), sizeof(header));
+
+        const auto has = [&](const HairFileArray array) { return (header.arrays & static_cast<uint32_t>(array)) != 0; };
+        const auto segmentsSize = has(HairFileArray::Segments) ? header.hairCount * sizeof(uint16_t) : 0;
+        const auto pointsSize = header.pointCount * sizeof(glm::vec3);
+        const auto thicknessSize = has(HairFileArray::Thickness) ? header.pointCount * sizeof(Float) : 0;
+        if(memcmp(header.signature, "HAIR", 4) != 0 || !has(HairFileArray::Points) ||
+           data.size() < sizeof(header) + segmentsSize + pointsSize + thicknessSize)
+            fatal(fmt::format("Invalid hair file {}", path));
+
+        const auto segments = data.data() + sizeof(header);
+        const auto points = segments + segmentsSize;
+        const auto thickness = points + pointsSize;
+        const auto point = [&](const uint32_t idx) {
+            const auto radius = 0.5f * (thicknessSize ? readElement<Float>(thickness, idx) : header.defaultThickness);
+            return glm::vec4{ readElement<glm::vec3>(points, idx), radius };
+        };
+
+        mControlPoints.reserve(header.pointCount + 2 * header.hairCount);
+        mSegments.reserve(header.pointCount);
+        uint32_t first = 0;
+        for(uint32_t hair = 0; hair < header.hairCount; ++hair) {
+            const uint32_t count = segmentsSize ? readElement<uint16_t>(segments, hair) : header.defaultSegments;
+            if(first + count + 1 > header.pointCount)
+                fatal(fmt::format("Invalid hair file {}: strand {} is out of range", path, hair));
+
+            if(count != 0) {
+                // the phantom end points make the B-spline start and end at the end points of the polyline
+                const auto begin = point(first), end = point(first + count);
+                const auto base = static_cast<uint32_t>(mControlPoints.size());
+                mControlPoints.emplace_back(glm::vec3{ 2.0f * begin - point(first + 1) }, begin.w);
+                for(uint32_t idx = 0; idx <= count; ++idx)
+                    mControlPoints.push_back(point(first + idx));
+                mControlPoints.emplace_back(glm::vec3{ 2.0f * end - point(first + count - 1) }, end.w);
+                for(uint32_t idx = 0; idx < count; ++idx)
+                    mSegments.push_back(base + idx);
+            }
+            first += count + 1;
+        }
+    }
+
+public:
+    explicit Curves(const Ref<ConfigNode>& node) : mType{ CurveType::Round } {
+        const auto& builder = RenderGlobalSetting::get().accelerationBuilder;
+        auto settings = builder->shapeSettings();
+        if(const auto ptr = node->tryGet("Acceleration"sv))
+            settings = parseBuildSettings((*ptr)->as<Ref<ConfigNode>>(), settings);
+        if(const auto ptr = node->tryGet("Type"sv))
+            mType = parseCurveType((*ptr)->as<std::string_view>());
+
+        load(node->get("Path"sv)->as<std::string_view>());
+        mGeometry = builder->buildFromCurves(mControlPoints, mSegments, mType, settings);
+        mPrimitiveGroup = builder->buildInstance(mGeometry, *this);
+        mSurface = makeVariant<MaterialBase, Material>(node->get("Surface"sv)->as<Ref<ConfigNode>>());
+    }
+
+    void updateTransform(const KeyFrames& keyFrames, const TimeInterval timeInterval) override {
+        mPrimitiveGroup->updateTransform(
+            generateTransform(keyFrames, timeInterval, RenderGlobalSetting::get().accelerationBuilder->maxStepCount()));
+        mPrimitiveGroup->commit();
+    }
+
+    PrimitiveGroup* primitiveGroup() const noexcept override {
+        return mPrimitiveGroup.get();
+    }
+
+    // the segment parameter u is along the curve, texCoord.y is the offset (h + 1) / 2 across the width used by the hair BSDFs
+    Intersection generateIntersection(const Ray& ray, const Distance hitDistance,
+                                      const AffineTransform<FrameOfReference::Object, FrameOfReference::World>& transform,
+                                      const Normal<FrameOfReference::World>& geometryNormal, const glm::vec2 barycentric,
+                                      const uint32_t primitiveIndex) const noexcept override {
+        const auto* cp = mControlPoints.data() + mSegments[primitiveIndex];
+        const auto u = barycentric.x, v = barycentric.y;
+        // derivative of the uniform cubic B-spline basis
+        const auto derivative = 0.5f *
+            (-sqr(1.0f - u) * glm::vec3{ cp[0] } + (3.0f * u * u - 4.0f * u) * glm::vec3{ cp[1] } +
+             (-3.0f * u * u + 2.0f * u + 1.0f) * glm::vec3{ cp[2] } + u * u * glm::vec3{ cp[3] });
+        const auto tangent = transform(Direction<FrameOfReference::Object>::fromRaw(
+                                           glm::length2(derivative) > 0.0f ? glm::normalize(derivative) : glm::vec3{ 1.0f, 0.0f, 0.0f }))
+                                 .raw();
+
+        // the projection of wo on the normal plane of the curve
+        const auto wo = -ray.direction.raw();
+        const auto woPerp = wo - glm::dot(wo, tangent) * tangent;
+        const auto facing = glm::length2(woPerp) > 0.0f ? glm::normalize(woPerp) : geometryNormal.raw();
+
+        // the shading normal is the normal of the equivalent cylinder, so that h = sin(gammaO) is consistent with the shading frame
+        glm::vec3 normal;
+        Float h;
+        if(mType == CurveType::Round) {
+            normal = geometryNormal.raw() - glm::dot(geometryNormal.raw(), tangent) * tangent;
+            normal = glm::length2(normal) > 0.0f ? glm::normalize(normal) : facing;
+            h = std::clamp(glm::dot(glm::cross(normal, facing), tangent), -1.0f, 1.0f);
+        } else {
+            h = std::clamp(2.0f * v - 1.0f, -1.0f, 1.0f);
+            normal = safeSqrt(1.0f - h * h) * facing - h * glm::cross(tangent, facing);
+        }
+
+        const auto coneWidth = ray.coneWidth + ray.coneSpread * hitDistance.raw();
+        return SurfaceHit{ ray.origin + ray.direction * hitDistance,
+                           hitDistance,
+                           geometryNormal,
+                           Normal<FrameOfReference::World>::fromRaw(normal),
+                           Direction<FrameOfReference::World>::fromRaw(tangent),
+                           primitiveIndex,
+                           barycentric,
+                           TexCoord{ u, 0.5f * (h + 1.0f) },
+                           ray.t,
+                           coneWidth,
+                           0.0f,
+                           Handle<Material>{ mSurface.get() },
+                           Handle<Light>{},
+                           Handle<Medium>{} };
+    }
+};
+
+PIPER_REGISTER_CLASS(Curves, Shape);
+
+PIPER_NAMESPACE_END
@@ -0,0 +1,265 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/FileIO.hpp>
+#include <Piper/Render/Acceleration.hpp>
+#include <Piper/Render/Material.hpp>
+#include <Piper/Render/Math.hpp>
+#include <Piper/Render/Shape.hpp>
+
+PIPER_NAMESPACE_BEGIN
+
+// Please refer to "Building an Orthonormal Basis, Revisited" (Duff et al. 2017)
+static std::pair<glm::vec3, glm::vec3> orthonormalBasis(const glm::vec3& n) noexcept {
+    const auto sign = std::copysign(1.0f, n.z);
+    const auto a = -1.0f / (sign + n.z);
+    const auto b = n.x * n.y * a;
+    return { { 1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x }, { b, sign + n.y * n.y * a, -n.y } };
+}
+
+// the angle in [0, 1) of the local coordinates
+static Float azimuth(const Float x, const Float y) noexcept {
+    const auto phi = std::atan2(y, x) * invTwoPi;
+    return phi < 0.0f ? phi + 1.0f : phi;
+}
+
+// The analytic primitives are intersected by the backend directly, so a particle costs one record instead of a tessellated
+// mesh. The records are read from a raw file of 32-bit floats, or a single primitive is given inline.
+class AnalyticShape : public Shape {
+protected:
+    std::pmr::vector<glm::vec4> mPoints{ trackedAllocator(MemoryTag::Geometry) };
+    // padded by one normal for the 16-byte loads of Embree
+    std::pmr::vector<glm::vec3> mNormals{ trackedAllocator(MemoryTag::Geometry) };
+    std::pmr::vector<uint32_t> mSegments{ trackedAllocator(MemoryTag::Geometry) };
+
+    // NOTICE: the geometry references the buffers above, so it must be released first
+    Ref<BottomLevelGeometry> mGeometry;
+    Ref<PrimitiveGroup> mPrimitiveGroup;
+    Ref<MaterialBase> mSurface;
+
+    static std::span<const Float> readRecords(const MappedFile& file, const std::string_view path, const size_t stride) {
+        const auto data = file.data();
+        if(data.size() % (stride * sizeof(Float)) != 0)
+            fatal(fmt::format("Invalid primitive file {}: expect {} floats per primitive", path, stride));
+        return { reinterpret_cast<const Float*>(data.data()), data.size() / sizeof(Float) };
+    }
+
+    template <typename Build>
+    void build(const Ref<ConfigNode>& node, Build&& buildGeometry) {
+        const auto& builder = RenderGlobalSetting::get().accelerationBuilder;
+        auto settings = builder->shapeSettings();
+        if(const auto ptr = node->tryGet("Acceleration"sv))
+            settings = parseBuildSettings((*ptr)->as<Ref<ConfigNode>>(), settings);
+        mGeometry = std::invoke(std::forward<Build>(buildGeometry), *builder, settings);
+        mPrimitiveGroup = builder->buildInstance(mGeometry, *this);
+        mSurface = makeVariant<MaterialBase, Material>(node->get("Surface"sv)->as<Ref<ConfigNode>>());
+    }
+
+    // the parametric coordinates are also the texture coordinates, dpdu and dpdv are the unnormalized partial derivatives
+    Intersection makeHit(const Ray& ray, const Distance hitDistance,
+                         const AffineTransform<FrameOfReference::Object, FrameOfReference::World>& transform,
+                         const Normal<FrameOfReference::World>& geometryNormal, const uint32_t primitiveIndex, const glm::vec3& normal,
+                         const glm::vec3& tangent, const glm::vec3& dpdu, const glm::vec3& dpdv, const glm::vec2 uv) const noexcept {
+        const auto outer = transform(Normal<FrameOfReference::Object>::fromRaw(normal));
+        const auto worldTangent = transform(Direction<FrameOfReference::Object>::fromRaw(tangent));
+
+        // the ray cone projected to the parametric space, see TriangleMesh
+        const auto worldArea = glm::length(glm::cross(transform(Vector<FrameOfReference::Object>::fromRaw(dpdu)).raw(),
+                                                      transform(Vector<FrameOfReference::Object>::fromRaw(dpdv)).raw()));
+        const auto coneWidth = ray.coneWidth + ray.coneSpread * hitDistance.raw();
+        const auto footprint =
+            worldArea > 0.0f ? coneWidth / std::sqrt(worldArea) / std::fmax(absDot(geometryNormal, ray.direction), 0.1f) : 0.0f;
+
+        return SurfaceHit{ ray.origin + ray.direction * hitDistance,
+                           hitDistance,
+                           geometryNormal,
+                           outer,
+                           worldTangent,
+                           primitiveIndex,
+                           uv,
+                           uv,
+                           ray.t,
+                           coneWidth,
+                           footprint,
+                           Handle<Material>{ mSurface.get() },
+                           Handle<Light>{},
+                           Handle<Medium>{} };
+    }
+
+    [[nodiscard]] glm::vec3 objectHit(const Ray& ray, const Distance hitDistance,
+                                      const AffineTransform<FrameOfReference::Object, FrameOfReference::World>& transform) const noexcept {
+        return transform(ray.origin + ray.direction * hitDistance).raw();
+    }
+
+public:
+    void updateTransform(const KeyFrames& keyFrames, const TimeInterval timeInterval) override {
+        mPrimitiveGroup->updateTransform(
+            generateTransform(keyFrames, timeInterval, RenderGlobalSetting::get().accelerationBuilder->maxStepCount()));
+        mPrimitiveGroup->commit();
+    }
+
+    PrimitiveGroup* primitiveGroup() const noexcept override {
+        return mPrimitiveGroup.get();
+    }
+};
+
+// records: center (3), radius
+// (u, v) = (azimuth, polar angle) / (2pi, pi) around the z axis
+class Spheres final : public AnalyticShape {
+public:
+    explicit Spheres(const Ref<ConfigNode>& node) {
+        if(const auto ptr = node->tryGet("Path"sv)) {
+            const auto path = (*ptr)->as<std::string_view>();
+            const MappedFile file{ path };
+            const auto records = readRecords(file, path, 4);
+            mPoints.reserve(records.size() / 4);
+            for(size_t idx = 0; idx < records.size(); idx += 4)
+                mPoints.emplace_back(records[idx], records[idx + 1], records[idx + 2], records[idx + 3]);
+        } else
+            mPoints.emplace_back(parseVec3(node->get("Center"sv)), node->get("Radius"sv)->as<Float>());
+
+        build(node, [&](const AccelerationBuilder& builder, const BuildSettings& settings) {
+            return builder.buildFromPoints(mPoints, {}, PointType::Sphere, settings);
+        });
+    }
+
+    Intersection generateIntersection(const Ray& ray, const Distance hitDistance,
+                                      const AffineTransform<FrameOfReference::Object, FrameOfReference::World>& transform,
+                                      const Normal<FrameOfReference::World>& geometryNormal, const glm::vec2,
+                                      const uint32_t primitiveIndex) const noexcept override {
+        const auto& sphere = mPoints[primitiveIndex];
+        const auto center = glm::vec3{ sphere }, radius = sphere.w;
+        const auto offset = objectHit(ray, hitDistance, transform) - center;
+        const auto n = glm::length2(offset) > 0.0f ? glm::normalize(offset) : glm::vec3{ 0.0f, 0.0f, 1.0f };
+
+        const auto u = azimuth(n.x, n.y), theta = std::acos(std::clamp(n.z, -1.0f, 1.0f));
+        const auto cosPhi = std::cos(u * twoPi), sinPhi = std::sin(u * twoPi);
+        const auto sinTheta = std::sin(theta), cosTheta = std::cos(theta);
+        const glm::vec3 tangent{ -sinPhi, cosPhi, 0.0f };
+        const auto dpdu = twoPi * radius * sinTheta * tangent;
+        const auto dpdv = pi * radius * glm::vec3{ cosTheta * cosPhi, cosTheta * sinPhi, -sinTheta };
+        return makeHit(ray, hitDistance, transform, geometryNormal, primitiveIndex, n, tangent, dpdu, dpdv, { u, theta * invPi });
+    }
+};
+
+// records: center (3), radius, normal (3)
+// (u, v) = (azimuth / 2pi, 1 - distance to the center / radius)
+class Disks final : public AnalyticShape {
+public:
+    explicit Disks(const Ref<ConfigNode>& node) {
+        if(const auto ptr = node->tryGet("Path"sv)) {
+            const auto path = (*ptr)->as<std::string_view>();
+            const MappedFile file{ path };
+            const auto records = readRecords(file, path, 7);
+            mPoints.reserve(records.size() / 7);
+            mNormals.reserve(records.size() / 7 + 1);
+            for(size_t idx = 0; idx < records.size(); idx += 7) {
+                mPoints.emplace_back(records[idx], records[idx + 1], records[idx + 2], records[idx + 3]);
+                mNormals.push_back(glm::normalize(glm::vec3{ records[idx + 4], records[idx + 5], records[idx + 6] }));
+            }
+        } else {
+            mPoints.emplace_back(parseVec3(node->get("Center"sv)), node->get("Radius"sv)->as<Float>());
+            glm::vec3 normal{ 0.0f, 0.0f, 1.0f };
+            if(const auto normalPtr = node->tryGet("Normal"sv))
+                normal = glm::normalize(parseVec3(*normalPtr));
+            mNormals.push_back(normal);
+        }
+        mNormals.emplace_back(0.0f);
+
+        build(node, [&](const AccelerationBuilder& builder, const BuildSettings& settings) {
+            return builder.buildFromPoints(mPoints, { mNormals.data(), mNormals.size() - 1 }, PointType::Disk, settings);
+        });
+    }
+
+    Intersection generateIntersection(const Ray& ray, const Distance hitDistance,
+                                      const AffineTransform<FrameOfReference::Object, FrameOfReference::World>& transform,
+                                      const Normal<FrameOfReference::World>& geometryNormal, const glm::vec2,
+                                      const uint32_t primitiveIndex) const noexcept override {
+        const auto& disk = mPoints[primitiveIndex];
+        const auto& n = mNormals[primitiveIndex];
+        const auto [s, t] = orthonormalBasis(n);
+        const auto offset = objectHit(ray, hitDistance, transform) - glm::vec3{ disk };
+        const auto x = glm::dot(offset, s), y = glm::dot(offset, t);
+        const auto rho = std::sqrt(x * x + y * y);
+
+        const auto u = azimuth(x, y);
+        const auto cosPhi = std::cos(u * twoPi), sinPhi = std::sin(u * twoPi);
+        const auto tangent = -sinPhi * s + cosPhi * t;
+        const auto dpdu = twoPi * rho * tangent;
+        const auto dpdv = -disk.w * (cosPhi * s + sinPhi * t);
+        return makeHit(ray, hitDistance, transform, geometryNormal, primitiveIndex, n, tangent, dpdu, dpdv,
+                       { u, std::fmax(1.0f - rho / disk.w, 0.0f) });
+    }
+};
+
+// records: begin (3), radius at the begin, end (3), radius at the end
+// (u, v) = (azimuth around the axis / 2pi, position along the axis), the different radii make cones
+class Cylinders final : public AnalyticShape {
+public:
+    explicit Cylinders(const Ref<ConfigNode>& node) {
+        if(const auto ptr = node->tryGet("Path"sv)) {
+            const auto path = (*ptr)->as<std::string_view>();
+            const MappedFile file{ path };
+            const auto records = readRecords(file, path, 8);
+            mPoints.reserve(records.size() / 4);
+            for(size_t idx = 0; idx < records.size(); idx += 4)
+                mPoints.emplace_back(records[idx], records[idx + 1], records[idx + 2], records[idx + 3]);
+        } else {
+            const auto radius = node->get("Radius"sv)->as<Float>();
+            mPoints.emplace_back(parseVec3(node->get("Begin"sv)), radius);
+            mPoints.emplace_back(parseVec3(node->get("End"sv)), radius);
+        }
+        mSegments.reserve(mPoints.size() / 2);
+        for(uint32_t idx = 0; idx < mPoints.size(); idx += 2)
+            mSegments.push_back(idx);
+
+        build(node, [&](const AccelerationBuilder& builder, const BuildSettings& settings) {
+            return builder.buildFromCylinders(mPoints, mSegments, settings);
+        });
+    }
+
+    Intersection generateIntersection(const Ray& ray, const Distance hitDistance,
+                                      const AffineTransform<FrameOfReference::Object, FrameOfReference::World>& transform,
+                                      const Normal<FrameOfReference::World>& geometryNormal, const glm::vec2,
+                                      const uint32_t primitiveIndex) const noexcept override {
+        const auto& begin = mPoints[mSegments[primitiveIndex]];
+        const auto& end = mPoints[mSegments[primitiveIndex] + 1];
+        const auto axis = glm::vec3{ end } - glm::vec3{ begin };
+        const auto [s, t] = orthonormalBasis(glm::normalize(axis));
+        const auto offset = objectHit(ray, hitDistance, transform) - glm::vec3{ begin };
+        const auto v = std::clamp(glm::dot(offset, axis) / glm::length2(axis), 0.0f, 1.0f);
+
+        const auto u = azimuth(glm::dot(offset, s), glm::dot(offset, t));
+        const auto cosPhi = std::cos(u * twoPi), sinPhi = std::sin(u * twoPi);
+        const auto radial = cosPhi * s + sinPhi * t;
+        const auto tangent = -sinPhi * s + cosPhi * t;
+        const auto dpdu = twoPi * glm::mix(begin.w, end.w, v) * tangent;
+        const auto dpdv = axis + (end.w - begin.w) * radial;
+        // the normal of the cone leans along the axis, dpdu vanishes at the apex
+        const auto normal = glm::normalize(glm::cross(tangent, dpdv));
+        return makeHit(ray, hitDistance, transform, geometryNormal, primitiveIndex, normal, tangent, dpdu, dpdv, { u, v });
+    }
+};
+
+PIPER_REGISTER_CLASS(Spheres, Shape);
+PIPER_REGISTER_CLASS(Disks, Shape);
+PIPER_REGISTER_CLASS(Cylinders, Shape);
+
+PIPER_NAMESPACE_END
@@ -0,0 +1,203 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <Piper/Render/Acceleration.hpp>
+#include <Piper/Render/Material.hpp>
+#include <Piper/Render/Shape.hpp>
+#include <Piper/Render/Texture.hpp>
+#include <bit>
+#include <map>
+#pragma warning(push, 0)
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+#pragma warning(pop)
+
+PIPER_NAMESPACE_BEGIN
+
+// The Catmull-Clark subdivision surface of a quad cage. The patches are tessellated on the first hit and kept in the bounded
+// tessellation cache of the backend, so the off-screen patches never cost memory. The tessellation rates of the edges follow the
+// projected edge lengths from the dicing camera.
+class SubdivisionMesh final : public Shape {
+    // the vertex buffer is padded by one vertex for the 16-byte loads of Embree
+    std::pmr::vector<glm::vec3> mVertices{ trackedAllocator(MemoryTag::Geometry) };
+    std::pmr::vector<glm::uvec4> mQuads{ trackedAllocator(MemoryTag::Geometry) };
+    std::pmr::vector<Float> mEdgeLevels{ trackedAllocator(MemoryTag::Geometry) };
+    // the texture coordinates of the face corners, so the cage keeps its topology at the seams
+    std::pmr::vector<TexCoord> mTexCoords{ trackedAllocator(MemoryTag::Geometry) };
+
+    Ref<ScalarTexture2D> mDisplacement;
+    Float mDisplacementScale = 1.0f;
+
+    // NOTICE: the geometry references the buffers above, so it must be released first
+    Ref<BottomLevelGeometry> mGeometry;
+    Ref<PrimitiveGroup> mPrimitiveGroup;
+    Ref<MaterialBase> mSurface;
+
+    void load(const std::string_view path) {
+        // the cage must not be triangulated, and the vertices split by the seams of the texture coordinates are welded below
+        Assimp::Importer importer;
+        const auto* scene = importer.ReadFile(std::string{ path }, 0);
+        if(!scene || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE)
+            fatal(fmt::format("Failed to load scene {}: {}", path, importer.GetErrorString()));
+
+        for(uint32_t k = 0; k < scene->mNumMeshes; ++k) {
+            const auto mesh = scene->mMeshes[k];
+            // the vertices are welded by position only, so the patches on both sides of a seam share their edges
+            // NOTICE: the meshes are welded separately, so the touching meshes stay separate surfaces
+            std::map<std::array<uint32_t, 3>, uint32_t> welded;
+            std::pmr::vector<uint32_t> remap{ mesh->mNumVertices, context().globalAllocator };
+            for(uint32_t idx = 0; idx < mesh->mNumVertices; ++idx) {
+                const auto& pos = mesh->mVertices[idx];
+                // +0.0f merges the signed zeros
+                const std::array key{ std::bit_cast<uint32_t>(pos.x + 0.0f), std::bit_cast<uint32_t>(pos.y + 0.0f),
+                                      std::bit_cast<uint32_t>(pos.z + 0.0f) };
+                const auto [iter, inserted] = welded.emplace(key, static_cast<uint32_t>(mVertices.size()));
+                if(inserted)
+                    mVertices.emplace_back(pos.x, pos.y, pos.z);
+                remap[idx] = iter->second;
+            }
+
+            for(uint32_t idx = 0; idx < mesh->mNumFaces; ++idx) {
+                const auto& face = mesh->mFaces[idx];
+                if(face.mNumIndices != 4)
+                    fatal(fmt::format("Subdivision cage {} has a face with {} vertices, only quads are supported", path, face.mNumIndices));
+                glm::uvec4 quad;
+                for(uint32_t corner = 0; corner < 4; ++corner) {
+                    const auto vertex = face.mIndices[corner];
+                    quad[corner] = remap[vertex];
+                    const auto coord = mesh->HasTextureCoords(0) ? mesh->mTextureCoords[0][vertex] : aiVector3D{ 0.0f };
+                    mTexCoords.emplace_back(coord.x, coord.y);
+                }
+                mQuads.push_back(quad);
+            }
+        }
+        mVertices.emplace_back(0.0f);
+    }
+
+    // the quad is parameterized as v0 (0, 0), v1 (1, 0), v2 (1, 1), v3 (0, 1)
+    template <typename T>
+    [[nodiscard]] static T bilinear(const std::array<T, 4>& x, const glm::vec2 uv) noexcept {
+        return (x[0] * (1.0f - uv.x) + x[1] * uv.x) * (1.0f - uv.y) + (x[3] * (1.0f - uv.x) + x[2] * uv.x) * uv.y;
+    }
+
+    [[nodiscard]] TexCoord texCoord(const uint32_t face, const glm::vec2 uv) const noexcept {
+        const auto corners = mTexCoords.data() + static_cast<size_t>(face) * 4;
+        return bilinear(std::array{ corners[0], corners[1], corners[2], corners[3] }, uv);
+    }
+
+public:
+    explicit SubdivisionMesh(const Ref<ConfigNode>& node) {
+        const auto& builder = RenderGlobalSetting::get().accelerationBuilder;
+        auto settings = builder->shapeSettings();
+        if(const auto ptr = node->tryGet("Acceleration"sv))
+            settings = parseBuildSettings((*ptr)->as<Ref<ConfigNode>>(), settings);
+
+        load(node->get("Path"sv)->as<std::string_view>());
+
+        // the uniform rate without the dicing camera
+        Float level = 8.0f, maxLevel = 64.0f;
+        if(const auto ptr = node->tryGet("Level"sv))
+            level = (*ptr)->as<Float>();
+        if(const auto ptr = node->tryGet("MaxLevel"sv))
+            maxLevel = (*ptr)->as<Float>();
+
+        mEdgeLevels.assign(mQuads.size() * 4, std::clamp(level, 1.0f, maxLevel));
+        if(const auto ptr = node->tryGet("DicingCamera"sv)) {
+            // NOTICE: the dicing camera is placed in the object space of the shape
+            const auto camera = (*ptr)->as<Ref<ConfigNode>>();
+            const auto position = parseVec3(camera->get("Position"sv));
+            const auto pixelAngle = glm::radians(camera->get("FieldOfView"sv)->as<Float>()) / camera->get("Width"sv)->as<Float>();
+            Float edgeLength = 1.0f;  // in pixels
+            if(const auto edgePtr = node->tryGet("EdgeLength"sv))
+                edgeLength = (*edgePtr)->as<Float>();
+
+            for(size_t face = 0; face < mQuads.size(); ++face) {
+                const auto& quad = mQuads[face];
+                for(uint32_t edge = 0; edge < 4; ++edge) {
+                    const auto& a = mVertices[quad[edge]];
+                    const auto& b = mVertices[quad[(edge + 1) % 4]];
+                    const auto distance = std::fmax(glm::distance((a + b) * 0.5f, position), epsilon);
+                    const auto pixels = glm::distance(a, b) / (distance * pixelAngle);
+                    mEdgeLevels[face * 4 + edge] = std::clamp(pixels / edgeLength, 1.0f, maxLevel);
+                }
+            }
+        }
+
+        DisplacementFunction displacement;
+        if(node->tryGet("Displacement"sv)) {
+            mDisplacement = getScalarTexture2D(node, "Displacement"sv, ""sv, 0.0f);
+            if(const auto ptr = node->tryGet("DisplacementScale"sv))
+                mDisplacementScale = (*ptr)->as<Float>();
+            displacement = [this](const uint32_t face, const glm::vec2 uv) {
+                return mDisplacementScale * mDisplacement->evaluate(TextureEvaluateInfo{ texCoord(face, uv), 0.0f, face, 0.0f, uv });
+            };
+        }
+
+        mGeometry = builder->buildFromSubdivisionMesh({ mVertices.data(), mVertices.size() - 1 }, mQuads, mEdgeLevels,
+                                                      std::move(displacement), settings);
+        mPrimitiveGroup = builder->buildInstance(mGeometry, *this);
+        mSurface = makeVariant<MaterialBase, Material>(node->get("Surface"sv)->as<Ref<ConfigNode>>());
+    }
+
+    void updateTransform(const KeyFrames& keyFrames, const TimeInterval timeInterval) override {
+        mPrimitiveGroup->updateTransform(
+            generateTransform(keyFrames, timeInterval, RenderGlobalSetting::get().accelerationBuilder->maxStepCount()));
+        mPrimitiveGroup->commit();
+    }
+
+    PrimitiveGroup* primitiveGroup() const noexcept override {
+        return mPrimitiveGroup.get();
+    }
+
+    // the geometry normal of the displaced limit surface is used for shading, the cage gives the tangent and the orientation
+    Intersection generateIntersection(const Ray& ray, const Distance hitDistance,
+                                      const AffineTransform<FrameOfReference::Object, FrameOfReference::World>& transform,
+                                      const Normal<FrameOfReference::World>& geometryNormal, const glm::vec2 barycentric,
+                                      const uint32_t primitiveIndex) const noexcept override {
+        const auto& quad = mQuads[primitiveIndex];
+        const std::array corners{ mVertices[quad.x], mVertices[quad.y], mVertices[quad.z], mVertices[quad.w] };
+        const auto dpdu = glm::mix(corners[1] - corners[0], corners[2] - corners[3], barycentric.y);
+        const auto dpdv = glm::mix(corners[3] - corners[0], corners[2] - corners[1], barycentric.x);
+        const auto outer = transform(Normal<FrameOfReference::Object>::fromRaw(glm::normalize(glm::cross(dpdu, dpdv))));
+        const auto tangent = transform(Direction<FrameOfReference::Object>::fromRaw(glm::normalize(dpdu)));
+        const auto shadingNormal = dot(outer, geometryNormal) < 0.0f ? -geometryNormal : geometryNormal;
+
+        const auto coord = texCoord(primitiveIndex, barycentric);
+        const auto coneWidth = ray.coneWidth + ray.coneSpread * hitDistance.raw();
+        return SurfaceHit{ ray.origin + ray.direction * hitDistance,
+                           hitDistance,
+                           geometryNormal,
+                           shadingNormal,
+                           tangent,
+                           primitiveIndex,
+                           barycentric,
+                           coord,
+                           ray.t,
+                           coneWidth,
+                           0.0f,
+                           Handle<Material>{ mSurface.get() },
+                           Handle<Light>{},
+                           Handle<Medium>{} };
+    }
+};
+
+PIPER_REGISTER_CLASS(SubdivisionMesh, Shape);
+
+PIPER_NAMESPACE_END
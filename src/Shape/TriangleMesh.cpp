@@ -18,9 +18,19 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <Piper/Core/FileIO.hpp>
+#include <Piper/Core/Residency.hpp>
 #include <Piper/Render/Acceleration.hpp>
+#include <Piper/Render/Light.hpp>
 #include <Piper/Render/Material.hpp>
+#include <Piper/Render/Medium.hpp>
 #include <Piper/Render/Shape.hpp>
+#include <Piper/Render/Texture.hpp>
+#include <fstream>
+#include <glm/gtc/packing.hpp>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
 #pragma warning(push, 0)
 // NOTE: assimp -> Irrlicht.dll -> opengl32.dll will cause memory leak.
 #include <assimp/Importer.hpp>
@@ -31,23 +41,149 @@
 
 PIPER_NAMESPACE_BEGIN
 
-class TriangleMesh final : public Shape {
-    Ref<PrimitiveGroup> mPrimitiveGroup;
-    std::pmr::vector<glm::uvec3> mIndices{ context().globalAllocator };
-    std::pmr::vector<Normal<FrameOfReference::Object>> mNormals{ context().globalAllocator };
-    std::pmr::vector<Direction<FrameOfReference::Object>> mTangents{ context().globalAllocator };
-    std::pmr::vector<TexCoord> mTexCoords{ context().globalAllocator };
-    Ref<MaterialBase> mSurface;
+// the shading attributes of a vertex are interleaved, so that a hit only touches one cache line per vertex
+struct VertexAttributes final {
+    Normal<FrameOfReference::Object> normal;
+    Direction<FrameOfReference::Object> tangent;
+    TexCoord texCoord;
+};
 
-public:
-    explicit TriangleMesh(const Ref<ConfigNode>& node) {
-        const auto path = node->get("Path"sv)->as<std::string_view>();
+// octahedral normal and tangent (2x16-bit snorm) and half texcoord, 12 bytes instead of 32 bytes per vertex
+struct CompressedVertexAttributes final {
+    uint32_t normal;
+    uint32_t tangent;
+    uint32_t texCoord;
+};
+
+static uint32_t encodeOctahedral(const glm::vec3 dir) noexcept {
+    const auto norm = std::fabs(dir.x) + std::fabs(dir.y) + std::fabs(dir.z);
+    if(norm == 0.0f)  // NOLINT(clang-diagnostic-float-equal)
+        return glm::packSnorm2x16(glm::vec2{ 0.0f });
+
+    auto p = glm::vec2{ dir.x, dir.y } / norm;
+    // fold the lower hemisphere
+    if(dir.z < 0.0f)
+        p = (1.0f - glm::abs(glm::vec2{ p.y, p.x })) * glm::vec2{ p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f };
+    return glm::packSnorm2x16(p);
+}
+
+static glm::vec3 decodeOctahedral(const uint32_t value) noexcept {
+    const auto p = glm::unpackSnorm2x16(value);
+    glm::vec3 dir{ p.x, p.y, 1.0f - std::fabs(p.x) - std::fabs(p.y) };
+    const auto t = std::fmax(-dir.z, 0.0f);
+    dir.x += dir.x >= 0.0f ? -t : t;
+    dir.y += dir.y >= 0.0f ? -t : t;
+    return glm::normalize(dir);
+}
+
+struct MeshAttributes final {
+    // the positions and indices are shared with the acceleration backend without copying
+    std::span<const glm::vec3> positions;
+    std::span<const glm::uvec3> indices;
+    // only one of them is used
+    std::span<const VertexAttributes> vertices;
+    std::span<const CompressedVertexAttributes> compressedVertices;
+};
+
+constexpr uint32_t importFlags = aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_SortByPType |
+    aiProcess_GenSmoothNormals | aiProcess_FixInfacingNormals | aiProcess_ImproveCacheLocality | aiProcess_CalcTangentSpace;
+
+// NOTICE: bump the version after changing the layout of the native mesh format or the post-processing of the imported meshes
+constexpr uint32_t nativeMeshVersion = 1;
+
+// layout: "PMSH", header, positions (with the padding vertex), indices, vertex attributes
+struct NativeMeshHeader final {
+    uint64_t sourceHash;
+    uint32_t version;
+    uint32_t importFlags;
+    uint32_t verticesCount;
+    uint32_t trianglesCount;
+};
+
+// the loaded mesh is shared by all triangle meshes with the same path, so that repeated assets only have one copy of the
+// vertex attributes and one bottom-level BVH
+class MeshData final : public RefCountBase {
+    std::string mKey;
+
+    // the buffers are either mapped from the native mesh file or imported by Assimp
+    std::optional<MappedFile> mMappedFile;
+    std::pmr::vector<glm::vec3> mPositions{ trackedAllocator(MemoryTag::Geometry) };
+    std::pmr::vector<glm::uvec3> mIndices{ trackedAllocator(MemoryTag::Geometry) };
+    std::pmr::vector<VertexAttributes> mVertices{ trackedAllocator(MemoryTag::Geometry) };
+    std::pmr::vector<CompressedVertexAttributes> mCompressedVertices{ trackedAllocator(MemoryTag::Geometry) };
+    MeshAttributes mAttributes;
+    // the first residency block of the vertex attributes in out-of-core mode
+    std::optional<uint32_t> mResidencyBlock;
+
+    // NOTICE: the geometry references the buffers above, so it must be released first
+    Ref<BottomLevelGeometry> mGeometry;
+
+    bool mapNativeMesh(const fs::path& cachePath, const uint64_t sourceHash) {
+        if(!fs::exists(cachePath))
+            return false;
+
+        auto& file = mMappedFile.emplace(cachePath);
+        const auto data = file.data();
+
+        NativeMeshHeader header{};
+        constexpr auto headerSize = 4 + sizeof(NativeMeshHeader);
+        if(data.size() >= headerSize) {
+            memcpy(&header, data.data() + 4, sizeof(header));
+            const auto expectedSize = headerSize + (header.verticesCount + 1) * sizeof(glm::vec3) +
+                header.trianglesCount * sizeof(glm::uvec3) + header.verticesCount * sizeof(VertexAttributes);
+
+            if(memcmp(data.data(), "PMSH", 4) == 0 && header.sourceHash == sourceHash && header.version == nativeMeshVersion &&
+               header.importFlags == importFlags && data.size() == expectedSize) {
+                auto ptr = data.data() + headerSize;
+                const auto view = [&]<typename T>(std::span<const T>& span, const uint32_t size, const uint32_t stride) {
+                    span = { reinterpret_cast<const T*>(ptr), size };
+                    ptr += stride * sizeof(T);
+                };
+                view(mAttributes.positions, header.verticesCount, header.verticesCount + 1);
+                view(mAttributes.indices, header.trianglesCount, header.trianglesCount);
+                view(mAttributes.vertices, header.verticesCount, header.verticesCount);
+                return true;
+            }
+        }
+
+        warning(fmt::format("Invalid native mesh \"{}\", regenerating it", cachePath.string()));
+        mMappedFile.reset();
+        return false;
+    }
 
+    // write to a temporary file first, so an interrupted run never leaves a broken native mesh behind
+    void saveNativeMesh(const fs::path& cachePath, const uint64_t sourceHash) const {
+        // the same source may be imported concurrently with different build settings
+        auto tmpPath = cachePath;
+        tmpPath += fmt::format(".{:016x}.tmp", std::hash<std::string>{}(mKey));
+
+        {
+            const NativeMeshHeader header{ sourceHash, nativeMeshVersion, importFlags, static_cast<uint32_t>(mVertices.size()),
+                                           static_cast<uint32_t>(mIndices.size()) };
+            std::ofstream out{ tmpPath, std::ios::out | std::ios::binary };
+            out.write("PMSH", 4);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(mPositions.data()),
+                      static_cast<std::streamsize>(mPositions.size() * sizeof(glm::vec3)));
+            out.write(reinterpret_cast<const char*>(mIndices.data()), static_cast<std::streamsize>(mIndices.size() * sizeof(glm::uvec3)));
+            out.write(reinterpret_cast<const char*>(mVertices.data()),
+                      static_cast<std::streamsize>(mVertices.size() * sizeof(VertexAttributes)));
+            out.flush();
+            if(!out) {
+                warning(fmt::format("Failed to save native mesh \"{}\"", tmpPath.string()));
+                return;
+            }
+        }
+
+        std::error_code ec;
+        fs::rename(tmpPath, cachePath, ec);
+        if(ec)
+            warning(fmt::format("Failed to save native mesh \"{}\": {}", cachePath.string(), ec.message()));
+    }
+
+    void import(const std::string_view path) {
         Assimp::Importer importer;
-        const auto* scene =
-            importer.ReadFile(path.data(),
-                              aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_SortByPType | aiProcess_GenSmoothNormals |
-                                  aiProcess_FixInfacingNormals | aiProcess_ImproveCacheLocality | aiProcess_CalcTangentSpace);
+        const auto* scene = importer.ReadFile(std::string{ path }, importFlags);
         if(!scene || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE)
             fatal(fmt::format("Failed to load scene {}: {}", path, importer.GetErrorString()));
 
@@ -59,76 +195,301 @@ public:
         }
 
         static_assert(sizeof(aiVector3D) == 3 * sizeof(Float));
-        static_assert(sizeof(Normal<FrameOfReference::Object>) == 3 * sizeof(Float));
-        static_assert(sizeof(Direction<FrameOfReference::Object>) == 3 * sizeof(Float));
+        static_assert(sizeof(glm::vec3) == 3 * sizeof(Float));
         static_assert(sizeof(glm::uvec3) == 3 * sizeof(uint32_t));
+        static_assert(sizeof(VertexAttributes) == 8 * sizeof(Float));
 
+        // Embree reads the last vertex with a 16-byte load, so one more vertex is appended as padding
+        mPositions.resize(verticesCount + 1);
         mIndices.resize(trianglesCount);
-        mNormals.resize(verticesCount);
-        mTangents.resize(verticesCount);
-        mTexCoords.resize(verticesCount);
+        mVertices.resize(verticesCount);
 
-        {
-            uint32_t faceOffset = 0;
-            uint32_t indexOffset = 0;
-            for(uint32_t k = 0; k < scene->mNumMeshes; ++k) {
-                const auto mesh = scene->mMeshes[k];
-                for(uint32_t idx = 0; idx < mesh->mNumFaces; ++idx)
-                    mIndices[faceOffset + idx] = indexOffset + *reinterpret_cast<glm::uvec3*>(mesh->mFaces[idx].mIndices);
+        uint32_t faceOffset = 0;
+        uint32_t indexOffset = 0;
+        for(uint32_t k = 0; k < scene->mNumMeshes; ++k) {
+            const auto mesh = scene->mMeshes[k];
+            for(uint32_t idx = 0; idx < mesh->mNumFaces; ++idx)
+                mIndices[faceOffset + idx] = indexOffset + *reinterpret_cast<glm::uvec3*>(mesh->mFaces[idx].mIndices);
+
+            memcpy(mPositions.data() + indexOffset, mesh->mVertices, mesh->mNumVertices * sizeof(aiVector3D));
 
-                memcpy(mNormals.data() + indexOffset, mesh->mNormals, mesh->mNumVertices * sizeof(aiVector3D));
+            constexpr glm::vec3 refA{ 1.0, 0.0, 0.0 };
+            constexpr glm::vec3 refB{ 0.0, 1.0, 0.0 };
+            for(uint32_t idx = 0; idx < mesh->mNumVertices; ++idx) {
+                auto& vertex = mVertices[indexOffset + idx];
+                const auto normal = *reinterpret_cast<const glm::vec3*>(mesh->mNormals + idx);
+                vertex.normal = Normal<FrameOfReference::Object>::fromRaw(normal);
 
                 if(mesh->HasTangentsAndBitangents()) {
-                    memcpy(mTangents.data() + indexOffset, mesh->mTangents, mesh->mNumVertices * sizeof(aiVector3D));
+                    const auto tangent = *reinterpret_cast<const glm::vec3*>(mesh->mTangents + idx);
+                    vertex.tangent = Direction<FrameOfReference::Object>::fromRaw(tangent);
                 } else {
-                    constexpr glm::vec3 refA{ 1.0, 0.0, 0.0 };
-                    constexpr glm::vec3 refB{ 0.0, 1.0, 0.0 };
-                    for(uint32_t idx = 0; idx < mesh->mNumVertices; ++idx) {
-                        const auto normal = mNormals[indexOffset + idx].raw();
-                        const auto dotA = std::fabs(glm::dot(refA, normal));
-                        const auto dotB = std::fabs(glm::dot(refB, normal));
-                        const auto ref = dotA < dotB ? refA : refB;
-                        mTangents[indexOffset + idx] = Direction<FrameOfReference::Object>::fromRaw(glm::cross(normal, ref));
-                    }
+                    const auto dotA = std::fabs(glm::dot(refA, normal));
+                    const auto dotB = std::fabs(glm::dot(refB, normal));
+                    const auto ref = dotA < dotB ? refA : refB;
+                    vertex.tangent = Direction<FrameOfReference::Object>::fromRaw(glm::cross(normal, ref));
                 }
 
                 if(mesh->HasTextureCoords(0)) {
-                    for(uint32_t idx = 0; idx < mesh->mNumVertices; ++idx) {
-                        const auto texCoord = mesh->mTextureCoords[0][idx];
-                        mTexCoords[indexOffset + idx] = { texCoord.x, texCoord.y };
-                    }
+                    const auto texCoord = mesh->mTextureCoords[0][idx];
+                    vertex.texCoord = { texCoord.x, texCoord.y };
+                }
+            }
+
+            indexOffset += mesh->mNumVertices;
+            faceOffset += mesh->mNumFaces;
+        }
+
+        mAttributes.positions = { mPositions.data(), verticesCount };
+        mAttributes.indices = mIndices;
+        mAttributes.vertices = mVertices;
+    }
+
+public:
+    MeshData(std::string key, const std::string_view path, const BuildSettings& settings, const bool compressAttributes)
+        : mKey{ std::move(key) } {
+        // the post-processed mesh is stored in the native format, so Assimp is only involved in the first run
+        const auto& cacheDirectory = RenderGlobalSetting::get().meshCacheDirectory;
+        if(cacheDirectory.empty())
+            import(path);
+        else {
+            const auto sourceHash = hashFile(path);
+            const auto cachePath = cacheDirectory / fmt::format("{}-{:016x}.pmesh", fs::path{ path }.stem().string(), sourceHash);
+            if(!mapNativeMesh(cachePath, sourceHash)) {
+                import(path);
+                saveNativeMesh(cachePath, sourceHash);
+
+                // page the attributes from the new native mesh instead of keeping them resident
+                if(ResidencyManager::get().enabled() && !compressAttributes && mapNativeMesh(cachePath, sourceHash)) {
+                    mPositions = decltype(mPositions){ trackedAllocator(MemoryTag::Geometry) };
+                    mIndices = decltype(mIndices){ trackedAllocator(MemoryTag::Geometry) };
+                    mVertices = decltype(mVertices){ trackedAllocator(MemoryTag::Geometry) };
                 }
+            }
+        }
+
+        if(mMappedFile && ResidencyManager::get().enabled() && !compressAttributes) {
+            // out-of-core mode: only the positions and the indices used by the BVH stay resident
+            const auto& [positions, indices, vertices, compressedVertices] = mAttributes;
+            mPositions.assign(positions.data(), positions.data() + positions.size() + 1);
+            mIndices.assign(indices.begin(), indices.end());
+            mAttributes.positions = { mPositions.data(), positions.size() };
+            mAttributes.indices = mIndices;
+            mResidencyBlock = ResidencyManager::get().registerRegion(std::as_bytes(vertices));
+        } else if(ResidencyManager::get().enabled() && !compressAttributes)
+            warning(fmt::format("Mesh {} is kept resident because it is not backed by the mesh cache", path));
+
+        if(compressAttributes) {
+            static_assert(sizeof(CompressedVertexAttributes) == 3 * sizeof(uint32_t));
 
-                indexOffset += mesh->mNumVertices;
-                faceOffset += mesh->mNumFaces;
+            mCompressedVertices.resize(mAttributes.vertices.size());
+            for(size_t idx = 0; idx < mCompressedVertices.size(); ++idx) {
+                const auto& vertex = mAttributes.vertices[idx];
+                mCompressedVertices[idx] = { encodeOctahedral(vertex.normal.raw()), encodeOctahedral(vertex.tangent.raw()),
+                                             glm::packHalf2x16(vertex.texCoord) };
             }
+            mAttributes.compressedVertices = mCompressedVertices;
+            mAttributes.vertices = {};
+            // release the full-precision attributes
+            mVertices = decltype(mVertices){ trackedAllocator(MemoryTag::Geometry) };
+        }
+
+        mGeometry = RenderGlobalSetting::get().accelerationBuilder->buildFromTriangleMesh(mAttributes.positions, mAttributes.indices,
+                                                                                          settings);
+    }
+
+    ~MeshData() override;
+
+    [[nodiscard]] const MeshAttributes& attributes() const noexcept {
+        return mAttributes;
+    }
+
+    [[nodiscard]] VertexAttributes vertex(const uint32_t idx) const noexcept {
+        if(mAttributes.compressedVertices.empty()) {
+            if(mResidencyBlock)
+                ResidencyManager::get().touch(*mResidencyBlock +
+                                              static_cast<uint32_t>(idx * sizeof(VertexAttributes) / ResidencyManager::blockSize));
+            return mAttributes.vertices[idx];
         }
 
+        const auto& [normal, tangent, texCoord] = mAttributes.compressedVertices[idx];
+        return { Normal<FrameOfReference::Object>::fromRaw(decodeOctahedral(normal)),
+                 Direction<FrameOfReference::Object>::fromRaw(decodeOctahedral(tangent)), glm::unpackHalf2x16(texCoord) };
+    }
+
+    [[nodiscard]] const Ref<BottomLevelGeometry>& geometry() const noexcept {
+        return mGeometry;
+    }
+
+    static Ref<MeshData> load(std::string_view path, const BuildSettings& settings, bool compressAttributes);
+};
+
+class MeshCache final {
+    std::mutex mMutex;
+    std::unordered_map<std::string, MeshData*> mMeshes;
+
+    friend class MeshData;
+
+public:
+    static MeshCache& get() {
+        static MeshCache inst;
+        return inst;
+    }
+};
+
+MeshData::~MeshData() {
+    if(mResidencyBlock)
+        ResidencyManager::get().unregisterRegion(*mResidencyBlock, std::as_bytes(mAttributes.vertices));
+
+    auto& cache = MeshCache::get();
+    std::lock_guard guard{ cache.mMutex };
+    if(const auto iter = cache.mMeshes.find(mKey); iter != cache.mMeshes.end() && iter->second == this)
+        cache.mMeshes.erase(iter);
+}
+
+Ref<MeshData> MeshData::load(const std::string_view path, const BuildSettings& settings, const bool compressAttributes) {
+    // the same mesh built with different settings cannot be shared
+    auto key = fmt::format("{}#{}{}", path, settings.key(), compressAttributes ? "#Compressed" : "");
+    auto& cache = MeshCache::get();
+    {
+        std::lock_guard guard{ cache.mMutex };
+        if(const auto iter = cache.mMeshes.find(key); iter != cache.mMeshes.end())
+            if(auto mesh = Ref<MeshData>::tryAcquire(iter->second))
+                return mesh;
+    }
+
+    // loading is done outside the lock, the first one wins if the same mesh is loaded concurrently
+    auto mesh = makeRefCount<MeshData>(key, path, settings, compressAttributes);
+    std::lock_guard guard{ cache.mMutex };
+    if(const auto [iter, inserted] = cache.mMeshes.emplace(std::move(key), mesh.get()); !inserted) {
+        if(auto winner = Ref<MeshData>::tryAcquire(iter->second))
+            return winner;
+        // the dying entry is only erased by its destructor if it is still the cached one
+        iter->second = mesh.get();
+    }
+    return mesh;
+}
+
+// the edge length of the right isosceles triangle with the average area
+static Float typicalEdgeLength(const MeshAttributes& attributes) noexcept {
+    const auto& [positions, indices, vertices, compressedVertices] = attributes;
+    double area = 0.0;
+    for(const auto& index : indices)
+        area += glm::length(glm::cross(positions[index.y] - positions[index.x], positions[index.z] - positions[index.x]));
+    return indices.empty() ? 0.0f : static_cast<Float>(std::sqrt(area / static_cast<double>(indices.size())));
+}
+
+class TriangleMesh final : public Shape {
+    Ref<MeshData> mMesh;
+    Ref<PrimitiveGroup> mPrimitiveGroup;
+    Ref<MaterialBase> mSurface;
+    Ref<LightBase> mAreaLight;
+    Ref<MediumBase> mInterior;
+    Ref<ScalarTexture2D> mOpacity;
+    // the simplified versions of the mesh sorted from the finest to the coarsest, which are generated offline
+    std::pmr::vector<Ref<TriangleMesh>> mCoarserLevels{ context().globalAllocator };
+
+    [[nodiscard]] TexCoord interpolateTexCoord(const uint32_t primitiveIndex, const glm::vec2 barycentric) const noexcept {
+        const auto index = mMesh->attributes().indices[primitiveIndex];
+        // Please refer to https://github.com/embree/embree/blob/master/doc/src/api/RTC_GEOMETRY_TYPE_TRIANGLE.md
+        return mMesh->vertex(index.x).texCoord * (1.0f - barycentric.x - barycentric.y) + mMesh->vertex(index.y).texCoord * barycentric.x +
+            mMesh->vertex(index.z).texCoord * barycentric.y;
+    }
+
+public:
+    explicit TriangleMesh(const Ref<ConfigNode>& node) {
         const auto& builder = RenderGlobalSetting::get().accelerationBuilder;
-        mPrimitiveGroup = builder->buildFromTriangleMesh(
-            verticesCount, trianglesCount,
-            [&](void* verticesBuffer, void* indicesBuffer) {
-                uint32_t indexOffset = 0;
-                for(uint32_t k = 0; k < scene->mNumMeshes; ++k) {
-                    const auto mesh = scene->mMeshes[k];
-                    memcpy(static_cast<aiVector3D*>(verticesBuffer) + indexOffset, mesh->mVertices,
-                           mesh->mNumVertices * sizeof(aiVector3D));
-                    indexOffset += mesh->mNumVertices;
-                }
+        auto settings = builder->shapeSettings();
+        if(const auto ptr = node->tryGet("Acceleration"sv))
+            settings = parseBuildSettings((*ptr)->as<Ref<ConfigNode>>(), settings);
+
+        // trade some shading precision for a smaller footprint on huge scenes
+        auto compressAttributes = false;
+        if(const auto ptr = node->tryGet("CompressAttributes"sv))
+            compressAttributes = (*ptr)->as<bool>();
+
+        mMesh = MeshData::load(node->get("Path"sv)->as<std::string_view>(), settings, compressAttributes);
+
+        if(const auto ptr = node->tryGet("Interior"sv))
+            mInterior = makeVariant<MediumBase, Medium>((*ptr)->as<Ref<ConfigNode>>());
+        // a shape without a surface is an index-matched boundary of its medium, the rays pass through it
+        if(const auto ptr = node->tryGet("Surface"sv))
+            mSurface = makeVariant<MaterialBase, Material>((*ptr)->as<Ref<ConfigNode>>());
+        else if(!mInterior)
+            fatal(fmt::format("Shape {} has neither a surface nor an interior medium", node->get("Path"sv)->as<std::string_view>()));
+
+        // the cutout mask of the alpha-textured cards (e.g., foliage)
+        if(node->tryGet("Opacity"sv)) {
+            mOpacity = getScalarTexture2D(node, "Opacity"sv, ""sv, 1.0f);
+            if(const auto constant = mOpacity->constantValue(); constant && *constant >= 1.0f)
+                mOpacity = Ref<ScalarTexture2D>{};
+        }
+
+        if(const auto ptr = node->tryGet("Emission"sv)) {
+            mAreaLight = makeVariant<LightBase, Light>((*ptr)->as<Ref<ConfigNode>>());
+            mAreaLight->attachShape(*this);
+        }
 
-                memcpy(indicesBuffer, mIndices.data(), mIndices.size() * sizeof(glm::uvec3));
-            },
-            *this);
+        // each triangle mesh only owns an instance of the shared geometry, the levels of detail are selected per ray
+        if(const auto ptr = node->tryGet("Levels"sv)) {
+            for(auto& item : (*ptr)->as<ConfigAttr::AttrArray>())
+                mCoarserLevels.push_back(
+                    makeRefCount<TriangleMesh>(*this, MeshData::load(item->as<std::string_view>(), settings, compressAttributes)));
 
-        mSurface = makeVariant<MaterialBase, Material>(node->get("Surface"sv)->as<Ref<ConfigNode>>());
+            // the coarser levels are used if their edges are shorter than the footprints of the rays times the scale
+            Float detailScale = 1.0f;
+            if(const auto scale = node->tryGet("DetailScale"sv))
+                detailScale = (*scale)->as<Float>();
+
+            std::pmr::vector<DetailLevel> levels{ context().scopedAllocator };
+            levels.push_back({ mMesh->geometry(), this, typicalEdgeLength(mMesh->attributes()) });
+            for(const auto& level : mCoarserLevels)
+                levels.push_back({ level->mMesh->geometry(), level.get(), typicalEdgeLength(level->mMesh->attributes()) });
+            mPrimitiveGroup = builder->buildLODInstance(levels, detailScale);
+        } else
+            mPrimitiveGroup = builder->buildInstance(mMesh->geometry(), *this);
     }
 
+    // a coarser level of the finest mesh, which only resolves its own hits
+    // NOTICE: the area light only samples the finest level
+    TriangleMesh(const TriangleMesh& finest, Ref<MeshData> mesh)
+        : mMesh{ std::move(mesh) }, mSurface{ finest.mSurface }, mAreaLight{ finest.mAreaLight }, mInterior{ finest.mInterior },
+          mOpacity{ finest.mOpacity } {}
+
     void updateTransform(const KeyFrames& keyFrames, const TimeInterval timeInterval) override {
         mPrimitiveGroup->updateTransform(
             generateTransform(keyFrames, timeInterval, RenderGlobalSetting::get().accelerationBuilder->maxStepCount()));
         mPrimitiveGroup->commit();
     }
 
+    [[nodiscard]] LightBase* areaLight() const noexcept override {
+        return mAreaLight.get();
+    }
+
+    [[nodiscard]] uint32_t triangleCount() const noexcept override {
+        return static_cast<uint32_t>(mMesh->attributes().indices.size());
+    }
+
+    [[nodiscard]] ShapeTriangle triangle(const uint32_t idx) const noexcept override {
+        const auto index = mMesh->attributes().indices[idx];
+        const auto& positions = mMesh->attributes().positions;
+        const auto vu = mMesh->vertex(index.x);
+        const auto vv = mMesh->vertex(index.y);
+        const auto vw = mMesh->vertex(index.z);
+        return { { positions[index.x], positions[index.y], positions[index.z] },
+                 { vu.normal.raw(), vv.normal.raw(), vw.normal.raw() },
+                 { vu.texCoord, vv.texCoord, vw.texCoord } };
+    }
+
+    [[nodiscard]] bool masked() const noexcept override {
+        return mOpacity.get() != nullptr;
+    }
+
+    [[nodiscard]] Float opacity(const uint32_t primitiveIndex, const glm::vec2 barycentric, const Float t) const noexcept override {
+        const auto texCoord = interpolateTexCoord(primitiveIndex, barycentric);
+        return mOpacity->evaluate(TextureEvaluateInfo{ texCoord, t, primitiveIndex, 0.0f, barycentric });
+    }
+
     PrimitiveGroup* primitiveGroup() const noexcept override {
         return mPrimitiveGroup.get();
     }
@@ -137,24 +498,38 @@ public:
                                       const AffineTransform<FrameOfReference::Object, FrameOfReference::World>& transform,
                                       const Normal<FrameOfReference::World>& geometryNormal, const glm::vec2 barycentric,
                                       const uint32_t primitiveIndex) const noexcept override {
-        const auto index = mIndices[primitiveIndex];
-        const auto iu = index.x, iv = index.y, iw = index.z;
+        const auto index = mMesh->attributes().indices[primitiveIndex];
+        const auto vu = mMesh->vertex(index.x);
+        const auto vv = mMesh->vertex(index.y);
+        const auto vw = mMesh->vertex(index.z);
         // Please refer to https://github.com/embree/embree/blob/master/doc/src/api/RTC_GEOMETRY_TYPE_TRIANGLE.md
         const auto wu = 1.0f - barycentric.x - barycentric.y, wv = barycentric.x, ww = barycentric.y;
         const auto lerp3 = [&](auto u, auto v, auto w) { return u * wu + v * wv + w * ww; };
 
-        const auto texCoord = lerp3(mTexCoords[iu], mTexCoords[iv], mTexCoords[iw]);
-        const auto normalizedTexCoord = texCoord - glm::floor(texCoord);  // TODO: reduce normalization?
+        const auto texCoord = lerp3(vu.texCoord, vv.texCoord, vw.texCoord);
 
         const auto lerpNormal = transform(
-            Normal<FrameOfReference::Object>::fromRaw(glm::normalize(lerp3(mNormals[iu].raw(), mNormals[iv].raw(), mNormals[iw].raw()))));
+            Normal<FrameOfReference::Object>::fromRaw(glm::normalize(lerp3(vu.normal.raw(), vv.normal.raw(), vw.normal.raw()))));
         const auto lerpTangent = transform(Direction<FrameOfReference::Object>::fromRaw(
-            glm::normalize(lerp3(mTangents[iu].raw(), mTangents[iv].raw(), mTangents[iw].raw()))));
+            glm::normalize(lerp3(vu.tangent.raw(), vv.tangent.raw(), vw.tangent.raw()))));
+
+        // Please refer to "Texture Level of Detail Strategies for Real-Time Ray Tracing" (Akenine-Moller et al. 2019)
+        const auto& positions = mMesh->attributes().positions;
+        const auto e1 = transform(Vector<FrameOfReference::Object>::fromRaw(positions[index.y] - positions[index.x])).raw();
+        const auto e2 = transform(Vector<FrameOfReference::Object>::fromRaw(positions[index.z] - positions[index.x])).raw();
+        const auto worldArea = glm::length(glm::cross(e1, e2));
+        const auto duv1 = vv.texCoord - vu.texCoord, duv2 = vw.texCoord - vu.texCoord;
+        const auto texCoordArea = std::abs(duv1.x * duv2.y - duv1.y * duv2.x);
+        const auto coneWidth = ray.coneWidth + ray.coneSpread * hitDistance.raw();
+        // the footprint is stretched at grazing angles
+        const auto texCoordFootprint = worldArea > 0.0f ?
+            coneWidth * std::sqrt(texCoordArea / worldArea) / std::fmax(absDot(geometryNormal, ray.direction), 0.1f) :
+            0.0f;
 
         return SurfaceHit{ ray.origin + ray.direction * hitDistance, hitDistance, geometryNormal, lerpNormal, lerpTangent, primitiveIndex,
-                           normalizedTexCoord, ray.t,
+                           barycentric, texCoord, ray.t, coneWidth, texCoordFootprint,
                            // transform.inverse(),
-                           Handle<Material>{ mSurface.get() } };
+                           Handle<Material>{ mSurface.get() }, Handle<Light>{ mAreaLight.get() }, Handle<Medium>{ mInterior.get() } };
     }
 };
 
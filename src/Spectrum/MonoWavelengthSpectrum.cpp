@@ -34,11 +34,4 @@ RGBSpectrum toRGB(const MonoWavelengthSpectrum& x, const MonoWavelengthSpectrum&
     return RGBSpectrum::fromRaw(glm::max(RGBSpectrum::matXYZ2RGB * xyz, glm::zero<glm::vec3>()));
 }
 
-Float temperatureToSpectrum(Float temperature, Float sampledWavelength) noexcept;
-
-MonoWavelengthSpectrum temperatureToSpectrum(const Float temperature, const MonoWavelengthSpectrum sampledWavelength) noexcept {
-    const auto value = temperatureToSpectrum(temperature, sampledWavelength.raw());
-    return MonoWavelengthSpectrum::fromScalar(value);
-}
-
 PIPER_NAMESPACE_END
@@ -24,12 +24,18 @@
 
 #include <Piper/Core/Report.hpp>
 #include <Piper/Render/Spectrum.hpp>
+#include <array>
 #include <fstream>
+#include <glm/gtc/packing.hpp>
 
 PIPER_NAMESPACE_BEGIN
 
 constexpr uint32_t numberOfCoefficients = 3;
 
+// The table starts with "SPEC" (float coefficients) or "SPEH" (half-precision coefficients), followed by the resolution, the
+// float scale table and the coefficients.
+constexpr size_t rgb2SpecHeaderSize = 4 + sizeof(uint32_t);
+
 struct RGB2SpecTable final {
     uint32_t res = 0;
     std::pmr::vector<Float> scale;
@@ -39,31 +45,18 @@ struct RGB2SpecTable final {
         return fs::current_path() / "rgb2spec.data";
     }
 
-    void load() {
-        std::ifstream in{ path(), std::ios::in | std::ios::binary };
-        if(!in)
-            fatal("Failed to load rgb2spec table");
-
-        if(char header[4]; !in.read(header, 4) || memcmp(header, "SPEC", 4) != 0)
-            fatal("Invalid rgb2spec table");
-
-        if(!in.read(reinterpret_cast<char*>(&res), sizeof(uint32_t)))
-            fatal("Invalid rgb2spec table");
-
-        scale.resize(res);
-        data.resize(3ULL * res * res * res * numberOfCoefficients);
-
-        if(!in.read(reinterpret_cast<char*>(scale.data()), static_cast<std::streamsize>(scale.size() * sizeof(Float))) ||
-           !in.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size() * sizeof(Float))))
-            fatal("Invalid rgb2spec table");
-    }
-
-    void save() const {
+    // the half-precision table halves the mapped size at the cost of about 3 significant digits of the coefficients
+    void save(const bool half) const {
         std::ofstream out{ path(), std::ios::out | std::ios::binary };
-        out.write("SPEC", 4);
+        out.write(half ? "SPEH" : "SPEC", 4);
         out.write(reinterpret_cast<const char*>(&res), sizeof(uint32_t));
         out.write(reinterpret_cast<const char*>(scale.data()), static_cast<std::streamsize>(scale.size() * sizeof(Float)));
-        out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size() * sizeof(Float)));
+        if(half) {
+            std::pmr::vector<uint16_t> packed(data.size());
+            std::transform(data.cbegin(), data.cend(), packed.begin(), [](const Float x) { return glm::packHalf1x16(x); });
+            out.write(reinterpret_cast<const char*>(packed.data()), static_cast<std::streamsize>(packed.size() * sizeof(uint16_t)));
+        } else
+            out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size() * sizeof(Float)));
         out.flush();
         if(!out)
             throw std::runtime_error{ "Failed to save rgb2spec table" };
@@ -73,20 +66,49 @@ struct RGB2SpecTable final {
 PIPER_NAMESPACE_END
 
 #ifndef PIPER_RGB2SPEC_OPT_STANDALONE
+#include <Piper/Core/FileIO.hpp>
+
 PIPER_NAMESPACE_BEGIN
 namespace Impl {
 
-    struct RGB2SpecTableLoader final {
-        RGB2SpecTable table;
-
-        RGB2SpecTableLoader() {
-            table.load();
+    // The table is mapped instead of read, so that all processes on the same host share the physical pages of the page cache.
+    struct RGB2SpecTableView final {
+        std::unique_ptr<MappedFile> file;
+        uint32_t res = 0;
+        const Float* scale = nullptr;
+        const Float* data = nullptr;
+        const uint16_t* halfData = nullptr;
+
+        RGB2SpecTableView() {
+            const auto path = RGB2SpecTable::path();
+            if(!fs::exists(path))
+                fatal("Failed to load rgb2spec table");
+            file = std::make_unique<MappedFile>(path);
+
+            const auto bytes = file->data();
+            if(bytes.size() < rgb2SpecHeaderSize)
+                fatal("Invalid rgb2spec table");
+            const auto half = memcmp(bytes.data(), "SPEH", 4) == 0;
+            if(!half && memcmp(bytes.data(), "SPEC", 4) != 0)
+                fatal("Invalid rgb2spec table");
+            memcpy(&res, bytes.data() + 4, sizeof(uint32_t));
+
+            const auto count = 3ULL * res * res * res * numberOfCoefficients;
+            const auto dataOffset = rgb2SpecHeaderSize + res * sizeof(Float);
+            if(res < 2 || bytes.size() < dataOffset + count * (half ? sizeof(uint16_t) : sizeof(Float)))
+                fatal("Invalid rgb2spec table");
+
+            scale = reinterpret_cast<const Float*>(bytes.data() + rgb2SpecHeaderSize);
+            if(half)
+                halfData = reinterpret_cast<const uint16_t*>(bytes.data() + dataOffset);
+            else
+                data = reinterpret_cast<const Float*>(bytes.data() + dataOffset);
         }
     };
 
-    static const RGB2SpecTable& getRGB2SpecTable() {
-        static RGB2SpecTableLoader inst;
-        return inst.table;
+    static const RGB2SpecTableView& getRGB2SpecTable() {
+        static RGB2SpecTableView inst;
+        return inst;
     }
 
     static uint32_t rgb2SpecFindInterval(const float* values, const uint32_t len, const Float x) {
@@ -109,8 +131,35 @@ namespace Impl {
         return std::min(left, lastInterval);
     }
 
+    static Float unpackCoefficient(const Float x) noexcept {
+        return x;
+    }
+
+    static Float unpackCoefficient(const uint16_t x) noexcept {
+        return glm::unpackHalf1x16(x);
+    }
+
+    template <typename T>
+    static void rgb2SpecInterpolate(const T* data, uint32_t offset, const uint32_t res, const std::array<Float, 6>& weights,
+                                    Float out[numberOfCoefficients]) noexcept {
+        const auto dz = numberOfCoefficients * res * res;
+        const auto dy = numberOfCoefficients * res;
+        constexpr auto dx = numberOfCoefficients;
+        const auto [x0, x1, y0, y1, z0, z1] = weights;
+        const auto at = [&](const uint32_t idx) { return unpackCoefficient(data[idx]); };
+
+        for(uint32_t j = 0; j < numberOfCoefficients; ++j, ++offset) {
+            out[j] = ((at(offset) * x0 + at(offset + dx) * x1) * y0 + (at(offset + dy) * x0 + at(offset + dy + dx) * x1) * y1) * z0 +
+                ((at(offset + dz) * x0 + at(offset + dz + dx) * x1) * y0 +
+                 (at(offset + dz + dy) * x0 + at(offset + dz + dy + dx) * x1) * y1) *
+                    z1;
+        }
+    }
+
     static void rgb2SpecFetch(glm::vec3 rgb, Float out[numberOfCoefficients]) noexcept {
-        const auto& [res, scaleLUT, data] = getRGB2SpecTable();
+        const auto& table = getRGB2SpecTable();
+        const auto res = table.res;
+        const auto scaleLUT = table.scale;
         /* Determine largest RGB component */
         rgb = glm::clamp(rgb, glm::vec3{ 0.0f }, glm::vec3{ 1.0f });
 
@@ -126,27 +175,19 @@ namespace Impl {
 
         const auto xi = std::min(static_cast<uint32_t>(x), res - 2);
         const auto yi = std::min(static_cast<uint32_t>(y), res - 2);
-        const auto zi = rgb2SpecFindInterval(scaleLUT.data(), res, z);
+        const auto zi = rgb2SpecFindInterval(scaleLUT, res, z);
         /* Trilinearly interpolated lookup */
-        auto offset = (((maxComponent * res + zi) * res + yi) * res + xi) * numberOfCoefficients;
-        const auto dz = numberOfCoefficients * res * res;
-        const auto dy = numberOfCoefficients * res;
-        constexpr auto dx = numberOfCoefficients;
+        const auto offset = (((maxComponent * res + zi) * res + yi) * res + xi) * numberOfCoefficients;
 
         const auto x1 = x - static_cast<Float>(xi);
-        const auto x0 = 1.0f - x1;
         const auto y1 = y - static_cast<Float>(yi);
-        const auto y0 = 1.0f - y1;
         const auto z1 = (z - scaleLUT[zi]) / (scaleLUT[zi + 1] - scaleLUT[zi]);
-        const auto z0 = 1.0f - z1;
+        const std::array<Float, 6> weights{ 1.0f - x1, x1, 1.0f - y1, y1, 1.0f - z1, z1 };
 
-        for(uint32_t j = 0; j < numberOfCoefficients; ++j, ++offset) {
-            out[j] =
-                ((data[offset] * x0 + data[offset + dx] * x1) * y0 + (data[offset + dy] * x0 + data[offset + dy + dx] * x1) * y1) * z0 +
-                ((data[offset + dz] * x0 + data[offset + dz + dx] * x1) * y0 +
-                 (data[offset + dz + dy] * x0 + data[offset + dz + dy + dx] * x1) * y1) *
-                    z1;
-        }
+        if(table.halfData)
+            rgb2SpecInterpolate(table.halfData, offset, res, weights, out);
+        else
+            rgb2SpecInterpolate(table.data, offset, res, weights, out);
     }
 
     static Float rgb2SpecEval(const Float coeff[numberOfCoefficients], const Float lambda) {
@@ -168,18 +209,52 @@ namespace Impl {
         return MonoWavelengthSpectrum::fromRaw(rgb2SpecEval(coefficients, w.raw()));
     }
 
-    SampledSpectrum fromRGB(const RGBSpectrum& u, const SampledSpectrum& w) noexcept {
+    template <int32_t N>
+    SampledSpectrumN<N> fromRGB(const RGBSpectrum& u, const SampledSpectrumN<N>& w) noexcept {
         Float coefficients[numberOfCoefficients];
         rgb2SpecFetch(u.raw(), coefficients);
 
-        const auto lambdas = w.raw();
-        SampledSpectrum::VecType res;
+        const auto& lambdas = w.raw();
+        typename SampledSpectrumN<N>::VecType res;
 
-        for(int32_t idx = 0; idx < SampledSpectrum::nSamples; ++idx)
+        for(int32_t idx = 0; idx < N; ++idx)
             res[idx] = rgb2SpecEval(coefficients, lambdas[idx]);
 
-        return SampledSpectrum::fromRaw(res);
+        return SampledSpectrumN<N>::fromRaw(res);
+    }
+
+    template SampledSpectrum fromRGB(const RGBSpectrum& u, const SampledSpectrum& w) noexcept;
+    template SampledSpectrum8 fromRGB(const RGBSpectrum& u, const SampledSpectrum8& w) noexcept;
+    template SampledSpectrum16 fromRGB(const RGBSpectrum& u, const SampledSpectrum16& w) noexcept;
+
+    glm::vec3 toSpectrumCoefficients(const RGBSpectrum& u) noexcept {
+        glm::vec3 coefficients;
+        rgb2SpecFetch(u.raw(), &coefficients.x);
+        return coefficients;
+    }
+
+    Float fromSpectrumCoefficients(const glm::vec3& coefficients, const Float wavelength) noexcept {
+        return rgb2SpecEval(&coefficients.x, wavelength);
+    }
+
+    MonoWavelengthSpectrum fromSpectrumCoefficients(const glm::vec3& coefficients, const MonoWavelengthSpectrum& w) noexcept {
+        return MonoWavelengthSpectrum::fromRaw(rgb2SpecEval(&coefficients.x, w.raw()));
+    }
+
+    template <int32_t N>
+    SampledSpectrumN<N> fromSpectrumCoefficients(const glm::vec3& coefficients, const SampledSpectrumN<N>& w) noexcept {
+        const auto& lambdas = w.raw();
+        typename SampledSpectrumN<N>::VecType res;
+
+        for(int32_t idx = 0; idx < N; ++idx)
+            res[idx] = rgb2SpecEval(&coefficients.x, lambdas[idx]);
+
+        return SampledSpectrumN<N>::fromRaw(res);
     }
+
+    template SampledSpectrum fromSpectrumCoefficients(const glm::vec3& coefficients, const SampledSpectrum& w) noexcept;
+    template SampledSpectrum8 fromSpectrumCoefficients(const glm::vec3& coefficients, const SampledSpectrum8& w) noexcept;
+    template SampledSpectrum16 fromSpectrumCoefficients(const glm::vec3& coefficients, const SampledSpectrum16& w) noexcept;
 }  // namespace Impl
 PIPER_NAMESPACE_END
 #else
@@ -326,48 +401,57 @@ static void evalCIELab(double* p) noexcept {
     p[2] = 200.0 * (f(y / yw) - f(z / zw));
 }
 
-static void evalResidual(const double* coeffs, const double* rgb, double* residual) noexcept {
-    double out[3] = { 0.0, 0.0, 0.0 };
+// The residuals of several coefficient sets are evaluated in one pass over the spectrum, so that the inner loop over the sets is
+// vectorized and the curves are only loaded once.
+template <uint32_t Count>
+static void evalResiduals(const double (&coeffs)[Count][3], const double* rgb, double (&residual)[Count][3]) noexcept {
+    double out[Count][3] = {};
 
     for(uint32_t i = 0; i < spectralLUTSize; ++i) {
         /* Scale lambda to 0..1 range */
         const auto lambda = i / static_cast<double>(wavelengthMax - wavelengthMin);
+        const double curve[3] = { rgbTable[0][i], rgbTable[1][i], rgbTable[2][i] };
 
-        /* Polynomial */
-        double x = 0.0;
-        for(uint32_t i = 0; i < 3; ++i)
-            x = std::fma(x, lambda, coeffs[i]);
+        for(uint32_t c = 0; c < Count; ++c) {
+            /* Polynomial */
+            const auto x = std::fma(std::fma(coeffs[c][0], lambda, coeffs[c][1]), lambda, coeffs[c][2]);
 
-        /* Sigmoid */
-        const auto s = sigmoid(x);
+            /* Sigmoid */
+            const auto s = sigmoid(x);
 
-        /* Integrate against precomputed curves */
-        for(uint32_t j = 0; j < 3; ++j)
-            out[j] += rgbTable[j][i] * s;
+            /* Integrate against precomputed curves */
+            for(uint32_t j = 0; j < 3; ++j)
+                out[c][j] += curve[j] * s;
+        }
     }
-    evalCIELab(out);
-    memcpy(residual, rgb, sizeof(double) * 3);
-    evalCIELab(residual);
 
-    for(uint32_t j = 0; j < 3; ++j)
-        residual[j] -= out[j];
-}
+    double target[3];
+    memcpy(target, rgb, sizeof(double) * 3);
+    evalCIELab(target);
 
-static void evalJacobian(const double* coeffs, const double* rgb, double** jac) noexcept {
-    double r0[3], r1[3], tmp[3];
+    for(uint32_t c = 0; c < Count; ++c) {
+        evalCIELab(out[c]);
+        for(uint32_t j = 0; j < 3; ++j)
+            residual[c][j] = target[j] - out[c][j];
+    }
+}
 
+// the residual and the central differences of the Jacobian share one pass
+static void evalResidualAndJacobian(const double* coeffs, const double* rgb, double* residual, double** jac) noexcept {
+    double sets[7][3], residuals[7][3];
+    for(uint32_t i = 0; i < 7; ++i)
+        memcpy(sets[i], coeffs, sizeof(double) * 3);
     for(uint32_t i = 0; i < 3; ++i) {
-        memcpy(tmp, coeffs, sizeof(double) * 3);
-        tmp[i] -= optEpslion;
-        evalResidual(tmp, rgb, r0);
+        sets[2 * i + 1][i] -= optEpslion;
+        sets[2 * i + 2][i] += optEpslion;
+    }
 
-        memcpy(tmp, coeffs, sizeof(double) * 3);
-        tmp[i] += optEpslion;
-        evalResidual(tmp, rgb, r1);
+    evalResiduals(sets, rgb, residuals);
 
+    memcpy(residual, residuals[0], sizeof(double) * 3);
+    for(uint32_t i = 0; i < 3; ++i)
         for(uint32_t j = 0; j < 3; ++j)
-            jac[j][i] = (r1[j] - r0[j]) / (2.0 * optEpslion);
-    }
+            jac[j][i] = (residuals[2 * i + 2][j] - residuals[2 * i + 1][j]) / (2.0 * optEpslion);
 }
 
 static double gaussNewton(const double rgb[3], double coeffs[3], uint32_t iteration) {
@@ -375,8 +459,7 @@ static double gaussNewton(const double rgb[3], double coeffs[3], uint32_t iterat
     for(uint32_t i = 0; i < iteration; ++i) {
         double J0[3], J1[3], J2[3], *J[3] = { J0, J1, J2 }, residual[3];
 
-        evalResidual(coeffs, rgb, residual);
-        evalJacobian(coeffs, rgb, J);
+        evalResidualAndJacobian(coeffs, rgb, residual, J);
 
         uint32_t P[4];
         uint32_t rv = evalLUPDecompose(J, 3, 1e-15, P);
@@ -409,9 +492,10 @@ static double gaussNewton(const double rgb[3], double coeffs[3], uint32_t iterat
 
 int main(int argc, char** argv) {
     if(argc < 2) {
-        std::cerr << "Usage:  PiperRGB2SpecOpt <resolution>" << std::endl;
+        std::cerr << "Usage:  PiperRGB2SpecOpt <resolution> [--half]" << std::endl;
         return EXIT_FAILURE;
     }
+    const auto half = argc > 2 && std::string_view{ argv[2] } == "--half";
 
     RGB2SpecTable table;
     auto& [res, scale, data] = table;
@@ -421,7 +505,8 @@ int main(int argc, char** argv) {
 
     const std::string_view resStr{ argv[1] };
     std::from_chars(resStr.data(), resStr.data() + resStr.size(), res);
-    if(res == 0 || res > 256) {
+    // NOTICE: the offsets of the table are 32-bit
+    if(res < 2 || res > 512) {
         std::cerr << "Invalid resolution!" << std::endl;
         return EXIT_FAILURE;
     }
@@ -435,49 +520,49 @@ int main(int argc, char** argv) {
     data.resize(3ULL * res * res * res * numberOfCoefficients);
     errors.resize(3ULL * res * res * res);
 
-    for(uint32_t t = 0; t < 3; ++t) {
-        tbb::parallel_for(tbb::blocked_range<uint32_t>(0, res), [&](const tbb::blocked_range<uint32_t>& r) {
-            for(size_t j = r.begin(); j != r.end(); ++j) {
-                const auto y = j / static_cast<double>(res - 1);
-                std::cout << "." << std::flush;
+    // the rows of all three slices are optimized in parallel, each row is a sequence of warm-started solves
+    tbb::parallel_for(tbb::blocked_range<uint32_t>(0, 3 * res), [&](const tbb::blocked_range<uint32_t>& r) {
+        for(auto row = r.begin(); row != r.end(); ++row) {
+            const auto t = row / res, j = row % res;
+            const auto y = j / static_cast<double>(res - 1);
+            std::cout << "." << std::flush;
 
-                for(uint32_t i = 0; i < res; ++i) {
-                    const double x = i / static_cast<double>(res - 1);
-                    double coeffs[3], rgb[3];
-                    memset(coeffs, 0, sizeof(double) * 3);
+            for(uint32_t i = 0; i < res; ++i) {
+                const double x = i / static_cast<double>(res - 1);
+                double coeffs[3], rgb[3];
+                memset(coeffs, 0, sizeof(double) * 3);
 
-                    const auto eval = [&](const uint32_t k) {
-                        const auto v = smoothstep(smoothstep(k / static_cast<double>(res - 1)));
-                        rgb[t] = v;
-                        rgb[(t + 1) % 3] = x * v;
-                        rgb[(t + 2) % 3] = y * v;
+                const auto eval = [&](const uint32_t k) {
+                    const auto v = smoothstep(smoothstep(k / static_cast<double>(res - 1)));
+                    rgb[t] = v;
+                    rgb[(t + 1) % 3] = x * v;
+                    rgb[(t + 2) % 3] = y * v;
 
-                        const auto error = gaussNewton(rgb, coeffs, 30);
+                    const auto error = gaussNewton(rgb, coeffs, 30);
 
-                        const auto c0 = static_cast<double>(wavelengthMin), c1 = 1.0 / static_cast<double>(wavelengthMax - wavelengthMin);
-                        const auto [a, b, c] = coeffs;
+                    const auto c0 = static_cast<double>(wavelengthMin), c1 = 1.0 / static_cast<double>(wavelengthMax - wavelengthMin);
+                    const auto [a, b, c] = coeffs;
 
-                        const auto idx = ((t * res + k) * res + j) * res + i;
+                    const auto idx = ((t * res + k) * res + j) * res + i;
 
-                        data[3 * idx + 0] = static_cast<Float>(a * sqr(c1));
-                        data[3 * idx + 1] = static_cast<Float>(b * c1 - 2.0 * a * c0 * sqr(c1));
-                        data[3 * idx + 2] = static_cast<Float>(c - b * c0 * c1 + a * sqr(c0 * c1));
-                        errors[idx] = error;
-                    };
+                    data[3 * idx + 0] = static_cast<Float>(a * sqr(c1));
+                    data[3 * idx + 1] = static_cast<Float>(b * c1 - 2.0 * a * c0 * sqr(c1));
+                    data[3 * idx + 2] = static_cast<Float>(c - b * c0 * c1 + a * sqr(c0 * c1));
+                    errors[idx] = error;
+                };
 
-                    const auto start = res / 5;
-                    for(uint32_t k = start; k < res; ++k)
-                        eval(k);
+                const auto start = res / 5;
+                for(uint32_t k = start; k < res; ++k)
+                    eval(k);
 
-                    memset(coeffs, 0, sizeof(double) * 3);
-                    for(int32_t k = start; k >= 0; --k)
-                        eval(k);
-                }
+                memset(coeffs, 0, sizeof(double) * 3);
+                for(int32_t k = start; k >= 0; --k)
+                    eval(k);
             }
-        });
-    }
+        }
+    });
 
-    table.save();
+    table.save(half);
 
     std::cout << " done." << std::endl;
     std::sort(errors.begin(), errors.end());
@@ -20,32 +20,64 @@
 
 #include <Piper/Render/ColorMatchingFunction.hpp>
 #include <Piper/Render/Spectrum.hpp>
+#include <algorithm>
+#include <array>
 
 PIPER_NAMESPACE_BEGIN
 
-template <size_t Samples, typename T, size_t... I>
-static constexpr Float expandLum(const T& x, const T& w, std::index_sequence<I...>) {
-    return ((static_cast<Float>(wavelength2Y(static_cast<double>(w[I]))) * x[I]) + ...) / static_cast<Float>(Samples);
-}
+// The linear RGB and Y responses on the 1nm grid, precombined with matXYZ2RGB and normalized by the integral of Y.
+// The float rows are gathered for all hero wavelengths at once instead of evaluating the double CMF tables per wavelength.
+static const auto cmfResponse = [] {
+    std::array<glm::vec4, spectralLUTSize> table;
+    const auto matXYZ2RGB = glm::dmat3{ RGBSpectrum::matXYZ2RGB };
+    for(int32_t idx = 0; idx < spectralLUTSize; ++idx) {
+        const auto xyz = glm::dvec3{ colorMatchingFunctionX[idx], colorMatchingFunctionY[idx], colorMatchingFunctionZ[idx] } / integralOfY;
+        table[idx] = glm::vec4{ glm::vec3{ matXYZ2RGB * xyz }, static_cast<Float>(xyz.y) };
+    }
+    return table;
+}();
+
+template <int32_t N>
+static glm::vec4 accumulateResponse(const SampledSpectrumN<N>& x, const SampledSpectrumN<N>& sampledWavelengths) noexcept {
+    const auto& lambda = sampledWavelengths.raw();
+    const auto& value = x.raw();
+
+    // the independent index computations are vectorized, then the rows are gathered
+    std::array<int32_t, N> indices;
+    std::array<Float, N> weights;
+    for(int32_t idx = 0; idx < N; ++idx) {
+        const auto offset = std::clamp(lambda[idx] - static_cast<Float>(wavelengthMin), 0.0f, static_cast<Float>(spectralLUTSize - 1));
+        indices[idx] = std::min(static_cast<int32_t>(offset), spectralLUTSize - 2);
+        weights[idx] = offset - static_cast<Float>(indices[idx]);
+    }
 
-Float luminance(const SampledSpectrum& x, const SampledSpectrum& sampledWavelengths) noexcept {
-    constexpr auto indices = std::make_index_sequence<SampledSpectrum::nSamples>{};
-    constexpr auto scale = static_cast<Float>(rcp(integralOfY));
-    return expandLum<SampledSpectrum::nSamples>(x.raw(), sampledWavelengths.raw(), indices) * scale;
+    auto res = glm::zero<glm::vec4>();
+    for(int32_t idx = 0; idx < N; ++idx) {
+        const auto row = indices[idx];
+        res += glm::mix(cmfResponse[row], cmfResponse[row + 1], weights[idx]) * value[idx];
+    }
+    return res / static_cast<Float>(N);
 }
 
-template <size_t Samples, typename T, size_t... I>
-static glm::vec3 expandXYZ(const T& x, const T& w, std::index_sequence<I...>) {
-    return ((static_cast<glm::vec3>(wavelength2XYZ(static_cast<double>(w[I]))) * x[I]) + ...) / static_cast<Float>(Samples);
+template <int32_t N>
+Float luminance(const SampledSpectrumN<N>& x, const SampledSpectrumN<N>& sampledWavelengths) noexcept {
+    return accumulateResponse(x, sampledWavelengths).w;
 }
 
-RGBSpectrum toRGB(const SampledSpectrum& x, const SampledSpectrum& sampledWavelengths) noexcept {
-    constexpr auto indices = std::make_index_sequence<SampledSpectrum::nSamples>{};
-    constexpr auto scale = static_cast<Float>(rcp(integralOfY));
-    const auto xyz = expandXYZ<SampledSpectrum::nSamples>(x.raw(), sampledWavelengths.raw(), indices) * scale;
-    return RGBSpectrum::fromRaw(glm::max(RGBSpectrum::matXYZ2RGB * xyz, glm::zero<glm::vec3>()));
+template Float luminance(const SampledSpectrum& x, const SampledSpectrum& sampledWavelengths) noexcept;
+template Float luminance(const SampledSpectrum8& x, const SampledSpectrum8& sampledWavelengths) noexcept;
+template Float luminance(const SampledSpectrum16& x, const SampledSpectrum16& sampledWavelengths) noexcept;
+
+template <int32_t N>
+RGBSpectrum toRGB(const SampledSpectrumN<N>& x, const SampledSpectrumN<N>& sampledWavelengths) noexcept {
+    const auto rgb = glm::vec3{ accumulateResponse(x, sampledWavelengths) };
+    return RGBSpectrum::fromRaw(glm::max(rgb, glm::zero<glm::vec3>()));
 }
 
+template RGBSpectrum toRGB(const SampledSpectrum& x, const SampledSpectrum& sampledWavelengths) noexcept;
+template RGBSpectrum toRGB(const SampledSpectrum8& x, const SampledSpectrum8& sampledWavelengths) noexcept;
+template RGBSpectrum toRGB(const SampledSpectrum16& x, const SampledSpectrum16& sampledWavelengths) noexcept;
+
 static double blackBody(const double temperature, const double lambdaNm) noexcept {
     // Planck constant h
     // Please refer to https://physics.nist.gov/cgi-bin/cuu/Value?h
@@ -64,22 +96,10 @@ static double blackBody(const double temperature, const double lambdaNm) noexcep
     return k1 / (pow<5>(lambda) * (std::exp(k2 / (lambda * temperature)) - 1.0));
 }
 
-template <size_t Samples, typename T, size_t... I>
-static auto expandBlackBody(const Float temperature, const T& x, std::index_sequence<I...>) {
-    return T{ (static_cast<Float>(blackBody(static_cast<double>(temperature), static_cast<double>(x[I]))),
-               ...) } /  // NOLINT(clang-diagnostic-unused-value)
-        static_cast<Float>(Samples);
-}
-
 Float temperatureToSpectrum(const Float temperature, const Float sampledWavelength) noexcept {
     return static_cast<Float>(blackBody(static_cast<double>(temperature), static_cast<double>(sampledWavelength)));
 }
 
-SampledSpectrum temperatureToSpectrum(const Float temperature, const SampledSpectrum& sampledWavelength) noexcept {
-    constexpr auto indices = std::make_index_sequence<SampledSpectrum::nSamples>{};
-    return SampledSpectrum::fromRaw(expandBlackBody<SampledSpectrum::nSamples>(temperature, sampledWavelength.raw(), indices));
-}
-
 RGBSpectrum temperatureToSpectrum(const Float temperature) noexcept {
     auto xyz = glm::zero<glm::dvec3>();
     for(uint32_t idx = 0; idx < spectralLUTSize; ++idx) {
@@ -18,99 +18,696 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <Piper/Core/FileIO.hpp>
+#include <Piper/Core/Monitor.hpp>
+#include <Piper/Core/Report.hpp>
 #include <Piper/Core/Stats.hpp>
+#include <Piper/Core/Trace.hpp>
 #include <Piper/Render/ColorSpace.hpp>
 #include <Piper/Render/SpectrumUtil.hpp>
 #include <Piper/Render/Texture.hpp>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <mutex>
+#include <optional>
+#include <thread>
 #pragma warning(push, 0)
-#include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/imagebufalgo.h>
-#include <OpenImageIO/texture.h>
-#include <oneapi/tbb/enumerable_thread_specific.h>
+#include <OpenImageIO/imageio.h>
+#include <oneapi/tbb/concurrent_vector.h>
 #pragma warning(pop)
 
 PIPER_NAMESPACE_BEGIN
 
-struct TextureSystemDeleter final {
-    void operator()(OIIO::TextureSystem* ptr) const {
-        OIIO::TextureSystem::destroy(ptr);
+// TODO: video, anisotropic, etc.
+// OIIO is only used to decode the images, and the decoded tiles of all levels are kept in a fixed-budget cache shared by all
+// textures.
+
+constexpr uint32_t tileSize = 32;
+constexpr uint32_t maxChannels = 4;
+
+// The tag of a slot works as a seqlock: it is odd while the slot is being refilled, and the lookups retry if the tag is changed
+// while copying the texels. So the lookups never block, and the evicted slots can be reused without reclaiming memory.
+struct TileSlot final {
+    std::atomic_uint64_t tag{ 0 };
+    std::atomic_bool referenced{ false };
+    std::array<std::atomic<float>, tileSize * tileSize * maxChannels> texels;
+};
+
+class TileCache final {
+    tbb::concurrent_vector<TileSlot, std::pmr::polymorphic_allocator<TileSlot>> mSlots{ trackedAllocator(MemoryTag::Texture) };
+    size_t mMaxSlots;
+    size_t mHand = 0;
+    std::mutex mMutex;
+
+    // the live statistics are protected by the mutex
+    uint64_t mDecodedTiles = 0;
+    uint64_t mEvictions = 0;
+    uint32_t mUpdateCount = 0;
+    std::atomic_uint32_t mOpenFiles{ 0 };
+
+    void reportStatus() {
+        auto& monitor = getMonitor();
+        const auto count = monitor.updateCount();
+        if(count == mUpdateCount)
+            return;
+        mUpdateCount = count;
+
+        constexpr auto toMB = [](const size_t bytes) { return static_cast<double>(bytes) * 1e-6; };
+        constexpr auto tileBytes = sizeof(TileSlot);
+        monitor.updateCustomStatus(this,
+                                   fmt::format(" Texture cache: {:.1f}/{:.1f} MB, {:.1f} MB decoded, {} files, {} evictions",
+                                               toMB(mSlots.size() * tileBytes), toMB(mMaxSlots * tileBytes),
+                                               toMB(mDecodedTiles * tileBytes), mOpenFiles.load(), mEvictions));
+    }
+
+public:
+    TileCache()
+        : mMaxSlots{ std::max(RenderGlobalSetting::get().textureCacheBudget / sizeof(TileSlot), static_cast<size_t>(1024)) } {}
+
+    TileSlot& operator[](const uint32_t idx) noexcept {
+        return mSlots[idx];
+    }
+
+    // returns a slot which can be refilled, the second-chance (CLOCK) policy is used when the budget is reached
+    uint32_t acquire() {
+        std::lock_guard guard{ mMutex };
+        Counter<StatsType::TextureTileDecode>::count();
+        ++mDecodedTiles;
+        reportStatus();
+
+        if(mSlots.size() < mMaxSlots) {
+            const auto iter = mSlots.grow_by(1);
+            return static_cast<uint32_t>(iter - mSlots.begin());
+        }
+
+        while(true) {
+            const auto idx = mHand;
+            mHand = (mHand + 1) % mSlots.size();
+            auto& slot = mSlots[idx];
+            if(slot.tag.load(std::memory_order_relaxed) & 1)
+                continue;
+            if(!slot.referenced.exchange(false, std::memory_order_relaxed)) {
+                Counter<StatsType::TextureTileEviction>::count();
+                ++mEvictions;
+                return static_cast<uint32_t>(idx);
+            }
+        }
+    }
+
+    void addOpenFile() noexcept {
+        ++mOpenFiles;
+    }
+
+    static TileCache& get() {
+        static TileCache cache;
+        return cache;
     }
 };
 
-// TODO: ptex, video, mipmap, anisotropic, color space, etc.
+enum class TextureWrap { Black, Clamp, Periodic };
+enum class TextureFilter { Point, Bilinear };
+
+class TextureImage final {
+    struct Level final {
+        uint32_t width, height;
+        uint32_t tilesX;
+        uint32_t firstTile;
+        // the level is decoded from the file if it is stored in the file, otherwise it is downsampled from the previous level
+        bool stored;
+    };
 
-class TextureSystem final {
-    std::unique_ptr<OIIO::TextureSystem, TextureSystemDeleter> mSystem;
-    tbb::enumerable_thread_specific<OIIO::TextureSystem::Perthread*> mPerThread;
-    OIIO::TextureOpt mOptions;
+    std::string mPath;
+    uint32_t mId;
+    uint32_t mChannels;
+    std::vector<Level> mLevels;
+    // slot index + 1 of each tile, 0 means the tile has not been decoded
+    std::unique_ptr<std::atomic_uint32_t[]> mTileSlots;
+    std::unique_ptr<OIIO::ImageInput> mInput;
+    // the spectral upsampling coefficients of the source image are stored instead of the decoded texels if it is not null
+    TextureImage* mSource = nullptr;
+    // the decoded texels are converted to the standard linear RGB if the color space of the file is specified
+    std::optional<ColorSpaceConverter> mConverter;
+    // generating a level fetches the previous level, which may be decoded by the same thread
+    std::recursive_mutex mDecodeMutex;
 
-    OIIO::TextureSystem::Perthread* local() {
-        auto& ref = mPerThread.local();
-        if(ref == nullptr)
-            ref = mSystem->create_thread_info();
-        return ref;
+    [[nodiscard]] uint64_t tag(const uint32_t tileIdx) const noexcept {
+        return ((static_cast<uint64_t>(mId) << 32 | tileIdx) + 1) << 1;
+    }
+
+    [[nodiscard]] bool resident(const uint32_t tileIdx) noexcept {
+        const auto slotIdx = mTileSlots[tileIdx].load(std::memory_order_acquire);
+        return slotIdx && TileCache::get()[slotIdx - 1].tag.load(std::memory_order_acquire) == tag(tileIdx);
+    }
+
+    void readBand(const uint32_t levelIdx, const uint32_t yBegin, const uint32_t yEnd, std::pmr::vector<float>& pixels) {
+        const auto& level = mLevels[levelIdx];
+        if(mSource) {
+            // the coefficients are converted from the same level of the source, since interpolating them is not linear in RGB
+            for(uint32_t y = yBegin; y < yEnd; ++y)
+                for(uint32_t x = 0; x < level.width; ++x) {
+                    std::array<float, maxChannels> rgb{};
+                    mSource->fetch(levelIdx, x, y, 3, rgb.data());
+                    if(mSource->mChannels < 3)
+                        rgb[2] = rgb[1] = rgb[0];
+                    // the black texels have no finite coefficients (the lookup divides by the largest component), so they get a steep
+                    // negative constant term instead, whose sigmoid is zero at all wavelengths
+                    const auto coefficients = std::fmax(rgb[0], std::fmax(rgb[1], rgb[2])) > 0.0f ?
+                        Impl::toSpectrumCoefficients(RGBSpectrum::fromRaw({ rgb[0], rgb[1], rgb[2] })) :
+                        glm::vec3{ 0.0f, 0.0f, -1e4f };
+                    std::copy_n(&coefficients.x, 3, pixels.data() + (static_cast<size_t>(y - yBegin) * level.width + x) * 3);
+                }
+            return;
+        }
+        if(level.stored) {
+            if(!mInput->read_scanlines(0, static_cast<int>(levelIdx), static_cast<int>(yBegin), static_cast<int>(yEnd), 0, 0,
+                                       static_cast<int>(mChannels), OIIO::TypeDesc::FLOAT, pixels.data()))
+                fatal(fmt::format("Failed to decode texture \"{}\": {}", mPath, mInput->geterror()));
+            // the generated levels are downsampled from the converted texels
+            if(mConverter && mChannels >= 3)
+                mConverter->apply(pixels.data(), static_cast<size_t>(yEnd - yBegin) * level.width, mChannels);
+            return;
+        }
+
+        // 2x2 box filter, the last row/column is repeated for the odd sizes
+        const auto& prev = mLevels[levelIdx - 1];
+        std::array<float, maxChannels> value{};
+        for(uint32_t y = yBegin; y < yEnd; ++y)
+            for(uint32_t x = 0; x < level.width; ++x) {
+                const auto dst = pixels.data() + (static_cast<size_t>(y - yBegin) * level.width + x) * mChannels;
+                std::fill_n(dst, mChannels, 0.0f);
+                for(uint32_t dy = 0; dy < 2; ++dy)
+                    for(uint32_t dx = 0; dx < 2; ++dx) {
+                        fetch(levelIdx - 1, std::min(2 * x + dx, prev.width - 1), std::min(2 * y + dy, prev.height - 1), mChannels,
+                              value.data());
+                        for(uint32_t c = 0; c < mChannels; ++c)
+                            dst[c] += 0.25f * value[c];
+                    }
+            }
+    }
+
+    // the whole band of tiles is decoded at once, since most formats can only be decoded by scanlines
+    void decode(const uint32_t levelIdx, const uint32_t tileIdx) {
+        std::lock_guard guard{ mDecodeMutex };
+        if(resident(tileIdx))
+            return;
+        PIPER_TRACE_SPAN("DecodeTextureTile");
+
+        const auto& level = mLevels[levelIdx];
+        const auto band = (tileIdx - level.firstTile) / level.tilesX;
+        const auto yBegin = band * tileSize;
+        const auto yEnd = std::min(yBegin + tileSize, level.height);
+        std::pmr::vector<float> pixels{ static_cast<size_t>(yEnd - yBegin) * level.width * mChannels, context().localAllocator };
+        readBand(levelIdx, yBegin, yEnd, pixels);
+
+        auto& cache = TileCache::get();
+        for(uint32_t tx = 0; tx < level.tilesX; ++tx) {
+            const auto idx = level.firstTile + band * level.tilesX + tx;
+            if(resident(idx))
+                continue;
+
+            const auto slotIdx = cache.acquire();
+            auto& slot = cache[slotIdx];
+            slot.tag.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            const auto xBegin = tx * tileSize;
+            const auto xEnd = std::min(xBegin + tileSize, level.width);
+            for(uint32_t y = yBegin; y < yEnd; ++y)
+                for(uint32_t x = xBegin; x < xEnd; ++x) {
+                    const auto src = pixels.data() + (static_cast<size_t>(y - yBegin) * level.width + x) * mChannels;
+                    const auto dst = ((y - yBegin) * tileSize + (x - xBegin)) * maxChannels;
+                    for(uint32_t c = 0; c < mChannels; ++c)
+                        slot.texels[dst + c].store(src[c], std::memory_order_relaxed);
+                }
+
+            slot.referenced.store(true, std::memory_order_relaxed);
+            slot.tag.store(tag(idx), std::memory_order_release);
+            mTileSlots[idx].store(slotIdx + 1, std::memory_order_release);
+        }
+    }
+
+    void fetch(const uint32_t levelIdx, const uint32_t x, const uint32_t y, const uint32_t channels, float* res) {
+        const auto& level = mLevels[levelIdx];
+        const auto tileIdx = level.firstTile + (y / tileSize) * level.tilesX + x / tileSize;
+        const auto offset = ((y % tileSize) * tileSize + x % tileSize) * maxChannels;
+        const auto expected = tag(tileIdx);
+        auto& cache = TileCache::get();
+        bool missed = false;
+
+        while(true) {
+            if(const auto slotIdx = mTileSlots[tileIdx].load(std::memory_order_acquire)) {
+                auto& slot = cache[slotIdx - 1];
+                if(slot.tag.load(std::memory_order_acquire) == expected) {
+                    for(uint32_t c = 0; c < channels; ++c)
+                        res[c] = slot.texels[offset + c].load(std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if(slot.tag.load(std::memory_order_relaxed) == expected) {
+                        // avoid writing to the shared cache line when it is not necessary
+                        if(!slot.referenced.load(std::memory_order_relaxed))
+                            slot.referenced.store(true, std::memory_order_relaxed);
+                        BoolCounter<StatsType::TextureTileHit>::count(!missed);
+                        return;
+                    }
+                }
+            }
+            missed = true;
+            decode(levelIdx, tileIdx);
+        }
+    }
+
+    // returns false if the texel is outside of the image
+    [[nodiscard]] bool wrap(int32_t& coord, const uint32_t size, const TextureWrap mode) const noexcept {
+        const auto isize = static_cast<int32_t>(size);
+        switch(mode) {
+            case TextureWrap::Black:
+                return coord >= 0 && coord < isize;
+            case TextureWrap::Clamp:
+                coord = std::clamp(coord, 0, isize - 1);
+                return true;
+            case TextureWrap::Periodic:
+                coord %= isize;
+                if(coord < 0)
+                    coord += isize;
+                return true;
+        }
+        PIPER_UNREACHABLE();
+    }
+
+    void texel(const uint32_t levelIdx, int32_t x, int32_t y, const uint32_t channels, const TextureWrap mode, const float weight,
+               Float* res) {
+        const auto& level = mLevels[levelIdx];
+        if(!wrap(x, level.width, mode) || !wrap(y, level.height, mode))
+            return;
+        std::array<float, maxChannels> value{};
+        fetch(levelIdx, static_cast<uint32_t>(x), static_cast<uint32_t>(y), std::min(channels, mChannels), value.data());
+        for(uint32_t c = 0; c < channels; ++c)
+            res[c] += weight * value[c];
+    }
+
+    void sampleLevel(const uint32_t levelIdx, const TexCoord& texCoord, const uint32_t channels, const TextureWrap wrapMode,
+                     const TextureFilter filter, const float weight, Float* res) {
+        const auto& level = mLevels[levelIdx];
+        const auto x = texCoord.x * static_cast<Float>(level.width);
+        const auto y = texCoord.y * static_cast<Float>(level.height);
+        if(filter == TextureFilter::Point) {
+            texel(levelIdx, static_cast<int32_t>(std::floor(x)), static_cast<int32_t>(std::floor(y)), channels, wrapMode, weight, res);
+            return;
+        }
+
+        const auto fx = std::floor(x - 0.5f), fy = std::floor(y - 0.5f);
+        const auto wx = x - 0.5f - fx, wy = y - 0.5f - fy;
+        const auto x0 = static_cast<int32_t>(fx), y0 = static_cast<int32_t>(fy);
+        texel(levelIdx, x0, y0, channels, wrapMode, weight * (1.0f - wx) * (1.0f - wy), res);
+        texel(levelIdx, x0 + 1, y0, channels, wrapMode, weight * wx * (1.0f - wy), res);
+        texel(levelIdx, x0, y0 + 1, channels, wrapMode, weight * (1.0f - wx) * wy, res);
+        texel(levelIdx, x0 + 1, y0 + 1, channels, wrapMode, weight * wx * wy, res);
+    }
+
+    [[nodiscard]] Float levelOfDetail(const Float footprint) const noexcept {
+        if(footprint <= 0.0f)
+            return 0.0f;
+        const auto& base = mLevels.front();
+        return std::clamp(std::log2(footprint * static_cast<Float>(std::max(base.width, base.height))), 0.0f,
+                          static_cast<Float>(mLevels.size() - 1));
+    }
+
+    // the tile touched by a lookup, which is used to group the lookups of a batch
+    [[nodiscard]] uint32_t tileOf(const TexCoord& texCoord, const Float footprint) const noexcept {
+        const auto& level = mLevels[static_cast<uint32_t>(levelOfDetail(footprint))];
+        const auto x = std::clamp(static_cast<int32_t>(texCoord.x * static_cast<Float>(level.width)), 0,
+                                  static_cast<int32_t>(level.width) - 1);
+        const auto y = std::clamp(static_cast<int32_t>(texCoord.y * static_cast<Float>(level.height)), 0,
+                                  static_cast<int32_t>(level.height) - 1);
+        return level.firstTile + static_cast<uint32_t>(y) / tileSize * level.tilesX + static_cast<uint32_t>(x) / tileSize;
     }
 
 public:
-    TextureSystem() : mSystem{ OIIO::TextureSystem::create() } {}
-    TextureSystem(const TextureSystem&) = delete;
-    TextureSystem(TextureSystem&&) = delete;
-    TextureSystem& operator=(const TextureSystem&) = delete;
-    TextureSystem& operator=(TextureSystem&&) = delete;
+    TextureImage(std::string path, const uint32_t id, const std::optional<ColorSpaceConverter> converter)
+        : mPath{ std::move(path) }, mId{ id }, mConverter{ converter } {
+        mInput = OIIO::ImageInput::open(mPath);
+        if(!mInput)
+            fatal(fmt::format("Failed to open texture \"{}\": {}", mPath, OIIO::geterror()));
+        TileCache::get().addOpenFile();
 
-    ~TextureSystem() {
-        for(const auto ptr : mPerThread)
-            mSystem->destroy_thread_info(ptr);
+        const auto& spec = mInput->spec();
+        mChannels = std::min(static_cast<uint32_t>(spec.nchannels), maxChannels);
+
+        // the levels stored in the file (e.g. the tiled .tx files) are used directly, the rest are generated on demand
+        uint32_t tileCount = 0;
+        auto width = static_cast<uint32_t>(spec.width), height = static_cast<uint32_t>(spec.height);
+        while(true) {
+            const auto levelIdx = static_cast<int>(mLevels.size());
+            const auto dims = mInput->spec_dimensions(0, levelIdx);
+            const auto stored = mLevels.empty() ||
+                (dims.width == static_cast<int>(width) && dims.height == static_cast<int>(height) && mLevels.back().stored);
+            const auto tilesX = (width + tileSize - 1) / tileSize;
+            mLevels.push_back({ width, height, tilesX, tileCount, stored });
+            tileCount += tilesX * ((height + tileSize - 1) / tileSize);
+
+            if(width == 1 && height == 1)
+                break;
+            width = std::max(width / 2, 1U);
+            height = std::max(height / 2, 1U);
+        }
+        mTileSlots = std::make_unique<std::atomic_uint32_t[]>(tileCount);
     }
 
-    OIIO::TextureSystem::TextureHandle* load(const std::string_view path) {
-        return mSystem->get_texture_handle({ path.data(), path.size() }, local());
+    // a texture of the per-texel sigmoid-polynomial coefficients of the source, so that the spectral lookups skip the RGB
+    // upsampling table
+    TextureImage(TextureImage& source, const uint32_t id)
+        : mPath{ source.mPath }, mId{ id }, mChannels{ 3 }, mLevels{ source.mLevels }, mSource{ &source } {
+        const auto& last = mLevels.back();
+        mTileSlots = std::make_unique<std::atomic_uint32_t[]>(last.firstTile + 1);
     }
 
-    void texture(OIIO::TextureSystem::TextureHandle* handle, const TextureEvaluateInfo& info, const int channels, Float* res) {
+    // The texture coordinates follow OIIO: (0, 0) is the upper-left corner of the image, and the texel centers are at half
+    // integers. The level is selected from the footprint, and the adjacent levels are blended.
+    void sample(const TexCoord& texCoord, const Float footprint, const uint32_t channels, const TextureWrap wrapMode,
+                const TextureFilter filter, Float* res) {
         Counter<StatsType::Texture2D>::count();
-        auto options = mOptions;
-        options.time = info.t;
-        // options.subimage = static_cast<int>(info.primitiveIdx);
+        std::fill_n(res, channels, 0.0f);
+
+        const auto lod = levelOfDetail(footprint);
 
-        [[maybe_unused]] const auto ok =
-            mSystem->texture(handle, local(), options, info.texCoord.x, info.texCoord.y, 0.0f, 0.0f, 0.0f, 0.0f, channels, res);
-        assert(ok);
+        if(filter == TextureFilter::Point) {
+            sampleLevel(static_cast<uint32_t>(std::round(lod)), texCoord, channels, wrapMode, filter, 1.0f, res);
+            return;
+        }
+
+        const auto lower = std::floor(lod);
+        const auto weight = lod - lower;
+        const auto levelIdx = static_cast<uint32_t>(lower);
+        sampleLevel(levelIdx, texCoord, channels, wrapMode, filter, 1.0f - weight, res);
+        if(weight > 0.0f)
+            sampleLevel(levelIdx + 1, texCoord, channels, wrapMode, filter, weight, res);
     }
 
-    static TextureSystem& get() noexcept {
-        static TextureSystem system;
-        return system;
+    // The lookups are sorted by the touched tiles, so that the coherent lookups of a batch stream through the same tiles instead
+    // of jumping between them.
+    void sampleBatch(const std::span<const TextureEvaluateInfo> infos, const uint32_t channels, const TextureWrap wrapMode,
+                     const TextureFilter filter, Float* res) {
+        std::pmr::vector<std::pair<uint32_t, uint32_t>> order{ context().localAllocator };
+        order.reserve(infos.size());
+        for(uint32_t idx = 0; idx < infos.size(); ++idx)
+            order.emplace_back(tileOf(infos[idx].texCoord, infos[idx].footprint), idx);
+        std::sort(order.begin(), order.end());
+
+        for(const auto [tile, idx] : order)
+            sample(infos[idx].texCoord, infos[idx].footprint, channels, wrapMode, filter, res + static_cast<size_t>(idx) * channels);
+    }
+};
+
+// The scanline images are converted to tiled and mipmapped .tx files by the maketx path of OIIO, so that the following runs
+// decode the tiles and the levels directly. The cached files are addressed by the content, so they can be shared by all nodes
+// of a render farm.
+static std::string convertTexture(const std::string& path) {
+    const auto& settings = RenderGlobalSetting::get();
+    if(settings.textureCacheDirectory.empty())
+        return path;
+
+    const auto hash = hashFile(path);
+    const auto cachePath =
+        settings.textureCacheDirectory / fmt::format("{:016x}{}.tx", hash, settings.textureHalfFloat ? "-half"sv : ""sv);
+    if(fs::exists(cachePath))
+        return cachePath.string();
+
+    OIIO::ImageSpec config;
+    config.tile_width = config.tile_height = 64;
+    config.attribute("maketx:filtername", "box");
+    if(settings.textureHalfFloat)
+        config.format = OIIO::TypeDesc::HALF;
+
+    // the extension of the temporary file selects the output format
+    auto tmpPath = settings.textureCacheDirectory;
+    tmpPath /= fmt::format("{:016x}.{:016x}.tmp.tx", hash, std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    if(!OIIO::ImageBufAlgo::make_texture(OIIO::ImageBufAlgo::MakeTxTexture, path, tmpPath.string(), config)) {
+        warning(fmt::format("Failed to convert texture \"{}\": {}", path, OIIO::geterror()));
+        std::error_code ec;
+        fs::remove(tmpPath, ec);
+        return path;
+    }
+
+    std::error_code ec;
+    fs::rename(tmpPath, cachePath, ec);
+    if(ec) {
+        warning(fmt::format("Failed to save texture \"{}\": {}", cachePath.string(), ec.message()));
+        return tmpPath.string();
+    }
+    return cachePath.string();
+}
+
+class TextureRegistry final {
+    std::mutex mMutex;
+    std::unordered_map<std::string, std::unique_ptr<TextureImage>> mImages;
+    std::atomic_uint32_t mNextId{ 0 };
+
+public:
+    TextureImage& load(const std::string_view path, const std::string_view colorSpace = {}) {
+        const auto key = colorSpace.empty() ? std::string{ path } : fmt::format("{}#{}", path, colorSpace);
+        {
+            std::lock_guard guard{ mMutex };
+            if(const auto iter = mImages.find(key); iter != mImages.cend())
+                return *iter->second;
+        }
+
+        // the conversion is done outside of the lock, so the textures referenced by the objects loaded in parallel are converted
+        // concurrently. If two threads race on the same texture, the first one wins.
+        std::optional<ColorSpaceConverter> converter;
+        if(!colorSpace.empty())
+            converter = getRGB2StandardLinearRGBConverter(colorSpace);
+        auto image = std::make_unique<TextureImage>(convertTexture(std::string{ path }), mNextId++, converter);
+        std::lock_guard guard{ mMutex };
+        return *mImages.emplace(key, std::move(image)).first->second;
+    }
+
+    TextureImage& loadSpectrumCoefficients(const std::string_view path, const std::string_view colorSpace = {}) {
+        const auto key = fmt::format("{}#{}#SpectrumCoefficients", path, colorSpace);
+        {
+            std::lock_guard guard{ mMutex };
+            if(const auto iter = mImages.find(key); iter != mImages.cend())
+                return *iter->second;
+        }
+
+        auto image = std::make_unique<TextureImage>(load(path, colorSpace), mNextId++);
+        std::lock_guard guard{ mMutex };
+        return *mImages.emplace(key, std::move(image)).first->second;
+    }
+
+    static TextureRegistry& get() {
+        static TextureRegistry registry;
+        return registry;
+    }
+};
+
+// A set of UDIM tiles, each one covers a unit square of the texture space and is numbered by 1001 + u + 10 * v. The files are
+// only listed here, each one is opened (and converted) by the first lookup hitting it, so the untouched tiles cost neither I/O
+// nor memory. The decoded texels share the budget of the tile cache with the other textures.
+class UDIMSet final {
+    struct Tile final {
+        std::string path;
+        std::once_flag flag;
+        std::atomic<TextureImage*> image{ nullptr };
+    };
+
+    static constexpr uint32_t firstTile = 1001;
+    static constexpr uint32_t tilesPerRow = 10;
+
+    std::string mColorSpace;
+    bool mSpectrumCoefficients;
+    // indexed by the tile number - 1001, null if the file of the tile does not exist
+    std::vector<std::unique_ptr<Tile>> mTiles;
+
+public:
+    static constexpr auto token = "<UDIM>"sv;
+
+    UDIMSet(const std::string_view pattern, const std::string_view colorSpace, const bool spectrumCoefficients)
+        : mColorSpace{ colorSpace }, mSpectrumCoefficients{ spectrumCoefficients } {
+        const fs::path path{ pattern };
+        const auto name = path.filename().string();
+        const auto pos = name.find(token);
+        if(pos == std::string::npos)
+            fatal(fmt::format("The directory of the UDIM texture \"{}\" cannot contain {}", pattern, token));
+        const auto prefix = std::string_view{ name }.substr(0, pos), suffix = std::string_view{ name }.substr(pos + token.size());
+
+        const auto directory = path.has_parent_path() ? path.parent_path() : fs::path{ "." };
+        std::error_code ec;
+        for(const auto& entry : fs::directory_iterator{ directory, ec }) {
+            const auto file = entry.path().filename().string();
+            if(file.size() != prefix.size() + 4 + suffix.size() || !file.starts_with(prefix) || !file.ends_with(suffix))
+                continue;
+            uint32_t tile = 0;
+            const auto digits = std::string_view{ file }.substr(prefix.size(), 4);
+            if(const auto [ptr, err] = std::from_chars(digits.data(), digits.data() + digits.size(), tile);
+               err != std::errc{} || ptr != digits.data() + digits.size() || tile < firstTile)
+                continue;
+
+            const auto idx = tile - firstTile;
+            if(idx >= mTiles.size())
+                mTiles.resize(idx + 1);
+            mTiles[idx] = std::make_unique<Tile>();
+            mTiles[idx]->path = entry.path().string();
+        }
+        if(mTiles.empty())
+            fatal(fmt::format("No tile of the UDIM texture \"{}\" is found", pattern));
+    }
+
+    // returns null if the lookup is outside of all tiles, the texture coordinates are moved into the tile
+    [[nodiscard]] TextureImage* locate(TexCoord& texCoord) const {
+        const auto u = std::floor(texCoord.x), v = std::floor(texCoord.y);
+        if(u < 0.0f || u >= static_cast<Float>(tilesPerRow) || v < 0.0f)
+            return nullptr;
+        const auto idx = static_cast<size_t>(v) * tilesPerRow + static_cast<size_t>(u);
+        if(idx >= mTiles.size() || !mTiles[idx])
+            return nullptr;
+        texCoord -= TexCoord{ u, v };
+
+        auto& tile = *mTiles[idx];
+        if(const auto image = tile.image.load(std::memory_order_acquire))
+            return image;
+        std::call_once(tile.flag, [&] {
+            auto& registry = TextureRegistry::get();
+            tile.image.store(mSpectrumCoefficients ? &registry.loadSpectrumCoefficients(tile.path, mColorSpace) :
+                                                     &registry.load(tile.path, mColorSpace),
+                             std::memory_order_release);
+        });
+        return tile.image.load(std::memory_order_acquire);
+    }
+};
+
+class TextureLookup final {
+    // exactly one of them is not null
+    TextureImage* mImage = nullptr;
+    std::unique_ptr<UDIMSet> mUDIM;
+    TextureWrap mWrap = TextureWrap::Black;
+    TextureFilter mFilter = TextureFilter::Bilinear;
+
+    // the coordinates on the borders (e.g. the poles of the environment maps) are kept
+    static TexCoord repeat(const TexCoord texCoord) noexcept {
+        const auto wrap = [](const Float x) { return x < 0.0f || x > 1.0f ? x - std::floor(x) : x; };
+        return { wrap(texCoord.x), wrap(texCoord.y) };
+    }
+
+    static std::string_view colorSpaceOf(const Ref<ConfigNode>& node) {
+        const auto ptr = node->tryGet("ColorSpace"sv);
+        return ptr ? (*ptr)->as<std::string_view>() : std::string_view{};
+    }
+
+public:
+    explicit TextureLookup(const Ref<ConfigNode>& node, const bool spectrumCoefficients = false) {
+        const auto path = node->get("FilePath"sv)->as<std::string_view>();
+        if(path.find(UDIMSet::token) != std::string_view::npos)
+            mUDIM = std::make_unique<UDIMSet>(path, colorSpaceOf(node), spectrumCoefficients);
+        else
+            mImage = spectrumCoefficients ? &TextureRegistry::get().loadSpectrumCoefficients(path, colorSpaceOf(node)) :
+                                            &TextureRegistry::get().load(path, colorSpaceOf(node));
+        if(const auto ptr = node->tryGet("Wrap"sv)) {
+            const auto mode = (*ptr)->as<std::string_view>();
+            if(mode == "Clamp"sv)
+                mWrap = TextureWrap::Clamp;
+            else if(mode == "Periodic"sv)
+                mWrap = TextureWrap::Periodic;
+            else if(mode != "Black"sv)
+                fatal(fmt::format("Unrecognized texture wrap mode \"{}\"", mode));
+        }
+        if(const auto ptr = node->tryGet("Filter"sv)) {
+            const auto filter = (*ptr)->as<std::string_view>();
+            if(filter == "Point"sv)
+                mFilter = TextureFilter::Point;
+            else if(filter != "Bilinear"sv)
+                fatal(fmt::format("Unrecognized texture filter \"{}\"", filter));
+        }
+        // the coefficients of black are not finite, so the border texels are repeated instead
+        if(spectrumCoefficients && mWrap == TextureWrap::Black)
+            mWrap = TextureWrap::Clamp;
+    }
+
+    // NOTICE: the shapes pass the texture coordinates without wrapping them, the single images repeat over the texture space and
+    // the wrap mode only applies to the filter footprint at the borders.
+    void texture(const TextureEvaluateInfo& info, const uint32_t channels, Float* res) const noexcept {
+        auto texCoord = info.texCoord;
+        TextureImage* image;
+        if(mUDIM) {
+            image = mUDIM->locate(texCoord);
+            if(!image) {
+                std::fill_n(res, channels, 0.0f);
+                return;
+            }
+        } else {
+            image = mImage;
+            texCoord = repeat(texCoord);
+        }
+        image->sample(texCoord, info.footprint, channels, mWrap, mFilter, res);
+    }
+
+    void textureBatch(const std::span<const TextureEvaluateInfo> infos, const uint32_t channels, Float* res) const noexcept {
+        // the lookups are split by the tiles of the set (or the image), so that each image sorts its own lookups
+        std::pmr::vector<TextureImage*> images{ infos.size(), context().localAllocator };
+        std::pmr::vector<TextureEvaluateInfo> local{ infos.begin(), infos.end(), context().localAllocator };
+        std::pmr::vector<uint32_t> order{ context().localAllocator };
+        order.reserve(infos.size());
+        for(uint32_t idx = 0; idx < infos.size(); ++idx) {
+            if(mUDIM)
+                images[idx] = mUDIM->locate(local[idx].texCoord);
+            else {
+                images[idx] = mImage;
+                local[idx].texCoord = repeat(local[idx].texCoord);
+            }
+            if(images[idx])
+                order.push_back(idx);
+            else
+                std::fill_n(res + static_cast<size_t>(idx) * channels, channels, 0.0f);
+        }
+        if(!mUDIM) {
+            mImage->sampleBatch(local, channels, mWrap, mFilter, res);
+            return;
+        }
+
+        std::stable_sort(order.begin(), order.end(), [&](const uint32_t lhs, const uint32_t rhs) { return images[lhs] < images[rhs]; });
+        std::pmr::vector<TextureEvaluateInfo> group{ context().localAllocator };
+        std::pmr::vector<Float> groupRes{ context().localAllocator };
+        for(size_t begin = 0; begin < order.size();) {
+            auto end = begin;
+            group.clear();
+            while(end < order.size() && images[order[end]] == images[order[begin]])
+                group.push_back(local[order[end++]]);
+            groupRes.resize(group.size() * channels);
+            images[order[begin]]->sampleBatch(group, channels, mWrap, mFilter, groupRes.data());
+            for(auto idx = begin; idx < end; ++idx)
+                std::copy_n(groupRes.data() + (idx - begin) * channels, channels, res + static_cast<size_t>(order[idx]) * channels);
+            begin = end;
+        }
     }
 };
 
 class BitMapScalar final : public ScalarTexture2D {
-    TextureSystem& mSystem;
-    OIIO::TextureSystem::TextureHandle* mHandle;
+    TextureLookup mLookup;
 
 public:
-    explicit BitMapScalar(const Ref<ConfigNode>& node)
-        : mSystem{ TextureSystem::get() }, mHandle{ mSystem.load(node->get("FilePath"sv)->as<std::string_view>()) } {}
+    explicit BitMapScalar(const Ref<ConfigNode>& node) : mLookup{ node } {}
 
     Float evaluate(const TextureEvaluateInfo& info) const noexcept override {
         Float res;
-        mSystem.texture(mHandle, info, 1, &res);
+        mLookup.texture(info, 1, &res);
         return res;
     }
+
+    void evaluateBatch(const std::span<const TextureEvaluateInfo> infos, const std::span<Float> res) const noexcept override {
+        mLookup.textureBatch(infos, 1, res.data());
+    }
 };
 
 class BitMapNormalized final : public NormalizedTexture2D {
-    TextureSystem& mSystem;
-    OIIO::TextureSystem::TextureHandle* mHandle;
+    TextureLookup mLookup;
 
 public:
-    explicit BitMapNormalized(const Ref<ConfigNode>& node)
-        : mSystem{ TextureSystem::get() }, mHandle{ mSystem.load(node->get("FilePath"sv)->as<std::string_view>()) } {}
+    explicit BitMapNormalized(const Ref<ConfigNode>& node) : mLookup{ node } {}
 
     Direction<FrameOfReference::Shading> evaluate(const TextureEvaluateInfo& info) const noexcept override {
         auto res = Vector<FrameOfReference::Shading>::undefined();
         static_assert(sizeof(res) == 3 * sizeof(Float));
-        mSystem.texture(mHandle, info, 3, reinterpret_cast<Float*>(&res));
+        mLookup.texture(info, 3, reinterpret_cast<Float*>(&res));
         if(dot(res, res).raw() < epsilon)
             return Direction<FrameOfReference::Shading>::positiveZ();
         return normalize(res);
@@ -121,26 +718,38 @@ template <typename Setting>
 class BitMap final : public SpectrumTexture2D<Setting> {
     PIPER_IMPORT_SETTINGS();
 
-    TextureSystem& mSystem;
-    OIIO::TextureSystem::TextureHandle* mHandle;
+    // the spectral variants may sample the precomputed upsampling coefficients instead of RGB
+    bool mSpectrumCoefficients;
+    TextureLookup mLookup;
+
+    static bool useSpectrumCoefficients(const Ref<ConfigNode>& node) {
+        if constexpr(std::is_same_v<Spectrum, MonoSpectrum> || std::is_same_v<Spectrum, RGBSpectrum>)
+            return false;
+        else {
+            const auto ptr = node->tryGet("SpectrumCoefficients"sv);
+            return ptr && (*ptr)->as<bool>();
+        }
+    }
 
 public:
     explicit BitMap(const Ref<ConfigNode>& node)
-        : mSystem{ TextureSystem::get() }, mHandle{ mSystem.load(node->get("FilePath"sv)->as<std::string_view>()) } {}
+        : mSpectrumCoefficients{ useSpectrumCoefficients(node) }, mLookup{ node, mSpectrumCoefficients } {}
 
     Spectrum evaluate(const TextureEvaluateInfo& info, const Wavelength& sampledWavelength) const noexcept override {
         if constexpr(std::is_same_v<Spectrum, MonoSpectrum>) {
             MonoSpectrum res;
-            mSystem.texture(mHandle, info, 1, &res);
+            mLookup.texture(info, 1, &res);
             return res;
         } else {
             RGBSpectrum res = RGBSpectrum::undefined();
             static_assert(sizeof(RGBSpectrum) == 3 * sizeof(Float));
-            mSystem.texture(mHandle, info, 3, reinterpret_cast<Float*>(&res));
+            mLookup.texture(info, 3, reinterpret_cast<Float*>(&res));
 
             if constexpr(std::is_same_v<Spectrum, RGBSpectrum>)
                 return res;
             else {
+                if(mSpectrumCoefficients)
+                    return Impl::fromSpectrumCoefficients(res.raw(), sampledWavelength);
                 return spectrumCast<Spectrum>(res, sampledWavelength);
             }
         }
@@ -150,16 +759,45 @@ public:
                                                                const Float wavelength) const noexcept override {
         if constexpr(std::is_same_v<Spectrum, MonoSpectrum>) {
             MonoSpectrum res;
-            mSystem.texture(mHandle, info, 1, &res);
+            mLookup.texture(info, 1, &res);
             return { false, res };
         } else {
             RGBSpectrum res = RGBSpectrum::undefined();
             static_assert(sizeof(RGBSpectrum) == 3 * sizeof(Float));
-            mSystem.texture(mHandle, info, 3, reinterpret_cast<Float*>(&res));
+            mLookup.texture(info, 3, reinterpret_cast<Float*>(&res));
 
+            if(mSpectrumCoefficients)
+                return { true, Impl::fromSpectrumCoefficients(res.raw(), wavelength) };
             return { true, Impl::fromRGB(res, wavelength) };
         }
     }
+
+    void evaluateBatch(const std::span<const TextureEvaluateInfo> infos, const std::span<const Wavelength> sampledWavelengths,
+                       const std::span<Spectrum> res) const noexcept override {
+        if constexpr(std::is_same_v<Spectrum, MonoSpectrum>) {
+            mLookup.textureBatch(infos, 1, res.data());
+        } else if constexpr(std::is_same_v<Spectrum, RGBSpectrum>) {
+            mLookup.textureBatch(infos, 3, reinterpret_cast<Float*>(res.data()));
+        } else {
+            std::pmr::vector<RGBSpectrum> rgb{ infos.size(), RGBSpectrum::undefined(), context().localAllocator };
+            mLookup.textureBatch(infos, 3, reinterpret_cast<Float*>(rgb.data()));
+            for(size_t idx = 0; idx < infos.size(); ++idx)
+                res[idx] = mSpectrumCoefficients ? Impl::fromSpectrumCoefficients(rgb[idx].raw(), sampledWavelengths[idx]) :
+                                                   spectrumCast<Spectrum>(rgb[idx], sampledWavelengths[idx]);
+        }
+    }
+
+    [[nodiscard]] RGBSpectrum estimateRGB(const TextureEvaluateInfo& info) const noexcept override {
+        // the upsampled spectra reproduce the stored RGB, so the texels are returned without integrating over wavelengths
+        if constexpr(isSampledSpectrum<Spectrum>) {
+            if(!mSpectrumCoefficients) {
+                RGBSpectrum res = RGBSpectrum::undefined();
+                mLookup.texture(info, 3, reinterpret_cast<Float*>(&res));
+                return res;
+            }
+        }
+        return SpectrumTexture2D<Setting>::estimateRGB(info);
+    }
 };
 
 PIPER_REGISTER_VARIANT(BitMap, SpectrumTexture2D);
@@ -25,9 +25,7 @@ PIPER_NAMESPACE_BEGIN
 
 // TODO: move to BlackBodyUtil.hpp?
 Float temperatureToSpectrum(Float temperature, Float sampledWavelength) noexcept;
-SampledSpectrum temperatureToSpectrum(Float temperature, const SampledSpectrum& sampledWavelength) noexcept;
 RGBSpectrum temperatureToSpectrum(Float temperature) noexcept;
-MonoWavelengthSpectrum temperatureToSpectrum(Float temperature, MonoWavelengthSpectrum sampledWavelength) noexcept;
 
 template <typename Setting>
 class BlackBody final : public ConstantTexture<Setting> {
@@ -38,22 +36,54 @@ class BlackBody final : public ConstantTexture<Setting> {
 
     std::optional<Spectrum> mCached;
 
+    // Planck's law on the 1nm grid of the CMF tables, normalized by its maximum
+    // Lookups interpolate the table instead of evaluating std::exp per wavelength.
+    std::array<Float, spectralLUTSize> mNormalizedSpectrum{};
+    Float mPeak = 0.0f;
+
+    [[nodiscard]] Float lookup(const Float lambda) const noexcept {
+        const auto offset =
+            std::clamp(lambda - static_cast<Float>(wavelengthMin), 0.0f, static_cast<Float>(spectralLUTSize - 1));
+        const auto idx = std::min(static_cast<uint32_t>(offset), static_cast<uint32_t>(spectralLUTSize - 2));
+        const auto u = offset - static_cast<Float>(idx);
+        return (mNormalizedSpectrum[idx] * (1.0f - u) + mNormalizedSpectrum[idx + 1] * u) * mPeak;
+    }
+
 public:
     explicit BlackBody(const Ref<ConfigNode>& node)
         : mTemperature{ node->get("Temperature"sv)->as<Float>() }, mScale{ node->get("Scale"sv)->as<Float>() } {
-        mMean = luminance(temperatureToSpectrum(mTemperature), std::monostate{});
-
-        if constexpr(!isSpectral)
-            mCached = spectrumCast<Spectrum>(temperatureToSpectrum(mTemperature), Wavelength{}) * mScale;
+        const auto rgb = temperatureToSpectrum(mTemperature);
+        mMean = luminance(rgb, std::monostate{});
+
+        if constexpr(isSpectral) {
+            for(uint32_t idx = 0; idx < spectralLUTSize; ++idx) {
+                mNormalizedSpectrum[idx] = temperatureToSpectrum(mTemperature, static_cast<Float>(wavelengthMin + idx));
+                mPeak = std::fmax(mPeak, mNormalizedSpectrum[idx]);
+            }
+            if(mPeak > 0.0f) {
+                const auto invPeak = 1.0f / mPeak;
+                for(auto& val : mNormalizedSpectrum)
+                    val *= invPeak;
+            }
+        } else
+            mCached = spectrumCast<Spectrum>(rgb, Wavelength{}) * mScale;
     }
 
     [[nodiscard]] std::pair<bool, Float> evaluateOneWavelength(const Float sampledWavelength) const noexcept override {
-        return { true, temperatureToSpectrum(mTemperature, sampledWavelength) };
+        if constexpr(isSpectral)
+            return { true, lookup(sampledWavelength) };
+        else
+            return { true, temperatureToSpectrum(mTemperature, sampledWavelength) };
     }
 
     Spectrum evaluate(const Wavelength& sampledWavelength) const noexcept override {
-        if constexpr(isSpectral)
-            return spectrumCast<Spectrum>(temperatureToSpectrum(mTemperature, sampledWavelength), sampledWavelength) * mScale;
+        if constexpr(isSampledSpectrum<Spectrum>) {
+            auto res = sampledWavelength.raw();
+            for(int32_t idx = 0; idx < Spectrum::nSamples; ++idx)
+                res[idx] = lookup(res[idx]);
+            return Spectrum::fromRaw(res) * mScale;
+        } else if constexpr(isSpectral)
+            return Spectrum::fromScalar(lookup(sampledWavelength.raw())) * mScale;
         else
             return mCached.value();
     }
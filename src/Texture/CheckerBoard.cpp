@@ -22,9 +22,12 @@
 
 PIPER_NAMESPACE_BEGIN
 
-inline bool select(TexCoord& texCoord, const TexCoord invSize) noexcept {
+inline bool select(TextureEvaluateInfo& info, const TexCoord invSize) noexcept {
+    // NOTICE: the shapes pass the unwrapped coordinates, wrap them first so that the pattern still repeats per texture unit
+    // and the cell indices stay non-negative
     TexCoord intCoord;
-    texCoord = glm::modf(texCoord * invSize, intCoord);
+    info.texCoord = glm::modf((info.texCoord - glm::floor(info.texCoord)) * invSize, intCoord);
+    info.footprint *= std::fmax(invSize.x, invSize.y);
     return (static_cast<uint32_t>(intCoord.x) ^ static_cast<uint32_t>(intCoord.y)) & 1;
 }
 
@@ -32,8 +35,8 @@ class CheckerBoardScalar final : public ScalarTexture2D {
     Ref<ScalarTexture2D> mWhite, mBlack;
     glm::vec2 mInvSize;
 
-    ScalarTexture2D& select(TexCoord& texCoord) const noexcept {
-        return *(Piper::select(texCoord, mInvSize) ? mWhite : mBlack);
+    ScalarTexture2D& select(TextureEvaluateInfo& info) const noexcept {
+        return *(Piper::select(info, mInvSize) ? mWhite : mBlack);
     }
 
 public:
@@ -44,14 +47,14 @@ public:
 
     Float evaluate(const TextureEvaluateInfo& info) const noexcept override {
         auto modifiedInfo = info;
-        const auto& tex = select(modifiedInfo.texCoord);
+        const auto& tex = select(modifiedInfo);
         return tex.evaluate(modifiedInfo);
     }
 
     [[nodiscard]] std::pair<bool, Float> evaluateOneWavelength(const TextureEvaluateInfo& info,
                                                                const Float wavelength) const noexcept override {
         auto modifiedInfo = info;
-        const auto& tex = select(modifiedInfo.texCoord);
+        const auto& tex = select(modifiedInfo);
         return tex.evaluateOneWavelength(modifiedInfo, wavelength);
     }
 };
@@ -65,8 +68,8 @@ class CheckerBoard final : public SpectrumTexture2D<Setting> {
     Ref<SpectrumTexture2D<Setting>> mWhite, mBlack;
     glm::vec2 mInvSize;
 
-    SpectrumTexture2D<Setting>& select(TexCoord& texCoord) const noexcept {
-        return *(Piper::select(texCoord, mInvSize) ? mWhite : mBlack);
+    SpectrumTexture2D<Setting>& select(TextureEvaluateInfo& info) const noexcept {
+        return *(Piper::select(info, mInvSize) ? mWhite : mBlack);
     }
 
 public:
@@ -77,15 +80,21 @@ public:
 
     Spectrum evaluate(const TextureEvaluateInfo& info, const Wavelength& sampledWavelength) const noexcept override {
         auto modifiedInfo = info;
-        const auto& tex = select(modifiedInfo.texCoord);
+        const auto& tex = select(modifiedInfo);
         return tex.evaluate(modifiedInfo, sampledWavelength);
     }
 
     [[nodiscard]] std::pair<bool, Float> evaluateOneWavelength(const TextureEvaluateInfo& info, Float wavelength) const noexcept override {
         auto modifiedInfo = info;
-        const auto& tex = select(modifiedInfo.texCoord);
+        const auto& tex = select(modifiedInfo);
         return tex.evaluateOneWavelength(modifiedInfo, wavelength);
     }
+
+    [[nodiscard]] RGBSpectrum estimateRGB(const TextureEvaluateInfo& info) const noexcept override {
+        auto modifiedInfo = info;
+        const auto& tex = select(modifiedInfo);
+        return tex.estimateRGB(modifiedInfo);
+    }
 };
 
 PIPER_REGISTER_VARIANT(CheckerBoard, SpectrumTexture2D);
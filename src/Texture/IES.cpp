@@ -0,0 +1,229 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Render/Distribution.hpp>
+#include <Piper/Render/Texture.hpp>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+PIPER_NAMESPACE_BEGIN
+
+// the candela table of the type C photometry in IES LM-63, the vertical angle is measured from the nadir and the horizontal angle
+// is measured counterclockwise from the C0 plane, both in degrees
+struct PhotometricTable final {
+    std::vector<Float> vertical;
+    std::vector<Float> horizontal;
+    std::vector<Float> candela;  // [horizontal][vertical]
+
+    // maps the horizontal angle in [0, 360) to the range covered by the table with its symmetry
+    [[nodiscard]] Float foldHorizontal(const Float c) const noexcept {
+        const auto first = horizontal.front(), last = horizontal.back();
+        if(first == 0.0f && last == 90.0f) {
+            const auto half = c > 180.0f ? 360.0f - c : c;
+            return half > 90.0f ? 180.0f - half : half;
+        }
+        if(first == 0.0f && last == 180.0f)
+            return c > 180.0f ? 360.0f - c : c;
+        if(first == 90.0f && last == 270.0f)
+            return c < 90.0f ? 180.0f - c : (c > 270.0f ? 540.0f - c : c);
+        return std::clamp(c, first, last);
+    }
+
+    // returns the index of the lower endpoint and the interpolation weight
+    static std::pair<uint32_t, Float> locate(const std::vector<Float>& angles, const Float x) noexcept {
+        const auto idx = static_cast<uint32_t>(
+            std::clamp<std::ptrdiff_t>(std::upper_bound(angles.cbegin(), angles.cend(), x) - angles.cbegin() - 1, 0,
+                                       static_cast<std::ptrdiff_t>(angles.size()) - 2));
+        const auto width = angles[idx + 1] - angles[idx];
+        return { idx, width > 0.0f ? std::clamp((x - angles[idx]) / width, 0.0f, 1.0f) : 0.0f };
+    }
+
+    [[nodiscard]] Float evaluate(const Float gamma, const Float c) const noexcept {
+        if(gamma < vertical.front() || gamma > vertical.back())
+            return 0.0f;
+        const auto stride = vertical.size();
+        const auto [v, tv] = locate(vertical, gamma);
+        const auto row = [&](const size_t h) {
+            const auto* values = candela.data() + h * stride;
+            return values[v] * (1.0f - tv) + values[v + 1] * tv;
+        };
+        if(horizontal.size() == 1)
+            return row(0);
+        const auto [h, th] = locate(horizontal, foldHorizontal(c));
+        return row(h) * (1.0f - th) + row(h + 1) * th;
+    }
+};
+
+static PhotometricTable loadIESFile(const std::string_view path) {
+    std::ifstream in{ std::string{ path } };
+    if(!in)
+        fatal(fmt::format("Failed to open IES file {}", path));
+
+    // the keywords before the TILT line are ignored
+    std::string line;
+    while(std::getline(in, line) && !line.starts_with("TILT"))
+        ;
+    if(!line.starts_with("TILT"))
+        fatal(fmt::format("Invalid IES file {}: missing TILT", path));
+    const auto tilt = line.find("INCLUDE") != std::string::npos;
+    if(!tilt && line.find("NONE") == std::string::npos)
+        warning(fmt::format("The tilt file of IES file {} is ignored", path));
+
+    std::string rest{ std::istreambuf_iterator<char>{ in }, std::istreambuf_iterator<char>{} };
+    std::replace(rest.begin(), rest.end(), ',', ' ');
+    std::istringstream stream{ rest };
+    const auto read = [&] {
+        Float val;
+        if(!(stream >> val))
+            fatal(fmt::format("Invalid IES file {}: unexpected end of data", path));
+        return val;
+    };
+
+    // the lamp-to-luminaire geometry, the count of pairs, the angles and the multiplying factors
+    if(tilt) {
+        read();
+        const auto pairs = static_cast<uint32_t>(read());
+        for(uint32_t idx = 0; idx < pairs * 2; ++idx)
+            read();
+    }
+
+    read();  // the number of lamps
+    read();  // the lumens per lamp
+    auto multiplier = read();
+    const auto verticalCount = static_cast<int32_t>(read());
+    const auto horizontalCount = static_cast<int32_t>(read());
+    const auto photometricType = static_cast<int32_t>(read());
+    for(uint32_t idx = 0; idx < 4; ++idx)  // the units type, the width, the length and the height
+        read();
+    multiplier *= read();  // the ballast factor
+    read();                // the future use (or the ballast-lamp photometric factor of the older versions)
+    read();                // the input watts
+
+    if(photometricType != 1)
+        fatal(fmt::format("Unsupported IES file {}: only the type C photometry is supported", path));
+    if(verticalCount < 2 || horizontalCount < 1)
+        fatal(fmt::format("Invalid IES file {}: {} vertical angles and {} horizontal angles", path, verticalCount, horizontalCount));
+
+    PhotometricTable table;
+    table.vertical.resize(verticalCount);
+    table.horizontal.resize(horizontalCount);
+    table.candela.resize(static_cast<size_t>(verticalCount) * horizontalCount);
+    for(auto& val : table.vertical)
+        val = read();
+    for(auto& val : table.horizontal)
+        val = read();
+    for(auto& val : table.candela)
+        val = std::fmax(read() * multiplier, 0.0f);
+
+    if(!std::is_sorted(table.vertical.cbegin(), table.vertical.cend()) ||
+       !std::is_sorted(table.horizontal.cbegin(), table.horizontal.cend()))
+        fatal(fmt::format("Invalid IES file {}: the angles are not ascending", path));
+    return table;
+}
+
+// The goniometric profile of the luminaires measured in the IES LM-63 format, the emission directions are sampled proportional to
+// the intensity by a piecewise constant distribution over the equirectangular mapping.
+// NOTICE: the nadir of the profile is -y and the C0 plane contains +x, the C90 plane contains +z
+template <typename Setting>
+class IESProfile final : public SphericalTexture<Setting> {
+    PIPER_IMPORT_SETTINGS();
+
+    Ref<SphericalTexture<Setting>> mColor;
+    PhotometricTable mTable;
+    Float mScale = 1.0f;
+    Float mMeanIntensity = 0.0f;
+    PiecewiseConstant2D mDistribution;
+
+    [[nodiscard]] Float profile(const glm::vec3& dir) const noexcept {
+        const auto gamma = std::acos(std::clamp(-dir.y, -1.0f, 1.0f)) * (180.0f * invPi);
+        auto c = std::atan2(dir.z, dir.x) * (180.0f * invPi);
+        if(c < 0.0f)
+            c += 360.0f;
+        return mTable.evaluate(gamma, c) * mScale;
+    }
+
+public:
+    explicit IESProfile(const Ref<ConfigNode>& node)
+        : mColor{ this->template make<SphericalTexture>(node->get("Color"sv)->as<Ref<ConfigNode>>()) },
+          mTable{ loadIESFile(node->get("Path"sv)->as<std::string_view>()) } {
+        if(const auto ptr = node->tryGet("Scale"sv))
+            mScale = (*ptr)->as<Float>();
+        // the peak of the normalized profile is 1, the color carries the strength
+        if(const auto ptr = node->tryGet("Normalize"sv); ptr && (*ptr)->as<bool>()) {
+            const auto peak = *std::max_element(mTable.candela.cbegin(), mTable.candela.cend());
+            if(peak > 0.0f)
+                mScale /= peak;
+        }
+        uint32_t width = 256;
+        if(const auto ptr = node->tryGet("DistributionResolution"sv))
+            width = std::max(2U, (*ptr)->as<uint32_t>());
+        const auto height = std::max(1U, width / 2);
+
+        // the cells take the maximum of the corners and the center, so the sharp cutoffs inside them are still sampled
+        std::pmr::vector<Float> function{ static_cast<size_t>(width) * height, context().globalAllocator };
+        Float sum = 0.0f;
+        const glm::vec2 size{ static_cast<Float>(width), static_cast<Float>(height) };
+        for(uint32_t y = 0; y < height; ++y) {
+            const auto sinPolar = std::sin((static_cast<Float>(y) + 0.5f) / size.y * pi);
+            for(uint32_t x = 0; x < width; ++x) {
+                const glm::vec2 base{ static_cast<Float>(x), static_cast<Float>(y) };
+                const auto center = profile(equirectangularToDirection((base + 0.5f) / size));
+                auto val = center;
+                for(const auto offset : { glm::vec2{ 0.0f, 0.0f }, glm::vec2{ 1.0f, 0.0f }, glm::vec2{ 0.0f, 1.0f }, glm::vec2{ 1.0f } })
+                    val = std::fmax(val, profile(equirectangularToDirection((base + offset) / size)));
+                function[static_cast<size_t>(y) * width + x] = std::fabs(val) * sinPolar;
+                sum += std::fabs(center) * sinPolar;
+            }
+        }
+        mDistribution = PiecewiseConstant2D{ std::move(function), width, height };
+        // the integral over the sphere is 2 pi^2 times the integral over [0,1]^2
+        mMeanIntensity = sum / (size.x * size.y) * 2.0f * pi * pi / fourPi;
+    }
+
+    Spectrum evaluate(const TextureEvaluateInfo& info, const Wavelength& sampledWavelength) const noexcept override {
+        return mColor->evaluate(info, sampledWavelength) * profile(equirectangularToDirection(info.texCoord));
+    }
+
+    [[nodiscard]] MonoSpectrum mean() const noexcept override {
+        return mColor->mean() * mMeanIntensity;
+    }
+
+    TextureSample<Setting> sample(SampleProvider& sampler, const Float t, const Wavelength& sampledWavelength) const noexcept override {
+        if(!(mDistribution.integral() > 0.0f))
+            return SphericalTexture<Setting>::sample(sampler, t, sampledWavelength);
+        const auto [texCoord, pdf] = mDistribution.sample(sampler.sampleVec2());
+        return TextureSample<Setting>{ Direction<FrameOfReference::Object>::fromRaw(equirectangularToDirection(texCoord)),
+                                       Rational<Spectrum, PdfType::Texture>::fromRaw(evaluate({ texCoord, t, 0U }, sampledWavelength)),
+                                       InversePdf<PdfType::Texture>::fromPdf(equirectangularSolidAnglePdf(texCoord, pdf)) };
+    }
+
+    [[nodiscard]] InversePdf<PdfType::Texture> inversePdf(const Direction<FrameOfReference::Object>& dir,
+                                                          const Float t) const noexcept override {
+        if(!(mDistribution.integral() > 0.0f))
+            return SphericalTexture<Setting>::inversePdf(dir, t);
+        const auto texCoord = directionToEquirectangular(dir.raw());
+        return InversePdf<PdfType::Texture>::fromPdf(equirectangularSolidAnglePdf(texCoord, mDistribution.pdf(texCoord)));
+    }
+};
+
+PIPER_REGISTER_VARIANT_IMPL("IES", IESProfile, SphericalTexture, IESProfile);
+
+PIPER_NAMESPACE_END
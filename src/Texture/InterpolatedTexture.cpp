@@ -25,22 +25,33 @@
 PIPER_NAMESPACE_BEGIN
 
 template <typename T>
-class InterpolatedTexture : public T {
+class InterpolatedTexture : public T, public TimeVaryingTexture {
     std::pmr::vector<std::tuple<Float, InterpolationCurve, Ref<T>>> mKeyFrames{ context().globalAllocator };
 
-    [[nodiscard]] std::tuple<T*, T*, Float> select(const Float t) const noexcept {
-        auto iter = std::lower_bound(mKeyFrames.cbegin(), mKeyFrames.cend(), t, [](const auto& lhs, const Float rhs) {
-            const auto& [lt, type, ref] = lhs;
-            return lt < rhs;
-        });
-
-        if(iter == mKeyFrames.cend())
-            iter = std::prev(mKeyFrames.cend());
+    // the segments overlapping the shutter interval of the current frame, the interval is empty before the first frame
+    TimeInterval mPrepared{ 1.0f, 0.0f };
+    uint32_t mFirstSegment = 0;
+    uint32_t mLastSegment = 0;
+
+    // the last keyframe in [first, last] at or before t
+    [[nodiscard]] uint32_t locate(const uint32_t first, const uint32_t last, const Float t) const noexcept {
+        const auto begin = mKeyFrames.cbegin() + first;
+        const auto iter = std::upper_bound(begin, mKeyFrames.cbegin() + last + 1, t,
+                                           [](const Float lhs, const auto& rhs) { return lhs < std::get<Float>(rhs); });
+        return iter == begin ? first : static_cast<uint32_t>(iter - mKeyFrames.cbegin()) - 1;
+    }
 
-        const auto& [bt, bc, bTexture] = *iter;
-        if(bc == InterpolationCurve::Hold || std::next(iter) == mKeyFrames.cend())
+    [[nodiscard]] std::tuple<T*, T*, Float> select(const Float t) const noexcept {
+        auto idx = mFirstSegment;
+        if(t < mPrepared.begin || t > mPrepared.end)
+            idx = locate(0, static_cast<uint32_t>(mKeyFrames.size()) - 1, t);
+        else if(mFirstSegment != mLastSegment)
+            idx = locate(mFirstSegment, mLastSegment, t);
+
+        const auto& [bt, bc, bTexture] = mKeyFrames[idx];
+        if(bc == InterpolationCurve::Hold || idx + 1 == mKeyFrames.size() || t <= bt)
             return { bTexture.get(), bTexture.get(), 0.0f };
-        const auto& [et, ec, eTexture] = *std::next(iter);
+        const auto& [et, ec, eTexture] = mKeyFrames[idx + 1];
         return { bTexture.get(), eTexture.get(), (t - bt) / (et - bt) };
     }
 
@@ -60,6 +71,13 @@ public:
         }
     }
 
+    void prepare(const TimeInterval interval) noexcept override {
+        const auto last = static_cast<uint32_t>(mKeyFrames.size()) - 1;
+        mFirstSegment = locate(0, last, interval.begin);
+        mLastSegment = locate(mFirstSegment, last, interval.end);
+        mPrepared = interval;
+    }
+
     template <typename Callable, typename Mixer>
     auto evaluateImpl(Callable&& callable, Mixer&& mixer, const Float t) const noexcept {
         auto [a, b, u] = select(t);
@@ -152,6 +170,10 @@ public:
                                   },
                                   info.t);
     }
+
+    [[nodiscard]] RGBSpectrum estimateRGB(const TextureEvaluateInfo& info) const noexcept override {
+        return this->evaluateImpl([&](const SpectrumTexture2D<Setting>* tex) { return tex->estimateRGB(info); }, info.t);
+    }
 };
 
 PIPER_REGISTER_VARIANT_IMPL("InterpolatedTexture", InterpolatedSpectrumTexture2D, SpectrumTexture2D, InterpolatedSpectrumTexture2D);
@@ -171,9 +193,24 @@ public:
         return this->meanImpl([](const SphericalTexture<Setting>* tex) { return tex->mean(); });
     }
 
+    // the direction is sampled by one of the keyframes, but the value and the pdf are of the mixture
     TextureSample<Setting> sample(SampleProvider& sampler, const Float t, const Wavelength& sampledWavelength) const noexcept override {
-        return this->sampleImpl(
-            sampler, [&](const SphericalTexture<Setting>* tex) { return tex->sample(sampler, t, sampledWavelength); }, t);
+        const auto dir = this->sampleImpl(
+            sampler, [&](const SphericalTexture<Setting>* tex) { return tex->sample(sampler, t, sampledWavelength).dir; }, t);
+        return TextureSample<Setting>{ dir,
+                                       Rational<Spectrum, PdfType::Texture>::fromRaw(
+                                           evaluate({ this->dir2TexCoord(dir), t, 0U }, sampledWavelength)),
+                                       inversePdf(dir, t) };
+    }
+
+    [[nodiscard]] InversePdf<PdfType::Texture> inversePdf(const Direction<FrameOfReference::Object>& dir,
+                                                          const Float t) const noexcept override {
+        return InversePdf<PdfType::Texture>::fromPdf(this->evaluateImpl(
+            [&](const SphericalTexture<Setting>* tex) {
+                const auto val = tex->inversePdf(dir, t);
+                return val.valid() ? rcp(val.raw()) : 0.0f;
+            },
+            t));
     }
 };
 
@@ -34,6 +34,10 @@ public:
     Float evaluate(const TextureEvaluateInfo&) const noexcept override {
         return mValue;
     }
+
+    [[nodiscard]] std::optional<Float> constantValue() const noexcept override {
+        return mValue;
+    }
 };
 
 PIPER_REGISTER_CLASS_IMPL("MonoSpectrumTexture", MonoSpectrumTextureScalar, ScalarTexture2D, MonoSpectrumTextureScalar);
@@ -0,0 +1,170 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifdef PIPER_WITH_PTEX
+#include <Piper/Core/Report.hpp>
+#include <Piper/Core/Stats.hpp>
+#include <Piper/Render/ColorSpace.hpp>
+#include <Piper/Render/SpectrumUtil.hpp>
+#include <Piper/Render/Texture.hpp>
+#include <array>
+#pragma warning(push, 0)
+#include <Ptexture.h>
+#pragma warning(pop)
+
+PIPER_NAMESPACE_BEGIN
+
+// The files and the decoded face data of all Ptex textures share the cache of Ptex, which keeps them within the budget and
+// lives until the process exits. The faces are loaded on demand, so the texels of the untouched faces are never read.
+static Ptex::PtexCache& ptexCache() {
+    static Ptex::PtexCache* const cache = [] {
+        constexpr int maxFiles = 256;
+        return Ptex::PtexCache::create(maxFiles, RenderGlobalSetting::get().ptexCacheBudget, /* premultiply */ false);
+    }();
+    return *cache;
+}
+
+// The lookups are addressed by the face index (the primitive index of the shape) and the local coordinates in the face, which
+// are the barycentric coordinates for the triangle meshes and the quad parameterization for the subdivision surfaces. The
+// faces must not be split by the importer, otherwise the face indices of the shape do not match the file.
+// NOTICE: the footprints of the ray cones are measured in the UV space instead of the faces, so the finest resolution of the
+// faces is filtered. The filters of Ptex are thread-safe, so one filter is shared by all threads.
+class PtexLookup final {
+    Ptex::PtexTexture* mTexture = nullptr;
+    Ptex::PtexFilter* mFilter = nullptr;
+    uint32_t mChannels;
+    int32_t mFaces;
+    std::optional<ColorSpaceConverter> mConverter;
+
+public:
+    explicit PtexLookup(const Ref<ConfigNode>& node) {
+        const auto path = node->get("FilePath"sv)->as<std::string_view>();
+        Ptex::String error;
+        mTexture = ptexCache().get(std::string{ path }.c_str(), error);
+        if(!mTexture)
+            fatal(fmt::format("Failed to open Ptex texture \"{}\": {}", path, error.c_str()));
+        mChannels = static_cast<uint32_t>(std::min(mTexture->numChannels(), 4));
+        mFaces = mTexture->numFaces();
+
+        auto filter = Ptex::PtexFilter::f_bilinear;
+        if(const auto ptr = node->tryGet("Filter"sv)) {
+            const auto name = (*ptr)->as<std::string_view>();
+            if(name == "Point"sv)
+                filter = Ptex::PtexFilter::f_point;
+            else if(name == "Gaussian"sv)
+                filter = Ptex::PtexFilter::f_gaussian;
+            else if(name != "Bilinear"sv)
+                fatal(fmt::format("Unrecognized Ptex filter \"{}\"", name));
+        }
+        mFilter = Ptex::PtexFilter::getFilter(mTexture, Ptex::PtexFilter::Options{ filter });
+
+        if(const auto ptr = node->tryGet("ColorSpace"sv))
+            mConverter = getRGB2StandardLinearRGBConverter((*ptr)->as<std::string_view>());
+    }
+    PtexLookup(const PtexLookup&) = delete;
+    PtexLookup& operator=(const PtexLookup&) = delete;
+    ~PtexLookup() {
+        mFilter->release();
+        mTexture->release();
+    }
+
+    // the missing channels are replicated from the first one, and the faces out of the file are black
+    void texture(const TextureEvaluateInfo& info, const uint32_t channels, Float* res) const noexcept {
+        Counter<StatsType::Texture2D>::count();
+        const auto face = static_cast<int32_t>(info.primitiveIdx);
+        if(face >= mFaces) {
+            std::fill_n(res, channels, 0.0f);
+            return;
+        }
+
+        std::array<float, 4> value{};
+        mFilter->eval(value.data(), 0, static_cast<int>(mChannels), face, info.faceUV.x, info.faceUV.y, 0.0f, 0.0f, 0.0f, 0.0f);
+        if(mChannels == 1)
+            value[2] = value[1] = value[0];
+        if(mConverter && mChannels >= 3)
+            mConverter->apply(value.data(), 1, mChannels);
+        std::copy_n(value.data(), channels, res);
+    }
+};
+
+class PtexScalar final : public ScalarTexture2D {
+    PtexLookup mLookup;
+
+public:
+    explicit PtexScalar(const Ref<ConfigNode>& node) : mLookup{ node } {}
+
+    Float evaluate(const TextureEvaluateInfo& info) const noexcept override {
+        Float res;
+        mLookup.texture(info, 1, &res);
+        return res;
+    }
+};
+
+PIPER_REGISTER_CLASS_IMPL("Ptex", PtexScalar, ScalarTexture2D, PtexScalar);
+
+template <typename Setting>
+class PtexSpectrumTexture final : public SpectrumTexture2D<Setting> {
+    PIPER_IMPORT_SETTINGS();
+
+    PtexLookup mLookup;
+
+    [[nodiscard]] RGBSpectrum rgb(const TextureEvaluateInfo& info) const noexcept {
+        RGBSpectrum res = RGBSpectrum::undefined();
+        static_assert(sizeof(RGBSpectrum) == 3 * sizeof(Float));
+        mLookup.texture(info, 3, reinterpret_cast<Float*>(&res));
+        return res;
+    }
+
+public:
+    explicit PtexSpectrumTexture(const Ref<ConfigNode>& node) : mLookup{ node } {}
+
+    Spectrum evaluate(const TextureEvaluateInfo& info, const Wavelength& sampledWavelength) const noexcept override {
+        if constexpr(std::is_same_v<Spectrum, MonoSpectrum>) {
+            MonoSpectrum res;
+            mLookup.texture(info, 1, &res);
+            return res;
+        } else if constexpr(std::is_same_v<Spectrum, RGBSpectrum>)
+            return rgb(info);
+        else
+            return spectrumCast<Spectrum>(rgb(info), sampledWavelength);
+    }
+
+    [[nodiscard]] std::pair<bool, Float> evaluateOneWavelength(const TextureEvaluateInfo& info,
+                                                               const Float wavelength) const noexcept override {
+        if constexpr(std::is_same_v<Spectrum, MonoSpectrum>) {
+            MonoSpectrum res;
+            mLookup.texture(info, 1, &res);
+            return { false, res };
+        } else
+            return { true, Impl::fromRGB(rgb(info), wavelength) };
+    }
+
+    [[nodiscard]] RGBSpectrum estimateRGB(const TextureEvaluateInfo& info) const noexcept override {
+        if constexpr(isSampledSpectrum<Spectrum>)
+            return rgb(info);
+        else
+            return SpectrumTexture2D<Setting>::estimateRGB(info);
+    }
+};
+
+PIPER_REGISTER_VARIANT_IMPL("Ptex", PtexSpectrumTexture, SpectrumTexture2D, PtexSpectrumTexture);
+
+PIPER_NAMESPACE_END
+#endif
@@ -20,37 +20,68 @@
 
 #include <Piper/Render/ColorMatchingFunction.hpp>
 #include <Piper/Render/ColorSpace.hpp>
+#include <Piper/Render/SpectralLUTUtil.hpp>
 #include <Piper/Render/Texture.hpp>
+#include <array>
 
 PIPER_NAMESPACE_BEGIN
 
+// The measured spectrum is resampled once onto the 1nm grid, so that a lookup is an indexed lerp instead of a binary search.
 class SampledSpectrumTextureScalar final : public ScalarTexture2D {
-    std::pmr::vector<glm::vec2> mLUT{ context().globalAllocator };  // wavelength, measurement
+    std::array<Float, spectralLUTSize> mTable{};
+    // the measurement is constant below the first measured wavelength
+    Float mVaryingBegin = std::numeric_limits<Float>::infinity();
     Float mMean = 0.0f;
 
+    static Float interpolate(const std::pmr::vector<glm::vec2>& lut, const Float wavelength) noexcept {
+        const auto idx = static_cast<int32_t>(
+            std::lower_bound(lut.cbegin(), lut.cend(), wavelength, [](const glm::vec2 lhs, const Float rhs) { return lhs.x < rhs; }) -
+            lut.cbegin());
+        const auto idx1 = std::clamp(idx, 0, static_cast<int32_t>(lut.size()) - 1);
+        const auto idx0 = std::max(idx1 - 1, 0);
+        if(idx0 == idx1)
+            return lut[idx0].y;
+        return glm::mix(lut[idx0].y, lut[idx1].y, (wavelength - lut[idx0].x) / (lut[idx1].x - lut[idx0].x));
+    }
+
 public:
     explicit SampledSpectrumTextureScalar(const Ref<ConfigNode>& node) {
-        auto& arr = node->get("Array"sv)->as<ConfigAttr::AttrArray>();
-        mLUT.reserve(arr.size());
-        for(auto& item : arr)
-            mLUT.push_back(parseVec2(item));
-        std::ranges::sort(mLUT, [](const glm::vec2 lhs, const glm::vec2 rhs) { return lhs.x < rhs.x; });
+        std::pmr::vector<glm::vec2> lut{ context().localAllocator };  // wavelength, measurement
+        const auto samples = parseFloats(node->get("Array"sv), 2, context().localAllocator);
+        lut.reserve(samples.size() / 2);
+        for(size_t idx = 0; idx < samples.size(); idx += 2)
+            lut.emplace_back(samples[idx], samples[idx + 1]);
+        std::ranges::sort(lut, [](const glm::vec2 lhs, const glm::vec2 rhs) { return lhs.x < rhs.x; });
 
         // TODO: use numerical integration?
-        for(const auto& item : mLUT)
+        for(const auto& item : lut)
             mMean += item.y;
-        mMean /= static_cast<Float>(mLUT.size());
+        mMean /= static_cast<Float>(lut.size());
+
+        for(int32_t idx = 0; idx < spectralLUTSize; ++idx)
+            mTable[idx] = interpolate(lut, static_cast<Float>(wavelengthMin + idx));
+        if(lut.size() > 1)
+            mVaryingBegin = lut.front().x;
+    }
+
+    [[nodiscard]] Float lookup(const Float wavelength) const noexcept {
+        const auto offset = std::clamp(wavelength - static_cast<Float>(wavelengthMin), 0.0f, static_cast<Float>(spectralLUTSize - 1));
+        const auto idx0 = std::min(static_cast<int32_t>(offset), spectralLUTSize - 2);
+        const auto u = offset - static_cast<Float>(idx0);
+        return mTable[idx0] * (1.0f - u) + mTable[idx0 + 1] * u;
+    }
+
+    // all wavelengths are looked up at once, the independent lerps are vectorized by the compiler
+    template <typename VecType>
+    [[nodiscard]] VecType lookup(const VecType& wavelengths) const noexcept {
+        VecType res;
+        for(int32_t idx = 0; idx < static_cast<int32_t>(VecType::length()); ++idx)
+            res[idx] = lookup(wavelengths[idx]);
+        return res;
     }
 
     [[nodiscard]] std::pair<bool, Float> evaluateOneWavelength(const TextureEvaluateInfo&, const Float wavelength) const noexcept override {
-        const auto idx = static_cast<int32_t>(
-            std::lower_bound(mLUT.cbegin(), mLUT.cend(), wavelength, [](const glm::vec2 lhs, const Float rhs) { return lhs.x < rhs; }) -
-            mLUT.cbegin());
-        const auto idx1 = std::clamp(idx, 0, static_cast<int32_t>(mLUT.size()) - 1);
-        const auto idx0 = std::max(idx1 - 1, 0);
-        if(idx0 == idx1)
-            return { false, mLUT[idx0].y };
-        return { true, glm::mix(mLUT[idx0].y, mLUT[idx1].y, (wavelength - mLUT[idx0].x) / (mLUT[idx1].x - mLUT[idx0].x)) };
+        return { wavelength > mVaryingBegin, lookup(wavelength) };
     }
 
     Float evaluate(const TextureEvaluateInfo&) const noexcept override {
@@ -81,21 +112,14 @@ public:
     }
 
     Spectrum evaluate(const Wavelength& sampledWavelength) const noexcept override {
-        if constexpr(std::is_same_v<Spectrum, SampledSpectrum>) {
-            const auto lambdas = sampledWavelength.raw();
-
-            SampledSpectrum::VecType measurement;
-
-            for(int32_t idx = 0; idx < SampledSpectrum::nSamples; ++idx)
-                measurement[idx] = mImpl.evaluateOneWavelength({}, lambdas[idx]).second;
-
-            return Spectrum::fromRaw(measurement);
+        if constexpr(isSampledSpectrum<Spectrum>) {
+            return Spectrum::fromRaw(mImpl.lookup(sampledWavelength.raw()));
         } else if constexpr(std::is_same_v<Spectrum, MonoSpectrum>) {
             return mImpl.evaluate({});
         } else if constexpr(std::is_same_v<Spectrum, RGBSpectrum>) {
             return mRGBSpectrum;
         } else {
-            return Spectrum::fromRaw(mImpl.evaluateOneWavelength({}, sampledWavelength.raw()).second);
+            return Spectrum::fromRaw(mImpl.lookup(sampledWavelength.raw()));
         }
     }
 
@@ -0,0 +1,60 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Render/Texture.hpp>
+#include <mutex>
+
+PIPER_NAMESPACE_BEGIN
+
+struct SharedTextureCache final {
+    std::mutex mutex;
+    std::unordered_map<std::string, Ref<ConfigNode>> files;
+    std::unordered_map<std::string, Ref<RefCountBase>> textures;
+};
+
+static SharedTextureCache& getSharedTextureCache() {
+    // never destroyed, since releasing the textures requires the thread-local context
+    static auto* inst = new SharedTextureCache;
+    return *inst;
+}
+
+Ref<RefCountBase> Impl::loadSharedTexture(const std::string_view name, const std::string_view attr, const size_t type,
+                                          Ref<RefCountBase> (*make)(const Ref<ConfigNode>& node)) {
+    auto& cache = getSharedTextureCache();
+    const auto path = resolvePath(name);
+    auto key = fmt::format("{}#{}#{:x}", path, attr, type);
+
+    // the files are small, so they are loaded under the lock to guarantee that each one is loaded once
+    std::lock_guard guard{ cache.mutex };
+    if(const auto iter = cache.textures.find(key); iter != cache.textures.cend())
+        return iter->second;
+
+    auto& file = cache.files[path];
+    if(!file) {
+        const ResolveConfiguration configuration;
+        file = parseJSONConfigNode(path, configuration);
+    }
+
+    auto texture = make(file->get(attr)->as<Ref<ConfigNode>>());
+    cache.textures.emplace(std::move(key), texture);
+    return texture;
+}
+
+PIPER_NAMESPACE_END
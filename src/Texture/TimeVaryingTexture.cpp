@@ -0,0 +1,58 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Render/Texture.hpp>
+#include <mutex>
+#include <unordered_set>
+
+PIPER_NAMESPACE_BEGIN
+
+struct TimeVaryingTextureRegistry final {
+    std::mutex mutex;
+    std::unordered_set<TimeVaryingTexture*> textures;
+};
+
+static TimeVaryingTextureRegistry& getTimeVaryingTextureRegistry() {
+    // never destroyed, since the shared textures may be released after the static objects
+    static auto* inst = new TimeVaryingTextureRegistry;
+    return *inst;
+}
+
+TimeVaryingTexture::TimeVaryingTexture() {
+    auto& registry = getTimeVaryingTextureRegistry();
+    std::lock_guard guard{ registry.mutex };
+    registry.textures.insert(this);
+}
+
+TimeVaryingTexture::~TimeVaryingTexture() {
+    auto& registry = getTimeVaryingTextureRegistry();
+    std::lock_guard guard{ registry.mutex };
+    registry.textures.erase(this);
+}
+
+bool prepareTimeVaryingTextures(const TimeInterval interval) {
+    auto& registry = getTimeVaryingTextureRegistry();
+    std::lock_guard guard{ registry.mutex };
+    for(const auto texture : registry.textures)
+        texture->prepare(interval);
+    return !registry.textures.empty();
+}
+
+PIPER_NAMESPACE_END
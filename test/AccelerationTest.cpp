@@ -0,0 +1,103 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Render/Acceleration.hpp>
+#include <Piper/Render/Intersection.hpp>
+#include <Piper/Render/Shape.hpp>
+#include <Piper/Render/TestUtil.hpp>
+
+PIPER_NAMESPACE_BEGIN
+
+Ref<AccelerationBuilder> createEmbreeBackend(const BuildSettings& sceneSettings, const BuildSettings& shapeSettings);
+
+// only the compact hit records and the occlusion queries are tested, so the surface attributes are never generated
+class NullShape final : public Shape {
+public:
+    Intersection generateIntersection(const Ray&, Distance, const AffineTransform<FrameOfReference::Object, FrameOfReference::World>&,
+                                      const Normal<FrameOfReference::World>&, glm::vec2, uint32_t) const noexcept override {
+        return std::monostate{};
+    }
+    void updateTransform(const KeyFrames&, TimeInterval) override {}
+    PrimitiveGroup* primitiveGroup() const noexcept override {
+        return nullptr;
+    }
+};
+
+// the coarse level lies below the fine one, as if the simplification shrank the surface. A shadow ray leaving the coarse level
+// towards the fine one must not be blocked by it.
+TEST(Acceleration, LODShadowRaysStayOnTheirLevel) {
+    const MemoryArena arena;
+    constexpr BuildSettings settings{ BuildQuality::Medium, false, false, false };
+    const auto builder = createEmbreeBackend(settings, settings);
+
+    // NOTICE: the vertex buffers are padded, since they must be readable for 4 more bytes past the last vertex
+    const std::array<glm::vec3, 5> fineVertices{ glm::vec3{ -1.0f, -1.0f, 0.0f }, glm::vec3{ 1.0f, -1.0f, 0.0f },
+                                                 glm::vec3{ 1.0f, 1.0f, 0.0f }, glm::vec3{ -1.0f, 1.0f, 0.0f }, glm::vec3{ 0.0f } };
+    const std::array<glm::vec3, 5> coarseVertices{ glm::vec3{ -1.0f, -1.0f, -0.1f }, glm::vec3{ 1.0f, -1.0f, -0.1f },
+                                                   glm::vec3{ 1.0f, 1.0f, -0.1f }, glm::vec3{ -1.0f, 1.0f, -0.1f }, glm::vec3{ 0.0f } };
+    const std::array<glm::uvec3, 2> indices{ glm::uvec3{ 0, 1, 2 }, glm::uvec3{ 0, 2, 3 } };
+
+    const NullShape shape;
+    const std::array<DetailLevel, 2> levels{
+        DetailLevel{ builder->buildFromTriangleMesh({ fineVertices.data(), 4 }, indices, settings), &shape, 0.5f },
+        DetailLevel{ builder->buildFromTriangleMesh({ coarseVertices.data(), 4 }, indices, settings), &shape, 2.0f }
+    };
+    const auto group = builder->buildLODInstance(levels, 1.0f);
+
+    ShutterKeyFrames transform{ context().globalAllocator };
+    transform.push_back(SRTTransform{ glm::vec3{ 1.0f }, glm::identity<glm::quat>(), glm::vec3{ 0.0f } });
+    group->updateTransform(transform);
+    group->commit();
+
+    const auto scene = builder->buildScene(std::pmr::vector<PrimitiveGroup*>{ { group.get() }, context().globalAllocator });
+    ASSERT_TRUE(scene->commit());
+    scene->swap();
+
+    // a wide cone selects the coarse level
+    RayStream primary{ context().globalAllocator };
+    primary.push_back(Ray{ Point<FrameOfReference::World>::fromRaw({ 0.2f, 0.3f, 5.0f }),
+                           Direction<FrameOfReference::World>::fromRaw({ 0.0f, 0.0f, -1.0f }), 0.0f, 1e3f, 0.0f });
+    const auto hits = scene->traceHits(primary, false);
+    ASSERT_TRUE(hits.front().valid());
+    ASSERT_EQ(hits.front().levelIdx, 1U);
+    ASSERT_NEAR(hits.front().distance, 5.1f, 1e-3f);
+
+    const auto origin = Point<FrameOfReference::World>::fromRaw({ 0.2f, 0.3f, -0.1f + 1e-3f });
+    const auto up = Direction<FrameOfReference::World>::fromRaw({ 0.0f, 0.0f, 1.0f });
+    const auto distance = Distance::fromRaw(10.0f);
+
+    // the shadow ray without a cone would traverse the finest level
+    ASSERT_TRUE(scene->occluded(Ray{ origin, up, 0.0f }, distance));
+
+    // the ray spawned from the coarse hit stays on the coarse level, with both single and batched queries
+    const Ray shadowRay{ origin, up, 0.0f, 0.0f, 0.0f, hits.front().instID, hits.front().levelIdx };
+    ASSERT_FALSE(scene->occluded(shadowRay, distance));
+
+    RayStream shadowRays{ context().globalAllocator };
+    shadowRays.push_back(shadowRay);
+    const std::pmr::vector<Distance> distances{ { distance }, context().globalAllocator };
+    ASSERT_FALSE(scene->occluded(shadowRays, distances).front());
+
+    // a ray pinned to the finest level still hits it
+    const Ray downRay{ Point<FrameOfReference::World>::fromRaw({ 0.2f, 0.3f, 5.0f }), -up, 0.0f, 0.0f, 0.0f, hits.front().instID, 0 };
+    ASSERT_TRUE(scene->occluded(downRay, Distance::fromRaw(5.05f)));
+}
+
+PIPER_NAMESPACE_END
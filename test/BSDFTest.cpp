@@ -377,19 +377,26 @@ static void testBSDF(const std::string_view name, const Normal<FrameOfReference:
     testEnergyConservation(name, normal, bsdf, specular);
 }
 
+static SurfaceHit makeTestHit(const Ref<Material<RSSMono>>& mat) {
+    return SurfaceHit{ Point<FrameOfReference::World>::fromRaw(glm::zero<glm::vec3>()),
+                       Distance::fromRaw(10.0f),
+                       Normal<FrameOfReference::World>::fromRaw(glm::vec3{ 0.0f, 1.0f, 0.0f }),
+                       Normal<FrameOfReference::World>::fromRaw(glm::vec3{ 0.0f, 1.0f, 0.0f }),
+                       Direction<FrameOfReference::World>::fromRaw(glm::vec3{ 1.0f, 0.0f, 0.0f }),
+                       0,
+                       glm::zero<glm::vec2>(),
+                       glm::zero<glm::vec2>(),
+                       0.0f,
+                       0.0f,
+                       0.0f,
+                       Handle<Material>{ mat.get() } };
+}
+
 static void testBSDF(const std::string_view name, const std::string_view config, const bool specular = false) {
     FloatingPointExceptionProbe::on();
 
     const auto mat = getStaticFactory().make<Material<RSSMono>>(parseJSONConfigNodeFromStr(config, {}));
-    SurfaceHit hit{ Point<FrameOfReference::World>::fromRaw(glm::zero<glm::vec3>()),
-                    Distance::fromRaw(10.0f),
-                    Normal<FrameOfReference::World>::fromRaw(glm::vec3{ 0.0f, 1.0f, 0.0f }),
-                    Normal<FrameOfReference::World>::fromRaw(glm::vec3{ 0.0f, 1.0f, 0.0f }),
-                    Direction<FrameOfReference::World>::fromRaw(glm::vec3{ 1.0f, 0.0f, 0.0f }),
-                    0,
-                    glm::zero<glm::vec2>(),
-                    0.0f,
-                    Handle<Material>{ mat.get() } };
+    auto hit = makeTestHit(mat);
 
     const auto bsdf = mat->evaluate(std::monostate{}, hit);
     testBSDF(name, hit.shadingNormal, bsdf, specular);
@@ -426,6 +433,84 @@ static void testBSDF(const std::string_view name, const std::string_view config,
     FloatingPointExceptionProbe::off();
 }
 
+// the fused overrides must agree with the separate calls
+static void testEvaluateWithPdf(const std::string_view name, const std::string_view config) {
+    constexpr uint32_t sampleCount = 1 << 16;
+    constexpr Float tolerance = 1e-4f;
+    FloatingPointExceptionProbe::on();
+
+    const auto mat = getStaticFactory().make<Material<RSSMono>>(parseJSONConfigNodeFromStr(config, {}));
+    const auto hit = makeTestHit(mat);
+    const auto bsdf = mat->evaluate(std::monostate{}, hit);
+    auto& sampler = getTestSampler();
+
+    const auto isClose = [&](const Float a, const Float b) { return std::fabs(a - b) <= tolerance * std::fmax(1.0f, std::fabs(a)); };
+
+    for(uint32_t idx = 0; idx < sampleCount; ++idx) {
+        const auto wo = sampleUniformSphere<FrameOfReference::World>(sampler.sampleVec2());
+        // mix the sampled directions with the uniform ones to cover both the lobes and the tails
+        const auto sample = bsdf.sample(sampler, wo, TransportMode::Radiance);
+        const auto wi = (idx & 1) && sample.valid() ? sample.wi : sampleUniformSphere<FrameOfReference::World>(sampler.sampleVec2());
+
+        for(const auto mode : { TransportMode::Radiance, TransportMode::Importance }) {
+            const auto f = bsdf.evaluate(wo, wi, mode);
+            const auto inversePdf = bsdf.pdf(wo, wi, mode);
+            const auto [fusedF, fusedInversePdf] = bsdf.evaluateWithPdf(wo, wi, mode);
+
+            ASSERT_TRUE(isClose(f.raw(), fusedF.raw())) << " name " << name << " f " << f.raw() << " fused " << fusedF.raw();
+            ASSERT_EQ(inversePdf.valid(), fusedInversePdf.valid()) << " name " << name << " iteration " << idx;
+            if(inversePdf.valid())
+                ASSERT_TRUE(isClose(inversePdf.raw(), fusedInversePdf.raw()))
+                    << " name " << name << " inverse pdf " << inversePdf.raw() << " fused " << fusedInversePdf.raw();
+        }
+    }
+
+    FloatingPointExceptionProbe::off();
+}
+
+TEST(BSDF, EvaluateWithPdfDielectric) {
+    testEvaluateWithPdf("Dielectric", R"(
+{
+    "Type": "Dielectric",
+    "Material": "GlassBK7",
+    "RoughnessU": 0.3,
+    "RoughnessV": 0.5,
+    "RemapRoughness": true
+}
+)");
+}
+
+TEST(BSDF, EvaluateWithPdfConductor) {
+    testEvaluateWithPdf("Conductor", R"(
+{
+    "Type": "Conductor",
+    "Material": "Cu",
+    "RoughnessU": 0.3,
+    "RoughnessV": 0.5,
+    "RemapRoughness": true
+}
+)");
+}
+
+TEST(BSDF, EvaluateWithPdfMixed) {
+    testEvaluateWithPdf("Mixed", R"(
+{
+    "Type": "MixedMaterial",
+    "MaterialA": {
+        "Type": "Dielectric",
+        "Material": "GlassBK7",
+        "Roughness": 0.3
+    },
+    "MaterialB": {
+        "Type": "Conductor",
+        "Material": "Cu",
+        "Roughness": 0.2
+    },
+    "Weight": 0.3
+}
+)");
+}
+
 TEST(BSDF, Diffuse) {
     testBSDF("Diffuse", R"(
 {
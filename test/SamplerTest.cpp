@@ -0,0 +1,185 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/StaticFactory.hpp>
+#include <Piper/Render/Sampler.hpp>
+#include <Piper/Render/TestUtil.hpp>
+#include <algorithm>
+
+PIPER_NAMESPACE_BEGIN
+
+constexpr uint32_t testResolution = 64;
+// the pair 0 is the pixel sample, the others are the consecutive dimensions of the sample provider
+constexpr uint32_t testPairs = 4;
+
+static Ref<TileSampler> prepareTestSampler(const std::string_view config) {
+    const auto sampler = getStaticFactory().make<Sampler>(parseJSONConfigNodeFromStr(config, {}));
+    return sampler->prepare(0, testResolution, testResolution, 1);
+}
+
+// res[pair][sampleIdx]
+static std::vector<std::vector<glm::vec2>> collectPixelSamples(const TileSampler& tileSampler, const uint32_t filmX, const uint32_t filmY,
+                                                                const uint32_t sampleCount) {
+    std::vector<std::vector<glm::vec2>> res(testPairs, std::vector<glm::vec2>(sampleCount));
+    for(uint32_t idx = 0; idx < sampleCount; ++idx) {
+        ArenaRewindScope scope;
+        auto [pixelSample, provider] = tileSampler.generate(filmX, filmY, idx);
+        res[0][idx] = pixelSample - glm::vec2{ filmX, filmY };
+        for(uint32_t pair = 1; pair < testPairs; ++pair)
+            res[pair][idx] = provider.sampleVec2();
+    }
+    return res;
+}
+
+// the maximum number of points in the elementary intervals of the volume 1/2^logCount
+// NOTICE: the points within the float rounding error of a cell boundary are skipped since the conversion may round them across
+static uint32_t maxPointsPerElementaryInterval(const std::vector<glm::vec2>& points, const uint32_t logCount) {
+    constexpr auto eps = 0x1p-20f;
+    const auto ambiguous = [&](const Float x, const uint32_t logCells) {
+        const auto scaled = x * static_cast<Float>(1U << logCells);
+        return std::fabs(scaled - std::round(scaled)) < eps * static_cast<Float>(1U << logCells);
+    };
+
+    uint32_t res = 0;
+    for(uint32_t logX = 0; logX <= logCount; ++logX) {
+        const auto logY = logCount - logX;
+        std::vector<uint32_t> cells(1ULL << logCount);
+        for(const auto p : points) {
+            if(ambiguous(p.x, logX) || ambiguous(p.y, logY))
+                continue;
+            const auto x = static_cast<uint32_t>(p.x * static_cast<Float>(1U << logX));
+            const auto y = static_cast<uint32_t>(p.y * static_cast<Float>(1U << logY));
+            res = std::max(res, ++cells[(y << logX) | x]);
+        }
+    }
+    return res;
+}
+
+// the maximum gap between the neighboring values on the unit circle
+static Float maxCircularGap(const std::vector<glm::vec2>& points, const int32_t axis) {
+    std::vector<Float> values(points.size());
+    std::ranges::transform(points, values.begin(), [axis](const glm::vec2 p) { return p[axis]; });
+    std::ranges::sort(values);
+    auto res = values.front() + 1.0f - values.back();
+    for(size_t idx = 1; idx < values.size(); ++idx)
+        res = std::max(res, values[idx] - values[idx - 1]);
+    return res;
+}
+
+// the estimators averaged over the whole image must converge to the exact integrals
+static void testUnbiased(const std::string_view name, const TileSampler& tileSampler, const uint32_t sampleCount) {
+    struct Integrand final {
+        std::string_view name;
+        Float (*f)(glm::vec2);
+        double expected;
+    };
+    const Integrand integrands[] = {
+        { "Bilinear", [](const glm::vec2 p) { return p.x * p.y; }, 0.25 },
+        { "Disk", [](const glm::vec2 p) { return glm::dot(p, p) < 1.0f ? 1.0f : 0.0f; }, pi / 4.0 },
+        { "Exp", [](const glm::vec2 p) { return std::exp(p.x + p.y); }, sqr(std::exp(1.0) - 1.0) },
+    };
+    constexpr double tolerance = 5e-3;
+
+    std::vector<double> sums(std::size(integrands) * testPairs);
+    for(uint32_t y = 0; y < testResolution; ++y)
+        for(uint32_t x = 0; x < testResolution; ++x) {
+            const auto samples = collectPixelSamples(tileSampler, x, y, sampleCount);
+            for(uint32_t pair = 0; pair < testPairs; ++pair)
+                for(size_t k = 0; k < std::size(integrands); ++k)
+                    for(const auto p : samples[pair])
+                        sums[pair * std::size(integrands) + k] += integrands[k].f(p);
+        }
+
+    const auto total = static_cast<double>(sampleCount) * testResolution * testResolution;
+    for(uint32_t pair = 0; pair < testPairs; ++pair)
+        for(size_t k = 0; k < std::size(integrands); ++k) {
+            const auto estimated = sums[pair * std::size(integrands) + k] / total;
+            ASSERT_NEAR(estimated, integrands[k].expected, tolerance)
+                << " name " << name << " integrand " << integrands[k].name << " pair " << pair;
+        }
+}
+
+// NOTICE: each pixel set is a (0,m,2)-net rotated on the torus, so an aligned cell overlaps at most 4 rotated cells
+static void testPMJ02Stratification(const std::string_view config) {
+    constexpr uint32_t logSampleCount = 8;
+    const auto tileSampler = prepareTestSampler(config);
+    MemoryArena arena;
+
+    for(const auto [x, y] : { std::pair{ 0U, 0U }, std::pair{ 17U, 5U }, std::pair{ 63U, 63U }, std::pair{ 31U, 48U } }) {
+        const auto samples = collectPixelSamples(*tileSampler, x, y, 1U << logSampleCount);
+        for(uint32_t pair = 0; pair < testPairs; ++pair) {
+            // the progressive prefixes of the power of 2 lengths are stratified as well
+            for(uint32_t logCount = 1; logCount <= logSampleCount; ++logCount) {
+                const auto count = 1U << logCount;
+                const std::vector prefix(samples[pair].begin(), samples[pair].begin() + count);
+                ASSERT_LE(maxPointsPerElementaryInterval(prefix, logCount), 4U)
+                    << " config " << config << " pixel " << x << "," << y << " pair " << pair << " prefix " << count;
+                for(int32_t axis = 0; axis < 2; ++axis)
+                    ASSERT_LT(maxCircularGap(prefix, axis), 2.0f / static_cast<Float>(count) + 1e-5f)
+                        << " config " << config << " pixel " << x << "," << y << " pair " << pair << " prefix " << count;
+            }
+        }
+    }
+}
+
+TEST(Sampler, PMJ02Stratification) {
+    testPMJ02Stratification(R"({ "Type": "PMJ02Sampler", "SampleCount": 256, "BlueNoise": false })");
+    testPMJ02Stratification(R"({ "Type": "PMJ02Sampler", "SampleCount": 256, "BlueNoise": true })");
+}
+
+TEST(Sampler, PMJ02Unbiased) {
+    MemoryArena arena;
+    testUnbiased("PMJ02WhiteNoise", *prepareTestSampler(R"({ "Type": "PMJ02Sampler", "SampleCount": 16, "BlueNoise": false })"), 16);
+    testUnbiased("PMJ02BlueNoise", *prepareTestSampler(R"({ "Type": "PMJ02Sampler", "SampleCount": 16, "BlueNoise": true })"), 16);
+}
+
+// NOTICE: the samples of a pixel are an aligned block of the Owen scrambled Sobol indices, which is an exact (0,m,2)-net.
+// The base-4 digits are shuffled, so only the prefixes of 2^(m mod 2) * 4^k samples are aligned blocks as well
+static void testZSobolStratification(const uint32_t logSampleCount) {
+    const auto tileSampler =
+        prepareTestSampler(fmt::format(R"({{ "Type": "ZSobolSampler", "SampleCount": {} }})", 1U << logSampleCount));
+    MemoryArena arena;
+
+    for(const auto [x, y] : { std::pair{ 0U, 0U }, std::pair{ 17U, 5U }, std::pair{ 63U, 63U }, std::pair{ 31U, 48U } }) {
+        const auto samples = collectPixelSamples(*tileSampler, x, y, 1U << logSampleCount);
+        for(uint32_t pair = 0; pair < testPairs; ++pair) {
+            for(auto logCount = logSampleCount & 1; logCount <= logSampleCount; logCount += 2) {
+                const auto count = 1U << logCount;
+                const std::vector prefix(samples[pair].begin(), samples[pair].begin() + count);
+                ASSERT_LE(maxPointsPerElementaryInterval(prefix, logCount), 1U)
+                    << " sample count " << (1U << logSampleCount) << " pixel " << x << "," << y << " pair " << pair << " prefix " << count;
+            }
+        }
+    }
+}
+
+TEST(Sampler, ZSobolStratification) {
+    testZSobolStratification(4);
+    testZSobolStratification(7);
+    testZSobolStratification(8);
+}
+
+TEST(Sampler, ZSobolUnbiased) {
+    MemoryArena arena;
+    testUnbiased("ZSobol16", *prepareTestSampler(R"({ "Type": "ZSobolSampler", "SampleCount": 16 })"), 16);
+    testUnbiased("ZSobol8", *prepareTestSampler(R"({ "Type": "ZSobolSampler", "SampleCount": 8 })"), 8);
+}
+
+PIPER_NAMESPACE_END
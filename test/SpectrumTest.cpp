@@ -61,6 +61,35 @@ TEST(Spectrum, SamplingVisibleWavelength) {
     EXPECT_NEAR(integral, integralOfY, integralOfY * 5e-3);
 }
 
+// the B batches of N hero wavelengths must be distinct and evenly spaced by 1/(B*N) in the sample space
+TEST(Spectrum, WavelengthBatchStratification) {
+    constexpr uint32_t heroCount = SampledSpectrum::nSamples;
+    // the inverse of the sampling CDF of sampleWavelength
+    const auto toSample = [](const Float lambda) {
+        return (0.8569106254698279 - std::tanh((538.0 - static_cast<double>(lambda)) / 138.88888888888889)) / 1.8275019724092267;
+    };
+
+    for(const uint32_t batchCount : { 2U, 3U, 4U, 8U }) {
+        const auto spacing = 1.0 / static_cast<double>(batchCount * heroCount);
+        for(uint32_t k = 0; k < 64; ++k) {
+            const auto u = getTestSampler().sample();
+            std::vector<double> samples;
+            for(uint32_t batch = 0; batch < batchCount; ++batch) {
+                const auto [lambda, weight] =
+                    sampleWavelength<SampledSpectrum, SampledSpectrum>(wavelengthBatchSample(u, batch, batchCount, heroCount));
+                for(int32_t idx = 0; idx < static_cast<int32_t>(heroCount); ++idx)
+                    samples.push_back(toSample(lambda.raw()[idx]));
+            }
+
+            std::ranges::sort(samples);
+            for(size_t idx = 0; idx < samples.size(); ++idx) {
+                const auto gap = idx + 1 < samples.size() ? samples[idx + 1] - samples[idx] : samples.front() + 1.0 - samples.back();
+                ASSERT_NEAR(gap, spacing, 1e-4) << " batches " << batchCount << " u " << u << " index " << idx;
+            }
+        }
+    }
+}
+
 TEST(Spectrum, Wavelength2XYZ) {
     constexpr uint32_t samples = 1 << 20;
 
@@ -0,0 +1,61 @@
+/*
+    SPDX-License-Identifier: GPL-3.0-or-later
+
+    This file is part of Piper0, a physically based renderer.
+    Copyright (C) 2022 Yingwei Zheng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <Piper/Core/StaticFactory.hpp>
+#include <Piper/Render/TestUtil.hpp>
+#include <Piper/Render/Texture.hpp>
+
+PIPER_NAMESPACE_BEGIN
+
+static Float evalAt(const ScalarTexture2D& texture, const TexCoord texCoord) {
+    return texture.evaluate(TextureEvaluateInfo{ texCoord, 0.0f, 0 });
+}
+
+// the shapes pass the unwrapped texture coordinates, the pattern must repeat per texture unit as it did with wrapped ones
+TEST(Texture, CheckerBoardUnwrappedCoords) {
+    const auto texture = getScalarTexture2D(parseJSONConfigNodeFromStr(R"(
+{
+    "Checker": {
+        "Type": "CheckerBoard",
+        "Size": [ 0.3, 0.3 ],
+        "White": 1.0,
+        "Black": 0.0
+    }
+}
+)",
+                                                                       {}),
+                                            "Checker"sv, ""sv, 0.0f);
+
+    constexpr TexCoord probes[] = { { 0.1f, 0.1f }, { 0.4f, 0.1f }, { 0.1f, 0.7f }, { 0.8f, 0.95f }, { 0.05f, 0.5f } };
+    constexpr TexCoord offsets[] = { { 1.0f, 0.0f }, { 0.0f, 3.0f }, { -1.0f, 0.0f }, { -2.0f, -5.0f }, { 17.0f, -9.0f } };
+
+    for(const auto probe : probes) {
+        const auto base = evalAt(*texture, probe);
+        for(const auto offset : offsets)
+            ASSERT_EQ(base, evalAt(*texture, probe + offset)) << " probe " << probe.x << "," << probe.y << " offset " << offset.x << ","
+                                                             << offset.y;
+    }
+
+    // the cells keep alternating inside a texture unit
+    ASSERT_NE(evalAt(*texture, { 0.1f, 0.1f }), evalAt(*texture, { 0.4f, 0.1f }));
+    ASSERT_NE(evalAt(*texture, { -0.9f, 0.1f }), evalAt(*texture, { -0.6f, 0.1f }));
+}
+
+PIPER_NAMESPACE_END